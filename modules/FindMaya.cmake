@@ -74,3 +74,16 @@ function(MAYA_PLUGIN _target)
     SUFFIX ${MAYA_PLUGIN_EXTENSION}
   )
 endfunction()
+
+function(MAYA_APPLICATION _target)
+  # Standalone Maya applications are built with NT_APP instead of NT_PLUGIN.
+  set(_definitions ${MAYA_COMPILE_DEFINITIONS})
+  if (WIN32)
+    list(REMOVE_ITEM _definitions NT_PLUGIN)
+    list(APPEND _definitions NT_APP)
+  endif()
+
+  set_target_properties(${_target} PROPERTIES
+    COMPILE_DEFINITIONS "${_definitions}"
+  )
+endfunction()
@@ -1,174 +1,610 @@
 #include "externals.h"
 
 #include "AccessorPacker.h"
+#include "GLTFObjectPool.h"
+#include "IndentableStream.h"
+#include "InterleavedAttributes.h"
+#include "MeshoptCompression.h"
+#include "Profiler.h"
+#include "ProgressiveLayout.h"
 
 #include "accessors.h"
 
 using GLTF::Constants::WebGL;
 
-GLTF::BufferView *AccessorPacker::packAccessorsForTargetByteStride(
-    const std::vector<GLTF::Accessor *> &accessors, WebGL target) {
-    std::map<GLTF::Accessor *, int> byteOffsets;
+// The maximum byteStride of a glTF buffer view.
+const int maxByteStride = 252;
+
+static int paddedByteStride(GLTF::Accessor *accessor) {
+    // The stride of vertex attributes must be a multiple of 4 bytes,
+    // which matters for the 8 and 16 bit component types.
+    return (accessor->getByteStride() + 3) & ~3;
+}
+
+/** The bytes of the elements, empty when these are not tightly packed */
+static gsl::span<const byte> elementBytes(GLTF::Accessor *accessor) {
+    const auto elementByteLength = accessor->getNumberOfComponents() *
+                                   accessor->getComponentByteLength();
+
+    const auto sourceView = accessor->bufferView;
+    if (sourceView->byteStride > 0 && sourceView->byteStride != elementByteLength)
+        return {};
+
+    const auto source =
+        sourceView->buffer->data + sourceView->byteOffset + accessor->byteOffset;
+    return {source, static_cast<std::ptrdiff_t>(elementByteLength) * accessor->count};
+}
+
+// Streamed views that need a copy are written in chunks of this size.
+const size_t streamChunkByteLength = 1 << 20;
+
+AccessorPacker::ElementSource
+AccessorPacker::elementSource(GLTF::Accessor *accessor) {
+    ElementSource source;
+    source.elementByteLength = accessor->getNumberOfComponents() *
+                               accessor->getComponentByteLength();
+    source.count = accessor->count;
+
+    const auto sourceView = accessor->bufferView;
+    source.byteStride = sourceView->byteStride > 0 ? sourceView->byteStride
+                                                   : source.elementByteLength;
+    source.data =
+        sourceView->buffer->data + sourceView->byteOffset + accessor->byteOffset;
+    return source;
+}
+
+void AccessorPacker::layoutView(ViewLayout &layout) {
     int byteLength = 0;
-    for (GLTF::Accessor *accessor : accessors) {
+
+    // The accessors are moved to the packed buffer view, so remember where
+    // their elements come from.
+    layout.sources.reserve(layout.accessors.size());
+    for (GLTF::Accessor *accessor : layout.accessors) {
+        layout.sources.push_back(elementSource(accessor));
+    }
+
+    if (layout.isInterleaved) {
+        // The stride is set by the caller, each element starts at a
+        // multiple of 4 bytes within the vertex.
+        for (GLTF::Accessor *accessor : layout.accessors) {
+            layout.accessorOffsets.push_back(byteLength);
+            byteLength += paddedByteStride(accessor);
+        }
+        assert(byteLength == layout.byteStride);
+        layout.byteLength = layout.byteStride * layout.accessors.front()->count;
+        return;
+    }
+
+    layout.accessorOffsets.reserve(layout.accessors.size());
+    for (GLTF::Accessor *accessor : layout.accessors) {
         const auto componentByteLength = accessor->getComponentByteLength();
         const auto padding = byteLength % componentByteLength;
         if (padding != 0) {
             byteLength += (componentByteLength - padding);
         }
-        byteOffsets[accessor] = byteLength;
-        byteLength += componentByteLength * accessor->getNumberOfComponents() *
-                      accessor->count;
+        layout.accessorOffsets.push_back(byteLength);
+        byteLength += layout.byteStride * accessor->count;
     }
+    layout.byteLength = byteLength;
+}
 
-    auto bufferData = new byte[byteLength];
-    m_data.emplace_back(bufferData);
+// The bounds are computed on chunks of this many copied elements.
+const int boundsChunkCount = 4096;
 
-    const auto bufferView =
-        new GLTF::BufferView(bufferData, byteLength, target);
-    m_views.emplace_back(bufferView);
+void AccessorPacker::copyView(const ViewLayout &layout, byte *target) {
+    for (size_t i = 0; i < layout.sources.size(); ++i) {
+        const auto &source = layout.sources[i];
+        const auto accessor = layout.accessors[i];
+        const auto accessorTarget = target + layout.accessorOffsets[i];
 
-    for (GLTF::Accessor *accessor : accessors) {
-        const auto byteOffset = byteOffsets[accessor];
-        GLTF::Accessor packedAccessor(accessor->type, accessor->componentType,
-                                      byteOffset, accessor->count, bufferView);
+        if (!accessor->min) {
+            kernels::copyElements(source, accessorTarget, layout.byteStride, 0,
+                                  source.count);
+            continue;
+        }
 
-        const size_t numberOfComponents = accessor->getNumberOfComponents();
+        // The bounds are widened by each chunk right after it is copied, so
+        // the elements are only read from memory once.
+        for (auto first = 0; first < source.count; first += boundsChunkCount) {
+            const auto n = std::min(boundsChunkCount, source.count - first);
+            const auto chunkTarget =
+                accessorTarget + size_t(first) * layout.byteStride;
+            kernels::copyElements(source, chunkTarget, layout.byteStride, first,
+                                  n);
+            widenBounds(accessor, chunkTarget, layout.byteStride, n);
+        }
+    }
+}
 
-        const auto components =
-            static_cast<float *>(alloca(sizeof(float) * numberOfComponents));
+void AccessorPacker::writeView(const ViewLayout &layout, const ByteSink &sink) {
+    if (layout.isInterleaved) {
+        // Interleave a chunk of vertices at a time.
+        const auto count = layout.sources.front().count;
+        const auto chunkCount = std::max(
+            1, static_cast<int>(streamChunkByteLength / layout.byteStride));
+        std::vector<byte> chunk(size_t(chunkCount) * layout.byteStride);
 
-        for (auto i = 0; i < accessor->count; i++) {
-            accessor->getComponentAtIndex(i, components);
-            packedAccessor.writeComponentAtIndex(i, components);
+        for (auto first = 0; first < count; first += chunkCount) {
+            const auto n = std::min(chunkCount, count - first);
+            for (size_t i = 0; i < layout.sources.size(); ++i) {
+                kernels::copyElements(layout.sources[i],
+                                      chunk.data() + layout.accessorOffsets[i],
+                                      layout.byteStride, first, n);
+            }
+            sink(chunk.data(), size_t(n) * layout.byteStride);
         }
+        return;
+    }
 
-        accessor->byteOffset = packedAccessor.byteOffset;
-        accessor->bufferView = packedAccessor.bufferView;
+    static const byte padding[4] = {};
+
+    int byteOffset = 0;
+    for (size_t i = 0; i < layout.sources.size(); ++i) {
+        const auto &source = layout.sources[i];
+
+        sink(padding, layout.accessorOffsets[i] - byteOffset);
+
+        if (source.byteStride == source.elementByteLength &&
+            layout.byteStride == source.elementByteLength) {
+            // Straight from the source memory.
+            sink(source.data, size_t(source.elementByteLength) * source.count);
+        } else {
+            const auto chunkCount = std::max(
+                1, static_cast<int>(streamChunkByteLength / layout.byteStride));
+            std::vector<byte> chunk(size_t(chunkCount) * layout.byteStride);
+
+            for (auto first = 0; first < source.count; first += chunkCount) {
+                const auto n = std::min(chunkCount, source.count - first);
+                kernels::copyElements(source, chunk.data(), layout.byteStride,
+                                      first, n);
+                sink(chunk.data(), size_t(n) * layout.byteStride);
+            }
+        }
+
+        byteOffset = layout.accessorOffsets[i] + layout.byteStride * source.count;
     }
-    return bufferView;
 }
 
 GLTF::Buffer *
 AccessorPacker::packAccessors(const std::vector<GLTF::Accessor *> &accessors,
                               const std::string &bufferName,
                               size_t additionalBufferSize) {
-    std::map<WebGL, std::map<int, std::vector<GLTF::Accessor *>>>
+    ProfileScope profileScope("Accessor packing");
+
+    // Accessors are grouped per tier, target, byte stride and compression
+    // stream kind, each group gets its own buffer view.
+    typedef std::pair<int, int> StrideKind;
+    typedef std::pair<int, WebGL> PriorityTarget;
+
+    std::map<PriorityTarget, std::map<StrideKind, std::vector<GLTF::Accessor *>>>
         accessorGroups;
-    accessorGroups[WebGL::ARRAY_BUFFER] =
-        std::map<int, std::vector<GLTF::Accessor *>>();
-    accessorGroups[WebGL::ELEMENT_ARRAY_BUFFER] =
-        std::map<int, std::vector<GLTF::Accessor *>>();
-    accessorGroups[WebGL(-1)] = std::map<int, std::vector<GLTF::Accessor *>>();
 
-    auto byteLength = 0;
+    const auto priorityOf = [&](const GLTF::Accessor *accessor) {
+        return m_progressiveLayout ? m_progressiveLayout->priority(accessor) : 0;
+    };
+
+    // The interleaved groups, per group index to keep the order of creation.
+    std::map<int, std::vector<GLTF::Accessor *>> interleavedGroups;
+
+    const auto addToGroup = [&](GLTF::Accessor *accessor) {
+        WebGL target = accessor->bufferView->target;
+        const auto byteStride = target == WebGL::ARRAY_BUFFER
+                                    ? paddedByteStride(accessor)
+                                    : accessor->getByteStride();
+
+        const StrideKind strideKind(
+            byteStride, m_compression ? m_compression->streamKind(accessor) : 0);
+
+        accessorGroups[PriorityTarget(priorityOf(accessor), target)][strideKind]
+            .push_back(accessor);
+    };
+
+    // Accessors with the same data as an accessor before them share its
+    // location. The hash only finds the candidates, the bytes must match.
+    std::map<uint64_t, std::vector<GLTF::Accessor *>> accessorsPerHash;
+    std::vector<std::pair<GLTF::Accessor *, GLTF::Accessor *>> aliases;
+    size_t aliasedByteLength = 0;
+
+    const auto isAlias = [&](GLTF::Accessor *accessor) {
+        const auto bytes = elementBytes(accessor);
+        if (bytes.empty())
+            return false;
+
+        const auto target = accessor->bufferView->target;
+        const auto streamKind =
+            m_compression ? m_compression->streamKind(accessor) : 0;
+
+        auto hash = fasthash::hashBytes(bytes.data(), bytes.size());
+        hash = fasthash::hashWords(hash, static_cast<uint64_t>(target));
+        hash = fasthash::hashWords(hash, static_cast<uint64_t>(streamKind));
+
+        auto &candidates = accessorsPerHash[hash];
+        for (GLTF::Accessor *candidate : candidates) {
+            if (candidate->type != accessor->type ||
+                candidate->componentType != accessor->componentType ||
+                candidate->count != accessor->count ||
+                candidate->bufferView->target != target ||
+                (m_compression &&
+                 m_compression->streamKind(candidate) != streamKind))
+                continue;
+
+            const auto candidateBytes = elementBytes(candidate);
+            if (std::memcmp(candidateBytes.data(), bytes.data(), bytes.size()) != 0)
+                continue;
+
+            aliases.emplace_back(accessor, candidate);
+            aliasedByteLength += bytes.size();
+            return true;
+        }
+
+        candidates.push_back(accessor);
+        return false;
+    };
+
+    std::set<GLTF::Accessor *> visitedAccessors;
+
     for (GLTF::Accessor *accessor : accessors) {
         // In glTF 2.0, bufferView is not required in accessor.
         if (accessor->bufferView == nullptr) {
             continue;
         }
 
-        WebGL target = accessor->bufferView->target;
-        auto targetGroup = accessorGroups[target];
-        auto byteStride = accessor->getByteStride();
-        auto findByteStrideGroup = targetGroup.find(byteStride);
-
-        std::vector<GLTF::Accessor *> byteStrideGroup =
-            findByteStrideGroup == targetGroup.end()
-                ? std::vector<GLTF::Accessor *>()
-                : findByteStrideGroup->second;
-
-        byteStrideGroup.push_back(accessor);
-        targetGroup[byteStride] = byteStrideGroup;
-        accessorGroups[target] = targetGroup;
-        byteLength += accessor->bufferView->byteLength;
-    }
-
-#if 0
-    // Go through primitives and look for primitives that use Draco extension.
-        // If extension is not enabled, the vector will be empty.
-    std::vector<GLTF::BufferView*> compressedBufferViews = asset->getAllCompressedBufferView();
-    // Reserve data for compressed data.
-    for (GLTF::BufferView* compressedBufferView : compressedBufferViews) {
-        byteLength += compressedBufferView->byteLength;
-    }
-#endif
-
-    std::vector<int> byteStrides;
-    std::map<int, std::vector<GLTF::BufferView *>> bufferViews;
-    for (auto targetGroup : accessorGroups) {
-        for (auto byteStrideGroup : targetGroup.second) {
-            const WebGL target = targetGroup.first;
-            int byteStride = byteStrideGroup.first;
-
-            GLTF::BufferView *bufferView = packAccessorsForTargetByteStride(
-                byteStrideGroup.second, target);
-
-            if (!bufferName.empty()) {
-                bufferView->name = bufferName + "/" +
-                                   glAccessorTargetPurpose(target) + "-" +
-                                   std::to_string(byteStride);
+        if (m_allBounds) {
+            requireBounds(accessor);
+        }
+
+        const auto groupIndex =
+            m_interleavedAttributes && accessor->bufferView->target ==
+                                           WebGL::ARRAY_BUFFER
+                ? m_interleavedAttributes->groupIndex(accessor)
+                : -1;
+
+        if (groupIndex >= 0) {
+            interleavedGroups[groupIndex].push_back(accessor);
+        } else if (!m_deduplicate) {
+            addToGroup(accessor);
+        } else if (visitedAccessors.insert(accessor).second &&
+                   !isAlias(accessor)) {
+            addToGroup(accessor);
+        }
+    }
+
+    std::vector<ViewLayout> layouts;
+
+    for (auto &&pair : interleavedGroups) {
+        auto &group = pair.second;
+
+        // Some accessors of the group can be replaced, e.g. by sparse or
+        // Draco data. The others are only interleaved when it still pays
+        // off and fits.
+        int byteStride = 0;
+        for (GLTF::Accessor *accessor : group) {
+            byteStride += paddedByteStride(accessor);
+        }
+
+        if (group.size() < 2 || byteStride > maxByteStride) {
+            for (GLTF::Accessor *accessor : group) {
+                addToGroup(accessor);
             }
+            continue;
+        }
+
+        ViewLayout layout;
+        layout.target = WebGL::ARRAY_BUFFER;
+        layout.priority = priorityOf(group.front());
+        layout.byteStride = byteStride;
+        layout.isInterleaved = true;
+        layout.accessors = std::move(group);
+        layoutView(layout);
+        layouts.emplace_back(std::move(layout));
+    }
+
+    // Compute the layout of all buffer views up front, so every accessor is
+    // copied once, straight to its location in the packed buffer.
+    for (auto &&targetGroup : accessorGroups) {
+        for (auto &&byteStrideGroup : targetGroup.second) {
+            ViewLayout layout;
+            layout.priority = targetGroup.first.first;
+            layout.target = targetGroup.first.second;
+            layout.byteStride = byteStrideGroup.first.first;
+            layout.streamKind = byteStrideGroup.first.second;
+            layout.accessors = std::move(byteStrideGroup.second);
+            layoutView(layout);
+            layouts.emplace_back(std::move(layout));
+        }
+    }
 
-            if (target == WebGL::ARRAY_BUFFER) {
-                bufferView->byteStride = byteStride;
+    if (m_compression) {
+        // The compressed size is only known after compressing, so these
+        // views are staged.
+        for (auto &&layout : layouts) {
+            auto stagedData = m_pool.allocateBytes(layout.byteLength);
+            m_heldMemory.add(layout.byteLength);
+            copyView(layout, stagedData);
+
+            layout.bufferView = m_pool.createBufferView(
+                stagedData, layout.byteLength, layout.target);
+
+            layout.compressedView = m_compression->compress(
+                layout.bufferView, layout.target, layout.byteStride,
+                layout.streamKind);
+        }
+    }
+
+    // Pack these into a buffer sorted from largest byteStride to smallest,
+    // per tier of the progressive layout.
+    std::stable_sort(layouts.begin(), layouts.end(),
+                     [](const ViewLayout &a, const ViewLayout &b) {
+                         if (a.priority != b.priority)
+                             return a.priority < b.priority;
+                         return a.byteStride > b.byteStride;
+                     });
+
+    const auto isFallbackWritten =
+        m_compression && m_compression->isFallbackWritten();
+
+    // A progressive layout keeps the compressed data and the additional data
+    // with their tier, so each tier is a single range.
+    const auto isProgressive = m_progressiveLayout != nullptr;
+    const auto additionalPriority =
+        isProgressive ? m_progressiveLayout->additionalPriority()
+                      : std::numeric_limits<int>::max();
+
+    struct PlacedRange {
+        int priority;
+        int byteOffset;
+        int byteLength;
+    };
+    std::vector<PlacedRange> placedRanges;
+
+    int byteLength = 0;
+    int fallbackByteOffset = 0;
+    int additionalByteOffset = -1;
+    std::vector<int> compressedByteOffsets(layouts.size(), -1);
+
+    const auto addAdditionalData = [&]() {
+        additionalByteOffset = byteLength;
+        byteLength += static_cast<int>(additionalBufferSize);
+        placedRanges.push_back({additionalPriority, additionalByteOffset,
+                                static_cast<int>(additionalBufferSize)});
+    };
+
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        auto &layout = layouts[i];
+
+        if (isProgressive) {
+            if (additionalByteOffset < 0 &&
+                layout.priority > additionalPriority) {
+                addAdditionalData();
             }
-            auto findBufferViews = bufferViews.find(byteStride);
-            std::vector<GLTF::BufferView *> bufferViewGroup;
-            if (findBufferViews == bufferViews.end()) {
-                byteStrides.push_back(byteStride);
-                bufferViewGroup = std::vector<GLTF::BufferView *>();
+
+            // The views of a tier don't follow the alignment of the sort
+            // order of the byte strides.
+            byteLength = (byteLength + 3) & ~3;
+        }
+
+        if (layout.compressedView && !isFallbackWritten) {
+            // Only described by the fallback buffer.
+            layout.compressedView->fallbackByteOffset = fallbackByteOffset;
+            fallbackByteOffset += (layout.byteLength + 3) & ~3;
+        } else {
+            layout.byteOffset = byteLength;
+            byteLength += layout.byteLength;
+            placedRanges.push_back(
+                {layout.priority, layout.byteOffset, layout.byteLength});
+        }
+
+        if (isProgressive && layout.compressedView) {
+            byteLength = (byteLength + 3) & ~3;
+            compressedByteOffsets[i] = byteLength;
+            const auto compressedByteLength =
+                static_cast<int>(layout.compressedView->data.size());
+            byteLength += compressedByteLength;
+            placedRanges.push_back(
+                {layout.priority, compressedByteOffsets[i], compressedByteLength});
+        }
+    }
+
+    // The compressed data is appended, aligned to 4 bytes, before the
+    // additional data.
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        if (const auto compressedView = layouts[i].compressedView) {
+            if (compressedByteOffsets[i] >= 0)
+                continue;
+
+            byteLength = (byteLength + 3) & ~3;
+            compressedByteOffsets[i] = byteLength;
+            byteLength += static_cast<int>(compressedView->data.size());
+        }
+    }
+
+    if (additionalByteOffset < 0) {
+        addAdditionalData();
+    }
+
+    if (byteLength == 0)
+        return nullptr;
+
+    // A streamed buffer has no data, it is written from the sources.
+    byte *bufferData = nullptr;
+    if (!m_isStreamed) {
+        bufferData = m_pool.allocateBytes(byteLength);
+        m_heldMemory.add(byteLength);
+    }
+
+    auto buffer = m_pool.createBuffer(bufferData, byteLength);
+    m_buffers.emplace_back(buffer);
+    buffer->name = bufferName;
+
+    m_additionalByteOffsets[buffer] = additionalByteOffset;
+
+    if (isProgressive) {
+        for (auto &&range : placedRanges) {
+            m_progressiveLayout->addRange(buffer, range.priority,
+                                          range.byteOffset, range.byteLength);
+        }
+    }
+
+    auto &streamedRegions = m_streamedRegions[buffer];
+
+    const auto place = [&](const int byteOffset, const byte *data,
+                           const int dataByteLength) {
+        if (bufferData) {
+            std::memcpy(&bufferData[byteOffset], data, dataByteLength);
+        } else {
+            streamedRegions.push_back({byteOffset, data, dataByteLength, nullptr});
+        }
+    };
+
+    for (size_t i = 0; i < layouts.size(); ++i) {
+        auto &layout = layouts[i];
+
+        if (layout.byteOffset >= 0) {
+            if (layout.bufferView) {
+                place(layout.byteOffset, layout.bufferView->buffer->data,
+                      layout.byteLength);
+                layout.bufferView->buffer = buffer;
+                layout.bufferView->byteOffset = layout.byteOffset;
             } else {
-                bufferViewGroup = findBufferViews->second;
+                if (bufferData) {
+                    copyView(layout, &bufferData[layout.byteOffset]);
+                } else {
+                    // The view is only assembled when written, but the
+                    // bounds must be known before the JSON is.
+                    for (size_t j = 0; j < layout.accessors.size(); ++j) {
+                        const auto &source = layout.sources[j];
+                        widenBounds(layout.accessors[j], source.data,
+                                    source.byteStride, source.count);
+                    }
+
+                    m_streamedLayouts.emplace_back(
+                        std::make_unique<ViewLayout>(layout));
+                    streamedRegions.push_back(
+                        {layout.byteOffset, nullptr, layout.byteLength,
+                         m_streamedLayouts.back().get()});
+                }
+                layout.bufferView = m_pool.createBufferView(
+                    layout.byteOffset, layout.byteLength, buffer);
+                layout.bufferView->target = layout.target;
             }
-            bufferViewGroup.push_back(bufferView);
-            bufferViews[byteStride] = bufferViewGroup;
         }
-    }
-    std::sort(byteStrides.begin(), byteStrides.end(), std::greater<>());
 
-    byteLength += additionalBufferSize;
+        auto *bufferView = layout.bufferView;
+
+        if (!bufferName.empty()) {
+            bufferView->name = bufferName + "/" +
+                               glAccessorTargetPurpose(layout.target) + "-" +
+                               std::to_string(layout.byteStride) +
+                               (layout.isInterleaved ? "-interleaved" : "");
+        }
+
+        // Vertex attributes are written with the padded stride.
+        if (layout.target == WebGL::ARRAY_BUFFER) {
+            bufferView->byteStride = layout.byteStride;
+        }
 
-    GLTF::Buffer *buffer = nullptr;
+        for (size_t j = 0; j < layout.accessors.size(); ++j) {
+            layout.accessors[j]->bufferView = bufferView;
+            layout.accessors[j]->byteOffset = layout.accessorOffsets[j];
+        }
 
-    if (byteLength > 0) {
-        // Pack these into a buffer sorted from largest byteStride to smallest
-        auto bufferData = new byte[byteLength];
-        m_data.emplace_back(bufferData);
+        if (auto compressedView = layout.compressedView) {
+            const auto compressedByteOffset = compressedByteOffsets[i];
+            const auto compressedByteLength =
+                static_cast<int>(compressedView->data.size());
+            place(compressedByteOffset, compressedView->data.data(),
+                  compressedByteLength);
 
-        buffer = new GLTF::Buffer(bufferData, byteLength);
-        m_buffers.emplace_back(buffer);
-        buffer->name = bufferName;
+            if (isFallbackWritten) {
+                m_compression->setPackedLocation(compressedView, buffer,
+                                                 compressedByteOffset,
+                                                 layout.byteOffset);
+            } else {
+                m_compression->setPackedLocation(
+                    compressedView, buffer, compressedByteOffset,
+                    compressedView->fallbackByteOffset);
 
-        int byteOffset = 0;
-        for (int byteStride : byteStrides) {
-            for (GLTF::BufferView *bufferView : bufferViews[byteStride]) {
-                std::memcpy(&bufferData[byteOffset], bufferView->buffer->data,
-                            bufferView->byteLength);
-                bufferView->byteOffset = byteOffset;
+                // The glTF writer needs a location in the buffer, patchJSON
+                // replaces it by the fallback location.
                 bufferView->buffer = buffer;
-                byteOffset += bufferView->byteLength;
+                bufferView->byteOffset = compressedByteOffset;
+                bufferView->byteLength = compressedByteLength;
             }
         }
+    }
 
-#if 0
-        // Append compressed data to buffer.
-        for (GLTF::BufferView* compressedBufferView : compressedBufferViews) {
-            std::memcpy(bufferData + byteOffset, compressedBufferView->buffer->data, compressedBufferView->byteLength);
-            compressedBufferView->byteOffset = byteOffset;
-            compressedBufferView->buffer = buffer;
-            byteOffset += compressedBufferView->byteLength;
-        }
-#endif
+    for (auto &&alias : aliases) {
+        computeBounds(alias.first);
+        alias.first->bufferView = alias.second->bufferView;
+        alias.first->byteOffset = alias.second->byteOffset;
+    }
+
+    if (!aliases.empty()) {
+        cout << prefix << "Buffer '" << bufferName << "': " << aliases.size()
+             << " accessors share the data of identical accessors, saving "
+             << aliasedByteLength << " bytes" << endl;
+    }
+
+    if (streamedRegions.empty()) {
+        m_streamedRegions.erase(buffer);
     }
 
     return buffer;
 }
 
-std::vector<GLTF::Buffer *> AccessorPacker::getPackedBuffers() const {
-    std::vector<GLTF::Buffer *> buffers;
-    for (auto &&buffer : m_buffers) {
-        buffers.emplace_back(buffer.get());
+void AccessorPacker::addStreamedData(const GLTF::Buffer *buffer,
+                                     const int byteOffset, const byte *data,
+                                     const int byteLength) {
+    if (buffer->data) {
+        std::memcpy(buffer->data + byteOffset, data, byteLength);
+    } else {
+        m_streamedRegions[buffer].push_back(
+            {byteOffset, data, byteLength, nullptr});
+    }
+}
+
+void AccessorPacker::writeBuffer(const GLTF::Buffer *buffer,
+                                 const ByteSink &sink) const {
+    const auto it = m_streamedRegions.find(buffer);
+    if (it == m_streamedRegions.end()) {
+        if (buffer->data && buffer->byteLength) {
+            sink(buffer->data, buffer->byteLength);
+        }
+        return;
     }
-    return move(buffers);
+
+    auto regions = it->second;
+    std::stable_sort(regions.begin(), regions.end(),
+                     [](const StreamedRegion &a, const StreamedRegion &b) {
+                         return a.byteOffset < b.byteOffset;
+                     });
+
+    // The gaps are the alignment padding, zero as in an allocated buffer.
+    const std::vector<byte> zeros(16);
+    const auto pad = [&](size_t byteLength) {
+        while (byteLength > 0) {
+            const auto n = std::min(byteLength, zeros.size());
+            sink(zeros.data(), n);
+            byteLength -= n;
+        }
+    };
+
+    int byteOffset = 0;
+    for (auto &&region : regions) {
+        pad(region.byteOffset - byteOffset);
+
+        if (region.layout) {
+            writeView(*region.layout, sink);
+        } else {
+            sink(region.data, region.byteLength);
+        }
+
+        byteOffset = region.byteOffset + region.byteLength;
+    }
+
+    pad(buffer->byteLength - byteOffset);
+}
+
+std::vector<GLTF::Buffer *> AccessorPacker::getPackedBuffers() const {
+    return m_buffers;
 }
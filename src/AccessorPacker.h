@@ -1,21 +1,120 @@
 #pragma once
 
 #include "BasicTypes.h"
+#include "HeldMemory.h"
+#include "kernels.h"
+
+class GLTFObjectPool;
+class InterleavedAttributes;
+class MeshoptCompression;
+class ProgressiveLayout;
+struct MeshoptView;
 
 class AccessorPacker {
   public:
+    typedef std::function<void(const byte *data, size_t byteLength)> ByteSink;
+
+    /** The buffers, buffer views and packed data are owned by the pool.
+     * When compression is given, the packed buffer views are compressed.
+     * When interleaved attributes are given, each complete group of these is
+     * packed into its own interleaved buffer view. When deduplicating,
+     * accessors with identical data share their location. Streamed buffers
+     * have no data, their bytes are only assembled by writeBuffer. */
+    explicit AccessorPacker(
+        GLTFObjectPool &pool, MeshoptCompression *compression = nullptr,
+        const InterleavedAttributes *interleavedAttributes = nullptr,
+        bool deduplicate = false, bool isStreamed = false)
+        : m_pool(pool), m_compression(compression),
+          m_interleavedAttributes(interleavedAttributes),
+          m_deduplicate(deduplicate), m_isStreamed(isStreamed) {}
+
+    /** With a progressive layout, the buffer views are packed in order of
+     * the tiers of their accessors, and the placed regions are added to the
+     * layout. */
+    void setProgressiveLayout(ProgressiveLayout *layout) {
+        m_progressiveLayout = layout;
+    }
+
+    /** Whether every packed accessor gets a min and max, not only those that
+     * require these, see requireBounds */
+    void setAllBounds(bool allBounds) { m_allBounds = allBounds; }
+
     GLTF::Buffer *packAccessors(const std::vector<GLTF::Accessor *> &accessors,
                                 const std::string &bufferName,
                                 size_t additionalBufferSize = 0);
 
+    /** Where the additional data of the packed buffer goes. That is at the
+     * end, unless a progressive layout places it between the tiers. */
+    int additionalByteOffset(const GLTF::Buffer *buffer) const {
+        return m_additionalByteOffsets.at(buffer);
+    }
+
+    /** Places the data at the offset of the buffer, e.g. the embedded
+     * images. The data of a streamed buffer must stay alive until written. */
+    void addStreamedData(const GLTF::Buffer *buffer, int byteOffset,
+                         const byte *data, int byteLength);
+
+    /** Passes the bytes of the buffer to the sink, in order. Also works for
+     * buffers that were not packed. */
+    void writeBuffer(const GLTF::Buffer *buffer, const ByteSink &sink) const;
+
     std::vector<GLTF::Buffer *> getPackedBuffers() const;
 
   private:
-    std::vector<std::unique_ptr<byte[]>> m_data;
-    std::vector<std::unique_ptr<GLTF::Buffer>> m_buffers;
-    std::vector<std::unique_ptr<GLTF::BufferView>> m_views;
+    GLTFObjectPool &m_pool;
+    MeshoptCompression *m_compression;
+    const InterleavedAttributes *m_interleavedAttributes;
+    const bool m_deduplicate;
+    const bool m_isStreamed;
+    ProgressiveLayout *m_progressiveLayout = nullptr;
+    bool m_allBounds = false;
+
+    HeldMemory m_heldMemory{MemoryKind::PACKED_BUFFERS};
+    std::vector<GLTF::Buffer *> m_buffers;
+    std::map<const GLTF::Buffer *, int> m_additionalByteOffsets;
+
+    typedef kernels::ElementSource ElementSource;
+
+    /** Where the accessors of a buffer view go, computed before copying */
+    struct ViewLayout {
+        GLTF::Constants::WebGL target;
+        int priority = 0;
+        int byteStride = 0;
+        int streamKind = 0;
+        std::vector<GLTF::Accessor *> accessors;
+        std::vector<ElementSource> sources;
+        std::vector<int> accessorOffsets;
+        int byteLength = 0;
+
+        // The elements of a vertex are next to each other.
+        bool isInterleaved = false;
+
+        // The offset in the packed buffer, -1 when the view is not written.
+        int byteOffset = -1;
+
+        // Only created up front for staged views.
+        GLTF::BufferView *bufferView = nullptr;
+        MeshoptView *compressedView = nullptr;
+    };
+
+    /** Data of a streamed buffer, either bytes or the elements of a view */
+    struct StreamedRegion {
+        int byteOffset;
+        const byte *data;
+        int byteLength;
+        const ViewLayout *layout;
+    };
+
+    std::vector<std::unique_ptr<ViewLayout>> m_streamedLayouts;
+    std::map<const GLTF::Buffer *, std::vector<StreamedRegion>>
+        m_streamedRegions;
+
+    static ElementSource elementSource(GLTF::Accessor *accessor);
+
+    static void layoutView(ViewLayout &layout);
+
+    static void copyView(const ViewLayout &layout, byte *target);
 
-    GLTF::BufferView *packAccessorsForTargetByteStride(
-        const std::vector<GLTF::Accessor *> &accessors,
-        GLTF::Constants::WebGL target);
+    /** Writes the view as copyView would, without assembling it */
+    static void writeView(const ViewLayout &layout, const ByteSink &sink);
 };
@@ -0,0 +1,206 @@
+#include "externals.h"
+
+#include "AnimatedBounds.h"
+#include "ExportableNode.h"
+#include "MayaUtils.h"
+#include "accessors.h"
+#include "jsonPatch.h"
+
+// Transforms the box by the affine matrix, in Maya's row vector convention.
+static void transformBox(const MMatrix &matrix, const double center[3], const double halfExtent[3],
+                         double transformedCenter[3], double transformedHalfExtent[3]) {
+    for (int j = 0; j < 3; ++j) {
+        transformedCenter[j] = matrix[3][j];
+        transformedHalfExtent[j] = 0;
+        for (int i = 0; i < 3; ++i) {
+            transformedCenter[j] += center[i] * matrix[i][j];
+            transformedHalfExtent[j] += halfExtent[i] * std::abs(matrix[i][j]);
+        }
+    }
+}
+
+const double maxDouble = std::numeric_limits<double>::max();
+const float maxFloat = std::numeric_limits<float>::max();
+
+namespace {
+struct Box {
+    double min[3] = {maxDouble, maxDouble, maxDouble};
+    double max[3] = {-maxDouble, -maxDouble, -maxDouble};
+
+    bool isEmpty() const { return min[0] > max[0]; }
+
+    void expand(const double center[3], const double halfExtent[3]) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], center[i] - halfExtent[i]);
+            max[i] = std::max(max[i], center[i] + halfExtent[i]);
+        }
+    }
+};
+} // namespace
+
+void computeNodeBounds(const VertexBufferTable &table, const MeshJoints &joints, const bool isSkinned,
+                       std::vector<NodeBounds> &bounds) {
+    std::vector<Box> boxes(isSkinned ? joints.size() : 1);
+
+    for (auto &&pair : table) {
+        const auto &vertexBuffer = pair.second;
+        const auto &componentsMap = vertexBuffer.componentsMap;
+        const auto vertexCount = vertexBuffer.maxIndex();
+
+        const auto positionIt = componentsMap.find(VertexSlot(ShapeIndex::main(), Semantic::POSITION, 0));
+        if (positionIt == componentsMap.end() || vertexCount == 0)
+            continue;
+
+        const auto positions = reinterpret_span<Position>(positionIt->second);
+
+        // The offsets of the vertices with any combination of the targets.
+        std::vector<Position> minOffsets(vertexCount, Position{0, 0, 0});
+        std::vector<Position> maxOffsets(vertexCount, Position{0, 0, 0});
+
+        std::vector<gsl::span<const JointIndices>> jointSets;
+        std::vector<gsl::span<const JointWeights>> weightSets;
+
+        for (auto &&slot : componentsMap) {
+            const auto &vertexSlot = slot.first;
+
+            if (!vertexSlot.shapeIndex.isMainShapeIndex()) {
+                if (vertexSlot.semantic == Semantic::POSITION) {
+                    const auto deltas = reinterpret_span<Position>(slot.second);
+                    for (size_t v = 0; v < vertexCount; ++v) {
+                        for (int i = 0; i < 3; ++i) {
+                            minOffsets[v][i] += std::min(0.0f, deltas[v][i]);
+                            maxOffsets[v][i] += std::max(0.0f, deltas[v][i]);
+                        }
+                    }
+                }
+            } else if (isSkinned && vertexSlot.semantic == Semantic::JOINTS) {
+                const auto weightIt =
+                    componentsMap.find(VertexSlot(ShapeIndex::main(), Semantic::WEIGHTS, vertexSlot.setIndex));
+                if (weightIt != componentsMap.end()) {
+                    jointSets.push_back(reinterpret_span<JointIndices>(slot.second));
+                    weightSets.push_back(reinterpret_span<JointWeights>(weightIt->second));
+                }
+            }
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v) {
+            double center[3];
+            double halfExtent[3];
+            for (int i = 0; i < 3; ++i) {
+                center[i] = positions[v][i] + (minOffsets[v][i] + maxOffsets[v][i]) / 2.0;
+                halfExtent[i] = (maxOffsets[v][i] - minOffsets[v][i]) / 2.0;
+            }
+
+            if (!isSkinned) {
+                boxes[0].expand(center, halfExtent);
+                continue;
+            }
+
+            for (size_t set = 0; set < jointSets.size(); ++set) {
+                for (int influence = 0; influence < 4; ++influence) {
+                    const auto jointIndex = jointSets[set][v][influence];
+                    if (weightSets[set][v][influence] <= 0 || jointIndex >= joints.size())
+                        continue;
+
+                    double jointCenter[3];
+                    double jointHalfExtent[3];
+                    transformBox(joints[jointIndex].inverseBindMatrix, center, halfExtent, jointCenter,
+                                 jointHalfExtent);
+                    boxes[jointIndex].expand(jointCenter, jointHalfExtent);
+                }
+            }
+        }
+    }
+
+    for (size_t index = 0; index < boxes.size(); ++index) {
+        const auto &box = boxes[index];
+        if (box.isEmpty())
+            continue;
+
+        NodeBounds nodeBounds;
+        nodeBounds.node = isSkinned ? joints[index].node : nullptr;
+        for (int i = 0; i < 3; ++i) {
+            const auto center = static_cast<float>((box.min[i] + box.max[i]) / 2);
+            const auto halfExtent = std::max(box.max[i] - center, center - box.min[i]);
+
+            // Rounded up, so the float box still holds the vertices.
+            nodeBounds.center[i] = center;
+            nodeBounds.halfExtent[i] = std::nextafter(static_cast<float>(halfExtent), maxFloat);
+        }
+
+        bounds.push_back(nodeBounds);
+    }
+}
+
+void expandWorldBounds(const std::vector<NodeBounds> &bounds, const ExportableNode &meshNode,
+                       const double scaleFactor, const bool isContextEvaluated, Position &min, Position &max) {
+    for (auto &&nodeBounds : bounds) {
+        const auto &dagPath = (nodeBounds.node ? nodeBounds.node : &meshNode)->dagPath;
+
+        MStatus status;
+        auto worldMatrix = isContextEvaluated ? utils::getWorldMatrix(dagPath) : dagPath.inclusiveMatrix(&status);
+        THROW_ON_FAILURE(status);
+
+        // The glTF translations are scaled, see -scaleFactor.
+        for (int i = 0; i < 3; ++i) {
+            worldMatrix[3][i] *= scaleFactor;
+        }
+
+        const double center[3] = {nodeBounds.center[0], nodeBounds.center[1], nodeBounds.center[2]};
+        const double halfExtent[3] = {nodeBounds.halfExtent[0], nodeBounds.halfExtent[1], nodeBounds.halfExtent[2]};
+
+        double worldCenter[3];
+        double worldHalfExtent[3];
+        transformBox(worldMatrix, center, halfExtent, worldCenter, worldHalfExtent);
+
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], std::nextafter(static_cast<float>(worldCenter[i] - worldHalfExtent[i]), -maxFloat));
+            max[i] = std::max(max[i], std::nextafter(static_cast<float>(worldCenter[i] + worldHalfExtent[i]), maxFloat));
+        }
+    }
+}
+
+AnimatedBounds::AnimatedBounds() = default;
+
+AnimatedBounds::~AnimatedBounds() = default;
+
+void AnimatedBounds::add(const GLTF::Animation *animation, const GLTF::Node *node, const Position &min,
+                         const Position &max) {
+    m_entries.push_back({animation, node, min, max});
+}
+
+void AnimatedBounds::patchJSON(rapidjson::Document &document) const {
+    auto &allocator = document.GetAllocator();
+
+    const auto toJSON = [&](const Position &position) {
+        rapidjson::Value jsonPosition(rapidjson::kArrayType);
+        for (auto value : position) {
+            jsonPosition.PushBack(value, allocator);
+        }
+        return jsonPosition;
+    };
+
+    for (auto &&entry : m_entries) {
+        // Animations without channels and meshes outside of the scene aren't written.
+        if (entry.animation->id < 0 || entry.node->id < 0 || !document.HasMember("animations"))
+            continue;
+
+        auto &jsonAnimation = document["animations"][entry.animation->id];
+
+        if (!jsonAnimation.HasMember("extras")) {
+            jsonAnimation.AddMember("extras", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        auto &jsonExtras = jsonAnimation["extras"];
+        if (!jsonExtras.HasMember("bounds")) {
+            jsonExtras.AddMember("bounds", rapidjson::Value(rapidjson::kArrayType), allocator);
+        }
+
+        rapidjson::Value jsonBounds(rapidjson::kObjectType);
+        jsonBounds.AddMember("node", entry.node->id, allocator);
+        jsonBounds.AddMember("min", toJSON(entry.min), allocator);
+        jsonBounds.AddMember("max", toJSON(entry.max), allocator);
+
+        jsonExtras["bounds"].PushBack(jsonBounds, allocator);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "MeshSkeleton.h"
+#include "macros.h"
+#include "sceneTypes.h"
+
+class ExportableNode;
+
+/** A box around the vertices that move with a node, in the space of the
+ * node, see -animatedBounds. A null node is the node of the mesh itself. */
+struct NodeBounds {
+    const ExportableNode *node;
+    Position center;
+    Position halfExtent;
+};
+
+/**
+ * Computes the boxes around the vertices of the mesh that move with each
+ * node. With a skin, these are the vertices with a non-zero weight of each
+ * joint, in the bind space of the joint. Without, these are all vertices, in
+ * the space of the mesh node. The boxes hold the vertices with any
+ * combination of fully applied morph targets, so the skinned or morphed
+ * vertices stay within the union of the transformed boxes.
+ */
+void computeNodeBounds(const VertexBufferTable &table, const MeshJoints &joints, bool isSkinned,
+                       std::vector<NodeBounds> &bounds);
+
+/** Expands the world box with the node bounds, transformed by the world
+ * matrices of their nodes at the current evaluation time */
+void expandWorldBounds(const std::vector<NodeBounds> &bounds, const ExportableNode &meshNode, double scaleFactor,
+                       bool isContextEvaluated, Position &min, Position &max);
+
+/**
+ * Keeps track of the world boxes that hold the meshes during each animation,
+ * see -animatedBounds. The COLLADA2GLTF object model doesn't know about
+ * these, so the JSON is patched after it is written, adding the boxes to the
+ * extras of the animations.
+ */
+class AnimatedBounds {
+  public:
+    AnimatedBounds();
+    ~AnimatedBounds();
+
+    void add(const GLTF::Animation *animation, const GLTF::Node *node, const Position &min, const Position &max);
+
+    bool empty() const { return m_entries.empty(); }
+
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(AnimatedBounds);
+
+    struct Entry {
+        const GLTF::Animation *animation;
+        const GLTF::Node *node;
+        Position min;
+        Position max;
+    };
+
+    std::vector<Entry> m_entries;
+};
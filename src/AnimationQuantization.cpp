@@ -0,0 +1,75 @@
+#include "externals.h"
+
+#include "AnimationQuantization.h"
+#include "accessors.h"
+
+using GLTF::Constants::WebGL;
+
+/** Encodes the values, or returns false when a value is out of range, or
+ * doesn't decode within the tolerance */
+template <typename T>
+static bool tryEncode(const gsl::span<const float> &values, const double tolerance, std::vector<T> &encoded) {
+    const double maxValue = std::numeric_limits<T>::max();
+    const double minValue = std::numeric_limits<T>::is_signed ? -1 : 0;
+
+    encoded.resize(values.size());
+
+    for (size_t i = 0; i < size_t(values.size()); ++i) {
+        const double value = values[i];
+        if (value < minValue || value > 1)
+            return false;
+
+        const auto quantized = static_cast<T>(std::lround(value * maxValue));
+
+        // The decoding of glTF, -1 is represented twice for snorm.
+        const auto decoded = std::max(minValue, quantized / maxValue);
+
+        if (std::abs(decoded - value) > tolerance)
+            return false;
+
+        encoded[i] = quantized;
+    }
+
+    return true;
+}
+
+template <typename T>
+static std::unique_ptr<GLTF::Accessor> tryEncodeAccessor(const std::string &name, const gsl::span<const float> &values,
+                                                         const size_t dimension, const WebGL componentType,
+                                                         const double tolerance) {
+    std::vector<T> encoded;
+    if (!tryEncode(values, tolerance, encoded))
+        return nullptr;
+
+    // The accessor copies the encoded values.
+    return contiguousAccessor(name, glAccessorType(dimension), componentType, static_cast<WebGL>(-1), span(encoded), dimension);
+}
+
+std::unique_ptr<GLTF::Accessor> quantizedOutputAccessor(const std::string &name, const gsl::span<const float> &values,
+                                                        const size_t dimension, const GLTF::Animation::Path path,
+                                                        const double tolerance) {
+    if (values.empty())
+        return nullptr;
+
+    switch (path) {
+    case GLTF::Animation::Path::ROTATION:
+        return tryEncodeAccessor<int16_t>(name, values, dimension, WebGL::SHORT, tolerance);
+
+    case GLTF::Animation::Path::WEIGHTS: {
+        const auto isUnsigned = std::all_of(values.begin(), values.end(), [](float v) { return v >= 0; });
+
+        if (isUnsigned) {
+            if (auto accessor = tryEncodeAccessor<uint8_t>(name, values, dimension, WebGL::UNSIGNED_BYTE, tolerance))
+                return accessor;
+            return tryEncodeAccessor<uint16_t>(name, values, dimension, WebGL::UNSIGNED_SHORT, tolerance);
+        }
+
+        if (auto accessor = tryEncodeAccessor<int8_t>(name, values, dimension, WebGL::BYTE, tolerance))
+            return accessor;
+        return tryEncodeAccessor<int16_t>(name, values, dimension, WebGL::SHORT, tolerance);
+    }
+
+    default:
+        return nullptr;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Encodes the outputs of an animation sampler as normalized integers, as
+ * KHR_mesh_quantization allows for rotations and morph target weights.
+ *
+ * Rotations use int16 snorm. Weights use the smallest of uint8 and uint16
+ * unorm when all values are in [0,1], or of int8 and int16 snorm when they
+ * are in [-1,1]. Returns null when no encoding reproduces all values within
+ * the tolerance, the outputs must stay float then.
+ */
+std::unique_ptr<GLTF::Accessor> quantizedOutputAccessor(const std::string &name, const gsl::span<const float> &values, size_t dimension,
+                                                        GLTF::Animation::Path path, double tolerance);
@@ -16,6 +16,7 @@ const auto cleanOutputFolder = "cof";
 const auto sceneName = "sn";
 const auto binary = "glb";
 const auto dumpMaya = "dmy";
+const auto dumpMayaBinary = "dmb";
 const auto dumpGLTF = "dgl";
 const auto externalTextures = "ext";
 const auto copyright = "cpr";
@@ -74,6 +75,7 @@ const auto forceAnimationSampling = "fas";
 const auto detectStepAnimations = "dsa";
 
 const auto hashBufferURIs = "hbu";
+const auto bufferURIHash = "buh";
 
 const auto dumpAccessorComponents = "dac";
 
@@ -94,6 +96,190 @@ const auto constantWeightsThreshold = "cwt";
 
 const auto keepObjectNamespace = "kon";
 
+const auto iteratorMeshExtraction = "ime";
+
+const auto sparseBlendShapeExtraction = "sbx";
+
+const auto sparseMorphTargets = "spt";
+
+const auto optimizeVertexCache = "ovc";
+
+const auto meshQuantization = "mq";
+
+const auto highPrecisionQuantization = "hpq";
+
+const auto dracoCompression = "dc";
+
+const auto dracoPositionBits = "dpb";
+
+const auto dracoNormalBits = "dnb";
+
+const auto dracoTexcoordBits = "dtb";
+
+const auto dracoColorBits = "dcb";
+
+const auto dracoGenericBits = "dgb";
+
+const auto dracoSpeed = "dsp";
+
+const auto meshoptCompression = "moc";
+
+const auto meshoptFallback = "mfb";
+
+const auto gpuInstancing = "gi";
+
+const auto instancingThreshold = "ith";
+
+const auto deduplicateMeshes = "ddm";
+
+const auto interleaveVertexAttributes = "iva";
+
+const auto interleaveMorphTargets = "imt";
+
+const auto deduplicateAccessors = "dda";
+
+const auto streamBuffers = "stb";
+
+const auto asyncWriteThreads = "awt";
+
+const auto contextSampling = "csa";
+
+const auto keyframeReduction = "kfr";
+
+const auto cubicSplineFitting = "csf";
+
+const auto exportAnimCurves = "eac";
+
+const auto quantizeAnimation = "qan";
+
+const auto sampleStaticNodes = "ssn";
+
+const auto splitClipBuffers = "scb";
+
+const auto streamClips = "stc";
+
+const auto appendClipsTo = "act";
+
+const auto exportNodeUuids = "enu";
+
+const auto sampleCacheFolder = "scf";
+
+const auto meshCacheFolder = "mcf";
+
+const auto imageCacheFolder = "icf";
+
+const auto prefetchImageThreads = "pit";
+
+const auto basisuEncoder = "bue";
+
+const auto basisuUASTC = "buu";
+
+const auto maxColorTextureSize = "mcs";
+
+const auto maxNormalTextureSize = "mns";
+
+const auto maxOrmTextureSize = "mos";
+
+const auto meshPipelineDepth = "mpd";
+
+const auto profileReport = "prf";
+
+const auto statisticsReport = "srp";
+
+const auto meshByteBudget = "mbb";
+
+const auto clipByteBudget = "cbb";
+
+const auto bufferByteBudget = "bbb";
+
+const auto imageByteBudget = "ibb";
+
+const auto recordKernelInputs = "rki";
+
+const auto splitAssets = "sas";
+
+const auto contentStore = "cos";
+
+const auto minInfluenceWeight = "miw";
+
+const auto maxInfluences = "mxi";
+
+const auto skinQuantization = "skq";
+
+const auto maxSkinJoints = "msj";
+
+const auto splitLargePrimitives = "slp";
+
+const auto batchStaticMeshes = "bsm";
+
+const auto batchMaxVertices = "bmv";
+
+const auto batchCellSize = "bcs";
+
+const auto lodRatios = "lor";
+
+const auto lodCoverages = "lcv";
+
+const auto lodMaxError = "lme";
+
+const auto animatedBounds = "anb";
+
+const auto meshlets = "mlt";
+
+const auto meshletMaxVertices = "mmv";
+
+const auto meshletMaxTriangles = "mmt";
+
+const auto pruneMorphTargets = "pmt";
+
+const auto morphDeltaThreshold = "mdt";
+
+const auto progressiveLayout = "pgl";
+
+const auto diagnostics = "dgs";
+
+const auto maxDiagnosticItems = "mdi";
+
+const auto morphTargetQuantization = "mtq";
+
+const auto recomputeBlendShapeNormals = "rbn";
+
+const auto liveLink = "llk";
+
+const auto stopLiveLink = "slk";
+
+const auto async = "asy";
+
+const auto asyncCallback = "acb";
+
+const auto positionDecimals = "pdc";
+
+const auto directionDecimals = "ddc";
+
+const auto colorDecimals = "cdc";
+
+const auto texCoordDecimals = "tdc";
+
+const auto scaleDecimals = "sdc";
+
+const auto matrixDecimals = "mdc";
+
+const auto allAccessorBounds = "aab";
+
+const auto compactSkinJoints = "csj";
+
+const auto shareSkins = "shs";
+
+const auto textureAtlasSize = "tas";
+
+const auto companionBlob = "cbl";
+
+const auto cachedPlayback = "cpb";
+
+const auto adaptiveSampleRate = "asr";
+
+const auto compactJSON = "cjs";
+
 } // namespace flag
 
 inline const char *getArgTypeName(const MSyntax::MArgType argType) {
@@ -142,6 +328,7 @@ SyntaxFactory::SyntaxFactory() {
     registerFlag(ss, flag::splitByReference, "splitByReference", kNoArg);
     registerFlag(ss, flag::dumpGLTF, "dumpGTLF", kString);
     registerFlag(ss, flag::dumpMaya, "dumpMaya", kString);
+    registerFlag(ss, flag::dumpMayaBinary, "dumpMayaBinary", kNoArg);
     registerFlag(ss, flag::dumpAccessorComponents, "dumpAccessorComponents", kNoArg);
     registerFlag(ss, flag::externalTextures, "externalTextures", kNoArg);
     registerFlag(ss, flag::defaultMaterial, "defaultMaterial", kNoArg);
@@ -189,6 +376,7 @@ SyntaxFactory::SyntaxFactory() {
     registerFlag(ss, flag::forceAnimationSampling, "forceAnimationSampling", kNoArg);
 
     registerFlag(ss, flag::hashBufferURIs, "hashBufferUri", kNoArg);
+    registerFlag(ss, flag::bufferURIHash, "bufferUriHash", kString);
     registerFlag(ss, flag::niceBufferURIs, "niceBufferNames", kNoArg);
 
     registerFlag(ss, flag::convertUnsupportedImages, "convertUnsupportedImages", kNoArg);
@@ -204,6 +392,99 @@ SyntaxFactory::SyntaxFactory() {
 
     registerFlag(ss, flag::keepObjectNamespace, "keepMayaNamespaces", kNoArg);
 
+    registerFlag(ss, flag::iteratorMeshExtraction, "iteratorMeshExtraction", kNoArg);
+    registerFlag(ss, flag::sparseBlendShapeExtraction, "sparseBlendShapeExtraction", kNoArg);
+    registerFlag(ss, flag::sparseMorphTargets, "sparseMorphTargets", kDouble);
+    registerFlag(ss, flag::optimizeVertexCache, "optimizeVertexCache", kNoArg);
+    registerFlag(ss, flag::meshQuantization, "meshQuantization", kNoArg);
+    registerFlag(ss, flag::highPrecisionQuantization, "highPrecisionQuantization", kNoArg);
+    registerFlag(ss, flag::dracoCompression, "dracoCompression", kNoArg);
+    registerFlag(ss, flag::dracoPositionBits, "dracoPositionBits", kLong);
+    registerFlag(ss, flag::dracoNormalBits, "dracoNormalBits", kLong);
+    registerFlag(ss, flag::dracoTexcoordBits, "dracoTexcoordBits", kLong);
+    registerFlag(ss, flag::dracoColorBits, "dracoColorBits", kLong);
+    registerFlag(ss, flag::dracoGenericBits, "dracoGenericBits", kLong);
+    registerFlag(ss, flag::dracoSpeed, "dracoSpeed", kLong);
+    registerFlag(ss, flag::meshoptCompression, "meshoptCompression", kNoArg);
+    registerFlag(ss, flag::meshoptFallback, "meshoptFallback", kNoArg);
+    registerFlag(ss, flag::gpuInstancing, "gpuInstancing", kNoArg);
+    registerFlag(ss, flag::instancingThreshold, "instancingThreshold", kLong);
+    registerFlag(ss, flag::deduplicateMeshes, "deduplicateMeshes", kNoArg);
+    registerFlag(ss, flag::interleaveVertexAttributes, "interleaveVertexAttributes", kNoArg);
+    registerFlag(ss, flag::interleaveMorphTargets, "interleaveMorphTargets", kNoArg);
+    registerFlag(ss, flag::deduplicateAccessors, "deduplicateAccessors", kNoArg);
+    registerFlag(ss, flag::streamBuffers, "streamBuffers", kNoArg);
+    registerFlag(ss, flag::asyncWriteThreads, "asyncWriteThreads", kLong);
+    registerFlag(ss, flag::contextSampling, "contextSampling", kNoArg);
+    registerFlag(ss, flag::keyframeReduction, "keyframeReduction", kNoArg);
+    registerFlag(ss, flag::cubicSplineFitting, "cubicSplineFitting", kNoArg);
+    registerFlag(ss, flag::exportAnimCurves, "exportAnimCurves", kNoArg);
+    registerFlag(ss, flag::quantizeAnimation, "quantizeAnimation", kNoArg);
+    registerFlag(ss, flag::sampleStaticNodes, "sampleStaticNodes", kNoArg);
+    registerFlag(ss, flag::splitClipBuffers, "splitClipBuffers", kNoArg);
+    registerFlag(ss, flag::streamClips, "streamClips", kNoArg);
+    registerFlag(ss, flag::appendClipsTo, "appendClipsTo", kString);
+    registerFlag(ss, flag::exportNodeUuids, "exportNodeUuids", kNoArg);
+    registerFlag(ss, flag::sampleCacheFolder, "sampleCacheFolder", kString);
+    registerFlag(ss, flag::meshCacheFolder, "meshCacheFolder", kString);
+    registerFlag(ss, flag::imageCacheFolder, "imageCacheFolder", kString);
+    registerFlag(ss, flag::prefetchImageThreads, "prefetchImageThreads", kLong);
+    registerFlag(ss, flag::basisuEncoder, "basisuEncoder", kString);
+    registerFlag(ss, flag::basisuUASTC, "basisuUASTC", kNoArg);
+    registerFlag(ss, flag::maxColorTextureSize, "maxColorTextureSize", kLong);
+    registerFlag(ss, flag::maxNormalTextureSize, "maxNormalTextureSize", kLong);
+    registerFlag(ss, flag::maxOrmTextureSize, "maxOrmTextureSize", kLong);
+    registerFlag(ss, flag::meshPipelineDepth, "meshPipelineDepth", kLong);
+    registerFlag(ss, flag::profileReport, "profileReport", kString);
+    registerFlag(ss, flag::statisticsReport, "statisticsReport", kString);
+    registerFlag(ss, flag::meshByteBudget, "meshByteBudget", kLong);
+    registerFlag(ss, flag::clipByteBudget, "clipByteBudget", kLong);
+    registerFlag(ss, flag::bufferByteBudget, "bufferByteBudget", kLong);
+    registerFlag(ss, flag::imageByteBudget, "imageByteBudget", kLong);
+    registerFlag(ss, flag::recordKernelInputs, "recordKernelInputs", kString);
+    registerFlag(ss, flag::splitAssets, "splitAssets", kString);
+    registerFlag(ss, flag::contentStore, "contentStore", kString);
+    registerFlag(ss, flag::minInfluenceWeight, "minInfluenceWeight", kDouble);
+    registerFlag(ss, flag::maxInfluences, "maxInfluences", kLong);
+    registerFlag(ss, flag::skinQuantization, "skinQuantization", kNoArg);
+    registerFlag(ss, flag::maxSkinJoints, "maxSkinJoints", kLong);
+    registerFlag(ss, flag::splitLargePrimitives, "splitLargePrimitives", kNoArg);
+    registerFlag(ss, flag::batchStaticMeshes, "batchStaticMeshes", kNoArg);
+    registerFlag(ss, flag::batchMaxVertices, "batchMaxVertices", kLong);
+    registerFlag(ss, flag::batchCellSize, "batchCellSize", kDouble);
+    registerFlag(ss, flag::lodRatios, "lodRatios", kString);
+    registerFlag(ss, flag::lodCoverages, "lodCoverages", kString);
+    registerFlag(ss, flag::lodMaxError, "lodMaxError", kDouble);
+    registerFlag(ss, flag::animatedBounds, "animatedBounds", kNoArg);
+    registerFlag(ss, flag::meshlets, "meshlets", kNoArg);
+    registerFlag(ss, flag::meshletMaxVertices, "meshletMaxVertices", kLong);
+    registerFlag(ss, flag::meshletMaxTriangles, "meshletMaxTriangles", kLong);
+    registerFlag(ss, flag::pruneMorphTargets, "pruneMorphTargets", kNoArg);
+    registerFlag(ss, flag::morphDeltaThreshold, "morphDeltaThreshold", kDouble);
+    registerFlag(ss, flag::progressiveLayout, "progressiveLayout", kNoArg);
+    registerFlag(ss, flag::diagnostics, "diagnostics", kString);
+    registerFlag(ss, flag::maxDiagnosticItems, "maxDiagnosticItems", kLong);
+    registerFlag(ss, flag::morphTargetQuantization, "morphTargetQuantization", kDouble);
+    registerFlag(ss, flag::recomputeBlendShapeNormals, "recomputeBlendShapeNormals", kNoArg);
+    registerFlag(ss, flag::liveLink, "liveLink", kLong);
+    registerFlag(ss, flag::stopLiveLink, "stopLiveLink", kNoArg);
+    registerFlag(ss, flag::async, "async", kNoArg);
+    registerFlag(ss, flag::asyncCallback, "asyncCallback", kString);
+    registerFlag(ss, flag::positionDecimals, "positionDecimals", kLong);
+    registerFlag(ss, flag::directionDecimals, "directionDecimals", kLong);
+    registerFlag(ss, flag::colorDecimals, "colorDecimals", kLong);
+    registerFlag(ss, flag::texCoordDecimals, "texCoordDecimals", kLong);
+    registerFlag(ss, flag::scaleDecimals, "scaleDecimals", kLong);
+    registerFlag(ss, flag::matrixDecimals, "matrixDecimals", kLong);
+    registerFlag(ss, flag::allAccessorBounds, "allAccessorBounds", kNoArg);
+    registerFlag(ss, flag::compactSkinJoints, "compactSkinJoints", kNoArg);
+    registerFlag(ss, flag::shareSkins, "shareSkins", kNoArg);
+    registerFlag(ss, flag::textureAtlasSize, "textureAtlasSize", kLong);
+    registerFlag(ss, flag::companionBlob, "companionBlob", kNoArg);
+    registerFlag(ss, flag::cachedPlayback, "cachedPlayback", kDouble);
+    registerFlag(ss, flag::adaptiveSampleRate, "adaptiveSampleRate", kLong);
+    registerFlag(ss, flag::compactJSON, "compactJSON", kNoArg);
+
     m_usage = ss.str();
 }
 
@@ -293,6 +574,26 @@ class ArgChecker {
         return semantics;
     }
 
+    /** Parses the numbers separated by '|' of the flag, if set */
+    std::vector<double> getNumbers(const char *shortName) const {
+        std::vector<double> numbers;
+
+        MString text;
+        if (optional(shortName, text)) {
+            MStringArray parts;
+            const auto status = text.split('|', parts);
+            throwOnArgument(status, shortName);
+            for (auto i = 0U; i < parts.length(); ++i) {
+                if (!parts[i].isDouble()) {
+                    throwInvalid(shortName, "Expected numbers separated by |");
+                }
+                numbers.emplace_back(parts[i].asDouble());
+            }
+        }
+
+        return numbers;
+    }
+
     bool isFlagSet(const char *shortName) const {
         MStatus status;
         const auto result = adb.isFlagSet(shortName, &status);
@@ -340,6 +641,16 @@ class ArgChecker {
         return true;
     }
 
+    /** The rounding grid of the decimals of the flag, if set. See RoundingGrid */
+    RoundingGrid roundingGrid(const char *shortName, const RoundingGrid &grid) const {
+        auto decimals = grid.decimals;
+        optional(shortName, decimals);
+        if (decimals < -1 || decimals > 15) {
+            throwInvalid(shortName, "Expected 0 to 15 decimals, or -1 to not round");
+        }
+        return RoundingGrid(decimals);
+    }
+
     bool optional(const char *shortName, float &value) const {
         double temp;
         if (!optional(shortName, temp))
@@ -357,12 +668,15 @@ class ArgChecker {
     }
 
     std::unique_ptr<IndentableStream> getOutputStream(const char *arg, const char *outputName, const fs::path &outputFolder,
-                                                      std::ofstream &fileOutputStream) const {
+                                                      std::ofstream &fileOutputStream, const bool isBinary = false) const {
         std::ostream *out = nullptr;
 
         if (adb.isFlagSet(arg)) {
             MString argPath;
             if (adb.getFlagArgument(arg, 0, argPath).error() || argPath.toLowerCase() == "console") {
+                if (isBinary) {
+                    throwInvalid(arg, "can't print a binary dump to Maya's console window");
+                }
                 out = &cout;
             } else if (argPath.length() == 0 || argPath.substring(0, 0) == "-") {
                 throwInvalid(arg, "requires an output filepath argument, or just "
@@ -373,12 +687,12 @@ class ArgChecker {
 
                 cout << prefix << "Writing " << outputName << " output to file " << absolutePath << endl;
 
-                fileOutputStream.open(absolutePath);
+                fileOutputStream.open(absolutePath, isBinary ? std::ios::out | std::ios::binary : std::ios::out);
                 out = &fileOutputStream;
             }
         }
 
-        return out ? std::make_unique<IndentableStream>(*out) : nullptr;
+        return out ? std::make_unique<IndentableStream>(*out, isBinary) : nullptr;
     }
 
     static void throwOnFailure(const MStatus &status, const char *message) {
@@ -415,6 +729,12 @@ class ArgChecker {
     MArgDatabase adb;
 };
 
+bool Arguments::isLiveLinkStop(const MArgList &args, const MSyntax &syntax) {
+    MStatus status;
+    const MArgDatabase adb(syntax, args, &status);
+    return status && adb.isFlagSet(flag::stopLiveLink);
+}
+
 Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     // ReSharper disable CppExpressionWithoutSideEffects
 
@@ -454,9 +774,11 @@ Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     cleanOutputFolder = adb.isFlagSet(flag::cleanOutputFolder);
 
     glb = adb.isFlagSet(flag::binary);
+    compactJSON = adb.isFlagSet(flag::compactJSON);
 
     const fs::path outputFolderPath(outputFolder.asChar());
-    m_mayaOutputStream = adb.getOutputStream(flag::dumpMaya, "Maya debug", outputFolderPath, m_mayaOutputFileStream);
+    m_mayaOutputStream = adb.getOutputStream(flag::dumpMaya, "Maya debug", outputFolderPath, m_mayaOutputFileStream,
+                                             adb.isFlagSet(flag::dumpMayaBinary));
     m_gltfOutputStream = adb.getOutputStream(flag::dumpGLTF, "glTF debug", outputFolderPath, m_gltfOutputFileStream);
 
     dumpMaya = m_mayaOutputStream.get();
@@ -466,6 +788,7 @@ Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     externalTextures = adb.isFlagSet(flag::externalTextures);
     splitMeshAnimation = adb.isFlagSet(flag::splitMeshAnimation);
     splitByReference = adb.isFlagSet(flag::splitByReference);
+    splitClipBuffers = adb.isFlagSet(flag::splitClipBuffers);
     separateAccessorBuffers = adb.isFlagSet(flag::separateAccessorBuffers);
     defaultMaterial = adb.isFlagSet(flag::defaultMaterial);
     colorizeMaterials = adb.isFlagSet(flag::colorizeMaterials);
@@ -473,10 +796,126 @@ Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     skipMaterialTextures = adb.isFlagSet(flag::skipMaterialTextures);
 
     force32bitIndices = adb.isFlagSet(flag::force32bitIndices);
+    splitLargePrimitives = adb.isFlagSet(flag::splitLargePrimitives);
+    batchStaticMeshes = adb.isFlagSet(flag::batchStaticMeshes);
+    adb.optional(flag::batchMaxVertices, batchMaxVertices);
+    if (batchMaxVertices < 1) {
+        adb.throwInvalid(flag::batchMaxVertices, "Expected a positive number of vertices");
+    }
+    adb.optional(flag::batchCellSize, batchCellSize);
+    if (batchCellSize < 0) {
+        adb.throwInvalid(flag::batchCellSize, "Expected a positive size, or 0 to merge regardless of the location");
+    }
+    lodRatios = adb.getNumbers(flag::lodRatios);
+    for (size_t i = 0; i < lodRatios.size(); ++i) {
+        if (lodRatios[i] <= 0 || lodRatios[i] >= (i == 0 ? 1 : lodRatios[i - 1])) {
+            adb.throwInvalid(flag::lodRatios, "Expected decreasing ratios between 0 and 1");
+        }
+    }
+    lodCoverages = adb.getNumbers(flag::lodCoverages);
+    if (!lodCoverages.empty() && lodCoverages.size() != lodRatios.size() + 1) {
+        adb.throwInvalid(flag::lodCoverages, "Expected a screen coverage per level of detail, and one for the mesh");
+    }
+    adb.optional(flag::lodMaxError, lodMaxError);
+    if (lodMaxError < 0) {
+        adb.throwInvalid(flag::lodMaxError, "Expected a positive error");
+    }
+    animatedBounds = adb.isFlagSet(flag::animatedBounds);
+    pruneMorphTargets = adb.isFlagSet(flag::pruneMorphTargets);
+    adb.optional(flag::morphDeltaThreshold, morphDeltaThreshold);
+    if (morphDeltaThreshold < 0) {
+        adb.throwInvalid(flag::morphDeltaThreshold, "Expected a positive threshold");
+    }
+    meshlets = adb.isFlagSet(flag::meshlets);
+    adb.optional(flag::meshletMaxVertices, meshletMaxVertices);
+    if (meshletMaxVertices < 3 || meshletMaxVertices > 256) {
+        adb.throwInvalid(flag::meshletMaxVertices, "Expected between 3 and 256 vertices");
+    }
+    adb.optional(flag::meshletMaxTriangles, meshletMaxTriangles);
+    if (meshletMaxTriangles < 1) {
+        adb.throwInvalid(flag::meshletMaxTriangles, "Expected a positive number of triangles");
+    }
+    meshQuantization = adb.isFlagSet(flag::meshQuantization);
+    dracoCompression = adb.isFlagSet(flag::dracoCompression);
+    meshoptCompression = adb.isFlagSet(flag::meshoptCompression);
+    meshoptFallback = adb.isFlagSet(flag::meshoptFallback);
+    if (meshlets && dracoCompression) {
+        adb.throwInvalid(flag::meshlets, "can't build meshlets of Draco compressed primitives, Draco reorders the vertices");
+    }
+    gpuInstancing = adb.isFlagSet(flag::gpuInstancing);
+    deduplicateMeshes = adb.isFlagSet(flag::deduplicateMeshes);
+    interleaveVertexAttributes = adb.isFlagSet(flag::interleaveVertexAttributes);
+    interleaveMorphTargets = adb.isFlagSet(flag::interleaveMorphTargets);
+    deduplicateAccessors = adb.isFlagSet(flag::deduplicateAccessors);
+    allAccessorBounds = adb.isFlagSet(flag::allAccessorBounds);
+    companionBlob = adb.isFlagSet(flag::companionBlob);
+    contextSampling = adb.isFlagSet(flag::contextSampling);
+    cachedPlayback = adb.isFlagSet(flag::cachedPlayback);
+    adb.optional(flag::cachedPlayback, cachedPlaybackTimeout);
+    if (cachedPlaybackTimeout < 0) {
+        adb.throwInvalid(flag::cachedPlayback, "Expected a non-negative timeout in seconds");
+    }
+    if (cachedPlayback && contextSampling) {
+        adb.throwInvalid(flag::cachedPlayback, "can't be combined with -contextSampling, the cache is only used when the current time changes");
+    }
+    keyframeReduction = adb.isFlagSet(flag::keyframeReduction);
+    cubicSplineFitting = adb.isFlagSet(flag::cubicSplineFitting);
+    adb.optional(flag::adaptiveSampleRate, adaptiveSampleRate);
+    if (adaptiveSampleRate < 1) {
+        adb.throwInvalid(flag::adaptiveSampleRate, "Expected a positive divisor of the clip frame rate");
+    }
+    exportAnimCurves = adb.isFlagSet(flag::exportAnimCurves);
+    quantizeAnimation = adb.isFlagSet(flag::quantizeAnimation);
+    sampleStaticNodes = adb.isFlagSet(flag::sampleStaticNodes);
+    streamClips = adb.isFlagSet(flag::streamClips);
+    exportNodeUuids = adb.isFlagSet(flag::exportNodeUuids);
+    adb.optional(flag::sampleCacheFolder, sampleCacheFolder);
+    adb.optional(flag::meshCacheFolder, meshCacheFolder);
+    adb.optional(flag::liveLink, liveLinkPort);
+    if (liveLinkPort < 0 || liveLinkPort > 65535) {
+        adb.throwInvalid(flag::liveLink, "Expected a TCP port from 1 to 65535, or 0 for no live link");
+    }
+    async = adb.isFlagSet(flag::async);
+    adb.optional(flag::asyncCallback, asyncCallback);
+    adb.optional(flag::appendClipsTo, appendClipsTo);
+    if (appendClipsTo.length() && glb) {
+        adb.throwInvalid(flag::appendClipsTo, "can't append clips to a binary glb file");
+    }
+    streamBuffers = adb.isFlagSet(flag::streamBuffers);
+    progressiveLayout = adb.isFlagSet(flag::progressiveLayout);
+    if (progressiveLayout && !glb && (splitMeshAnimation || separateAccessorBuffers)) {
+        adb.throwInvalid(flag::progressiveLayout, "needs a single buffer, not -splitMeshAnimation or -separateAccessorBuffers");
+    }
+    highPrecisionQuantization = adb.isFlagSet(flag::highPrecisionQuantization);
+    rounding.position = adb.roundingGrid(flag::positionDecimals, rounding.position);
+    rounding.direction = adb.roundingGrid(flag::directionDecimals, rounding.direction);
+    rounding.color = adb.roundingGrid(flag::colorDecimals, rounding.color);
+    rounding.texCoord = adb.roundingGrid(flag::texCoordDecimals, rounding.texCoord);
+    rounding.scale = adb.roundingGrid(flag::scaleDecimals, rounding.scale);
+    rounding.matrix = adb.roundingGrid(flag::matrixDecimals, rounding.matrix);
+    skinQuantization = adb.isFlagSet(flag::skinQuantization);
+    optimizeVertexCache = adb.isFlagSet(flag::optimizeVertexCache);
     disableNameAssignment = adb.isFlagSet(flag::disableNameAssignment);
     keepObjectNamespace = adb.isFlagSet(flag::keepObjectNamespace);
+    iteratorMeshExtraction = adb.isFlagSet(flag::iteratorMeshExtraction);
     skipSkinClusters = adb.isFlagSet(flag::skipSkinClusters);
+    adb.optional(flag::maxSkinJoints, maxSkinJoints);
+    if (maxSkinJoints < 0) {
+        adb.throwInvalid(flag::maxSkinJoints, "Expected a positive number of joints, or 0 for no limit");
+    }
+    adb.optional(flag::maxInfluences, maxInfluences);
+    if (maxInfluences < 0) {
+        adb.throwInvalid(flag::maxInfluences, "Expected a positive number of joints, or 0 for no limit");
+    }
+    adb.optional(flag::minInfluenceWeight, minInfluenceWeight);
+    if (minInfluenceWeight < 0 || minInfluenceWeight >= 1) {
+        adb.throwInvalid(flag::minInfluenceWeight, "Expected a weight from 0 up to 1");
+    }
     skipBlendShapes = adb.isFlagSet(flag::skipBlendShapes);
+    shareSkins = adb.isFlagSet(flag::shareSkins);
+    compactSkinJoints = adb.isFlagSet(flag::compactSkinJoints);
+    sparseBlendShapeExtraction = adb.isFlagSet(flag::sparseBlendShapeExtraction);
+    recomputeBlendShapeNormals = adb.isFlagSet(flag::recomputeBlendShapeNormals);
     redrawViewport = adb.isFlagSet(flag::redrawViewport);
     excludeUnusedTexcoord = adb.isFlagSet(flag::excludeUnusedTexcoord);
     ignoreSegmentScaleCompensation = adb.isFlagSet(flag::ignoreSegmentScaleCompensation);
@@ -486,12 +925,105 @@ Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     forceAnimationChannels = adb.isFlagSet(flag::forceAnimationChannels);
     forceAnimationSampling = adb.isFlagSet(flag::forceAnimationSampling);
     hashBufferURIs = adb.isFlagSet(flag::hashBufferURIs);
+
+    MString bufferURIHashName;
+    if (adb.optional(flag::bufferURIHash, bufferURIHashName)) {
+        if (bufferURIHashName == "sha256") {
+            bufferURIHash = BufferURIHash::SHA256;
+        } else if (bufferURIHashName == "treeSha256") {
+            bufferURIHash = BufferURIHash::TREE_SHA256;
+        } else if (bufferURIHashName == "fast") {
+            bufferURIHash = BufferURIHash::FAST128;
+        } else {
+            adb.throwInvalid(flag::bufferURIHash, "Expected sha256, treeSha256 or fast");
+        }
+    }
     niceBufferURIs = adb.isFlagSet(flag::niceBufferURIs);
     convertUnsupportedImages = adb.isFlagSet(flag::convertUnsupportedImages);
+    adb.optional(flag::imageCacheFolder, imageCacheFolder);
     reportSkewedInverseBindMatrices = adb.isFlagSet(flag::reportSkewedInverseBindMatrices);
     clearOutputWindow = adb.isFlagSet(flag::clearOutputWindow);
+    MString diagnosticsName;
+    if (adb.optional(flag::diagnostics, diagnosticsName)) {
+        if (diagnosticsName == "fast") {
+            diagnostics = Diagnostics::FAST;
+        } else if (diagnosticsName == "full") {
+            diagnostics = Diagnostics::FULL;
+        } else {
+            adb.throwInvalid(flag::diagnostics, "Expected fast or full");
+        }
+    }
+    adb.optional(flag::maxDiagnosticItems, maxDiagnosticItems);
+    if (maxDiagnosticItems < 1) {
+        adb.throwInvalid(flag::maxDiagnosticItems, "Expected a positive number of items");
+    }
 
     adb.optional(flag::globalOpacityFactor, opacityFactor);
+    adb.optional(flag::sparseMorphTargets, sparseMorphTargets);
+    adb.optional(flag::morphTargetQuantization, morphTargetQuantization);
+    if (morphTargetQuantization < 0) {
+        adb.throwInvalid(flag::morphTargetQuantization, "Expected a non-negative tolerance");
+    }
+    adb.optional(flag::dracoSpeed, dracoSpeed);
+    adb.optional(flag::dracoGenericBits, dracoGenericBits);
+    adb.optional(flag::dracoColorBits, dracoColorBits);
+    adb.optional(flag::dracoTexcoordBits, dracoTexcoordBits);
+    adb.optional(flag::dracoNormalBits, dracoNormalBits);
+    adb.optional(flag::dracoPositionBits, dracoPositionBits);
+    adb.optional(flag::instancingThreshold, instancingThreshold);
+    adb.optional(flag::asyncWriteThreads, asyncWriteThreads);
+    adb.optional(flag::meshPipelineDepth, meshPipelineDepth);
+    adb.optional(flag::profileReport, profileReport);
+    adb.optional(flag::statisticsReport, statisticsReport);
+    adb.optional(flag::recordKernelInputs, recordKernelInputs);
+    adb.optional(flag::imageByteBudget, imageByteBudget);
+    adb.optional(flag::bufferByteBudget, bufferByteBudget);
+    adb.optional(flag::clipByteBudget, clipByteBudget);
+    adb.optional(flag::meshByteBudget, meshByteBudget);
+    adb.optional(flag::maxOrmTextureSize, maxOrmTextureSize);
+    adb.optional(flag::maxNormalTextureSize, maxNormalTextureSize);
+    adb.optional(flag::maxColorTextureSize, maxColorTextureSize);
+    adb.optional(flag::textureAtlasSize, textureAtlasSize);
+    if (textureAtlasSize < 0) {
+        adb.throwInvalid(flag::textureAtlasSize, "Expected a positive size, or 0 for no atlases");
+    }
+    basisuUASTC = adb.isFlagSet(flag::basisuUASTC);
+    adb.optional(flag::basisuEncoder, basisuEncoder);
+
+    MString splitAssetsName;
+    if (adb.optional(flag::splitAssets, splitAssetsName)) {
+        if (splitAssetsName == "topLevel") {
+            splitAssets = AssetSplit::TOP_LEVEL;
+        } else if (splitAssetsName == "reference") {
+            splitAssets = AssetSplit::REFERENCE;
+        } else {
+            adb.throwInvalid(flag::splitAssets, "Expected topLevel or reference");
+        }
+
+        // These patch the JSON of the whole scene, not of a single asset.
+        if (appendClipsTo.length() || dracoCompression || meshoptCompression || gpuInstancing || sparseMorphTargets > 0 ||
+            basisuEncoder.length() || !lodRatios.empty() || animatedBounds || meshlets || pruneMorphTargets || progressiveLayout) {
+            adb.throwInvalid(flag::splitAssets, "can't split assets with -appendClipsTo, -dracoCompression, -meshoptCompression, "
+                                                "-gpuInstancing, -sparseMorphTargets, -basisuEncoder, -lodRatios, -animatedBounds, "
+                                                "-meshlets, -pruneMorphTargets or -progressiveLayout");
+        }
+
+        // A batch can merge meshes of different assets.
+        if (batchStaticMeshes) {
+            adb.throwInvalid(flag::splitAssets, "can't split assets with -batchStaticMeshes");
+        }
+
+        // The live link only pushes the JSON and buffers of the whole scene.
+        if (liveLinkPort > 0) {
+            adb.throwInvalid(flag::splitAssets, "can't split assets with -liveLink");
+        }
+    }
+
+    adb.optional(flag::prefetchImageThreads, prefetchImageThreads);
+    adb.optional(flag::contentStore, contentStore);
+    if (contentStore.length() && appendClipsTo.length()) {
+        adb.throwInvalid(flag::contentStore, "can't store the buffers of clips appended to a glTF file");
+    }
 
     adb.optional(flag::constantTranslationThreshold, constantTranslationThreshold);
     adb.optional(flag::constantRotationThreshold, constantRotationThreshold);
@@ -639,6 +1171,9 @@ Arguments::Arguments(const MArgList &args, const MSyntax &syntax) {
     //    cameras.add(camera);
     //}
 
+    meshShapes.sort();
+    cameraShapes.sort();
+
     cout << prefix << "Exporting shapes:";
     for (auto &path : meshShapes) {
         cout << " " << path.partialPathName();
@@ -701,72 +1236,102 @@ std::string Arguments::assignName(GLTF::Object &glObj, const MFnDependencyNode &
     return result;
 }
 
+/** Whether the node itself is visible, regardless of its ancestors. MDagPath::isVisible checks all the ancestors again
+ * for each node, so a subtree is checked once per node instead, top down. */
+static bool isNodeVisible(const MDagPath &dagPath) {
+    MStatus status;
+    MFnDagNode node(dagPath, &status);
+    if (!status || node.isIntermediateObject())
+        return false;
+
+    const auto isOn = [&](const char *plugName, const bool defaultValue) {
+        const auto plug = node.findPlug(plugName, true, &status);
+        return status ? plug.asBool() : defaultValue;
+    };
+
+    // The display layers hide their members by overriding the visibility.
+    return isOn("visibility", true) && isOn("lodVisibility", true) &&
+           !(isOn("overrideEnabled", false) && !isOn("overrideVisibility", true));
+}
+
 void Arguments::select(Selection &shapeSelection, Selection &cameraSelection, const MDagPath &dagPath, const bool includeDescendants,
                        const bool includeInvisibleNodes) {
+    if (!includeDescendants) {
+        selectShapes(shapeSelection, cameraSelection, dagPath);
+        return;
+    }
+
     MStatus status;
+    MItDag dagIterator(MItDag::kDepthFirst, MFn::kInvalid, &status);
+    THROW_ON_FAILURE(status);
+    THROW_ON_FAILURE(dagIterator.reset(dagPath, MItDag::kDepthFirst, MFn::kInvalid));
 
-    std::string debugName{dagPath.partialPathName().asChar()};
+    // The ancestors of each visited node are visible, so only the node itself
+    // is checked, and the subtree of an invisible node is skipped.
+    for (auto isRoot = true; !dagIterator.isDone(); dagIterator.next(), isRoot = false) {
+        MDagPath nodePath;
+        THROW_ON_FAILURE(dagIterator.getPath(nodePath));
 
-    if (includeInvisibleNodes || dagPath.isVisible()) {
-        if (dagPath.hasFn(MFn::kTransform)) {
-            unsigned shapeCount;
-            status = dagPath.numberOfShapesDirectlyBelow(shapeCount);
+        if (!isRoot && !includeInvisibleNodes && !isNodeVisible(nodePath)) {
+            dagIterator.prune();
+            continue;
+        }
 
-            if (status) {
-                for (auto shapeIndex = 0U; shapeIndex < shapeCount; ++shapeIndex) {
-                    MDagPath shapePath = dagPath;
-                    status = shapePath.extendToShapeDirectlyBelow(shapeIndex);
-                    if (status) {
-                        MFnMesh mesh(shapePath, &status);
-                        // Do not include intermediate meshes
-                        if (status && !mesh.isIntermediateObject()) {
-                            shapeSelection.insert(shapePath);
-                        }
-
-                        MFnCamera camera(shapePath, &status);
-                        // Do not include intermediate cameras
-                        if (status && !camera.isIntermediateObject()) {
-                            cameraSelection.insert(shapePath);
-                        }
+        selectShapes(shapeSelection, cameraSelection, nodePath);
+    }
+}
+
+void Arguments::selectShapes(Selection &shapeSelection, Selection &cameraSelection, const MDagPath &dagPath) {
+    MStatus status;
+
+    if (dagPath.hasFn(MFn::kTransform)) {
+        unsigned shapeCount;
+        status = dagPath.numberOfShapesDirectlyBelow(shapeCount);
+
+        if (status) {
+            for (auto shapeIndex = 0U; shapeIndex < shapeCount; ++shapeIndex) {
+                MDagPath shapePath = dagPath;
+                status = shapePath.extendToShapeDirectlyBelow(shapeIndex);
+                if (!status)
+                    continue;
+
+                if (shapePath.hasFn(MFn::kMesh)) {
+                    MFnMesh mesh(shapePath, &status);
+                    // Do not include intermediate meshes
+                    if (status && !mesh.isIntermediateObject()) {
+                        shapeSelection.insert(shapePath);
+                    }
+                } else if (shapePath.hasFn(MFn::kCamera)) {
+                    MFnCamera camera(shapePath, &status);
+                    // Do not include intermediate cameras
+                    if (status && !camera.isIntermediateObject()) {
+                        cameraSelection.insert(shapePath);
                     }
                 }
             }
-        } else if (dagPath.hasFn(MFn::kMesh)) {
-            MFnMesh mesh(dagPath, &status);
-            // Do not include intermediate meshes
-            if (status && !mesh.isIntermediateObject()) {
-                MDagPath shapePath;
-                status = mesh.getPath(shapePath);
-                if (status) {
-                    shapeSelection.insert(shapePath);
-                } else {
-                    cerr << prefix << "Failed to get DAG path of " << mesh.partialPathName() << endl;
-                }
-            }
-        } else if (dagPath.hasFn(MFn::kCamera)) {
-            MFnCamera camera(dagPath, &status);
-            // Do not include intermediate cameras
-            if (status && !camera.isIntermediateObject()) {
-                MDagPath cameraPath;
-                status = camera.getPath(cameraPath);
-                if (status) {
-                    cameraSelection.insert(cameraPath);
-                } else {
-                    cerr << prefix << "Failed to get DAG path of " << camera.partialPathName() << endl;
-                }
+        }
+    } else if (dagPath.hasFn(MFn::kMesh)) {
+        MFnMesh mesh(dagPath, &status);
+        // Do not include intermediate meshes
+        if (status && !mesh.isIntermediateObject()) {
+            MDagPath shapePath;
+            status = mesh.getPath(shapePath);
+            if (status) {
+                shapeSelection.insert(shapePath);
+            } else {
+                cerr << prefix << "Failed to get DAG path of " << mesh.partialPathName() << endl;
             }
         }
-
-        if (includeDescendants) {
-            const auto childCount = dagPath.childCount(&status);
-            THROW_ON_FAILURE(status);
-
-            for (auto childIndex = 0U; childIndex < childCount; ++childIndex) {
-                const auto child = dagPath.child(childIndex, &status);
-                MDagPath childDagPath = dagPath;
-                status = childDagPath.push(child);
-                THROW_ON_FAILURE(status);
-                select(shapeSelection, cameraSelection, childDagPath, includeDescendants, includeInvisibleNodes);
+    } else if (dagPath.hasFn(MFn::kCamera)) {
+        MFnCamera camera(dagPath, &status);
+        // Do not include intermediate cameras
+        if (status && !camera.isIntermediateObject()) {
+            MDagPath cameraPath;
+            status = camera.getPath(cameraPath);
+            if (status) {
+                cameraSelection.insert(cameraPath);
+            } else {
+                cerr << prefix << "Failed to get DAG path of " << camera.partialPathName() << endl;
             }
         }
     }
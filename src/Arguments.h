@@ -1,5 +1,6 @@
 #pragma once
 
+#include "DagPathKey.h"
 #include "IndentableStream.h"
 #include "sceneTypes.h"
 
@@ -31,6 +32,14 @@ class SyntaxFactory : MSyntax {
     void registerFlag(std::stringstream &ss, const char *shortName, const char *longName, MArgType argType1 = kNoArg);
 };
 
+/** The hash used for the buffer URIs */
+enum class BufferURIHash { SHA256, TREE_SHA256, FAST128 };
+
+enum class AssetSplit { NONE, TOP_LEVEL, REFERENCE };
+
+/** How much validation is done, see -diagnostics */
+enum class Diagnostics { FAST, FULL };
+
 struct AnimClipArg {
     AnimClipArg(std::string name, const MTime &startTime, const MTime &endTime, const double framesPerSecond, const int stepDetectSampleCount)
         : name{std::move(name)}, startTime{startTime}, endTime{endTime}, framesPerSecond{framesPerSecond}, stepDetectSampleCount(stepDetectSampleCount) {}
@@ -51,13 +60,15 @@ struct MDagPathComparer {
     bool operator()(const MDagPath &a, const MDagPath &b) const { return strcmp(a.fullPathName().asChar(), b.fullPathName().asChar()) < 0; }
 };
 
-typedef std::set<MDagPath, MDagPathComparer> Selection;
-
 class Arguments {
   public:
     Arguments(const MArgList &args, const MSyntax &syntax);
     ~Arguments();
 
+    /** Whether the command only stops the live link, with -stopLiveLink. The
+     * other arguments are not parsed then. */
+    static bool isLiveLinkStop(const MArgList &args, const MSyntax &syntax);
+
     MString sceneName;
     MString outputFolder;
 
@@ -74,6 +85,9 @@ class Arguments {
      * gltf, others might need the official glTF */
     MString gltfFileExtension = "gltf";
 
+    /* Write the JSON of a glTF file without indentation? */
+    bool compactJSON = false;
+
     /* The extension to use for glb files. */
     MString glbFileExtension = "glb";
 
@@ -87,6 +101,10 @@ class Arguments {
      * splitMeshAnimation */
     bool splitByReference = false;
 
+    /** Pack the accessors of each animation clip into its own buffer? Requires
+     * splitMeshAnimation, and is split per reference with splitByReference */
+    bool splitClipBuffers = false;
+
     /** Separate all accessors buffers? Overrides splitMeshAnimation */
     bool separateAccessorBuffers = false;
 
@@ -113,6 +131,11 @@ class Arguments {
      * converted */
     bool convertUnsupportedImages = false;
 
+    /** The folder to keep the images converted by convertUnsupportedImages
+     * in, so these are only converted again when the source changes. By
+     * default a folder in the temporary directory */
+    MString imageCacheFolder;
+
     /** Report skewed inverse-bind-matrix issues. glTF 2.0 does not allow these,
      * but should (see issue 1507). By default no such issues are reported */
     bool reportSkewedInverseBindMatrices = false;
@@ -123,7 +146,52 @@ class Arguments {
     /** Always use 32-bit indices, even when 16-bit would be sufficient */
     bool force32bitIndices = false;
 
-    /** If non-null, dump the Maya intermediate objects to the stream */
+    /** Split the primitives with more than 65535 vertices in primitives that can use 16-bit indices */
+    bool splitLargePrimitives = false;
+
+    /** Merge the static meshes with the same parent and material in a single primitive */
+    bool batchStaticMeshes = false;
+
+    /** The maximum number of vertices of a batch of static meshes, see batchStaticMeshes */
+    int batchMaxVertices = 65535;
+
+    /** The size of the grid cells in which static meshes are batched, or 0 for a single cell, see batchStaticMeshes */
+    double batchCellSize = 0;
+
+    /** The ratios of the triangles of the generated levels of detail, from fine to coarse. By default no levels are
+     * generated */
+    std::vector<double> lodRatios;
+
+    /** The MSFT_screencoverage of the mesh and each level of detail, see lodRatios. By default none */
+    std::vector<double> lodCoverages;
+
+    /** The maximum error of the levels of detail, relative to the size of the mesh, see lodRatios */
+    double lodMaxError = 0.01;
+
+    /** Add the world bounds of the skinned and morphed meshes during each clip to the extras of its animation */
+    bool animatedBounds = false;
+
+    /** Split the triangles of each primitive in meshlets with culling data, for mesh shader renderers */
+    bool meshlets = false;
+
+    /** The maximum number of vertices of a meshlet, see meshlets */
+    int meshletMaxVertices = 64;
+
+    /** The maximum number of triangles of a meshlet, see meshlets */
+    int meshletMaxTriangles = 124;
+
+    /** Drop the morph target attributes without deltas in a primitive, see morphDeltaThreshold */
+    bool pruneMorphTargets = false;
+
+    /** Consider a morph target attribute without deltas if all its components are below this threshold, see
+     * pruneMorphTargets */
+    double morphDeltaThreshold = 1e-9;
+
+    /** Order the packed buffer by what is needed first to show the scene, and write the byte ranges to the extras */
+    bool progressiveLayout = false;
+
+    /** If non-null, dump the Maya intermediate objects to the stream. Binary
+     * with -dumpMayaBinary, see tools/DumpViewer */
     IndentableStream *dumpMaya;
 
     /** If non-null, dump the GLTF JSON to the stream */
@@ -142,6 +210,215 @@ class Arguments {
     /** By default we remove the Maya object namespace from GLTF node names  */
     bool keepObjectNamespace = false;
 
+    /** Extract the mesh topology using the MItMeshPolygon iterator, one Maya
+     * API call per triangle corner. By default the whole-mesh array queries
+     * are used, which is a lot faster and gives the same result */
+    bool iteratorMeshExtraction = false;
+
+    /** Reorder the triangles of each primitive for post-transform vertex cache locality, and the vertices in order
+     * of first use for vertex fetch locality. By default the Maya face order is kept */
+    bool optimizeVertexCache = false;
+
+    /** The decimals that the positions, directions, colors, texture coordinates, scales and matrices are rounded
+     * to, see Exporter. Coarser grids weld more vertices, and compress better */
+    RoundingGrids rounding;
+
+    /** Quantize the vertex attributes using the KHR_mesh_quantization extension. Positions become normalized int16,
+     * normals and tangents normalized int8, texture coordinates normalized uint16 and colors normalized uint8 */
+    bool meshQuantization = false;
+
+    /** When quantizing the mesh, use normalized int16 for normals and tangents, and normalized uint16 for colors
+     * and skin weights */
+    bool highPrecisionQuantization = false;
+
+    /** Store the joint indices as uint8 when the skin has at most 256 joints, and the weights as normalized uint8,
+     * or uint16 with highPrecisionQuantization, rounded so the weights of each vertex add up exactly to one */
+    bool skinQuantization = false;
+
+    /** Compress the mesh primitives using the KHR_draco_mesh_compression extension */
+    bool dracoCompression = false;
+
+    /** The number of Draco quantization bits for positions */
+    int dracoPositionBits = 14;
+
+    /** The number of Draco quantization bits for normals */
+    int dracoNormalBits = 10;
+
+    /** The number of Draco quantization bits for texture coordinates */
+    int dracoTexcoordBits = 12;
+
+    /** The number of Draco quantization bits for colors */
+    int dracoColorBits = 8;
+
+    /** The number of Draco quantization bits for tangents and skin weights */
+    int dracoGenericBits = 12;
+
+    /** The Draco encoding and decoding speed, from 0 (best compression) to 10 (fastest) */
+    int dracoSpeed = 5;
+
+    /** Compress the buffer views using the EXT_meshopt_compression extension */
+    bool meshoptCompression = false;
+
+    /** With meshopt compression, also write the uncompressed buffer views, so the extension is optional */
+    bool meshoptFallback = false;
+
+    /** Draw instances of the same mesh using the EXT_mesh_gpu_instancing extension */
+    bool gpuInstancing = false;
+
+    /** With GPU instancing, the minimum number of instances to combine */
+    int instancingThreshold = 2;
+
+    /** Share the glTF mesh between meshes with identical primitives and materials */
+    bool deduplicateMeshes = false;
+
+    /** Pack the vertex attributes of each primitive into one interleaved buffer view */
+    bool interleaveVertexAttributes = false;
+
+    /** With interleaved vertex attributes, also interleave the attributes of each morph target */
+    bool interleaveMorphTargets = false;
+
+    /** Let accessors with identical data share a single copy of it in the buffer */
+    bool deduplicateAccessors = false;
+
+    /** Write the min and max of all accessors, not only of those that glTF requires these for */
+    bool allAccessorBounds = false;
+
+    /** Also write a memory mappable binary next to the glTF, with the vertex, index, skin and animation data as tightly
+     * packed and aligned streams, see blobLayout.h */
+    bool companionBlob = false;
+
+    /** Write the packed buffers straight from the exported data, without assembling them in memory */
+    bool streamBuffers = false;
+
+    /** The number of threads writing the output files while the JSON is generated, 0 to write these in order */
+    int asyncWriteThreads = 0;
+
+    /** Sample the animation clips by evaluating the exported nodes in a
+     * context at each sample time, instead of changing the global time? */
+    bool contextSampling = false;
+
+    /** Sample the animation clips from Maya's Cached Playback, filling the cache over the sampled range first, waiting at
+     * most cachedPlaybackTimeout seconds? The nodes that can't be cached are evaluated as usual. */
+    bool cachedPlayback = false;
+    double cachedPlaybackTimeout = 0;
+
+    /** Remove the keys of LINEAR animation channels that can be interpolated
+     * from the other keys, within the constant threshold of the path? */
+    bool keyframeReduction = false;
+
+    /** Fit the LINEAR animation channels with CUBICSPLINE samplers, within
+     * the constant threshold of the path? */
+    bool cubicSplineFitting = false;
+
+    /** Resample each LINEAR animation channel at the lowest rate of the clip frame rate divided by 1 up to this divisor that
+     * reproduces its samples within the constant threshold of the path */
+    int adaptiveSampleRate = 1;
+
+    /** Export the keys of transforms driven directly by linear or stepped
+     * anim curves, instead of sampling these each frame? */
+    bool exportAnimCurves = false;
+
+    /** Store rotation and blend shape weight animation outputs as normalized
+     * integers using KHR_mesh_quantization, when within the constant threshold
+     * of the path? */
+    bool quantizeAnimation = false;
+
+    /** Sample all nodes, instead of skipping the nodes that provably never
+     * move? */
+    bool sampleStaticNodes = false;
+
+    /** Sample and finish the clips one at a time, so only the samples of a
+     * single clip are in memory? */
+    bool streamClips = false;
+
+    /** When not empty, the glTF file exported before to add the animation
+     * clips to, without exporting meshes. Relative to the output folder. */
+    MString appendClipsTo;
+
+    /** Store the UUID of the Maya node in the extras of each glTF node? */
+    bool exportNodeUuids = false;
+
+    /** When not empty, the folder to store the samples of the clips in, so
+     * unchanged clips are not sampled again. Relative to the output folder. */
+    MString sampleCacheFolder;
+
+    /** When not 0, the local TCP port of the live link; after the export, the exported nodes are watched, and
+     * exported again when these change, and the changes are pushed to the connected viewers, see LiveLink */
+    int liveLinkPort = 0;
+
+    /** Export from the timer events of Maya, a mesh, camera or clip at a time, so the UI stays responsive, see
+     * Exporter. The command returns before the export is done. */
+    bool async = false;
+
+    /** The MEL procedure called when an -async export is done, with 1 when it succeeded, 0 when it failed or was
+     * cancelled */
+    MString asyncCallback;
+
+    /** When not empty, the folder to store the welded primitives of the
+     * meshes in, so unchanged meshes are not extracted again. Relative to the
+     * output folder. */
+    MString meshCacheFolder;
+
+    /** The number of threads reading the texture files while the meshes are
+     * extracted, 0 to only read these when loaded */
+    int prefetchImageThreads = 0;
+
+    /** The path of the toktx tool, to add KTX2 transcodes of the textures */
+    MString basisuEncoder;
+
+    /** Transcode to UASTC instead of ETC1S? */
+    bool basisuUASTC = false;
+
+    /** The maximum width and height of the base color and emissive textures, 0 for no maximum */
+    int maxColorTextureSize = 0;
+
+    /** The maximum width and height of the normal maps, 0 for no maximum */
+    int maxNormalTextureSize = 0;
+
+    /** The maximum width and height of the occlusion, roughness and metallic textures, 0 for no maximum */
+    int maxOrmTextureSize = 0;
+
+    /** The maximum width and height of the atlases that the small textures are packed into, 0 (the default) doesn't
+     * pack these */
+    int textureAtlasSize = 0;
+
+    /** The number of meshes welded in the background while the next meshes
+     * are extracted, 0 to finish each mesh before extracting the next */
+    int meshPipelineDepth = 0;
+
+    /** When not empty, the file to write the time spent per export phase to,
+     * as a Chrome trace. Relative to the output folder. */
+    MString profileReport;
+
+    /** When not empty, the file to write the sizes of the exported meshes,
+     * clips, buffers and images to. Relative to the output folder. */
+    MString statisticsReport;
+
+    /** When not empty, the file to record the inputs of the welding and
+     * animation kernels to, for tools/KernelBenchmark. Relative to the
+     * output folder. */
+    MString recordKernelInputs;
+
+    /** Writes a glTF file per top-level node or per reference instead of a
+     * single file, from a single pass over the scene and the timeline */
+    AssetSplit splitAssets = AssetSplit::NONE;
+
+    /** When not empty, the folder shared by exports to write the buffers and
+     * images to, once per hash of their bytes. Relative to the output folder. */
+    MString contentStore;
+
+    /** Warn when the accessors of a mesh have more bytes, 0 for no budget */
+    int meshByteBudget = 0;
+
+    /** Warn when the accessors of an animation clip have more bytes, 0 for no budget */
+    int clipByteBudget = 0;
+
+    /** Warn when a written buffer has more bytes, 0 for no budget */
+    int bufferByteBudget = 0;
+
+    /** Warn when a written image has more bytes, 0 for no budget */
+    int imageByteBudget = 0;
+
     /** Generate debug tangent vector lines? */
     bool debugTangentVectors = false;
 
@@ -178,9 +455,37 @@ class Arguments {
     /** Ignore all skin clusters */
     bool skipSkinClusters = false;
 
+    /** Drop the skin weights of a vertex below this, and rescale the others to the same total.
+     * The largest weight of a vertex is always kept. */
+    double minInfluenceWeight = 0;
+
+    /** Keep at most this many joints with the largest skin weights per vertex, 0 for no limit.
+     * The kept weights are rescaled to the same total. */
+    int maxInfluences = 0;
+
+    /** Split the meshes with a skin of more joints in parts that use at most this many joints, each with its own
+     * skin with a palette of the joints. 0 (the default) doesn't split */
+    int maxSkinJoints = 0;
+
+    /** Drop the joints of a skin that no vertex is weighted to, and remap the joint indices */
+    bool compactSkinJoints = false;
+
+    /** Let meshes bound to the same joints with the same inverse bind matrices share a single skin */
+    bool shareSkins = false;
+
     /** Ignore all blend shapes */
     bool skipBlendShapes = false;
 
+    /** Read the blend shape target offsets directly from the blendShape deformer, instead of evaluating the
+     * deformer chain for each target. Targets that can't be read that way are still evaluated. Only used when
+     * POSITION is the only blend shape primitive attribute */
+    bool sparseBlendShapeExtraction = false;
+
+    /** Compute the normals and tangents of the evaluated blend shape targets from their positions, with the
+     * topology and smoothing of the main shape, instead of asking Maya for these. Only the points of the
+     * targets are evaluated */
+    bool recomputeBlendShapeNormals = false;
+
     /** Ignore these mesh deformers. By default the deformer closest to the
      * displayed mesh is used. */
     MSelectionList ignoreMeshDeformers;
@@ -213,6 +518,9 @@ class Arguments {
      * mesh buffer per animation scene */
     bool hashBufferURIs = false;
 
+    /** The hash used with hashBufferURIs */
+    BufferURIHash bufferURIHash = BufferURIHash::SHA256;
+
     /**
      * The time where the 'initial values' of all nodes are to be found (aka
      * neutral base pose) By default the current time is used, unless animation
@@ -250,6 +558,24 @@ class Arguments {
     /** Consider a blend shape weight animation path as constant if all values are below this threshold */
     double constantWeightsThreshold = 1e-9;
 
+    /** Write the morph target attributes as sparse accessors when they take at most this fraction of the dense
+     * size, e.g. 1 means whenever sparse is smaller. Zero (the default) disables sparse accessors */
+    double sparseMorphTargets = 0;
+
+    /** With meshQuantization, store the morph target deltas as normalized integers. The position deltas use int8
+     * or int16, whichever keeps the rounding error within this tolerance, in the units of the exported positions.
+     * Zero (the default) keeps the deltas as floats */
+    double morphTargetQuantization = 0;
+
+    /** How much validation is done while exporting. FAST skips the checks
+     * that cost time on large scenes. By default FULL */
+    Diagnostics diagnostics = Diagnostics::FULL;
+
+    /** The maximum number of items a diagnostic collects and reports, like
+     * the invalid tangents of a mesh, or the skewed sample times of a node.
+     * By default 10 */
+    int maxDiagnosticItems = 10;
+
     std::vector<AnimClipArg> animationClips;
 
     /** Copyright text of the exported file */
@@ -268,8 +594,13 @@ class Arguments {
   private:
     DISALLOW_COPY_MOVE_ASSIGN(Arguments);
 
+    /** Selects the shapes of the DAG path, and of its descendants in a single pass over its subtree. The DAG path itself
+     * must be visible already, unless the invisible nodes are included; the subtrees of invisible descendants are skipped. */
     static void select(Selection &shapeSelection, Selection &cameraSelection, const MDagPath &dagPath, bool includeDescendants,
-                       bool visibleNodesOnly);
+                       bool includeInvisibleNodes);
+
+    /** Selects the mesh or camera, or the shapes directly below the transform */
+    static void selectShapes(Selection &shapeSelection, Selection &cameraSelection, const MDagPath &dagPath);
 
     std::ofstream m_mayaOutputFileStream;
     std::ofstream m_gltfOutputFileStream;
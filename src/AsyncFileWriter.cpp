@@ -0,0 +1,79 @@
+#include "externals.h"
+
+#include "AsyncFileWriter.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+
+AsyncFileWriter::AsyncFileWriter(const size_t threadCount) : m_threadCount(threadCount) {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    TaskScheduler::instance().waitUntil([this] { return isIdle(); });
+}
+
+void AsyncFileWriter::submit(Job job) {
+    if (m_threadCount == 0) {
+        ProfileScope profileScope("File write");
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.emplace_back(std::move(job));
+
+        if (m_runningTaskCount >= m_threadCount)
+            return;
+
+        ++m_runningTaskCount;
+    }
+
+    TaskScheduler::instance().submit([this]() { work(); });
+}
+
+void AsyncFileWriter::join() {
+    TaskScheduler::instance().waitUntil([this] { return isIdle(); });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_error) {
+        auto error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+bool AsyncFileWriter::isIdle() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.empty() && m_runningTaskCount == 0;
+}
+
+void AsyncFileWriter::work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_jobs.empty()) {
+        auto job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            ProfileScope profileScope("File write");
+            job();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+
+        if (error && !m_error) {
+            m_error = error;
+        }
+    }
+
+    --m_runningTaskCount;
+    lock.unlock();
+
+    // The writer can be gone already, only the scheduler is used.
+    TaskScheduler::instance().notifyWaiters();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "macros.h"
+
+/**
+ * Writes output files on at most threadCount workers of the TaskScheduler
+ * at once, so the latency of each write overlaps with the work of the main
+ * thread, and with the other writes. Without threads, the jobs run when
+ * submitted.
+ *
+ * The jobs must NOT call into the Maya API, which is not thread-safe, and
+ * the data they write must stay alive until join returns.
+ */
+class AsyncFileWriter {
+  public:
+    typedef std::function<void()> Job;
+
+    explicit AsyncFileWriter(size_t threadCount);
+
+    /** Waits for the pending jobs, ignoring their errors */
+    ~AsyncFileWriter();
+
+    void submit(Job job);
+
+    /** Waits for all jobs, and rethrows the first error of a job */
+    void join();
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(AsyncFileWriter);
+
+    const size_t m_threadCount;
+
+    std::mutex m_mutex;
+    std::deque<Job> m_jobs;
+    size_t m_runningTaskCount = 0;
+    std::exception_ptr m_error;
+
+    bool isIdle();
+
+    // Runs the queued jobs one after the other, on a worker.
+    void work();
+};
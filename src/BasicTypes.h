@@ -24,26 +24,46 @@ const std::array<T, N> &&reinterpret_array(const T (&items)[N]) {
     return std::move(*reinterpret_cast<const std::array<T, N> *>(items));
 }
 
-// const double posPrecision = 1e6;
-// const double dirPrecision = 1e4;
-// const double colPrecision = 1e4;
-// const double texPrecision = 1e4;
-// const double sclPrecision = 1e4;
-// const double matPrecision = 1e6;
-
-const double posPrecision = 1e9;
-const double dirPrecision = 1e9;
-const double colPrecision = 1e9;
-const double texPrecision = 1e9;
-const double sclPrecision = 1e9;
-const double matPrecision = 1e9;
-
-inline double roundTo(const double v, const double precision) {
-    return round(v * precision) / precision;
+/** The grid of 10^-decimals that values are rounded to. Rounding multiplies
+ * by the scale and the step, so it doesn't divide. With negative decimals,
+ * the values are not rounded. */
+struct RoundingGrid {
+    int decimals;
+    double scale;
+    double step;
+
+    explicit RoundingGrid(const int decimals)
+        : decimals(decimals), scale(decimals < 0 ? 0 : std::pow(10.0, decimals)),
+          step(decimals < 0 ? 0 : std::pow(10.0, -decimals)) {}
+
+    bool isRounding() const { return decimals >= 0; }
+};
+
+/** The grids per kind of value, see -positionDecimals and the other
+ * decimals arguments. The directions are the normals, tangents and
+ * rotations. */
+struct RoundingGrids {
+    RoundingGrid position{9};
+    RoundingGrid direction{9};
+    RoundingGrid color{9};
+    RoundingGrid texCoord{9};
+    RoundingGrid scale{9};
+    RoundingGrid matrix{9};
+};
+
+/** The grids of the running export, set by Exporter. Read by the worker
+ * threads, so only changed between exports. Copy the grid before long loops. */
+inline RoundingGrids &currentRoundingGrids() {
+    static RoundingGrids grids;
+    return grids;
+}
+
+inline double roundTo(const double v, const RoundingGrid &grid) {
+    return grid.isRounding() ? std::round(v * grid.scale) * grid.step : v;
 }
 
-inline float roundToFloat(const double v, const double precision) {
-    const auto f = static_cast<float>(roundTo(v, precision));
+inline float roundToFloat(const double v, const RoundingGrid &grid) {
+    const auto f = static_cast<float>(roundTo(v, grid));
 
     // Convert -0 to 0.  Needed to get consistent output when hashing the binary
     // buffers
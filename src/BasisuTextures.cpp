@@ -0,0 +1,145 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "BasisuTextures.h"
+#include "MayaException.h"
+#include "jsonPatch.h"
+#include "parallel.h"
+
+BasisuTextures::BasisuTextures(const Arguments &args) : m_args(args), m_workers(parallelThreadCount()) {}
+
+BasisuTextures::~BasisuTextures() = default;
+
+void BasisuTextures::add(const GLTF::Texture *texture, const fs::path &sourcePath, const fs::path &cachedPath) {
+    auto &imagePtr = m_imagePerCachedPath[cachedPath.generic_string()];
+    if (!imagePtr) {
+        imagePtr = std::make_unique<BasisuImage>();
+        imagePtr->sourcePath = sourcePath;
+        imagePtr->cachedPath = cachedPath;
+
+        auto *image = imagePtr.get();
+        m_workers.submit([this, image]() { transcode(*image); });
+    }
+
+    m_textures[texture] = imagePtr.get();
+}
+
+void BasisuTextures::transcode(BasisuImage &image) const {
+    std::error_code error;
+    if (exists(image.cachedPath, error)) {
+        image.isTranscoded = true;
+        return;
+    }
+
+    create_directories(image.cachedPath.parent_path(), error);
+
+    // Written under another name first, so an interrupted transcode is never
+    // reused. toktx picks the file format from the extension, so keep it.
+    auto tempPath = image.cachedPath;
+    tempPath.replace_extension(".tmp.ktx2");
+
+    std::ostringstream command;
+    command << '"' << m_args.basisuEncoder.asChar() << "\" --t2 --genmipmap --encode "
+            << (m_args.basisuUASTC ? "uastc" : "etc1s") << " \"" << tempPath.string() << "\" \""
+            << image.sourcePath.string() << '"';
+
+#ifdef _WIN32
+    // cmd.exe strips the outer quotes of the command.
+    const auto commandLine = '"' + command.str() + '"';
+#else
+    const auto commandLine = command.str();
+#endif
+
+    if (std::system(commandLine.c_str()) == 0 && exists(tempPath, error)) {
+        fs::rename(tempPath, image.cachedPath, error);
+        image.isTranscoded = !error;
+    }
+
+    if (!image.isTranscoded) {
+        fs::remove(tempPath, error);
+    }
+}
+
+void BasisuTextures::finish(const fs::path &outputFolder) {
+    if (m_imagePerCachedPath.empty())
+        return;
+
+    cout << prefix << "Waiting for " << m_imagePerCachedPath.size() << " KTX2 texture transcodes..." << endl;
+    m_workers.join();
+
+    std::set<std::string> uris;
+
+    for (auto &pair : m_imagePerCachedPath) {
+        auto &image = *pair.second;
+        if (!image.isTranscoded) {
+            MayaException::printWarning(formatted("Failed to transcode image '%s' to KTX2 with '%s', only the original image is used",
+                                                  image.sourcePath.string().c_str(), m_args.basisuEncoder.asChar()));
+            continue;
+        }
+
+        // Different sources can have the same filename.
+        const auto stem = image.sourcePath.stem().string();
+        image.uri = stem + ".ktx2";
+        for (int suffix = 1; !uris.insert(image.uri).second; ++suffix) {
+            image.uri = stem + "-" + std::to_string(suffix) + ".ktx2";
+        }
+
+        std::error_code error;
+        if (!fs::copy_file(image.cachedPath, outputFolder / image.uri, fs::copy_options::overwrite_existing, error)) {
+            MayaException::printWarning(formatted("Failed to copy the KTX2 texture '%s'", image.uri.c_str()));
+            image.isTranscoded = false;
+        }
+    }
+}
+
+void BasisuTextures::patchJSON(rapidjson::Document &document) const {
+    if (!document.HasMember("textures"))
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    if (!document.HasMember("images")) {
+        document.AddMember("images", rapidjson::Value(rapidjson::kArrayType), allocator);
+    }
+
+    auto &jsonImages = document["images"];
+    auto &jsonTextures = document["textures"];
+
+    std::map<const BasisuImage *, int> imageIds;
+    bool hasTranscodedTexture = false;
+
+    for (auto &pair : m_textures) {
+        const auto *texture = pair.first;
+        const auto *image = pair.second;
+
+        if (!image->isTranscoded || texture->id < 0 || texture->id >= static_cast<int>(jsonTextures.Size()))
+            continue;
+
+        auto imageIdIt = imageIds.find(image);
+        if (imageIdIt == imageIds.end()) {
+            rapidjson::Value jsonImage(rapidjson::kObjectType);
+            jsonImage.AddMember("uri", rapidjson::Value(image->uri.c_str(), allocator), allocator);
+            jsonImage.AddMember("mimeType", "image/ktx2", allocator);
+
+            imageIdIt = imageIds.emplace(image, static_cast<int>(jsonImages.Size())).first;
+            jsonImages.PushBack(jsonImage, allocator);
+        }
+
+        rapidjson::Value jsonBasisu(rapidjson::kObjectType);
+        jsonBasisu.AddMember("source", imageIdIt->second, allocator);
+
+        auto &jsonTexture = jsonTextures[texture->id];
+
+        if (!jsonTexture.HasMember("extensions")) {
+            jsonTexture.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        jsonTexture["extensions"].AddMember("KHR_texture_basisu", jsonBasisu, allocator);
+        hasTranscodedTexture = true;
+    }
+
+    // Clients without the extension use the original images.
+    if (hasTranscodedTexture) {
+        addExtensionUsed(document, "KHR_texture_basisu", false);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "AsyncFileWriter.h"
+#include "filesystem.h"
+#include "macros.h"
+
+class Arguments;
+
+/** The KTX2 transcode of a source image */
+struct BasisuImage {
+    fs::path sourcePath;
+    fs::path cachedPath;
+
+    // The filename in the output folder, set by finish.
+    std::string uri;
+
+    // Set by the worker, read after joining it.
+    bool isTranscoded = false;
+};
+
+/**
+ * Transcodes the images of the textures to KTX2 with Basis Universal
+ * supercompression, using KHR_texture_basisu. The original image stays the
+ * source of the texture, as a fallback for clients without the extension.
+ *
+ * The tree doesn't link Basis Universal, so the images are transcoded by the
+ * external toktx tool of KTX-Software, on worker threads while the scene is
+ * extracted. The transcodes are kept in the image cache folder, and reused
+ * until the source image changes.
+ *
+ * The KTX2 files are always written next to the glTF file, also when the
+ * fallback images are embedded.
+ */
+class BasisuTextures {
+  public:
+    explicit BasisuTextures(const Arguments &args);
+    ~BasisuTextures();
+
+    /** Starts transcoding the image of the texture, unless that was done
+     * before, into the given cached path. */
+    void add(const GLTF::Texture *texture, const fs::path &sourcePath, const fs::path &cachedPath);
+
+    bool empty() const { return m_textures.empty(); }
+
+    /** Waits for the transcodes, and copies these into the output folder */
+    void finish(const fs::path &outputFolder);
+
+    /** Adds the KTX2 images and the extension to the textures of the JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(BasisuTextures);
+
+    void transcode(BasisuImage &image) const;
+
+    const Arguments &m_args;
+
+    std::map<std::string, std::unique_ptr<BasisuImage>> m_imagePerCachedPath;
+    std::map<const GLTF::Texture *, BasisuImage *> m_textures;
+
+    // Declared last, so the workers stop before the images go.
+    AsyncFileWriter m_workers;
+};
@@ -0,0 +1,72 @@
+#include "externals.h"
+
+#include "BlendShapeWeights.h"
+#include "MayaException.h"
+
+BlendShapeWeights::BlendShapeWeights() = default;
+
+BlendShapeWeights::~BlendShapeWeights() = default;
+
+BlendShapeWeights::Slot BlendShapeWeights::add(const MPlug &weightPlug) {
+    MStatus status;
+
+    const auto arrayPlug = weightPlug.array(&status);
+    THROW_ON_FAILURE(status);
+
+    // A deformer has a single weight array, so only a few arrays are expected.
+    auto it = std::find_if(m_arrays.begin(), m_arrays.end(),
+                           [&](const WeightArray &array) { return array.plug == arrayPlug; });
+
+    if (it == m_arrays.end()) {
+        m_arrays.push_back({arrayPlug, {}, 0});
+        it = m_arrays.end() - 1;
+    }
+
+    return {static_cast<size_t>(it - m_arrays.begin()), weightPlug.logicalIndex(), weightPlug};
+}
+
+float BlendShapeWeights::weight(const Slot &slot) {
+    auto &array = m_arrays.at(slot.arrayIndex);
+
+    if (array.stamp != m_stamp) {
+        read(array);
+        array.stamp = m_stamp;
+    }
+
+    const auto value = slot.logicalIndex < array.values.size() ? array.values[slot.logicalIndex] : NAN;
+    if (!std::isnan(value))
+        return value;
+
+    // Not in the data block, e.g. never set, so fall back to the element plug.
+    float weight;
+    THROW_ON_FAILURE(slot.plug.getValue(weight));
+    return weight;
+}
+
+void BlendShapeWeights::read(WeightArray &array) const {
+    MStatus status;
+
+    // Evaluates the whole array at the current time, or in the current context.
+    auto handle = array.plug.asMDataHandle(&status);
+    THROW_ON_FAILURE(status);
+
+    std::fill(array.values.begin(), array.values.end(), NAN);
+
+    MArrayDataHandle arrayHandle(handle, &status);
+    if (status) {
+        const auto count = arrayHandle.elementCount();
+        for (unsigned i = 0; i < count; ++i) {
+            if (!arrayHandle.jumpToArrayElement(i))
+                break;
+
+            const auto logicalIndex = arrayHandle.elementIndex();
+            if (logicalIndex >= array.values.size()) {
+                array.values.resize(logicalIndex + 1, NAN);
+            }
+
+            array.values[logicalIndex] = arrayHandle.inputValue().asFloat();
+        }
+    }
+
+    array.plug.destructHandle(handle);
+}
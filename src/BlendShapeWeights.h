@@ -0,0 +1,48 @@
+#pragma once
+
+#include "macros.h"
+
+/**
+ * Reads the blend shape weights of all exported meshes.
+ *
+ * Each deformer's weight array plug is read in one go the first time one of
+ * its weights is needed after a reset, and the values are shared by all
+ * meshes driven by that deformer. Reading the individual weight plugs costs
+ * a plug evaluation per weight, which adds up for rigs with many targets.
+ */
+class BlendShapeWeights {
+  public:
+    /** Identifies a single weight of a deformer */
+    struct Slot {
+        size_t arrayIndex;
+        unsigned logicalIndex;
+        MPlug plug;
+    };
+
+    BlendShapeWeights();
+    ~BlendShapeWeights();
+
+    /** Registers the weight plug, an element of a deformer's weight array */
+    Slot add(const MPlug &weightPlug);
+
+    /** Forgets the weights read before, must be called when the time changes */
+    void reset() { ++m_stamp; }
+
+    /** The weight at the current evaluation time */
+    float weight(const Slot &slot);
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(BlendShapeWeights);
+
+    struct WeightArray {
+        MPlug plug;
+        // Indexed by logical index, NaN for missing elements.
+        std::vector<float> values;
+        unsigned stamp = 0;
+    };
+
+    void read(WeightArray &array) const;
+
+    std::vector<WeightArray> m_arrays;
+    unsigned m_stamp = 1;
+};
@@ -0,0 +1,158 @@
+#include "externals.h"
+
+#include "AccessorPacker.h"
+#include "Arguments.h"
+#include "BufferHash.h"
+#include "Profiler.h"
+#include "fasthash.h"
+#include "parallel.h"
+#include "picosha2.h"
+
+// The tree hashes split the buffer into chunks of this size.
+const size_t hashChunkByteLength = 4 << 20;
+
+// Large enough for SHA-256, the fast hash uses the first 16 bytes.
+typedef std::array<uint8_t, 32> ChunkDigest;
+
+static size_t digestByteLength(const BufferURIHash kind) { return kind == BufferURIHash::FAST128 ? 16 : 32; }
+
+static void hashChunk(const BufferURIHash kind, const byte *data, const size_t byteLength, ChunkDigest &digest) {
+    if (kind == BufferURIHash::FAST128) {
+        // The names are persisted, so the words are little-endian on any host.
+        const uint64_t words[2] = {fasthash::hashBytes(data, byteLength, 0), fasthash::hashBytes(data, byteLength, ~0ULL)};
+        for (size_t i = 0; i < 16; ++i) {
+            digest[i] = static_cast<uint8_t>(words[i / 8] >> (i % 8 * 8));
+        }
+    } else {
+        picosha2::hash256(data, data + byteLength, digest.begin(), digest.end());
+    }
+}
+
+/**
+ * Splits the bytes that are passed in pieces into chunks. Chunks that are
+ * within a single piece are hashed from the piece itself, other chunks are
+ * gathered first. The chunks are hashed in parallel batches, in order.
+ */
+class ChunkHasher {
+  public:
+    explicit ChunkHasher(const BufferURIHash kind) : m_kind(kind) {}
+
+    void process(const byte *data, size_t byteLength) {
+        if (!m_partial.empty()) {
+            const auto n = std::min(byteLength, hashChunkByteLength - m_partial.size());
+            m_partial.insert(m_partial.end(), data, data + n);
+            data += n;
+            byteLength -= n;
+
+            if (m_partial.size() == hashChunkByteLength) {
+                m_gathered.emplace_back(std::move(m_partial));
+                m_partial.clear();
+                addChunk(m_gathered.back().data(), hashChunkByteLength);
+            }
+        }
+
+        bool hasDirectChunks = false;
+        while (byteLength >= hashChunkByteLength) {
+            addChunk(data, hashChunkByteLength);
+            hasDirectChunks = true;
+            data += hashChunkByteLength;
+            byteLength -= hashChunkByteLength;
+        }
+
+        if (byteLength > 0) {
+            m_partial.reserve(hashChunkByteLength);
+            m_partial.assign(data, data + byteLength);
+        }
+
+        // The piece is only valid during this call.
+        if (hasDirectChunks || m_pending.size() >= parallelThreadCount()) {
+            flush();
+        }
+    }
+
+    std::string finish() {
+        if (!m_partial.empty()) {
+            addChunk(m_partial.data(), m_partial.size());
+        }
+        flush();
+
+        // Hash the digests of the chunks, and the total length.
+        const auto chunkDigestByteLength = digestByteLength(m_kind);
+        std::vector<byte> digests;
+        digests.reserve(m_digests.size() * chunkDigestByteLength + sizeof(uint64_t));
+        for (auto &&digest : m_digests) {
+            digests.insert(digests.end(), digest.begin(), digest.begin() + chunkDigestByteLength);
+        }
+
+        const auto totalByteLength = static_cast<uint64_t>(m_totalByteLength);
+        const auto lengthBytes = reinterpret_cast<const byte *>(&totalByteLength);
+        digests.insert(digests.end(), lengthBytes, lengthBytes + sizeof(totalByteLength));
+
+        ChunkDigest root;
+        hashChunk(m_kind, digests.data(), digests.size(), root);
+
+        std::string hex;
+        picosha2::bytes_to_hex_string(root.begin(), root.begin() + chunkDigestByteLength, hex);
+        return hex;
+    }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ChunkHasher);
+
+    struct Chunk {
+        const byte *data;
+        size_t byteLength;
+        size_t index;
+    };
+
+    const BufferURIHash m_kind;
+
+    std::vector<byte> m_partial;
+    std::vector<std::vector<byte>> m_gathered;
+    std::vector<Chunk> m_pending;
+    std::vector<ChunkDigest> m_digests;
+    size_t m_totalByteLength = 0;
+
+    void addChunk(const byte *data, const size_t byteLength) {
+        m_pending.push_back({data, byteLength, m_digests.size()});
+        m_digests.emplace_back();
+        m_totalByteLength += byteLength;
+    }
+
+    void flush() {
+        parallelForEach(m_pending.size(), 1, [&](const size_t i) {
+            const auto &chunk = m_pending[i];
+            hashChunk(m_kind, chunk.data, chunk.byteLength, m_digests[chunk.index]);
+        });
+
+        m_pending.clear();
+        m_gathered.clear();
+    }
+};
+
+std::string hashBuffer(const AccessorPacker &packer, const GLTF::Buffer *buffer, const BufferURIHash kind) {
+    ProfileScope profileScope("Buffer hashing", buffer->byteLength);
+
+    if (kind == BufferURIHash::SHA256) {
+        picosha2::hash256_one_by_one hasher;
+        packer.writeBuffer(buffer, [&](const byte *data, size_t byteLength) { hasher.process(data, data + byteLength); });
+        hasher.finish();
+        return picosha2::get_hash_hex_string(hasher);
+    }
+
+    ChunkHasher hasher(kind);
+    packer.writeBuffer(buffer, [&](const byte *data, size_t byteLength) { hasher.process(data, byteLength); });
+    return hasher.finish();
+}
+
+std::string hashBytes(const byte *data, const size_t byteLength, const BufferURIHash kind) {
+    ProfileScope profileScope("Buffer hashing", byteLength);
+
+    if (kind == BufferURIHash::SHA256) {
+        return picosha2::hash256_hex_string(data, data + byteLength);
+    }
+
+    ChunkHasher hasher(kind);
+    hasher.process(data, byteLength);
+    return hasher.finish();
+}
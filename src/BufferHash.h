@@ -0,0 +1,14 @@
+#pragma once
+
+#include "BasicTypes.h"
+
+class AccessorPacker;
+enum class BufferURIHash;
+
+/** Hashes the bytes of the buffer, as written by the packer, to a hex string.
+ * The tree hashes split the buffer into chunks that are hashed in parallel,
+ * and hash their digests; these differ from a plain hash of the bytes. */
+std::string hashBuffer(const AccessorPacker &packer, const GLTF::Buffer *buffer, BufferURIHash kind);
+
+/** Hashes the bytes to a hex string, like hashBuffer */
+std::string hashBytes(const byte *data, size_t byteLength, BufferURIHash kind);
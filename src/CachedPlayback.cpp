@@ -0,0 +1,52 @@
+#include "externals.h"
+
+#include "CachedPlayback.h"
+#include "Profiler.h"
+#include "dump.h"
+
+CachedPlayback::CachedPlayback(const MTime &startTime, const MTime &endTime, const double timeoutSeconds)
+    : m_minTime(MAnimControl::minTime()), m_maxTime(MAnimControl::maxTime()) {
+#if MAYA_API_VERSION >= 20190000
+    MStringArray modes;
+    MGlobal::executeCommand("evaluationManager -query -mode", modes);
+    if (modes.length() == 0 || modes[0] == "off") {
+        cerr << prefix << "WARNING: Cached playback requires the parallel or serial evaluation mode, sampling live"
+             << endl;
+        return;
+    }
+
+    int isCacheEnabled = 0;
+    MGlobal::executeCommand("evaluator -query -name \"cache\" -enable", isCacheEnabled);
+    m_wasCacheEnabled = isCacheEnabled != 0;
+
+    if (!m_wasCacheEnabled && !MGlobal::executeCommand("evaluator -name \"cache\" -enable 1")) {
+        cerr << prefix << "WARNING: Failed to enable cached playback, sampling live" << endl;
+        return;
+    }
+
+    m_isEnabled = true;
+
+    ProfileScope profileScope("Cached playback fill");
+
+    cout << prefix << "Filling the evaluation cache from frame " << startTime.as(MTime::uiUnit()) << " to "
+         << endTime.as(MTime::uiUnit()) << "..." << endl;
+
+    MAnimControl::setMinMaxTime(startTime, endTime);
+
+    // The frames that are not cached yet after the timeout are evaluated live.
+    MGlobal::executeCommand(formatted("cacheEvaluator -waitForCache %g", std::max(0.0, timeoutSeconds)).c_str());
+#else
+    cerr << prefix << "WARNING: Cached playback requires Maya 2019 or later, sampling live" << endl;
+#endif
+}
+
+CachedPlayback::~CachedPlayback() {
+    if (!m_isEnabled)
+        return;
+
+    MAnimControl::setMinMaxTime(m_minTime, m_maxTime);
+
+    if (!m_wasCacheEnabled) {
+        MGlobal::executeCommand("evaluator -name \"cache\" -enable 0");
+    }
+}
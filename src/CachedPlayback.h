@@ -0,0 +1,34 @@
+#pragma once
+
+#include "macros.h"
+
+/**
+ * While in scope, Maya's Cached Playback caches the evaluation of the scene
+ * over a time range, see -cachedPlayback. The evaluation manager fills the
+ * cache in the background using all cores, and changing the current time to
+ * a cached frame then restores the cached values instead of evaluating the
+ * rigs again. The nodes that can't be cached, and the times between the
+ * cached frames, are still evaluated as usual.
+ *
+ * The cache is filled over the playback range, so that range is changed to
+ * the sampled range while in scope. Requires Maya 2019 or later, and an
+ * evaluation manager mode other than DG; otherwise this does nothing.
+ */
+class CachedPlayback {
+  public:
+    /** Fills the cache from the start to the end time, waiting at most
+     * timeoutSeconds for the background fill */
+    CachedPlayback(const MTime &startTime, const MTime &endTime, double timeoutSeconds);
+
+    /** Restores the playback range, and disables the cache when it wasn't
+     * enabled before */
+    ~CachedPlayback();
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(CachedPlayback);
+
+    const MTime m_minTime;
+    const MTime m_maxTime;
+    bool m_isEnabled = false;
+    bool m_wasCacheEnabled = false;
+};
@@ -0,0 +1,275 @@
+#include "externals.h"
+
+#include "BasicTypes.h"
+#include "ClipAppender.h"
+#include "dump.h"
+#include "jsonPatch.h"
+#include "jsonWriter.h"
+
+typedef rapidjson::Document::AllocatorType Allocator;
+
+/** Returns the array member, adding it when missing */
+static rapidjson::Value &arrayMember(rapidjson::Document &document, const char *name) {
+    if (!document.HasMember(name)) {
+        document.AddMember(rapidjson::StringRef(name), rapidjson::Value(rapidjson::kArrayType), document.GetAllocator());
+    }
+
+    return document[name];
+}
+
+static bool hasExtensionIn(const rapidjson::Value &document, const char *member, const char *name) {
+    if (!document.HasMember(member))
+        return false;
+
+    for (auto &existing : document[member].GetArray()) {
+        if (existing.IsString() && strcmp(existing.GetString(), name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+ClipAppender::ClipAppender(fs::path path) : m_path(std::move(path)) {
+    std::ifstream file(m_path.string(), ios::in | ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error(formatted("Couldn't read the glTF file '%s' to append the clips to", m_path.string().c_str()));
+
+    std::stringstream json;
+    json << file.rdbuf();
+
+    const auto text = json.str();
+    if (m_document.Parse(text.c_str(), text.size()).HasParseError() || !m_document.IsObject())
+        throw std::runtime_error(formatted("Failed to parse the glTF file '%s'", m_path.string().c_str()));
+
+    if (m_document.HasMember("buffers")) {
+        for (auto &jsonBuffer : m_document["buffers"].GetArray()) {
+            if (jsonBuffer.HasMember("uri") && jsonBuffer["uri"].IsString()) {
+                m_bufferPaths.insert((m_path.parent_path() / jsonBuffer["uri"].GetString()).lexically_normal());
+            }
+        }
+    }
+
+    if (!m_document.HasMember("nodes"))
+        return;
+
+    const auto &jsonNodes = m_document["nodes"].GetArray();
+
+    for (rapidjson::SizeType id = 0; id < jsonNodes.Size(); ++id) {
+        const auto &jsonNode = jsonNodes[id];
+
+        if (jsonNode.HasMember("extras") && jsonNode["extras"].HasMember("mayaUuid") && jsonNode["extras"]["mayaUuid"].IsString()) {
+            m_nodesPerUuid[jsonNode["extras"]["mayaUuid"].GetString()] = static_cast<int>(id);
+        }
+
+        if (jsonNode.HasMember("name") && jsonNode["name"].IsString()) {
+            const std::string name = jsonNode["name"].GetString();
+            if (!m_nodesPerName.emplace(name, static_cast<int>(id)).second) {
+                m_ambiguousNames.insert(name);
+            }
+        }
+    }
+
+    for (auto &&name : m_ambiguousNames) {
+        cerr << prefix << "WARNING: Multiple nodes in " << m_path << " are named '" << name
+             << "', these are only matched by UUID" << endl;
+        m_nodesPerName.erase(name);
+    }
+}
+
+ClipAppender::~ClipAppender() = default;
+
+int ClipAppender::findNode(const NodeKey &key) const {
+    if (!key.uuid.empty()) {
+        const auto it = m_nodesPerUuid.find(key.uuid);
+        if (it != m_nodesPerUuid.end())
+            return it->second;
+    }
+
+    if (!key.name.empty()) {
+        const auto it = m_nodesPerName.find(key.name);
+        if (it != m_nodesPerName.end())
+            return it->second;
+    }
+
+    return -1;
+}
+
+std::string ClipAppender::uniqueBufferUri(std::string name, const fs::path &bufferFolder) {
+    makeValidFilename(name);
+
+    const auto base = m_path.stem().string() + "_" + name;
+
+    for (int suffix = 1;; ++suffix) {
+        auto uri = base + (suffix > 1 ? std::to_string(suffix) : "") + ".bin";
+
+        const auto path = (bufferFolder / uri).lexically_normal();
+        std::error_code errorCode;
+        if (m_bufferPaths.count(path) == 0 && !fs::exists(path, errorCode)) {
+            m_bufferPaths.insert(path);
+            return uri;
+        }
+    }
+}
+
+size_t ClipAppender::append(const rapidjson::Document &exported, const std::vector<NodeKey> &nodeKeys,
+                            const fs::path &bufferFolder) {
+    if (!exported.HasMember("animations"))
+        return 0;
+
+    auto &allocator = m_document.GetAllocator();
+
+    // The URIs of the new buffers are relative to the folder of the existing file.
+    const auto uriPrefix = fs::relative(bufferFolder, m_path.parent_path()).generic_string();
+
+    // The ids of the copied objects, per id in the exported JSON.
+    std::map<int, int> bufferIds;
+    std::map<int, int> bufferViewIds;
+    std::map<int, int> accessorIds;
+
+    const auto copyObject = [&](const char *member, const int exportedId, std::map<int, int> &ids,
+                                const std::function<void(rapidjson::Value &)> &remap) {
+        const auto it = ids.find(exportedId);
+        if (it != ids.end())
+            return it->second;
+
+        rapidjson::Value copy(exported[member][static_cast<rapidjson::SizeType>(exportedId)], allocator);
+        remap(copy);
+
+        auto &objects = arrayMember(m_document, member);
+        const auto id = static_cast<int>(objects.Size());
+        objects.PushBack(copy, allocator);
+        ids[exportedId] = id;
+        return id;
+    };
+
+    const auto bufferId = [&](const int exportedId) {
+        return copyObject("buffers", exportedId, bufferIds, [&](rapidjson::Value &jsonBuffer) {
+            if (jsonBuffer.HasMember("uri") && !uriPrefix.empty() && uriPrefix != ".") {
+                const auto uri = uriPrefix + "/" + jsonBuffer["uri"].GetString();
+                jsonBuffer["uri"].SetString(uri.c_str(), static_cast<rapidjson::SizeType>(uri.size()), allocator);
+            }
+        });
+    };
+
+    const auto bufferViewId = [&](const int exportedId) {
+        return copyObject("bufferViews", exportedId, bufferViewIds, [&](rapidjson::Value &jsonView) {
+            jsonView["buffer"] = bufferId(jsonView["buffer"].GetInt());
+
+            if (jsonView.HasMember("extensions") && jsonView["extensions"].HasMember("EXT_meshopt_compression")) {
+                auto &jsonMeshopt = jsonView["extensions"]["EXT_meshopt_compression"];
+                jsonMeshopt["buffer"] = bufferId(jsonMeshopt["buffer"].GetInt());
+            }
+        });
+    };
+
+    const auto accessorId = [&](const int exportedId) {
+        return copyObject("accessors", exportedId, accessorIds, [&](rapidjson::Value &jsonAccessor) {
+            if (jsonAccessor.HasMember("bufferView")) {
+                jsonAccessor["bufferView"] = bufferViewId(jsonAccessor["bufferView"].GetInt());
+            }
+
+            if (jsonAccessor.HasMember("sparse")) {
+                auto &jsonSparse = jsonAccessor["sparse"];
+                jsonSparse["indices"]["bufferView"] = bufferViewId(jsonSparse["indices"]["bufferView"].GetInt());
+                jsonSparse["values"]["bufferView"] = bufferViewId(jsonSparse["values"]["bufferView"].GetInt());
+            }
+        });
+    };
+
+    std::set<std::string> existingNames;
+    if (m_document.HasMember("animations")) {
+        for (auto &jsonAnimation : m_document["animations"].GetArray()) {
+            if (jsonAnimation.HasMember("name")) {
+                existingNames.insert(jsonAnimation["name"].GetString());
+            }
+        }
+    }
+
+    size_t channelCount = 0;
+
+    for (auto &exportedAnimation : exported["animations"].GetArray()) {
+        const std::string name = exportedAnimation.HasMember("name") ? exportedAnimation["name"].GetString() : "";
+
+        rapidjson::Value jsonChannels(rapidjson::kArrayType);
+        rapidjson::Value jsonSamplers(rapidjson::kArrayType);
+
+        // Only the samplers of the matched channels are copied.
+        std::map<int, int> samplerIds;
+        std::set<std::string> unmatchedNodes;
+
+        for (auto &exportedChannel : exportedAnimation["channels"].GetArray()) {
+            const auto exportedNodeId = exportedChannel["target"]["node"].GetInt();
+            const auto &key = nodeKeys.at(static_cast<size_t>(exportedNodeId));
+
+            const auto nodeId = findNode(key);
+            if (nodeId < 0) {
+                unmatchedNodes.insert(key.name);
+                continue;
+            }
+
+            const auto exportedSamplerId = exportedChannel["sampler"].GetInt();
+
+            auto samplerIt = samplerIds.find(exportedSamplerId);
+            if (samplerIt == samplerIds.end()) {
+                rapidjson::Value jsonSampler(exportedAnimation["samplers"][static_cast<rapidjson::SizeType>(exportedSamplerId)], allocator);
+                jsonSampler["input"] = accessorId(jsonSampler["input"].GetInt());
+                jsonSampler["output"] = accessorId(jsonSampler["output"].GetInt());
+
+                samplerIt = samplerIds.emplace(exportedSamplerId, static_cast<int>(jsonSamplers.Size())).first;
+                jsonSamplers.PushBack(jsonSampler, allocator);
+            }
+
+            rapidjson::Value jsonChannel(exportedChannel, allocator);
+            jsonChannel["sampler"] = samplerIt->second;
+            jsonChannel["target"]["node"] = nodeId;
+            jsonChannels.PushBack(jsonChannel, allocator);
+        }
+
+        for (auto &&nodeName : unmatchedNodes) {
+            cerr << prefix << "WARNING: Node '" << nodeName << "' is not found in " << m_path << ", skipping its channels of clip '"
+                 << name << "'" << endl;
+        }
+
+        if (jsonChannels.Empty()) {
+            cerr << prefix << "WARNING: No node of clip '" << name << "' is found in " << m_path << ", the clip is not appended" << endl;
+            continue;
+        }
+
+        if (existingNames.count(name)) {
+            cerr << prefix << "WARNING: " << m_path << " already has a clip named '" << name << "', appending another one" << endl;
+        }
+
+        channelCount += jsonChannels.Size();
+
+        rapidjson::Value jsonAnimation(rapidjson::kObjectType);
+        if (!name.empty()) {
+            jsonAnimation.AddMember("name", rapidjson::Value(name.c_str(), allocator), allocator);
+        }
+        jsonAnimation.AddMember("channels", jsonChannels, allocator);
+        jsonAnimation.AddMember("samplers", jsonSamplers, allocator);
+
+        arrayMember(m_document, "animations").PushBack(jsonAnimation, allocator);
+    }
+
+    // E.g. KHR_mesh_quantization for quantized clips.
+    if (exported.HasMember("extensionsUsed")) {
+        for (auto &extension : exported["extensionsUsed"].GetArray()) {
+            const auto name = extension.GetString();
+            addExtensionUsed(m_document, name, hasExtensionIn(exported, "extensionsRequired", name));
+        }
+    }
+
+    return channelCount;
+}
+
+void ClipAppender::write() const {
+    std::ofstream file(m_path.string(), ios::out);
+    if (!file.is_open())
+        throw std::runtime_error(formatted("Couldn't write to '%s'", m_path.string().c_str()));
+
+    rapidjson::OStreamWrapper streamWrapper(file);
+    rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+    writeJSONDocument(m_document, writer);
+
+    file << endl;
+}
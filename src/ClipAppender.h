@@ -0,0 +1,62 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+/** Identifies an exported glTF node: the name and UUID of its Maya node,
+ * with the suffix of the extra node of a complex transform. */
+struct NodeKey {
+    std::string name;
+    std::string uuid;
+};
+
+/**
+ * Adds the animation clips of an export to a glTF file that was exported
+ * before, without exporting the meshes again.
+ *
+ * The animation channels target the nodes of the existing file, matched by
+ * the Maya UUID stored with -exportNodeUuids, or else by their unique name.
+ * The accessors, buffer views and buffers of the clips are appended, the
+ * data of the existing file is left as is.
+ */
+class ClipAppender {
+  public:
+    /** Loads the glTF JSON, throws when it can't be read */
+    explicit ClipAppender(fs::path path);
+    ~ClipAppender();
+
+    const fs::path &path() const { return m_path; }
+
+    /** Does the existing file have a node with this key? */
+    bool hasNode(const NodeKey &key) const { return findNode(key) >= 0; }
+
+    /** Appends the animations of the exported JSON, mapping its nodes with
+     * the given keys, indexed by node id. The buffer URIs are relative to
+     * the buffer folder. Returns the number of appended channels. */
+    size_t append(const rapidjson::Document &exported, const std::vector<NodeKey> &nodeKeys,
+                  const fs::path &bufferFolder);
+
+    /** A URI for an appended buffer in the buffer folder that no buffer of
+     * the existing file uses, and no file in the folder has. The name is
+     * prefixed with the name of the existing file. */
+    std::string uniqueBufferUri(std::string name, const fs::path &bufferFolder);
+
+    /** Overwrites the existing file with the updated JSON */
+    void write() const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ClipAppender);
+
+    /** The node id in the existing file, -1 if not found */
+    int findNode(const NodeKey &key) const;
+
+    const fs::path m_path;
+    rapidjson::Document m_document;
+
+    std::map<std::string, int> m_nodesPerUuid;
+    std::map<std::string, int> m_nodesPerName;
+    std::set<std::string> m_ambiguousNames;
+
+    // The buffer paths of the existing file and of the appended buffers.
+    std::set<fs::path> m_bufferPaths;
+};
@@ -0,0 +1,128 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "CachedPlayback.h"
+#include "ClipScheduler.h"
+#include "ExportableClip.h"
+#include "ExportableResources.h"
+#include "Profiler.h"
+#include "Transform.h"
+#include "progress.h"
+#include "timeControl.h"
+
+// The smallest time step of Maya.
+const double mayaTicksPerSecond = 141120000;
+
+ClipScheduler::ClipScheduler(ExportableResources &resources, const size_t nodeCount)
+    : m_resources(resources), m_args(resources.arguments()), m_nodeCount(nodeCount) {}
+
+ClipScheduler::~ClipScheduler() = default;
+
+void ClipScheduler::addClip(ExportableClip *clip) {
+    if (!clip->needsSampling())
+        return;
+
+    const auto frameCount = clip->frameCount();
+    const auto stepDetectSampleCount = clip->stepDetectSampleCount();
+
+    m_samples.reserve(m_samples.size() + frameCount * stepDetectSampleCount);
+
+    for (size_t relativeFrameIndex = 0; relativeFrameIndex < frameCount; ++relativeFrameIndex) {
+        for (size_t superSampleIndex = 0; superSampleIndex < stepDetectSampleCount; ++superSampleIndex) {
+            const auto time = clip->sampleTime(relativeFrameIndex, superSampleIndex);
+
+            // The sample times are half a tick past a tick, so rounding down
+            // makes the same time of different clips get the same tick.
+            const auto tick = static_cast<int64_t>(std::floor(time.as(MTime::kSeconds) * mayaTicksPerSecond));
+
+            m_samples.push_back({tick, time, clip, relativeFrameIndex, superSampleIndex});
+        }
+    }
+}
+
+void ClipScheduler::beginSampling() {
+    assert(!m_isSampling);
+
+    m_profileScope = std::make_unique<ProfileScope>("Clip sampling");
+
+    // A stable sort keeps the samples of each clip in order, and the clips
+    // in the order they were added.
+    std::stable_sort(m_samples.begin(), m_samples.end(),
+                     [](const Sample &a, const Sample &b) { return a.tick < b.tick; });
+
+    m_isSampling = true;
+    m_nextSampleIndex = 0;
+    m_evaluatedTimeCount = 0;
+
+    // With cached playback, the samples restore the cached frames instead of
+    // evaluating the rigs, the cache is filled in the background first.
+    if (m_args.cachedPlayback && !m_samples.empty()) {
+        m_cachedPlayback = std::make_unique<CachedPlayback>(m_samples.front().time, m_samples.back().time,
+                                                            m_args.cachedPlaybackTimeout);
+    }
+
+    // Reused for all times, to avoid allocations in the sampling loop. The
+    // fast diagnostics don't check the skew of every node at every time.
+    m_transformCache = std::make_unique<NodeTransformCache>(m_args.contextSampling, m_nodeCount,
+                                                            m_args.diagnostics == Diagnostics::FULL);
+}
+
+bool ClipScheduler::sampleNextTime() {
+    assert(m_isSampling);
+
+    if (m_nextSampleIndex == m_samples.size()) {
+        endSampling();
+        return false;
+    }
+
+    const auto begin = m_samples.begin() + m_nextSampleIndex;
+    const auto end = std::find_if(begin, m_samples.end(), [&](const Sample &s) { return s.tick != begin->tick; });
+
+    const auto shouldRedraw = std::any_of(begin, end, [](const Sample &s) { return s.superSampleIndex == 0; });
+
+    // With context sampling, the exported nodes are evaluated at the sample time, the scene time doesn't change.
+    std::unique_ptr<ScopedEvaluationTime> evaluationTime;
+    if (m_args.contextSampling) {
+        evaluationTime = std::make_unique<ScopedEvaluationTime>(begin->time);
+    } else {
+        setCurrentTime(begin->time, m_args.redrawViewport && shouldRedraw);
+    }
+
+    // Many times can pass between the progress steps.
+    uiCheckCancelled();
+
+    auto &transformCache = *m_transformCache;
+    transformCache.reset();
+    m_resources.blendShapeWeights().reset();
+
+    for (auto it = begin; it != end; ++it) {
+        auto &clip = *it->clip;
+        clip.sampleAt(begin->time, it->relativeFrameIndex, it->superSampleIndex, transformCache);
+
+        const auto frameCount = clip.frameCount();
+
+        if (it->superSampleIndex == clip.stepDetectSampleCount() - 1 &&
+            it->relativeFrameIndex % checkProgressFrameInterval == checkProgressFrameInterval - 1) {
+            uiAdvanceProgress("exporting clip '" + clip.clipArg().name +
+                              formatted("' %d%%", it->relativeFrameIndex * 100 / frameCount));
+        }
+    }
+
+    ++m_evaluatedTimeCount;
+    m_nextSampleIndex = static_cast<size_t>(end - m_samples.begin());
+    return true;
+}
+
+void ClipScheduler::endSampling() {
+    if (m_evaluatedTimeCount < m_samples.size()) {
+        cout << prefix << "Evaluated " << m_evaluatedTimeCount << " unique times for " << m_samples.size()
+             << " clip samples" << endl;
+    }
+
+    m_transformCache.reset();
+    m_cachedPlayback.reset();
+    m_profileScope.reset();
+
+    m_samples.clear();
+    m_isSampling = false;
+}
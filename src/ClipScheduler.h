@@ -0,0 +1,65 @@
+#pragma once
+
+#include "macros.h"
+
+class Arguments;
+class CachedPlayback;
+class ExportableClip;
+class ExportableResources;
+class NodeTransformCache;
+class ProfileScope;
+
+/**
+ * Samples all animation clips in a single pass over the timeline.
+ *
+ * The sample times of all clips are merged, so times shared by overlapping
+ * clips are evaluated once, and the samples are handed to each clip that
+ * needs them. The times are visited in increasing order, so the samples of
+ * each clip are still taken in order. Each time is sampled in its own step,
+ * so an -async export can return to Maya between the times.
+ */
+class ClipScheduler {
+  public:
+    ClipScheduler(ExportableResources &resources, size_t nodeCount);
+    ~ClipScheduler();
+
+    void addClip(ExportableClip *clip);
+
+    /** Starts sampling the added clips, see sampleNextTime */
+    void beginSampling();
+
+    /** Evaluates the next unique sample time, and samples the clips that
+     * need it. Returns false when all times are sampled. */
+    bool sampleNextTime();
+
+    /** Between beginSampling and the last sampleNextTime */
+    bool isSampling() const { return m_isSampling; }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ClipScheduler);
+
+    struct Sample {
+        // The sample time, in Maya time ticks.
+        int64_t tick;
+        MTime time;
+        ExportableClip *clip;
+        size_t relativeFrameIndex;
+        size_t superSampleIndex;
+    };
+
+    ExportableResources &m_resources;
+    const Arguments &m_args;
+    const size_t m_nodeCount;
+    std::vector<Sample> m_samples;
+
+    // The state of the sampling, between the steps.
+    bool m_isSampling = false;
+    size_t m_nextSampleIndex = 0;
+    size_t m_evaluatedTimeCount = 0;
+    std::unique_ptr<ProfileScope> m_profileScope;
+    std::unique_ptr<CachedPlayback> m_cachedPlayback;
+    std::unique_ptr<NodeTransformCache> m_transformCache;
+
+    /** Reports the statistics and frees the samples */
+    void endSampling();
+};
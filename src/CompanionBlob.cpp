@@ -0,0 +1,236 @@
+#include "externals.h"
+
+#include "CompanionBlob.h"
+#include "MeshQuantization.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+// The elements of strided accessors are copied in chunks of this many bytes.
+const size_t chunkByteLength = 1 << 16;
+
+static const char *streamKindName(const blobs::StreamKind kind) {
+    switch (kind) {
+    case blobs::StreamKind::VERTEX_ATTRIBUTE:
+        return "vertexAttribute";
+    case blobs::StreamKind::MORPH_TARGET:
+        return "morphTarget";
+    case blobs::StreamKind::INDICES:
+        return "indices";
+    case blobs::StreamKind::INVERSE_BIND_MATRICES:
+        return "inverseBindMatrices";
+    case blobs::StreamKind::JOINT_PALETTE:
+        return "jointPalette";
+    case blobs::StreamKind::ANIMATION_INPUT:
+        return "animationInput";
+    case blobs::StreamKind::ANIMATION_OUTPUT:
+        return "animationOutput";
+    default:
+        assert(false);
+        return "unknown";
+    }
+}
+
+/** The glTF array of the owner of the streams of the kind */
+static const char *ownerName(const blobs::StreamKind kind) {
+    switch (kind) {
+    case blobs::StreamKind::INVERSE_BIND_MATRICES:
+    case blobs::StreamKind::JOINT_PALETTE:
+        return "skin";
+    case blobs::StreamKind::ANIMATION_INPUT:
+    case blobs::StreamKind::ANIMATION_OUTPUT:
+        return "animation";
+    default:
+        return "mesh";
+    }
+}
+
+CompanionBlob::CompanionBlob(std::ostream &stream, const QuantizedAccessors &quantizedAccessors)
+    : m_stream(stream), m_quantizedAccessors(quantizedAccessors), m_byteLength(0) {
+    // The header is written again by finish, once the table is known.
+    const blobs::FileHeader header{};
+    write(&header, sizeof(header));
+}
+
+CompanionBlob::~CompanionBlob() = default;
+
+void CompanionBlob::addAsset(GLTF::Asset &glAsset, const std::set<GLTF::Accessor *> &accessorSet) {
+    using blobs::StreamKind;
+
+    for (auto *mesh : glAsset.getAllMeshes()) {
+        for (auto *primitive : mesh->primitives) {
+            add(StreamKind::INDICES, primitive->indices, mesh, accessorSet);
+
+            for (auto &&attribute : primitive->attributes) {
+                add(StreamKind::VERTEX_ATTRIBUTE, attribute.second, mesh, accessorSet);
+            }
+
+            for (auto *target : primitive->targets) {
+                for (auto &&attribute : target->attributes) {
+                    add(StreamKind::MORPH_TARGET, attribute.second, mesh, accessorSet);
+                }
+            }
+        }
+    }
+
+    for (auto *skin : glAsset.getAllSkins()) {
+        add(StreamKind::INVERSE_BIND_MATRICES, skin->inverseBindMatrices, skin, accessorSet);
+
+        // The node ids are written by finish.
+        Stream palette{};
+        palette.entry.kind = static_cast<uint32_t>(StreamKind::JOINT_PALETTE);
+        palette.entry.componentType = static_cast<uint32_t>(WebGL::UNSIGNED_INT);
+        palette.entry.componentCount = 1;
+        palette.entry.count = skin->joints.size();
+        palette.entry.byteLength = skin->joints.size() * sizeof(uint32_t);
+        palette.owner = skin;
+        palette.skin = skin;
+        m_streams.emplace_back(palette);
+    }
+
+    for (auto *animation : glAsset.animations) {
+        for (auto *channel : animation->channels) {
+            add(StreamKind::ANIMATION_INPUT, channel->sampler->input, animation, accessorSet);
+            add(StreamKind::ANIMATION_OUTPUT, channel->sampler->output, animation, accessorSet);
+        }
+    }
+}
+
+void CompanionBlob::add(const blobs::StreamKind kind, GLTF::Accessor *accessor, GLTF::Object *owner,
+                        const std::set<GLTF::Accessor *> &accessorSet) {
+    // The Draco compressed accessors have no buffer view.
+    if (!accessor || !accessor->bufferView || !accessor->bufferView->buffer ||
+        !accessor->bufferView->buffer->data || accessorSet.count(accessor) == 0 ||
+        !m_writtenAccessors.insert(accessor).second)
+        return;
+
+    const auto view = accessor->bufferView;
+    const auto componentCount = static_cast<size_t>(accessor->getNumberOfComponents());
+    const auto elementByteLength = componentCount * accessor->getComponentByteLength();
+    const auto byteStride = view->byteStride > 0 ? static_cast<size_t>(view->byteStride) : elementByteLength;
+    const auto count = static_cast<size_t>(accessor->count);
+
+    // With -splitAssets, the accessors saved with a previous asset can refer
+    // to their compressed data already; these can't be read as elements.
+    if (count > 0 && accessor->byteOffset + (count - 1) * byteStride + elementByteLength > size_t(view->byteLength))
+        return;
+
+    align();
+
+    Stream stream{};
+    stream.entry.kind = static_cast<uint32_t>(kind);
+    stream.entry.componentType = static_cast<uint32_t>(accessor->componentType);
+    stream.entry.componentCount = static_cast<uint32_t>(componentCount);
+    stream.entry.isNormalized = m_quantizedAccessors.isNormalized(accessor);
+    stream.entry.count = count;
+    stream.entry.byteOffset = m_byteLength;
+    stream.entry.byteLength = count * elementByteLength;
+    stream.accessor = accessor;
+    stream.owner = owner;
+
+    const auto *elements = view->buffer->data + view->byteOffset + accessor->byteOffset;
+
+    if (byteStride == elementByteLength) {
+        write(elements, count * elementByteLength);
+    } else {
+        // Interleaved elements are packed tightly, a chunk at a time.
+        const auto chunkCount = std::max<size_t>(1, chunkByteLength / elementByteLength);
+        std::vector<byte> chunk(chunkCount * elementByteLength);
+
+        for (size_t begin = 0; begin < count; begin += chunkCount) {
+            const auto end = std::min(count, begin + chunkCount);
+            for (auto index = begin; index < end; ++index) {
+                memcpy(&chunk[(index - begin) * elementByteLength], elements + index * byteStride,
+                       elementByteLength);
+            }
+            write(chunk.data(), (end - begin) * elementByteLength);
+        }
+    }
+
+    m_streams.emplace_back(stream);
+}
+
+void CompanionBlob::finish() {
+    for (auto &stream : m_streams) {
+        if (!stream.skin)
+            continue;
+
+        std::vector<uint32_t> nodeIds;
+        nodeIds.reserve(stream.skin->joints.size());
+        for (const auto *joint : stream.skin->joints) {
+            nodeIds.emplace_back(static_cast<uint32_t>(joint->id));
+        }
+
+        align();
+        stream.entry.byteOffset = m_byteLength;
+        write(nodeIds.data(), nodeIds.size() * sizeof(uint32_t));
+    }
+
+    align();
+
+    blobs::FileHeader header{};
+    std::copy(std::begin(blobs::fileMagic), std::end(blobs::fileMagic), header.magic);
+    header.version = blobs::fileVersion;
+    header.streamCount = static_cast<uint32_t>(m_streams.size());
+    header.tableOffset = m_byteLength;
+
+    for (auto &stream : m_streams) {
+        stream.entry.accessor = stream.accessor ? stream.accessor->id : -1;
+        stream.entry.owner = stream.owner ? stream.owner->id : -1;
+        write(&stream.entry, sizeof(stream.entry));
+    }
+
+    header.byteLength = m_byteLength;
+
+    m_stream.seekp(0);
+    m_stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_stream.seekp(0, std::ios::end);
+}
+
+void CompanionBlob::patchJSON(rapidjson::Document &document, const std::string &uri) const {
+    auto &allocator = document.GetAllocator();
+
+    rapidjson::Value jsonStreams(rapidjson::kArrayType);
+    jsonStreams.Reserve(static_cast<rapidjson::SizeType>(m_streams.size()), allocator);
+
+    for (auto &&stream : m_streams) {
+        const auto &entry = stream.entry;
+
+        rapidjson::Value jsonStream(rapidjson::kObjectType);
+        jsonStream.AddMember(
+            "kind", rapidjson::StringRef(streamKindName(static_cast<blobs::StreamKind>(entry.kind))), allocator);
+        if (entry.accessor >= 0) {
+            jsonStream.AddMember("accessor", entry.accessor, allocator);
+        }
+        if (entry.owner >= 0) {
+            jsonStream.AddMember(rapidjson::StringRef(ownerName(static_cast<blobs::StreamKind>(entry.kind))),
+                                 entry.owner, allocator);
+        }
+        jsonStream.AddMember("byteOffset", entry.byteOffset, allocator);
+        jsonStream.AddMember("byteLength", entry.byteLength, allocator);
+        jsonStreams.PushBack(jsonStream, allocator);
+    }
+
+    rapidjson::Value jsonBlob(rapidjson::kObjectType);
+    jsonBlob.AddMember("uri", rapidjson::Value(uri.c_str(), allocator), allocator);
+    jsonBlob.AddMember("version", blobs::fileVersion, allocator);
+    jsonBlob.AddMember("byteLength", m_byteLength, allocator);
+    jsonBlob.AddMember("alignment", blobs::streamAlignment, allocator);
+    jsonBlob.AddMember("streams", jsonStreams, allocator);
+
+    if (!document.HasMember("extras")) {
+        document.AddMember("extras", rapidjson::Value(rapidjson::kObjectType), allocator);
+    }
+
+    setMember(document["extras"], "companionBlob", std::move(jsonBlob), allocator);
+}
+
+void CompanionBlob::align() {
+    static const char padding[blobs::streamAlignment] = {};
+    write(padding, static_cast<size_t>(blobs::alignedOffset(m_byteLength) - m_byteLength));
+}
+
+void CompanionBlob::write(const void *data, const size_t byteLength) {
+    m_stream.write(static_cast<const char *>(data), static_cast<std::streamsize>(byteLength));
+    m_byteLength += byteLength;
+}
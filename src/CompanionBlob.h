@@ -0,0 +1,62 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "blobLayout.h"
+#include "macros.h"
+
+class QuantizedAccessors;
+
+/**
+ * Writes the companion blob of -companionBlob, see blobLayout.h. The streams
+ * are written from the accessors before these are packed, compressed or
+ * interleaved, so these stay tightly packed. The glTF ids are only known
+ * after the JSON is written, so the joint palettes, the table and the header
+ * are written then, and the table is also added to the extras of the glTF.
+ */
+class CompanionBlob {
+  public:
+    /** Writes to the stream, which must be seekable */
+    CompanionBlob(std::ostream &stream, const QuantizedAccessors &quantizedAccessors);
+    ~CompanionBlob();
+
+    /** Writes the streams of the meshes, skins and animations of the asset,
+     * skipping the accessors that are not in the accessor set */
+    void addAsset(GLTF::Asset &glAsset, const std::set<GLTF::Accessor *> &accessorSet);
+
+    /** Writes the joint palettes, the table and the header. Must be called
+     * after the JSON is written. */
+    void finish();
+
+    /** Adds the table of the streams to the extras of the glTF JSON, with the
+     * URI of the blob */
+    void patchJSON(rapidjson::Document &document, const std::string &uri) const;
+
+    size_t streamCount() const { return m_streams.size(); }
+    uint64_t byteLength() const { return m_byteLength; }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(CompanionBlob);
+
+    struct Stream {
+        blobs::StreamEntry entry;
+        GLTF::Accessor *accessor;
+        GLTF::Object *owner;
+        // The skin of a JOINT_PALETTE stream.
+        GLTF::Skin *skin;
+    };
+
+    std::ostream &m_stream;
+    const QuantizedAccessors &m_quantizedAccessors;
+
+    std::vector<Stream> m_streams;
+    std::set<GLTF::Accessor *> m_writtenAccessors;
+    uint64_t m_byteLength;
+
+    void add(blobs::StreamKind kind, GLTF::Accessor *accessor, GLTF::Object *owner,
+             const std::set<GLTF::Accessor *> &accessorSet);
+
+    /** Pads the stream to the next multiple of the stream alignment */
+    void align();
+
+    void write(const void *data, size_t byteLength);
+};
@@ -0,0 +1,95 @@
+#include "externals.h"
+
+#include "ContentStore.h"
+#include "MayaException.h"
+
+ContentStore::ContentStore(fs::path folder, fs::path outputFolder) : m_folder(std::move(folder)), m_outputFolder(std::move(outputFolder)) {
+    std::error_code error;
+    create_directories(m_folder / "assets", error);
+    if (error)
+        throw std::runtime_error(formatted("Couldn't create the content store folder '%s'", m_folder.string().c_str()));
+
+    static std::atomic<uint64_t> storeCount{0};
+    const auto ticks = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    m_temporarySuffix = formatted(".%llx-%llx.tmp", static_cast<unsigned long long>(ticks), static_cast<unsigned long long>(++storeCount));
+}
+
+ContentStore::~ContentStore() = default;
+
+std::string ContentStore::add(const std::string &hash, const std::string &extension, const size_t byteLength, bool &mustWrite) {
+    const auto blobPath = m_folder / (hash + extension);
+    const auto uri = fs::relative(blobPath, m_outputFolder).generic_string();
+
+    // An asset can use the same blob more than once.
+    const auto isNew = m_uris.insert(uri).second;
+    mustWrite = isNew && !exists(blobPath);
+
+    if (isNew) {
+        m_blobs.push_back({uri, byteLength, mustWrite});
+    }
+
+    return uri;
+}
+
+fs::path ContentStore::temporaryPath(const std::string &uri) const {
+    auto path = m_outputFolder / uri;
+    path += m_temporarySuffix;
+    return path;
+}
+
+void ContentStore::commit(const std::string &uri) const {
+    const auto tempPath = temporaryPath(uri);
+
+    std::error_code error;
+    fs::rename(tempPath, m_outputFolder / uri, error);
+    if (error) {
+        // Another export stored the same bytes meanwhile.
+        fs::remove(tempPath, error);
+    }
+}
+
+void ContentStore::writeManifest(const std::string &assetName, const fs::path &assetPath) const {
+    rapidjson::Document document(rapidjson::kObjectType);
+    auto &allocator = document.GetAllocator();
+
+    document.AddMember("asset", rapidjson::Value(assetPath.generic_string().c_str(), allocator), allocator);
+
+    rapidjson::Value jsonBlobs(rapidjson::kArrayType);
+    for (auto &&blob : m_blobs) {
+        rapidjson::Value jsonBlob(rapidjson::kObjectType);
+        jsonBlob.AddMember("uri", rapidjson::Value(fs::path(blob.uri).filename().generic_string().c_str(), allocator), allocator);
+        jsonBlob.AddMember("byteLength", static_cast<uint64_t>(blob.byteLength), allocator);
+        jsonBlob.AddMember("written", blob.isWritten, allocator);
+        jsonBlobs.PushBack(jsonBlob, allocator);
+    }
+
+    document.AddMember("blobs", jsonBlobs, allocator);
+
+    const auto manifestPath = m_folder / "assets" / (assetName + ".json");
+
+    std::ofstream file(manifestPath.string(), ios::out | ios::trunc);
+    rapidjson::OStreamWrapper streamWrapper(file);
+    rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+    document.Accept(writer);
+
+    if (!file) {
+        MayaException::printWarning(formatted("Failed to write the content store manifest '%s'", manifestPath.string().c_str()));
+    }
+}
+
+void ContentStore::printStatistics() const {
+    size_t writtenCount = 0;
+    size_t writtenByteLength = 0;
+    size_t totalByteLength = 0;
+
+    for (auto &&blob : m_blobs) {
+        totalByteLength += blob.byteLength;
+        if (blob.isWritten) {
+            ++writtenCount;
+            writtenByteLength += blob.byteLength;
+        }
+    }
+
+    cout << prefix << "Content store: wrote " << writtenCount << " of " << m_blobs.size() << " blobs, " << writtenByteLength << " of "
+         << totalByteLength << " bytes" << endl;
+}
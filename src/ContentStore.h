@@ -0,0 +1,59 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+/**
+ * A folder shared by exports, that holds the written buffers and images
+ * once, named after the hash of their bytes, see -contentStore.
+ *
+ * A blob is only written when the store doesn't have it yet. It is written
+ * under a temporary name first, so exports that run at the same time never
+ * read a partial blob, and the last rename wins with the same bytes.
+ *
+ * Each export writes a manifest to the assets sub folder of the store, with
+ * the blobs of the asset, so the store can be garbage collected.
+ */
+class ContentStore {
+  public:
+    /** The blobs are referenced relative to the output folder */
+    ContentStore(fs::path folder, fs::path outputFolder);
+    ~ContentStore();
+
+    /**
+     * Adds the blob with the hash of its bytes and its file extension to the
+     * manifest, and returns its URI relative to the output folder. Returns
+     * true in mustWrite when the store doesn't have it yet.
+     */
+    std::string add(const std::string &hash, const std::string &extension, size_t byteLength, bool &mustWrite);
+
+    /** The file to write a blob that must be written to, see commit */
+    fs::path temporaryPath(const std::string &uri) const;
+
+    /** Moves the written temporary file to the blob. Called by the writers. */
+    void commit(const std::string &uri) const;
+
+    /** Writes the manifest of the asset with the glTF file at the path */
+    void writeManifest(const std::string &assetName, const fs::path &assetPath) const;
+
+    void printStatistics() const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ContentStore);
+
+    struct Blob {
+        std::string uri;
+        size_t byteLength;
+        bool isWritten;
+    };
+
+    const fs::path m_folder;
+    const fs::path m_outputFolder;
+
+    // The blobs of the asset, in order of addition.
+    std::vector<Blob> m_blobs;
+    std::set<std::string> m_uris;
+
+    // Makes the temporary names unique between exports.
+    std::string m_temporarySuffix;
+};
@@ -0,0 +1,269 @@
+#include "externals.h"
+
+#include "CurveDrivenTransform.h"
+#include "ExportableNode.h"
+#include "MayaException.h"
+#include "MayaUtils.h"
+#include "Transform.h"
+
+// glTF slerps rotations along the shortest path, so a linear Euler rotation
+// must not turn too much between two keys: a quarter turn at most.
+const double maxLinearRotationStep = 1.5707963267948966;
+
+static bool isStatic(const MFnTransform &fnTransform, const char *plugName) {
+    MStatus status;
+    const auto plug = fnTransform.findPlug(plugName, true, &status);
+    return !status || !utils::hasInputConnection(plug);
+}
+
+enum class CurveKind { INVALID, CONSTANT, LINEAR, STEP };
+
+/** How the curve interpolates between all of its keys */
+static CurveKind curveKind(const MObject &curve) {
+    MStatus status;
+    MFnAnimCurve fnCurve(curve, &status);
+    THROW_ON_FAILURE(status);
+
+    // A time warp or other input would change the key times.
+    const auto inputPlug = fnCurve.findPlug("input", true, &status);
+    if (status && utils::hasInputConnection(inputPlug))
+        return CurveKind::INVALID;
+
+    if (fnCurve.preInfinityType() != MFnAnimCurve::kConstant || fnCurve.postInfinityType() != MFnAnimCurve::kConstant)
+        return CurveKind::INVALID;
+
+    const auto keyCount = fnCurve.numKeys();
+    if (keyCount < 2)
+        return CurveKind::CONSTANT;
+
+    auto isLinear = true;
+    auto isStep = true;
+
+    for (unsigned i = 0; i + 1 < keyCount; ++i) {
+        const auto outTangent = fnCurve.outTangentType(i);
+        isLinear &= outTangent == MFnAnimCurve::kTangentLinear && fnCurve.inTangentType(i + 1) == MFnAnimCurve::kTangentLinear;
+        isStep &= outTangent == MFnAnimCurve::kTangentStep;
+    }
+
+    return isStep ? CurveKind::STEP : isLinear ? CurveKind::LINEAR : CurveKind::INVALID;
+}
+
+std::unique_ptr<CurveDrivenTransform> CurveDrivenTransform::tryCreate(const ExportableNode &node) {
+    MStatus status;
+
+    if (node.transformKind != TransformKind::Simple)
+        return nullptr;
+
+    const auto &dagPath = node.dagPath;
+
+    // Joints have an orientation, and are often driven by IK.
+    if (!dagPath.hasFn(MFn::kTransform) || dagPath.hasFn(MFn::kJoint))
+        return nullptr;
+
+    // The glTF parent must be the Maya parent, for the local matrix to be
+    // the matrix of the transform.
+    MDagPath mayaParentPath = dagPath;
+    THROW_ON_FAILURE(mayaParentPath.pop());
+    if (!(mayaParentPath == node.parentDagPath()) && !(mayaParentPath.length() == 0 && node.parentDagPath().length() == 0))
+        return nullptr;
+
+    MFnTransform fnTransform(dagPath, &status);
+    if (!status)
+        return nullptr;
+
+    // Everything but the translation, rotation and scaling must be static
+    // and neutral.
+    for (auto plugName : {"rotateOrder", "rotateAxis", "shear", "rotatePivot", "scalePivot", "rotatePivotTranslate",
+                          "scalePivotTranslate", "inheritsTransform", "offsetParentMatrix"}) {
+        if (!isStatic(fnTransform, plugName))
+            return nullptr;
+    }
+
+    bool inheritsTransform = true;
+    const auto inheritsTransformPlug = fnTransform.findPlug("inheritsTransform", true, &status);
+    if (status) {
+        THROW_ON_FAILURE(inheritsTransformPlug.getValue(inheritsTransform));
+    }
+
+    double shear[3];
+    THROW_ON_FAILURE(fnTransform.getShear(shear));
+
+    const auto isNeutral = inheritsTransform && shear[0] == 0 && shear[1] == 0 && shear[2] == 0 &&
+                           fnTransform.rotateOrientation(MSpace::kTransform).isEquivalent(MQuaternion::identity) &&
+                           fnTransform.rotatePivot(MSpace::kTransform) == MPoint::origin &&
+                           fnTransform.scalePivot(MSpace::kTransform) == MPoint::origin &&
+                           fnTransform.rotatePivotTranslation(MSpace::kTransform) == MVector::zero &&
+                           fnTransform.scalePivotTranslation(MSpace::kTransform) == MVector::zero;
+
+    if (!isNeutral)
+        return nullptr;
+
+#if MAYA_API_VERSION >= 20200000
+    const auto offsetParentMatrixPlug = fnTransform.findPlug("offsetParentMatrix", true, &status);
+    if (status && !utils::getMatrix(offsetParentMatrixPlug).isEquivalent(MMatrix::identity))
+        return nullptr;
+#endif
+
+    auto transform = std::make_unique<CurveDrivenTransform>();
+    transform->m_rotationOrder = fnTransform.rotationOrder(&status);
+    THROW_ON_FAILURE(status);
+
+    const char *plugNames[PATH_COUNT][3] = {
+        {"translateX", "translateY", "translateZ"}, {"rotateX", "rotateY", "rotateZ"}, {"scaleX", "scaleY", "scaleZ"}};
+
+    const char *compoundPlugNames[PATH_COUNT] = {"translate", "rotate", "scale"};
+
+    for (int path = 0; path < PATH_COUNT; ++path) {
+        const auto compoundPlug = fnTransform.findPlug(compoundPlugNames[path], true, &status);
+        THROW_ON_FAILURE(status);
+
+        MPlugArray compoundSources;
+        compoundPlug.connectedTo(compoundSources, true, false, &status);
+        if (compoundSources.length() > 0)
+            return nullptr;
+
+        auto hasLinearCurve = false;
+        auto hasStepCurve = false;
+        auto linearCurveCount = 0;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            auto &channel = transform->m_channels[path][axis];
+
+            const auto plug = fnTransform.findPlug(plugNames[path][axis], true, &status);
+            THROW_ON_FAILURE(status);
+
+            MPlugArray sources;
+            plug.connectedTo(sources, true, false, &status);
+
+            if (sources.length() == 0) {
+                THROW_ON_FAILURE(plug.getValue(channel.value));
+                continue;
+            }
+
+            // Expressions, constraints, animation layers, unit conversions...
+            const auto source = sources[0].node();
+            if (sources.length() > 1 ||
+                !(source.hasFn(MFn::kAnimCurveTimeToDistance) || source.hasFn(MFn::kAnimCurveTimeToAngular) ||
+                  source.hasFn(MFn::kAnimCurveTimeToUnitless)))
+                return nullptr;
+
+            switch (curveKind(source)) {
+            case CurveKind::INVALID:
+                return nullptr;
+            case CurveKind::LINEAR:
+                hasLinearCurve = true;
+                ++linearCurveCount;
+                break;
+            case CurveKind::STEP:
+                hasStepCurve = true;
+                break;
+            case CurveKind::CONSTANT:
+                break;
+            }
+
+            channel.curve = source;
+        }
+
+        if (hasLinearCurve && hasStepCurve)
+            return nullptr;
+
+        // Interpolating Euler angles of two axes is not a slerp.
+        if (path == ROTATION && linearCurveCount > 1)
+            return nullptr;
+
+        transform->m_interpolations[path] = hasStepCurve ? "STEP" : "LINEAR";
+    }
+
+    return transform;
+}
+
+double CurveDrivenTransform::evaluate(const Channel &channel, const MTime &time) const {
+    if (channel.curve.isNull())
+        return channel.value;
+
+    MStatus status;
+    MFnAnimCurve fnCurve(channel.curve, &status);
+    THROW_ON_FAILURE(status);
+
+    double value;
+    THROW_ON_FAILURE(fnCurve.evaluate(time, value));
+    return value;
+}
+
+CurveKeys CurveDrivenTransform::keys(const Path path, const MTime &startTime, const MTime &endTime) const {
+    MStatus status;
+
+    CurveKeys keys;
+    keys.interpolation = m_interpolations[path];
+
+    auto &times = keys.times;
+    times.emplace_back(startTime);
+
+    for (auto &&channel : m_channels[path]) {
+        if (channel.curve.isNull())
+            continue;
+
+        MFnAnimCurve fnCurve(channel.curve, &status);
+        THROW_ON_FAILURE(status);
+
+        const auto keyCount = fnCurve.numKeys();
+        for (unsigned i = 0; i < keyCount; ++i) {
+            const auto time = fnCurve.time(i);
+            if (time > startTime && time < endTime) {
+                times.emplace_back(time);
+            }
+        }
+    }
+
+    if (endTime > startTime) {
+        times.emplace_back(endTime);
+    }
+
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+
+    if (path == ROTATION && strcmp(keys.interpolation, "LINEAR") == 0) {
+        // At most one axis is linear, and it is linear between all key times.
+        for (auto &&channel : m_channels[path]) {
+            if (channel.curve.isNull())
+                continue;
+
+            std::vector<MTime> subdividedTimes;
+            subdividedTimes.reserve(times.size());
+
+            for (size_t i = 0; i < times.size(); ++i) {
+                if (i > 0) {
+                    const auto angle = std::abs(evaluate(channel, times[i]) - evaluate(channel, times[i - 1]));
+                    const auto stepCount = static_cast<int>(std::ceil(angle / maxLinearRotationStep));
+
+                    for (int step = 1; step < stepCount; ++step) {
+                        subdividedTimes.emplace_back(times[i - 1] + (times[i] - times[i - 1]) * (double(step) / stepCount));
+                    }
+                }
+
+                subdividedTimes.emplace_back(times[i]);
+            }
+
+            times = std::move(subdividedTimes);
+        }
+    }
+
+    return keys;
+}
+
+void CurveDrivenTransform::getTransform(const MTime &time, const double scaleFactor, GLTF::Node::TransformTRS &trs) const {
+    double values[PATH_COUNT][3];
+
+    for (int path = 0; path < PATH_COUNT; ++path) {
+        for (int axis = 0; axis < 3; ++axis) {
+            values[path][axis] = evaluate(m_channels[path][axis], time);
+        }
+    }
+
+    MTransformationMatrix matrix;
+    THROW_ON_FAILURE(matrix.setScale(values[SCALE], MSpace::kTransform));
+    THROW_ON_FAILURE(matrix.setRotation(values[ROTATION], m_rotationOrder));
+    THROW_ON_FAILURE(matrix.setTranslation(MVector(values[TRANSLATION]), MSpace::kTransform));
+
+    getSimpleTransform(matrix.asMatrix(), scaleFactor, trs);
+}
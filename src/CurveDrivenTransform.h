@@ -0,0 +1,57 @@
+#pragma once
+
+#include "macros.h"
+
+class ExportableNode;
+
+/** The key times of a TRS path, and how glTF must interpolate them */
+struct CurveKeys {
+    const char *interpolation = "LINEAR";
+    std::vector<MTime> times;
+};
+
+/**
+ * A plain transform whose translation, rotation and scaling are static or
+ * driven directly by time based anim curves, without constraints,
+ * expressions or other nodes in between.
+ *
+ * The keys of such a transform can be exported directly, instead of sampling
+ * each frame, but only when glTF interpolates them exactly like Maya:
+ * linear or stepped translation and scaling curves, stepped rotation curves,
+ * and linear rotation around a single Euler axis. Otherwise tryCreate
+ * returns null, and the node must be sampled.
+ */
+class CurveDrivenTransform {
+  public:
+    enum Path { TRANSLATION, ROTATION, SCALE, PATH_COUNT };
+
+    CurveDrivenTransform() = default;
+    ~CurveDrivenTransform() = default;
+
+    static std::unique_ptr<CurveDrivenTransform> tryCreate(const ExportableNode &node);
+
+    /** The times of the keys of the path between the start and end time,
+     * including these. Linear rotations get extra keys, so glTF never
+     * rotates more than a quarter turn between two keys. */
+    CurveKeys keys(Path path, const MTime &startTime, const MTime &endTime) const;
+
+    /** Evaluates the curves, the result matches the sampled local transform */
+    void getTransform(const MTime &time, double scaleFactor, GLTF::Node::TransformTRS &trs) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(CurveDrivenTransform);
+
+    struct Channel {
+        // The value of a static channel
+        double value = 0;
+
+        // Null for a static channel
+        MObject curve;
+    };
+
+    double evaluate(const Channel &channel, const MTime &time) const;
+
+    Channel m_channels[PATH_COUNT][3];
+    const char *m_interpolations[PATH_COUNT] = {"LINEAR", "LINEAR", "LINEAR"};
+    MTransformationMatrix::RotationOrder m_rotationOrder = MTransformationMatrix::kXYZ;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+/** Identifies a DAG path by its node and instance number, so it can be
+ * looked up without building its path name */
+struct DagPathKey {
+    explicit DagPathKey(const MDagPath &dagPath) : handle(dagPath.node()), instanceNumber(dagPath.instanceNumber()) {}
+
+    MObjectHandle handle;
+    unsigned instanceNumber;
+
+    bool operator==(const DagPathKey &other) const { return instanceNumber == other.instanceNumber && handle == other.handle; }
+};
+
+struct DagPathKeyHasher {
+    size_t operator()(const DagPathKey &key) const {
+        return std::hash<uint64_t>()(static_cast<uint64_t>(key.handle.hashCode()) << 32 | key.instanceNumber);
+    }
+};
+
+struct MObjectHandleHasher {
+    size_t operator()(const MObjectHandle &handle) const { return handle.hashCode(); }
+};
+
+/**
+ * A set of DAG paths, hashed by DagPathKey. After sort, the paths are
+ * iterated in the order of their full path names, as these are exported;
+ * the names are only built once per path.
+ */
+class Selection {
+  public:
+    typedef std::vector<MDagPath>::const_iterator const_iterator;
+
+    /** Returns false when the set has the path already */
+    bool insert(const MDagPath &dagPath) {
+        if (!m_keys.emplace(dagPath).second)
+            return false;
+
+        m_paths.push_back(dagPath);
+        return true;
+    }
+
+    bool contains(const MDagPath &dagPath) const { return m_keys.count(DagPathKey(dagPath)) > 0; }
+
+    size_t size() const { return m_paths.size(); }
+    bool empty() const { return m_paths.empty(); }
+
+    const MDagPath &operator[](const size_t index) const { return m_paths[index]; }
+
+    const_iterator begin() const { return m_paths.begin(); }
+    const_iterator end() const { return m_paths.end(); }
+
+    /** Orders the paths by full path name */
+    void sort() {
+        std::vector<std::pair<std::string, size_t>> names;
+        names.reserve(m_paths.size());
+
+        for (size_t i = 0; i < m_paths.size(); ++i) {
+            names.emplace_back(m_paths[i].fullPathName().asChar(), i);
+        }
+
+        std::sort(names.begin(), names.end());
+
+        std::vector<MDagPath> sortedPaths;
+        sortedPaths.reserve(m_paths.size());
+
+        for (auto &&pair : names) {
+            sortedPaths.push_back(m_paths[pair.second]);
+        }
+
+        m_paths.swap(sortedPaths);
+    }
+
+  private:
+    std::unordered_set<DagPathKey, DagPathKeyHasher> m_keys;
+    std::vector<MDagPath> m_paths;
+};
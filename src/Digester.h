@@ -0,0 +1,56 @@
+#pragma once
+
+#include "picosha2.h"
+
+/** Hashes plain values, strings and arrays with SHA-256, for keys that are
+ * persisted, see SampleCache and MeshCache */
+class Digester {
+  public:
+    template <typename T> void add(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values are hashed");
+        addBytes(&value, sizeof(T));
+    }
+
+    void add(const std::string &text) {
+        add(static_cast<uint64_t>(text.size()));
+        addBytes(text.data(), text.size());
+    }
+
+    void add(const MString &text) { add(std::string(text.asChar())); }
+
+    void add(const GLTF::Node::TransformTRS &trs) {
+        add(trs.translation);
+        add(trs.rotation);
+        add(trs.scale);
+    }
+
+    /** Adds the length and the elements of a Maya array */
+    template <typename Array> void addArray(const Array &array) {
+        const auto length = array.length();
+        add(length);
+        for (unsigned i = 0; i < length; ++i) {
+            add(array[i]);
+        }
+    }
+
+    void addBytes(const void *data, const size_t byteLength) {
+        const auto bytes = static_cast<const unsigned char *>(data);
+        m_hasher.process(bytes, bytes + byteLength);
+    }
+
+    /** The raw bytes of the digest */
+    std::string digest() {
+        m_hasher.finish();
+        std::string bytes(picosha2::k_digest_size, '\0');
+        m_hasher.get_hash_bytes(bytes.begin(), bytes.end());
+        return bytes;
+    }
+
+    std::string hexDigest() {
+        m_hasher.finish();
+        return picosha2::get_hash_hex_string(m_hasher);
+    }
+
+  private:
+    picosha2::hash256_one_by_one m_hasher;
+};
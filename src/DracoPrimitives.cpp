@@ -0,0 +1,211 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "DracoPrimitives.h"
+#include "MayaException.h"
+#include "accessors.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+static draco::GeometryAttribute::Type dracoAttributeType(const Semantic::Kind semantic) {
+    switch (semantic) {
+    case Semantic::POSITION:
+        return draco::GeometryAttribute::POSITION;
+    case Semantic::NORMAL:
+        return draco::GeometryAttribute::NORMAL;
+    case Semantic::COLOR:
+        return draco::GeometryAttribute::COLOR;
+    case Semantic::TEXCOORD:
+        return draco::GeometryAttribute::TEX_COORD;
+    default:
+        // Tangents and skinning attributes
+        return draco::GeometryAttribute::GENERIC;
+    }
+}
+
+DracoPrimitives::DracoPrimitives() = default;
+
+DracoPrimitives::~DracoPrimitives() = default;
+
+bool DracoPrimitives::compress(const std::string &name, GLTF::Accessor *indices, const gsl::span<const Index> &indexData,
+                               const size_t vertexCount, const std::vector<DracoAttribute> &attributes,
+                               const bool preserveVertexOrder, const Arguments &args) {
+    const auto triangleCount = indexData.size() / 3;
+
+    draco::Mesh mesh;
+    mesh.set_num_points(static_cast<uint32_t>(vertexCount));
+    mesh.SetNumFaces(triangleCount);
+
+    for (size_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+        draco::Mesh::Face face;
+        for (int corner = 0; corner < 3; ++corner) {
+            face[corner] = draco::PointIndex(static_cast<uint32_t>(indexData[triangleIndex * 3 + corner]));
+        }
+        mesh.SetFace(draco::FaceIndex(static_cast<uint32_t>(triangleIndex)), face);
+    }
+
+    auto primitive = std::make_unique<DracoPrimitive>();
+    primitive->indices = indices;
+
+    for (auto &&attribute : attributes) {
+        const auto dim = dimension(attribute.semantic, ShapeIndex::main());
+        const auto isFloat = Component::type(attribute.semantic) == Component::FLOAT;
+        const auto elementByteSize = dim * (isFloat ? sizeof(float) : sizeof(uint16_t));
+
+        assert(size_t(attribute.data.size()) == elementByteSize * vertexCount);
+
+        draco::GeometryAttribute geometryAttribute;
+        geometryAttribute.Init(dracoAttributeType(attribute.semantic), nullptr, static_cast<int8_t>(dim),
+                               isFloat ? draco::DT_FLOAT32 : draco::DT_UINT16, false,
+                               static_cast<int64_t>(elementByteSize), 0);
+
+        const auto attributeId = mesh.AddAttribute(geometryAttribute, true, static_cast<uint32_t>(vertexCount));
+        auto *pointAttribute = mesh.attribute(attributeId);
+
+        for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+            pointAttribute->SetAttributeValue(draco::AttributeValueIndex(static_cast<uint32_t>(vertexIndex)),
+                                              &attribute.data[vertexIndex * elementByteSize]);
+        }
+
+        primitive->attributeIds[attribute.name] = static_cast<int>(pointAttribute->unique_id());
+        primitive->attributes.emplace_back(attribute.accessor);
+    }
+
+    draco::Encoder encoder;
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION, args.dracoPositionBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::NORMAL, args.dracoNormalBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD, args.dracoTexcoordBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::COLOR, args.dracoColorBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::GENERIC, args.dracoGenericBits);
+    encoder.SetSpeedOptions(args.dracoSpeed, args.dracoSpeed);
+
+    // The edgebreaker reorders the vertices, which would break the morph
+    // targets, as these are not compressed.
+    if (preserveVertexOrder) {
+        encoder.SetEncodingMethod(draco::MESH_SEQUENTIAL_ENCODING);
+    }
+
+    draco::EncoderBuffer buffer;
+    const auto status = encoder.EncodeMeshToBuffer(mesh, &buffer);
+    if (!status.ok()) {
+        MayaException::printWarning(
+            formatted("Failed to compress primitive '%s' with Draco: %s", name.c_str(), status.error_msg()));
+        return false;
+    }
+
+    primitive->data.assign(buffer.data(), buffer.data() + buffer.size());
+
+    // Only the compressed data is packed, so the bounds of the accessors
+    // are computed from their uncompressed data now.
+    if (args.allAccessorBounds) {
+        requireBounds(indices);
+    }
+    computeBounds(indices);
+    for (auto accessor : primitive->attributes) {
+        computeBounds(accessor);
+    }
+
+    primitive->dataAccessor = contiguousAccessor(name + "/draco", GLTF::Accessor::Type::SCALAR, WebGL::UNSIGNED_BYTE,
+                                                 static_cast<WebGL>(-1), span(primitive->data), 1);
+
+    m_accessorToPrimitive[indices] = primitive.get();
+    for (auto accessor : primitive->attributes) {
+        m_accessorToPrimitive[accessor] = primitive.get();
+    }
+
+    m_primitives.emplace_back(std::move(primitive));
+
+    return true;
+}
+
+std::vector<GLTF::Accessor *> DracoPrimitives::substitute(const std::vector<GLTF::Accessor *> &accessors) const {
+    std::vector<GLTF::Accessor *> result;
+    result.reserve(accessors.size());
+
+    for (auto accessor : accessors) {
+        const auto it = m_accessorToPrimitive.find(accessor);
+        if (it == m_accessorToPrimitive.end()) {
+            result.emplace_back(accessor);
+        } else if (it->second->indices == accessor) {
+            result.emplace_back(it->second->dataAccessor.get());
+        }
+    }
+
+    return result;
+}
+
+void DracoPrimitives::finishPacking() const {
+    for (auto &&primitive : m_primitives) {
+        // The compressed accessors need some buffer view for the glTF writer,
+        // patchJSON removes the reference again. Pointing to the compressed
+        // data makes sure that view is written.
+        const auto dataView = primitive->dataAccessor->bufferView;
+        const auto dataOffset = primitive->dataAccessor->byteOffset;
+
+        primitive->indices->bufferView = dataView;
+        primitive->indices->byteOffset = dataOffset;
+
+        for (auto accessor : primitive->attributes) {
+            accessor->bufferView = dataView;
+            accessor->byteOffset = dataOffset;
+        }
+    }
+}
+
+void DracoPrimitives::patchJSON(rapidjson::Document &document) const {
+    if (m_primitives.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    auto &jsonAccessors = document["accessors"];
+
+    // Each primitive has its own indices accessor, so that identifies it.
+    std::map<int, const DracoPrimitive *> primitivePerIndicesId;
+
+    for (auto &&primitive : m_primitives) {
+        primitivePerIndicesId[primitive->indices->id] = primitive.get();
+
+        jsonAccessors[primitive->indices->id].RemoveMember("bufferView");
+        jsonAccessors[primitive->indices->id].RemoveMember("byteOffset");
+
+        for (auto accessor : primitive->attributes) {
+            jsonAccessors[accessor->id].RemoveMember("bufferView");
+            jsonAccessors[accessor->id].RemoveMember("byteOffset");
+        }
+    }
+
+    if (!document.HasMember("meshes"))
+        return;
+
+    for (auto &jsonMesh : document["meshes"].GetArray()) {
+        for (auto &jsonPrimitive : jsonMesh["primitives"].GetArray()) {
+            if (!jsonPrimitive.HasMember("indices"))
+                continue;
+
+            const auto it = primitivePerIndicesId.find(jsonPrimitive["indices"].GetInt());
+            if (it == primitivePerIndicesId.end())
+                continue;
+
+            const auto &primitive = *it->second;
+
+            rapidjson::Value jsonAttributes(rapidjson::kObjectType);
+            for (auto &&pair : primitive.attributeIds) {
+                jsonAttributes.AddMember(rapidjson::Value(pair.first.c_str(), allocator), pair.second, allocator);
+            }
+
+            rapidjson::Value jsonDraco(rapidjson::kObjectType);
+            jsonDraco.AddMember("bufferView", primitive.dataAccessor->bufferView->id, allocator);
+            jsonDraco.AddMember("attributes", jsonAttributes, allocator);
+
+            if (!jsonPrimitive.HasMember("extensions")) {
+                jsonPrimitive.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+            }
+
+            jsonPrimitive["extensions"].AddMember("KHR_draco_mesh_compression", jsonDraco, allocator);
+        }
+    }
+
+    addExtensionUsed(document, "KHR_draco_mesh_compression", true);
+}
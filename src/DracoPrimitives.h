@@ -0,0 +1,70 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "MeshSemantics.h"
+#include "macros.h"
+#include "sceneTypes.h"
+
+class Arguments;
+
+/** A vertex attribute of a primitive to compress with Draco */
+struct DracoAttribute {
+    std::string name;
+    Semantic::Kind semantic;
+    GLTF::Accessor *accessor;
+    gsl::span<const byte> data;
+};
+
+/**
+ * A primitive compressed using KHR_draco_mesh_compression. Its index and
+ * vertex attribute accessors are kept for the count, min and max, but their
+ * data is replaced by the compressed buffer view when saving.
+ */
+struct DracoPrimitive {
+    GLTF::Accessor *indices = nullptr;
+    std::vector<GLTF::Accessor *> attributes;
+    std::map<std::string, int> attributeIds;
+
+    std::vector<byte> data;
+
+    // Carries the compressed data, so it gets packed like any accessor.
+    std::unique_ptr<GLTF::Accessor> dataAccessor;
+};
+
+/**
+ * Keeps track of the Draco compressed primitives of the asset.
+ * Morph target attributes are not compressed, as the extension requires; the
+ * vertex order is then preserved by using the sequential encoding.
+ * The JSON is patched after it is written, like for sparse accessors.
+ */
+class DracoPrimitives {
+  public:
+    DracoPrimitives();
+    ~DracoPrimitives();
+
+    /** Compresses the indices and vertex attributes of a primitive.
+     * Returns false if Draco failed, the primitive is then kept as it is. */
+    bool compress(const std::string &name, GLTF::Accessor *indices,
+                  const gsl::span<const Index> &indexData, size_t vertexCount,
+                  const std::vector<DracoAttribute> &attributes,
+                  bool preserveVertexOrder, const Arguments &args);
+
+    bool empty() const { return m_primitives.empty(); }
+
+    /** Replaces the accessors of compressed primitives by their compressed
+     * data, so that only that gets packed */
+    std::vector<GLTF::Accessor *>
+    substitute(const std::vector<GLTF::Accessor *> &accessors) const;
+
+    /** Must be called after packing, before the JSON is written */
+    void finishPacking() const;
+
+    /** Adds the Draco extension to the compressed primitives of the JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(DracoPrimitives);
+
+    std::vector<std::unique_ptr<DracoPrimitive>> m_primitives;
+    std::map<const GLTF::Accessor *, DracoPrimitive *> m_accessorToPrimitive;
+};
@@ -0,0 +1,186 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "ExportStatistics.h"
+#include "MayaException.h"
+
+template <typename Map> static size_t sumOfValues(const Map &map) {
+    size_t sum = 0;
+    for (auto &&pair : map) {
+        sum += pair.second;
+    }
+    return sum;
+}
+
+template <typename Map> static rapidjson::Value jsonCounts(const Map &map, rapidjson::Document::AllocatorType &allocator) {
+    rapidjson::Value jsonObject(rapidjson::kObjectType);
+    for (auto &&pair : map) {
+        jsonObject.AddMember(rapidjson::Value(pair.first.c_str(), allocator), static_cast<uint64_t>(pair.second), allocator);
+    }
+    return jsonObject;
+}
+
+static rapidjson::Value jsonFiles(const std::vector<std::pair<std::string, size_t>> &files,
+                                  rapidjson::Document::AllocatorType &allocator) {
+    rapidjson::Value jsonArray(rapidjson::kArrayType);
+    for (auto &&pair : files) {
+        rapidjson::Value jsonFile(rapidjson::kObjectType);
+        jsonFile.AddMember("uri", rapidjson::Value(pair.first.c_str(), allocator), allocator);
+        jsonFile.AddMember("bytes", static_cast<uint64_t>(pair.second), allocator);
+        jsonArray.PushBack(jsonFile, allocator);
+    }
+    return jsonArray;
+}
+
+size_t MeshStatistics::byteCount() const { return sumOfValues(bytesPerSemantic) + sumOfValues(bytesPerMorphTarget); }
+
+size_t ClipStatistics::byteCount() const { return sumOfValues(bytesPerPath) + inputByteCount; }
+
+ExportStatistics::ExportStatistics(const Arguments &args) : m_args(args) {}
+
+ExportStatistics::~ExportStatistics() = default;
+
+bool ExportStatistics::isEnabled(const Arguments &args) {
+    return args.statisticsReport.length() || args.meshByteBudget > 0 || args.clipByteBudget > 0 || args.bufferByteBudget > 0 ||
+           args.imageByteBudget > 0;
+}
+
+MeshStatistics &ExportStatistics::addMesh(const std::string &name) {
+    m_meshes.emplace_back(std::make_unique<MeshStatistics>());
+    m_meshes.back()->name = name;
+    return *m_meshes.back();
+}
+
+ClipStatistics &ExportStatistics::addClip(const std::string &name) {
+    m_clips.emplace_back(std::make_unique<ClipStatistics>());
+    m_clips.back()->name = name;
+    return *m_clips.back();
+}
+
+void ExportStatistics::addBuffer(const std::string &uri, const size_t byteCount) { m_buffers.emplace_back(uri, byteCount); }
+
+void ExportStatistics::addImage(const std::string &uri, const size_t byteCount) { m_images.emplace_back(uri, byteCount); }
+
+void ExportStatistics::checkBudget(const char *kind, const std::string &name, const size_t byteCount, const int budget) {
+    if (budget <= 0 || byteCount <= static_cast<size_t>(budget))
+        return;
+
+    auto warning = formatted("%s '%s' has %llu bytes, exceeding the budget of %d bytes", kind, name.c_str(),
+                             static_cast<unsigned long long>(byteCount), budget);
+    MayaException::printWarning(warning);
+    m_budgetWarnings.emplace_back(std::move(warning));
+}
+
+void ExportStatistics::finish() {
+    // The largest files first, these hurt the most.
+    const auto isLarger = [](const std::pair<std::string, size_t> &a, const std::pair<std::string, size_t> &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+
+    std::sort(m_buffers.begin(), m_buffers.end(), isLarger);
+    std::sort(m_images.begin(), m_images.end(), isLarger);
+
+    for (auto &&mesh : m_meshes) {
+        checkBudget("Mesh", mesh->name, mesh->byteCount(), m_args.meshByteBudget);
+    }
+
+    for (auto &&clip : m_clips) {
+        checkBudget("Clip", clip->name, clip->byteCount(), m_args.clipByteBudget);
+    }
+
+    for (auto &&buffer : m_buffers) {
+        checkBudget("Buffer", buffer.first, buffer.second, m_args.bufferByteBudget);
+    }
+
+    for (auto &&image : m_images) {
+        checkBudget("Image", image.first, image.second, m_args.imageByteBudget);
+    }
+
+    if (m_args.statisticsReport.length() == 0)
+        return;
+
+    rapidjson::Document document(rapidjson::kObjectType);
+    auto &allocator = document.GetAllocator();
+
+    size_t meshByteCount = 0;
+    rapidjson::Value jsonMeshes(rapidjson::kArrayType);
+
+    for (auto &&mesh : m_meshes) {
+        rapidjson::Value jsonMesh(rapidjson::kObjectType);
+        jsonMesh.AddMember("name", rapidjson::Value(mesh->name.c_str(), allocator), allocator);
+
+        if (!mesh->duplicateOf.empty()) {
+            jsonMesh.AddMember("duplicateOf", rapidjson::Value(mesh->duplicateOf.c_str(), allocator), allocator);
+        }
+
+        jsonMesh.AddMember("corners", static_cast<uint64_t>(mesh->cornerCount), allocator);
+        jsonMesh.AddMember("vertices", static_cast<uint64_t>(mesh->vertexCount), allocator);
+        jsonMesh.AddMember("primitives", static_cast<uint64_t>(mesh->primitiveCount), allocator);
+        jsonMesh.AddMember("bytes", static_cast<uint64_t>(mesh->byteCount()), allocator);
+        jsonMesh.AddMember("bytesPerSemantic", jsonCounts(mesh->bytesPerSemantic, allocator), allocator);
+
+        if (!mesh->bytesPerMorphTarget.empty()) {
+            rapidjson::Value jsonTargets(rapidjson::kArrayType);
+            for (auto &&pair : mesh->bytesPerMorphTarget) {
+                rapidjson::Value jsonTarget(rapidjson::kObjectType);
+                jsonTarget.AddMember("name", rapidjson::Value(pair.first.c_str(), allocator), allocator);
+                jsonTarget.AddMember("bytes", static_cast<uint64_t>(pair.second), allocator);
+                jsonTargets.PushBack(jsonTarget, allocator);
+            }
+            jsonMesh.AddMember("morphTargets", jsonTargets, allocator);
+        }
+
+        meshByteCount += mesh->byteCount();
+        jsonMeshes.PushBack(jsonMesh, allocator);
+    }
+
+    size_t clipByteCount = 0;
+    rapidjson::Value jsonClips(rapidjson::kArrayType);
+
+    for (auto &&clip : m_clips) {
+        rapidjson::Value jsonClip(rapidjson::kObjectType);
+        jsonClip.AddMember("name", rapidjson::Value(clip->name.c_str(), allocator), allocator);
+        jsonClip.AddMember("keptChannels", static_cast<uint64_t>(clip->keptChannelCount), allocator);
+        jsonClip.AddMember("droppedChannels", static_cast<uint64_t>(clip->droppedChannelCount), allocator);
+        jsonClip.AddMember("channelsPerInterpolation", jsonCounts(clip->channelsPerInterpolation, allocator), allocator);
+        jsonClip.AddMember("bytes", static_cast<uint64_t>(clip->byteCount()), allocator);
+        jsonClip.AddMember("inputBytes", static_cast<uint64_t>(clip->inputByteCount), allocator);
+        jsonClip.AddMember("bytesPerPath", jsonCounts(clip->bytesPerPath, allocator), allocator);
+
+        clipByteCount += clip->byteCount();
+        jsonClips.PushBack(jsonClip, allocator);
+    }
+
+    rapidjson::Value jsonTotals(rapidjson::kObjectType);
+    jsonTotals.AddMember("meshBytes", static_cast<uint64_t>(meshByteCount), allocator);
+    jsonTotals.AddMember("clipBytes", static_cast<uint64_t>(clipByteCount), allocator);
+    jsonTotals.AddMember("bufferBytes", static_cast<uint64_t>(sumOfValues(m_buffers)), allocator);
+    jsonTotals.AddMember("imageBytes", static_cast<uint64_t>(sumOfValues(m_images)), allocator);
+
+    rapidjson::Value jsonWarnings(rapidjson::kArrayType);
+    for (auto &&warning : m_budgetWarnings) {
+        jsonWarnings.PushBack(rapidjson::Value(warning.c_str(), allocator), allocator);
+    }
+
+    document.AddMember("meshes", jsonMeshes, allocator);
+    document.AddMember("clips", jsonClips, allocator);
+    document.AddMember("buffers", jsonFiles(m_buffers, allocator), allocator);
+    document.AddMember("images", jsonFiles(m_images, allocator), allocator);
+    document.AddMember("totals", jsonTotals, allocator);
+    document.AddMember("budgetWarnings", jsonWarnings, allocator);
+
+    const fs::path reportPath(m_args.statisticsReport.asChar());
+    const auto absoluteReportPath = reportPath.is_relative() ? fs::path(m_args.outputFolder.asChar()) / reportPath : reportPath;
+
+    std::ofstream file(absoluteReportPath.string(), ios::out | ios::trunc);
+    rapidjson::OStreamWrapper streamWrapper(file);
+    rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+    document.Accept(writer);
+
+    if (!file) {
+        MayaException::printWarning(formatted("Failed to write the statistics report '%s'", absoluteReportPath.string().c_str()));
+        return;
+    }
+
+    cout << prefix << "Wrote the statistics report to " << absoluteReportPath << endl;
+}
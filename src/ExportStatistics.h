@@ -0,0 +1,82 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+class Arguments;
+
+struct MeshStatistics {
+    std::string name;
+
+    // The name of the identical mesh that is drawn instead, see -deduplicateMeshes.
+    std::string duplicateOf;
+
+    size_t cornerCount = 0;
+    size_t vertexCount = 0;
+    size_t primitiveCount = 0;
+
+    // The bytes of the accessors, per glTF attribute name, and "indices".
+    std::map<std::string, size_t> bytesPerSemantic;
+
+    // The bytes of the accessors of each morph target, in target order.
+    std::vector<std::pair<std::string, size_t>> bytesPerMorphTarget;
+
+    size_t byteCount() const;
+};
+
+struct ClipStatistics {
+    std::string name;
+
+    size_t keptChannelCount = 0;
+    size_t droppedChannelCount = 0;
+    std::map<std::string, size_t> channelsPerInterpolation;
+
+    // The bytes of the output accessors, per animated glTF path.
+    std::map<std::string, size_t> bytesPerPath;
+
+    // The bytes of the key times, shared by the channels.
+    size_t inputByteCount = 0;
+
+    size_t byteCount() const;
+};
+
+/**
+ * Collects the sizes of the exported meshes, clips, buffers and images, and
+ * warns about the ones exceeding the budgets given by the arguments. Writes
+ * these as a JSON report with -statisticsReport.
+ *
+ * The mesh and clip bytes are those of their accessors, before compression
+ * and deduplication. The buffer and image bytes are those written, these
+ * are listed from largest to smallest.
+ */
+class ExportStatistics {
+  public:
+    explicit ExportStatistics(const Arguments &args);
+    ~ExportStatistics();
+
+    /** Is any statistic needed for the arguments? */
+    static bool isEnabled(const Arguments &args);
+
+    MeshStatistics &addMesh(const std::string &name);
+    ClipStatistics &addClip(const std::string &name);
+
+    void addBuffer(const std::string &uri, size_t byteCount);
+    void addImage(const std::string &uri, size_t byteCount);
+
+    /** Warns about the budgets, and writes the report */
+    void finish();
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ExportStatistics);
+
+    void checkBudget(const char *kind, const std::string &name, size_t byteCount, int budget);
+
+    const Arguments &m_args;
+
+    std::vector<std::unique_ptr<MeshStatistics>> m_meshes;
+    std::vector<std::unique_ptr<ClipStatistics>> m_clips;
+    std::vector<std::pair<std::string, size_t>> m_buffers;
+    std::vector<std::pair<std::string, size_t>> m_images;
+
+    std::vector<std::string> m_budgetWarnings;
+};
@@ -2,10 +2,22 @@
 
 #include "AccessorPacker.h"
 #include "Arguments.h"
+#include "AsyncFileWriter.h"
+#include "BasisuTextures.h"
+#include "BufferHash.h"
+#include "ClipScheduler.h"
+#include "CompanionBlob.h"
+#include "ContentStore.h"
+#include "ExportStatistics.h"
 #include "ExportableAsset.h"
+#include "Profiler.h"
+#include "SampleCache.h"
+#include "TaskScheduler.h"
+#include "fileCopy.h"
 #include "filesystem.h"
+#include "jsonPatch.h"
+#include "jsonWriter.h"
 #include "milo.h"
-#include "picosha2.h"
 #include "progress.h"
 #include "timeControl.h"
 #include "version.h"
@@ -16,6 +28,21 @@ struct MStringComparer {
     bool operator()(const MString &a, const MString &b) const { return strcmp(a.asChar(), b.asChar()) < 0; }
 };
 
+// The key of the glTF node of the Maya node with the given name suffix, see ExportableNode::load
+static NodeKey nodeKey(const Arguments &args, const MDagPath &dagPath, const char *suffix) {
+    MStatus status;
+    const MFnDependencyNode fnNode(dagPath.node(), &status);
+    THROW_ON_FAILURE(status);
+
+    // The name is also needed when names are not assigned.
+    GLTF::Node unnamedNode;
+
+    NodeKey key;
+    key.name = args.assignName(unnamedNode, fnNode, suffix);
+    key.uuid = std::string(fnNode.uuid().asString().asChar()) + suffix;
+    return key;
+}
+
 ExportableAsset::ExportableAsset(const Arguments &args) : m_resources{args}, m_scene{m_resources} {
     m_glAsset.scenes.push_back(&m_scene.glScene);
     m_glAsset.scene = 0;
@@ -35,12 +62,16 @@ ExportableAsset::ExportableAsset(const Arguments &args) : m_resources{args}, m_s
     // export succeeded.
     const auto sceneName = std::string(args.sceneName.asChar());
     const auto outputFolder = fs::path(args.outputFolder.asChar());
-    if (args.cleanOutputFolder && exists(outputFolder)) {
+    if (args.appendClipsTo.length()) {
+        // The output folder can hold the file the clips are appended to.
+        const fs::path appendPath(args.appendClipsTo.asChar());
+        m_clipAppender = std::make_unique<ClipAppender>(appendPath.is_relative() ? outputFolder / appendPath : appendPath);
+    } else if (args.cleanOutputFolder && exists(outputFolder)) {
         std::cout << prefix << "Deleting " << outputFolder << "..." << endl;
         remove_all(outputFolder);
     }
 
-    const auto currentFrameTime = MAnimControl::currentTime();
+    m_currentFrameTime = MAnimControl::currentTime();
 
     setCurrentTime(args.initialValuesTime, args.redrawViewport);
 
@@ -51,46 +82,200 @@ ExportableAsset::ExportableAsset(const Arguments &args) : m_resources{args}, m_s
     }
 
     uiSetupProgress(progressStepCount);
+}
+
+ExportableAsset::~ExportableAsset() { uiTeardownProgress(); }
+
+bool ExportableAsset::exportNextStep() {
+    const auto &args = m_resources.arguments();
+
+    // Between the steps, the main thread runs the Maya tasks that the
+    // workers queued.
+    auto &taskScheduler = TaskScheduler::instance();
+
+    switch (m_stage) {
+    case Stage::MESHES:
+        if (m_clipAppender) {
+            findAppendedNodes();
+
+            // The nodes of the existing file can still extract their meshes.
+            m_scene.finishMeshes(0);
+            beginClips();
+        } else if (m_stepIndex < args.meshShapes.size()) {
+            const auto &dagPath = args.meshShapes[m_stepIndex++];
+            uiAdvanceProgress(std::string("exporting mesh ") + dagPath.partialPathName().asChar());
+            cout << prefix << "Processing mesh '" << dagPath.partialPathName().asChar() << "' ..." << endl;
+            m_scene.getNode(dagPath);
+            taskScheduler.runMainThreadTasks();
+        } else {
+            m_scene.finishMeshes(0);
+
+            if (args.batchStaticMeshes) {
+                m_rootBatchNodes = m_scene.batchStaticMeshes();
+            }
+
+            m_stage = Stage::CAMERAS;
+            m_stepIndex = 0;
+        }
+        return true;
+
+    case Stage::CAMERAS:
+        if (m_stepIndex < args.cameraShapes.size()) {
+            const auto &dagPath = args.cameraShapes[m_stepIndex++];
+            uiAdvanceProgress(std::string("exporting camera") + dagPath.partialPathName().asChar());
+            cout << prefix << "Processing camera '" << dagPath.partialPathName().asChar() << "' ..." << endl;
+            m_scene.getNode(dagPath);
+            return true;
+        }
+
+        if (const auto *meshCache = m_resources.meshCache()) {
+            meshCache->printStatistics();
+        }
+
+        beginClips();
+        return true;
+
+    case Stage::CLIPS:
+        // Each sample time is a step of its own.
+        if (m_clipScheduler && m_clipScheduler->isSampling()) {
+            if (!m_clipScheduler->sampleNextTime()) {
+                finishClips();
+            }
+            return true;
+        }
+
+        if (m_stepIndex < args.animationClips.size()) {
+            const auto &clipArg = args.animationClips[m_stepIndex++];
+            uiAdvanceProgress("exporting clip " + clipArg.name);
+            m_pendingClips.emplace_back(std::make_unique<ExportableClip>(args, clipArg, m_scene));
+
+            if (!m_sampleCache || !m_sampleCache->load(*m_pendingClips.back())) {
+                m_clipScheduler->addClip(m_pendingClips.back().get());
+            }
+
+            if (args.streamClips) {
+                m_clipScheduler->beginSampling();
+            }
+
+            taskScheduler.runMainThreadTasks();
+            return true;
+        }
+
+        if (m_clipScheduler) {
+            if (!m_pendingClips.empty()) {
+                m_clipScheduler->beginSampling();
+                return true;
+            }
+
+            if (m_sampleCache) {
+                m_sampleCache->printStatistics();
+            }
+
+            m_clipScheduler.reset();
+            m_sampleCache.reset();
+        } else if (m_currentFrameTime != args.initialValuesTime) {
+            // When we export just a single frame, we normally bake the geometry at
+            // that frame. However, when explicitly specifying a different
+            // initialValuesTime argument, we bake the values at the initial frame,
+            // and re-evaluate the node-transforms and blend-shape-weights of the
+            // current frame, not the initial-values frame.
+            setCurrentTime(m_currentFrameTime, args.redrawViewport);
+            m_scene.updateCurrentValues();
+        }
+
+        finishScene();
+        m_stage = Stage::DONE;
+        return false;
 
-    for (auto &dagPath : args.meshShapes) {
-        uiAdvanceProgress(std::string("exporting mesh ") + dagPath.partialPathName().asChar());
-        cout << prefix << "Processing mesh '" << dagPath.partialPathName().asChar() << "' ..." << endl;
-        m_scene.getNode(dagPath);
+    case Stage::DONE:
+        break;
     }
 
-    for (auto &dagPath : args.cameraShapes) {
-        uiAdvanceProgress(std::string("exporting camera") + dagPath.partialPathName().asChar());
-        cout << prefix << "Processing camera '" << dagPath.partialPathName().asChar() << "' ..." << endl;
-        m_scene.getNode(dagPath);
+    return false;
+}
+
+void ExportableAsset::findAppendedNodes() {
+    const auto &args = m_resources.arguments();
+
+    // Only the transforms of the existing file are needed to sample the clips.
+    MStatus status;
+    MItDag dagIterator(MItDag::kDepthFirst, MFn::kTransform, &status);
+    THROW_ON_FAILURE(status);
+
+    size_t matchCount = 0;
+
+    for (; !dagIterator.isDone(); dagIterator.next()) {
+        MDagPath dagPath;
+        THROW_ON_FAILURE(dagIterator.getPath(dagPath));
+
+        if (m_clipAppender->hasNode(nodeKey(args, dagPath, ""))) {
+            m_scene.getNode(dagPath);
+            ++matchCount;
+        }
     }
 
+    cout << prefix << "Found " << matchCount << " nodes of " << m_clipAppender->path() << " to append the clips to" << endl;
+}
+
+void ExportableAsset::beginClips() {
+    const auto &args = m_resources.arguments();
+
     if (!args.keepShapeNodes) {
         m_scene.mergeRedundantShapeNodes();
     }
 
+    m_stage = Stage::CLIPS;
+    m_stepIndex = 0;
+
     // Now export animation clips of all the nodes, in one pass over the slow
     // timeline
     const auto clipCount = args.animationClips.size();
+    if (!clipCount)
+        return;
 
-    if (clipCount) {
-        for (auto &clipArg : args.animationClips) {
-            uiAdvanceProgress("exporting clip " + clipArg.name);
-            auto clip = std::make_unique<ExportableClip>(args, clipArg, m_scene);
-            if (!clip->glAnimation.channels.empty()) {
-                m_glAsset.animations.push_back(&clip->glAnimation);
-                m_clips.emplace_back(std::move(clip));
-            }
+    // Forced channels need the samples of all nodes.
+    if (!args.sampleStaticNodes && !args.forceAnimationSampling && !args.forceAnimationChannels) {
+        m_scene.markStaticNodes();
+    }
+
+    // Overlapping clips share their sample times, each time is evaluated
+    // once for all clips. When streaming, each clip is sampled on its own,
+    // so the samples of only one clip are kept in memory.
+    m_clipScheduler = std::make_unique<ClipScheduler>(m_resources, m_scene.nodeCount());
+
+    m_pendingClips.reserve(clipCount);
+
+    // Unchanged clips are read from the cache instead of sampled.
+    if (args.sampleCacheFolder.length()) {
+        const fs::path cachePath(args.sampleCacheFolder.asChar());
+        const auto outputFolder = fs::path(args.outputFolder.asChar());
+        m_sampleCache = std::make_unique<SampleCache>(args, cachePath.is_relative() ? outputFolder / cachePath : cachePath);
+    }
+}
+
+void ExportableAsset::finishClips() {
+    for (auto &clip : m_pendingClips) {
+        if (m_sampleCache) {
+            m_sampleCache->store(*clip);
+        }
+
+        // This frees the samples, only the accessors are kept.
+        clip->finish();
+        if (!clip->glAnimation.channels.empty()) {
+            m_glAsset.animations.push_back(&clip->glAnimation);
+            m_clips.emplace_back(std::move(clip));
         }
-    } else if (currentFrameTime != args.initialValuesTime) {
-        // When we export just a single frame, we normally bake the geometry at
-        // that frame. However, when explicitly specifying a different
-        // initialValuesTime argument, we bake the values at the initial frame,
-        // and re-evaluate the node-transforms and blend-shape-weights of the
-        // current frame, not the initial-values frame.
-        setCurrentTime(currentFrameTime, args.redrawViewport);
-        m_scene.updateCurrentValues();
     }
 
+    m_pendingClips.clear();
+}
+
+void ExportableAsset::finishScene() {
+    const auto &args = m_resources.arguments();
+
+    // After the clips and current values, the final transforms are known.
+    const auto rootInstanceNodes = args.gpuInstancing ? m_scene.instanceMeshes() : std::vector<GLTF::Node *>();
+
     const auto rootScaleFactor = args.getRootScaleFactor();
     if (args.forceRootNode || rootScaleFactor != 1) {
         // Create global root node for scaling.
@@ -107,11 +292,27 @@ ExportableAsset::ExportableAsset(const Arguments &args) : m_resources{args}, m_s
             GLTF::Node *secondary_node = &pair.second->glSecondaryNode();
             m_glRootNode.children.push_back(secondary_node);
         }
+
+        for (auto *node : rootInstanceNodes) {
+            m_glRootNode.children.push_back(node);
+        }
+
+        for (auto *node : m_rootBatchNodes) {
+            m_glRootNode.children.push_back(node);
+        }
     } else {
         for (auto &&pair : m_scene.orphans()) {
             GLTF::Node *secondary_node = &pair.second->glSecondaryNode();
             m_scene.glScene.nodes.push_back(secondary_node);
         }
+
+        for (auto *node : rootInstanceNodes) {
+            m_scene.glScene.nodes.push_back(node);
+        }
+
+        for (auto *node : m_rootBatchNodes) {
+            m_scene.glScene.nodes.push_back(node);
+        }
     }
 
     if (args.dumpMaya) {
@@ -119,41 +320,46 @@ ExportableAsset::ExportableAsset(const Arguments &args) : m_resources{args}, m_s
     }
 }
 
-ExportableAsset::~ExportableAsset() { uiTeardownProgress(); }
-
 ExportableAsset::Cleanup::Cleanup() : currentTime{MAnimControl::currentTime()} {}
 
 ExportableAsset::Cleanup::~Cleanup() { setCurrentTime(currentTime, true); }
 
-const std::string &ExportableAsset::prettyJsonString() const {
-    if (m_prettyJsonString.empty() && !m_rawJsonString.empty()) {
-        // Pretty format the JSON
-        rapidjson::Document jsonDocument;
-        const bool hasParseErrors = jsonDocument.Parse(m_rawJsonString.c_str()).HasParseError();
+void ExportableAsset::writeJSON(std::ostream &stream, const bool isPretty) const {
+    rapidjson::OStreamWrapper streamWrapper(stream);
 
-        if (hasParseErrors) {
-            cerr << prefix << "Failed to reformat glTF JSON, outputting raw JSON" << endl;
-            m_prettyJsonString = m_rawJsonString;
-        } else {
-            rapidjson::StringBuffer jsonPrettyBuffer;
-
-            // Write the pretty JSON
-            rapidjson::PrettyWriter<rapidjson::StringBuffer> jsonPrettyWriter(jsonPrettyBuffer);
-            jsonDocument.Accept(jsonPrettyWriter);
-            m_prettyJsonString = jsonPrettyBuffer.GetString();
-        }
+    if (isPretty) {
+        rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+        writeJSONDocument(m_jsonDocument, writer);
+    } else {
+        rapidjson::Writer<rapidjson::OStreamWrapper> writer(streamWrapper);
+        writeJSONDocument(m_jsonDocument, writer);
     }
-
-    return m_prettyJsonString;
 }
 
 void ExportableAsset::save() {
     const auto &args = m_resources.arguments();
 
-    const auto sceneName = std::string(args.sceneName.asChar());
-
     const auto outputFolder = fs::path(args.outputFolder.asChar());
 
+    // The atlases need the texture coordinates of all the meshes.
+    if (args.textureAtlasSize > 0) {
+        m_resources.buildTextureAtlases(m_glAsset.getAllMeshes());
+    }
+
+    if (args.splitAssets == AssetSplit::NONE) {
+        saveAsset(m_glAsset, args.sceneName.asChar(), outputFolder);
+    } else {
+        saveSplitAssets(outputFolder);
+    }
+
+    if (auto *statistics = m_resources.statistics()) {
+        statistics->finish();
+    }
+}
+
+void ExportableAsset::saveAsset(GLTF::Asset &glAsset, const std::string &sceneName, const fs::path &outputFolder) {
+    const auto &args = m_resources.arguments();
+
     std::cerr << prefix << "Creating " << outputFolder << "..." << endl;
 
     for (int retry = 0; retry < 10; ++retry) {
@@ -172,20 +378,100 @@ void ExportableAsset::save() {
     // Last try, this will throw an exception if it fails.
     create_directories(outputFolder);
 
-    const auto allAccessors = m_glAsset.getAllAccessors();
+    auto allAccessors = glAsset.getAllAccessors();
+    m_resources.getAllAccessors(allAccessors);
+
+    // With -splitAssets, the scene and the clips also have the accessors of
+    // the other assets.
+    const std::set<GLTF::Accessor *> assetAccessorSet(allAccessors.begin(), allAccessors.end());
+    const auto keepAssetAccessors = [&](std::vector<GLTF::Accessor *> &accessors) {
+        if (args.splitAssets == AssetSplit::NONE)
+            return;
+
+        accessors.erase(std::remove_if(accessors.begin(), accessors.end(),
+                                       [&](GLTF::Accessor *accessor) { return assetAccessorSet.count(accessor) == 0; }),
+                        accessors.end());
+    };
 
     if (args.dumpAccessorComponents) {
         dumpAccessorComponents(allAccessors);
     }
 
+    // With -companionBlob, the streams are written before the accessors are
+    // packed, compressed or interleaved, the table once the JSON is written.
+    const auto blobPath = outputFolder / (sceneName + ".m2gb");
+    std::ofstream blobFile;
+    std::unique_ptr<CompanionBlob> companionBlob;
+    if (args.companionBlob && !m_clipAppender) {
+        create(blobFile, blobPath.string(), ios::out | ios::binary);
+        companionBlob = std::make_unique<CompanionBlob>(blobFile, m_resources.quantizedAccessors());
+        companionBlob->addAsset(glAsset, assetAccessorSet);
+    }
+
     GLTF::Options options;
     options.embeddedBuffers = args.glb;
     options.embeddedShaders = args.glb;
     options.embeddedTextures = args.glb && !args.externalTextures;
-    options.name = args.sceneName.asChar();
+    options.name = sceneName;
     options.binary = args.glb;
 
-    AccessorPacker bufferPacker;
+    auto &bufferPacker = *m_bufferPackers.emplace_back(std::make_unique<AccessorPacker>(
+        m_resources.objectPool(), args.meshoptCompression ? &m_resources.meshoptCompression() : nullptr,
+        args.interleaveVertexAttributes ? &m_resources.interleavedAttributes() : nullptr, args.deduplicateAccessors,
+        args.streamBuffers));
+    bufferPacker.setAllBounds(args.allAccessorBounds);
+
+    // With -contentStore, the buffers and images are written to the store,
+    // unless it has these already.
+    std::unique_ptr<ContentStore> contentStore;
+    if (args.contentStore.length()) {
+        const fs::path storePath(args.contentStore.asChar());
+        contentStore = std::make_unique<ContentStore>(
+            storePath.is_relative() ? fs::path(args.outputFolder.asChar()) / storePath : storePath, outputFolder);
+    }
+
+    // The packer and the store outlive the writer, so pending writes finish
+    // before these go.
+    AsyncFileWriter fileWriter(static_cast<size_t>(std::max(0, args.asyncWriteThreads)));
+
+    if (!options.embeddedTextures) {
+        // The images are final once loaded, copy the files when possible.
+        for (GLTF::Image *image : glAsset.getAllImages()) {
+            auto *store = image->data && image->byteLength ? contentStore.get() : nullptr;
+            if (store) {
+                // The extension still tells the image type.
+                bool mustWrite = false;
+                image->uri = store->add(hashBytes(image->data, image->byteLength, args.bufferURIHash),
+                                        fs::path(image->uri).extension().string(), image->byteLength, mustWrite);
+                if (!mustWrite)
+                    continue;
+            }
+
+            const auto storeUri = image->uri;
+            const auto uri = store ? store->temporaryPath(storeUri) : outputFolder / image->uri;
+            const auto sourcePath = m_resources.getImageSourcePath(image);
+            fileWriter.submit([image, uri, sourcePath, store, storeUri]() {
+                std::error_code errorCode;
+                if (sourcePath.empty() || !cloneOrCopyFile(sourcePath, uri, errorCode)) {
+                    // Images copied as is have no data to write.
+                    if (!image->data) {
+                        std::cerr << prefix << "ERROR: Failed to copy image " << sourcePath << " to " << uri << ": "
+                                  << errorCode.message() << endl;
+                        return;
+                    }
+
+                    std::ofstream file;
+                    create(file, uri.generic_string(), ios::out | ios::binary);
+                    file.write(reinterpret_cast<char *>(image->data), image->byteLength);
+                    file.close();
+                }
+
+                if (store) {
+                    store->commit(storeUri);
+                }
+            });
+        }
+    }
 
     PackedBufferMap packedBufferMap;
 
@@ -196,6 +482,10 @@ void ExportableAsset::save() {
         AccessorsPerDagPath meshAccessorsPerDagPath;
         m_scene.getAllAccessors(meshAccessorsPerDagPath);
 
+        for (auto &pair : meshAccessorsPerDagPath) {
+            keepAssetAccessors(pair.second);
+        }
+
         // Compute animation clip accessors
         std::vector<GLTF::Accessor *> animAccessors;
 
@@ -212,9 +502,51 @@ void ExportableAsset::save() {
             }
         }
 
-        packMeshAccessors(meshAccessorsPerDagPath, bufferPacker, packedBufferMap, "/mesh");
+        packAccessorsPerReference(meshAccessorsPerDagPath, bufferPacker, packedBufferMap, sceneName, "/mesh");
 
-        // TODO: Also associate clips with dag-paths!
+        if (args.splitClipBuffers) {
+            // Each clip gets its own buffers, so a runtime can load the clips on demand.
+            std::set<GLTF::Accessor *> clipAccessorSet;
+
+            // The inputs shared by clips stay in the common animation buffer.
+            std::map<GLTF::Accessor *, int> clipCountPerInput;
+            for (auto &clip : m_clips) {
+                AccessorsPerDagPath clipAccessorsPerDagPath;
+                std::vector<GLTF::Accessor *> clipInputs;
+                clip->getAllAccessors(clipAccessorsPerDagPath, clipInputs);
+
+                for (auto *input : clipInputs) {
+                    ++clipCountPerInput[input];
+                }
+            }
+
+            for (auto &clip : m_clips) {
+                AccessorsPerDagPath clipAccessorsPerDagPath;
+                std::vector<GLTF::Accessor *> clipInputs;
+                clip->getAllAccessors(clipAccessorsPerDagPath, clipInputs);
+
+                keepAssetAccessors(clipInputs);
+
+                clipInputs.erase(std::remove_if(clipInputs.begin(), clipInputs.end(),
+                                                [&](GLTF::Accessor *input) { return clipCountPerInput[input] > 1; }),
+                                 clipInputs.end());
+
+                for (auto &pair : clipAccessorsPerDagPath) {
+                    keepAssetAccessors(pair.second);
+                    clipAccessorSet.insert(pair.second.begin(), pair.second.end());
+                }
+                clipAccessorSet.insert(clipInputs.begin(), clipInputs.end());
+
+                packAccessorsPerReference(clipAccessorsPerDagPath, bufferPacker, packedBufferMap, sceneName,
+                                          "/anim/" + clip->clipArg().name, clipInputs);
+            }
+
+            animAccessors.erase(std::remove_if(animAccessors.begin(), animAccessors.end(),
+                                               [&](GLTF::Accessor *accessor) { return clipAccessorSet.count(accessor) > 0; }),
+                                animAccessors.end());
+        }
+
+        // The accessors that are not part of a mesh or a split clip.
         const auto animBufferName = sceneName + "/anim";
         const auto animBuffer = bufferPacker.packAccessors(animAccessors, animBufferName);
         if (animBuffer) {
@@ -236,7 +568,7 @@ void ExportableAsset::save() {
 
         size_t imageBufferLength = 0;
 
-        const auto images = m_glAsset.getAllImages();
+        auto images = glAsset.getAllImages();
 
         if (options.embeddedTextures) {
             // Allocate extra space for images.
@@ -245,16 +577,69 @@ void ExportableAsset::save() {
             }
         }
 
-        const auto buffer = bufferPacker.packAccessors(allAccessors, bufferName, imageBufferLength);
+        // With -progressiveLayout, the data needed for a first frame goes first.
+        if (args.progressiveLayout) {
+            auto &layout = m_resources.progressiveLayout();
+
+            std::map<std::pair<int, int>, std::vector<GLTF::Accessor *>> meshAccessors;
+            m_scene.getAccessorsPerLodRankAndDepth(meshAccessors);
+
+            for (auto &&pair : meshAccessors) {
+                const auto priority =
+                    layout.addTier(formatted("meshes/lod%d/depth%d", pair.first.first, pair.first.second));
+                for (auto *accessor : pair.second) {
+                    layout.setPriority(accessor, priority);
+                }
+            }
+
+            layout.setDefaultPriority(layout.addTier("other"));
+            layout.setAdditionalPriority(layout.addTier("images"));
+
+            for (auto &clip : m_clips) {
+                AccessorsPerDagPath clipOutputsPerDagPath;
+                std::vector<GLTF::Accessor *> clipInputs;
+                clip->getAllAccessors(clipOutputsPerDagPath, clipInputs);
+
+                const auto priority = layout.addTier("clips/" + clip->clipArg().name);
+                for (auto *accessor : clipInputs) {
+                    layout.setPriority(accessor, priority);
+                }
+
+                for (auto &pair : clipOutputsPerDagPath) {
+                    for (auto *accessor : pair.second) {
+                        layout.setPriority(accessor, priority);
+                    }
+                }
+            }
+
+            // The packed data of an accessor, e.g. its sparse data, goes with it.
+            for (auto *accessor : allAccessors) {
+                const auto priority = layout.priority(accessor);
+                for (auto *packed : m_resources.packedAccessors({accessor})) {
+                    layout.setPriority(packed, priority);
+                }
+            }
+
+            // The small images first, a renderer can show these while the large ones load.
+            std::stable_sort(images.begin(), images.end(), [](const GLTF::Image *a, const GLTF::Image *b) {
+                return a->byteLength < b->byteLength;
+            });
+
+            bufferPacker.setProgressiveLayout(&layout);
+        }
+
+        const auto buffer = bufferPacker.packAccessors(m_resources.packedAccessors(allAccessors), bufferName, imageBufferLength);
 
         if (buffer) {
             if (imageBufferLength) {
                 // Copy images to buffer, and create image buffer-views
-                size_t byteOffset = buffer->byteLength - imageBufferLength;
+                size_t byteOffset = bufferPacker.additionalByteOffset(buffer);
                 for (GLTF::Image *image : images) {
-                    const auto bufferView = new GLTF::BufferView(byteOffset, image->byteLength, buffer);
+                    const auto bufferView =
+                        m_resources.objectPool().createBufferView(int(byteOffset), image->byteLength, buffer);
                     image->bufferView = bufferView;
-                    std::memcpy(buffer->data + byteOffset, image->data, image->byteLength);
+                    bufferPacker.addStreamedData(buffer, static_cast<int>(byteOffset), image->data,
+                                                 image->byteLength);
                     byteOffset += image->byteLength;
                 }
             }
@@ -262,6 +647,8 @@ void ExportableAsset::save() {
         }
     }
 
+    m_resources.finishPacking();
+
     if (args.niceBufferURIs) {
         std::map<std::string, int> bufferNameSuffix;
 
@@ -281,13 +668,12 @@ void ExportableAsset::save() {
         }
     }
 
-    if (args.hashBufferURIs) {
+    if (args.hashBufferURIs && !contentStore) {
         // Generate hash buffer URIs
         for (const auto &pair : packedBufferMap) {
             auto buffer = pair.first;
 
-            std::string hash_hex_str;
-            picosha2::hash256_hex_string(buffer->data, buffer->data + buffer->byteLength, hash_hex_str);
+            const auto hash_hex_str = hashBuffer(bufferPacker, buffer, args.bufferURIHash);
 
             std::string filename = pair.second;
             makeValidFilename(filename);
@@ -299,57 +685,164 @@ void ExportableAsset::save() {
         }
     }
 
+    if (m_clipAppender && !options.embeddedBuffers && !contentStore) {
+        // The appended buffers must not overwrite those of the existing file.
+        for (const auto &pair : packedBufferMap) {
+            pair.first->uri = m_clipAppender->uniqueBufferUri(pair.second, outputFolder);
+        }
+    }
+
+    // The buffers are final now. The store names these after their bytes
+    // before the JSON refers to them; the others only get their default URIs
+    // when the JSON is written, so all are written after that.
+    std::vector<GLTF::Buffer *> writtenBuffers;
+    if (!options.embeddedBuffers) {
+        for (const auto &pair : packedBufferMap) {
+            const auto buffer = pair.first;
+            if (!buffer->byteLength)
+                continue;
+
+            if (contentStore) {
+                bool mustWrite = false;
+                buffer->uri = contentStore->add(hashBuffer(bufferPacker, buffer, args.bufferURIHash), ".bin",
+                                                buffer->byteLength, mustWrite);
+                if (!mustWrite)
+                    continue;
+            }
+
+            writtenBuffers.push_back(buffer);
+        }
+    }
+
+    if (auto *basisuTextures = m_resources.basisuTextures()) {
+        // The transcodes ran while the scene was extracted.
+        basisuTextures->finish(outputFolder);
+    }
+
+    if (auto *statistics = m_resources.statistics()) {
+        for (const auto &pair : packedBufferMap) {
+            statistics->addBuffer(pair.first->uri.empty() ? pair.second : pair.first->uri, pair.first->byteLength);
+        }
+
+        for (GLTF::Image *image : glAsset.getAllImages()) {
+            statistics->addImage(image->uri.empty() ? image->name : image->uri, m_resources.getImageByteLength(image));
+        }
+    }
+
     // Generate glTF JSON file
     rapidjson::StringBuffer jsonStringBuffer;
-    rapidjson::Writer<rapidjson::StringBuffer> jsonWriter(jsonStringBuffer);
-    jsonWriter.StartObject();
 
-    m_glAsset.writeJSON(&jsonWriter, &options);
-    jsonWriter.EndObject();
+    // The glTF writer only writes compact JSON to a string buffer. The pretty
+    // JSON and the patched JSON are written from a document instead, parsed
+    // once straight from that buffer; the compact JSON is written as is.
+    const auto requiresJSONPatching = m_resources.requiresJSONPatching() || args.exportNodeUuids || companionBlob;
+    const auto hasJSONDocument =
+        requiresJSONPatching || (!args.glb && !args.compactJSON) || args.dumpGLTF || m_clipAppender;
 
-    m_rawJsonString = jsonStringBuffer.GetString();
+    {
+        ProfileScope profileScope("JSON generation");
 
-    const auto outputFilename = args.sceneName + "." + (args.glb ? args.glbFileExtension : args.gltfFileExtension);
-    const auto outputPath = outputFolder / outputFilename.asChar();
+        rapidjson::Writer<rapidjson::StringBuffer> jsonWriter(jsonStringBuffer);
+        jsonWriter.StartObject();
 
-    cout << prefix << "Writing glTF file to '" << outputPath << "'" << endl;
+        glAsset.writeJSON(&jsonWriter, &options);
+        jsonWriter.EndObject();
 
-    if (!options.embeddedTextures) {
-        for (GLTF::Image *image : m_glAsset.getAllImages()) {
-            fs::path uri = outputFolder / image->uri;
+        profileScope.addBytes(jsonStringBuffer.GetSize());
+
+        if (hasJSONDocument) {
+            if (m_jsonDocument.Parse(jsonStringBuffer.GetString(), jsonStringBuffer.GetSize()).HasParseError())
+                throw std::runtime_error("Failed to parse the generated glTF JSON");
+
+            jsonStringBuffer.Clear();
+            jsonStringBuffer.ShrinkToFit();
+
+            if (requiresJSONPatching) {
+                // The glTF writer doesn't support sparse accessors, normalized
+                // accessors and extensions, patch these in.
+                m_resources.patchJSON(m_jsonDocument);
+            }
+
+            if (companionBlob) {
+                companionBlob->finish();
+                companionBlob->patchJSON(m_jsonDocument, blobPath.filename().string());
+                blobFile.close();
+
+                cout << prefix << "Wrote " << companionBlob->streamCount() << " streams to the companion blob "
+                     << blobPath << endl;
+            }
+
+            if (args.exportNodeUuids && m_jsonDocument.HasMember("nodes")) {
+                auto &allocator = m_jsonDocument.GetAllocator();
+                auto &jsonNodes = m_jsonDocument["nodes"];
+                const auto keys = nodeKeys(jsonNodes.Size());
+
+                for (rapidjson::SizeType id = 0; id < jsonNodes.Size(); ++id) {
+                    if (keys[id].uuid.empty())
+                        continue;
+
+                    auto &jsonNode = jsonNodes[id];
+                    if (!jsonNode.HasMember("extras")) {
+                        jsonNode.AddMember("extras", rapidjson::Value(rapidjson::kObjectType), allocator);
+                    }
+
+                    setMember(jsonNode["extras"], "mayaUuid", rapidjson::Value(keys[id].uuid.c_str(), allocator), allocator);
+                }
+            }
+        }
+    }
+
+    // The JSON assigned the default URIs, write the buffers and shaders while
+    // the JSON file is written.
+    for (auto *buffer : writtenBuffers) {
+        auto *store = contentStore.get();
+        const auto storeUri = buffer->uri;
+        const auto uri = store ? store->temporaryPath(storeUri) : outputFolder / buffer->uri;
+        fileWriter.submit([&bufferPacker, buffer, uri, store, storeUri]() {
             std::ofstream file;
             create(file, uri.generic_string(), ios::out | ios::binary);
-            file.write(reinterpret_cast<char *>(image->data), image->byteLength);
+            bufferPacker.writeBuffer(buffer, [&](const byte *data, size_t byteLength) {
+                file.write(reinterpret_cast<const char *>(data), byteLength);
+            });
             file.close();
-        }
+
+            if (store) {
+                store->commit(storeUri);
+            }
+        });
     }
 
-    if (!options.embeddedBuffers) {
-        for (const auto &pair : packedBufferMap) {
-            const auto buffer = pair.first;
-            if (buffer->data && buffer->byteLength) {
-                fs::path uri = outputFolder / buffer->uri;
+    if (!options.embeddedShaders) {
+        for (GLTF::Shader *shader : glAsset.getAllShaders()) {
+            const auto uri = outputFolder / shader->uri;
+            fileWriter.submit([shader, uri]() {
                 std::ofstream file;
                 create(file, uri.generic_string(), ios::out | ios::binary);
-                file.write(reinterpret_cast<char *>(buffer->data), buffer->byteLength);
+                file.write(shader->source.c_str(), shader->source.length());
                 file.close();
-            }
+            });
         }
     }
 
-    if (!options.embeddedShaders) {
-        for (GLTF::Shader *shader : m_glAsset.getAllShaders()) {
-            fs::path uri = outputFolder / shader->uri;
-            std::ofstream file;
-            create(file, uri.generic_string(), ios::out | ios::binary);
-            file.write(shader->source.c_str(), shader->source.length());
-            file.close();
-        }
+    if (m_clipAppender) {
+        const auto nodeCount = m_jsonDocument.HasMember("nodes") ? m_jsonDocument["nodes"].Size() : 0;
+        const auto channelCount = m_clipAppender->append(m_jsonDocument, nodeKeys(nodeCount), outputFolder);
+
+        cout << prefix << "Appending " << channelCount << " animation channels to " << m_clipAppender->path() << endl;
+        m_clipAppender->write();
+
+        fileWriter.join();
+        return;
     }
 
+    const auto outputFilename = sceneName + "." + (args.glb ? args.glbFileExtension : args.gltfFileExtension).asChar();
+    const auto outputPath = outputFolder / outputFilename;
+
+    cout << prefix << "Writing glTF file to '" << outputPath << "'" << endl;
+
     // Write glTF file.
     {
-        const auto &jsonString = m_rawJsonString;
+        ProfileScope profileScope("File write");
 
         std::ofstream file;
         create(file, outputPath.string(), ios::out | (args.glb ? ios::binary : std::ios_base::openmode(0)));
@@ -359,12 +852,19 @@ void ExportableAsset::save() {
             const auto maybeBuffer = packedBufferMap.empty() ? nullptr : packedBufferMap.begin()->first;
             const auto bufferLength = maybeBuffer ? maybeBuffer->byteLength : 0;
 
+            // The length of the JSON chunk goes first, so the JSON is
+            // serialized in memory.
+            if (hasJSONDocument) {
+                rapidjson::Writer<rapidjson::StringBuffer> documentWriter(jsonStringBuffer);
+                writeJSONDocument(m_jsonDocument, documentWriter);
+            }
+
             file.write("glTF", 4); // magic header
 
             const auto writeHeader = new uint32_t[2];
             writeHeader[0] = 2; // version
 
-            const int jsonLength = static_cast<int>(jsonString.length());
+            const int jsonLength = static_cast<int>(jsonStringBuffer.GetSize());
             const int jsonPadding = (4 - (jsonLength & 3)) & 3;
             const int binPadding = (4 - (bufferLength & 3)) & 3;
 
@@ -382,7 +882,7 @@ void ExportableAsset::save() {
             writeHeader[1] = 0x4E4F534A;               // chunkType JSON
             file.write(reinterpret_cast<char *>(writeHeader), sizeof(uint32_t) * 2);
 
-            file.write(jsonString.c_str(), jsonLength);
+            file.write(jsonStringBuffer.GetString(), jsonLength);
             for (int i = 0; i < jsonPadding; i++) {
                 file.write(" ", 1);
             }
@@ -392,29 +892,279 @@ void ExportableAsset::save() {
                 writeHeader[1] = 0x004E4942;                // chunkType BIN
                 file.write(reinterpret_cast<char *>(writeHeader), sizeof(uint32_t) * 2);
 
-                file.write(reinterpret_cast<char *>(maybeBuffer->data), bufferLength);
+                bufferPacker.writeBuffer(maybeBuffer, [&](const byte *data, size_t byteLength) {
+                    file.write(reinterpret_cast<const char *>(data), byteLength);
+                });
                 for (int i = 0; i < binPadding; i++) {
                     file.write("\0", 1);
                 }
             }
 
         } else {
-            file << prettyJsonString() << endl;
+            if (hasJSONDocument) {
+                writeJSON(file, !args.compactJSON);
+            } else {
+                file.write(jsonStringBuffer.GetString(), static_cast<std::streamsize>(jsonStringBuffer.GetSize()));
+            }
+            file << endl;
         }
 
+        profileScope.addBytes(static_cast<size_t>(file.tellp()));
         file.close();
     }
 
+    fileWriter.join();
+
+    if (contentStore) {
+        contentStore->writeManifest(sceneName, outputPath);
+        contentStore->printStatistics();
+    }
+
     if (args.dumpGLTF) {
         auto &out = *args.dumpGLTF;
         out << "glTF dump:" << endl;
-        out << prettyJsonString();
+        writeJSON(out, true);
         out << endl;
     }
 }
 
-void ExportableAsset::packMeshAccessors(AccessorsPerDagPath &accessorsPerDagPath, AccessorPacker &packer,
-                                        PackedBufferMap &packedBufferMap, std::string nameSuffix) const {
+std::vector<NodeKey> ExportableAsset::nodeKeys(const size_t nodeCount) const {
+    const auto &args = m_resources.arguments();
+
+    std::vector<NodeKey> keys(nodeCount);
+
+    const auto setKey = [&](const ExportableNode &node, const GLTF::Node &glNode, const char *suffix) {
+        if (glNode.id >= 0 && size_t(glNode.id) < nodeCount) {
+            keys[glNode.id] = nodeKey(args, node.dagPath, suffix);
+        }
+    };
+
+    for (auto &&pair : m_scene.table()) {
+        auto &node = *pair.second;
+
+        switch (node.transformKind) {
+        case TransformKind::ComplexJoint:
+            setKey(node, node.glSecondaryNode(), ":SSC");
+            setKey(node, node.glPrimaryNode(), "");
+            break;
+        case TransformKind::ComplexTransform:
+            setKey(node, node.glPrimaryNode(), ":PIV");
+            setKey(node, node.glSecondaryNode(), "");
+            break;
+        default:
+            setKey(node, node.glPrimaryNode(), "");
+            break;
+        }
+    }
+
+    return keys;
+}
+
+std::string ExportableAsset::splitAssetName(const ExportableNode &orphan,
+                                            const std::map<std::string, std::string> &referencePerNode) const {
+    const auto &args = m_resources.arguments();
+
+    std::string name;
+
+    if (args.splitAssets == AssetSplit::REFERENCE) {
+        const auto it = referencePerNode.find(orphan.dagPath.partialPathName().asChar());
+        name = it == referencePerNode.end() ? args.sceneName.asChar() : it->second;
+    } else {
+        MDagPath topLevelPath = orphan.dagPath;
+        while (topLevelPath.length() > 1) {
+            THROW_ON_FAILURE(topLevelPath.pop());
+        }
+
+        name = topLevelPath.partialPathName().asChar();
+    }
+
+    makeValidFilename(name);
+    return name;
+}
+
+void ExportableAsset::saveSplitAssets(const fs::path &outputFolder) {
+    const auto &args = m_resources.arguments();
+
+    // The nodes of each referenced file, as in packAccessorsPerReference
+    std::map<std::string, std::string> referencePerNode;
+
+    if (args.splitAssets == AssetSplit::REFERENCE) {
+        MStringArray refNames;
+        THROW_ON_FAILURE(MFileIO::getReferences(refNames));
+
+        for (auto refIndex = 0U; refIndex < refNames.length(); ++refIndex) {
+            MStringArray refNodes;
+            THROW_ON_FAILURE(MFileIO::getReferenceNodes(refNames[refIndex], refNodes));
+
+            const auto refStem = fs::path(refNames[refIndex].asChar()).stem().generic_string();
+
+            for (auto i = 0U; i < refNodes.length(); ++i) {
+                referencePerNode.emplace(refNodes[i].asChar(), refStem);
+            }
+        }
+    }
+
+    struct SplitAsset {
+        std::string name;
+        std::vector<GLTF::Node *> rootNodes;
+
+        // The index of the asset this one is merged into, see below.
+        size_t mergedIndex;
+    };
+
+    std::vector<SplitAsset> assets;
+    std::map<std::string, size_t> assetIndexPerName;
+    std::map<const GLTF::Node *, size_t> assetIndexPerNode;
+
+    for (auto &&pair : m_scene.orphans()) {
+        const auto name = splitAssetName(*pair.second, referencePerNode);
+
+        const auto it = assetIndexPerName.emplace(name, assets.size()).first;
+        if (it->second == assets.size()) {
+            assets.push_back({name, {}, it->second});
+        }
+
+        GLTF::Node *rootNode = &pair.second->glSecondaryNode();
+        assets[it->second].rootNodes.push_back(rootNode);
+
+        std::vector<const GLTF::Node *> pendingNodes{rootNode};
+        while (!pendingNodes.empty()) {
+            const auto *node = pendingNodes.back();
+            pendingNodes.pop_back();
+            assetIndexPerNode[node] = it->second;
+            pendingNodes.insert(pendingNodes.end(), node->children.begin(), node->children.end());
+        }
+    }
+
+    // A skinned mesh needs its joints, so the asset with the mesh and the
+    // assets with its joints are written as one.
+    const auto findMerged = [&](size_t index) {
+        while (assets[index].mergedIndex != index) {
+            index = assets[index].mergedIndex;
+        }
+        return index;
+    };
+
+    for (auto &&pair : assetIndexPerNode) {
+        if (!pair.first->skin)
+            continue;
+
+        for (const auto *joint : pair.first->skin->joints) {
+            const auto jointIt = assetIndexPerNode.find(joint);
+            if (jointIt == assetIndexPerNode.end())
+                continue;
+
+            const auto meshIndex = findMerged(pair.second);
+            const auto jointIndex = findMerged(jointIt->second);
+            if (meshIndex != jointIndex) {
+                cout << prefix << "Writing asset '" << assets[std::max(meshIndex, jointIndex)].name << "' with asset '"
+                     << assets[std::min(meshIndex, jointIndex)].name << "', it has the skeleton of a mesh" << endl;
+                assets[std::max(meshIndex, jointIndex)].mergedIndex = std::min(meshIndex, jointIndex);
+            }
+        }
+    }
+
+    for (auto &asset : assets) {
+        const auto index = findMerged(asset.mergedIndex);
+        if (&asset != &assets[index]) {
+            auto &target = assets[index];
+            target.rootNodes.insert(target.rootNodes.end(), asset.rootNodes.begin(), asset.rootNodes.end());
+        }
+    }
+
+    for (auto &&pair : assetIndexPerNode) {
+        pair.second = findMerged(pair.second);
+    }
+
+    for (size_t assetIndex = 0; assetIndex < assets.size(); ++assetIndex) {
+        auto &asset = assets[assetIndex];
+        if (asset.mergedIndex != assetIndex)
+            continue;
+
+        // The glTF writer only numbers the objects without an id, so the ids
+        // of the previous asset are cleared first.
+        const auto clearIds = [](const auto &objects) {
+            for (auto *object : objects) {
+                object->id = -1;
+            }
+        };
+
+        clearIds(m_glAsset.getAllNodes());
+        clearIds(m_glAsset.getAllMeshes());
+        clearIds(m_glAsset.getAllSkins());
+        clearIds(m_glAsset.getAllMaterials());
+        clearIds(m_glAsset.getAllTextures());
+        clearIds(m_glAsset.getAllImages());
+        clearIds(m_glAsset.getAllAccessors());
+        clearIds(m_glAsset.getAllBufferViews());
+        clearIds(m_glAsset.getAllBuffers());
+        clearIds(m_glAsset.animations);
+
+        for (auto *node : m_glAsset.getAllNodes()) {
+            if (node->camera) {
+                node->camera->id = -1;
+            }
+        }
+
+        for (auto *texture : m_glAsset.getAllTextures()) {
+            if (texture->sampler) {
+                texture->sampler->id = -1;
+            }
+        }
+
+        for (auto &clip : m_clips) {
+            for (auto *channel : clip->glAnimation.channels) {
+                channel->sampler->id = -1;
+            }
+        }
+
+        GLTF::Scene glScene;
+        GLTF::Node glRootNode;
+
+        if (args.forceRootNode || args.getRootScaleFactor() != 1) {
+            // Each asset gets its own copy of the scaled root node.
+            glRootNode.transform = m_glRootNode.transform;
+            glRootNode.children = asset.rootNodes;
+            glScene.nodes.push_back(&glRootNode);
+        } else {
+            glScene.nodes = asset.rootNodes;
+        }
+
+        // The clips only animate the nodes of this asset.
+        std::vector<std::unique_ptr<GLTF::Animation>> glAnimations;
+
+        GLTF::Asset glAsset;
+        glAsset.scenes.push_back(&glScene);
+        glAsset.scene = 0;
+        glAsset.metadata = &m_glMetadata;
+
+        for (auto &clip : m_clips) {
+            auto glAnimation = std::make_unique<GLTF::Animation>();
+            glAnimation->name = clip->glAnimation.name;
+
+            for (auto *channel : clip->glAnimation.channels) {
+                const auto it = assetIndexPerNode.find(channel->target->node);
+                if (it != assetIndexPerNode.end() && it->second == assetIndex) {
+                    glAnimation->channels.push_back(channel);
+                }
+            }
+
+            if (!glAnimation->channels.empty()) {
+                glAsset.animations.push_back(glAnimation.get());
+                glAnimations.emplace_back(std::move(glAnimation));
+            }
+        }
+
+        cout << prefix << "Saving asset '" << asset.name << "' with " << asset.rootNodes.size() << " root nodes and "
+             << glAsset.animations.size() << " clips..." << endl;
+
+        saveAsset(glAsset, asset.name, outputFolder / asset.name);
+    }
+}
+
+void ExportableAsset::packAccessorsPerReference(AccessorsPerDagPath &accessorsPerDagPath, AccessorPacker &packer,
+                                                PackedBufferMap &packedBufferMap, const std::string &sceneName, std::string nameSuffix,
+                                                const std::vector<GLTF::Accessor *> &sharedAccessors) const {
     AccessorsPerDagPath remainingAccessorsPerDagPath = accessorsPerDagPath;
 
     const auto &args = m_resources.arguments();
@@ -452,30 +1202,32 @@ void ExportableAsset::packMeshAccessors(AccessorsPerDagPath &accessorsPerDagPath
             auto refStem = refPath.stem().generic_string();
 
             const auto bufferName = refStem + nameSuffix;
-            const auto buffer = packer.packAccessors(refAccessors, bufferName);
+            const auto buffer = packer.packAccessors(m_resources.packedAccessors(refAccessors), bufferName);
 
-            packedBufferMap[buffer] = bufferName;
+            if (buffer) {
+                packedBufferMap[buffer] = bufferName;
+            }
         }
 
         if (!remainingAccessorsPerDagPath.empty()) {
             std::cerr << prefix
-                      << "WARNING: Found unreferenced meshes in scene but "
+                      << "WARNING: Found unreferenced nodes in scene but "
                          "-splitByReference flag was passed! Merging all these "
-                         "meshes into a single buffer"
+                         "into a single buffer"
                       << endl;
         }
     }
 
     // Pack all remaining accessors into a single buffer.
     {
-        std::vector<GLTF::Accessor *> flatAccessors;
+        std::vector<GLTF::Accessor *> flatAccessors = sharedAccessors;
 
         for (auto &pair : remainingAccessorsPerDagPath) {
             std::copy(pair.second.begin(), pair.second.end(), std::back_inserter(flatAccessors));
         }
 
-        const auto bufferName = args.sceneName.asChar() + nameSuffix;
-        const auto buffer = packer.packAccessors(flatAccessors, bufferName);
+        const auto bufferName = sceneName + nameSuffix;
+        const auto buffer = packer.packAccessors(m_resources.packedAccessors(flatAccessors), bufferName);
 
         if (buffer) {
             packedBufferMap[buffer] = bufferName;
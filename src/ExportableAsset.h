@@ -1,19 +1,29 @@
 #pragma once
+#include "ClipAppender.h"
 #include "ExportableClip.h"
 #include "ExportableResources.h"
 #include "ExportableScene.h"
 
 class Arguments;
+class ClipScheduler;
+class SampleCache;
 
 // A packed buffer and a filename hint.
 typedef std::map<GLTF::Buffer *, std::string> PackedBufferMap;
 
 class ExportableAsset {
   public:
+    /** Prepares the export, see exportNextStep */
     ExportableAsset(const Arguments &args);
     ~ExportableAsset();
 
-    const std::string &prettyJsonString() const;
+    /** Exports the next mesh, camera, clip or sample time, or finishes the scene. Returns
+     * false when the asset can be saved. The Maya UI can be serviced between
+     * the steps, see -async. */
+    bool exportNextStep();
+
+    /** Writes the JSON of the saved asset */
+    void writeJSON(std::ostream &stream, bool isPretty) const;
 
     void save();
 
@@ -29,6 +39,12 @@ class ExportableAsset {
 
     Cleanup m_cleanup;
 
+    enum class Stage { MESHES, CAMERAS, CLIPS, DONE };
+
+    Stage m_stage = Stage::MESHES;
+    size_t m_stepIndex = 0;
+    MTime m_currentFrameTime;
+
     GLTF::Asset m_glAsset;
     GLTF::Asset::Metadata m_glMetadata;
     GLTF::Node m_glRootNode;
@@ -40,16 +56,57 @@ class ExportableAsset {
     // std::vector<std::unique_ptr<ExportableItem>> m_items;
     std::vector<std::unique_ptr<ExportableClip>> m_clips;
 
-    std::string m_rawJsonString;
-    mutable std::string m_prettyJsonString;
+    // While exporting the clips, the clips that are not sampled yet.
+    std::unique_ptr<ClipScheduler> m_clipScheduler;
+    std::vector<std::unique_ptr<ExportableClip>> m_pendingClips;
+    std::unique_ptr<SampleCache> m_sampleCache;
+
+    std::vector<GLTF::Node *> m_rootBatchNodes;
+
+    // With -appendClipsTo, the glTF file the clips are added to.
+    std::unique_ptr<ClipAppender> m_clipAppender;
+
+    // The packers of the saved assets. With -splitAssets, the accessors
+    // shared by assets are packed again, from the buffers of the previous
+    // asset, so these are kept until the end.
+    std::vector<std::unique_ptr<class AccessorPacker>> m_bufferPackers;
+
+    rapidjson::Document m_jsonDocument;
+
+    /** With -appendClipsTo, exports the nodes of the file the clips are appended to */
+    void findAppendedNodes();
+
+    void beginClips();
+
+    /** Adds the animations of the sampled clips */
+    void finishClips();
+
+    /** Adds the root nodes to the scene */
+    void finishScene();
+
+    /** The keys of the glTF nodes written as JSON, indexed by node id */
+    std::vector<NodeKey> nodeKeys(size_t nodeCount) const;
+
+    /** Writes the glTF file and buffers of the asset to the folder */
+    void saveAsset(GLTF::Asset &glAsset, const std::string &sceneName, const fs::path &outputFolder);
+
+    /** With -splitAssets, writes an asset per top-level node or reference */
+    void saveSplitAssets(const fs::path &outputFolder);
+
+    /** The name of the asset of the node without parent, see -splitAssets */
+    std::string splitAssetName(const ExportableNode &orphan, const std::map<std::string, std::string> &referencePerNode) const;
 
     void dumpAccessorComponents(
         const std::vector<GLTF::Accessor *> &accessors) const;
 
-    void packMeshAccessors(AccessorsPerDagPath &accessors,
-                           class AccessorPacker &packer,
-                           PackedBufferMap &packedBufferMap,
-                           std::string namePrefix) const;
+    /** Packs the accessors into a buffer per reference with splitByReference,
+     * the remaining and shared accessors into a single buffer */
+    void packAccessorsPerReference(AccessorsPerDagPath &accessors,
+                                   class AccessorPacker &packer,
+                                   PackedBufferMap &packedBufferMap,
+                                   const std::string &sceneName,
+                                   std::string nameSuffix,
+                                   const std::vector<GLTF::Accessor *> &sharedAccessors = {}) const;
 
     static void create(std::ofstream &file, const std::string &path,
                        const std::ios_base::openmode mode);
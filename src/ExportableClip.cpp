@@ -1,56 +1,212 @@
 #include "externals.h"
 
+#include "ExportStatistics.h"
 #include "ExportableClip.h"
+#include "ExportableMesh.h"
 #include "ExportableNode.h"
-#include "progress.h"
-#include "timeControl.h"
+#include "ExportableResources.h"
+#include "parallel.h"
 
 ExportableClip::ExportableClip(const Arguments &args, const AnimClipArg &clipArg, const ExportableScene &scene)
-    : m_frames(args.makeName(clipArg.name + "/anim/frames"), clipArg.frameCount(), clipArg.framesPerSecond) {
+    : m_clipArg(clipArg)
+    , m_resources(scene.resources())
+    , m_stepDetectSampleCount(args.getStepDetectSampleCount())
+    , m_frames(m_resources.frameTimeInputs(), clipArg.frameCount(), clipArg.framesPerSecond)
+    , m_scaleFactor(args.getBakeScaleFactor())
+    , m_isContextEvaluated(args.contextSampling) {
     glAnimation.name = clipArg.name;
 
-    const auto stepDetectSampleCount = args.getStepDetectSampleCount();
-    const auto frameCount = m_frames.count;
     const auto scaleFactor = args.getBakeScaleFactor();
 
     auto &items = scene.table();
 
+    // The curves are exported between the first and last frame of the clip.
+    const auto exportsCurves = args.exportAnimCurves && !args.forceAnimationSampling;
+    const auto startTime = clipArg.startTime;
+    const auto endTime = startTime + MTime((m_frames.count - 1) / clipArg.framesPerSecond, MTime::kSeconds);
+
     m_nodeAnimations.reserve(items.size());
 
     for (auto &pair : items) {
         auto &node = pair.second;
+        if (node->isStatic)
+            continue;
+
         auto nodeAnimation = node->createAnimation(args, m_frames, scaleFactor);
         if (nodeAnimation) {
+            if (exportsCurves) {
+                nodeAnimation->exportCurves(startTime, endTime);
+            }
             m_nodeAnimations.emplace_back(std::move(nodeAnimation));
         }
     }
 
-    const auto superSampleFrameRate = stepDetectSampleCount * clipArg.framesPerSecond;
+    if (args.animatedBounds) {
+        for (auto &pair : items) {
+            auto &node = pair.second;
+            const auto *mesh = node->mesh();
+            if (mesh && !mesh->nodeBounds().empty()) {
+                m_meshBounds.push_back({node, &mesh->nodeBounds(), Position(), Position()});
+            }
+        }
+
+        clearMeshBounds();
+    }
+}
+
+void ExportableClip::clearMeshBounds() {
+    const auto maxFloat = std::numeric_limits<float>::max();
+
+    for (auto &&meshBounds : m_meshBounds) {
+        meshBounds.min = {maxFloat, maxFloat, maxFloat};
+        meshBounds.max = {-maxFloat, -maxFloat, -maxFloat};
+    }
+}
+
+bool ExportableClip::needsSampling() const {
+    // The bounds are always sampled, even when the nodes are curve driven.
+    return !m_hasReadSamples &&
+           (!m_meshBounds.empty() || std::any_of(m_nodeAnimations.begin(), m_nodeAnimations.end(),
+                                                 [](auto &nodeAnimation) { return nodeAnimation->needsSampling(); }));
+}
+
+ExportableClip::~ExportableClip() = default;
+
+std::vector<const ExportableNode *> ExportableClip::sampledNodes() const {
+    std::vector<const ExportableNode *> nodes;
+    for (auto &nodeAnimation : m_nodeAnimations) {
+        if (nodeAnimation->needsSampling()) {
+            nodes.emplace_back(&nodeAnimation->node);
+        }
+    }
+    return nodes;
+}
+
+void ExportableClip::writeSamples(std::ostream &stream) const {
+    for (auto &nodeAnimation : m_nodeAnimations) {
+        if (nodeAnimation->needsSampling()) {
+            nodeAnimation->writeSamples(stream);
+        }
+    }
+
+    for (auto &&meshBounds : m_meshBounds) {
+        stream.write(reinterpret_cast<const char *>(&meshBounds.min), sizeof(meshBounds.min));
+        stream.write(reinterpret_cast<const char *>(&meshBounds.max), sizeof(meshBounds.max));
+    }
+}
+
+bool ExportableClip::readSamples(std::istream &stream) {
+    const auto isValid = std::all_of(m_nodeAnimations.begin(), m_nodeAnimations.end(), [&](auto &nodeAnimation) {
+        return !nodeAnimation->needsSampling() || nodeAnimation->readSamples(stream);
+    }) && std::all_of(m_meshBounds.begin(), m_meshBounds.end(), [&](MeshBounds &meshBounds) {
+        return stream.read(reinterpret_cast<char *>(&meshBounds.min), sizeof(meshBounds.min)) &&
+               stream.read(reinterpret_cast<char *>(&meshBounds.max), sizeof(meshBounds.max));
+    });
+
+    // Trailing data means the samples are of another clip.
+    if (!isValid || stream.peek() != std::istream::traits_type::eof()) {
+        for (auto &nodeAnimation : m_nodeAnimations) {
+            if (nodeAnimation->needsSampling()) {
+                nodeAnimation->clearSamples();
+            }
+        }
+        clearMeshBounds();
+        return false;
+    }
+
+    m_hasReadSamples = true;
+    return true;
+}
+
+MTime ExportableClip::sampleTime(const size_t relativeFrameIndex, const size_t superSampleIndex) const {
+    const auto superSampleFrameRate = m_stepDetectSampleCount * m_clipArg.framesPerSecond;
 
     // To make sure Maya never rounds to just before a frame, we add half the smallest time step. Need to detect step interpolation
     const double mayaTimeEpsilon = 0.5 / 141120000;
 
-    for (size_t relativeFrameIndex = 0; relativeFrameIndex < frameCount; ++relativeFrameIndex) {
-        for (size_t superSampleIndex = 0; superSampleIndex < stepDetectSampleCount; ++superSampleIndex) {
-            const double relativeFrameTime = (relativeFrameIndex * stepDetectSampleCount + superSampleIndex) / superSampleFrameRate + mayaTimeEpsilon;
-            const MTime absoluteFrameTime = clipArg.startTime + MTime(relativeFrameTime, MTime::kSeconds);
-            setCurrentTime(absoluteFrameTime, args.redrawViewport && superSampleIndex == 0);
-            // const auto absoluteFrameTimeDebug = MAnimControl::currentTime().as(MTime::k24FPS);
+    const double relativeFrameTime = (relativeFrameIndex * m_stepDetectSampleCount + superSampleIndex) / superSampleFrameRate + mayaTimeEpsilon;
+    return m_clipArg.startTime + MTime(relativeFrameTime, MTime::kSeconds);
+}
 
-            NodeTransformCache transformCache;
-            for (auto &nodeAnimation : m_nodeAnimations) {
-                nodeAnimation->sampleAt(absoluteFrameTime, relativeFrameIndex, superSampleIndex, transformCache);
-            }
+void ExportableClip::sampleAt(const MTime &absoluteTime, const size_t relativeFrameIndex, const size_t superSampleIndex,
+                              NodeTransformCache &transformCache) {
+    // The sampled nodes don't change while sampling, the clip is sampled
+    // from its first frame.
+    if (relativeFrameIndex == 0 && superSampleIndex == 0) {
+        m_sampledNodes = sampledNodes();
+    }
+
+    // All transforms of the frame are decomposed at once.
+    transformCache.decomposeAll(m_sampledNodes, m_scaleFactor);
+
+    for (auto &nodeAnimation : m_nodeAnimations) {
+        nodeAnimation->sampleAt(absoluteTime, relativeFrameIndex, superSampleIndex, transformCache);
+    }
+
+    // The super samples are only used to detect steps.
+    if (superSampleIndex == 0) {
+        for (auto &&meshBounds : m_meshBounds) {
+            expandWorldBounds(*meshBounds.nodeBounds, *meshBounds.node, m_scaleFactor, m_isContextEvaluated,
+                              meshBounds.min, meshBounds.max);
         }
+    }
+}
 
-        if (relativeFrameIndex % checkProgressFrameInterval == checkProgressFrameInterval - 1) {
-            uiAdvanceProgress("exporting clip '" + clipArg.name + formatted("' %d%%", relativeFrameIndex * 100 / frameCount));
+void ExportableClip::finish() {
+    // The channels of all nodes are finished in parallel, this doesn't touch Maya.
+    std::vector<std::pair<NodeAnimation *, size_t>> channels;
+    for (auto &nodeAnimation : m_nodeAnimations) {
+        for (size_t channelIndex = 0; channelIndex < nodeAnimation->channelCount(); ++channelIndex) {
+            channels.emplace_back(nodeAnimation.get(), channelIndex);
         }
     }
 
+    parallelForEach(channels.size(), 1, [&](const size_t index) {
+        auto &channel = channels[index];
+        channel.first->finishChannel(channel.second, glAnimation.name);
+    });
+
+    // Adding the channels in node order keeps the output deterministic.
     for (auto &nodeAnimation : m_nodeAnimations) {
-        nodeAnimation->exportTo(glAnimation);
+        nodeAnimation->exportTo(glAnimation, m_resources);
+    }
+
+    for (auto &&meshBounds : m_meshBounds) {
+        if (meshBounds.min[0] <= meshBounds.max[0]) {
+            m_resources.animatedBounds().add(&glAnimation, &meshBounds.node->glPrimaryNode(), meshBounds.min,
+                                             meshBounds.max);
+        }
+    }
+
+    if (auto *statistics = m_resources.statistics()) {
+        auto &clipStatistics = statistics->addClip(m_clipArg.name);
+
+        for (auto &nodeAnimation : m_nodeAnimations) {
+            nodeAnimation->addStatistics(clipStatistics);
+        }
+
+        AccessorsPerDagPath outputsPerDagPath;
+        std::vector<GLTF::Accessor *> inputs;
+        getAllAccessors(outputsPerDagPath, inputs);
+
+        for (auto *input : inputs) {
+            clipStatistics.inputByteCount += glAccessorByteLength(input);
+        }
     }
 }
 
-ExportableClip::~ExportableClip() = default;
+void ExportableClip::getAllAccessors(AccessorsPerDagPath &outputsPerDagPath, std::vector<GLTF::Accessor *> &inputs) const {
+    std::vector<GLTF::Accessor *> nodeInputs;
+
+    for (auto &nodeAnimation : m_nodeAnimations) {
+        nodeAnimation->getAllAccessors(outputsPerDagPath[nodeAnimation->node.dagPath], nodeInputs);
+    }
+
+    // Keep the first use of each input, so the order is deterministic.
+    std::set<GLTF::Accessor *> seen;
+    for (auto *input : nodeInputs) {
+        if (seen.insert(input).second) {
+            inputs.emplace_back(input);
+        }
+    }
+}
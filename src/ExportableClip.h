@@ -1,5 +1,6 @@
 #pragma once
 
+#include "AnimatedBounds.h"
 #include "Arguments.h"
 #include "ExportableFrames.h"
 #include "NodeAnimation.h"
@@ -11,9 +12,63 @@ class ExportableClip {
 
     GLTF::Animation glAnimation;
 
+    const AnimClipArg &clipArg() const { return m_clipArg; }
+
+    size_t frameCount() const { return m_frames.count; }
+    size_t stepDetectSampleCount() const { return m_stepDetectSampleCount; }
+
+    /** False when all node animations are exported from anim curves, or the samples were read from the cache */
+    bool needsSampling() const;
+
+    /** The nodes whose animation is sampled, in the order of their samples */
+    std::vector<const ExportableNode *> sampledNodes() const;
+
+    /** Writes the samples of the sampled node animations, after all samples are taken */
+    void writeSamples(std::ostream &stream) const;
+
+    /** Reads the samples written by writeSamples instead of sampling the clip.
+     * Returns false, without samples, when these don't match the clip. */
+    bool readSamples(std::istream &stream);
+
+    /** The absolute time of the sample; identical sample times of different clips are evaluated once */
+    MTime sampleTime(size_t relativeFrameIndex, size_t superSampleIndex) const;
+
+    /** Samples all node animations, the caller must evaluate the scene at the sample time */
+    void sampleAt(const MTime &absoluteTime, size_t relativeFrameIndex, size_t superSampleIndex, NodeTransformCache &transformCache);
+
+    /** Exports the node animations to the glTF animation, after all samples are taken */
+    void finish();
+
+    /** Gets the output accessors of each animated node, and the input accessors shared by the nodes.
+     * Clips with the same times share their inputs, see FrameTimeInputs. */
+    void getAllAccessors(AccessorsPerDagPath &outputsPerDagPath, std::vector<GLTF::Accessor *> &inputs) const;
+
   private:
+    const AnimClipArg &m_clipArg;
+    ExportableResources &m_resources;
+    const size_t m_stepDetectSampleCount;
+    bool m_hasReadSamples = false;
+
     ExportableFrames m_frames;
     std::vector<std::unique_ptr<NodeAnimation>> m_nodeAnimations;
 
+    // The nodes of sampledNodes, while sampling.
+    std::vector<const ExportableNode *> m_sampledNodes;
+
+    // With -animatedBounds, the world boxes of the skinned and morphed
+    // meshes over the frames of the clip.
+    struct MeshBounds {
+        const ExportableNode *node;
+        const std::vector<NodeBounds> *nodeBounds;
+        Position min;
+        Position max;
+    };
+
+    std::vector<MeshBounds> m_meshBounds;
+    const double m_scaleFactor;
+    const bool m_isContextEvaluated;
+
+    void clearMeshBounds();
+
     DISALLOW_COPY_MOVE_ASSIGN(ExportableClip);
 };
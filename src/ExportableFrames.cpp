@@ -1,12 +1,10 @@
 #include "externals.h"
 
 #include "ExportableFrames.h"
-#include "accessors.h"
+#include "FrameTimeInputs.h"
 
-ExportableFrames::ExportableFrames(std::string accessorName,
-                                   const int frameCount,
-                                   const double framesPerSecond)
-    : count(frameCount), m_accessorName(std::move(accessorName)) {
+ExportableFrames::ExportableFrames(FrameTimeInputs &inputs, const int frameCount, const double framesPerSecond)
+    : count(frameCount), framesPerSecond(framesPerSecond), m_inputs(inputs) {
     m_glTimes.reserve(frameCount);
 
     for (auto relativeFrameIndex = 0; relativeFrameIndex < frameCount; ++relativeFrameIndex) {
@@ -16,18 +14,39 @@ ExportableFrames::ExportableFrames(std::string accessorName,
 }
 
 GLTF::Accessor *ExportableFrames::glInputs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
     if (!m_glInputs) {
-        m_glInputs = contiguousChannelAccessor(m_accessorName, m_glTimes, 1);
+        m_glInputs = m_inputs.input(m_glTimes);
     }
 
-    return m_glInputs.get();
+    return m_glInputs;
 }
 
 GLTF::Accessor *ExportableFrames::glInput0() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
     if (!m_glInput0) {
-        m_glInput0 = contiguousChannelAccessor(m_accessorName, span(m_glTimes).subspan(0, 1), 1);
+        m_glInput0 = m_inputs.input(std::vector<float>(m_glTimes.begin(), m_glTimes.begin() + 1));
     }
 
-    return m_glInput0.get();
+    return m_glInput0;
 }
 
+GLTF::Accessor *ExportableFrames::glInputs(const std::vector<int> &frameIndices) const {
+    if (frameIndices.size() == m_glTimes.size())
+        return glInputs();
+
+    std::vector<float> times;
+    times.reserve(frameIndices.size());
+
+    for (auto frameIndex : frameIndices) {
+        times.emplace_back(m_glTimes.at(frameIndex));
+    }
+
+    return m_inputs.input(times);
+}
+
+GLTF::Accessor *ExportableFrames::glKeyTimes(const std::vector<float> &times) const {
+    return m_inputs.input(times);
+}
@@ -2,25 +2,39 @@
 
 #include "macros.h"
 
+class FrameTimeInputs;
+
 class ExportableFrames {
   public:
-    ExportableFrames(std::string accessorName, int frameCount, double framesPerSecond);
+    ExportableFrames(FrameTimeInputs &inputs, int frameCount, double framesPerSecond);
     ~ExportableFrames() = default;
 
     const int count;
+    const double framesPerSecond;
 
     GLTF::Accessor *glInputs() const;
 
     GLTF::Accessor *glInput0() const;
 
+    /** The times of the given frames, for channels with non-uniform keys.
+     * Channels keeping the same frames share the accessor. */
+    GLTF::Accessor *glInputs(const std::vector<int> &frameIndices) const;
+
+    /** The given clip-relative times in seconds, for keys in between frames */
+    GLTF::Accessor *glKeyTimes(const std::vector<float> &times) const;
+
   private:
-    const std::string m_accessorName;
+    // The accessors are shared with the other clips, see FrameTimeInputs.
+    FrameTimeInputs &m_inputs;
 
     // For each animation frame, the clip-relative time in seconds.
     std::vector<float> m_glTimes;
 
-    mutable std::unique_ptr<GLTF::Accessor> m_glInputs;
-    mutable std::unique_ptr<GLTF::Accessor> m_glInput0;
+    // The accessors are created on demand by channels finished in parallel.
+    mutable std::mutex m_mutex;
+
+    mutable GLTF::Accessor *m_glInputs = nullptr;
+    mutable GLTF::Accessor *m_glInput0 = nullptr;
 
     DISALLOW_COPY_MOVE_ASSIGN(ExportableFrames);
 };
@@ -7,6 +7,7 @@
 #include "ExportableTexture.h"
 #include "MayaException.h"
 #include "filesystem.h"
+#include "parallel.h"
 
 ExportableMaterial::ExportableMaterial() = default;
 ExportableMaterial::~ExportableMaterial() = default;
@@ -35,7 +36,7 @@ bool ExportableMaterial::tryCreateNormalTexture(ExportableResources &resources,
     if (!outputTexture)
         return false;
 
-    outputTexture = ExportableTexture::tryLoad(resources, normalCamera, "bumpValue");
+    outputTexture = ExportableTexture::tryLoad(resources, normalCamera, "bumpValue", IMAGE_SLOT_Normal);
     return outputTexture != nullptr;
 }
 
@@ -70,6 +71,24 @@ bool ExportableMaterialBasePBR::hasTextures() const {
            m_glEmissiveTexture.texture || m_glOcclusionTexture.texture;
 }
 
+std::vector<ExportableMaterial::TextureInfo> ExportableMaterialBasePBR::textureInfos() {
+    std::vector<TextureInfo> infos;
+
+    const auto add = [&](const char *member, const bool isMetallicRoughnessMember, const ImageSlot slot,
+                         GLTF::MaterialPBR::Texture &texture) {
+        if (texture.texture) {
+            infos.push_back({member, isMetallicRoughnessMember, slot, &texture});
+        }
+    };
+
+    add("baseColorTexture", true, IMAGE_SLOT_Color, m_glBaseColorTexture);
+    add("metallicRoughnessTexture", true, IMAGE_SLOT_ORM, m_glMetallicRoughnessTexture);
+    add("normalTexture", false, IMAGE_SLOT_Normal, m_glNormalTexture);
+    add("occlusionTexture", false, IMAGE_SLOT_ORM, m_glOcclusionTexture);
+    add("emissiveTexture", false, IMAGE_SLOT_Color, m_glEmissiveTexture);
+    return infos;
+}
+
 ExportableMaterialPBR::ExportableMaterialPBR(ExportableResources &resources, const MFnDependencyNode &shaderNode) {
     MStatus status;
 
@@ -117,7 +136,7 @@ void ExportableMaterialPBR::convert(ExportableResources &resources, const MObjec
     m_glMetallicRoughness.metallicFactor = 0;
     m_glMaterial.metallicRoughness = &m_glMetallicRoughness;
 
-    const auto colorTexture = ExportableTexture::tryLoad(resources, shaderObject, "color");
+    const auto colorTexture = ExportableTexture::tryLoad(resources, shaderObject, "color", IMAGE_SLOT_Color);
     if (colorTexture) {
         m_glBaseColorTexture.texture = colorTexture;
         m_glMetallicRoughness.baseColorTexture = &m_glBaseColorTexture;
@@ -196,7 +215,7 @@ void ExportableMaterialPBR::loadPBR(ExportableResources &resources, const MFnDep
         m_glMaterial.alphaMode = "BLEND";
     }
 
-    const auto baseColorTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_BaseColorTexture");
+    const auto baseColorTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_BaseColorTexture", IMAGE_SLOT_Color);
     if (baseColorTexture) {
         m_glBaseColorTexture.texture = baseColorTexture;
         m_glMetallicRoughness.baseColorTexture = &m_glBaseColorTexture;
@@ -217,8 +236,8 @@ void ExportableMaterialPBR::loadPBR(ExportableResources &resources, const MFnDep
         m_glMaterial.metallicRoughness = &m_glMetallicRoughness;
     }
 
-    const auto roughnessTexture = ExportableTexture::tryCreate(resources, shaderObject, "u_RoughnessTexture");
-    const auto metallicTexture = ExportableTexture::tryCreate(resources, shaderObject, "u_MetallicTexture");
+    const auto roughnessTexture = ExportableTexture::tryCreate(resources, shaderObject, "u_RoughnessTexture", IMAGE_SLOT_ORM);
+    const auto metallicTexture = ExportableTexture::tryCreate(resources, shaderObject, "u_MetallicTexture", IMAGE_SLOT_ORM);
     if (roughnessTexture || metallicTexture) {
         status = tryCreateRoughnessMetalnessTexture(resources, metallicTexture.get(), roughnessTexture.get(), status);
         m_glMetallicRoughness.metallicRoughnessTexture = &m_glMetallicRoughnessTexture;
@@ -230,7 +249,7 @@ void ExportableMaterialPBR::loadPBR(ExportableResources &resources, const MFnDep
         m_glMaterial.emissiveFactor = &m_glEmissiveFactor[0];
     }
 
-    const auto emissiveTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_EmissiveTexture");
+    const auto emissiveTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_EmissiveTexture", IMAGE_SLOT_Color);
     if (emissiveTexture) {
         m_glEmissiveTexture.texture = emissiveTexture;
         m_glMaterial.emissiveTexture = &m_glEmissiveTexture;
@@ -239,7 +258,7 @@ void ExportableMaterialPBR::loadPBR(ExportableResources &resources, const MFnDep
     // Ambient occlusion
     getScalar(shaderObject, "u_OcclusionStrength", m_glOcclusionTexture.strength);
 
-    const auto occlusionTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_OcclusionTexture");
+    const auto occlusionTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_OcclusionTexture", IMAGE_SLOT_ORM);
     if (occlusionTexture) {
         m_glOcclusionTexture.texture = occlusionTexture;
         m_glMaterial.occlusionTexture = &m_glOcclusionTexture;
@@ -248,7 +267,7 @@ void ExportableMaterialPBR::loadPBR(ExportableResources &resources, const MFnDep
     // Normal
     getScalar(shaderObject, "u_NormalScale", m_glNormalTexture.scale);
 
-    const auto normalTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_NormalTexture");
+    const auto normalTexture = ExportableTexture::tryLoad(resources, shaderObject, "u_NormalTexture", IMAGE_SLOT_Normal);
     if (normalTexture) {
         m_glNormalTexture.texture = normalTexture;
         m_glMaterial.normalTexture = &m_glNormalTexture;
@@ -285,15 +304,38 @@ ExportableDebugMaterial::ExportableDebugMaterial(const Float3 &hsv) {
 
 ExportableDebugMaterial::~ExportableDebugMaterial() = default;
 
+// The minimum number of pixels merged per thread.
+const size_t mergeChunkPixelCount = 1 << 18;
+
+// Copies the blue metallic channel into the roughness pixels, keeping their
+// green roughness channel, with an opaque alpha. The rows are merged in
+// parallel, the branch-free inner loop is vectorized by the compiler.
+static void mergeMetallicIntoRoughness(uint32_t *roughnessPixels, const uint32_t *metallicPixels,
+                                       const unsigned width, const unsigned height) {
+    const auto minChunkRowCount = std::max<size_t>(1, mergeChunkPixelCount / std::max(1u, width));
+
+    parallelFor(height, minChunkRowCount, [=](const size_t beginRow, const size_t endRow) {
+        const auto begin = beginRow * width;
+        const auto end = endRow * width;
+        for (size_t i = begin; i < end; ++i) {
+            roughnessPixels[i] = (roughnessPixels[i] & 0xff00) | (metallicPixels[i] & 0xff0000) | 0xff000000;
+        }
+    });
+}
+
 MStatus ExportableMaterialPBR::tryCreateRoughnessMetalnessTexture(ExportableResources &resources,
                                                                   const ExportableTexture *metallicTexture,
                                                                   const ExportableTexture *roughnessTexture,
                                                                   MStatus status) {
     // TODO: Test this code!
-    if (!metallicTexture || roughnessTexture->glTexture == metallicTexture->glTexture) {
+    if (!metallicTexture) {
         m_glMetallicRoughnessTexture.texture = roughnessTexture->glTexture;
-    } else if (!roughnessTexture) {
+    } else if (!roughnessTexture || roughnessTexture->glTexture == metallicTexture->glTexture) {
         m_glMetallicRoughnessTexture.texture = metallicTexture->glTexture;
+    } else if (const auto mergedTexture =
+                   resources.findMergedTexture(metallicTexture->glTexture, roughnessTexture->glTexture)) {
+        // Materials sharing the textures share the merged texture too.
+        m_glMetallicRoughnessTexture.texture = mergedTexture;
     } else {
         cerr << prefix << "WARNING: Merging roughness and metallic into one texture" << endl;
 
@@ -321,13 +363,8 @@ MStatus ExportableMaterialPBR::tryCreateRoughnessMetalnessTexture(ExportableReso
                                                 metallicTexture->imageFilePath.asChar(),
                                                 roughnessTexture->imageFilePath.asChar()));
         } else {
-            // Merge metallic into roughness
-            auto metallicPixels = reinterpret_cast<uint32_t *>(metallicImage.pixels());
-            auto roughnessPixels = reinterpret_cast<uint32_t *>(roughnessImage.pixels());
-            int64_t pixelCount = width * height;
-            while (--pixelCount >= 0) {
-                *roughnessPixels++ = (*roughnessPixels & 0xff00) | (*metallicPixels++ & 0xff0000) | 0xff000000;
-            }
+            mergeMetallicIntoRoughness(reinterpret_cast<uint32_t *>(roughnessImage.pixels()),
+                                       reinterpret_cast<const uint32_t *>(metallicImage.pixels()), width, height);
 
             // TODO: Add argument for output image file mime-type
             const fs::path roughnessPath{roughnessTexture->imageFilePath.asChar()};
@@ -343,13 +380,14 @@ MStatus ExportableMaterialPBR::tryCreateRoughnessMetalnessTexture(ExportableReso
                                                     "metallic-roughness texture to '%s'",
                                                     mergedImagePath.asChar()));
 
-            const auto imagePtr = resources.getImage(mergedImagePath.asChar());
+            const auto imagePtr = resources.getImage(mergedImagePath.asChar(), IMAGE_SLOT_ORM);
             assert(imagePtr);
 
             const auto texturePtr = resources.getTexture(imagePtr, roughnessTexture->glSampler);
             assert(texturePtr);
 
             m_glMetallicRoughnessTexture.texture = texturePtr;
+            resources.registerMergedTexture(metallicTexture->glTexture, roughnessTexture->glTexture, texturePtr);
         }
     }
     return status;
@@ -387,22 +425,14 @@ void ExportableMaterialPBR::loadAiStandard(
     }
 
     bool hasTransparency = false;
-    const auto baseColorTexture = ExportableTexture::tryLoad(resources, shaderObject, "baseColor");
+    const auto baseColorTexture = ExportableTexture::tryLoad(resources, shaderObject, "baseColor", IMAGE_SLOT_Color);
     if (baseColorTexture) {
         m_glBaseColorTexture.texture = baseColorTexture;
         m_glMetallicRoughness.baseColorTexture = &m_glBaseColorTexture;
 
-        unsigned baseColorWidth = baseColorTexture->source->getDimensions().first;
-        unsigned baseColorHeight = baseColorTexture->source->getDimensions().second;
-        uint32_t *baseColorPixels = reinterpret_cast<uint32_t *>(baseColorTexture->source->data);
-        int64_t pixelCount = baseColorWidth * baseColorHeight;
-        if (pixelCount) {
-            while (--pixelCount >= 0) {
-                // Check if the alpha is opaque
-                uint8_t *pixel = reinterpret_cast<uint8_t *>(baseColorPixels);
-                hasTransparency = hasTransparency || pixel[3] != 255;
-            }
-        }
+        // The image isn't decoded, its header tells whether it has alpha.
+        const auto *header = resources.getImageHeader(baseColorTexture->source);
+        hasTransparency = header && header->hasAlpha;
     }
 
     if (customBaseColor[3] != 1.0f || hasTransparency) {
@@ -420,8 +450,8 @@ void ExportableMaterialPBR::loadAiStandard(
         m_glMaterial.metallicRoughness = &m_glMetallicRoughness;
     }
 
-    const auto roughnessTexture = ExportableTexture::tryCreate(resources, shaderObject, "specularRoughness");
-    const auto metallicTexture = ExportableTexture::tryCreate(resources, shaderObject, "metalness");
+    const auto roughnessTexture = ExportableTexture::tryCreate(resources, shaderObject, "specularRoughness", IMAGE_SLOT_ORM);
+    const auto metallicTexture = ExportableTexture::tryCreate(resources, shaderObject, "metalness", IMAGE_SLOT_ORM);
     if (roughnessTexture || metallicTexture) {
         status = tryCreateRoughnessMetalnessTexture(resources, metallicTexture.get(), roughnessTexture.get(), status);
 
@@ -434,7 +464,7 @@ void ExportableMaterialPBR::loadAiStandard(
         m_glMaterial.emissiveFactor = &m_glEmissiveFactor[0];
     }
 
-    const auto emissiveTexture = ExportableTexture::tryLoad(resources, shaderObject, "emissionColor");
+    const auto emissiveTexture = ExportableTexture::tryLoad(resources, shaderObject, "emissionColor", IMAGE_SLOT_Color);
     if (emissiveTexture) {
         m_glEmissiveTexture.texture = emissiveTexture;
         m_glMaterial.emissiveTexture = &m_glEmissiveTexture;
@@ -15,6 +15,18 @@ class ExportableMaterial {
 
     virtual bool hasTextures() const = 0;
 
+    /** A texture of the glTF material, and the member of the material JSON
+     * that refers to it */
+    struct TextureInfo {
+        const char *member;
+        bool isMetallicRoughnessMember;
+        ImageSlot slot;
+        GLTF::MaterialPBR::Texture *texture;
+    };
+
+    /** The textures of the material, see TextureAtlases */
+    virtual std::vector<TextureInfo> textureInfos() { return {}; }
+
     static std::unique_ptr<ExportableMaterial>
     from(ExportableResources &resources, const MFnDependencyNode &shaderNode);
 
@@ -50,6 +62,8 @@ class ExportableMaterialBasePBR : public ExportableMaterial {
 
     bool hasTextures() const override;
 
+    std::vector<TextureInfo> textureInfos() override;
+
   protected:
     Float4 m_glBaseColorFactor;
     Float4 m_glEmissiveFactor;
@@ -2,6 +2,7 @@
 
 #include "Arguments.h"
 #include "DagHelper.h"
+#include "ExportStatistics.h"
 #include "ExportableMesh.h"
 #include "ExportableNode.h"
 #include "ExportablePrimitive.h"
@@ -10,32 +11,377 @@
 #include "GLTFTargetNames.h"
 #include "MayaException.h"
 #include "Mesh.h"
+#include "MeshArena.h"
+#include "MeshCache.h"
+#include "MeshQuantization.h"
+#include "MeshRenderables.h"
+#include "MeshSimplification.h"
 #include "MeshSkeleton.h"
+#include "PrimitiveSplitting.h"
+#include "Profiler.h"
+#include "SkinPartitions.h"
+#include "TaskScheduler.h"
+#include "Transform.h"
 #include "accessors.h"
+#include "parallel.h"
+
+// Hashes the welded vertex streams and materials of the primitives. The
+// tables are unordered, so the entries are combined independent of order.
+static uint64_t hashContent(const VertexBufferTable &table, const std::vector<ExportableMaterial *> &materials,
+                            const uint64_t seed) {
+    uint64_t tableHash = fasthash::hashWords(table.size(), seed);
+
+    size_t vertexBufferIndex = 0;
+    for (auto &&pair : table) {
+        const auto &vertexBuffer = pair.second;
+
+        uint64_t entryHash = fasthash::hashWords(hash_value(pair.first),
+                                                 reinterpret_cast<uintptr_t>(materials.at(vertexBufferIndex)), seed);
+        entryHash = fasthash::hashWords(entryHash, fasthash::hashBytes(vertexBuffer.indices.data(),
+                                                                       vertexBuffer.indices.size() * sizeof(Index),
+                                                                       seed));
+
+        for (auto &&slot : vertexBuffer.componentsMap) {
+            const auto &elements = slot.second;
+            entryHash += fasthash::hashWords(hash_value(slot.first),
+                                             fasthash::hashBytes(elements.data(), elements.size(), seed), seed);
+        }
 
-ExportableMesh::ExportableMesh(ExportableScene &scene, ExportableNode &node, const MDagPath &shapeDagPath)
-    : ExportableObject(shapeDagPath.node()) {
-    MStatus status;
+        tableHash += entryHash;
+        ++vertexBufferIndex;
+    }
+
+    return tableHash;
+}
+
+static uint64_t hashSkin(const std::vector<GLTF::Node *> &joints, const std::vector<Float4x4> &inverseBindMatrices,
+                         const uint64_t seed) {
+    uint64_t hash = fasthash::hashWords(joints.size(), seed);
+    for (auto *joint : joints) {
+        hash = fasthash::hashWords(hash, reinterpret_cast<uintptr_t>(joint), seed);
+    }
+
+    return fasthash::hashWords(
+        hash, fasthash::hashBytes(inverseBindMatrices.data(), inverseBindMatrices.size() * sizeof(Float4x4), seed),
+        seed);
+}
+
+// A part of a mesh skinned with a palette of the joints, see -maxSkinJoints.
+struct ExportableMesh::Partition {
+    GLTF::Mesh glMesh;
+    GLTF::Skin glSkin;
+    GLTF::Node glNode;
+
+    std::vector<Float4x4> inverseBindMatrices;
+    std::unique_ptr<GLTF::Accessor> inverseBindMatricesAccessor;
+};
+
+// A simplified level of detail, see -lodRatios.
+struct ExportableMesh::Lod {
+    GLTF::Mesh glMesh;
+    GLTF::Node glNode;
+};
+
+// What the constructor extracted from Maya, kept until the mesh is finished.
+struct ExportableMesh::Extraction {
+    Extraction(ExportableScene &scene, const MDagPath &shapeDagPath) : scene(scene), shapeDagPath(shapeDagPath) {}
+
+    ExportableScene &scene;
+    const MDagPath shapeDagPath;
 
+    MeshCache *meshCache = nullptr;
+    std::string meshKey;
+
+    MeshContent content;
+    std::unique_ptr<Mesh> mayaMesh;
+    std::unique_ptr<MeshRenderables> renderables;
+
+    // Cleared while the welding task runs.
+    std::atomic<bool> isWelded{true};
+    std::exception_ptr weldingError;
+};
+
+ExportableMesh::ExportableMesh(ExportableScene &scene, ExportableNode &node, const MDagPath &shapeDagPath)
+    : ExportableObject(shapeDagPath.node()), m_blendShapeWeights(scene.resources().blendShapeWeights()),
+      m_extraction(std::make_unique<Extraction>(scene, shapeDagPath)) {
     auto &resources = scene.resources();
     auto &args = resources.arguments();
+    auto &extraction = *m_extraction;
+    auto &content = extraction.content;
+
+    // The temporaries of the extraction are released at once when done.
+    MeshArena::Scope arenaScope;
+
+    // An unchanged mesh is read from the cache, skipping the extraction and welding.
+    extraction.meshCache = args.dumpMaya ? nullptr : resources.meshCache();
+    extraction.meshKey = extraction.meshCache ? extraction.meshCache->meshKey(shapeDagPath) : std::string();
+
+    if (extraction.meshCache && extraction.meshCache->load(extraction.meshKey, scene, content))
+        return;
 
-    const auto mayaMesh = std::make_unique<Mesh>(scene, shapeDagPath, node);
+    {
+        ProfileScope profileScope("Mesh extraction");
+        extraction.mayaMesh = std::make_unique<Mesh>(scene, shapeDagPath, node);
+    }
 
     if (args.dumpMaya) {
-        mayaMesh->dump(*args.dumpMaya, shapeDagPath.fullPathName().asChar());
+        extraction.mayaMesh->dump(*args.dumpMaya, shapeDagPath.fullPathName().asChar());
+    }
+
+    if (extraction.mayaMesh->isEmpty())
+        return;
+
+    auto &mainShape = extraction.mayaMesh->shape();
+    const auto &shadingMap = mainShape.indices().shadingPerInstance();
+
+    const auto instanceNumber = mainShape.instanceNumber();
+
+    content.shaderGroups = shadingMap.at(instanceNumber).shaderGroups;
+    content.isSkinned = !mainShape.skeleton().isEmpty();
+    content.joints = mainShape.skeleton().joints();
+
+    for (auto &&shape : extraction.mayaMesh->allShapes()) {
+        if (shape->shapeIndex.isBlendShapeIndex()) {
+            content.morphTargets.push_back({shape->weightPlug, shape->initialWeight});
+        }
     }
 
-    if (!mayaMesh->isEmpty()) {
+    // Generate primitives. The welding doesn't call Maya, so it runs on a
+    // worker, while the main thread extracts the next meshes.
+    extraction.isWelded = false;
+
+    TaskScheduler::instance().submit([&extraction, &args, instanceNumber]() {
+        try {
+            extraction.renderables =
+                std::make_unique<MeshRenderables>(extraction.mayaMesh->allShapes(), instanceNumber, args);
+        } catch (...) {
+            extraction.weldingError = std::current_exception();
+        }
+
+        extraction.isWelded = true;
+        TaskScheduler::instance().notifyWaiters();
+    });
+}
+
+void ExportableMesh::waitForWelding() const {
+    auto &extraction = *m_extraction;
+    TaskScheduler::instance().waitUntil([&extraction] { return extraction.isWelded.load(); });
+}
+
+// Assigns a material to each primitive, in table order.
+static std::vector<ExportableMaterial *> getMaterials(ExportableResources &resources, const MeshContent &content) {
+    const auto &args = resources.arguments();
+
+    const auto shaderCount = static_cast<int>(content.shaderGroups.length());
+
+    const auto &vertexBufferEntries = *content.table;
+    const size_t vertexBufferCount = vertexBufferEntries.size();
+
+    std::vector<ExportableMaterial *> materials;
+    materials.reserve(vertexBufferCount);
+
+    for (auto &&pair : vertexBufferEntries) {
+        const auto vertexBufferIndex = materials.size();
+        const int shaderIndex = pair.first.shaderIndex;
+        auto &shaderGroup =
+            shaderIndex >= 0 && shaderIndex < shaderCount ? content.shaderGroups[shaderIndex] : MObject::kNullObj;
+
+        ExportableMaterial *material = nullptr;
+
+        if (args.colorizeMaterials) {
+            const float h = vertexBufferIndex * 1.0f / vertexBufferCount;
+            const float s = shaderCount == 0 ? 0.5f : 1;
+            const float v = shaderIndex < 0 ? 0.5f : 1;
+            material = resources.getDebugMaterial({h, s, v});
+        } else {
+            material = resources.getMaterial(shaderGroup);
+            if (!material && args.defaultMaterial)
+                material = resources.getDefaultMaterial();
+        }
+
+        materials.emplace_back(material);
+    }
+
+    return materials;
+}
+
+void ExportableMesh::finish(const bool isBatchable) {
+    if (!m_extraction || m_isWaitingForBatch)
+        return;
+
+    waitForWelding();
+
+    if (m_extraction->weldingError) {
+        const auto extraction = std::move(m_extraction);
+        std::rethrow_exception(extraction->weldingError);
+    }
+
+    auto &extraction = *m_extraction;
+    auto &content = extraction.content;
+
+    // The welded vertices are copies, so the Maya mesh is released here
+    // rather than with the extraction, before the primitives copy the
+    // vertices again. A batched mesh can wait long for its batch.
+    extraction.mayaMesh.reset();
+
+    if (const auto &renderables = extraction.renderables) {
+        renderables->printStatistics(extraction.shapeDagPath);
+        content.table = &renderables->table();
+
+        if (extraction.meshCache) {
+            extraction.meshCache->store(extraction.meshKey, content);
+        }
+    }
+
+    // A static mesh keeps its welded vertices, to be merged with other
+    // meshes, see ExportableScene::batchStaticMeshes.
+    if (isBatchable && content.table && !content.isSkinned && content.morphTargets.empty()) {
+        m_isWaitingForBatch = true;
+        m_batchMaterials = getMaterials(extraction.scene.resources(), content);
+        return;
+    }
+
+    finishPrimitives();
+}
+
+const VertexBufferTable &ExportableMesh::batchVertexBuffers() const {
+    assert(m_isWaitingForBatch);
+    return *m_extraction->content.table;
+}
+
+void ExportableMesh::finishPrimitives() {
+    m_isWaitingForBatch = false;
+
+    // The welded tables are released when finished.
+    const auto extraction = std::move(m_extraction);
+
+    MStatus status;
+
+    auto &resources = extraction->scene.resources();
+    auto &args = resources.arguments();
+    const auto &shapeDagPath = extraction->shapeDagPath;
+    auto &content = extraction->content;
+
+    if (content.table) {
         auto shapeName = args.assignName(glMesh, shapeDagPath, "");
 
-        auto &mainShape = mayaMesh->shape();
+        const auto &vertexBufferEntries = *content.table;
+
+        const auto materials = m_batchMaterials.empty() ? getMaterials(resources, content) : std::move(m_batchMaterials);
+
+        // Share the glTF mesh of an identical mesh that was exported before.
+        // Morph target weights are per mesh, so these are not shared.
+        const auto isMorphed = !content.morphTargets.empty();
 
-        // Generate primitives
-        MeshRenderables renderables(mayaMesh->allShapes(), args);
-        const auto &shadingMap = mainShape.indices().shadingPerInstance();
-        const auto &shading = shadingMap.at(renderables.instanceNumber);
-        const auto shaderCount = static_cast<int>(shading.shaderGroups.length());
+        // Split the triangles in parts that use at most -maxSkinJoints joints.
+        // The partitions have their own meshes, so these are not shared.
+        std::vector<SkinPartition> skinPartitions;
+
+        if (args.maxSkinJoints > 0 && content.isSkinned && content.joints.size() > size_t(args.maxSkinJoints)) {
+            std::vector<const VertexBuffer *> vertexBuffers;
+            for (auto &&pair : vertexBufferEntries) {
+                vertexBuffers.push_back(&pair.second);
+            }
+
+            if (isMorphed) {
+                MayaException::printWarning(formatted(
+                    "Mesh '%s' is not split in joint palettes, since its morph target weights are on its node",
+                    shapeName.c_str()));
+            } else if (!partitionSkin(vertexBuffers, content.joints.size(), args.maxSkinJoints, skinPartitions)) {
+                MayaException::printWarning(
+                    formatted("Mesh '%s' is not split in joint palettes, since a triangle uses more than %d joints",
+                              shapeName.c_str(), args.maxSkinJoints));
+                skinPartitions.clear();
+            } else {
+                cout << prefix << "Mesh '" << shapeName << "' with " << content.joints.size() << " joints is split in "
+                     << skinPartitions.size() << " joint palettes" << endl;
+            }
+
+            for (size_t index = 0; index < skinPartitions.size(); ++index) {
+                auto partition = std::make_unique<Partition>();
+                const auto suffix = MString(":P") + static_cast<int>(index);
+                args.assignName(partition->glMesh, shapeDagPath, suffix);
+                args.assignName(partition->glSkin, shapeDagPath, suffix);
+                args.assignName(partition->glNode, shapeDagPath, suffix);
+                partition->glNode.mesh = &partition->glMesh;
+                partition->glNode.skin = &partition->glSkin;
+                m_partitions.emplace_back(std::move(partition));
+            }
+        }
+
+        // The weights of a morphed mesh are animated on its node, and the
+        // partitions are drawn by their own nodes, so these get no levels.
+        const auto hasLods = !args.lodRatios.empty() && !isMorphed && m_partitions.empty();
+
+        MeshContentHash contentHash;
+
+        if (args.deduplicateMeshes && !isMorphed && m_partitions.empty() && !hasLods) {
+            contentHash = {hashContent(vertexBufferEntries, materials, 0),
+                           hashContent(vertexBufferEntries, materials, ~0ULL)};
+
+            m_original = resources.findMesh(contentHash);
+
+            if (m_original) {
+                cout << prefix << "Mesh '" << shapeName << "' is identical to '" << m_original->glMesh.name
+                     << "', sharing it" << endl;
+            }
+        }
+
+        // Quantize the vertex attributes of all primitives on the same grid.
+        if (args.meshQuantization) {
+            if (args.debugTangentVectors || args.debugNormalVectors) {
+                MayaException::printWarning(
+                    formatted("Mesh '%s' is not quantized, since it has debug vectors", shapeName.c_str()));
+            } else if (args.dracoCompression) {
+                MayaException::printWarning(
+                    formatted("Mesh '%s' is not quantized, since Draco compression quantizes it", shapeName.c_str()));
+            } else {
+                // The weights of a morphed mesh are animated on its node, so
+                // there is no room for a dequantization node.
+                const auto isSkinned = content.isSkinned;
+                const auto isPositionQuantized = isSkinned || !isMorphed;
+
+                m_quantization =
+                    std::make_unique<MeshQuantization>(vertexBufferEntries, args, isPositionQuantized);
+                resources.quantizedAccessors().setUsed();
+
+                if (isPositionQuantized && !isSkinned) {
+                    args.assignName(m_dequantizationNode, shapeDagPath, ":DQ");
+
+                    auto &trs = m_dequantizationTransform;
+                    makeIdentity(trs);
+
+                    const auto &offset = m_quantization->positionOffset();
+                    const auto scale = m_quantization->positionScale();
+                    for (int axis = 0; axis < 3; ++axis) {
+                        trs.translation[axis] = offset[axis];
+                        trs.scale[axis] = scale;
+                    }
+
+                    m_dequantizationNode.transform = &trs;
+                    m_dequantizationNode.mesh = &glSharedMesh();
+                }
+            }
+        }
+
+        // The clips transform these boxes to bound the animated vertices.
+        if (args.animatedBounds && (content.isSkinned || isMorphed)) {
+            computeNodeBounds(vertexBufferEntries, content.joints, content.isSkinned, m_nodeBounds);
+        }
+
+        // The skin attributes are encoded independently of the other
+        // attributes, with core glTF component types.
+        if (args.skinQuantization && content.isSkinned) {
+            if (args.dracoCompression) {
+                MayaException::printWarning(formatted(
+                    "The skin of mesh '%s' is not quantized, since Draco compression quantizes it", shapeName.c_str()));
+            } else {
+                // The joint indices of a partition index its palette.
+                const auto jointCount =
+                    m_partitions.empty() ? content.joints.size() : static_cast<size_t>(args.maxSkinJoints);
+                m_skinQuantization = std::make_unique<SkinQuantization>(jointCount, args);
+            }
+        }
 
         /* TODO: Implement overrides
         auto mainDagPath = mainShape.dagPath();
@@ -55,85 +401,64 @@ ExportableMesh::ExportableMesh(ExportableScene &scene, ExportableNode &node, con
         overrideShading); THROW_ON_FAILURE(status);
          */
 
-        const auto &vertexBufferEntries = renderables.table();
-        const size_t vertexBufferCount = vertexBufferEntries.size();
+        std::vector<std::string> targetNames;
+
         {
             size_t vertexBufferIndex = 0;
             for (auto &&pair : vertexBufferEntries) {
-                const auto &vertexSignature = pair.first;
                 const auto &vertexBuffer = pair.second;
 
-                const int shaderIndex = vertexSignature.shaderIndex;
-                auto &shaderGroup = shaderIndex >= 0 && shaderIndex < shaderCount ? shading.shaderGroups[shaderIndex]
-                                                                                  : MObject::kNullObj;
-
-                ExportableMaterial *material = nullptr;
-
-                // Assign material to primitive
-                if (args.colorizeMaterials) {
-                    const float h = vertexBufferIndex * 1.0f / vertexBufferCount;
-                    const float s = shaderCount == 0 ? 0.5f : 1;
-                    const float v = shaderIndex < 0 ? 0.5f : 1;
-                    material = resources.getDebugMaterial({h, s, v});
-                } else {
-                    material = resources.getMaterial(shaderGroup);
-                    if (!material && resources.arguments().defaultMaterial)
-                        material = resources.getDefaultMaterial();
-                }
+                auto *material = materials.at(vertexBufferIndex);
 
-                if (material) {
+                if (material && !m_original) {
                     const auto primitiveName = shapeName + "#" + std::to_string(vertexBufferIndex);
 
-                    auto exportablePrimitive =
-                        std::make_unique<ExportablePrimitive>(primitiveName, vertexBuffer, resources, material);
-                    glMesh.primitives.push_back(&exportablePrimitive->glPrimitive);
-
-                    m_primitives.emplace_back(std::move(exportablePrimitive));
-
-                    if (args.debugTangentVectors) {
-                        auto debugPrimitive = std::make_unique<ExportablePrimitive>(
-                            primitiveName, vertexBuffer, resources, Semantic::Kind::TANGENT, ShapeIndex::main(),
-                            args.debugVectorLength, Color({1, 0, 0, 1}));
-                        glMesh.primitives.push_back(&debugPrimitive->glPrimitive);
-                        m_primitives.emplace_back(move(debugPrimitive));
+                    if (m_partitions.empty()) {
+                        addPrimitives(glMesh, primitiveName, vertexBuffer, resources, material);
                     }
 
-                    if (args.debugNormalVectors) {
-                        auto debugPrimitive = std::make_unique<ExportablePrimitive>(
-                            primitiveName, vertexBuffer, resources, Semantic::Kind::NORMAL, ShapeIndex::main(),
-                            args.debugVectorLength, Color({1, 1, 0, 1}));
-                        glMesh.primitives.push_back(&debugPrimitive->glPrimitive);
-                        m_primitives.emplace_back(move(debugPrimitive));
+                    for (size_t index = 0; index < m_partitions.size(); ++index) {
+                        const auto &partitionBuffer = skinPartitions[index].vertexBuffers[vertexBufferIndex];
+                        if (!partitionBuffer.indices.empty()) {
+                            addPrimitives(m_partitions[index]->glMesh, primitiveName + ":P" + std::to_string(index),
+                                          partitionBuffer, resources, material);
+                        }
                     }
                 }
 
                 ++vertexBufferIndex;
             }
-            for (auto &&shape : mayaMesh->allShapes()) {
-                if (shape->shapeIndex.isBlendShapeIndex()) {
-                    m_weightPlugs.emplace_back(shape->weightPlug);
-                    m_initialWeights.emplace_back(shape->initialWeight);
-                    glMesh.weights.emplace_back(shape->initialWeight);
-                    MStringArray weightArrays;
-                    MString weight = shape->weightPlug.name();
-                    weight.split('.', weightArrays);
-
-                    m_morphTargetNames->addName(weightArrays.length() <= 1
-                                                    ? std::string("morph_") + std::to_string(m_morphTargetNames->size())
-                                                    : std::string(weightArrays[1].asChar()));
-                }
-            }
-            if (!mayaMesh->allShapes().empty()) {
-                glMesh.extras.insert({"targetNames", static_cast<GLTF::Object *>(m_morphTargetNames.get())});
+            for (auto &&target : content.morphTargets) {
+                m_weightPlugs.emplace_back(target.weightPlug);
+                m_weightSlots.emplace_back(m_blendShapeWeights.add(target.weightPlug));
+                m_initialWeights.emplace_back(target.initialWeight);
+                glMesh.weights.emplace_back(target.initialWeight);
+                MStringArray weightArrays;
+                MString weight = target.weightPlug.name();
+                weight.split('.', weightArrays);
+
+                const auto targetName = weightArrays.length() <= 1
+                                            ? std::string("morph_") + std::to_string(m_morphTargetNames->size())
+                                            : std::string(weightArrays[1].asChar());
+                m_morphTargetNames->addName(targetName);
+                targetNames.emplace_back(targetName);
             }
+            glMesh.extras.insert({"targetNames", static_cast<GLTF::Object *>(m_morphTargetNames.get())});
+        }
+
+        if (hasLods) {
+            addLods(shapeName, shapeDagPath, vertexBufferEntries, materials, resources);
+        }
+
+        if (args.deduplicateMeshes && !isMorphed && !m_original && m_partitions.empty() && !hasLods) {
+            resources.registerMesh(contentHash, this);
         }
 
         // Generate skin
-        auto &skeleton = mainShape.skeleton();
-        if (!skeleton.isEmpty()) {
+        if (content.isSkinned) {
             args.assignName(glSkin, shapeDagPath, "");
 
-            auto &joints = skeleton.joints();
+            auto &joints = content.joints;
 
             // std::map<int, std::vector<ExportableNode *>> distanceToRootMap;
 
@@ -147,24 +472,71 @@ ExportableMesh::ExportableMesh(ExportableScene &scene, ExportableNode &node, con
                 // auto distanceToRoot = ExportableScene::distanceToRoot(jointNode->dagPath);
                 // distanceToRootMap[distanceToRoot].emplace_back(jointNode);
 
+                // Quantized positions are dequantized before binding.
+                const auto inverseBindMatrix = m_quantization && m_quantization->isPositionQuantized()
+                                                   ? m_quantization->dequantizationMatrix() * joint.inverseBindMatrix
+                                                   : joint.inverseBindMatrix;
+
                 double ibm[4][4];
-                THROW_ON_FAILURE(joint.inverseBindMatrix.get(ibm));
+                THROW_ON_FAILURE(inverseBindMatrix.get(ibm));
 
-                Float4x4 inverseBindMatrix;
+                Float4x4 roundedInverseBindMatrix;
+                const auto &grid = currentRoundingGrids().matrix;
 
                 for (int i = 0; i < 4; ++i) {
                     for (int j = 0; j < 4; ++j) {
-                        inverseBindMatrix[i][j] = roundToFloat(ibm[i][j], matPrecision);
+                        roundedInverseBindMatrix[i][j] = roundToFloat(ibm[i][j], grid);
+                    }
+                }
+
+                m_inverseBindMatrices.emplace_back(roundedInverseBindMatrix);
+            }
+
+            if (m_partitions.empty()) {
+                // Meshes bound to the same joints with the same matrices
+                // share a single skin, see -shareSkins.
+                SkinContentHash skinHash;
+
+                if (args.shareSkins) {
+                    skinHash = {hashSkin(glSkin.joints, m_inverseBindMatrices, 0),
+                                hashSkin(glSkin.joints, m_inverseBindMatrices, ~0ULL)};
+
+                    m_skin = resources.findSkin(skinHash);
+
+                    if (m_skin) {
+                        cout << prefix << "Skin of mesh '" << shapeName << "' is identical to '" << m_skin->name
+                             << "', sharing it" << endl;
                     }
                 }
 
-                m_inverseBindMatrices.emplace_back(inverseBindMatrix);
+                if (!m_skin) {
+                    m_inverseBindMatricesAccessor = contiguousChannelAccessor(
+                        args.makeName(shapeName + "/skin/IBM"), reinterpret_span<float>(m_inverseBindMatrices), 16);
+
+                    glSkin.inverseBindMatrices = m_inverseBindMatricesAccessor.get();
+                    m_skin = &glSkin;
+
+                    if (args.shareSkins) {
+                        resources.registerSkin(skinHash, m_skin);
+                    }
+                }
             }
 
-            m_inverseBindMatricesAccessor = contiguousChannelAccessor(
-                args.makeName(shapeName + "/skin/IBM"), reinterpret_span<float>(m_inverseBindMatrices), 16);
+            // Each partition is bound to the joints of its palette.
+            for (size_t index = 0; index < m_partitions.size(); ++index) {
+                auto &partition = *m_partitions[index];
 
-            glSkin.inverseBindMatrices = m_inverseBindMatricesAccessor.get();
+                for (auto jointIndex : skinPartitions[index].palette) {
+                    partition.glSkin.joints.emplace_back(glSkin.joints.at(jointIndex));
+                    partition.inverseBindMatrices.emplace_back(m_inverseBindMatrices.at(jointIndex));
+                }
+
+                partition.inverseBindMatricesAccessor = contiguousChannelAccessor(
+                    args.makeName(shapeName + "/skin:P" + std::to_string(index) + "/IBM"),
+                    reinterpret_span<float>(partition.inverseBindMatrices), 16);
+
+                partition.glSkin.inverseBindMatrices = partition.inverseBindMatricesAccessor.get();
+            }
 
             // Find root
             // NOTE: Disabled to support skeletons with multiple roots, the
@@ -183,10 +555,196 @@ ExportableMesh::ExportableMesh(ExportableScene &scene, ExportableNode &node, con
             // '\'') << " as skeleton root for mesh " << quoted(shapeName, '\'')
             // << endl; glSkin.skeleton = &rootJointNode->glPrimaryNode();
         }
+
+        // The levels are alternatives of the node that draws the mesh.
+        if (!m_lods.empty()) {
+            if (!m_dequantizationNode.mesh) {
+                args.assignName(m_lodNode, shapeDagPath, ":LOD0");
+                m_lodNode.mesh = &glMesh;
+                m_lodNode.skin = m_skin;
+            }
+
+            auto &baseNode = *meshNode();
+
+            std::vector<GLTF::Node *> lodNodes;
+            for (auto &&lod : m_lods) {
+                lod->glNode.transform = baseNode.transform;
+                lod->glNode.skin = baseNode.skin;
+                baseNode.children.push_back(&lod->glNode);
+                lodNodes.push_back(&lod->glNode);
+            }
+
+            resources.meshLods().addChain(&baseNode, lodNodes, args.lodCoverages);
+        }
+
+        if (auto *statistics = resources.statistics()) {
+            auto &meshStatistics = statistics->addMesh(shapeName);
+            for (auto &&pair : vertexBufferEntries) {
+                meshStatistics.cornerCount += pair.second.indices.size();
+                meshStatistics.vertexCount += pair.second.maxIndex();
+            }
+            addStatistics(meshStatistics, targetNames);
+        }
+    }
+}
+
+void ExportableMesh::addStatistics(MeshStatistics &statistics, const std::vector<std::string> &targetNames) const {
+    if (m_original) {
+        statistics.duplicateOf = m_original->glMesh.name;
+        return;
+    }
+
+    statistics.primitiveCount = m_primitives.size();
+    statistics.bytesPerMorphTarget.reserve(targetNames.size());
+
+    for (auto &&targetName : targetNames) {
+        statistics.bytesPerMorphTarget.emplace_back(targetName, 0);
+    }
+
+    for (auto &&primitive : m_primitives) {
+        auto &glPrimitive = primitive->glPrimitive;
+
+        statistics.bytesPerSemantic["indices"] += glAccessorByteLength(glPrimitive.indices);
+
+        for (auto &&attribute : glPrimitive.attributes) {
+            statistics.bytesPerSemantic[attribute.first] += glAccessorByteLength(attribute.second);
+        }
+
+        for (size_t targetIndex = 0; targetIndex < glPrimitive.targets.size() && targetIndex < targetNames.size(); ++targetIndex) {
+            for (auto &&attribute : glPrimitive.targets[targetIndex]->attributes) {
+                statistics.bytesPerMorphTarget[targetIndex].second += glAccessorByteLength(attribute.second);
+            }
+        }
+    }
+
+    if (m_inverseBindMatricesAccessor) {
+        statistics.bytesPerSemantic["inverseBindMatrices"] += glAccessorByteLength(m_inverseBindMatricesAccessor.get());
+    }
+
+    for (auto &&partition : m_partitions) {
+        statistics.bytesPerSemantic["inverseBindMatrices"] +=
+            glAccessorByteLength(partition->inverseBindMatricesAccessor.get());
     }
 }
 
-ExportableMesh::~ExportableMesh() = default;
+void ExportableMesh::addLods(const std::string &shapeName, const MDagPath &shapeDagPath,
+                             const VertexBufferTable &vertexBufferEntries,
+                             const std::vector<ExportableMaterial *> &materials, ExportableResources &resources) {
+    auto &args = resources.arguments();
+
+    std::vector<const VertexBuffer *> vertexBuffers;
+    size_t triangleCount = 0;
+
+    for (auto &&pair : vertexBufferEntries) {
+        if (materials.at(vertexBuffers.size())) {
+            triangleCount += pair.second.indices.size() / 3;
+        }
+        vertexBuffers.push_back(&pair.second);
+    }
+
+    const auto levelCount = args.lodRatios.size();
+    const auto bufferCount = vertexBuffers.size();
+
+    // Each level is simplified from the primitives of the mesh, so all
+    // levels and primitives are simplified at the same time.
+    std::vector<VertexBuffer> simplifiedBuffers(levelCount * bufferCount);
+    std::vector<size_t> simplifiedTriangleCounts(simplifiedBuffers.size(), 0);
+
+    parallelFor(simplifiedBuffers.size(), 1, [&](const size_t begin, const size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            const auto bufferIndex = i % bufferCount;
+            if (materials.at(bufferIndex)) {
+                simplifiedTriangleCounts[i] = simplifyVertexBuffer(
+                    *vertexBuffers[bufferIndex], args.lodRatios[i / bufferCount], args.lodMaxError, simplifiedBuffers[i]);
+            }
+        }
+    });
+
+    cout << prefix << "Mesh '" << shapeName << "' has levels of detail with " << triangleCount;
+
+    for (size_t level = 0; level < levelCount; ++level) {
+        auto lod = std::make_unique<Lod>();
+        const auto suffix = ":LOD" + std::to_string(level + 1);
+        args.assignName(lod->glMesh, shapeDagPath, suffix.c_str());
+        args.assignName(lod->glNode, shapeDagPath, suffix.c_str());
+        lod->glNode.mesh = &lod->glMesh;
+
+        size_t levelTriangleCount = 0;
+
+        for (size_t bufferIndex = 0; bufferIndex < bufferCount; ++bufferIndex) {
+            const auto i = level * bufferCount + bufferIndex;
+            if (simplifiedTriangleCounts[i] > 0) {
+                addPrimitives(lod->glMesh, shapeName + "#" + std::to_string(bufferIndex) + suffix, simplifiedBuffers[i],
+                              resources, materials.at(bufferIndex));
+                levelTriangleCount += simplifiedTriangleCounts[i];
+            }
+        }
+
+        cout << ", " << levelTriangleCount;
+
+        // A glTF mesh must have primitives.
+        if (!lod->glMesh.primitives.empty()) {
+            m_lods.emplace_back(std::move(lod));
+        }
+    }
+
+    cout << " triangles" << endl;
+}
+
+void ExportableMesh::addPrimitives(GLTF::Mesh &mesh, const std::string &primitiveName, const VertexBuffer &vertexBuffer,
+                                   ExportableResources &resources, ExportableMaterial *material) {
+    auto &args = resources.arguments();
+
+    // Split the primitive in parts that use 16-bit indices, see ExportablePrimitive.
+    const size_t maxShortIndexVertexCount = std::numeric_limits<uint16_t>::max();
+    if (args.splitLargePrimitives && !args.force32bitIndices && vertexBuffer.maxIndex() > maxShortIndexVertexCount) {
+        std::vector<VertexBuffer> parts;
+        splitVertexBuffer(vertexBuffer, maxShortIndexVertexCount, parts);
+
+        size_t partVertexCount = 0;
+        for (auto &&part : parts) {
+            partVertexCount += part.maxIndex();
+        }
+
+        cout << prefix << primitiveName << " with " << vertexBuffer.maxIndex() << " vertices is split in "
+             << parts.size() << " primitives with " << partVertexCount << " vertices" << endl;
+
+        for (size_t index = 0; index < parts.size(); ++index) {
+            addPrimitives(mesh, primitiveName + "/part#" + std::to_string(index), parts[index], resources, material);
+        }
+
+        return;
+    }
+
+    auto exportablePrimitive = std::make_unique<ExportablePrimitive>(primitiveName, vertexBuffer, resources, material,
+                                                                     m_quantization.get(), m_skinQuantization.get());
+    mesh.primitives.push_back(&exportablePrimitive->glPrimitive);
+
+    m_primitives.emplace_back(std::move(exportablePrimitive));
+
+    if (args.debugTangentVectors) {
+        auto debugPrimitive =
+            std::make_unique<ExportablePrimitive>(primitiveName, vertexBuffer, resources, Semantic::Kind::TANGENT,
+                                                  ShapeIndex::main(), args.debugVectorLength, Color({1, 0, 0, 1}));
+        mesh.primitives.push_back(&debugPrimitive->glPrimitive);
+        m_primitives.emplace_back(move(debugPrimitive));
+    }
+
+    if (args.debugNormalVectors) {
+        auto debugPrimitive =
+            std::make_unique<ExportablePrimitive>(primitiveName, vertexBuffer, resources, Semantic::Kind::NORMAL,
+                                                  ShapeIndex::main(), args.debugVectorLength, Color({1, 1, 0, 1}));
+        mesh.primitives.push_back(&debugPrimitive->glPrimitive);
+        m_primitives.emplace_back(move(debugPrimitive));
+    }
+}
+
+ExportableMesh::~ExportableMesh() {
+    // The welding task uses the extraction.
+    if (m_extraction) {
+        waitForWelding();
+    }
+}
 
 void ExportableMesh::getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const {
     for (auto &&primitive : m_primitives) {
@@ -196,27 +754,95 @@ void ExportableMesh::getAllAccessors(std::vector<GLTF::Accessor *> &accessors) c
     if (m_inverseBindMatricesAccessor) {
         accessors.emplace_back(m_inverseBindMatricesAccessor.get());
     }
+
+    for (auto &&partition : m_partitions) {
+        accessors.emplace_back(partition->inverseBindMatricesAccessor.get());
+    }
 }
 
-std::vector<float> ExportableMesh::currentWeights() const {
-    std::vector<float> weights;
-    weights.reserve(m_weightPlugs.size());
+void ExportableMesh::getAccessorsPerLodRank(std::map<int, std::vector<GLTF::Accessor *>> &accessors) const {
+    const auto levelCount = static_cast<int>(m_lods.size());
 
-    for (auto &plug : m_weightPlugs) {
-        float weight;
-        THROW_ON_FAILURE(plug.getValue(weight));
-        weights.emplace_back(weight);
+    std::map<const GLTF::Primitive *, int> rankPerPrimitive;
+    for (int level = 0; level < levelCount; ++level) {
+        for (auto *primitive : m_lods[level]->glMesh.primitives) {
+            rankPerPrimitive[primitive] = levelCount - 1 - level;
+        }
+    }
+
+    for (auto &&primitive : m_primitives) {
+        const auto it = rankPerPrimitive.find(&primitive->glPrimitive);
+        primitive->getAllAccessors(accessors[it == rankPerPrimitive.end() ? levelCount : it->second]);
+    }
+
+    // Every level uses the skin.
+    if (m_inverseBindMatricesAccessor) {
+        accessors[0].emplace_back(m_inverseBindMatricesAccessor.get());
     }
 
-    return weights;
+    for (auto &&partition : m_partitions) {
+        accessors[0].emplace_back(partition->inverseBindMatricesAccessor.get());
+    }
+}
+
+void ExportableMesh::currentWeights(std::vector<float> &weights) const {
+    weights.clear();
+
+    for (auto &slot : m_weightSlots) {
+        weights.emplace_back(m_blendShapeWeights.weight(slot));
+    }
 }
 
 void ExportableMesh::attachToNode(GLTF::Node &node) {
-    node.mesh = &glMesh;
+    if (!m_partitions.empty()) {
+        detachFromNode();
+
+        for (auto &&partition : m_partitions) {
+            node.children.push_back(&partition->glNode);
+        }
 
-    if (glSkin.inverseBindMatrices) {
-        node.skin = &glSkin;
+        m_attachedNode = &node;
+        return;
     }
+
+    if (auto *childNode = meshNode()) {
+        if (m_attachedNode) {
+            auto &children = m_attachedNode->children;
+            children.erase(std::remove(children.begin(), children.end(), childNode), children.end());
+        }
+
+        node.children.push_back(childNode);
+        m_attachedNode = &node;
+        return;
+    }
+
+    node.mesh = &glSharedMesh();
+
+    if (m_skin) {
+        node.skin = m_skin;
+    }
+
+    m_attachedNode = &node;
+}
+
+void ExportableMesh::detachFromNode() {
+    if (!m_attachedNode)
+        return;
+
+    if (!m_partitions.empty()) {
+        auto &children = m_attachedNode->children;
+        for (auto &&partition : m_partitions) {
+            children.erase(std::remove(children.begin(), children.end(), &partition->glNode), children.end());
+        }
+    } else if (auto *childNode = meshNode()) {
+        auto &children = m_attachedNode->children;
+        children.erase(std::remove(children.begin(), children.end(), childNode), children.end());
+    } else {
+        m_attachedNode->mesh = nullptr;
+        m_attachedNode->skin = nullptr;
+    }
+
+    m_attachedNode = nullptr;
 }
 
 void ExportableMesh::updateWeights() {
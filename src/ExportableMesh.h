@@ -1,13 +1,20 @@
 #pragma once
 
 #include "ExportableObject.h"
+#include "AnimatedBounds.h"
 #include "BasicTypes.h"
+#include "BlendShapeWeights.h"
+#include "MeshRenderables.h"
 
 class ExportableResources;
+class ExportableMaterial;
 class ExportablePrimitive;
 class Arguments;
 class ExportableScene;
 class ExportableNode;
+class MeshQuantization;
+class SkinQuantization;
+struct MeshStatistics;
 
 class ExportableMesh : public ExportableObject {
   public:
@@ -15,34 +22,138 @@ class ExportableMesh : public ExportableObject {
     // To properly support instance, we need to decide what to do with shapes
     // that are both with and without a skeleton Do we generate two meshes, with
     // and without skinning vertex attributes?
+    // Extracts the mesh from Maya, and starts welding it on a worker.
     ExportableMesh(ExportableScene &scene, ExportableNode &node,
                    const MDagPath &shapeDagPath);
     virtual ~ExportableMesh();
 
+    // Waits for the welding, and creates the primitives, materials and skin.
+    // Must be called on the main thread before the mesh is used, see
+    // ExportableScene::finishMeshes. A batchable mesh without skin and morph
+    // targets waits for ExportableScene::batchStaticMeshes instead.
+    void finish(bool isBatchable = false);
+
+    // Is the mesh waiting to be merged into a batch, see -batchStaticMeshes?
+    bool isWaitingForBatch() const { return m_isWaitingForBatch; }
+
+    // The welded primitives of a mesh waiting for a batch, and their
+    // materials in table order.
+    const VertexBufferTable &batchVertexBuffers() const;
+    const std::vector<ExportableMaterial *> &batchMaterials() const { return m_batchMaterials; }
+
+    // Creates the primitives of a mesh that waited for a batch, but wasn't
+    // merged.
+    void finishPrimitives();
+
     GLTF::Mesh glMesh;
     GLTF::Skin glSkin;
 
+    // The glTF mesh to draw, the one of the original mesh for a duplicate.
+    GLTF::Mesh &glSharedMesh() { return m_original ? m_original->glMesh : glMesh; }
+
+    // Is this an identical copy of a mesh that was exported before?
+    bool isDuplicate() const { return m_original != nullptr; }
+
     size_t blendShapeCount() const { return m_weightPlugs.size(); }
 
     gsl::span<const float> initialWeights() const { return m_initialWeights; }
 
-    std::vector<float> currentWeights() const;
+    /** Reads the weights at the current evaluation time into the given vector */
+    void currentWeights(std::vector<float> &weights) const;
 
     void attachToNode(GLTF::Node &node);
 
+    void detachFromNode();
+
+    /** Can the mesh be drawn with GPU instancing? Not when skinned, morphed or with levels of detail */
+    bool isInstanceable() const {
+        return !m_skin && m_partitions.empty() && m_weightPlugs.empty() && m_lods.empty();
+    }
+
+    /** The transform that must be applied before the node transform, or null */
+    const GLTF::Node::TransformTRS *dequantizationTransform() const {
+        return m_dequantizationNode.mesh ? &m_dequantizationTransform : nullptr;
+    }
+
+    /** The boxes around the vertices per joint or of the morphed mesh, see -animatedBounds */
+    const std::vector<NodeBounds> &nodeBounds() const { return m_nodeBounds; }
+
     void updateWeights();
 
     void getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const;
 
+    /** The accessors per level of detail rank, see -progressiveLayout. The coarsest level has rank 0, the mesh itself
+     * the number of levels. */
+    void getAccessorsPerLodRank(std::map<int, std::vector<GLTF::Accessor *>> &accessors) const;
+
   private:
     DISALLOW_COPY_MOVE_ASSIGN(ExportableMesh);
 
+    struct Extraction;
+    struct Partition;
+    struct Lod;
+
+    void waitForWelding() const;
+
+    void addStatistics(MeshStatistics &statistics, const std::vector<std::string> &targetNames) const;
+
+    // The child node that draws the mesh, or null when the attached node draws it.
+    GLTF::Node *meshNode() {
+        return m_dequantizationNode.mesh ? &m_dequantizationNode : m_lodNode.mesh ? &m_lodNode : nullptr;
+    }
+
+    // Adds the simplified levels of detail of the primitives, see -lodRatios.
+    void addLods(const std::string &shapeName, const MDagPath &shapeDagPath, const VertexBufferTable &vertexBufferEntries,
+                 const std::vector<ExportableMaterial *> &materials, ExportableResources &resources);
+
+    void addPrimitives(GLTF::Mesh &mesh, const std::string &primitiveName, const VertexBuffer &vertexBuffer,
+                       ExportableResources &resources, ExportableMaterial *material);
+
     std::vector<float> m_initialWeights;
     std::vector<MPlug> m_weightPlugs;
+    std::vector<BlendShapeWeights::Slot> m_weightSlots;
+    BlendShapeWeights &m_blendShapeWeights;
     std::vector<std::unique_ptr<ExportablePrimitive>> m_primitives;
 
     std::vector<Float4x4> m_inverseBindMatrices;
     std::unique_ptr<GLTF::Accessor> m_inverseBindMatricesAccessor;
     std::unique_ptr<GLTF::MorphTargetNames> m_morphTargetNames =
         std::make_unique<GLTF::MorphTargetNames>();
+
+    std::unique_ptr<MeshQuantization> m_quantization;
+
+    bool m_isWaitingForBatch = false;
+    std::vector<ExportableMaterial *> m_batchMaterials;
+    std::unique_ptr<SkinQuantization> m_skinQuantization;
+
+    // The skin of the node drawing the mesh: glSkin, or with -shareSkins the
+    // identical skin of a mesh exported before. Null without skin, or when
+    // the partitions have the skins.
+    GLTF::Skin *m_skin = nullptr;
+
+    // With mesh deduplication, the identical mesh that was exported before.
+    ExportableMesh *m_original = nullptr;
+
+    // With quantized positions of a mesh without skin, the mesh is attached
+    // to this child node, to apply the dequantization transform.
+    GLTF::Node m_dequantizationNode;
+    GLTF::Node::TransformTRS m_dequantizationTransform;
+
+    // The node the mesh, or its dequantization node, is attached to.
+    GLTF::Node *m_attachedNode = nullptr;
+
+    // With -maxSkinJoints, the parts of a skin with too many joints, attached
+    // to child nodes of the node instead of the mesh.
+    std::vector<std::unique_ptr<Partition>> m_partitions;
+
+    // With -lodRatios, the simplified levels of detail. Without a
+    // dequantization node, the mesh is attached to the LOD node, that has the
+    // levels as MSFT_lod alternatives.
+    std::vector<std::unique_ptr<Lod>> m_lods;
+    GLTF::Node m_lodNode;
+
+    std::vector<NodeBounds> m_nodeBounds;
+
+    // Null once finished.
+    std::unique_ptr<Extraction> m_extraction;
 };
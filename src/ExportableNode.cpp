@@ -9,7 +9,8 @@
 #include "NodeAnimation.h"
 #include "Transform.h"
 
-ExportableNode::ExportableNode(const MDagPath &dagPath) : ExportableObject(dagPath.node()), dagPath(dagPath) {}
+ExportableNode::ExportableNode(const MDagPath &dagPath, const size_t transformIndex)
+    : ExportableObject(dagPath.node()), dagPath(dagPath), transformIndex(transformIndex) {}
 
 void ExportableNode::load(ExportableScene &scene, NodeTransformCache &transformCache) {
     MStatus status;
@@ -119,19 +120,22 @@ void ExportableNode::load(ExportableScene &scene, NodeTransformCache &transformC
 
     // Create mesh, if any
     // Get mesh, but only if the node was selected.
-    if (args.meshShapes.find(dagPath) != args.meshShapes.end()) {
+    if (args.meshShapes.contains(dagPath)) {
         MDagPath shapeDagPath = dagPath;
         status = shapeDagPath.extendToShape();
 
         if (status && shapeDagPath.hasFn(MFn::kMesh)) {
             // The shape is a mesh
             m_mesh = std::make_unique<ExportableMesh>(scene, *this, shapeDagPath);
-            m_mesh->attachToNode(pNode);
+
+            // Attached when finished, after the next meshes were extracted.
+            scene.m_pendingMeshNodes.push_back(this);
+            scene.finishMeshes(static_cast<size_t>(std::max(0, args.meshPipelineDepth)));
         }
     }
 
     // Set camera, but only if the node was selected.
-    if (args.cameraShapes.count(dagPath)) {
+    if (args.cameraShapes.contains(dagPath)) {
         MDagPath shapeDagPath = dagPath;
         status = shapeDagPath.extendToShape();
 
@@ -31,6 +31,9 @@ class ExportableNode : public ExportableObject {
 
     const MDagPath dagPath;
 
+    // Dense index assigned by the scene, used by the NodeTransformCache.
+    const size_t transformIndex;
+
     TransformKind transformKind = TransformKind::Simple;
 
     double scaleFactor = 1.0;
@@ -40,6 +43,10 @@ class ExportableNode : public ExportableObject {
     // nullptr for root nodes.
     ExportableNode *parentNode = nullptr;
 
+    // Is the local transform provably the same at all times? Static nodes
+    // are not sampled.
+    bool isStatic = false;
+
     NodeTransformState initialTransformState;
     NodeTransformState currentTransformState;
 
@@ -71,7 +78,7 @@ class ExportableNode : public ExportableObject {
   private:
     friend class ExportableScene;
 
-    ExportableNode(const MDagPath &dagPath);
+    ExportableNode(const MDagPath &dagPath, size_t transformIndex);
 
     void load(ExportableScene &scene, NodeTransformCache &transformCache);
 
@@ -3,7 +3,10 @@
 #include "Arguments.h"
 #include "ExportablePrimitive.h"
 #include "ExportableResources.h"
+#include "MeshQuantization.h"
 #include "MeshRenderables.h"
+#include "Meshlets.h"
+#include "VertexCacheOptimizer.h"
 #include "accessors.h"
 
 using namespace GLTF::Constants;
@@ -38,13 +41,60 @@ inline std::string glTFattributeName(const Kind s, const int setIndex) {
 ExportablePrimitive::ExportablePrimitive(const std::string &name,
                                          const VertexBuffer &vertexBuffer,
                                          ExportableResources &resources,
-                                         ExportableMaterial *material) {
+                                         ExportableMaterial *material,
+                                         const MeshQuantization *quantization,
+                                         const SkinQuantization *skinQuantization) {
     auto &args = resources.arguments();
 
     glPrimitive.mode = GLTF::Primitive::TRIANGLES;
     glPrimitive.material = material->glMaterial();
 
-    auto &vertexIndices = vertexBuffer.indices;
+    // Optionally reorder the triangles and vertices for the GPU caches,
+    // remapping all vertex streams, including the morph targets. The streams
+    // are remapped straight into the data of their accessors; the encoded
+    // streams are read from there, and their unused accessors dropped.
+    IndexVector optimizedIndices;
+    std::unordered_map<VertexSlot, std::unique_ptr<GLTF::Accessor>, VertexHashers> remappedAccessors;
+    std::unordered_map<VertexSlot, gsl::span<const byte>, VertexHashers> remappedElements;
+
+    if (args.optimizeVertexCache) {
+        const auto vertexCount = vertexBuffer.maxIndex();
+
+        optimizedIndices = vertexBuffer.indices;
+        optimizeVertexCacheOrder(optimizedIndices, vertexCount);
+
+        cout << prefix << name << " vertex cache miss ratio "
+             << averageCacheMissRatio(vertexBuffer.indices, vertexCount)
+             << " -> " << averageCacheMissRatio(optimizedIndices, vertexCount)
+             << endl;
+
+        const auto newVertexIndices =
+            optimizeVertexFetchOrder(optimizedIndices, vertexCount);
+
+        for (auto &&pair : vertexBuffer.componentsMap) {
+            auto &slot = pair.first;
+            auto accessor = allocatedElementAccessor(
+                std::string(), slot.semantic, slot.shapeIndex,
+                pair.second.size());
+            const auto elements = accessorElements<byte>(*accessor);
+            remapVertexElements(span(pair.second), newVertexIndices, elements);
+
+            remappedElements.emplace(slot, elements);
+            remappedAccessors.emplace(slot, std::move(accessor));
+        }
+    }
+
+    auto &vertexIndices = args.optimizeVertexCache ? optimizedIndices
+                                                   : vertexBuffer.indices;
+    auto &componentsMap = vertexBuffer.componentsMap;
+
+    // The elements of a vertex stream, in the optimized order if remapped.
+    const auto elementsOf =
+        [&](const VertexSlot &slot) -> gsl::span<const byte> {
+        const auto it = remappedElements.find(slot);
+        return it != remappedElements.end() ? it->second
+                                            : span(componentsMap.at(slot));
+    };
 
     const auto indicesName = args.makeName(name + "/indices");
 
@@ -56,18 +106,58 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
             WebGL::ELEMENT_ARRAY_BUFFER, span(vertexIndices), 1);
         glPrimitive.indices = glIndices.get();
     } else {
-        // Use 16-bit indices
-        std::vector<uint16_t> shortIndices(vertexIndices.size());
-        std::copy(vertexIndices.begin(), vertexIndices.end(),
-                  shortIndices.begin());
-        glIndices = contiguousAccessor(
+        // Use 16-bit indices, narrowed straight into the accessor.
+        glIndices = allocatedAccessor(
             indicesName, GLTF::Accessor::Type::SCALAR, WebGL::UNSIGNED_SHORT,
-            WebGL::ELEMENT_ARRAY_BUFFER, span(shortIndices), 1);
+            WebGL::ELEMENT_ARRAY_BUFFER,
+            vertexIndices.size() * sizeof(uint16_t), vertexIndices.size());
+        const auto shortIndices = accessorElements<uint16_t>(*glIndices);
+        std::transform(vertexIndices.begin(), vertexIndices.end(),
+                       shortIndices.begin(), [](const Index index) {
+                           return static_cast<uint16_t>(index);
+                       });
         glPrimitive.indices = glIndices.get();
     }
 
+    if (args.meshoptCompression) {
+        resources.meshoptCompression().addTriangleIndices(glIndices.get());
+    }
+
+    if (args.meshlets && !vertexIndices.empty()) {
+        const VertexSlot positionSlot(ShapeIndex::main(), Semantic::POSITION, 0);
+        const auto positions =
+            reinterpret_span<Position>(elementsOf(positionSlot));
+
+        MeshletBuffer meshlets;
+        buildMeshlets(vertexIndices, positions, args.meshletMaxVertices,
+                      args.meshletMaxTriangles, meshlets);
+
+        // The bounds are in the space of the quantized positions.
+        if (quantization && quantization->isPositionQuantized()) {
+            const auto &offset = quantization->positionOffset();
+            const auto invScale = 1.0f / quantization->positionScale();
+            for (auto &sphere : meshlets.spheres) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    sphere[axis] = (sphere[axis] - offset[axis]) * invScale;
+                }
+                sphere[3] *= invScale;
+            }
+        }
+
+        const auto meshletCount = meshlets.meshletCount();
+
+        cout << prefix << name << " has " << meshletCount << " meshlets, "
+             << double(meshlets.vertices.size()) / meshletCount
+             << " vertices and "
+             << double(vertexIndices.size() / 3) / meshletCount
+             << " triangles per meshlet" << endl;
+
+        m_meshlets = resources.meshlets().add(
+            args.makeName(name), glIndices.get(), std::move(meshlets));
+    }
+
     auto componentsPerShapeIndex =
-        from(vertexBuffer.componentsMap) |
+        from(componentsMap) |
         group_by([](auto &pair) { return pair.first.shapeIndex; }) |
         to_vector();
 
@@ -92,9 +182,95 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
     const auto blendShapeSemanticSet =
         args.blendPrimitiveAttributes & mainShapeSemanticSet;
 
+    // The morph target attributes without deltas in this primitive, see
+    // -pruneMorphTargets. The attributes without deltas in any target are
+    // dropped, the others share an accessor without data.
+    typedef std::pair<Semantic::Kind, SetIndex> TargetAttribute;
+    std::set<VertexSlot> zeroDeltaSlots;
+    std::set<TargetAttribute> prunedAttributes;
+
+    if (args.pruneMorphTargets && shapeCount > 1) {
+        const auto threshold = static_cast<float>(args.morphDeltaThreshold);
+
+        std::map<TargetAttribute, size_t> zeroDeltaCounts;
+
+        for (auto &&pair : componentsMap) {
+            auto &slot = pair.first;
+            if (!slot.shapeIndex.isBlendShapeIndex() ||
+                !blendShapeSemanticSet.test(slot.semantic) ||
+                Component::type(slot.semantic) != Component::FLOAT)
+                continue;
+
+            auto &zeroDeltaCount =
+                zeroDeltaCounts[TargetAttribute(slot.semantic, slot.setIndex)];
+
+            const auto components = reinterpret_span<float>(elementsOf(slot));
+            if (std::all_of(components.begin(), components.end(),
+                            [threshold](const float c) {
+                                return std::abs(c) <= threshold;
+                            })) {
+                zeroDeltaSlots.insert(slot);
+                ++zeroDeltaCount;
+            }
+        }
+
+        for (auto &&pair : zeroDeltaCounts) {
+            if (pair.second == shapeCount - 1) {
+                prunedAttributes.insert(pair.first);
+            }
+        }
+
+        // A morph target must have an attribute, even without deltas.
+        if (!prunedAttributes.empty() &&
+            prunedAttributes.size() == zeroDeltaCounts.size()) {
+            prunedAttributes.erase(prunedAttributes.begin());
+        }
+
+        if (!zeroDeltaSlots.empty()) {
+            cout << prefix << name << " has " << zeroDeltaSlots.size()
+                 << " morph target attributes without deltas, dropped "
+                 << prunedAttributes.size() * (shapeCount - 1) << endl;
+        }
+    }
+
+    // Accessors without data need sparse accessors, see SparseAccessors.
+    const auto isZeroDeltaShared = !args.separateAccessorBuffers;
+    std::map<std::string, GLTF::Accessor *> zeroDeltaAccessors;
+
+    // The Draco compressed data is packed like any accessor, so not with
+    // separate accessor buffers.
+    const auto isDracoCompressed =
+        args.dracoCompression && !args.separateAccessorBuffers;
+
+    std::vector<DracoAttribute> dracoAttributes;
+
+    // The weights of all sets of a vertex are rounded together.
+    std::map<SetIndex, std::vector<byte>> encodedWeightSets;
+    if (skinQuantization) {
+        std::map<SetIndex, gsl::span<const float>> weightSets;
+        for (auto &&pair : componentsMap) {
+            auto &slot = pair.first;
+            if (slot.semantic == Semantic::WEIGHTS &&
+                slot.shapeIndex.isMainShapeIndex()) {
+                weightSets[slot.setIndex] =
+                    reinterpret_span<float>(elementsOf(slot));
+            }
+        }
+
+        skinQuantization->encodeWeights(weightSets, encodedWeightSets);
+    }
+
     for (auto &&group : componentsPerShapeIndex) {
         const auto shapeIndex = group.first;
 
+        // The Draco compressed attributes have no buffer view.
+        const auto isInterleaved =
+            args.interleaveVertexAttributes && !args.separateAccessorBuffers &&
+            (shapeIndex.isMainShapeIndex() ? !isDracoCompressed
+                                           : args.interleaveMorphTargets);
+
+        std::vector<GLTF::Accessor *> interleavedAccessors;
+
         auto &glAttributes =
             shapeIndex.isMainShapeIndex()
                 ? glPrimitive.attributes
@@ -109,6 +285,39 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
                 auto attributeSlot =
                     glTFattributeName(slot.semantic, slot.setIndex);
 
+                if (slot.shapeIndex.isBlendShapeIndex() &&
+                    prunedAttributes.count(
+                        TargetAttribute(slot.semantic, slot.setIndex)))
+                    continue;
+
+                if (isZeroDeltaShared && zeroDeltaSlots.count(slot)) {
+                    auto &zeroDeltaAccessor = zeroDeltaAccessors[attributeSlot];
+
+                    if (!zeroDeltaAccessor) {
+                        const std::vector<byte> zeroBytes(pair.second.size(), 0);
+
+                        auto accessor = contiguousElementAccessor(
+                            args.makeName(name + "/zero/vertices/" +
+                                          attributeSlot),
+                            slot.semantic, slot.shapeIndex, span(zeroBytes));
+
+                        if (slot.semantic == Semantic::POSITION ||
+                            args.allAccessorBounds) {
+                            requireBounds(accessor.get());
+                        }
+
+                        resources.sparseAccessors().trySparsify(
+                            accessor.get(), reinterpret_span<float>(zeroBytes),
+                            dimension(slot.semantic, slot.shapeIndex), 0);
+
+                        zeroDeltaAccessor = accessor.get();
+                        glAccessors.emplace_back(std::move(accessor));
+                    }
+
+                    glAttributes[attributeSlot] = zeroDeltaAccessor;
+                    continue;
+                }
+
                 std::string accessorName;
 
                 if (!args.disableNameAssignment) {
@@ -125,13 +334,116 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
                     accessorName = ss.str();
                 }
 
-                auto accessor = contiguousElementAccessor(
-                    accessorName, slot.semantic, slot.shapeIndex, pair.second);
+                const auto dim = dimension(slot.semantic, slot.shapeIndex);
+
+                const auto sourceBytes = elementsOf(slot);
+                auto elementBytes = sourceBytes;
+
+                std::unique_ptr<GLTF::Accessor> accessor;
+                std::vector<byte> encodedBytes;
+                WebGL componentType;
+                bool isNormalized;
+
+                auto isEncoded =
+                    quantization &&
+                    quantization->encode(slot, elementBytes, encodedBytes,
+                                         componentType, isNormalized);
+
+                if (!isEncoded && skinQuantization &&
+                    slot.shapeIndex.isMainShapeIndex()) {
+                    if (slot.semantic == Semantic::WEIGHTS) {
+                        encodedBytes =
+                            std::move(encodedWeightSets.at(slot.setIndex));
+                        componentType = skinQuantization->weightComponentType();
+                        isNormalized = true;
+                        isEncoded = true;
+                    } else {
+                        isEncoded = skinQuantization->encodeJoints(
+                            slot, elementBytes, encodedBytes, componentType);
+                        isNormalized = false;
+                    }
+                }
+
+                if (isEncoded) {
+                    elementBytes = span(encodedBytes);
+
+                    accessor = contiguousEncodedElementAccessor(
+                        accessorName, componentType, elementBytes, dim);
+
+                    if (isNormalized) {
+                        resources.quantizedAccessors().addNormalized(
+                            accessor.get(), slot.semantic != Semantic::WEIGHTS);
+                    }
+
+                    // Quantized unit vectors compress better when
+                    // octahedral encoded.
+                    if (args.meshoptCompression &&
+                        slot.shapeIndex.isMainShapeIndex() &&
+                        (slot.semantic == Semantic::NORMAL ||
+                         slot.semantic == Semantic::TANGENT)) {
+                        resources.meshoptCompression().setFilter(
+                            accessor.get(), MeshoptFilter::OCTAHEDRAL);
+                    }
+                } else {
+                    // The remapped elements are in their accessor already.
+                    const auto it = remappedAccessors.find(slot);
+                    if (it != remappedAccessors.end()) {
+                        accessor = std::move(it->second);
+                        accessor->name = accessorName;
+                    } else {
+                        accessor = contiguousElementAccessor(
+                            accessorName, slot.semantic, slot.shapeIndex,
+                            elementBytes);
+                    }
+                }
+
+                // Required for the positions of the shape and its targets.
+                if (slot.semantic == Semantic::POSITION ||
+                    args.allAccessorBounds) {
+                    requireBounds(accessor.get());
+                }
+
+                // Morph target deltas are mostly zero, so these can be
+                // written as sparse accessors, also when quantized.
+                if (slot.shapeIndex.isBlendShapeIndex() &&
+                    args.sparseMorphTargets > 0 &&
+                    !args.separateAccessorBuffers &&
+                    Component::type(slot.semantic) == Component::FLOAT) {
+                    resources.sparseAccessors().trySparsify(
+                        accessor.get(), elementBytes,
+                        isEncoded ? componentType : WebGL::FLOAT, dim,
+                        args.sparseMorphTargets);
+                }
+
+                // Only the main shape is compressed, morph targets must
+                // stay uncompressed.
+                if (isDracoCompressed && slot.shapeIndex.isMainShapeIndex()) {
+                    dracoAttributes.emplace_back(
+                        DracoAttribute{attributeSlot, slot.semantic,
+                                       accessor.get(), sourceBytes});
+                }
+
+                if (isInterleaved) {
+                    interleavedAccessors.emplace_back(accessor.get());
+                }
+
                 glAttributes[attributeSlot] = accessor.get();
                 glAccessors.emplace_back(std::move(accessor));
             }
         }
+
+        if (isInterleaved) {
+            resources.interleavedAttributes().addGroup(interleavedAccessors);
+        }
+    }
+
+    if (isDracoCompressed) {
+        resources.dracoPrimitives().compress(
+            name, glIndices.get(), span(vertexIndices), vertexBuffer.maxIndex(),
+            dracoAttributes, !glTargetTable.empty(), args);
     }
+
+    updateHeldMemory();
 }
 
 ExportablePrimitive::ExportablePrimitive(const std::string &name,
@@ -155,9 +467,26 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
     const auto vectorDimension = dimension(debugSemantic, debugShapeIndex);
     const auto lineCount = positions.size();
     const auto elementCount = lineCount * 2;
-    std::vector<uint16_t> lineIndices(elementCount);
-    std::vector<Position> linePoints(elementCount);
-    std::vector<Color> lineColors(elementCount);
+
+    // The lines are written straight into their accessors.
+    glIndices =
+        allocatedAccessor(args.makeName(name + "/debug/indices"),
+                          GLTF::Accessor::Type::SCALAR, WebGL::UNSIGNED_SHORT,
+                          WebGL::ELEMENT_ARRAY_BUFFER,
+                          elementCount * sizeof(uint16_t), elementCount);
+    glPrimitive.indices = glIndices.get();
+
+    auto pointAccessor = allocatedElementAccessor(
+        args.makeName(name + "/debug/points"), Semantic::Kind::POSITION,
+        ShapeIndex::main(), elementCount * sizeof(Position));
+
+    auto colorAccessor = allocatedElementAccessor(
+        args.makeName(name + "/debug/colors"), Semantic::Kind::COLOR,
+        ShapeIndex::main(), elementCount * sizeof(Color));
+
+    const auto lineIndices = accessorElements<uint16_t>(*glIndices);
+    const auto linePoints = accessorElements<Position>(*pointAccessor);
+    const auto lineColors = accessorElements<Color>(*colorAccessor);
 
     iota(lineIndices.begin(), lineIndices.end(), 0);
     fill(lineColors.begin(), lineColors.end(), debugLineColor);
@@ -181,28 +510,38 @@ ExportablePrimitive::ExportablePrimitive(const std::string &name,
         linePoints[offset + 1] = point;
     }
 
-    glIndices =
-        contiguousAccessor(args.makeName(name + "/debug/indices"),
-                           GLTF::Accessor::Type::SCALAR, WebGL::UNSIGNED_SHORT,
-                           WebGL::ELEMENT_ARRAY_BUFFER, span(lineIndices), 1);
-    glPrimitive.indices = glIndices.get();
-
-    auto pointAccessor = contiguousElementAccessor(
-        args.makeName(name + "/debug/points"), Semantic::Kind::POSITION,
-        ShapeIndex::main(), reinterpret_span<byte>(linePoints));
+    requireBounds(pointAccessor.get());
     glPrimitive.attributes[glTFattributeName(Semantic::Kind::POSITION, 0)] =
         pointAccessor.get();
     glAccessors.emplace_back(move(pointAccessor));
 
-    auto colorAccessor = contiguousElementAccessor(
-        args.makeName(name + "/debug/colors"), Semantic::Kind::COLOR,
-        ShapeIndex::main(), reinterpret_span<byte>(lineColors));
     glPrimitive.attributes[glTFattributeName(Semantic::Kind::COLOR, 0)] =
         colorAccessor.get();
     glAccessors.emplace_back(move(colorAccessor));
+
+    updateHeldMemory();
 }
 
-ExportablePrimitive::~ExportablePrimitive() = default;
+ExportablePrimitive::~ExportablePrimitive() {
+    // The meshlets are patched into the JSON of the primitive, if written.
+    if (m_meshlets) {
+        m_meshlets->indices = nullptr;
+    }
+}
+
+void ExportablePrimitive::updateHeldMemory() {
+    std::vector<GLTF::Accessor *> accessors;
+    getAllAccessors(accessors);
+
+    size_t byteCount = 0;
+    for (auto *accessor : accessors) {
+        if (accessor && accessor->bufferView) {
+            byteCount += accessor->bufferView->byteLength;
+        }
+    }
+
+    m_heldMemory.set(byteCount);
+}
 
 void ExportablePrimitive::getAllAccessors(
     std::vector<GLTF::Accessor *> &accessors) const {
@@ -211,4 +550,8 @@ void ExportablePrimitive::getAllAccessors(
     for (auto &&accessor : glAccessors) {
         accessors.emplace_back(accessor.get());
     }
+
+    if (m_meshlets) {
+        m_meshlets->getAllAccessors(accessors);
+    }
 }
@@ -2,6 +2,7 @@
 
 #include "ExportableMaterial.h"
 #include "ExportableMesh.h"
+#include "HeldMemory.h"
 #include "MeshRenderables.h"
 #include "sceneTypes.h"
 
@@ -9,13 +10,18 @@ typedef std::vector<std::unique_ptr<GLTF::Primitive::Target>>
     BlendShapeToTargetTable;
 
 class ExportableResources;
+class MeshQuantization;
+class SkinQuantization;
+struct MeshletPrimitive;
 
 class ExportablePrimitive {
   public:
     ExportablePrimitive(const std::string &name,
                         const VertexBuffer &vertexBuffer,
                         ExportableResources &resources,
-                        ExportableMaterial *material);
+                        ExportableMaterial *material,
+                        const MeshQuantization *quantization = nullptr,
+                        const SkinQuantization *skinQuantization = nullptr);
 
     ExportablePrimitive(const std::string &name,
                         const VertexBuffer &vertexBuffer,
@@ -35,5 +41,13 @@ class ExportablePrimitive {
   private:
     std::vector<std::unique_ptr<GLTF::Accessor>> glAccessors;
 
+    // Owned by the meshlets of the resources, see -meshlets.
+    MeshletPrimitive *m_meshlets = nullptr;
+
+    HeldMemory m_heldMemory{MemoryKind::PRIMITIVE_ACCESSORS};
+
+    // Accounts the bytes of the accessor data, after these are created.
+    void updateHeldMemory();
+
     DISALLOW_COPY_MOVE_ASSIGN(ExportablePrimitive);
 };
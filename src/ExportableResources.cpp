@@ -1,14 +1,44 @@
 #include "externals.h"
 
 #include "Arguments.h"
+#include "BasisuTextures.h"
 #include "DagHelper.h"
+#include "Digester.h"
+#include "ExportStatistics.h"
 #include "ExportableMaterial.h"
 #include "ExportableResources.h"
+#include "ImagePrefetcher.h"
 #include "MayaException.h"
+#include "MeshCache.h"
 #include "filesystem.h"
+#include "imageScaling.h"
 
 ExportableResources::ExportableResources(const Arguments &args)
-    : m_args(args) {}
+    : m_meshlets(args), m_meshoptCompression(args), m_frameTimeInputs(args), m_args(args) {
+    if (args.meshCacheFolder.length()) {
+        const fs::path cachePath(args.meshCacheFolder.asChar());
+        m_meshCache = std::make_unique<MeshCache>(
+            args, cachePath.is_relative() ? fs::path(args.outputFolder.asChar()) / cachePath : cachePath);
+    } else if (args.liveLinkPort) {
+        // The live link exports again after each change.
+        m_meshCache =
+            std::make_unique<MeshCache>(args, fs::temp_directory_path() / "maya2glTF" / "liveLinkMeshes");
+    }
+
+    if (args.basisuEncoder.length() && !args.skipMaterialTextures) {
+        m_basisuTextures = std::make_unique<BasisuTextures>(args);
+    }
+
+    if (ExportStatistics::isEnabled(args)) {
+        m_statistics = std::make_unique<ExportStatistics>(args);
+    }
+
+    // The textures are read while the meshes are extracted.
+    if (args.prefetchImageThreads > 0 && !args.skipMaterialTextures) {
+        m_imagePrefetcher = std::make_unique<ImagePrefetcher>(static_cast<size_t>(args.prefetchImageThreads));
+        m_imagePrefetcher->prefetchFileTextures(args.meshShapes);
+    }
+}
 
 ExportableResources::~ExportableResources() {}
 
@@ -19,11 +49,17 @@ ExportableResources::getMaterial(const MObject &shaderGroup) {
     if (shaderGroup.isNull())
         return nullptr;
 
+    // Primitives of many meshes share the shading groups.
+    if (const auto material = m_materialPerShadingGroup.find(shaderGroup))
+        return *material;
+
     MObject surfaceShader =
         DagHelper::findSourceNodeConnectedTo(shaderGroup, "surfaceShader");
 
-    if (surfaceShader.isNull())
+    if (surfaceShader.isNull()) {
+        m_materialPerShadingGroup[shaderGroup] = nullptr;
         return nullptr;
+    }
 
     MFnDependencyNode shaderNode(surfaceShader, &status);
 
@@ -40,10 +76,102 @@ ExportableResources::getMaterial(const MObject &shaderGroup) {
         materialPtr = ExportableMaterial::from(*this, shaderNode);
     }
 
+    m_materialPerShadingGroup[shaderGroup] = materialPtr.get();
     return materialPtr.get();
 }
 
-GLTF::Image *ExportableResources::getImage(fs::path path) {
+/** The path of the image converted from the source image. Each source gets its own
+ * sub-folder, named after the source path, size and modification time, so a
+ * conversion is reused until the source changes, and sources with the same
+ * filename don't overwrite each other, while the converted file keeps the
+ * filename of the source. */
+static fs::path convertedImagePath(const fs::path &folder, const fs::path &sourcePath, const std::string &suffix) {
+    Digester digester;
+    digester.add(fs::absolute(sourcePath).generic_string());
+    digester.add(static_cast<uint64_t>(fs::file_size(sourcePath)));
+    digester.add(static_cast<int64_t>(fs::last_write_time(sourcePath).time_since_epoch().count()));
+
+    return folder / digester.hexDigest().substr(0, 16) / (sourcePath.stem().string() + suffix);
+}
+
+fs::path ExportableResources::imageCacheFolder() const {
+    if (!m_args.imageCacheFolder.length())
+        return fs::temp_directory_path() / "maya2glTF" / "images";
+
+    // Relative to the output folder, like the other cache folders.
+    const fs::path cachePath(m_args.imageCacheFolder.asChar());
+    return cachePath.is_relative() ? fs::path(m_args.outputFolder.asChar()) / cachePath : cachePath;
+}
+
+fs::path ExportableResources::downscaledImagePath(const fs::path &path, const ImageSlot slot) const {
+    const int maxSizes[] = {m_args.maxColorTextureSize, m_args.maxNormalTextureSize, m_args.maxOrmTextureSize};
+    const auto maxSize = maxSizes[slot];
+    if (maxSize <= 0)
+        return path;
+
+    std::string ext = path.extension().generic_string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    // MImage can't write DDS, and these usually have their mipmaps already.
+    if (ext == ".dds")
+        return path;
+
+    const auto isJPEG = ext == ".jpg" || ext == ".jpeg";
+
+    // The size is part of the filename, so the same image downscaled for
+    // different slots doesn't overwrite itself in the output folder.
+    const char *slotNames[] = {"color", "normal", "orm"};
+    const auto downscaledPath = convertedImagePath(imageCacheFolder(), path,
+                                                   formatted("-%s%d%s", slotNames[slot], maxSize, isJPEG ? ".jpg" : ".png"));
+
+    if (exists(downscaledPath)) {
+        cout << prefix << "Using the image downscaled before from " << path << endl;
+        return downscaledPath;
+    }
+
+    // Most images fit, the header tells without reading the pixels.
+    ImageHeader header;
+    if (readImageHeader(path, header) &&
+        fittedImageSize(header.width, header.height, static_cast<unsigned>(maxSize)) ==
+            std::make_pair(header.width, header.height))
+        return path;
+
+    MImage image;
+    THROW_ON_FAILURE_WITH(image.readFromFile(MString(path.c_str())), formatted("Failed to read image %s", path.c_str()));
+
+    unsigned width = 0;
+    unsigned height = 0;
+    THROW_ON_FAILURE(image.getSize(width, height));
+
+    const auto newSize = fittedImageSize(width, height, static_cast<unsigned>(maxSize));
+    if (newSize.first == width && newSize.second == height)
+        return path;
+
+    cout << prefix << "Downscaling image " << path << " from " << width << "x" << height << " to " << newSize.first << "x"
+         << newSize.second << endl;
+
+    const auto encoding = slot == IMAGE_SLOT_Color    ? PixelEncoding::sRGB
+                          : slot == IMAGE_SLOT_Normal ? PixelEncoding::NormalMap
+                                                      : PixelEncoding::Linear;
+
+    auto pixels = downscaleImage(image.pixels(), width, height, newSize.first, newSize.second, encoding);
+    THROW_ON_FAILURE(image.setPixels(pixels.data(), newSize.first, newSize.second));
+
+    create_directories(downscaledPath.parent_path());
+
+    // Written under another name first, so an interrupted write is never
+    // reused.
+    auto tempPath = downscaledPath;
+    tempPath += ".tmp";
+
+    THROW_ON_FAILURE_WITH(image.writeToFile(MString(tempPath.c_str()), isJPEG ? "jpg" : "png"),
+                          formatted("Failed to write image %s", tempPath.c_str()));
+
+    fs::rename(tempPath, downscaledPath);
+    return downscaledPath;
+}
+
+GLTF::Image *ExportableResources::getImage(fs::path path, const ImageSlot slot) {
     if (!exists(path)) {
         MayaException::printError(
             formatted("Image with path '%s' does not exist!", path.c_str()));
@@ -54,8 +182,13 @@ GLTF::Image *ExportableResources::getImage(fs::path path) {
 
     std::string key(path.generic_string());
     std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-    auto &imagePtr = m_imageMap[key];
-    if (!imagePtr) {
+    // Slots with different maximum sizes can load different images.
+    auto &slotImage = m_imagePerSlotKey[key + "#" + std::to_string(slot)];
+    if (!slotImage) {
+        if (m_imagePrefetcher) {
+            m_imagePrefetcher->wait(path);
+        }
+
         if (m_args.convertUnsupportedImages) {
             // Convert unsupported formats to PNG
             std::string ext = path.extension().generic_string();
@@ -63,32 +196,89 @@ GLTF::Image *ExportableResources::getImage(fs::path path) {
 
             if (ext != ".jpg" && ext != ".jpeg" && ext != ".png" &&
                 ext != ".dds") {
-                std::cout << prefix << "WARNING: Converting image '" << path
-                          << "' to .png, since glTF does not support " << ext
-                          << std::endl;
+                const auto convertedPath = convertedImagePath(imageCacheFolder(), path, ".png");
+
+                if (exists(convertedPath)) {
+                    std::cout << prefix << "Using the .png converted before from image '" << path
+                              << "', since glTF does not support " << ext << std::endl;
+                } else {
+                    std::cout << prefix << "WARNING: Converting image '" << path
+                              << "' to .png, since glTF does not support " << ext
+                              << std::endl;
 
-                MImage image;
-                THROW_ON_FAILURE_WITH(
-                    image.readFromFile(MString(path.c_str())),
-                    formatted("Failed to read image %s", path.c_str()));
+                    MImage image;
+                    THROW_ON_FAILURE_WITH(
+                        image.readFromFile(MString(path.c_str())),
+                        formatted("Failed to read image %s", path.c_str()));
 
-                path = fs::temp_directory_path() /
-                       path.filename().replace_extension(".png");
+                    create_directories(convertedPath.parent_path());
 
-                THROW_ON_FAILURE_WITH(
-                    image.writeToFile(MString(path.c_str()), "png"),
-                    formatted("Failed to write image %s", path.c_str()));
+                    // Written under another name first, so an interrupted
+                    // conversion is never reused.
+                    auto tempPath = convertedPath;
+                    tempPath += ".tmp";
+
+                    THROW_ON_FAILURE_WITH(
+                        image.writeToFile(MString(tempPath.c_str()), "png"),
+                        formatted("Failed to write image %s", tempPath.c_str()));
+
+                    fs::rename(tempPath, convertedPath);
+                }
+
+                path = convertedPath;
             }
         }
 
-        try {
-            imagePtr.reset(GLTF::Image::load(path.generic_string()));
-        } catch (std::exception &ex) {
-            MayaException::printError(
-                formatted("Failed to load image '%s': %s", path.c_str(), ex.what()));
+        path = downscaledImagePath(path, slot);
+
+        std::string loadedKey(path.generic_string());
+        std::transform(loadedKey.begin(), loadedKey.end(), loadedKey.begin(), ::tolower);
+        auto &imagePtr = m_imageMap[loadedKey];
+        if (!imagePtr) {
+            // Images that are not embedded are copied from their file, and
+            // only need their bytes to be hashed for the content store.
+            const auto isCopied = !(m_args.glb && !m_args.externalTextures) && !m_args.contentStore.length();
+
+            try {
+                ImageHeader header;
+                const auto hasHeader = readImageHeader(path, header);
+
+                if (hasHeader && isCopied) {
+                    // Named like GLTF::Image::load does, by its filename.
+                    imagePtr = std::make_unique<GLTF::Image>(path.filename().generic_string());
+                    imagePtr->mimeType = header.mimeType;
+                } else {
+                    imagePtr.reset(GLTF::Image::load(path.generic_string()));
+                }
+
+                m_imageSourcePaths[imagePtr.get()] = path;
+                if (hasHeader) {
+                    m_imageHeaders[imagePtr.get()] = header;
+                }
+            } catch (std::exception &ex) {
+                MayaException::printError(
+                    formatted("Failed to load image '%s': %s", path.c_str(), ex.what()));
+            }
         }
+
+        slotImage = imagePtr.get();
     }
-    return imagePtr.get();
+    return slotImage;
+}
+
+fs::path ExportableResources::getImageSourcePath(const GLTF::Image *image) const {
+    const auto it = m_imageSourcePaths.find(image);
+    return it == m_imageSourcePaths.end() ? fs::path() : it->second;
+}
+
+const ImageHeader *ExportableResources::getImageHeader(const GLTF::Image *image) const {
+    const auto it = m_imageHeaders.find(image);
+    return it == m_imageHeaders.end() ? nullptr : &it->second;
+}
+
+size_t ExportableResources::getImageByteLength(const GLTF::Image *image) const {
+    const auto *header = image->data ? nullptr : getImageHeader(image);
+    return header ? header->byteLength : image->byteLength;
 }
 
 static GLTF::Constants::WebGL
@@ -163,6 +353,20 @@ GLTF::Sampler *ExportableResources::getSampler(const ImageFilterKind filter,
     return samplerPtr.get();
 }
 
+const ResolvedFileTexture *ExportableResources::findFileTexture(const MObject &fileNode, const ImageSlot slot) {
+    const auto textures = m_resolvedFileTextures.find(fileNode);
+    if (!textures)
+        return nullptr;
+
+    const auto it = textures->find(slot);
+    return it == textures->end() ? nullptr : &it->second;
+}
+
+void ExportableResources::registerFileTexture(const MObject &fileNode, const ImageSlot slot,
+                                              const ResolvedFileTexture &texture) {
+    m_resolvedFileTextures[fileNode][slot] = texture;
+}
+
 GLTF::Texture *ExportableResources::getTexture(GLTF::Image *image,
                                                GLTF::Sampler *sampler) {
     const auto key = std::make_pair(image, sampler);
@@ -172,13 +376,102 @@ GLTF::Texture *ExportableResources::getTexture(GLTF::Image *image,
         texturePtr = std::make_unique<GLTF::Texture>();
         texturePtr->source = image;
         texturePtr->sampler = sampler;
+
+        const auto sourcePath = getImageSourcePath(image);
+        if (m_basisuTextures && !sourcePath.empty()) {
+            m_basisuTextures->add(texturePtr.get(), sourcePath,
+                                  convertedImagePath(imageCacheFolder(), sourcePath,
+                                                     m_args.basisuUASTC ? ".uastc.ktx2" : ".etc1s.ktx2"));
+        }
     }
     return texturePtr.get();
 }
 
 void ExportableResources::getAllAccessors(
     std::vector<GLTF::Accessor *> &accessors) {
-    // None
+    // Accessors the glTF writer doesn't know about.
+    m_meshInstances.getAllAccessors(accessors);
+}
+
+ExportableMesh *
+ExportableResources::findMesh(const MeshContentHash &hash) const {
+    const auto it = m_meshPerContentHash.find(hash);
+    return it == m_meshPerContentHash.end() ? nullptr : it->second;
+}
+
+void ExportableResources::registerMesh(const MeshContentHash &hash,
+                                       ExportableMesh *mesh) {
+    m_meshPerContentHash.emplace(hash, mesh);
+}
+
+GLTF::Skin *ExportableResources::findSkin(const SkinContentHash &hash) const {
+    const auto it = m_skinPerContentHash.find(hash);
+    return it == m_skinPerContentHash.end() ? nullptr : it->second;
+}
+
+void ExportableResources::registerSkin(const SkinContentHash &hash,
+                                       GLTF::Skin *skin) {
+    m_skinPerContentHash.emplace(hash, skin);
+}
+
+GLTF::Texture *ExportableResources::findMergedTexture(const GLTF::Texture *metallic,
+                                                      const GLTF::Texture *roughness) const {
+    const auto it = m_mergedTextureMap.find(std::make_pair(metallic, roughness));
+    return it == m_mergedTextureMap.end() ? nullptr : it->second;
+}
+
+void ExportableResources::registerMergedTexture(const GLTF::Texture *metallic,
+                                                const GLTF::Texture *roughness,
+                                                GLTF::Texture *merged) {
+    m_mergedTextureMap.emplace(std::make_pair(metallic, roughness), merged);
+}
+
+void ExportableResources::buildTextureAtlases(const std::vector<GLTF::Mesh *> &meshes) {
+    std::vector<ExportableMaterial *> materials;
+    for (auto &&pair : m_materialMap) {
+        if (pair.second) {
+            materials.push_back(pair.second.get());
+        }
+    }
+
+    m_textureAtlases.build(*this, meshes, materials, imageCacheFolder() / "atlases");
+}
+
+std::vector<GLTF::Accessor *> ExportableResources::packedAccessors(
+    const std::vector<GLTF::Accessor *> &accessors) const {
+    return m_dracoPrimitives.substitute(
+        m_sparseAccessors.substitute(accessors));
+}
+
+void ExportableResources::finishPacking() const {
+    m_sparseAccessors.finishPacking();
+    m_dracoPrimitives.finishPacking();
+}
+
+bool ExportableResources::requiresJSONPatching() const {
+    return !m_sparseAccessors.empty() || !m_quantizedAccessors.empty() ||
+           !m_dracoPrimitives.empty() || !m_meshInstances.empty() || !m_meshLods.empty() ||
+           !m_animatedBounds.empty() || !m_meshlets.empty() || !m_textureAtlases.empty() || !m_progressiveLayout.empty() ||
+           !m_meshoptCompression.empty() || (m_basisuTextures && !m_basisuTextures->empty());
+}
+
+void ExportableResources::patchJSON(rapidjson::Document &document) const {
+    m_sparseAccessors.patchJSON(document);
+    m_meshInstances.patchJSON(document);
+    m_meshLods.patchJSON(document);
+    m_textureAtlases.patchJSON(document);
+    m_animatedBounds.patchJSON(document);
+    m_meshlets.patchJSON(document);
+    m_progressiveLayout.patchJSON(document);
+    m_quantizedAccessors.patchJSON(document);
+    m_dracoPrimitives.patchJSON(document);
+
+    if (m_basisuTextures) {
+        m_basisuTextures->patchJSON(document);
+    }
+
+    // Must be last, it needs the ids of all buffer views.
+    m_meshoptCompression.patchJSON(document);
 }
 
 ExportableMaterial *ExportableResources::getDebugMaterial(const Float3 &hsv) {
@@ -1,14 +1,34 @@
 #pragma once
 #include "ExportableItem.h"
+#include "AnimatedBounds.h"
+#include "BlendShapeWeights.h"
+#include "DracoPrimitives.h"
 #include "ExportableMaterial.h"
+#include "FrameTimeInputs.h"
+#include "GLTFObjectPool.h"
+#include "InterleavedAttributes.h"
+#include "MeshInstances.h"
+#include "MeshLods.h"
+#include "MeshQuantization.h"
+#include "Meshlets.h"
+#include "MeshoptCompression.h"
+#include "NodeHandleMap.h"
+#include "ProgressiveLayout.h"
+#include "SparseAccessors.h"
+#include "TextureAtlases.h"
 #include "filesystem.h"
+#include "imageHeader.h"
 
 class Arguments;
 typedef std::string MayaFilename;
 typedef std::string MayaNodeName;
 
+class BasisuTextures;
+class ExportStatistics;
 class ExportableMaterial;
 class ExportableMesh;
+class ImagePrefetcher;
+class MeshCache;
 
 enum ImageTilingFlags { IMAGE_TILING_Wrap = 1, IMAGE_TILING_Mirror = 2 };
 
@@ -21,6 +41,12 @@ enum ImageFilterKind {
     IMAGE_FILTER_Gaussian = 5
 };
 
+// Two independent hashes of the content of a mesh
+typedef std::pair<uint64_t, uint64_t> MeshContentHash;
+
+// Two independent hashes of the joints and inverse bind matrices of a skin
+typedef std::pair<uint64_t, uint64_t> SkinContentHash;
+
 class ExportableResources : public ExportableItem {
   public:
     ExportableResources(const Arguments &args);
@@ -32,7 +58,19 @@ class ExportableResources : public ExportableItem {
     ExportableMaterial *getDebugMaterial(const Float3 &hue);
     ExportableMaterial *getMaterial(const MObject &shaderGroup);
 
-    GLTF::Image *getImage(fs::path path);
+    /** Loads the image, downscaled to the maximum size of the slot. A PNG or
+     * JPEG image that is copied to the output folder as is has no data, only
+     * its header is read. */
+    GLTF::Image *getImage(fs::path path, ImageSlot slot);
+
+    /** The file an image was loaded from, empty if unknown */
+    fs::path getImageSourcePath(const GLTF::Image *image) const;
+
+    /** The header of the file of a PNG or JPEG image, null if unknown */
+    const ImageHeader *getImageHeader(const GLTF::Image *image) const;
+
+    /** The size of the image file, also when its data isn't loaded */
+    size_t getImageByteLength(const GLTF::Image *image) const;
 
     GLTF::Sampler *getSampler(const ImageFilterKind filter,
                               const ImageTilingFlags uTiling,
@@ -40,21 +78,140 @@ class ExportableResources : public ExportableItem {
 
     GLTF::Texture *getTexture(GLTF::Image *image, GLTF::Sampler *sampler);
 
+    // Returns the texture resolved before for the file texture node and slot, or null.
+    const ResolvedFileTexture *findFileTexture(const MObject &fileNode, ImageSlot slot);
+
+    void registerFileTexture(const MObject &fileNode, ImageSlot slot, const ResolvedFileTexture &texture);
+
     // std::map<MayaFilename, std::unique_ptr<GLTF::Image>> imageMap;
     // std::map<MayaNodeName, std::unique_ptr<GLTF::Texture>> textureMap;
     // std::map<MayaNodeName, std::unique_ptr<GLTF::Sampler>> samplerMap;
 
     void getAllAccessors(std::vector<GLTF::Accessor *> &accessors);
 
+    // Returns the mesh exported before with the same content, or null.
+    ExportableMesh *findMesh(const MeshContentHash &hash) const;
+
+    void registerMesh(const MeshContentHash &hash, ExportableMesh *mesh);
+
+    // Returns the skin exported before with the same joints and inverse bind matrices, or null.
+    GLTF::Skin *findSkin(const SkinContentHash &hash) const;
+
+    void registerSkin(const SkinContentHash &hash, GLTF::Skin *skin);
+
+    // Returns the texture merged before from the metallic and roughness textures, or null.
+    GLTF::Texture *findMergedTexture(const GLTF::Texture *metallic, const GLTF::Texture *roughness) const;
+
+    void registerMergedTexture(const GLTF::Texture *metallic, const GLTF::Texture *roughness,
+                               GLTF::Texture *merged);
+
+    SparseAccessors &sparseAccessors() { return m_sparseAccessors; }
+    const SparseAccessors &sparseAccessors() const { return m_sparseAccessors; }
+
+    QuantizedAccessors &quantizedAccessors() { return m_quantizedAccessors; }
+    const QuantizedAccessors &quantizedAccessors() const { return m_quantizedAccessors; }
+
+    DracoPrimitives &dracoPrimitives() { return m_dracoPrimitives; }
+    const DracoPrimitives &dracoPrimitives() const { return m_dracoPrimitives; }
+
+    MeshInstances &meshInstances() { return m_meshInstances; }
+    const MeshInstances &meshInstances() const { return m_meshInstances; }
+
+    AnimatedBounds &animatedBounds() { return m_animatedBounds; }
+    const AnimatedBounds &animatedBounds() const { return m_animatedBounds; }
+
+    MeshLods &meshLods() { return m_meshLods; }
+    const MeshLods &meshLods() const { return m_meshLods; }
+
+    Meshlets &meshlets() { return m_meshlets; }
+    const Meshlets &meshlets() const { return m_meshlets; }
+
+    MeshoptCompression &meshoptCompression() { return m_meshoptCompression; }
+    const MeshoptCompression &meshoptCompression() const { return m_meshoptCompression; }
+
+    ProgressiveLayout &progressiveLayout() { return m_progressiveLayout; }
+    const ProgressiveLayout &progressiveLayout() const { return m_progressiveLayout; }
+
+    InterleavedAttributes &interleavedAttributes() { return m_interleavedAttributes; }
+    const InterleavedAttributes &interleavedAttributes() const { return m_interleavedAttributes; }
+
+    BlendShapeWeights &blendShapeWeights() { return m_blendShapeWeights; }
+
+    FrameTimeInputs &frameTimeInputs() { return m_frameTimeInputs; }
+
+    /** Owns the packed buffers and buffer views, until the asset is destroyed */
+    GLTFObjectPool &objectPool() { return m_objectPool; }
+
+    /** Null unless -basisuEncoder is used */
+    BasisuTextures *basisuTextures() const { return m_basisuTextures.get(); }
+
+    /** Null unless -meshCacheFolder is used */
+    MeshCache *meshCache() const { return m_meshCache.get(); }
+
+    /** Null unless -statisticsReport or a byte budget is used */
+    ExportStatistics *statistics() const { return m_statistics.get(); }
+
+    /** Packs the small textures of the materials into atlases, see -textureAtlasSize. Must be called once all the
+     * meshes are finished, before their accessors are packed. */
+    void buildTextureAtlases(const std::vector<GLTF::Mesh *> &meshes);
+
+    /** The accessors to pack instead of the given ones, e.g. the data of
+     * sparse accessors and Draco compressed primitives */
+    std::vector<GLTF::Accessor *> packedAccessors(const std::vector<GLTF::Accessor *> &accessors) const;
+
+    /** Must be called after packing, before the JSON is written */
+    void finishPacking() const;
+
+    /** Does the written JSON need patchJSON? */
+    bool requiresJSONPatching() const;
+
+    /** Patches the glTF features that the glTF writer doesn't support into the JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
   private:
+    /** Where converted images are kept, see -imageCacheFolder */
+    fs::path imageCacheFolder() const;
+
+    /** The image downscaled to the maximum size of the slot, or the image
+     * itself when it fits */
+    fs::path downscaledImagePath(const fs::path &path, ImageSlot slot) const;
+
+    // Destroyed last, the other resources refer to its buffer views.
+    GLTFObjectPool m_objectPool;
+
     std::map<MayaNodeName, std::unique_ptr<ExportableMaterial>> m_materialMap;
+    NodeHandleMap<ExportableMaterial *> m_materialPerShadingGroup;
+    NodeHandleMap<std::map<ImageSlot, ResolvedFileTexture>> m_resolvedFileTextures;
     std::map<Float3, std::unique_ptr<ExportableMaterial>> m_debugMaterialMap;
     std::map<std::string, std::unique_ptr<GLTF::Image>> m_imageMap;
+    std::map<std::string, GLTF::Image *> m_imagePerSlotKey;
+    std::map<const GLTF::Image *, fs::path> m_imageSourcePaths;
+    std::map<const GLTF::Image *, ImageHeader> m_imageHeaders;
     std::map<int, std::unique_ptr<GLTF::Sampler>> m_samplerMap;
     std::map<std::pair<GLTF::Image *, GLTF::Sampler *>,
              std::unique_ptr<GLTF::Texture>>
         m_TextureMap;
+    std::map<MeshContentHash, ExportableMesh *> m_meshPerContentHash;
+    std::map<SkinContentHash, GLTF::Skin *> m_skinPerContentHash;
+    std::map<std::pair<const GLTF::Texture *, const GLTF::Texture *>, GLTF::Texture *> m_mergedTextureMap;
 
     ExportableDefaultMaterial m_defaultMaterial;
+    SparseAccessors m_sparseAccessors;
+    QuantizedAccessors m_quantizedAccessors;
+    DracoPrimitives m_dracoPrimitives;
+    MeshInstances m_meshInstances;
+    MeshLods m_meshLods;
+    TextureAtlases m_textureAtlases;
+    AnimatedBounds m_animatedBounds;
+    Meshlets m_meshlets;
+    MeshoptCompression m_meshoptCompression;
+    ProgressiveLayout m_progressiveLayout;
+    InterleavedAttributes m_interleavedAttributes;
+    BlendShapeWeights m_blendShapeWeights;
+    FrameTimeInputs m_frameTimeInputs;
+    std::unique_ptr<MeshCache> m_meshCache;
+    std::unique_ptr<BasisuTextures> m_basisuTextures;
+    std::unique_ptr<ImagePrefetcher> m_imagePrefetcher;
+    std::unique_ptr<ExportStatistics> m_statistics;
     const Arguments &m_args;
 };
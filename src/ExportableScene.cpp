@@ -3,6 +3,9 @@
 #include "ExportableNode.h"
 #include "ExportableScene.h"
 #include "MayaException.h"
+#include "MeshBatch.h"
+#include "Profiler.h"
+#include "StaticNodes.h"
 
 ExportableScene::ExportableScene(ExportableResources &resources) : m_resources(resources) {}
 
@@ -19,6 +22,21 @@ void ExportableScene::updateCurrentValues() {
     }
 }
 
+void ExportableScene::markStaticNodes() {
+    size_t staticNodeCount = 0;
+
+    for (auto &&pair : m_table) {
+        auto &node = pair.second;
+        node->isStatic = isProvablyStatic(*node);
+        staticNodeCount += node->isStatic;
+    }
+
+    if (staticNodeCount > 0) {
+        cout << prefix << "Skipping the animation of " << staticNodeCount << " of " << m_table.size()
+             << " nodes, these never move" << endl;
+    }
+}
+
 void ExportableScene::mergeRedundantShapeNodes() {
     std::set<NodeTable::key_type> redundantKeys;
 
@@ -30,25 +48,337 @@ void ExportableScene::mergeRedundantShapeNodes() {
     }
 
     for (auto &&key : redundantKeys) {
-        m_table.erase(key);
+        const auto it = m_table.find(key);
+        const DagPathKey nodeKey(it->second->dagPath);
+        m_table.erase(it);
+        m_nodesByKey.erase(nodeKey);
+    }
+}
+
+std::vector<GLTF::Node *> ExportableScene::instanceMeshes() {
+    const auto &args = arguments();
+
+    std::vector<GLTF::Node *> rootInstanceNodes;
+
+    // The instances must have the same parent, shape and materials. With
+    // mesh deduplication, identical meshes share the glTF mesh.
+    typedef std::tuple<const ExportableNode *, const GLTF::Mesh *, std::string, std::vector<const GLTF::Material *>>
+        InstanceKey;
+
+    std::map<InstanceKey, size_t> groupIndices;
+    std::vector<std::vector<ExportableNode *>> groups;
+
+    for (auto &&pair : m_table) {
+        auto &node = pair.second;
+        auto *mesh = node->mesh();
+
+        if (!mesh || node->camera() || !mesh->isInstanceable())
+            continue;
+
+        // Instance transforms are static TRS transforms relative to the
+        // parent.
+        if (node->transformKind != TransformKind::Simple || node->obj.hasFn(MFn::kJoint))
+            continue;
+
+        const auto *transform = node->glPrimaryNode().transform;
+        if (!transform || transform->type != GLTF::Node::Transform::TRS)
+            continue;
+
+        if (MAnimUtil::isAnimated(node->dagPath))
+            continue;
+
+        std::vector<const GLTF::Material *> materials;
+        for (auto *primitive : mesh->glSharedMesh().primitives) {
+            materials.emplace_back(primitive->material);
+        }
+
+        InstanceKey key(node->parentNode, nullptr, std::string(), std::move(materials));
+
+        if (args.deduplicateMeshes) {
+            std::get<1>(key) = &mesh->glSharedMesh();
+        } else {
+            // Instanced shapes have a single node, identified by its first
+            // path.
+            std::get<2>(key) = MFnDagNode(mesh->obj).fullPathName().asChar();
+        }
+
+        const auto it = groupIndices.find(key);
+        if (it == groupIndices.end()) {
+            groupIndices[key] = groups.size();
+            groups.emplace_back(std::vector<ExportableNode *>{node});
+        } else {
+            groups[it->second].emplace_back(node);
+        }
+    }
+
+    const auto minInstanceCount = std::max<size_t>(2, args.instancingThreshold);
+
+    for (auto &&instances : groups) {
+        if (instances.size() < minInstanceCount)
+            continue;
+
+        auto *firstNode = instances.front();
+        auto &mesh = *firstNode->mesh();
+
+        cout << prefix << "Drawing mesh '" << mesh.name() << "' with " << instances.size() << " GPU instances" << endl;
+
+        const auto *dequantization = mesh.dequantizationTransform();
+
+        std::vector<GLTF::Node::TransformTRS> transforms;
+        transforms.reserve(instances.size());
+
+        for (auto *node : instances) {
+            auto trs = *static_cast<const GLTF::Node::TransformTRS *>(node->glPrimaryNode().transform);
+
+            if (dequantization) {
+                // T*R*S * Td*Sd == (T + R*S*Td) * R * (S*Sd)
+                const MQuaternion rotation(trs.rotation[0], trs.rotation[1], trs.rotation[2], trs.rotation[3]);
+                MVector offset(trs.scale[0] * dequantization->translation[0],
+                               trs.scale[1] * dequantization->translation[1],
+                               trs.scale[2] * dequantization->translation[2]);
+                offset = offset.rotateBy(rotation);
+
+                for (int axis = 0; axis < 3; ++axis) {
+                    trs.translation[axis] += static_cast<float>(offset[axis]);
+                    trs.scale[axis] *= dequantization->scale[axis];
+                }
+            }
+
+            transforms.emplace_back(trs);
+
+            // Keep the node for its children, but without the mesh. Only the
+            // mesh of the first instance is used; other meshes can still be
+            // shared by duplicates elsewhere.
+            node->m_mesh->detachFromNode();
+            if (node != firstNode && (!args.deduplicateMeshes || node->m_mesh->isDuplicate())) {
+                node->m_mesh.reset();
+            }
+        }
+
+        const auto &firstName = firstNode->glPrimaryNode().name;
+        const auto name = firstName.empty() ? firstName : firstName + ":GPU";
+
+        auto *instanceNode = m_resources.meshInstances().addGroup(name, &mesh.glSharedMesh(), transforms);
+
+        if (firstNode->parentNode) {
+            firstNode->parentNode->glPrimaryNode().children.emplace_back(instanceNode);
+        } else {
+            rootInstanceNodes.emplace_back(instanceNode);
+        }
+    }
+
+    return rootInstanceNodes;
+}
+
+// The matrix of a static glTF transform, in Maya's row vector convention.
+static MMatrix trsMatrix(const GLTF::Node::TransformTRS &trs) {
+    const double scale[3] = {trs.scale[0], trs.scale[1], trs.scale[2]};
+
+    MTransformationMatrix matrix;
+    THROW_ON_FAILURE(matrix.setScale(scale, MSpace::kTransform));
+    matrix.setRotationQuaternion(trs.rotation[0], trs.rotation[1], trs.rotation[2], trs.rotation[3]);
+    THROW_ON_FAILURE(matrix.setTranslation(MVector(trs.translation[0], trs.translation[1], trs.translation[2]),
+                                           MSpace::kTransform));
+    return matrix.asMatrix();
+}
+
+std::vector<GLTF::Node *> ExportableScene::batchStaticMeshes() {
+    const auto &args = arguments();
+
+    std::vector<GLTF::Node *> rootBatchNodes;
+
+    // The parts of a batch must have the same parent, material and vertex
+    // slots. With a cell size, these must also have their center in the same
+    // cell of a grid in the space of the parent, so a batch stays local
+    // enough to be culled.
+    typedef std::vector<std::pair<VertexSlot, size_t>> SlotLayout;
+    typedef std::tuple<const ExportableNode *, const ExportableMaterial *, std::array<int64_t, 3>, SlotLayout> BatchKey;
+
+    struct BatchEntry {
+        ExportableNode *node;
+        const VertexSignature *signature;
+        MeshBatchPart part;
+    };
+
+    std::map<BatchKey, std::vector<BatchEntry>> groups;
+    std::map<const ExportableNode *, std::vector<const BatchKey *>> keysPerNode;
+
+    for (auto &&pair : m_table) {
+        auto *node = pair.second;
+        auto *mesh = node->mesh();
+        if (!mesh || !mesh->isWaitingForBatch())
+            continue;
+
+        const auto &state = node->initialTransformState;
+        auto matrix = trsMatrix(state.primaryTRS());
+        if (state.requiresExtraNode) {
+            matrix *= trsMatrix(state.secondaryTRS());
+        }
+
+        const auto &materials = mesh->batchMaterials();
+        const auto &vertexBuffers = mesh->batchVertexBuffers();
+
+        // A primitive without material would lose its default look in a batch.
+        if (std::find(materials.begin(), materials.end(), nullptr) != materials.end())
+            continue;
+
+        size_t vertexBufferIndex = 0;
+        for (auto &&entry : vertexBuffers) {
+            auto *material = materials.at(vertexBufferIndex++);
+            const auto &vertexBuffer = entry.second;
+            if (vertexBuffer.indices.empty())
+                continue;
+
+            BatchKey key(node->parentNode, material, {0, 0, 0}, SlotLayout());
+
+            for (auto &&slot : vertexBuffer.componentsMap) {
+                std::get<3>(key).emplace_back(slot.first, slot.second.size() / vertexBuffer.maxIndex());
+            }
+
+            std::sort(std::get<3>(key).begin(), std::get<3>(key).end());
+
+            if (args.batchCellSize > 0) {
+                const auto positionIt =
+                    vertexBuffer.componentsMap.find(VertexSlot(ShapeIndex::main(), Semantic::POSITION, 0));
+                if (positionIt != vertexBuffer.componentsMap.end()) {
+                    MPoint minPoint(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+                    MPoint maxPoint(-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max());
+
+                    for (auto &&position : reinterpret_span<Position>(positionIt->second)) {
+                        const auto point = MPoint(position[0], position[1], position[2]) * matrix;
+                        for (int axis = 0; axis < 3; ++axis) {
+                            minPoint[axis] = std::min(minPoint[axis], point[axis]);
+                            maxPoint[axis] = std::max(maxPoint[axis], point[axis]);
+                        }
+                    }
+
+                    for (int axis = 0; axis < 3; ++axis) {
+                        const auto center = (minPoint[axis] + maxPoint[axis]) / 2;
+                        std::get<2>(key)[axis] = static_cast<int64_t>(std::floor(center / args.batchCellSize));
+                    }
+                }
+            }
+
+            auto groupIt = groups.find(key);
+            if (groupIt == groups.end()) {
+                groupIt = groups.emplace(key, std::vector<BatchEntry>()).first;
+            }
+
+            groupIt->second.push_back({node, &entry.first, {&vertexBuffer, matrix}});
+            keysPerNode[node].push_back(&groupIt->first);
+        }
     }
+
+    // A mesh that can't be merged with any other mesh keeps its own node.
+    std::set<const ExportableNode *> batchedNodes;
+
+    for (auto &&pair : keysPerNode) {
+        for (auto *key : pair.second) {
+            const auto &entries = groups.at(*key);
+            if (std::any_of(entries.begin(), entries.end(), [&](auto &entry) { return entry.node != pair.first; })) {
+                batchedNodes.insert(pair.first);
+                break;
+            }
+        }
+    }
+
+    size_t batchCount = 0;
+    const auto maxVertexCount = static_cast<size_t>(std::max(1, args.batchMaxVertices));
+
+    for (auto &&group : groups) {
+        auto *parentNode = std::get<0>(group.first);
+        auto *material = const_cast<ExportableMaterial *>(std::get<1>(group.first));
+
+        std::vector<MeshBatchPart> parts;
+        size_t vertexCount = 0;
+        const ExportableNode *firstNode = nullptr;
+
+        const auto addBatch = [&]() {
+            if (parts.empty())
+                return;
+
+            const auto &firstName = firstNode->glPrimaryNode().name;
+            const auto name = firstName.empty() ? firstName : firstName + ":BATCH";
+
+            auto &batch = *m_meshBatches.emplace_back(std::make_unique<MeshBatch>(
+                name, *group.second.front().signature, parts, m_resources, material));
+
+            if (parentNode) {
+                const_cast<ExportableNode *>(parentNode)->glPrimaryNode().children.emplace_back(&batch.glNode);
+            } else {
+                rootBatchNodes.emplace_back(&batch.glNode);
+            }
+
+            m_meshBatchDagPaths.emplace_back(parentNode ? parentNode->dagPath : firstNode->dagPath);
+
+            ++batchCount;
+            parts.clear();
+            vertexCount = 0;
+            firstNode = nullptr;
+        };
+
+        for (auto &&entry : group.second) {
+            if (!batchedNodes.count(entry.node))
+                continue;
+
+            const auto partVertexCount = entry.part.vertexBuffer->maxIndex();
+            if (!parts.empty() && vertexCount + partVertexCount > maxVertexCount) {
+                addBatch();
+            }
+
+            if (!firstNode) {
+                firstNode = entry.node;
+            }
+
+            parts.push_back(entry.part);
+            vertexCount += partVertexCount;
+        }
+
+        addBatch();
+    }
+
+    size_t meshCount = 0;
+
+    for (auto &&pair : m_table) {
+        auto *node = pair.second;
+        auto *mesh = node->mesh();
+        if (!mesh || !mesh->isWaitingForBatch())
+            continue;
+
+        if (batchedNodes.count(node)) {
+            // The node is kept for its children, but without the mesh.
+            node->m_mesh.reset();
+            ++meshCount;
+        } else {
+            mesh->finishPrimitives();
+            mesh->attachToNode(node->glPrimaryNode());
+        }
+    }
+
+    if (meshCount > 0) {
+        cout << prefix << "Merged " << meshCount << " static meshes into " << batchCount << " batches" << endl;
+    }
+
+    return rootBatchNodes;
 }
 
 ExportableNode *ExportableScene::getNode(const MDagPath &dagPath) {
     MStatus status;
 
-    const std::string fullDagPath{dagPath.fullPathName(&status).asChar()};
-    THROW_ON_FAILURE(status);
-
     MObject mayaNode = dagPath.node(&status);
     if (mayaNode.isNull() || status.error()) {
-        cerr << "glTF2Maya: skipping '" << fullDagPath << "' as it is not a node" << endl;
+        cerr << "glTF2Maya: skipping '" << dagPath.fullPathName().asChar() << "' as it is not a node" << endl;
         return nullptr;
     }
 
-    auto &ptr = m_table[fullDagPath];
+    auto &ptr = m_nodesByKey[DagPathKey(dagPath)];
     if (ptr == nullptr) {
-        ptr.reset(new ExportableNode(dagPath));
+        const std::string fullDagPath{dagPath.fullPathName(&status).asChar()};
+        THROW_ON_FAILURE(status);
+
+        ProfileScope profileScope("Node discovery");
+        ptr.reset(new ExportableNode(dagPath, m_nodeCount++));
+        m_table[fullDagPath] = ptr.get();
         ptr->load(*this, m_initialTransformCache);
     }
     return ptr.get();
@@ -59,14 +389,26 @@ ExportableNode *ExportableScene::getParent(ExportableNode *node) {
 
     ExportableNode *parentNode = nullptr;
 
-    MDagPath parentDagPath;
-    if (findLogicalParent(dagPath, parentDagPath)) {
-        // Logical parent overrides Maya's parent.
-        // TODO: Check for cycles!
-        parentNode = getNode(parentDagPath);
+    if (!m_hasFoundLogicalParents) {
+        findLogicalParents();
     }
 
-    // Find first ancestor that is a Maya node.
+    const auto logicalParentIt = m_logicalParents.empty() ? m_logicalParents.end() : m_logicalParents.find(MObjectHandle(node->obj));
+    if (logicalParentIt != m_logicalParents.end()) {
+        const auto &logicalParent = logicalParentIt->second;
+        if (logicalParent.warning.empty()) {
+            cout << prefix << "Found logical parent '" << logicalParent.dagPath.partialPathName().asChar() << " on node '"
+                 << dagPath.partialPathName() << "'" << endl;
+
+            // Logical parent overrides Maya's parent.
+            // TODO: Check for cycles!
+            parentNode = getNode(logicalParent.dagPath);
+        } else {
+            cout << prefix << "WARNING: " << logicalParent.warning << " on node '" << dagPath.partialPathName() << "'" << endl;
+        }
+    }
+
+    // Find first ancestor that is a Maya node, it is created only once.
     // That will become our glTF parent.
     while (!parentNode) {
         dagPath.pop();
@@ -85,10 +427,54 @@ void ExportableScene::getAllAccessors(AccessorsPerDagPath &accessors) {
 
         node->getAllAccessors(accessors[node->dagPath]);
     }
+
+    for (size_t i = 0; i < m_meshBatches.size(); ++i) {
+        m_meshBatches[i]->getAllAccessors(accessors[m_meshBatchDagPaths[i]]);
+    }
+}
+
+void ExportableScene::getAccessorsPerLodRankAndDepth(
+    std::map<std::pair<int, int>, std::vector<GLTF::Accessor *>> &accessors) {
+    for (auto &&pair : m_table) {
+        auto *mesh = pair.second->mesh();
+        if (!mesh)
+            continue;
+
+        const auto depth = static_cast<int>(pair.second->dagPath.length());
+
+        std::map<int, std::vector<GLTF::Accessor *>> accessorsPerLodRank;
+        mesh->getAccessorsPerLodRank(accessorsPerLodRank);
+
+        for (auto &&rankAccessors : accessorsPerLodRank) {
+            auto &target = accessors[std::make_pair(rankAccessors.first, depth)];
+            target.insert(target.end(), rankAccessors.second.begin(), rankAccessors.second.end());
+        }
+    }
+
+    // The batches have no levels of detail, these go with their parent.
+    for (size_t i = 0; i < m_meshBatches.size(); ++i) {
+        const auto depth = static_cast<int>(m_meshBatchDagPaths[i].length());
+        m_meshBatches[i]->getAllAccessors(accessors[std::make_pair(0, depth)]);
+    }
 }
 
 void ExportableScene::registerOrphanNode(ExportableNode *node) { m_orphans[node->dagPath] = node; }
 
+void ExportableScene::finishMeshes(const size_t maxPendingCount) {
+    while (m_pendingMeshNodes.size() > maxPendingCount) {
+        auto *node = m_pendingMeshNodes.front();
+        m_pendingMeshNodes.pop_front();
+
+        // Only static meshes can be baked into the space of their parent.
+        const auto isBatchable = arguments().batchStaticMeshes && isProvablyStatic(*node);
+
+        node->m_mesh->finish(isBatchable);
+        if (!node->m_mesh->isWaitingForBatch()) {
+            node->m_mesh->attachToNode(node->glPrimaryNode());
+        }
+    }
+}
+
 // int ExportableScene::distanceToRoot(MDagPath dagPath) {
 //     int distance;
 //
@@ -101,42 +487,48 @@ void ExportableScene::registerOrphanNode(ExportableNode *node) { m_orphans[node-
 //     return distance;
 // }
 
-bool ExportableScene::findLogicalParent(const MFnDagNode &childDagNode, MDagPath &parentDagPath) {
-    parentDagPath = MDagPath();
+void ExportableScene::findLogicalParents() {
+    m_hasFoundLogicalParents = true;
 
-    const auto childName = childDagNode.partialPathName();
+    // A single pass over the DG, instead of a plug lookup per exported node.
+    // Nodes often share their logical parent, each name is resolved once.
+    std::map<std::string, LogicalParent> logicalParentPerName;
 
-    const auto logicalParentPlug = childDagNode.findPlug("Maya2glTF_LogicalParent");
-    if (logicalParentPlug.isNull())
-        return false;
+    MStatus status;
+    MItDependencyNodes nodeIterator(MFn::kDagNode, &status);
+    THROW_ON_FAILURE(status);
 
-    MString logicalParentName;
-    if (!logicalParentPlug.getValue(logicalParentName))
-        return false;
+    for (; !nodeIterator.isDone(); nodeIterator.next()) {
+        const auto obj = nodeIterator.thisNode();
+        const MFnDependencyNode fnNode(obj);
 
-    MSelectionList selection;
-    selection.add(logicalParentName);
-    if (selection.length() == 0) {
-        cout << prefix << "WARNING: Logical parent '" << logicalParentName.asChar() << " not found on node '"
-             << childName << "'" << endl;
-        return false;
-    }
+        if (!fnNode.hasAttribute("Maya2glTF_LogicalParent"))
+            continue;
 
-    if (selection.length() > 1) {
-        cout << prefix << "WARNING: More than one logical parent matching '" << logicalParentName.asChar()
-             << " was found on node '" << childName << "'" << endl;
-        return false;
-    }
+        const auto logicalParentPlug = fnNode.findPlug("Maya2glTF_LogicalParent", true);
 
-    MDagPath logicalParentDagPath;
-    if (!selection.getDagPath(0, logicalParentDagPath)) {
-        cout << prefix << "WARNING: Failed to get DAG path of logical parent '" << logicalParentName.asChar()
-             << " on node '" << childName << "'" << endl;
-        return false;
-    }
+        MString logicalParentName;
+        if (logicalParentPlug.isNull() || !logicalParentPlug.getValue(logicalParentName))
+            continue;
+
+        auto it = logicalParentPerName.find(logicalParentName.asChar());
+        if (it == logicalParentPerName.end()) {
+            LogicalParent logicalParent;
+
+            MSelectionList selection;
+            selection.add(logicalParentName);
 
-    parentDagPath = logicalParentDagPath;
-    cout << prefix << "Found logical parent '" << logicalParentDagPath.partialPathName().asChar() << " on node '"
-         << childName << "'" << endl;
-    return true;
+            if (selection.length() == 0) {
+                logicalParent.warning = formatted("Logical parent '%s not found", logicalParentName.asChar());
+            } else if (selection.length() > 1) {
+                logicalParent.warning = formatted("More than one logical parent matching '%s was found", logicalParentName.asChar());
+            } else if (!selection.getDagPath(0, logicalParent.dagPath)) {
+                logicalParent.warning = formatted("Failed to get DAG path of logical parent '%s", logicalParentName.asChar());
+            }
+
+            it = logicalParentPerName.emplace(logicalParentName.asChar(), logicalParent).first;
+        }
+
+        m_logicalParents.emplace(MObjectHandle(obj), it->second);
+    }
 }
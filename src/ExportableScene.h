@@ -4,8 +4,10 @@
 #include "Transform.h"
 
 class ExportableNode;
+class MeshBatch;
 
-typedef std::map<std::string, std::unique_ptr<ExportableNode>> NodeTable;
+// The nodes by full DAG path name, this is the order of the export.
+typedef std::map<std::string, ExportableNode *> NodeTable;
 
 // OrphanNodes = nodes without a parent. We use the MDagPath as a key to make
 // sure we get a deterministic output (pointers change)
@@ -31,6 +33,18 @@ class ExportableScene {
 
     void mergeRedundantShapeNodes();
 
+    // Marks the nodes that provably never move, so these are not sampled.
+    void markStaticNodes();
+
+    // Draws the instances of the same mesh with a single GPU instanced node.
+    // Returns the created nodes that have no parent.
+    std::vector<GLTF::Node *> instanceMeshes();
+
+    // Merges the finished static meshes with the same parent and material
+    // into batches, and finishes the other static meshes, see
+    // -batchStaticMeshes. Returns the created nodes that have no parent.
+    std::vector<GLTF::Node *> batchStaticMeshes();
+
     // Gets or creates the node
     // Returns null if the DAG path has no node
     ExportableNode *getNode(const MDagPath &dagPath);
@@ -41,6 +55,14 @@ class ExportableScene {
 
     void getAllAccessors(AccessorsPerDagPath &accessors);
 
+    /** The accessors of the meshes per level of detail rank and node depth, see -progressiveLayout */
+    void getAccessorsPerLodRankAndDepth(std::map<std::pair<int, int>, std::vector<GLTF::Accessor *>> &accessors);
+
+    // Finishes the oldest meshes that are still welded in the background,
+    // until at most maxPendingCount remain. The meshes are finished in the
+    // order they were created, so the output doesn't depend on the threads.
+    void finishMeshes(size_t maxPendingCount);
+
     // Register a node without parent
     void registerOrphanNode(ExportableNode *node);
 
@@ -48,6 +70,9 @@ class ExportableScene {
 
     const NodeTable &table() const { return m_table; }
 
+    // The number of transform indices handed out to nodes
+    size_t nodeCount() const { return m_nodeCount; }
+
     GLTF::Scene glScene;
 
   private:
@@ -55,11 +80,31 @@ class ExportableScene {
 
     friend class ExportableNode;
 
-    static bool findLogicalParent(const MFnDagNode &childDagNode, MDagPath &parentDagPath);
+    // The logical parent of a node with a Maya2glTF_LogicalParent attribute,
+    // or why it has none.
+    struct LogicalParent {
+        MDagPath dagPath;
+        std::string warning;
+    };
+
+    // Finds all nodes with a logical parent, and resolves their parents, once.
+    void findLogicalParents();
 
     ExportableResources &m_resources;
+
+    // The nodes are looked up by key, the path names are only built for new nodes.
+    std::unordered_map<DagPathKey, std::unique_ptr<ExportableNode>, DagPathKeyHasher> m_nodesByKey;
     NodeTable m_table;
+    size_t m_nodeCount = 0;
     NodeTransformCache m_initialTransformCache;
     NodeTransformCache m_currentTransformCache;
     OrphanNodes m_orphans;
+    std::deque<ExportableNode *> m_pendingMeshNodes;
+
+    // The merged static meshes, and the DAG paths their accessors belong to.
+    std::vector<std::unique_ptr<MeshBatch>> m_meshBatches;
+    std::vector<MDagPath> m_meshBatchDagPaths;
+
+    bool m_hasFoundLogicalParents = false;
+    std::unordered_map<MObjectHandle, LogicalParent, MObjectHandleHasher> m_logicalParents;
 };
@@ -8,7 +8,8 @@
 
 ExportableTexture::ExportableTexture(Private, ExportableResources &resources,
                                      const MObject &obj,
-                                     const char *attributeName) {
+                                     const char *attributeName,
+                                     const ImageSlot slot) {
     if (resources.arguments().skipMaterialTextures)
         return;
 
@@ -28,6 +29,13 @@ ExportableTexture::ExportableTexture(Private, ExportableResources &resources,
         return;
     }
 
+    if (const auto resolved = resources.findFileTexture(connectedObject, slot)) {
+        imageFilePath = resolved->imageFilePath;
+        glSampler = resolved->glSampler;
+        glTexture = resolved->glTexture;
+        return;
+    }
+
     if (!DagHelper::getPlugValue(connectedObject, "fileTextureName",
                                  imageFilePath)) {
         MayaException::printError(formatted("Failed to get %s.fileTextureName",
@@ -61,26 +69,30 @@ ExportableTexture::ExportableTexture(Private, ExportableResources &resources,
                                      static_cast<ImageTilingFlags>(vTiling));
     assert(glSampler);
 
-    const auto imagePtr = resources.getImage(imageFilePath.asChar());
+    const auto imagePtr = resources.getImage(imageFilePath.asChar(), slot);
     if (imagePtr) {
         glTexture = resources.getTexture(imagePtr, glSampler);
         assert(glTexture);
+
+        resources.registerFileTexture(connectedObject, slot, {imageFilePath, glSampler, glTexture});
     }
 }
 
 std::unique_ptr<ExportableTexture>
 ExportableTexture::tryCreate(ExportableResources &resources, const MObject &obj,
-                             const char *attributeName) {
+                             const char *attributeName,
+                             const ImageSlot slot) {
 
     auto instance = std::make_unique<ExportableTexture>(Private(), resources,
-                                                        obj, attributeName);
+                                                        obj, attributeName, slot);
     return instance->glTexture ? std::move(instance) : nullptr;
 }
 
 GLTF::Texture *ExportableTexture::tryLoad(ExportableResources &resources,
                                           const MObject &obj,
-                                          const char *attributeName) {
-    const auto instance = tryCreate(resources, obj, attributeName);
+                                          const char *attributeName,
+                                          const ImageSlot slot) {
+    const auto instance = tryCreate(resources, obj, attributeName, slot);
     return instance ? instance->glTexture : nullptr;
 }
 
@@ -3,6 +3,18 @@
 #include "macros.h"
 class ExportableResources;
 
+/** What a texture is used for, it selects the maximum image size and the
+ * filtering when downscaling */
+enum ImageSlot { IMAGE_SLOT_Color, IMAGE_SLOT_Normal, IMAGE_SLOT_ORM };
+
+/** What a file texture node resolved to, reused by the materials sharing
+ * the node */
+struct ResolvedFileTexture {
+    MString imageFilePath;
+    GLTF::Sampler *glSampler = nullptr;
+    GLTF::Texture *glTexture = nullptr;
+};
+
 /** The ExportableTexture just creates textures and samples in the resources, it
  * does not own them! */
 class ExportableTexture {
@@ -11,11 +23,11 @@ class ExportableTexture {
   public:
     static std::unique_ptr<ExportableTexture>
     tryCreate(ExportableResources &resources, const MObject &obj,
-              const char *attributeName);
+              const char *attributeName, ImageSlot slot);
 
     static GLTF::Texture *tryLoad(ExportableResources &resources,
                                   const MObject &obj,
-                                  const char *attributeName);
+                                  const char *attributeName, ImageSlot slot);
 
     virtual ~ExportableTexture();
 
@@ -26,7 +38,8 @@ class ExportableTexture {
     MString imageFilePath;
 
     ExportableTexture(Private, ExportableResources &resources,
-                      const MObject &obj, const char *attributeName);
+                      const MObject &obj, const char *attributeName,
+                      ImageSlot slot);
 
   private:
     ExportableTexture() = default;
@@ -3,8 +3,12 @@
 #include "Arguments.h"
 #include "ExportableAsset.h"
 #include "Exporter.h"
+#include "KernelRecording.h"
+#include "LiveLink.h"
 #include "MayaException.h"
+#include "MeshArena.h"
 #include "OutputWindow.h"
+#include "Profiler.h"
 
 Exporter::Exporter() = default;
 
@@ -79,22 +83,315 @@ bool Exporter::isUndoable() const { return false; }
 
 bool Exporter::hasSyntax() const { return true; }
 
+/** Records the inputs of the kernels while in scope, see -recordKernelInputs */
+struct KernelRecordingScope {
+    explicit KernelRecordingScope(const Arguments &args) {
+        if (args.recordKernelInputs.length() == 0)
+            return;
+
+        const fs::path recordingPath(args.recordKernelInputs.asChar());
+        KernelRecording::start(recordingPath.is_relative() ? fs::path(args.outputFolder.asChar()) / recordingPath : recordingPath);
+    }
+
+    ~KernelRecordingScope() { KernelRecording::stop(); }
+};
+
+/** Frees the blocks of the mesh arena after the export, see MeshArena */
+struct MeshArenaRelease {
+    ~MeshArenaRelease() { MeshArena::current().release(); }
+};
+
+/** Rounds to the grids of the arguments while in scope, see RoundingGrids */
+struct RoundingScope {
+    explicit RoundingScope(const Arguments &args) { currentRoundingGrids() = args.rounding; }
+    ~RoundingScope() { currentRoundingGrids() = RoundingGrids(); }
+};
+
+/** Writes the profile report when done, see -profileReport */
+struct ProfilerScope {
+    fs::path reportPath;
+
+    explicit ProfilerScope(const Arguments &args) {
+        if (args.profileReport.length() == 0)
+            return;
+
+        const fs::path path(args.profileReport.asChar());
+        reportPath = path.is_relative() ? fs::path(args.outputFolder.asChar()) / path : path;
+
+        Profiler::start();
+    }
+
+    // Also reports the phases that ran when the export failed, to see where it failed.
+    ~ProfilerScope() {
+        if (reportPath.empty())
+            return;
+
+        try {
+            Profiler::stop(reportPath);
+        } catch (const std::exception &ex) {
+            MayaException::printError(ex.what());
+        }
+    }
+};
+
+/** The export of an asset, a step at a time, see ExportableAsset::exportNextStep */
+class AssetExport {
+  public:
+    explicit AssetExport(const Arguments &args)
+        : m_roundingScope(args), m_kernelRecordingScope(args), m_profilerScope(args),
+          m_asset(std::make_unique<ExportableAsset>(args)) {}
+
+    /** Returns false when the asset is saved */
+    bool exportNextStep() {
+        if (!m_asset->exportNextStep()) {
+            m_asset->save();
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    const RoundingScope m_roundingScope;
+    const KernelRecordingScope m_kernelRecordingScope;
+    const MeshArenaRelease m_meshArenaRelease;
+    const ProfilerScope m_profilerScope;
+    const std::unique_ptr<ExportableAsset> m_asset;
+};
+
+// How often the timer of an -async export runs, in seconds.
+const float asyncPollSeconds = 0.01f;
+
+// How long an -async export runs steps before Maya gets to handle its events.
+const auto asyncStepBudget = std::chrono::milliseconds(50);
+
+/**
+ * The -async export. The timer runs the steps of the export on the main
+ * thread, as the Maya API requires, until the time budget is spent, and
+ * then returns to Maya, so it can redraw and handle the progress window.
+ * Between the steps, the user can edit the scene, which invalidates the
+ * exported nodes, so the export is aborted when the DAG changes, when a
+ * node is deleted, or when another scene is opened.
+ */
+class AsyncExport {
+  public:
+    static void start(const MArgList &args, const MSyntax &syntax, std::unique_ptr<const Arguments> arguments) {
+        session.reset(new AsyncExport(args, syntax, std::move(arguments)));
+    }
+
+    static bool isRunning() { return session != nullptr; }
+
+    /** Ends the session without calling the callback */
+    static void stop() { session.reset(); }
+
+    ~AsyncExport() {
+        if (m_hasTimerCallback) {
+            MMessage::removeCallback(m_timerCallback);
+        }
+
+        unwatch();
+    }
+
+  private:
+    AsyncExport(const MArgList &args, const MSyntax &syntax, std::unique_ptr<const Arguments> arguments)
+        : m_args(args), m_syntax(syntax), m_arguments(std::move(arguments)) {
+        if (m_arguments->clearOutputWindow) {
+            OutputWindow().clear();
+        }
+
+        std::cout << prefix << "Starting asynchronous export..." << endl;
+        m_export = std::make_unique<AssetExport>(*m_arguments);
+
+        try {
+            watch();
+
+            MStatus status;
+            m_timerCallback = MTimerMessage::addTimerCallback(asyncPollSeconds, onTimer, this, &status);
+            THROW_ON_FAILURE(status);
+            m_hasTimerCallback = true;
+        } catch (...) {
+            unwatch();
+            throw;
+        }
+    }
+
+    DISALLOW_COPY_MOVE_ASSIGN(AsyncExport);
+
+    static std::unique_ptr<AsyncExport> session;
+
+    const MArgList m_args;
+    const MSyntax m_syntax;
+    const std::unique_ptr<const Arguments> m_arguments;
+    std::unique_ptr<AssetExport> m_export;
+
+    MCallbackId m_timerCallback = 0;
+    bool m_hasTimerCallback = false;
+
+    // The callbacks of the scene changes that abort the export.
+    MCallbackIdArray m_sceneCallbacks;
+
+    // The steps change the scene themselves, e.g. the temporary meshes.
+    bool m_isRunningSteps = false;
+    bool m_isSceneChanged = false;
+
+    void watch() {
+        MStatus status;
+
+        const auto add = [this, &status](const MCallbackId callbackId) {
+            THROW_ON_FAILURE(status);
+            m_sceneCallbacks.append(callbackId);
+        };
+
+        for (auto message : {MSceneMessage::kBeforeNew, MSceneMessage::kBeforeOpen, MSceneMessage::kBeforeImport,
+                             MSceneMessage::kBeforeCreateReference, MSceneMessage::kBeforeRemoveReference,
+                             MSceneMessage::kBeforeLoadReference, MSceneMessage::kBeforeUnloadReference}) {
+            add(MSceneMessage::addCallback(message, onSceneReplaced, this, &status));
+        }
+
+        add(MDagMessage::addAllDagChangesCallback(onDagChanged, this, &status));
+        add(MDGMessage::addNodeRemovedCallback(onNodeRemoved, "dependNode", this, &status));
+    }
+
+    void unwatch() {
+        if (m_sceneCallbacks.length() > 0) {
+            MMessage::removeCallbacks(m_sceneCallbacks);
+            m_sceneCallbacks.clear();
+        }
+    }
+
+    /** The scene is replaced before the next step, abort right away */
+    static void onSceneReplaced(void *clientData) {
+        auto &self = *static_cast<AsyncExport *>(clientData);
+        MayaException::printError("The asynchronous export was aborted, the scene was replaced");
+        self.finish(false);
+    }
+
+    static void onDagChanged(MDagMessage::DagMessage, MDagPath &, MDagPath &, void *clientData) {
+        static_cast<AsyncExport *>(clientData)->onSceneChanged();
+    }
+
+    static void onNodeRemoved(MObject &, void *clientData) {
+        static_cast<AsyncExport *>(clientData)->onSceneChanged();
+    }
+
+    /** Aborts the export at the next timer event, the change is still being
+     * made */
+    void onSceneChanged() {
+        if (!m_isRunningSteps) {
+            m_isSceneChanged = true;
+        }
+    }
+
+    static void onTimer(float, float, void *clientData) {
+        auto &self = *static_cast<AsyncExport *>(clientData);
+
+        if (self.m_isSceneChanged) {
+            MayaException::printError("The asynchronous export was aborted, the scene changed");
+            self.finish(false);
+            return;
+        }
+
+        bool isDone = false;
+        bool hasSucceeded = false;
+
+        try {
+            const auto stepEnd = std::chrono::steady_clock::now() + asyncStepBudget;
+
+            self.m_isRunningSteps = true;
+            do {
+                isDone = !self.m_export->exportNextStep();
+            } while (!isDone && std::chrono::steady_clock::now() < stepEnd);
+
+            hasSucceeded = isDone;
+        } catch (const MayaException &ex) {
+            MayaException::printError(ex.what(), ex.status);
+            isDone = true;
+        } catch (const std::exception &ex) {
+            MayaException::printError(ex.what());
+            isDone = true;
+        } catch (...) {
+            MayaException::printError("Unexpected fatal error!");
+            isDone = true;
+        }
+
+        self.m_isRunningSteps = false;
+
+        if (isDone) {
+            self.finish(hasSucceeded);
+        }
+    }
+
+    /** Restores the scene, calls the callback, and ends the session */
+    void finish(const bool hasSucceeded) {
+        // Restoring the scene deletes the temporary nodes.
+        unwatch();
+
+        // This closes the progress window and restores the current time.
+        m_export.reset();
+
+        if (hasSucceeded) {
+            std::cout << prefix << "Finished export :-)" << endl;
+            std::cout << "---------------------------------------------------------"
+                         "-----------------------"
+                      << endl;
+
+            if (m_arguments->liveLinkPort) {
+                try {
+                    LiveLink::start(m_args, m_syntax, *m_arguments);
+                } catch (const std::exception &ex) {
+                    MayaException::printError(ex.what());
+                }
+            }
+        }
+
+        if (m_arguments->asyncCallback.length()) {
+            MGlobal::executeCommandOnIdle(m_arguments->asyncCallback + (hasSucceeded ? " 1" : " 0"));
+        }
+
+        // Destroys this, which also removes the timer callback.
+        session.reset();
+    }
+};
+
+std::unique_ptr<AsyncExport> AsyncExport::session;
+
+bool Exporter::isExportRunning() { return AsyncExport::isRunning(); }
+
+void Exporter::stopExport() { AsyncExport::stop(); }
+
 void Exporter::exportScene(const Arguments &args) {
-    ExportableAsset exportableAsset(args);
-    exportableAsset.save();
+    AssetExport assetExport(args);
+    while (assetExport.exportNextStep()) {
+    }
 }
 
 MStatus Exporter::run(const MArgList &args) const {
     try {
+        if (Arguments::isLiveLinkStop(args, syntax())) {
+            LiveLink::stop();
+            return MStatus::kSuccess;
+        }
+
+        if (isExportRunning())
+            throw std::runtime_error("An asynchronous export is still running, wait until it is done");
+
         std::cout << prefix << "Parsing arguments..." << endl;
-        const Arguments arguments(args, syntax());
+        auto arguments = std::make_unique<const Arguments>(args, syntax());
+
+        if (arguments->async) {
+            AsyncExport::start(args, syntax(), std::move(arguments));
+            return MStatus::kSuccess;
+        }
 
-        if (arguments.clearOutputWindow) {
+        if (arguments->clearOutputWindow) {
             OutputWindow().clear();
         }
 
         std::cout << prefix << "Starting export..." << endl;
-        exportScene(arguments);
+        exportScene(*arguments);
+
+        if (arguments->liveLinkPort) {
+            LiveLink::start(args, syntax(), *arguments);
+        }
 
         std::cout << prefix << "Finished export :-)" << endl;
         std::cout << "---------------------------------------------------------"
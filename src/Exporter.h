@@ -18,6 +18,12 @@ class Exporter : public MPxCommand {
 
     static void exportScene(const Arguments &args);
 
+    /** Whether an -async export is running */
+    static bool isExportRunning();
+
+    /** Stops the -async export, if any, without saving it */
+    static void stopExport();
+
   private:
     DISALLOW_COPY_MOVE_ASSIGN(Exporter);
     MStatus run(const MArgList &args) const;
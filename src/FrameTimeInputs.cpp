@@ -0,0 +1,23 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "FrameTimeInputs.h"
+#include "accessors.h"
+
+FrameTimeInputs::FrameTimeInputs(const Arguments &args) : m_args(args) {}
+
+FrameTimeInputs::~FrameTimeInputs() = default;
+
+GLTF::Accessor *FrameTimeInputs::input(const std::vector<float> &times) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto &accessor = m_inputs[times];
+
+    if (!accessor) {
+        // The accessor is shared by the clips, so it is named by its times only.
+        accessor = contiguousChannelAccessor(m_args.makeName("anim/times" + std::to_string(times.size())), times, 1);
+        requireBounds(accessor.get());
+    }
+
+    return accessor.get();
+}
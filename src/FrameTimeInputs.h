@@ -0,0 +1,32 @@
+#pragma once
+
+#include "macros.h"
+
+class Arguments;
+
+/**
+ * The input accessors of the animation samplers of all clips. Clips with the
+ * same frame count and frame rate have the same frame times, and the times
+ * of the reduced keys of many channels are the same too, so each distinct
+ * array of times gets a single accessor, shared by all clips and channels.
+ *
+ * Besides the smaller buffers, a runtime that caches its samplers per input
+ * accessor shares these between the clips.
+ */
+class FrameTimeInputs {
+  public:
+    FrameTimeInputs(const Arguments &args);
+    ~FrameTimeInputs();
+
+    /** The accessor of the clip-relative times in seconds. Thread-safe, the
+     * channels get their inputs while these are finished in parallel. */
+    GLTF::Accessor *input(const std::vector<float> &times);
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(FrameTimeInputs);
+
+    const Arguments &m_args;
+
+    std::mutex m_mutex;
+    std::map<std::vector<float>, std::unique_ptr<GLTF::Accessor>> m_inputs;
+};
@@ -0,0 +1,31 @@
+#include "externals.h"
+
+#include "GLTFObjectPool.h"
+
+// Smaller data blocks share blocks of this size, larger ones get their own.
+const size_t sharedBlockByteLength = 1 << 20;
+const size_t maxSharedByteLength = sharedBlockByteLength / 4;
+
+const size_t blockAlignment = 16;
+
+GLTFObjectPool::GLTFObjectPool() = default;
+
+GLTFObjectPool::~GLTFObjectPool() = default;
+
+byte *GLTFObjectPool::allocateBytes(const size_t byteLength) {
+    if (byteLength > maxSharedByteLength) {
+        m_largeBlocks.emplace_back(new byte[byteLength]());
+        return m_largeBlocks.back().get();
+    }
+
+    const auto alignedLength = (byteLength + blockAlignment - 1) & ~(blockAlignment - 1);
+
+    if (m_sharedBlocks.empty() || m_sharedBlockOffset + alignedLength > sharedBlockByteLength) {
+        m_sharedBlocks.emplace_back(new byte[sharedBlockByteLength]());
+        m_sharedBlockOffset = 0;
+    }
+
+    auto *data = m_sharedBlocks.back().get() + m_sharedBlockOffset;
+    m_sharedBlockOffset += alignedLength;
+    return data;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+
+/**
+ * Owns the GLTF buffers, buffer views and data blocks that are created
+ * while packing an asset, see ExportableResources::objectPool.
+ *
+ * The objects are stored in chunks rather than allocated one by one, and
+ * the small data blocks share larger blocks, so an asset with many buffer
+ * views is built and torn down with few allocations. Everything is freed at
+ * once with the pool, when the asset is destroyed. Not thread-safe.
+ */
+class GLTFObjectPool {
+  public:
+    GLTFObjectPool();
+    ~GLTFObjectPool();
+
+    template <typename... Args> GLTF::Buffer *createBuffer(Args &&... args) {
+        return &m_buffers.emplace_back(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args> GLTF::BufferView *createBufferView(Args &&... args) {
+        return &m_bufferViews.emplace_back(std::forward<Args>(args)...);
+    }
+
+    /** Zero-initialized bytes, aligned to 16 bytes */
+    byte *allocateBytes(size_t byteLength);
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(GLTFObjectPool);
+
+    std::deque<GLTF::Buffer> m_buffers;
+    std::deque<GLTF::BufferView> m_bufferViews;
+
+    std::vector<std::unique_ptr<byte[]>> m_sharedBlocks;
+    size_t m_sharedBlockOffset = 0;
+    std::vector<std::unique_ptr<byte[]>> m_largeBlocks;
+};
@@ -0,0 +1,69 @@
+#include "externals.h"
+
+#include "HeldMemory.h"
+
+static const size_t memoryKindCount = static_cast<size_t>(MemoryKind::COUNT);
+
+static std::atomic<size_t> currentBytesPerKind[memoryKindCount];
+static std::atomic<size_t> peakBytesPerKind[memoryKindCount];
+static std::atomic<size_t> currentTotal{0};
+static std::atomic<size_t> peakTotal{0};
+
+static void raisePeak(std::atomic<size_t> &peak, const size_t value) {
+    auto previous = peak.load(std::memory_order_relaxed);
+    while (previous < value && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+void HeldMemory::set(const size_t byteCount) {
+    if (byteCount == m_byteCount)
+        return;
+
+    const auto index = static_cast<size_t>(m_kind);
+
+    if (byteCount > m_byteCount) {
+        const auto delta = byteCount - m_byteCount;
+        raisePeak(peakBytesPerKind[index], currentBytesPerKind[index].fetch_add(delta, std::memory_order_relaxed) + delta);
+        raisePeak(peakTotal, currentTotal.fetch_add(delta, std::memory_order_relaxed) + delta);
+    } else {
+        const auto delta = m_byteCount - byteCount;
+        currentBytesPerKind[index].fetch_sub(delta, std::memory_order_relaxed);
+        currentTotal.fetch_sub(delta, std::memory_order_relaxed);
+    }
+
+    m_byteCount = byteCount;
+}
+
+const char *HeldMemory::kindName(const MemoryKind kind) {
+    switch (kind) {
+    case MemoryKind::MESH_INDICES:
+        return "Mesh indices";
+    case MemoryKind::MESH_VERTICES:
+        return "Mesh vertices";
+    case MemoryKind::MESH_ARENA:
+        return "Mesh extraction arena";
+    case MemoryKind::WELDED_VERTICES:
+        return "Welded vertex buffers";
+    case MemoryKind::PRIMITIVE_ACCESSORS:
+        return "Primitive accessors";
+    case MemoryKind::PACKED_BUFFERS:
+        return "Packed buffers";
+    default:
+        return "Unknown";
+    }
+}
+
+size_t HeldMemory::currentBytes(const MemoryKind kind) { return currentBytesPerKind[static_cast<size_t>(kind)]; }
+
+size_t HeldMemory::peakBytes(const MemoryKind kind) { return peakBytesPerKind[static_cast<size_t>(kind)]; }
+
+size_t HeldMemory::peakTotalBytes() { return peakTotal; }
+
+size_t HeldMemory::currentTotalBytes() { return currentTotal; }
+
+void HeldMemory::resetPeaks() {
+    for (size_t index = 0; index < memoryKindCount; ++index) {
+        peakBytesPerKind[index] = currentBytesPerKind[index].load();
+    }
+    peakTotal = currentTotal.load();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "macros.h"
+
+/** The major containers of an export, whose bytes are accounted */
+enum class MemoryKind {
+    MESH_INDICES,
+    MESH_VERTICES,
+    MESH_ARENA,
+    WELDED_VERTICES,
+    PRIMITIVE_ACCESSORS,
+    PACKED_BUFFERS,
+    COUNT
+};
+
+/**
+ * Accounts the bytes held by a container while it is alive. The current and
+ * peak bytes per kind are summed over all threads, and reported by the
+ * Profiler. The peaks are reset when the profiler starts.
+ */
+class HeldMemory {
+  public:
+    explicit HeldMemory(const MemoryKind kind) : m_kind(kind) {}
+    ~HeldMemory() { set(0); }
+
+    /** Replaces the bytes held */
+    void set(size_t byteCount);
+
+    void add(const size_t byteCount) { set(m_byteCount + byteCount); }
+
+    size_t byteCount() const { return m_byteCount; }
+
+    static const char *kindName(MemoryKind kind);
+
+    /** The bytes held of a kind now */
+    static size_t currentBytes(MemoryKind kind);
+
+    /** The most bytes held of a kind at once, since the last reset */
+    static size_t peakBytes(MemoryKind kind);
+
+    /** The most bytes held of all kinds at once, since the last reset */
+    static size_t peakTotalBytes();
+
+    static size_t currentTotalBytes();
+
+    static void resetPeaks();
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(HeldMemory);
+
+    const MemoryKind m_kind;
+    size_t m_byteCount = 0;
+};
+
+template <typename T> size_t heldBytes(const std::vector<T> &vector) { return vector.capacity() * sizeof(T); }
+
+template <typename K, typename T> size_t heldBytes(const std::map<K, std::vector<T>> &vectors) {
+    size_t byteCount = 0;
+    for (auto &&pair : vectors) {
+        byteCount += heldBytes(pair.second);
+    }
+    return byteCount;
+}
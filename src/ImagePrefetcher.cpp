@@ -0,0 +1,102 @@
+#include "externals.h"
+
+#include "DagHelper.h"
+#include "DagPathKey.h"
+#include "ImagePrefetcher.h"
+#include "MayaException.h"
+
+// The size of the chunks the files are read in.
+const size_t prefetchChunkByteLength = 1 << 20;
+
+ImagePrefetcher::ImagePrefetcher(const size_t threadCount) : m_readers(threadCount) {}
+
+ImagePrefetcher::~ImagePrefetcher() = default;
+
+std::string ImagePrefetcher::key(const fs::path &path) {
+    // Same as the image paths of ExportableResources are compared.
+    std::string key(path.generic_string());
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    return key;
+}
+
+void ImagePrefetcher::prefetchFileTextures(const Selection &meshShapes) {
+    MStatus status;
+
+    // The shading groups of all instances, each visited once.
+    std::unordered_set<MObjectHandle, MObjectHandleHasher> shadingGroups;
+
+    for (auto &&dagPath : meshShapes) {
+        MFnMesh fnMesh(dagPath, &status);
+        THROW_ON_FAILURE(status);
+
+        MObjectArray shaders;
+        MIntArray indices;
+        THROW_ON_FAILURE(fnMesh.getConnectedShaders(dagPath.instanceNumber(), shaders, indices));
+
+        for (unsigned i = 0; i < shaders.length(); ++i) {
+            shadingGroups.emplace(shaders[i]);
+        }
+    }
+
+    const auto readCount = m_readsPerPath.size();
+
+    // Only the shaders of a shading group are searched, the members and
+    // their history have no textures to export.
+    for (auto &&shadingGroup : shadingGroups) {
+        const MFnDependencyNode fnShadingGroup(shadingGroup.object());
+
+        for (auto plugName : {"surfaceShader", "volumeShader", "displacementShader"}) {
+            const auto plug = fnShadingGroup.findPlug(plugName, true, &status);
+            if (!status || !plug.isConnected())
+                continue;
+
+            MItDependencyGraph dgIt(plug, MFn::kFileTexture, MItDependencyGraph::kUpstream,
+                                    MItDependencyGraph::kDepthFirst, MItDependencyGraph::kNodeLevel, &status);
+            THROW_ON_FAILURE(status);
+
+            dgIt.disablePruningOnFilter();
+
+            for (; !dgIt.isDone(); dgIt.next()) {
+                prefetch(dgIt.currentItem());
+            }
+        }
+    }
+
+    if (const auto fileCount = m_readsPerPath.size() - readCount) {
+        cout << prefix << "Reading " << fileCount << " texture files in the background" << endl;
+    }
+}
+
+void ImagePrefetcher::prefetch(const MObject &fileTexture) {
+    MString imageFilePath;
+    if (!DagHelper::getPlugValue(fileTexture, "fileTextureName", imageFilePath))
+        return;
+
+    const fs::path path(imageFilePath.asChar());
+
+    std::error_code error;
+    if (imageFilePath.length() == 0 || !exists(path, error))
+        return;
+
+    auto &read = m_readsPerPath[key(path)];
+    if (read.valid())
+        return;
+
+    // The job must be copyable, the task isn't.
+    const auto task = std::make_shared<std::packaged_task<void()>>([path]() {
+        std::ifstream file(path.string(), ios::in | ios::binary);
+        std::vector<char> chunk(prefetchChunkByteLength);
+        while (file.read(chunk.data(), chunk.size())) {
+        }
+    });
+
+    read = task->get_future().share();
+    m_readers.submit([task]() { (*task)(); });
+}
+
+void ImagePrefetcher::wait(const fs::path &path) {
+    const auto it = m_readsPerPath.find(key(path));
+    if (it != m_readsPerPath.end()) {
+        it->second.wait();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "AsyncFileWriter.h"
+#include "filesystem.h"
+#include "macros.h"
+
+class Selection;
+
+/**
+ * Reads the image files of the file textures of the exported meshes on
+ * worker threads,
+ * while the meshes are extracted, so loading an image on the main thread
+ * mostly copies from the file system cache instead of waiting for the disk
+ * or the network.
+ *
+ * The images are still loaded and converted on the main thread: the
+ * conversion uses the Maya API, and GLTF::Image::load is not thread-safe.
+ */
+class ImagePrefetcher {
+  public:
+    explicit ImagePrefetcher(size_t threadCount);
+    ~ImagePrefetcher();
+
+    /** Queues reading the image files of the file texture nodes upstream of
+     * the shading groups of the meshes */
+    void prefetchFileTextures(const Selection &meshShapes);
+
+    /** Waits until the file is read, when it was queued */
+    void wait(const fs::path &path);
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ImagePrefetcher);
+
+    // The worker pool of the file writer runs the reads just as well.
+    AsyncFileWriter m_readers;
+
+    std::map<std::string, std::shared_future<void>> m_readsPerPath;
+
+    void prefetch(const MObject &fileTexture);
+
+    static std::string key(const fs::path &path);
+};
@@ -10,25 +10,56 @@ ostream &prefix(ostream &stream) {
     return stream;
 }
 
-IndentationBuffer::IndentationBuffer(std::streambuf *sbuf)
-    : m_streamBuffer(sbuf), m_indentationLevel(0), m_shouldIndent(true) {}
+// The text is passed on in blocks of this size.
+const size_t indentationBufferSize = 64 * 1024;
+
+IndentationBuffer::IndentationBuffer(std::streambuf *sbuf, const bool isBinary)
+    : m_streamBuffer(sbuf), m_indentationLevel(0), m_shouldIndent(true),
+      m_isBinary(isBinary), m_buffer(indentationBufferSize) {
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+
+    if (m_isBinary) {
+        m_streamBuffer->sputn(dumps::fileMagic, sizeof(dumps::fileMagic));
+    }
+}
+
+IndentationBuffer::~IndentationBuffer() { flush(); }
+
+void IndentationBuffer::flush() {
+    const auto length = static_cast<size_t>(pptr() - pbase());
+    if (length == 0)
+        return;
+
+    m_indented.clear();
+    dumps::appendIndented(m_indented, pbase(), length, m_indentationLevel,
+                          m_shouldIndent);
+
+    if (m_isBinary) {
+        dumps::writeRecord(*m_streamBuffer, dumps::RecordKind::TEXT,
+                           m_indented.data(), m_indented.size());
+    } else {
+        m_streamBuffer->sputn(m_indented.data(), m_indented.size());
+    }
+
+    setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
 
 std::basic_streambuf<char>::int_type
 IndentationBuffer::overflow(const int_type c) {
-    if (traits_type::eq_int_type(c, traits_type::eof()))
-        return m_streamBuffer->sputc(c);
+    flush();
 
-    if (m_shouldIndent) {
-        fill_n(std::ostreambuf_iterator<char>(m_streamBuffer),
-               m_indentationLevel, '\t');
-        m_shouldIndent = false;
-    }
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
 
-    if (traits_type::eq_int_type(m_streamBuffer->sputc(c), traits_type::eof()))
-        return traits_type::eof();
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
 
-    if (traits_type::eq_int_type(c, traits_type::to_char_type('\n')))
-        m_shouldIndent = true;
+int IndentationBuffer::sync() {
+    if (!m_isBinary) {
+        flush();
+    }
 
-    return traits_type::not_eof(c);
+    return 0;
 }
@@ -2,6 +2,8 @@
 
 #include "externals.h"
 
+#include "dumpRecords.h"
+
 /** Prints the common prefix ("maya2glTF@<time>: ") */
 ostream &prefix(ostream &stream);
 
@@ -20,29 +22,93 @@ class JsonSeparator {
     const char *m_current;
 };
 
+/**
+ * Indents the lines written to the stream buffer. The text is buffered, and
+ * indented and passed on in blocks, so writing a character is cheap.
+ *
+ * A binary buffer writes dumps::RecordKind::TEXT records of the text, and
+ * the tables as raw values, see dumpRecords.h.
+ */
 class IndentationBuffer : public std::streambuf {
   public:
-    IndentationBuffer(std::streambuf *sbuf);
+    IndentationBuffer(std::streambuf *sbuf, bool isBinary = false);
+    ~IndentationBuffer() override;
 
     int indentationLevel() const { return m_indentationLevel; }
 
-    void indent() { ++m_indentationLevel; }
+    void indent() {
+        flush();
+        ++m_indentationLevel;
+    }
+
+    void undent() {
+        flush();
+        m_indentationLevel = std::max(0, m_indentationLevel - 1);
+    }
+
+    bool isBinary() const { return m_isBinary; }
 
-    void undent() { m_indentationLevel = std::max(0, m_indentationLevel - 1); }
+    /** Writes the table like dumps::formatTable, as a record when binary */
+    template <typename T>
+    void writeTable(const std::string &name, const T *values, size_t count,
+                    size_t itemsPerLine, int precision);
+
+    /** Indents and passes on the buffered text */
+    void flush();
 
   protected:
-    int_type overflow(const int_type c) override;
+    int_type overflow(int_type c) override;
+
+    // Doesn't flush the stream buffer for every endl. A binary buffer only
+    // writes the text when the buffer is full, so not a record per line.
+    int sync() override;
 
     std::streambuf *m_streamBuffer;
     int m_indentationLevel;
     bool m_shouldIndent;
+    const bool m_isBinary;
+
+    std::vector<char> m_buffer;
+    std::string m_indented;
 };
 
+template <typename T>
+void IndentationBuffer::writeTable(const std::string &name, const T *values,
+                                   const size_t count,
+                                   const size_t itemsPerLine,
+                                   const int precision) {
+    flush();
+
+    if (m_isBinary) {
+        dumps::TableHeader header{};
+        header.itemsPerLine = static_cast<uint32_t>(itemsPerLine);
+        header.precision = static_cast<uint32_t>(precision);
+        header.indentationLevel = static_cast<uint32_t>(m_indentationLevel);
+        header.startsLine = m_shouldIndent;
+        dumps::writeTableRecord(*m_streamBuffer, header, name, values, count);
+
+        // The table ends with a bracket.
+        m_shouldIndent = false;
+        return;
+    }
+
+    std::string text;
+    dumps::formatTable(text, name, values, count, itemsPerLine, precision);
+
+    m_indented.clear();
+    dumps::appendIndented(m_indented, text.data(), text.size(),
+                          m_indentationLevel, m_shouldIndent);
+    m_streamBuffer->sputn(m_indented.data(), m_indented.size());
+}
+
 class IndentableStream : public ostream {
   public:
-    explicit IndentableStream(ostream &os)
-        : ostream(&m_indentationBuffer), m_indentationBuffer(os.rdbuf()),
-          m_itemsPerLine(1) {}
+    explicit IndentableStream(ostream &os, const bool isBinary = false)
+        : ostream(&m_indentationBuffer),
+          m_indentationBuffer(os.rdbuf(), isBinary), m_itemsPerLine(1),
+          m_itemsPrecision(3) {}
+
+    ~IndentableStream() override { m_indentationBuffer.flush(); }
 
     IndentableStream &indent() {
         m_indentationBuffer.indent();
@@ -67,6 +133,16 @@ class IndentableStream : public ostream {
 
     size_t itemsPrecision() const { return m_itemsPrecision; }
 
+    /** Writes the table much faster than the stream formatting, see
+     * dumps::formatTable */
+    template <typename T>
+    void writeTable(const std::string &name, const T *values,
+                    const size_t count, const size_t itemsPerLine,
+                    const int precision) {
+        m_indentationBuffer.writeTable(name, values, count, itemsPerLine,
+                                       precision);
+    }
+
   private:
     IndentationBuffer m_indentationBuffer;
     size_t m_itemsPerLine;
@@ -0,0 +1,25 @@
+#include "externals.h"
+
+#include "InterleavedAttributes.h"
+
+InterleavedAttributes::InterleavedAttributes() = default;
+
+InterleavedAttributes::~InterleavedAttributes() = default;
+
+void InterleavedAttributes::addGroup(const std::vector<GLTF::Accessor *> &accessors) {
+    // A single accessor is packed as usual.
+    if (accessors.size() < 2)
+        return;
+
+    for (auto accessor : accessors) {
+        assert(accessor->count == accessors.front()->count);
+        m_groupIndices[accessor] = m_groupCount;
+    }
+
+    ++m_groupCount;
+}
+
+int InterleavedAttributes::groupIndex(const GLTF::Accessor *accessor) const {
+    const auto it = m_groupIndices.find(accessor);
+    return it == m_groupIndices.end() ? -1 : it->second;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+
+/**
+ * Keeps track of the vertex attribute accessors that share an interleaved
+ * buffer view. The accessor packer writes each group into its own buffer
+ * view, with the elements of each vertex next to each other.
+ */
+class InterleavedAttributes {
+  public:
+    InterleavedAttributes();
+    ~InterleavedAttributes();
+
+    /** The accessors must have the same count */
+    void addGroup(const std::vector<GLTF::Accessor *> &accessors);
+
+    /** The index of the group holding the accessor, or -1 */
+    int groupIndex(const GLTF::Accessor *accessor) const;
+
+    bool empty() const { return m_groupIndices.empty(); }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(InterleavedAttributes);
+
+    std::map<const GLTF::Accessor *, int> m_groupIndices;
+    int m_groupCount = 0;
+};
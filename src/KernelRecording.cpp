@@ -0,0 +1,49 @@
+#include "externals.h"
+
+#include "KernelRecording.h"
+#include "MayaException.h"
+
+std::atomic<bool> KernelRecording::s_isRecording{false};
+
+static std::mutex recordMutex;
+static std::ofstream recordStream;
+static size_t recordCount = 0;
+
+void KernelRecording::start(const fs::path &path) {
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    recordStream.open(path.string(), ios::out | ios::trunc | ios::binary);
+    if (!recordStream) {
+        MayaException::printWarning(formatted("Failed to create the kernel recording '%s'", path.string().c_str()));
+        return;
+    }
+
+    recordCount = 0;
+    s_isRecording = true;
+}
+
+void KernelRecording::stop() {
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    if (!s_isRecording)
+        return;
+
+    s_isRecording = false;
+    recordStream.close();
+
+    if (!recordStream) {
+        MayaException::printWarning("Failed to write the kernel recording");
+        return;
+    }
+
+    cout << prefix << "Recorded " << recordCount << " kernel inputs" << endl;
+}
+
+void KernelRecording::record(const kernels::RecordKind kind, const uint32_t parameter, const void *data, const size_t byteLength) {
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    if (s_isRecording) {
+        kernels::writeRecord(recordStream, kind, parameter, data, byteLength);
+        ++recordCount;
+    }
+}
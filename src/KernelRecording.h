@@ -0,0 +1,26 @@
+#pragma once
+
+#include "filesystem.h"
+#include "kernels.h"
+
+/**
+ * Records the inputs of the Maya independent kernels during an export, see
+ * -recordKernelInputs, so tools/KernelBenchmark can replay these on real
+ * data without Maya.
+ */
+class KernelRecording {
+  public:
+    /** Starts recording to the file, replacing it */
+    static void start(const fs::path &path);
+
+    static bool isRecording() { return s_isRecording; }
+
+    /** Stops recording, and closes the file */
+    static void stop();
+
+    /** Thread-safe, appends a record with the given bytes */
+    static void record(kernels::RecordKind kind, uint32_t parameter, const void *data, size_t byteLength);
+
+  private:
+    static std::atomic<bool> s_isRecording;
+};
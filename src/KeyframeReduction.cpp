@@ -0,0 +1,309 @@
+#include "externals.h"
+
+#include "KeyframeReduction.h"
+
+static void slerp(const float *q0, const float *q1, const double t, double *result) {
+    double cosAngle = 0;
+    for (int i = 0; i < 4; ++i) {
+        cosAngle += double(q0[i]) * q1[i];
+    }
+
+    // Same as glTF viewers: take the shortest path.
+    const double sign = cosAngle < 0 ? -1 : 1;
+    cosAngle = std::abs(cosAngle);
+
+    double w0 = 1 - t;
+    double w1 = t;
+
+    // Nearly identical quaternions are interpolated linearly.
+    if (cosAngle < 1 - 1e-6) {
+        const auto angle = std::acos(std::min(1.0, cosAngle));
+        const auto sinAngle = std::sin(angle);
+        w0 = std::sin((1 - t) * angle) / sinAngle;
+        w1 = std::sin(t * angle) / sinAngle;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        result[i] = w0 * q0[i] + w1 * sign * q1[i];
+    }
+}
+
+/** The largest difference of a component between the frames of the segment
+ * and the interpolation of its end keys */
+static double maxSegmentError(const gsl::span<const float> &values, const size_t dimension, const bool isQuaternion,
+                              const int first, const int last, int &maxErrorFrame) {
+    const auto *v0 = &values[first * dimension];
+    const auto *v1 = &values[last * dimension];
+
+    double interpolated[4];
+    double maxError = -1;
+
+    for (int frame = first + 1; frame < last; ++frame) {
+        const double t = double(frame - first) / (last - first);
+        const auto *v = &values[frame * dimension];
+
+        double error = 0;
+
+        if (isQuaternion) {
+            slerp(v0, v1, t, interpolated);
+
+            // q and -q are the same rotation.
+            double ep = 0;
+            double en = 0;
+            for (int i = 0; i < 4; ++i) {
+                ep = std::max(ep, std::abs(interpolated[i] - v[i]));
+                en = std::max(en, std::abs(interpolated[i] + v[i]));
+            }
+            error = std::min(ep, en);
+        } else {
+            for (size_t i = 0; i < dimension; ++i) {
+                const auto lerp = (1 - t) * v0[i] + t * v1[i];
+                error = std::max(error, std::abs(lerp - v[i]));
+            }
+        }
+
+        if (error > maxError) {
+            maxError = error;
+            maxErrorFrame = frame;
+        }
+    }
+
+    return maxError;
+}
+
+std::vector<int> reduceKeyframes(const gsl::span<const float> &values, const size_t dimension, const bool isQuaternion,
+                                 const double tolerance) {
+    assert(!isQuaternion || dimension == 4);
+
+    const auto frameCount = static_cast<int>(values.size() / dimension);
+
+    std::vector<int> keys;
+
+    if (frameCount <= 2 || tolerance <= 0) {
+        keys.resize(frameCount);
+        std::iota(keys.begin(), keys.end(), 0);
+        return keys;
+    }
+
+    // Split the segments at the frame with the largest error, until all
+    // segments are within the tolerance (Ramer-Douglas-Peucker).
+    std::vector<bool> isKey(frameCount, false);
+    isKey.front() = true;
+    isKey.back() = true;
+
+    std::vector<std::pair<int, int>> segments{{0, frameCount - 1}};
+
+    while (!segments.empty()) {
+        const auto segment = segments.back();
+        segments.pop_back();
+
+        if (segment.second - segment.first < 2)
+            continue;
+
+        int splitFrame = -1;
+        const auto maxError = maxSegmentError(values, dimension, isQuaternion, segment.first, segment.second, splitFrame);
+
+        if (maxError > tolerance) {
+            isKey[splitFrame] = true;
+            segments.emplace_back(segment.first, splitFrame);
+            segments.emplace_back(splitFrame, segment.second);
+        }
+    }
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        if (isKey[frame]) {
+            keys.emplace_back(frame);
+        }
+    }
+
+    return keys;
+}
+
+std::vector<int> resampleKeyframes(const gsl::span<const float> &values, const size_t dimension, const bool isQuaternion,
+                                   const double tolerance, const int maxStride) {
+    assert(!isQuaternion || dimension == 4);
+
+    const auto frameCount = static_cast<int>(values.size() / dimension);
+
+    int stride = 1;
+
+    if (frameCount > 2 && tolerance > 0) {
+        // Each stride interpolates the frames between the kept ones.
+        for (auto candidate = 2; candidate <= maxStride && candidate < frameCount; ++candidate) {
+            auto isWithinTolerance = true;
+
+            for (auto first = 0; first < frameCount - 1 && isWithinTolerance; first += candidate) {
+                const auto last = std::min(first + candidate, frameCount - 1);
+
+                int maxErrorFrame = -1;
+                isWithinTolerance = maxSegmentError(values, dimension, isQuaternion, first, last, maxErrorFrame) <= tolerance;
+            }
+
+            if (!isWithinTolerance)
+                break;
+
+            stride = candidate;
+        }
+    }
+
+    std::vector<int> keys;
+    keys.reserve(frameCount / stride + 2);
+
+    for (auto frame = 0; frame < frameCount; frame += stride) {
+        keys.emplace_back(frame);
+    }
+
+    if (frameCount > 0 && keys.back() != frameCount - 1) {
+        keys.emplace_back(frameCount - 1);
+    }
+
+    return keys;
+}
+
+/** The derivative per second at each frame, using central differences */
+static std::vector<double> sampledTangents(const gsl::span<const float> &values, const size_t dimension, const int frameCount,
+                                           const double framesPerSecond) {
+    std::vector<double> tangents(frameCount * dimension, 0.0);
+
+    if (frameCount < 2)
+        return tangents;
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        const auto prev = std::max(0, frame - 1);
+        const auto next = std::min(frameCount - 1, frame + 1);
+        const auto scale = framesPerSecond / (next - prev);
+
+        for (size_t i = 0; i < dimension; ++i) {
+            tangents[frame * dimension + i] = (double(values[next * dimension + i]) - values[prev * dimension + i]) * scale;
+        }
+    }
+
+    return tangents;
+}
+
+/** The largest difference of a component between the frames of the segment
+ * and the Hermite curve through its end keys */
+static double maxHermiteError(const gsl::span<const float> &values, const std::vector<double> &tangents, const size_t dimension,
+                              const bool isQuaternion, const double framesPerSecond, const int first, const int last,
+                              int &maxErrorFrame) {
+    const auto *v0 = &values[first * dimension];
+    const auto *v1 = &values[last * dimension];
+    const auto *m0 = &tangents[first * dimension];
+    const auto *m1 = &tangents[last * dimension];
+
+    const double segmentDuration = (last - first) / framesPerSecond;
+
+    std::vector<double> interpolated(dimension);
+    double maxError = -1;
+
+    for (int frame = first + 1; frame < last; ++frame) {
+        const double t = double(frame - first) / (last - first);
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+
+        const double h00 = 2 * t3 - 3 * t2 + 1;
+        const double h10 = t3 - 2 * t2 + t;
+        const double h01 = -2 * t3 + 3 * t2;
+        const double h11 = t3 - t2;
+
+        for (size_t i = 0; i < dimension; ++i) {
+            interpolated[i] = h00 * v0[i] + h10 * segmentDuration * m0[i] + h01 * v1[i] + h11 * segmentDuration * m1[i];
+        }
+
+        const auto *v = &values[frame * dimension];
+
+        double error = 0;
+
+        if (isQuaternion) {
+            double length = 0;
+            for (int i = 0; i < 4; ++i) {
+                length += interpolated[i] * interpolated[i];
+            }
+            length = std::sqrt(length);
+
+            // q and -q are the same rotation.
+            double ep = 0;
+            double en = 0;
+            for (int i = 0; i < 4; ++i) {
+                const auto q = length > 0 ? interpolated[i] / length : interpolated[i];
+                ep = std::max(ep, std::abs(q - v[i]));
+                en = std::max(en, std::abs(q + v[i]));
+            }
+            error = std::min(ep, en);
+        } else {
+            for (size_t i = 0; i < dimension; ++i) {
+                error = std::max(error, std::abs(interpolated[i] - v[i]));
+            }
+        }
+
+        if (error > maxError) {
+            maxError = error;
+            maxErrorFrame = frame;
+        }
+    }
+
+    return maxError;
+}
+
+std::vector<int> fitCubicSpline(const gsl::span<const float> &values, const size_t dimension, const bool isQuaternion,
+                                const double tolerance, const double framesPerSecond, std::vector<float> &output) {
+    assert(!isQuaternion || dimension == 4);
+
+    const auto frameCount = static_cast<int>(values.size() / dimension);
+
+    const auto tangents = sampledTangents(values, dimension, frameCount, framesPerSecond);
+
+    std::vector<bool> isKey(frameCount, tolerance <= 0);
+
+    if (frameCount > 0) {
+        isKey.front() = true;
+        isKey.back() = true;
+    }
+
+    std::vector<std::pair<int, int>> segments;
+
+    if (frameCount > 2 && tolerance > 0) {
+        segments.emplace_back(0, frameCount - 1);
+    }
+
+    // As for the linear reduction, split at the frame with the largest error.
+    while (!segments.empty()) {
+        const auto segment = segments.back();
+        segments.pop_back();
+
+        if (segment.second - segment.first < 2)
+            continue;
+
+        int splitFrame = -1;
+        const auto maxError = maxHermiteError(values, tangents, dimension, isQuaternion, framesPerSecond, segment.first,
+                                              segment.second, splitFrame);
+
+        if (maxError > tolerance) {
+            isKey[splitFrame] = true;
+            segments.emplace_back(segment.first, splitFrame);
+            segments.emplace_back(splitFrame, segment.second);
+        }
+    }
+
+    std::vector<int> keys;
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        if (isKey[frame]) {
+            keys.emplace_back(frame);
+        }
+    }
+
+    output.clear();
+    output.reserve(keys.size() * dimension * 3);
+
+    for (auto frame : keys) {
+        const auto *tangent = &tangents[frame * dimension];
+        const auto *value = &values[frame * dimension];
+
+        std::transform(tangent, tangent + dimension, std::back_inserter(output), [](double d) { return static_cast<float>(d); });
+        std::copy(value, value + dimension, std::back_inserter(output));
+        std::transform(tangent, tangent + dimension, std::back_inserter(output), [](double d) { return static_cast<float>(d); });
+    }
+
+    return keys;
+}
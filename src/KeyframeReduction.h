@@ -0,0 +1,36 @@
+#pragma once
+
+/**
+ * Removes the keys of a uniformly sampled LINEAR channel that can be
+ * interpolated from the remaining keys, within the tolerance per component.
+ *
+ * The values hold dimension components per frame. Quaternions are
+ * interpolated with slerp, as glTF does for rotations, other values
+ * linearly. Returns the indices of the frames to keep, always including the
+ * first and last frame.
+ */
+std::vector<int> reduceKeyframes(const gsl::span<const float> &values, size_t dimension, bool isQuaternion, double tolerance);
+
+/**
+ * Resamples a uniformly sampled LINEAR channel at the lowest rate that still
+ * reproduces each frame within the tolerance per component: every
+ * stride-th frame, trying the strides from 2 up to maxStride, and keeping
+ * the last one that fits. The last frame is always kept. Unlike
+ * reduceKeyframes, the kept frames stay uniform, so channels with the same
+ * frame count and stride share their times.
+ */
+std::vector<int> resampleKeyframes(const gsl::span<const float> &values, size_t dimension, bool isQuaternion, double tolerance,
+                                   int maxStride);
+
+/**
+ * Fits a uniformly sampled channel with a glTF CUBICSPLINE, keeping as few
+ * keys as possible while staying within the tolerance per component.
+ *
+ * The tangents are the derivatives of the samples, so the curve passes
+ * through the kept samples with the sampled slope. Quaternions are
+ * normalized after interpolation, as glTF does. The output receives the
+ * in-tangent, value and out-tangent of each key, as the sampler output
+ * requires. Returns the indices of the kept frames.
+ */
+std::vector<int> fitCubicSpline(const gsl::span<const float> &values, size_t dimension, bool isQuaternion, double tolerance,
+                                double framesPerSecond, std::vector<float> &output);
@@ -0,0 +1,435 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Exporter.h"
+#include "IndentableStream.h"
+#include "LiveLink.h"
+#include "LiveLinkServer.h"
+#include "MayaException.h"
+
+// How often the timer accepts the viewers and checks for changes, in seconds.
+const float livePollSeconds = 0.1f;
+
+// How long nothing must change before exporting again.
+const auto liveSettleTime = std::chrono::milliseconds(300);
+
+// The granularity of the changed byte ranges of the buffers.
+const size_t liveBufferBlockByteLength = 64 * 1024;
+
+static std::unique_ptr<LiveLink> liveSession;
+
+typedef rapidjson::Document::AllocatorType JSONAllocator;
+
+/** The arguments with the objects that were selected, so each export of a
+ * session exports the same objects, whatever is selected later */
+static MArgList withSelectedObjects(const MArgList &args, const MSyntax &syntax) {
+    MStatus status;
+    const MArgDatabase adb(syntax, args, &status);
+    THROW_ON_FAILURE(status);
+
+    MSelectionList objects;
+    THROW_ON_FAILURE(adb.getObjects(objects));
+
+    MStringArray names;
+    THROW_ON_FAILURE(objects.getSelectionStrings(names));
+
+    auto result = args;
+    for (unsigned i = 0; i < names.length(); ++i) {
+        result.addArg(names[i]);
+    }
+    return result;
+}
+
+static bool readFile(const fs::path &path, std::vector<byte> &bytes) {
+    std::ifstream file(path.string(), std::ios::binary);
+    if (!file)
+        return false;
+
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+static uint32_t readUint32(const byte *bytes) {
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
+
+/** The name as a JSON pointer reference token */
+static std::string pointerToken(const char *name) {
+    std::string token;
+    for (; *name; ++name) {
+        switch (*name) {
+        case '~':
+            token += "~0";
+            break;
+        case '/':
+            token += "~1";
+            break;
+        default:
+            token += *name;
+        }
+    }
+    return token;
+}
+
+static void addOperation(rapidjson::Value &operations, const char *op, const std::string &path,
+                         const rapidjson::Value *value, JSONAllocator &allocator) {
+    rapidjson::Value operation(rapidjson::kObjectType);
+    operation.AddMember("op", rapidjson::StringRef(op), allocator);
+    operation.AddMember("path", rapidjson::Value(path.c_str(), allocator), allocator);
+    if (value) {
+        operation.AddMember("value", rapidjson::Value(*value, allocator), allocator);
+    }
+    operations.PushBack(operation, allocator);
+}
+
+/** The JSON patch operations from the previous to the next glTF JSON, on
+ * the top level members, and on the items of the top level arrays */
+static void addJSONChanges(const rapidjson::Value &previous, const rapidjson::Value &next,
+                           rapidjson::Value &operations, JSONAllocator &allocator) {
+    for (auto &&member : next.GetObject()) {
+        const auto path = "/" + pointerToken(member.name.GetString());
+        const auto &nextValue = member.value;
+
+        const auto it = previous.FindMember(member.name);
+        if (it == previous.MemberEnd()) {
+            addOperation(operations, "add", path, &nextValue, allocator);
+            continue;
+        }
+
+        const auto &previousValue = it->value;
+        if (previousValue == nextValue)
+            continue;
+
+        if (!previousValue.IsArray() || !nextValue.IsArray()) {
+            addOperation(operations, "replace", path, &nextValue, allocator);
+            continue;
+        }
+
+        const auto previousSize = previousValue.Size();
+        const auto nextSize = nextValue.Size();
+        const auto commonSize = std::min(previousSize, nextSize);
+
+        for (rapidjson::SizeType i = 0; i < commonSize; ++i) {
+            if (previousValue[i] != nextValue[i]) {
+                addOperation(operations, "replace", path + "/" + std::to_string(i), &nextValue[i], allocator);
+            }
+        }
+
+        for (auto i = commonSize; i < nextSize; ++i) {
+            addOperation(operations, "add", path + "/" + std::to_string(i), &nextValue[i], allocator);
+        }
+
+        // Removed from the end, so the indices of the others stay valid.
+        for (auto i = previousSize; i-- > commonSize;) {
+            addOperation(operations, "remove", path + "/" + std::to_string(i), nullptr, allocator);
+        }
+    }
+
+    for (auto &&member : previous.GetObject()) {
+        if (!next.HasMember(member.name)) {
+            addOperation(operations, "remove", "/" + pointerToken(member.name.GetString()), nullptr, allocator);
+        }
+    }
+}
+
+/** The changed byte ranges from the previous to the next bytes of a buffer,
+ * appends these to the payload. Returns false when nothing changed. */
+static bool addBufferChanges(const std::vector<byte> &previous, const std::vector<byte> &next,
+                             rapidjson::Value &ranges, std::vector<byte> &payload, JSONAllocator &allocator) {
+    for (size_t offset = 0; offset < next.size(); offset += liveBufferBlockByteLength) {
+        const auto length = std::min(liveBufferBlockByteLength, next.size() - offset);
+        if (offset + length <= previous.size() && std::memcmp(&next[offset], &previous[offset], length) == 0)
+            continue;
+
+        // Adjacent changed blocks are sent as one range.
+        const auto rangeCount = ranges.Size();
+        if (rangeCount > 0) {
+            auto &last = ranges[rangeCount - 1];
+            const auto lastEnd = last["byteOffset"].GetUint64() + last["byteLength"].GetUint64();
+            if (lastEnd == offset) {
+                last["byteLength"].SetUint64(last["byteLength"].GetUint64() + length);
+                payload.insert(payload.end(), next.begin() + offset, next.begin() + offset + length);
+                continue;
+            }
+        }
+
+        rapidjson::Value range(rapidjson::kObjectType);
+        range.AddMember("byteOffset", uint64_t(offset), allocator);
+        range.AddMember("byteLength", uint64_t(length), allocator);
+        range.AddMember("payloadOffset", uint64_t(payload.size()), allocator);
+        ranges.PushBack(range, allocator);
+
+        payload.insert(payload.end(), next.begin() + offset, next.begin() + offset + length);
+    }
+
+    return !ranges.Empty() || next.size() != previous.size();
+}
+
+LiveLink::LiveLink(const MArgList &args, const MSyntax &syntax, const Arguments &arguments)
+    : m_args(withSelectedObjects(args, syntax)), m_syntax(syntax), m_outputFolder(arguments.outputFolder.asChar()),
+      m_outputPath(m_outputFolder /
+                   (std::string(arguments.sceneName.asChar()) + "." +
+                    (arguments.glb ? arguments.glbFileExtension : arguments.gltfFileExtension).asChar())),
+      m_isBinary(arguments.glb), m_server(std::make_unique<LiveLinkServer>(arguments.liveLinkPort)) {
+    if (!read(m_snapshot)) {
+        cerr << prefix << "WARNING: The live link failed to read " << m_outputPath << endl;
+    }
+
+    try {
+        watch(arguments);
+
+        MStatus status;
+        m_timerCallback = MTimerMessage::addTimerCallback(livePollSeconds, onTimer, this, &status);
+        THROW_ON_FAILURE(status);
+        m_hasTimerCallback = true;
+    } catch (...) {
+        unwatch();
+        throw;
+    }
+}
+
+LiveLink::~LiveLink() {
+    if (m_hasTimerCallback) {
+        MMessage::removeCallback(m_timerCallback);
+    }
+
+    unwatch();
+}
+
+void LiveLink::start(const MArgList &args, const MSyntax &syntax, const Arguments &arguments) {
+    stop();
+
+    liveSession.reset(new LiveLink(args, syntax, arguments));
+    cout << prefix << "Live link listening on port " << arguments.liveLinkPort << endl;
+}
+
+void LiveLink::stop() {
+    if (!liveSession)
+        return;
+
+    liveSession.reset();
+    cout << prefix << "Live link stopped" << endl;
+}
+
+void LiveLink::watch(const Arguments &arguments) {
+    MStatus status;
+
+    // The exported shapes with their transforms, and the shading groups of
+    // the meshes, which are dirtied by their materials and textures.
+    MSelectionList nodes;
+
+    const auto addPath = [&nodes](MDagPath dagPath) {
+        for (; dagPath.length() > 0; dagPath.pop()) {
+            nodes.add(dagPath.node(), true);
+        }
+    };
+
+    for (auto &&dagPath : arguments.meshShapes) {
+        addPath(dagPath);
+
+        MFnMesh fnMesh(dagPath, &status);
+        THROW_ON_FAILURE(status);
+
+        MObjectArray shaders;
+        MIntArray indices;
+        THROW_ON_FAILURE(fnMesh.getConnectedShaders(dagPath.instanceNumber(), shaders, indices));
+
+        for (unsigned i = 0; i < shaders.length(); ++i) {
+            nodes.add(shaders[i], true);
+        }
+    }
+
+    for (auto &&dagPath : arguments.cameraShapes) {
+        addPath(dagPath);
+    }
+
+    for (unsigned i = 0; i < nodes.length(); ++i) {
+        MObject node;
+        THROW_ON_FAILURE(nodes.getDependNode(i, node));
+
+        const auto callbackId = MNodeMessage::addNodeDirtyCallback(node, onNodeDirty, this, &status);
+        THROW_ON_FAILURE(status);
+        m_nodeCallbacks.append(callbackId);
+    }
+}
+
+void LiveLink::unwatch() {
+    if (m_nodeCallbacks.length() > 0) {
+        MMessage::removeCallbacks(m_nodeCallbacks);
+        m_nodeCallbacks.clear();
+    }
+}
+
+void LiveLink::onNodeDirty(MObject &, void *clientData) {
+    auto &session = *static_cast<LiveLink *>(clientData);
+
+    // The exports change the time and the blend shape weights.
+    if (session.m_isExporting)
+        return;
+
+    session.m_isDirty = true;
+    session.m_dirtyTime = Clock::now();
+}
+
+void LiveLink::onTimer(float, float, void *clientData) { static_cast<LiveLink *>(clientData)->update(); }
+
+void LiveLink::update() {
+    if (m_isExporting || Exporter::isExportRunning())
+        return;
+
+    try {
+        m_server->acceptViewers();
+
+        if (m_server->hasNewViewers()) {
+            send(Snapshot(), m_snapshot, true);
+        }
+
+        if (m_isDirty && Clock::now() - m_dirtyTime >= liveSettleTime) {
+            exportChanges();
+        }
+    } catch (const MayaException &ex) {
+        MayaException::printError(ex.what(), ex.status);
+    } catch (const std::exception &ex) {
+        MayaException::printError(ex.what());
+    } catch (...) {
+        MayaException::printError("Unexpected live link error!");
+    }
+}
+
+void LiveLink::exportChanges() {
+    m_isDirty = false;
+
+    struct ExportingScope {
+        bool &isExporting;
+        explicit ExportingScope(bool &isExporting) : isExporting(isExporting) { isExporting = true; }
+        ~ExportingScope() { isExporting = false; }
+    };
+
+    {
+        const ExportingScope exportingScope(m_isExporting);
+
+        const Arguments arguments(m_args, m_syntax);
+        Exporter::exportScene(arguments);
+
+        // The exported shapes change when shapes are added to an exported group.
+        unwatch();
+        watch(arguments);
+    }
+
+    Snapshot next;
+    if (!read(next)) {
+        cerr << prefix << "WARNING: The live link failed to read " << m_outputPath << endl;
+        return;
+    }
+
+    ++m_version;
+
+    if (m_server->hasViewers()) {
+        send(m_snapshot, next, false);
+    }
+
+    m_snapshot = std::move(next);
+}
+
+bool LiveLink::read(Snapshot &snapshot) const {
+    std::vector<byte> bytes;
+    if (!readFile(m_outputPath, bytes))
+        return false;
+
+    const char *jsonText = reinterpret_cast<const char *>(bytes.data());
+    size_t jsonLength = bytes.size();
+    std::vector<byte> binaryChunk;
+
+    if (m_isBinary) {
+        // The header, the JSON chunk, and the BIN chunk of the first buffer.
+        if (bytes.size() < 20 || std::memcmp(bytes.data(), "glTF", 4) != 0)
+            return false;
+
+        jsonText += 20;
+        jsonLength = readUint32(&bytes[12]);
+
+        const auto binaryOffset = 20 + size_t(jsonLength);
+        if (binaryOffset > bytes.size())
+            return false;
+
+        if (binaryOffset + 8 <= bytes.size()) {
+            const auto binaryLength = readUint32(&bytes[binaryOffset]);
+            const auto binaryBegin = bytes.begin() + binaryOffset + 8;
+            if (binaryOffset + 8 + binaryLength <= bytes.size()) {
+                binaryChunk.assign(binaryBegin, binaryBegin + binaryLength);
+            }
+        }
+    }
+
+    snapshot.json.Parse(jsonText, jsonLength);
+    if (snapshot.json.HasParseError() || !snapshot.json.IsObject())
+        return false;
+
+    snapshot.buffers.clear();
+
+    if (snapshot.json.HasMember("buffers") && snapshot.json["buffers"].IsArray()) {
+        for (auto &&buffer : snapshot.json["buffers"].GetArray()) {
+            snapshot.buffers.emplace_back();
+            auto &bufferBytes = snapshot.buffers.back();
+
+            if (!buffer.HasMember("uri")) {
+                if (snapshot.buffers.size() == 1) {
+                    bufferBytes = std::move(binaryChunk);
+                }
+                continue;
+            }
+
+            // Embedded buffers are part of the JSON changes.
+            const std::string uri = buffer["uri"].GetString();
+            if (uri.compare(0, 5, "data:") != 0 && !readFile(m_outputFolder / uri, bufferBytes)) {
+                cerr << prefix << "WARNING: The live link failed to read the buffer " << uri << endl;
+            }
+        }
+    }
+
+    return true;
+}
+
+void LiveLink::send(const Snapshot &previous, const Snapshot &next, const bool toNewViewers) const {
+    rapidjson::Document header(rapidjson::kObjectType);
+    auto &allocator = header.GetAllocator();
+
+    rapidjson::Value operations(rapidjson::kArrayType);
+    addJSONChanges(previous.json, next.json, operations, allocator);
+
+    static const std::vector<byte> noBytes;
+
+    std::vector<byte> payload;
+    rapidjson::Value buffers(rapidjson::kArrayType);
+
+    for (size_t index = 0; index < next.buffers.size(); ++index) {
+        const auto &nextBytes = next.buffers[index];
+        const auto &previousBytes = index < previous.buffers.size() ? previous.buffers[index] : noBytes;
+
+        rapidjson::Value ranges(rapidjson::kArrayType);
+        if (!addBufferChanges(previousBytes, nextBytes, ranges, payload, allocator))
+            continue;
+
+        rapidjson::Value buffer(rapidjson::kObjectType);
+        buffer.AddMember("buffer", uint64_t(index), allocator);
+        buffer.AddMember("byteLength", uint64_t(nextBytes.size()), allocator);
+        buffer.AddMember("ranges", ranges, allocator);
+        buffers.PushBack(buffer, allocator);
+    }
+
+    if (!toNewViewers && operations.Empty() && buffers.Empty())
+        return;
+
+    header.AddMember("version", m_version, allocator);
+    header.AddMember("json", operations, allocator);
+    header.AddMember("buffers", buffers, allocator);
+
+    rapidjson::StringBuffer text;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(text);
+    header.Accept(writer);
+
+    m_server->send(std::string(text.GetString(), text.GetSize()), payload, toNewViewers);
+
+    cout << prefix << "Live link sent version " << m_version << " with " << operations.Size() << " JSON changes and "
+         << payload.size() << " buffer bytes" << endl;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "filesystem.h"
+#include "macros.h"
+
+class Arguments;
+class LiveLinkServer;
+
+/**
+ * The session of -liveLink. After the export, it stays resident in Maya,
+ * watches the exported shapes, their transforms and shading groups, and
+ * when these change, it exports the scene again and pushes the changes of
+ * the written asset to the viewers connected to its LiveLinkServer.
+ *
+ * The meshes that didn't change are read from the mesh cache, so the
+ * exports after an edit only extract the edited meshes. The changes are
+ * found by comparing the written JSON and buffers with the previous ones:
+ * the JSON patch operations on the top level members and the items of the
+ * top level arrays, and the changed byte ranges of the buffers.
+ *
+ * The Maya callbacks only mark the session dirty; a timer on the main
+ * thread accepts the viewers, and exports when nothing changed for a
+ * moment, so dragging a vertex doesn't export each intermediate position.
+ */
+class LiveLink {
+  public:
+    /** Starts a session for the export that was just written, stopping the
+     * previous session */
+    static void start(const MArgList &args, const MSyntax &syntax, const Arguments &arguments);
+
+    /** Stops the session, if any */
+    static void stop();
+
+    ~LiveLink();
+
+  private:
+    LiveLink(const MArgList &args, const MSyntax &syntax, const Arguments &arguments);
+    DISALLOW_COPY_MOVE_ASSIGN(LiveLink);
+
+    /** The written glTF JSON and buffers */
+    struct Snapshot {
+        rapidjson::Document json{rapidjson::kObjectType};
+        std::vector<std::vector<byte>> buffers;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    const MArgList m_args;
+    const MSyntax m_syntax;
+    const fs::path m_outputFolder;
+    const fs::path m_outputPath;
+    const bool m_isBinary;
+
+    std::unique_ptr<LiveLinkServer> m_server;
+
+    MCallbackIdArray m_nodeCallbacks;
+    MCallbackId m_timerCallback = 0;
+    bool m_hasTimerCallback = false;
+
+    bool m_isDirty = false;
+    bool m_isExporting = false;
+    Clock::time_point m_dirtyTime;
+
+    Snapshot m_snapshot;
+    int m_version = 0;
+
+    /** Watches the nodes of the exported shapes */
+    void watch(const Arguments &arguments);
+    void unwatch();
+
+    static void onNodeDirty(MObject &node, void *clientData);
+    static void onTimer(float elapsedTime, float lastTime, void *clientData);
+
+    void update();
+
+    /** Exports again and sends the changes to the viewers */
+    void exportChanges();
+
+    /** Reads the written asset, returns false when it can't */
+    bool read(Snapshot &snapshot) const;
+
+    /** Sends the changes from the snapshot to the next one, to the new
+     * viewers or the others */
+    void send(const Snapshot &previous, const Snapshot &next, bool toNewViewers) const;
+};
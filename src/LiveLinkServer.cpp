@@ -0,0 +1,190 @@
+#include "externals.h"
+
+#include "IndentableStream.h"
+#include "LiveLinkServer.h"
+#include "dump.h"
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef SOCKET SocketHandle;
+typedef int SocketLength;
+static const SocketHandle invalidSocket = INVALID_SOCKET;
+static const int sendFlags = 0;
+
+static void closeSocket(const SocketHandle socket) { closesocket(socket); }
+
+static bool setNonBlocking(const SocketHandle socket, const bool isNonBlocking) {
+    u_long mode = isNonBlocking ? 1 : 0;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+}
+
+static void setSendTimeout(const SocketHandle socket, const int milliseconds) {
+    const DWORD timeout = milliseconds;
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+}
+
+/** Winsock is started with the first server, and cleaned up when the plugin unloads */
+struct SocketLibrary {
+    SocketLibrary() {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+            throw std::runtime_error("Failed to start Winsock");
+    }
+
+    ~SocketLibrary() { WSACleanup(); }
+};
+
+#else
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SocketHandle;
+typedef socklen_t SocketLength;
+static const SocketHandle invalidSocket = -1;
+
+#ifdef MSG_NOSIGNAL
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+static void closeSocket(const SocketHandle socket) { close(socket); }
+
+static bool setNonBlocking(const SocketHandle socket, const bool isNonBlocking) {
+    const auto flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, isNonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) == 0;
+}
+
+static void setSendTimeout(const SocketHandle socket, const int milliseconds) {
+    timeval timeout{};
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+#ifdef SO_NOSIGPIPE
+    // A viewer that disconnects must not stop Maya.
+    const int isEnabled = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &isEnabled, sizeof(isEnabled));
+#endif
+}
+
+struct SocketLibrary {};
+
+#endif
+
+// A viewer that takes longer to receive a part of a message is dropped.
+const int viewerSendTimeoutMilliseconds = 1000;
+
+static SocketLibrary &socketLibrary() {
+    static SocketLibrary library;
+    return library;
+}
+
+static SocketHandle handleOf(const intptr_t socket) { return static_cast<SocketHandle>(socket); }
+
+static bool sendAll(const SocketHandle socket, const char *data, size_t byteLength) {
+    while (byteLength > 0) {
+        const auto chunkLength = static_cast<int>(std::min<size_t>(byteLength, 1 << 20));
+        const auto sentLength = ::send(socket, data, chunkLength, sendFlags);
+        if (sentLength <= 0)
+            return false;
+
+        data += sentLength;
+        byteLength -= static_cast<size_t>(sentLength);
+    }
+    return true;
+}
+
+LiveLinkServer::LiveLinkServer(const int port) {
+    socketLibrary();
+
+    const auto listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == invalidSocket)
+        throw std::runtime_error("Failed to create the live link socket");
+
+    const int isEnabled = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&isEnabled), sizeof(isEnabled));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0 || !setNonBlocking(listener, true)) {
+        closeSocket(listener);
+        throw std::runtime_error(formatted("Failed to listen on live link port %d", port));
+    }
+
+    m_listener = static_cast<intptr_t>(listener);
+}
+
+LiveLinkServer::~LiveLinkServer() {
+    for (auto &&viewer : m_viewers) {
+        closeSocket(handleOf(viewer.socket));
+    }
+
+    closeSocket(handleOf(m_listener));
+}
+
+size_t LiveLinkServer::acceptViewers() {
+    size_t count = 0;
+
+    for (;;) {
+        sockaddr_in address{};
+        SocketLength addressLength = sizeof(address);
+        const auto socket = accept(handleOf(m_listener), reinterpret_cast<sockaddr *>(&address), &addressLength);
+        if (socket == invalidSocket)
+            break;
+
+        // Accepted sockets can inherit the mode of the listener.
+        setNonBlocking(socket, false);
+        setSendTimeout(socket, viewerSendTimeoutMilliseconds);
+
+        m_viewers.push_back({static_cast<intptr_t>(socket), true});
+        ++count;
+    }
+
+    return count;
+}
+
+bool LiveLinkServer::hasNewViewers() const {
+    return std::any_of(m_viewers.begin(), m_viewers.end(), [](const Viewer &viewer) { return viewer.isNew; });
+}
+
+void LiveLinkServer::send(const std::string &header, const std::vector<byte> &payload, const bool toNewViewers) {
+    const auto headerLength = static_cast<uint32_t>(header.size());
+    const char lengthBytes[4] = {char(headerLength & 0xff), char((headerLength >> 8) & 0xff),
+                                 char((headerLength >> 16) & 0xff), char((headerLength >> 24) & 0xff)};
+
+    for (auto it = m_viewers.begin(); it != m_viewers.end();) {
+        if (it->isNew != toNewViewers) {
+            ++it;
+            continue;
+        }
+
+        const auto socket = handleOf(it->socket);
+        const auto isSent = sendAll(socket, lengthBytes, sizeof(lengthBytes)) &&
+                            sendAll(socket, header.data(), header.size()) &&
+                            sendAll(socket, reinterpret_cast<const char *>(payload.data()), payload.size());
+
+        if (isSent) {
+            it->isNew = false;
+            ++it;
+        } else {
+            cerr << prefix << "WARNING: Dropped a live link viewer" << endl;
+            closeSocket(socket);
+            it = m_viewers.erase(it);
+        }
+    }
+}
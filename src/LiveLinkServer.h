@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+
+/**
+ * The TCP server of the live link, on a port of the local host only. It
+ * never blocks on accepting, so it is polled from the Maya main thread, see
+ * LiveLink. Sending blocks up to a second per viewer, the viewers that don't
+ * keep up are dropped.
+ */
+class LiveLinkServer {
+  public:
+    /** Listens on the port, throws when it can't */
+    explicit LiveLinkServer(int port);
+    ~LiveLinkServer();
+
+    /** Accepts the waiting viewers, returns how many connected */
+    size_t acceptViewers();
+
+    /** Whether viewers connected since the last message to the new viewers */
+    bool hasNewViewers() const;
+
+    bool hasViewers() const { return !m_viewers.empty(); }
+
+    /**
+     * Sends a message, the byte length of the header, the header and the
+     * payload, either to the viewers that connected since the last such
+     * call, or to the others.
+     */
+    void send(const std::string &header, const std::vector<byte> &payload, bool toNewViewers);
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(LiveLinkServer);
+
+    struct Viewer {
+        intptr_t socket;
+        bool isNew;
+    };
+
+    intptr_t m_listener;
+    std::vector<Viewer> m_viewers;
+};
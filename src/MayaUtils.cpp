@@ -43,6 +43,44 @@ MTransformationMatrix getTransformation(const MDagPath &path) {
     return fnMat.transformation();
 }
 
+MMatrix getWorldMatrix(const MDagPath &path) {
+    MStatus status;
+
+    MFnDagNode fnDagNode(path, &status);
+    THROW_ON_FAILURE(status);
+
+    MPlug matrixPlugArray = fnDagNode.findPlug("worldMatrix", true, &status);
+    THROW_ON_FAILURE(status);
+
+    const auto instanceNumber = path.instanceNumber(&status);
+    THROW_ON_FAILURE(status);
+
+    MPlug matrixPlug =
+        matrixPlugArray.elementByLogicalIndex(instanceNumber, &status);
+    THROW_ON_FAILURE(status);
+
+    return getMatrix(matrixPlug);
+}
+
+bool hasInputConnection(const MPlug &plug) {
+    MStatus status;
+
+    MPlugArray sources;
+    plug.connectedTo(sources, true, false, &status);
+    if (status && sources.length() > 0)
+        return true;
+
+    if (plug.isCompound()) {
+        const auto childCount = plug.numChildren();
+        for (unsigned i = 0; i < childCount; ++i) {
+            if (hasInputConnection(plug.child(i)))
+                return true;
+        }
+    }
+
+    return false;
+}
+
 bool isNotSimpleChar(const char c) { return !isalnum(c); }
 
 MString simpleName(const MString &name) {
@@ -6,6 +6,13 @@ MMatrix getMatrix(const MFnDependencyNode &node, const char *plugName);
 
 MTransformationMatrix getTransformation(const MDagPath &path);
 
+// Evaluates the world matrix plug of the instance, so unlike
+// MDagPath::inclusiveMatrix, this respects the current evaluation context.
+MMatrix getWorldMatrix(const MDagPath &path);
+
+// Is the plug, or any of its children, the destination of a connection?
+bool hasInputConnection(const MPlug &plug);
+
 // Return a string with all non-alpha-numeric characters replaced with an
 // underscore.
 MString simpleName(const MString &name);
@@ -6,7 +6,76 @@
 #include "MayaException.h"
 #include "MayaUtils.h"
 #include "Mesh.h"
+#include "MeshArena.h"
+#include "MeshBlendShapeDeltas.h"
 #include "MeshBlendShapeWeights.h"
+#include "TaskScheduler.h"
+
+// The most evaluated blend shape targets whose Maya arrays wait to be
+// converted, which bounds the memory of the arrays.
+const size_t maxPendingTargetConversions = 4;
+
+/**
+ * Converts the vertices of the evaluated blend shape targets on the worker
+ * threads, while the main thread switches the weights and fetches the next
+ * targets. Waits for the pending conversions when destroyed, so these are
+ * joined when the extraction throws.
+ */
+class TargetConversions {
+  public:
+    TargetConversions(const MainShape &mainShape, const Arguments &args)
+        : m_mainShape(mainShape), m_args(args) {}
+
+    ~TargetConversions() { waitUntilPendingAtMost(0); }
+
+    /** Waits until less than maxPendingTargetConversions are pending, so
+     * the next target can be fetched */
+    void reserve() { waitUntilPendingAtMost(maxPendingTargetConversions - 1); }
+
+    void submit(MeshShape &shape, std::unique_ptr<MeshVertexArrays> arrays) {
+        ++m_pendingCount;
+
+        std::shared_ptr<MeshVertexArrays> sharedArrays(std::move(arrays));
+
+        TaskScheduler::instance().submit([this, &shape, sharedArrays]() mutable {
+            try {
+                MeshArena::Scope arenaScope;
+                shape.convertVertices(m_mainShape, *sharedArrays, m_args);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_errorMutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+
+            sharedArrays.reset();
+            --m_pendingCount;
+            TaskScheduler::instance().notifyWaiters();
+        });
+    }
+
+    /** Waits for all conversions, rethrows the first error */
+    void finish() {
+        waitUntilPendingAtMost(0);
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(TargetConversions);
+
+    void waitUntilPendingAtMost(const size_t count) {
+        TaskScheduler::instance().waitUntil(
+            [this, count] { return m_pendingCount.load() <= count; });
+    }
+
+    const MainShape &m_mainShape;
+    const Arguments &m_args;
+
+    std::atomic<size_t> m_pendingCount{0};
+
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
 
 Mesh::Mesh(ExportableScene &scene, MDagPath dagPath,
            const ExportableNode &node) {
@@ -33,7 +102,7 @@ Mesh::Mesh(ExportableScene &scene, MDagPath dagPath,
         MFnBlendShapeDeformer fnBlendShapeDeformer(blendShapeDeformer, &status);
         THROW_ON_FAILURE(status);
 
-        const auto deformerName = fnBlendShapeDeformer.name().asChar();
+        const auto deformerName = fnBlendShapeDeformer.name();
         cout << prefix << "Processing blend shapes of " << deformerName << "..."
              << endl;
 
@@ -64,18 +133,78 @@ Mesh::Mesh(ExportableScene &scene, MDagPath dagPath,
                                                   ShapeIndex::main());
         m_allShapes.emplace_back(m_mainShape.get());
 
+        // The sparse target offsets can only be used when no other blend
+        // shape attributes than POSITION are needed.
+        std::unique_ptr<MeshBlendShapeDeltas> targetDeltas;
+        if (args.sparseBlendShapeExtraction) {
+            if (args.blendPrimitiveAttributes.count() > 1) {
+                cerr << prefix
+                     << "WARNING: sparse blend shape extraction only supports "
+                        "POSITION, evaluating all targets of "
+                     << deformerName << endl;
+            } else {
+                targetDeltas = std::make_unique<MeshBlendShapeDeltas>(
+                    blendShapeDeformer, fnMesh);
+                if (!targetDeltas->isReadable()) {
+                    cerr << prefix << "WARNING: evaluating all targets of "
+                         << deformerName << ", " << targetDeltas->reason()
+                         << endl;
+                }
+            }
+        }
+
+        int evaluatedTargetCount = 0;
+
+        // Only switching the weights and fetching the Maya arrays of the
+        // evaluated targets runs on the main thread, the workers convert the
+        // previous targets meanwhile.
+        TargetConversions conversions(*m_mainShape, args);
+        std::vector<const MeshShape *> evaluatedShapes;
+
         for (auto &&pair : weightEntries) {
             auto &entry = pair.second;
-            weightPlugs.clearWeightsExceptFor(&entry);
             auto weightPlug = weightPlugs.getWeightPlug(entry);
             auto initialWeight = static_cast<float>(entry.originalWeight);
-            auto blendShape = std::make_unique<MeshShape>(
-                m_mainShape->indices(), fnMesh, node, args,
-                ShapeIndex::target(entry.shapeIndex), weightPlug,
-                initialWeight);
+            const auto shapeIndex = ShapeIndex::target(entry.shapeIndex);
+
+            BlendShapeTargetDeltas deltas;
+            std::unique_ptr<MeshShape> blendShape;
+
+            if (targetDeltas &&
+                targetDeltas->tryGetTargetDeltas(entry.plugIndex, deltas)) {
+                blendShape = std::make_unique<MeshShape>(
+                    *m_mainShape, fnMesh, args, shapeIndex, weightPlug,
+                    initialWeight, deltas);
+            } else {
+                conversions.reserve();
+                weightPlugs.clearWeightsExceptFor(&entry);
+                blendShape = std::make_unique<MeshShape>(
+                    fnMesh, args, shapeIndex, weightPlug, initialWeight);
+                conversions.submit(*blendShape,
+                                   std::make_unique<MeshVertexArrays>(
+                                       m_mainShape->indices(), fnMesh,
+                                       shapeIndex, args));
+                evaluatedShapes.emplace_back(blendShape.get());
+                ++evaluatedTargetCount;
+            }
+
             m_allShapes.emplace_back(blendShape.get());
             m_blendShapes.emplace_back(std::move(blendShape));
         }
+
+        conversions.finish();
+
+        for (auto &&shape : evaluatedShapes) {
+            shape->vertices().reportTangentIssues(
+                fnMesh, m_mainShape->indices(), args);
+        }
+
+        if (targetDeltas && targetDeltas->isReadable()) {
+            cout << prefix << "Read "
+                 << weightEntries.size() - evaluatedTargetCount
+                 << " blend shape targets directly, evaluated "
+                 << evaluatedTargetCount << endl;
+        }
     }
 }
 
@@ -0,0 +1,81 @@
+#include "externals.h"
+
+#include "MeshArena.h"
+
+// The size of the first block, the next blocks double.
+const size_t minBlockByteLength = 256 * 1024;
+
+MeshArena::MeshArena() = default;
+
+MeshArena::~MeshArena() = default;
+
+MeshArena &MeshArena::current() {
+    static thread_local MeshArena arena;
+    return arena;
+}
+
+void *MeshArena::allocate(const size_t byteCount, const size_t alignment) {
+    while (m_blockIndex < m_blocks.size()) {
+        auto &block = m_blocks[m_blockIndex];
+        const auto address = reinterpret_cast<uintptr_t>(block.data.get()) + m_offset;
+        const auto padding = (alignment - address % alignment) % alignment;
+        if (m_offset + padding + byteCount <= block.byteLength) {
+            auto *data = block.data.get() + m_offset + padding;
+            m_offset += padding + byteCount;
+            return data;
+        }
+
+        // Continue in the next block, the rest of this one stays unused.
+        ++m_blockIndex;
+        m_offset = 0;
+    }
+
+    const auto previousByteLength = m_blocks.empty() ? minBlockByteLength / 2 : m_blocks.back().byteLength;
+    const auto byteLength = std::max(previousByteLength * 2, byteCount + alignment);
+
+    m_blocks.push_back({std::unique_ptr<byte[]>(new byte[byteLength]), byteLength});
+    m_heldMemory.add(byteLength);
+
+    m_blockIndex = m_blocks.size() - 1;
+    m_offset = 0;
+    return allocate(byteCount, alignment);
+}
+
+void MeshArena::rewind(const size_t blockIndex, const size_t offset) {
+    m_blockIndex = blockIndex;
+    m_offset = offset;
+
+    // When the arena is empty again, a mesh that needed several blocks gets a
+    // single block for all of these, so the next mesh like it doesn't chain.
+    if (m_scopeDepth == 0 && blockIndex == 0 && offset == 0 && m_blocks.size() > 1) {
+        size_t byteLength = 0;
+        for (auto &&block : m_blocks) {
+            byteLength += block.byteLength;
+        }
+
+        m_blocks.clear();
+        m_blocks.push_back({std::unique_ptr<byte[]>(new byte[byteLength]), byteLength});
+        m_heldMemory.set(byteLength);
+
+        m_blockIndex = 0;
+        m_offset = 0;
+    }
+}
+
+void MeshArena::release() {
+    assert(m_scopeDepth == 0);
+    m_blocks.clear();
+    m_blockIndex = 0;
+    m_offset = 0;
+    m_heldMemory.set(0);
+}
+
+MeshArena::Scope::Scope()
+    : m_arena(current()), m_blockIndex(m_arena.m_blockIndex), m_offset(m_arena.m_offset) {
+    ++m_arena.m_scopeDepth;
+}
+
+MeshArena::Scope::~Scope() {
+    --m_arena.m_scopeDepth;
+    m_arena.rewind(m_blockIndex, m_offset);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "HeldMemory.h"
+#include "macros.h"
+
+/**
+ * A monotonic arena for the short-lived containers of the extraction of a
+ * mesh: allocating bumps an offset in the current block, deallocating does
+ * nothing, and a Scope releases everything allocated within it at once.
+ *
+ * The blocks are kept for the next mesh, so the arena holds about the
+ * temporaries of the largest mesh, instead of fragmenting the heap with the
+ * containers of thousands of small meshes.
+ *
+ * Each thread has its own arena, but the extraction only uses the arena of
+ * the main thread; containers from the arena must not grow on the workers.
+ */
+class MeshArena {
+  public:
+    MeshArena();
+    ~MeshArena();
+
+    /** The arena of the calling thread */
+    static MeshArena &current();
+
+    void *allocate(size_t byteCount, size_t alignment);
+
+    /** Frees the blocks, outside all scopes, e.g. after an export */
+    void release();
+
+    /** Releases what was allocated in the arena of the calling thread during
+     * its lifetime. Scopes can be nested. */
+    class Scope {
+      public:
+        Scope();
+        ~Scope();
+
+      private:
+        DISALLOW_COPY_MOVE_ASSIGN(Scope);
+
+        MeshArena &m_arena;
+        const size_t m_blockIndex;
+        const size_t m_offset;
+    };
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshArena);
+
+    struct Block {
+        std::unique_ptr<byte[]> data;
+        size_t byteLength;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_blockIndex = 0;
+    size_t m_offset = 0;
+    int m_scopeDepth = 0;
+
+    HeldMemory m_heldMemory{MemoryKind::MESH_ARENA};
+
+    void rewind(size_t blockIndex, size_t offset);
+};
+
+/** A standard allocator from the arena of the thread that creates it */
+template <typename T> class ArenaAllocator {
+  public:
+    typedef T value_type;
+
+    ArenaAllocator() : m_arena(&MeshArena::current()) {}
+    explicit ArenaAllocator(MeshArena &arena) : m_arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.arena()) {}
+
+    T *allocate(const size_t n) {
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    MeshArena *arena() const { return m_arena; }
+
+    template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+        return m_arena == other.arena();
+    }
+
+    template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+        return m_arena != other.arena();
+    }
+
+  private:
+    MeshArena *m_arena;
+};
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+template <typename K, typename V, typename H = std::hash<K>>
+using ArenaUnorderedMap = std::unordered_map<K, V, H, std::equal_to<K>, ArenaAllocator<std::pair<const K, V>>>;
+
+template <typename T> gsl::span<const T> span(const ArenaVector<T> &vec) { return gsl::make_span(vec.data(), vec.size()); }
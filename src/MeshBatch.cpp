@@ -0,0 +1,138 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "ExportStatistics.h"
+#include "ExportablePrimitive.h"
+#include "ExportableResources.h"
+#include "MeshBatch.h"
+#include "MeshQuantization.h"
+#include "Transform.h"
+#include "accessors.h"
+
+// Transforms the elements of a part while they are copied.
+static void transformElements(const VertexSlot &slot, const MMatrix &matrix, const gsl::span<byte> &elements) {
+    if (!slot.shapeIndex.isMainShapeIndex() || elements.empty())
+        return;
+
+    switch (slot.semantic) {
+    case Semantic::POSITION:
+        for (auto &position : mutable_span(reinterpret_span<Position>(elements))) {
+            const auto p = MPoint(position[0], position[1], position[2]) * matrix;
+            position = {static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z)};
+        }
+        break;
+
+    case Semantic::NORMAL: {
+        const auto normalMatrix = matrix.inverse().transpose();
+        for (auto &normal : mutable_span(reinterpret_span<Normal>(elements))) {
+            const auto n = (MVector(normal[0], normal[1], normal[2]) * normalMatrix).normal();
+            normal = {static_cast<float>(n.x), static_cast<float>(n.y), static_cast<float>(n.z)};
+        }
+        break;
+    }
+
+    case Semantic::TANGENT: {
+        // A mirroring matrix flips the bitangent.
+        const auto sign = matrix.det3x3() < 0 ? -1.0f : 1.0f;
+        for (auto &tangent : mutable_span(reinterpret_span<MainShapeTangent>(elements))) {
+            const auto t = (MVector(tangent[0], tangent[1], tangent[2]) * matrix).normal();
+            tangent = {static_cast<float>(t.x), static_cast<float>(t.y), static_cast<float>(t.z), tangent[3] * sign};
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void mergeVertexBuffers(const std::vector<MeshBatchPart> &parts, VertexBuffer &merged) {
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+
+    for (auto &&part : parts) {
+        vertexCount += part.vertexBuffer->maxIndex();
+        indexCount += part.vertexBuffer->indices.size();
+    }
+
+    merged.indices.reserve(indexCount);
+    merged.weldTable.restoreSize(vertexCount);
+
+    Index vertexOffset = 0;
+
+    for (auto &&part : parts) {
+        const auto &vertexBuffer = *part.vertexBuffer;
+
+        // A mirroring matrix flips the winding of the triangles.
+        const auto isMirrored = part.matrix.det3x3() < 0;
+        const auto &indices = vertexBuffer.indices;
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            merged.indices.push_back(vertexOffset + indices[i]);
+            merged.indices.push_back(vertexOffset + indices[isMirrored ? i + 2 : i + 1]);
+            merged.indices.push_back(vertexOffset + indices[isMirrored ? i + 1 : i + 2]);
+        }
+
+        for (auto &&pair : vertexBuffer.componentsMap) {
+            auto &elements = merged.componentsMap[pair.first];
+            const auto offset = elements.size();
+            elements.insert(elements.end(), pair.second.begin(), pair.second.end());
+            transformElements(pair.first, part.matrix, gsl::make_span(elements).subspan(offset));
+        }
+
+        vertexOffset += static_cast<Index>(vertexBuffer.maxIndex());
+    }
+}
+
+MeshBatch::MeshBatch(const std::string &name, const VertexSignature &signature, const std::vector<MeshBatchPart> &parts,
+                     ExportableResources &resources, ExportableMaterial *material) {
+    const auto &args = resources.arguments();
+
+    glNode.name = args.makeName(name);
+    m_glMesh.name = glNode.name;
+    glNode.mesh = &m_glMesh;
+
+    // The quantization needs the bounds of the whole table.
+    VertexBufferTable table;
+    auto &merged = table.emplace(signature, VertexBuffer()).first->second;
+    mergeVertexBuffers(parts, merged);
+
+    if (args.meshQuantization && !args.debugTangentVectors && !args.debugNormalVectors && !args.dracoCompression) {
+        m_quantization = std::make_unique<MeshQuantization>(table, args, true);
+        resources.quantizedAccessors().setUsed();
+
+        auto &trs = m_dequantizationTransform;
+        makeIdentity(trs);
+
+        const auto &offset = m_quantization->positionOffset();
+        const auto scale = m_quantization->positionScale();
+        for (int axis = 0; axis < 3; ++axis) {
+            trs.translation[axis] = offset[axis];
+            trs.scale[axis] = scale;
+        }
+
+        glNode.transform = &trs;
+    }
+
+    m_primitive = std::make_unique<ExportablePrimitive>(name, merged, resources, material, m_quantization.get());
+    m_glMesh.primitives.push_back(&m_primitive->glPrimitive);
+
+    if (auto *statistics = resources.statistics()) {
+        auto &meshStatistics = statistics->addMesh(name);
+        meshStatistics.cornerCount = merged.indices.size();
+        meshStatistics.vertexCount = merged.maxIndex();
+        meshStatistics.primitiveCount = 1;
+
+        const auto &glPrimitive = m_primitive->glPrimitive;
+        meshStatistics.bytesPerSemantic["indices"] += glAccessorByteLength(glPrimitive.indices);
+        for (auto &&attribute : glPrimitive.attributes) {
+            meshStatistics.bytesPerSemantic[attribute.first] += glAccessorByteLength(attribute.second);
+        }
+    }
+}
+
+MeshBatch::~MeshBatch() = default;
+
+void MeshBatch::getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const {
+    m_primitive->getAllAccessors(accessors);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "macros.h"
+
+class ExportableMaterial;
+class ExportablePrimitive;
+class ExportableResources;
+class MeshQuantization;
+
+/** A primitive of a static mesh, with the matrix from the space of its node
+ * to the space of the parent node, see MeshBatch */
+struct MeshBatchPart {
+    const VertexBuffer *vertexBuffer;
+    MMatrix matrix;
+};
+
+/**
+ * Static meshes with the same material and the same parent node, merged into
+ * a single primitive to save draw calls, see -batchStaticMeshes.
+ *
+ * The positions, normals and tangents of each part are baked into the space
+ * of the parent node. The batch is drawn by its own node, a child of the
+ * parent node, that holds the dequantization transform of a quantized batch.
+ */
+class MeshBatch {
+  public:
+    /** The signature is the one of the vertex buffers of the parts */
+    MeshBatch(const std::string &name, const VertexSignature &signature, const std::vector<MeshBatchPart> &parts,
+              ExportableResources &resources, ExportableMaterial *material);
+    ~MeshBatch();
+
+    GLTF::Node glNode;
+
+    void getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshBatch);
+
+    GLTF::Mesh m_glMesh;
+    GLTF::Node::TransformTRS m_dequantizationTransform;
+    std::unique_ptr<MeshQuantization> m_quantization;
+    std::unique_ptr<ExportablePrimitive> m_primitive;
+};
+
+/** Concatenates the vertex buffers of the parts, which must have the same
+ * vertex slots, with the main shape positions, normals and tangents
+ * transformed by the matrices of the parts. Doesn't call Maya. */
+void mergeVertexBuffers(const std::vector<MeshBatchPart> &parts, VertexBuffer &merged);
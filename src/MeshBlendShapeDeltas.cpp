@@ -0,0 +1,159 @@
+#include "externals.h"
+
+#include "DagHelper.h"
+#include "MayaException.h"
+#include "MeshBlendShapeDeltas.h"
+
+// The index of the inputTargetItem holding the full weight target.
+const int fullWeightTargetItemIndex = 6000;
+
+static bool hasUnitWeights(const MPlug &weightsPlug) {
+    MStatus status;
+    const auto count = weightsPlug.numElements(&status);
+    THROW_ON_FAILURE(status);
+
+    for (auto i = 0U; i < count; ++i) {
+        double weight = 1;
+        THROW_ON_FAILURE(weightsPlug.elementByPhysicalIndex(i).getValue(weight));
+        if (weight != 1)
+            return false;
+    }
+
+    return true;
+}
+
+MeshBlendShapeDeltas::MeshBlendShapeDeltas(const MObject &blendShapeDeformer,
+                                           const MFnMesh &fnMesh)
+    : m_fnDeformer(blendShapeDeformer) {
+    MStatus status;
+
+    // The blend shape result must feed the mesh directly, otherwise other
+    // deformers modify the offsets.
+    const auto inMeshPlug = fnMesh.findPlug("inMesh", true, &status);
+    THROW_ON_FAILURE(status);
+
+    const auto sourcePlug = inMeshPlug.source(&status);
+    THROW_ON_FAILURE(status);
+
+    if (sourcePlug.isNull() || sourcePlug.node() != blendShapeDeformer) {
+        m_reason = "other deformers are applied after the blend shapes";
+        return;
+    }
+
+    const auto geometryIndex = sourcePlug.logicalIndex(&status);
+    THROW_ON_FAILURE(status);
+
+    // Local origin (1) stores the offsets in object space.
+    int origin = 0;
+    THROW_ON_FAILURE(DagHelper::getPlugValue(blendShapeDeformer, "origin", origin));
+    if (origin != 1) {
+        m_reason = "the blend shape origin is not local";
+        return;
+    }
+
+    float envelope = 0;
+    THROW_ON_FAILURE(DagHelper::getPlugValue(blendShapeDeformer, "envelope", envelope));
+    if (envelope != 1) {
+        m_reason = "the envelope of the blend shape deformer is not 1";
+        return;
+    }
+
+    const auto inputTargetArrayPlug =
+        m_fnDeformer.findPlug("inputTarget", true, &status);
+    THROW_ON_FAILURE(status);
+
+    m_inputTargetPlug =
+        inputTargetArrayPlug.elementByLogicalIndex(geometryIndex, &status);
+    THROW_ON_FAILURE(status);
+
+    if (!hasUnitWeights(childPlug(m_inputTargetPlug, "baseWeights"))) {
+        m_reason = "the blend shape has painted base weights";
+        return;
+    }
+
+    m_isReadable = true;
+}
+
+MeshBlendShapeDeltas::~MeshBlendShapeDeltas() = default;
+
+MPlug MeshBlendShapeDeltas::childPlug(const MPlug &plug,
+                                      const char *attributeName) const {
+    MStatus status;
+    const auto attribute = m_fnDeformer.attribute(attributeName, &status);
+    THROW_ON_FAILURE(status);
+
+    auto child = plug.child(attribute, &status);
+    THROW_ON_FAILURE(status);
+    return child;
+}
+
+bool MeshBlendShapeDeltas::tryGetTargetDeltas(
+    const int weightIndex, BlendShapeTargetDeltas &deltas) const {
+    if (!m_isReadable)
+        return false;
+
+    MStatus status;
+
+    const auto targetGroupArrayPlug =
+        childPlug(m_inputTargetPlug, "inputTargetGroup");
+
+    const auto targetGroupPlug =
+        targetGroupArrayPlug.elementByLogicalIndex(weightIndex, &status);
+    THROW_ON_FAILURE(status);
+
+    if (!hasUnitWeights(childPlug(targetGroupPlug, "targetWeights")))
+        return false;
+
+    // Only a single full weight target, in-betweens need evaluation.
+    const auto targetItemArrayPlug =
+        childPlug(targetGroupPlug, "inputTargetItem");
+
+    if (targetItemArrayPlug.numElements() != 1)
+        return false;
+
+    const auto targetItemPlug = targetItemArrayPlug.elementByPhysicalIndex(0);
+    if (targetItemPlug.logicalIndex() != fullWeightTargetItemIndex)
+        return false;
+
+    // When a target mesh is still connected, the stored offsets might be stale.
+    if (childPlug(targetItemPlug, "inputGeomTarget").isConnected())
+        return false;
+
+    MObject pointsData;
+    status = childPlug(targetItemPlug, "inputPointsTarget").getValue(pointsData);
+    if (!status || pointsData.isNull())
+        return false;
+
+    MObject componentsData;
+    status = childPlug(targetItemPlug, "inputComponentsTarget")
+                 .getValue(componentsData);
+    if (!status || componentsData.isNull())
+        return false;
+
+    MFnPointArrayData fnPoints(pointsData, &status);
+    THROW_ON_FAILURE(status);
+    deltas.offsets = fnPoints.array();
+
+    MFnComponentListData fnComponents(componentsData, &status);
+    THROW_ON_FAILURE(status);
+
+    deltas.vertexIndices.clear();
+
+    for (auto i = 0U; i < fnComponents.length(); ++i) {
+        const auto component = fnComponents[i];
+        if (!component.hasFn(MFn::kMeshVertComponent))
+            return false;
+
+        MFnSingleIndexedComponent fnComponent(component, &status);
+        THROW_ON_FAILURE(status);
+
+        MIntArray elements;
+        THROW_ON_FAILURE(fnComponent.getElements(elements));
+
+        for (auto j = 0U; j < elements.length(); ++j) {
+            deltas.vertexIndices.append(elements[j]);
+        }
+    }
+
+    return deltas.vertexIndices.length() == deltas.offsets.length();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "macros.h"
+
+/** The sparse object-space offsets of a single blend shape target, as stored
+ * in the blendShape deformer */
+struct BlendShapeTargetDeltas {
+    MIntArray vertexIndices;
+    MPointArray offsets;
+};
+
+/*
+ * Helper class to read the blend shape target deltas directly from the
+ * inputTarget data of a blendShape deformer, without evaluating the deformer
+ * chain. This only works for simple setups, the other targets must be
+ * reconstructed by toggling the weights.
+ */
+class MeshBlendShapeDeltas {
+  public:
+    MeshBlendShapeDeltas(const MObject &blendShapeDeformer,
+                         const MFnMesh &fnMesh);
+    ~MeshBlendShapeDeltas();
+
+    /** False if none of the targets can be read directly, see reason() */
+    bool isReadable() const { return m_isReadable; }
+
+    /** Why the targets cannot be read directly */
+    const std::string &reason() const { return m_reason; }
+
+    /** Reads the deltas of the target driven by the weight with the given
+     * logical index. Returns false if the target must be evaluated instead,
+     * e.g. when it has in-between targets, a live target mesh connection or
+     * painted target weights */
+    bool tryGetTargetDeltas(int weightIndex,
+                            BlendShapeTargetDeltas &deltas) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshBlendShapeDeltas);
+
+    MFnDependencyNode m_fnDeformer;
+    MPlug m_inputTargetPlug;
+    bool m_isReadable = false;
+    std::string m_reason;
+
+    MPlug childPlug(const MPlug &plug, const char *attributeName) const;
+};
@@ -0,0 +1,441 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Digester.h"
+#include "ExportableNode.h"
+#include "ExportableScene.h"
+#include "MayaException.h"
+#include "MeshBlendShapeDeltas.h"
+#include "MeshCache.h"
+#include "dump.h"
+
+// Change this when the stored content or its key change.
+const uint32_t meshCacheVersion = 1;
+
+const char meshCacheMagic[4] = {'M', '2', 'G', 'M'};
+
+template <typename T> static void writeValue(std::ostream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static bool readValue(std::istream &stream, T &value) {
+    return bool(stream.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+template <typename T> static void writeVector(std::ostream &stream, const std::vector<T> &values) {
+    writeValue(stream, static_cast<uint64_t>(values.size()));
+    stream.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T> static bool readVector(std::istream &stream, std::vector<T> &values) {
+    uint64_t size = 0;
+    if (!readValue(stream, size))
+        return false;
+
+    // Don't trust the size of a corrupt file.
+    values.clear();
+    while (values.size() < size) {
+        const auto offset = values.size();
+        values.resize(std::min<size_t>(size, offset + (1 << 20)));
+        if (!stream.read(reinterpret_cast<char *>(values.data() + offset), (values.size() - offset) * sizeof(T)))
+            return false;
+    }
+
+    return true;
+}
+
+static void writeString(std::ostream &stream, const MString &text) {
+    writeVector(stream, std::vector<char>(text.asChar(), text.asChar() + text.length()));
+}
+
+static bool readString(std::istream &stream, MString &text) {
+    std::vector<char> chars;
+    if (!readVector(stream, chars))
+        return false;
+
+    text = MString(chars.data(), static_cast<int>(chars.size()));
+    return true;
+}
+
+static void addMeshGeometry(Digester &digester, const MFnMesh &fnMesh) {
+    MStatus status;
+
+    const auto vertexCount = fnMesh.numVertices();
+    digester.add(vertexCount);
+    digester.add(fnMesh.numPolygons());
+    digester.add(fnMesh.numFaceVertices());
+
+    const auto *points = fnMesh.getRawPoints(&status);
+    THROW_ON_FAILURE(status);
+    digester.addBytes(points, vertexCount * 3 * sizeof(float));
+
+    MIntArray counts;
+    MIntArray ids;
+    THROW_ON_FAILURE(fnMesh.getVertices(counts, ids));
+    digester.addArray(counts);
+    digester.addArray(ids);
+}
+
+static void addMeshAttributes(Digester &digester, const MFnMesh &fnMesh) {
+    MStatus status;
+
+    const auto *normals = fnMesh.getRawNormals(&status);
+    THROW_ON_FAILURE(status);
+    digester.addBytes(normals, fnMesh.numNormals() * 3 * sizeof(float));
+
+    MIntArray counts;
+    MIntArray ids;
+    THROW_ON_FAILURE(fnMesh.getNormalIds(counts, ids));
+    digester.addArray(ids);
+
+    MStringArray uvSetNames;
+    THROW_ON_FAILURE(fnMesh.getUVSetNames(uvSetNames));
+
+    for (unsigned i = 0; i < uvSetNames.length(); ++i) {
+        MFloatArray us;
+        MFloatArray vs;
+        THROW_ON_FAILURE(fnMesh.getUVs(us, vs, &uvSetNames[i]));
+        THROW_ON_FAILURE(fnMesh.getAssignedUVs(counts, ids, &uvSetNames[i]));
+        digester.add(uvSetNames[i]);
+        digester.addArray(us);
+        digester.addArray(vs);
+        digester.addArray(counts);
+        digester.addArray(ids);
+    }
+
+    MStringArray colorSetNames;
+    THROW_ON_FAILURE(fnMesh.getColorSetNames(colorSetNames));
+
+    for (unsigned i = 0; i < colorSetNames.length(); ++i) {
+        MColorArray colors;
+        THROW_ON_FAILURE(fnMesh.getFaceVertexColors(colors, &colorSetNames[i]));
+        digester.add(colorSetNames[i]);
+        digester.add(colors.length());
+        for (unsigned j = 0; j < colors.length(); ++j) {
+            const auto &color = colors[j];
+            digester.add(std::array<float, 4>{color.r, color.g, color.b, color.a});
+        }
+    }
+}
+
+static void addMatrix(Digester &digester, const MMatrix &matrix) { digester.add(matrix.matrix); }
+
+static void addSkinCluster(Digester &digester, const MObject &skin, const MDagPath &shapeDagPath, const int vertexCount) {
+    MStatus status;
+    MFnSkinCluster fnSkin(skin, &status);
+    THROW_ON_FAILURE(status);
+
+    MDagPathArray jointDagPaths;
+    const auto jointCount = fnSkin.influenceObjects(jointDagPaths, &status);
+    THROW_ON_FAILURE(status);
+
+    for (unsigned i = 0; i < jointCount; ++i) {
+        digester.add(jointDagPaths[i].fullPathName());
+        addMatrix(digester, jointDagPaths[i].inclusiveMatrix());
+    }
+
+    // The weights of all vertices in a single query.
+    MFnSingleIndexedComponent fnComponent;
+    const auto components = fnComponent.create(MFn::kMeshVertComponent, &status);
+    THROW_ON_FAILURE(status);
+    THROW_ON_FAILURE(fnComponent.setCompleteData(vertexCount));
+
+    MDoubleArray weights;
+    unsigned influenceCount = 0;
+    if (fnSkin.getWeights(shapeDagPath, components, weights, influenceCount)) {
+        digester.addArray(weights);
+    }
+}
+
+static void addBlendShape(Digester &digester, const MObject &deformer, const MFnMesh &fnMesh) {
+    MStatus status;
+    MFnDependencyNode fnDeformer(deformer, &status);
+    THROW_ON_FAILURE(status);
+
+    const auto weightArrayPlug = fnDeformer.findPlug("weight", true, &status);
+    THROW_ON_FAILURE(status);
+
+    const MeshBlendShapeDeltas targetDeltas(deformer, fnMesh);
+
+    for (unsigned i = 0; i < weightArrayPlug.numElements(); ++i) {
+        const auto weightPlug = weightArrayPlug.elementByPhysicalIndex(i);
+        const auto weightIndex = static_cast<int>(weightPlug.logicalIndex());
+        digester.add(weightIndex);
+        digester.add(weightPlug.asFloat());
+
+        // Live targets are upstream meshes, the others are stored in the deformer.
+        BlendShapeTargetDeltas deltas;
+        if (targetDeltas.isReadable() && targetDeltas.tryGetTargetDeltas(weightIndex, deltas)) {
+            digester.addArray(deltas.vertexIndices);
+            for (unsigned j = 0; j < deltas.offsets.length(); ++j) {
+                const auto &offset = deltas.offsets[j];
+                digester.add(std::array<double, 3>{offset.x, offset.y, offset.z});
+            }
+        }
+    }
+}
+
+MeshCache::MeshCache(const Arguments &args, fs::path folder) : m_args(args), m_folder(std::move(folder)) {}
+
+MeshCache::~MeshCache() = default;
+
+std::string MeshCache::meshKey(const MDagPath &shapeDagPath) const {
+    MStatus status;
+
+    auto dagPath = shapeDagPath;
+    THROW_ON_FAILURE(dagPath.extendToShape());
+
+    MFnMesh fnMesh(dagPath, &status);
+    THROW_ON_FAILURE(status);
+
+    Digester digester;
+    digester.add(meshCacheVersion);
+
+    // The arguments that change the primitives.
+    digester.add(m_args.meshPrimitiveAttributes.to_ullong());
+    digester.add(m_args.blendPrimitiveAttributes.to_ullong());
+    digester.add(m_args.getBakeScaleFactor());
+    digester.add(m_args.rounding.position.decimals);
+    digester.add(m_args.rounding.direction.decimals);
+    digester.add(m_args.rounding.color.decimals);
+    digester.add(m_args.rounding.texCoord.decimals);
+    digester.add(m_args.mikkelsenTangentAngularThreshold);
+    digester.add(m_args.skipSkinClusters);
+    digester.add(m_args.compactSkinJoints);
+    digester.add(m_args.skipBlendShapes);
+    digester.add(m_args.sparseBlendShapeExtraction);
+    digester.add(m_args.recomputeBlendShapeNormals);
+    digester.add(m_args.iteratorMeshExtraction);
+
+    MStringArray ignoredDeformers;
+    THROW_ON_FAILURE(m_args.ignoreMeshDeformers.getSelectionStrings(ignoredDeformers));
+    digester.addArray(ignoredDeformers);
+
+    const auto instanceNumber = dagPath.instanceNumber(&status);
+    THROW_ON_FAILURE(status);
+
+    digester.add(dagPath.fullPathName());
+    digester.add(instanceNumber);
+    addMatrix(digester, dagPath.inclusiveMatrix());
+
+    addMeshGeometry(digester, fnMesh);
+    addMeshAttributes(digester, fnMesh);
+
+    MObjectArray shaders;
+    MIntArray shaderIndices;
+    THROW_ON_FAILURE(fnMesh.getConnectedShaders(instanceNumber, shaders, shaderIndices));
+    for (unsigned i = 0; i < shaders.length(); ++i) {
+        digester.add(MFnDependencyNode(shaders[i]).name());
+    }
+    digester.addArray(shaderIndices);
+
+    const auto inMeshPlug = fnMesh.findPlug("inMesh", true, &status);
+    THROW_ON_FAILURE(status);
+
+    if (inMeshPlug.isConnected()) {
+        MItDependencyGraph dgIt(inMeshPlug, MFn::kInvalid, MItDependencyGraph::kUpstream, MItDependencyGraph::kDepthFirst,
+                                MItDependencyGraph::kNodeLevel, &status);
+        THROW_ON_FAILURE(status);
+
+        dgIt.disablePruningOnFilter();
+
+        for (; !dgIt.isDone(); dgIt.next()) {
+            const auto item = dgIt.currentItem();
+            const MFnDependencyNode fnNode(item);
+
+            digester.add(fnNode.typeName());
+            digester.add(fnNode.name());
+
+            if (item.hasFn(MFn::kMesh)) {
+                addMeshGeometry(digester, MFnMesh(item));
+            } else if (item.hasFn(MFn::kSkinClusterFilter)) {
+                addSkinCluster(digester, item, dagPath, fnMesh.numVertices());
+            } else if (item.hasFn(MFn::kBlendShape)) {
+                addBlendShape(digester, item, fnMesh);
+            }
+        }
+    }
+
+    return digester.hexDigest();
+}
+
+bool MeshCache::load(const std::string &key, ExportableScene &scene, MeshContent &content) {
+    std::ifstream file((m_folder / (key + ".mesh")).string(), ios::in | ios::binary);
+
+    char magic[sizeof(meshCacheMagic)] = {};
+    uint32_t version = 0;
+
+    auto isValid = file.is_open() && file.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), meshCacheMagic) &&
+                   readValue(file, version) && version == meshCacheVersion;
+
+    // The primitives
+    uint64_t entryCount = 0;
+    isValid = isValid && readValue(file, entryCount);
+
+    auto &table = content.cachedTable;
+    table.clear();
+
+    for (uint64_t entryIndex = 0; isValid && entryIndex < entryCount; ++entryIndex) {
+        ShaderIndex shaderIndex = 0;
+        VertexSlotUsage slotUsage = 0;
+        uint64_t vertexCount = 0;
+        uint64_t slotCount = 0;
+
+        isValid = readValue(file, shaderIndex) && readValue(file, slotUsage) && readValue(file, vertexCount);
+        if (!isValid)
+            break;
+
+        auto &vertexBuffer = table[VertexSignature(shaderIndex, slotUsage)];
+        vertexBuffer.weldTable.restoreSize(vertexCount);
+
+        isValid = readVector(file, vertexBuffer.indices) && readValue(file, slotCount);
+
+        for (uint64_t slotIndex = 0; isValid && slotIndex < slotCount; ++slotIndex) {
+            int32_t shapeIndex = 0;
+            int32_t semantic = 0;
+            SetIndex setIndex = 0;
+
+            isValid = readValue(file, shapeIndex) && readValue(file, semantic) && readValue(file, setIndex) && shapeIndex >= 0 &&
+                      semantic >= 0 && semantic < Semantic::COUNT;
+
+            isValid = isValid &&
+                      readVector(file, vertexBuffer.componentsMap[VertexSlot(ShapeIndex::shape(shapeIndex),
+                                                                             static_cast<Semantic::Kind>(semantic), setIndex)]);
+        }
+    }
+
+    // The Maya objects, resolved by name
+    uint32_t shaderGroupCount = 0;
+    isValid = isValid && readValue(file, shaderGroupCount);
+
+    content.shaderGroups.clear();
+
+    for (uint32_t i = 0; isValid && i < shaderGroupCount; ++i) {
+        MString name;
+        MSelectionList selection;
+        MObject shaderGroup;
+        isValid = readString(file, name) && selection.add(name) && selection.getDependNode(0, shaderGroup);
+        content.shaderGroups.append(shaderGroup);
+    }
+
+    uint32_t jointCount = 0;
+    isValid = isValid && readValue(file, content.isSkinned) && readValue(file, jointCount);
+
+    content.joints.clear();
+
+    for (uint32_t i = 0; isValid && i < jointCount; ++i) {
+        MString name;
+        double ibm[4][4];
+        MSelectionList selection;
+        MDagPath jointDagPath;
+        isValid = readString(file, name) && readValue(file, ibm) && selection.add(name) && selection.getDagPath(0, jointDagPath);
+
+        auto *jointNode = isValid ? scene.getNode(jointDagPath) : nullptr;
+        isValid = jointNode != nullptr;
+
+        if (isValid) {
+            content.joints.emplace_back(jointNode, MMatrix(ibm));
+        }
+    }
+
+    uint32_t targetCount = 0;
+    isValid = isValid && readValue(file, targetCount);
+
+    content.morphTargets.clear();
+
+    for (uint32_t i = 0; isValid && i < targetCount; ++i) {
+        MString name;
+        MeshMorphTarget target;
+        MSelectionList selection;
+        isValid = readString(file, name) && readValue(file, target.initialWeight) && selection.add(name) &&
+                  selection.getPlug(0, target.weightPlug);
+        content.morphTargets.emplace_back(target);
+    }
+
+    isValid = isValid && file.peek() == std::istream::traits_type::eof();
+
+    if (isValid) {
+        ++m_hitCount;
+        content.table = &table;
+        content.cachedTableMemory.set(heldBytes(table));
+    } else {
+        ++m_missCount;
+        table.clear();
+    }
+
+    return isValid;
+}
+
+void MeshCache::store(const std::string &key, const MeshContent &content) const {
+    std::error_code error;
+    create_directories(m_folder, error);
+
+    const auto path = m_folder / (key + ".mesh");
+
+    // Written under another name first, so a failed write never leaves a
+    // truncated file that would be read later.
+    auto tempPath = path;
+    tempPath += ".tmp";
+
+    {
+        std::ofstream file(tempPath.string(), ios::out | ios::binary | ios::trunc);
+        file.write(meshCacheMagic, sizeof(meshCacheMagic));
+        writeValue(file, meshCacheVersion);
+
+        writeValue(file, static_cast<uint64_t>(content.table->size()));
+
+        for (auto &&pair : *content.table) {
+            const auto &vertexBuffer = pair.second;
+            writeValue(file, pair.first.shaderIndex);
+            writeValue(file, pair.first.slotUsage);
+            writeValue(file, static_cast<uint64_t>(vertexBuffer.maxIndex()));
+            writeVector(file, vertexBuffer.indices);
+            writeValue(file, static_cast<uint64_t>(vertexBuffer.componentsMap.size()));
+
+            for (auto &&slot : vertexBuffer.componentsMap) {
+                writeValue(file, static_cast<int32_t>(slot.first.shapeIndex.arrayIndex()));
+                writeValue(file, static_cast<int32_t>(slot.first.semantic));
+                writeValue(file, slot.first.setIndex);
+                writeVector(file, slot.second);
+            }
+        }
+
+        writeValue(file, static_cast<uint32_t>(content.shaderGroups.length()));
+        for (unsigned i = 0; i < content.shaderGroups.length(); ++i) {
+            writeString(file, MFnDependencyNode(content.shaderGroups[i]).name());
+        }
+
+        writeValue(file, content.isSkinned);
+        writeValue(file, static_cast<uint32_t>(content.joints.size()));
+        for (auto &&joint : content.joints) {
+            writeString(file, joint.node->dagPath.fullPathName());
+            writeValue(file, joint.inverseBindMatrix.matrix);
+        }
+
+        writeValue(file, static_cast<uint32_t>(content.morphTargets.size()));
+        for (auto &&target : content.morphTargets) {
+            writeString(file, target.weightPlug.name());
+            writeValue(file, target.initialWeight);
+        }
+
+        if (!file) {
+            MayaException::printWarning(formatted("Failed to write the mesh cache file '%s'", tempPath.string().c_str()));
+            return;
+        }
+    }
+
+    fs::rename(tempPath, path, error);
+    if (error) {
+        MayaException::printWarning(formatted("Failed to write the mesh cache file '%s'", path.string().c_str()));
+        fs::remove(tempPath, error);
+    }
+}
+
+void MeshCache::printStatistics() const {
+    const auto total = m_hitCount + m_missCount;
+    if (total == 0)
+        return;
+
+    cout << prefix << "Mesh cache: " << m_hitCount << " of " << total << " meshes read, " << m_missCount << " extracted ("
+         << m_hitCount * 100 / total << "% hit rate)" << endl;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "MeshSkeleton.h"
+#include "filesystem.h"
+#include "macros.h"
+
+class Arguments;
+class ExportableScene;
+
+struct MeshMorphTarget {
+    MPlug weightPlug;
+    float initialWeight;
+};
+
+/** What an ExportableMesh is built from: the welded primitives of a Maya
+ * mesh, and how these are shaded, skinned and morphed. */
+struct MeshContent {
+    const VertexBufferTable *table = nullptr;
+
+    // The shading groups of the primitives, indexed by shader index.
+    MObjectArray shaderGroups;
+
+    bool isSkinned = false;
+    MeshJoints joints;
+
+    std::vector<MeshMorphTarget> morphTargets;
+
+    // Holds the table when it is read from the cache.
+    VertexBufferTable cachedTable;
+    HeldMemory cachedTableMemory{MemoryKind::WELDED_VERTICES};
+};
+
+/**
+ * Stores the welded primitives of the exported meshes in a folder, so meshes
+ * that didn't change since the previous export are not extracted again.
+ *
+ * Each mesh is stored in a file named after a hash of cheap Maya queries:
+ * the topology, the points, normals, UVs and colors, the shading groups,
+ * the nodes upstream of the mesh with the points of upstream meshes, the
+ * skin weights, influences and blend shape target deltas, and the export
+ * arguments that change the primitives. Changing an in-between target, or
+ * the painted weights of a blend shape target, is not detected.
+ *
+ * The primitives of a mesh read from the cache can be in another order.
+ */
+class MeshCache {
+  public:
+    MeshCache(const Arguments &args, fs::path folder);
+    ~MeshCache();
+
+    /** The key of the mesh shape, a hex string */
+    std::string meshKey(const MDagPath &shapeDagPath) const;
+
+    /** Reads the content of the mesh when it is in the cache, returns false on a miss */
+    bool load(const std::string &key, ExportableScene &scene, MeshContent &content);
+
+    /** Writes the content of a mesh that missed */
+    void store(const std::string &key, const MeshContent &content) const;
+
+    void printStatistics() const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshCache);
+
+    const Arguments &m_args;
+    const fs::path m_folder;
+
+    size_t m_hitCount = 0;
+    size_t m_missCount = 0;
+};
@@ -1,17 +1,17 @@
 #include "externals.h"
 
+#include "Arguments.h"
 #include "MayaException.h"
+#include "MeshArena.h"
 #include "MeshIndices.h"
 #include "dump.h"
 
 MeshIndices::MeshIndices(const MeshSemantics *meshSemantics,
-                         const MFnMesh &fnMesh)
+                         const MFnMesh &fnMesh, const Arguments &args)
     : meshName(fnMesh.partialPathName().asChar()), semantics(*meshSemantics) {
-    MStatus status;
-
     const auto instanceCount = fnMesh.instanceCount(true);
 
-    std::vector<MIntArray> mapPolygonToShaderPerInstance(instanceCount);
+    ArenaVector<MIntArray> mapPolygonToShaderPerInstance(instanceCount);
 
     const auto numPolygons = fnMesh.numPolygons();
 
@@ -24,6 +24,70 @@ MeshIndices::MeshIndices(const MeshSemantics *meshSemantics,
         shading.primitiveToShaderIndexMap.reserve(numPolygons * 2);
     }
 
+    if (args.iteratorMeshExtraction) {
+        extractWithIterator(fnMesh, mapPolygonToShaderPerInstance);
+    } else {
+        extractInBulk(fnMesh, mapPolygonToShaderPerInstance);
+    }
+
+    size_t heldByteCount =
+        heldBytes(m_triangleToFaceIndexMap) + heldBytes(m_cornerTable);
+    for (auto &&pair : m_shadingPerInstance) {
+        heldByteCount += heldBytes(pair.second.primitiveToShaderIndexMap);
+    }
+    m_heldMemory.set(heldByteCount);
+}
+
+MeshIndices::ColumnWriterTable MeshIndices::allocateTable() {
+    const auto cornerCount = size_t(m_TriangleCount) * 3;
+
+    // The vertex joint assignments have the same indices as the points.
+    const auto isAliasOfPositions = [](const Semantic::Kind kind) {
+        return kind == Semantic::WEIGHTS || kind == Semantic::JOINTS;
+    };
+
+    size_t columnCount = 0;
+    for (auto kind = 0; kind < Semantic::COUNT; ++kind) {
+        if (!isAliasOfPositions(Semantic::from(kind))) {
+            columnCount += semantics.descriptions(Semantic::from(kind)).size();
+        }
+    }
+
+    m_cornerTable.assign(columnCount * cornerCount, NoIndex);
+
+    // The positions come before the skin weights and joints aliasing them.
+    ColumnWriterTable writers;
+    auto column = m_cornerTable.data();
+
+    for (auto kind = 0; kind < Semantic::COUNT; ++kind) {
+        auto &indexSet = m_table.at(kind);
+        auto &writerSet = writers.at(kind);
+        const auto semantic = Semantic::from(kind);
+        const auto n = semantics.descriptions(semantic).size();
+        for (auto set = 0U; set < n; ++set) {
+            if (isAliasOfPositions(semantic)) {
+                indexSet.push_back(m_table.at(Semantic::POSITION).at(0));
+            } else {
+                indexSet.push_back(CornerIndices(column, cornerCount));
+                writerSet.push_back(ColumnWriter{column});
+                column += cornerCount;
+            }
+        }
+    }
+
+    m_triangleToFaceIndexMap.reserve(m_TriangleCount);
+
+    return writers;
+}
+
+void MeshIndices::extractWithIterator(
+    const MFnMesh &fnMesh,
+    const ArenaVector<MIntArray> &mapPolygonToShaderPerInstance) {
+    MStatus status;
+
+    const auto instanceCount =
+        static_cast<unsigned>(mapPolygonToShaderPerInstance.size());
+
     m_TriangleCount = 0;
     for (MItMeshPolygon itPoly(fnMesh.object()); !itPoly.isDone();
          itPoly.next()) {
@@ -32,21 +96,13 @@ MeshIndices::MeshIndices(const MeshSemantics *meshSemantics,
         m_TriangleCount += triangleCount;
     }
 
-    for (auto kind = 0; kind < Semantic::COUNT; ++kind) {
-        auto &indexSet = m_table.at(kind);
-        const auto n = semantics.descriptions(Semantic::from(kind)).size();
-        for (auto set = 0U; set < n; ++set) {
-            IndexVector indices;
-            indices.reserve(m_TriangleCount * 3);
-            indexSet.push_back(indices);
-        }
-    }
+    auto writers = allocateTable();
 
-    auto &positions = m_table.at(Semantic::POSITION).at(0);
-    auto &normals = m_table.at(Semantic::NORMAL).at(0);
-    auto &texCoordSets = m_table.at(Semantic::TEXCOORD);
-    auto &tangentSets = m_table.at(Semantic::TANGENT);
-    auto &colorSets = m_table.at(Semantic::COLOR);
+    auto &positions = writers.at(Semantic::POSITION).at(0);
+    auto &normals = writers.at(Semantic::NORMAL).at(0);
+    auto &texCoordSets = writers.at(Semantic::TEXCOORD);
+    auto &tangentSets = writers.at(Semantic::TANGENT);
+    auto &colorSets = writers.at(Semantic::COLOR);
 
     auto &colorSemantics = semantics.descriptions(Semantic::COLOR);
     auto &texCoordSemantics = semantics.descriptions(Semantic::TEXCOORD);
@@ -59,14 +115,12 @@ MeshIndices::MeshIndices(const MeshSemantics *meshSemantics,
     const auto numVertices = fnMesh.numVertices(&status);
     THROW_ON_FAILURE(status);
 
-    std::vector<int> localPolygonVertices(numVertices);
+    ArenaVector<int> localPolygonVertices(numVertices);
 
     MPointArray triangleVertexPoints;
     MIntArray triangleVertexIndices;
     MIntArray polygonVertexIndices;
 
-    m_triangleToFaceIndexMap.reserve(m_TriangleCount);
-
     for (MItMeshPolygon itPoly(fnMesh.object()); !itPoly.isDone();
          itPoly.next()) {
         const auto polygonIndex = itPoly.index(&status);
@@ -174,17 +228,163 @@ MeshIndices::MeshIndices(const MeshSemantics *meshSemantics,
             }
         }
     }
+}
 
-    // The indices of the vertex joint assignments are the same as the points.
-    // TODO: We should use spans instead of copying the vectors...
-    auto &vertexJointWeightsSets = m_table.at(Semantic::WEIGHTS);
-    for (auto &set : vertexJointWeightsSets) {
-        set = positions;
+void MeshIndices::extractInBulk(
+    const MFnMesh &fnMesh,
+    const ArenaVector<MIntArray> &mapPolygonToShaderPerInstance) {
+    MStatus status;
+
+    const auto instanceCount =
+        static_cast<unsigned>(mapPolygonToShaderPerInstance.size());
+
+    MIntArray triangleCounts;
+    MIntArray triangleVertexIndices;
+    THROW_ON_FAILURE(fnMesh.getTriangles(triangleCounts, triangleVertexIndices));
+
+    MIntArray polygonVertexCounts;
+    MIntArray polygonVertexIndices;
+    THROW_ON_FAILURE(
+        fnMesh.getVertices(polygonVertexCounts, polygonVertexIndices));
+
+    MIntArray normalCounts;
+    MIntArray normalIds;
+    THROW_ON_FAILURE(fnMesh.getNormalIds(normalCounts, normalIds));
+
+    const int numPolygons = triangleCounts.length();
+
+    m_TriangleCount = 0;
+    for (auto polygonIndex = 0; polygonIndex < numPolygons; ++polygonIndex) {
+        m_TriangleCount += triangleCounts[polygonIndex];
     }
 
-    auto &vertexJointIndicesSets = m_table.at(Semantic::JOINTS);
-    for (auto &set : vertexJointIndicesSets) {
-        set = positions;
+    auto writers = allocateTable();
+
+    auto &positions = writers.at(Semantic::POSITION).at(0);
+    auto &normals = writers.at(Semantic::NORMAL).at(0);
+    auto &texCoordSets = writers.at(Semantic::TEXCOORD);
+    auto &tangentSets = writers.at(Semantic::TANGENT);
+    auto &colorSets = writers.at(Semantic::COLOR);
+
+    auto &colorSemantics = semantics.descriptions(Semantic::COLOR);
+    auto &texCoordSemantics = semantics.descriptions(Semantic::TEXCOORD);
+    auto &tangentSemantics = semantics.descriptions(Semantic::TANGENT);
+
+    const auto colorSetCount = colorSemantics.size();
+    const auto texCoordSetCount = texCoordSemantics.size();
+    const auto tangentSetCount = tangentSemantics.size();
+
+    // Per UV set, the number of assigned UVs per polygon (zero when the
+    // polygon is not mapped) and the flat list of assigned UV ids.
+    // Tangent sets are tied to UV sets, so they need the same information.
+    struct AssignedUVs {
+        MIntArray counts;
+        MIntArray ids;
+        unsigned offset = 0;
+    };
+
+    const auto getAssignedUVs =
+        [&](const VertexComponentSetDescriptionPerSetIndex &descriptions) {
+            ArenaVector<AssignedUVs> result(descriptions.size());
+            for (auto setIndex = 0U; setIndex < descriptions.size();
+                 ++setIndex) {
+                auto &uvs = result[setIndex];
+                THROW_ON_FAILURE(fnMesh.getAssignedUVs(
+                    uvs.counts, uvs.ids, &descriptions[setIndex].setName));
+            }
+            return result;
+        };
+
+    auto texCoordUVs = getAssignedUVs(texCoordSemantics);
+    auto tangentUVs = getAssignedUVs(tangentSemantics);
+
+    const auto numVertices = fnMesh.numVertices(&status);
+    THROW_ON_FAILURE(status);
+
+    ArenaVector<int> localPolygonVertices(numVertices);
+
+    // Offset of the first face-vertex of the current polygon. Maya stores
+    // normal ids and tangents per face-vertex, in polygon order.
+    unsigned faceVertexOffset = 0;
+    unsigned triangleVertexOffset = 0;
+
+    for (auto polygonIndex = 0; polygonIndex < numPolygons; ++polygonIndex) {
+        const auto numTrianglesInPolygon = triangleCounts[polygonIndex];
+        const auto numPolygonVertices = polygonVertexCounts[polygonIndex];
+
+        // Map mesh-vertex-indices to face-vertex-indices, just like the
+        // iterator path does.
+        for (auto polygonVertexIndex = 0;
+             polygonVertexIndex < numPolygonVertices; ++polygonVertexIndex) {
+            const auto meshVertexIndex =
+                polygonVertexIndices[faceVertexOffset + polygonVertexIndex];
+            localPolygonVertices[meshVertexIndex] = polygonVertexIndex;
+        }
+
+        for (auto localTriangleIndex = 0;
+             localTriangleIndex < numTrianglesInPolygon; ++localTriangleIndex) {
+            m_triangleToFaceIndexMap.emplace_back(polygonIndex);
+
+            for (unsigned instanceIndex = 0; instanceIndex < instanceCount;
+                 ++instanceIndex) {
+                auto &shading = m_shadingPerInstance[instanceIndex];
+                const auto shaderIndex = mapPolygonToShaderPerInstance.at(
+                    instanceIndex)[polygonIndex];
+                shading.primitiveToShaderIndexMap.push_back(shaderIndex);
+            }
+
+            for (auto i = 0; i < 3; ++i, ++triangleVertexOffset) {
+                const auto meshVertexIndex =
+                    triangleVertexIndices[triangleVertexOffset];
+                const auto localVertexIndex =
+                    localPolygonVertices[meshVertexIndex];
+                const auto faceVertexIndex =
+                    faceVertexOffset + localVertexIndex;
+
+                positions.push_back(polygonVertexIndices[faceVertexIndex]);
+                normals.push_back(normalIds[faceVertexIndex]);
+
+                for (auto setIndex = 0U; setIndex < colorSetCount; ++setIndex) {
+                    // Maya has no bulk query for color ids that honors
+                    // unmapped face-vertices, so use the function set here.
+                    int colorIndex;
+                    const auto &colorSetName = colorSemantics[setIndex].setName;
+                    status = fnMesh.getColorIndex(polygonIndex,
+                                                  localVertexIndex, colorIndex,
+                                                  &colorSetName);
+                    colorSets.at(setIndex).push_back(
+                        status && colorIndex >= 0 ? colorIndex : NoIndex);
+                }
+
+                for (auto setIndex = 0U; setIndex < texCoordSetCount;
+                     ++setIndex) {
+                    const auto &uvs = texCoordUVs[setIndex];
+                    texCoordSets.at(setIndex).push_back(
+                        uvs.counts[polygonIndex] > 0
+                            ? uvs.ids[uvs.offset + localVertexIndex]
+                            : NoIndex);
+                }
+
+                for (auto setIndex = 0U; setIndex < tangentSetCount;
+                     ++setIndex) {
+                    const auto &uvs = tangentUVs[setIndex];
+                    tangentSets.at(setIndex).push_back(
+                        uvs.counts[polygonIndex] > 0
+                            ? static_cast<Index>(faceVertexIndex)
+                            : NoIndex);
+                }
+            }
+        }
+
+        faceVertexOffset += numPolygonVertices;
+
+        for (auto &uvs : texCoordUVs) {
+            uvs.offset += uvs.counts[polygonIndex];
+        }
+
+        for (auto &uvs : tangentUVs) {
+            uvs.offset += uvs.counts[polygonIndex];
+        }
     }
 }
 
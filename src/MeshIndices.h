@@ -1,5 +1,7 @@
 #pragma once
 
+#include "HeldMemory.h"
+#include "MeshArena.h"
 #include "MeshSemantics.h"
 #include "macros.h"
 #include "sceneTypes.h"
@@ -20,7 +22,11 @@
 // we determine what semantics are actually used
 const Index NoIndex = -1;
 
-typedef std::vector<IndexVector> VertexElementIndicesPerSetIndex;
+// The indices of the corners in the elements of a semantic set, a column of
+// the corner table of the mesh.
+typedef gsl::span<const Index> CornerIndices;
+
+typedef std::vector<CornerIndices> VertexElementIndicesPerSetIndex;
 typedef std::array<VertexElementIndicesPerSetIndex, Semantic::COUNT>
     VertexElementIndicesPerSetIndexTable;
 typedef std::vector<bool> ShaderUsageVector;
@@ -41,7 +47,8 @@ typedef std::map<InstanceNumber, MeshShading> MeshShadingPerInstance;
 
 class MeshIndices {
   public:
-    MeshIndices(const MeshSemantics *meshSemantics, const MFnMesh &fnMesh);
+    MeshIndices(const MeshSemantics *meshSemantics, const MFnMesh &fnMesh,
+                const class Arguments &args);
     virtual ~MeshIndices();
 
     const VertexElementIndicesPerSetIndexTable &table() const {
@@ -59,7 +66,7 @@ class MeshIndices {
         return perPrimitiveVertexCount() * primitiveCount();
     }
 
-    const IndexVector &indicesAt(const size_t semanticIndex,
+    const CornerIndices &indicesAt(const size_t semanticIndex,
                                  const size_t setIndex) const {
         return m_table.at(semanticIndex).at(setIndex);
     }
@@ -75,10 +82,43 @@ class MeshIndices {
     void dump(class IndentableStream &out, const std::string &name) const;
 
   private:
+    // Appends the indices of a semantic set to its column during extraction.
+    struct ColumnWriter {
+        Index *next;
+        void push_back(const Index index) { *next++ = index; }
+    };
+
+    typedef std::array<std::vector<ColumnWriter>, Semantic::COUNT>
+        ColumnWriterTable;
+
+    // Allocates the corner table for m_TriangleCount triangles, returns the
+    // writers of its columns.
+    ColumnWriterTable allocateTable();
+
+    // Walks the polygons with MItMeshPolygon, one API call per corner.
+    void extractWithIterator(
+        const MFnMesh &fnMesh,
+        const ArenaVector<MIntArray> &mapPolygonToShaderPerInstance);
+
+    // Uses the whole-mesh array queries of MFnMesh, same output.
+    void extractInBulk(
+        const MFnMesh &fnMesh,
+        const ArenaVector<MIntArray> &mapPolygonToShaderPerInstance);
+
     int m_TriangleCount;
+
+    // The corner table, in structure-of-arrays layout: one column of
+    // m_TriangleCount * 3 indices per semantic set with its own indices.
+    // The skin weights and joints have the indices of the positions, so their
+    // sets are views of the position column, rather than copies.
+    IndexVector m_cornerTable;
+
+    // The column of each semantic set, in the corner table.
     VertexElementIndicesPerSetIndexTable m_table;
     MeshShadingPerInstance m_shadingPerInstance;
     TriangleToFaceIndexMap m_triangleToFaceIndexMap;
 
+    HeldMemory m_heldMemory{MemoryKind::MESH_INDICES};
+
     DISALLOW_COPY_MOVE_ASSIGN(MeshIndices);
 };
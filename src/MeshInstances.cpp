@@ -0,0 +1,109 @@
+#include "externals.h"
+
+#include "MeshInstances.h"
+#include "accessors.h"
+#include "jsonPatch.h"
+
+MeshInstances::MeshInstances() = default;
+
+MeshInstances::~MeshInstances() = default;
+
+GLTF::Node *MeshInstances::addGroup(const std::string &name, GLTF::Mesh *mesh,
+                                    const std::vector<GLTF::Node::TransformTRS> &transforms) {
+    auto group = std::make_unique<MeshInstanceGroup>();
+    group->node.name = name;
+    group->node.mesh = mesh;
+
+    const auto count = transforms.size();
+    group->translations.reserve(count);
+    group->rotations.reserve(count);
+    group->scales.reserve(count);
+
+    bool hasTranslation = false;
+    bool hasRotation = false;
+    bool hasScale = false;
+
+    for (auto &&trs : transforms) {
+        const Position t = {trs.translation[0], trs.translation[1], trs.translation[2]};
+        const Rotation r = {trs.rotation[0], trs.rotation[1], trs.rotation[2], trs.rotation[3]};
+        const Scale s = {trs.scale[0], trs.scale[1], trs.scale[2]};
+
+        hasTranslation |= t[0] != 0 || t[1] != 0 || t[2] != 0;
+        hasRotation |= r[0] != 0 || r[1] != 0 || r[2] != 0 || r[3] != 1;
+        hasScale |= s[0] != 1 || s[1] != 1 || s[2] != 1;
+
+        group->translations.emplace_back(t);
+        group->rotations.emplace_back(r);
+        group->scales.emplace_back(s);
+    }
+
+    const auto accessorName = [&](const char *path) { return name.empty() ? name : name + "/instances/" + path; };
+
+    // The extension needs at least one attribute.
+    if (hasTranslation || (!hasRotation && !hasScale)) {
+        group->translationAccessor =
+            contiguousChannelAccessor(accessorName("T"), reinterpret_span<float>(group->translations), 3);
+    }
+
+    if (hasRotation) {
+        group->rotationAccessor =
+            contiguousChannelAccessor(accessorName("R"), reinterpret_span<float>(group->rotations), 4);
+    }
+
+    if (hasScale) {
+        group->scaleAccessor =
+            contiguousChannelAccessor(accessorName("S"), reinterpret_span<float>(group->scales), 3);
+    }
+
+    m_groups.emplace_back(std::move(group));
+    return &m_groups.back()->node;
+}
+
+void MeshInstances::getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const {
+    for (auto &&group : m_groups) {
+        for (auto *accessor : {group->translationAccessor.get(), group->rotationAccessor.get(),
+                               group->scaleAccessor.get()}) {
+            if (accessor) {
+                accessors.emplace_back(accessor);
+            }
+        }
+    }
+}
+
+void MeshInstances::patchJSON(rapidjson::Document &document) const {
+    if (m_groups.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    for (auto &&group : m_groups) {
+        rapidjson::Value jsonAttributes(rapidjson::kObjectType);
+
+        if (group->translationAccessor) {
+            jsonAttributes.AddMember("TRANSLATION", addAccessor(document, group->translationAccessor.get()),
+                                     allocator);
+        }
+
+        if (group->rotationAccessor) {
+            jsonAttributes.AddMember("ROTATION", addAccessor(document, group->rotationAccessor.get()), allocator);
+        }
+
+        if (group->scaleAccessor) {
+            jsonAttributes.AddMember("SCALE", addAccessor(document, group->scaleAccessor.get()), allocator);
+        }
+
+        rapidjson::Value jsonInstancing(rapidjson::kObjectType);
+        jsonInstancing.AddMember("attributes", jsonAttributes, allocator);
+
+        auto &jsonNode = document["nodes"][group->node.id];
+
+        if (!jsonNode.HasMember("extensions")) {
+            jsonNode.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        jsonNode["extensions"].AddMember("EXT_mesh_gpu_instancing", jsonInstancing, allocator);
+    }
+
+    // Without the extension, the instances would be missing.
+    addExtensionUsed(document, "EXT_mesh_gpu_instancing", true);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+#include "sceneTypes.h"
+
+/** The nodes drawing a single mesh many times, using EXT_mesh_gpu_instancing */
+struct MeshInstanceGroup {
+    GLTF::Node node;
+
+    PositionVector translations;
+    RotationVector rotations;
+    ScaleVector scales;
+
+    // Null when all instances have the identity value.
+    std::unique_ptr<GLTF::Accessor> translationAccessor;
+    std::unique_ptr<GLTF::Accessor> rotationAccessor;
+    std::unique_ptr<GLTF::Accessor> scaleAccessor;
+};
+
+/**
+ * Keeps track of the GPU instanced meshes of the asset.
+ * The COLLADA2GLTF object model doesn't know about the extension, so the
+ * instance transform accessors are packed with the other accessors, and the
+ * JSON is patched after it is written.
+ */
+class MeshInstances {
+  public:
+    MeshInstances();
+    ~MeshInstances();
+
+    /** Creates a node drawing the mesh with each of the instance transforms.
+     * The caller must add the node to the scene. An empty name disables the
+     * names of the node and its accessors. */
+    GLTF::Node *
+    addGroup(const std::string &name, GLTF::Mesh *mesh,
+             const std::vector<GLTF::Node::TransformTRS> &transforms);
+
+    bool empty() const { return m_groups.empty(); }
+
+    void getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const;
+
+    /** Adds the extension and the instance accessors to the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshInstances);
+
+    std::vector<std::unique_ptr<MeshInstanceGroup>> m_groups;
+};
@@ -0,0 +1,72 @@
+#include "externals.h"
+
+#include "MeshLods.h"
+#include "jsonPatch.h"
+
+MeshLods::MeshLods() = default;
+
+MeshLods::~MeshLods() = default;
+
+void MeshLods::addChain(GLTF::Node *node, const std::vector<GLTF::Node *> &lodNodes,
+                        const std::vector<double> &coverages) {
+    m_chains.push_back({node, lodNodes, coverages});
+}
+
+void MeshLods::patchJSON(rapidjson::Document &document) const {
+    if (m_chains.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    for (auto &&chain : m_chains) {
+        // A node that is not part of the scene isn't written.
+        if (chain.node->id < 0)
+            continue;
+
+        auto &jsonNode = document["nodes"][chain.node->id];
+
+        rapidjson::Value jsonIds(rapidjson::kArrayType);
+        for (auto *lodNode : chain.lodNodes) {
+            jsonIds.PushBack(lodNode->id, allocator);
+        }
+
+        // The levels are only drawn instead of the node.
+        if (jsonNode.HasMember("children")) {
+            auto &jsonChildren = jsonNode["children"];
+            for (auto it = jsonChildren.Begin(); it != jsonChildren.End();) {
+                const auto isLod = std::any_of(chain.lodNodes.begin(), chain.lodNodes.end(),
+                                               [&](const GLTF::Node *lodNode) { return it->GetInt() == lodNode->id; });
+                it = isLod ? jsonChildren.Erase(it) : it + 1;
+            }
+
+            if (jsonChildren.Empty()) {
+                jsonNode.RemoveMember("children");
+            }
+        }
+
+        rapidjson::Value jsonLod(rapidjson::kObjectType);
+        jsonLod.AddMember("ids", jsonIds, allocator);
+
+        if (!jsonNode.HasMember("extensions")) {
+            jsonNode.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        jsonNode["extensions"].AddMember("MSFT_lod", jsonLod, allocator);
+
+        if (!chain.coverages.empty()) {
+            rapidjson::Value jsonCoverages(rapidjson::kArrayType);
+            for (auto coverage : chain.coverages) {
+                jsonCoverages.PushBack(coverage, allocator);
+            }
+
+            if (!jsonNode.HasMember("extras")) {
+                jsonNode.AddMember("extras", rapidjson::Value(rapidjson::kObjectType), allocator);
+            }
+
+            setMember(jsonNode["extras"], "MSFT_screencoverage", std::move(jsonCoverages), allocator);
+        }
+    }
+
+    // Without the extension, the mesh is drawn at full detail.
+    addExtensionUsed(document, "MSFT_lod", false);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "macros.h"
+
+/** The levels of detail of a mesh node, using MSFT_lod */
+struct MeshLodChain {
+    GLTF::Node *node;
+    std::vector<GLTF::Node *> lodNodes;
+    std::vector<double> coverages;
+};
+
+/**
+ * Keeps track of the mesh nodes with levels of detail, see -lodRatios.
+ * The COLLADA2GLTF object model doesn't know about the extension, so the
+ * level nodes are written as children of the mesh node, and the JSON is
+ * patched after it is written, to make these alternatives instead.
+ */
+class MeshLods {
+  public:
+    MeshLods();
+    ~MeshLods();
+
+    /** The level nodes must be children of the node. The coverages are the
+     * MSFT_screencoverage of the node and each level, or empty. */
+    void addChain(GLTF::Node *node, const std::vector<GLTF::Node *> &lodNodes, const std::vector<double> &coverages);
+
+    bool empty() const { return m_chains.empty(); }
+
+    /** Moves the level nodes from the children of the node to the extension */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshLods);
+
+    std::vector<MeshLodChain> m_chains;
+};
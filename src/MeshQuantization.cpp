@@ -0,0 +1,343 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "MeshQuantization.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+template <typename T> static T encodeSigned(const float value) {
+    const float maxValue = std::numeric_limits<T>::max();
+    const float clamped = std::max(-1.0f, std::min(1.0f, value));
+    return static_cast<T>(std::lround(clamped * maxValue));
+}
+
+template <typename T> static T encodeUnsigned(const float value) {
+    const float maxValue = std::numeric_limits<T>::max();
+    const float clamped = std::max(0.0f, std::min(1.0f, value));
+    return static_cast<T>(std::lround(clamped * maxValue));
+}
+
+template <typename T, typename Encoder>
+static void encodeComponents(const gsl::span<const float> &components, std::vector<byte> &encoded, Encoder encoder) {
+    encoded.resize(components.size() * sizeof(T));
+    auto *target = reinterpret_cast<T *>(encoded.data());
+    for (size_t i = 0; i < size_t(components.size()); ++i) {
+        target[i] = encoder(components[i]);
+    }
+}
+
+MeshQuantization::MeshQuantization(const VertexBufferTable &table, const Arguments &args, const bool isPositionQuantized)
+    : m_positionOffset({0, 0, 0}), m_positionScale(1), m_isPositionQuantized(isPositionQuantized),
+      m_isHighPrecision(args.highPrecisionQuantization), m_morphTolerance(float(args.morphTargetQuantization)) {
+    if (!isPositionQuantized)
+        return;
+
+    const VertexSlot positionSlot(ShapeIndex::main(), Semantic::POSITION, 0);
+
+    Float3 minPosition = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                          std::numeric_limits<float>::max()};
+    Float3 maxPosition = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                          std::numeric_limits<float>::lowest()};
+
+    for (auto &&pair : table) {
+        const auto &componentsMap = pair.second.componentsMap;
+        const auto it = componentsMap.find(positionSlot);
+        if (it == componentsMap.end())
+            continue;
+
+        for (auto &&position : reinterpret_span<Position>(it->second)) {
+            for (int axis = 0; axis < 3; ++axis) {
+                minPosition[axis] = std::min(minPosition[axis], position[axis]);
+                maxPosition[axis] = std::max(maxPosition[axis], position[axis]);
+            }
+        }
+    }
+
+    float halfExtent = 0;
+
+    // The quantized morph target position deltas use the same grid, which
+    // must be large enough for the largest delta.
+    if (m_morphTolerance > 0) {
+        for (auto &&pair : table) {
+            for (auto &&slotPair : pair.second.componentsMap) {
+                const auto &slot = slotPair.first;
+                if (slot.semantic != Semantic::POSITION || !slot.shapeIndex.isBlendShapeIndex())
+                    continue;
+
+                for (auto delta : reinterpret_span<float>(slotPair.second)) {
+                    if (std::isfinite(delta)) {
+                        halfExtent = std::max(halfExtent, std::abs(delta));
+                    }
+                }
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (minPosition[axis] <= maxPosition[axis]) {
+            m_positionOffset[axis] = (minPosition[axis] + maxPosition[axis]) / 2;
+            halfExtent = std::max(halfExtent, (maxPosition[axis] - minPosition[axis]) / 2);
+        }
+    }
+
+    // A degenerate mesh still needs an invertible transform.
+    m_positionScale = halfExtent > 0 ? halfExtent : 1;
+}
+
+MMatrix MeshQuantization::dequantizationMatrix() const {
+    MMatrix matrix;
+    for (int axis = 0; axis < 3; ++axis) {
+        matrix(axis, axis) = m_positionScale;
+        matrix(3, axis) = m_positionOffset[axis];
+    }
+    return matrix;
+}
+
+bool MeshQuantization::encode(const VertexSlot &slot, const gsl::span<const byte> &elements, std::vector<byte> &encoded,
+                              WebGL &componentType, bool &isNormalized) const {
+    if (slot.componentType() != Component::FLOAT)
+        return false;
+
+    const auto components = reinterpret_span<float>(elements);
+
+    if (slot.shapeIndex.isBlendShapeIndex())
+        return encodeMorphDeltas(slot, components, encoded, componentType, isNormalized);
+
+    if (slot.semantic == Semantic::POSITION && !m_isPositionQuantized)
+        return false;
+
+    switch (slot.semantic) {
+    case Semantic::POSITION: {
+        const auto offset = m_positionOffset;
+        const auto invScale = 1.0f / m_positionScale;
+        encoded.resize(components.size() * sizeof(int16_t));
+        auto *target = reinterpret_cast<int16_t *>(encoded.data());
+        for (size_t i = 0; i < size_t(components.size()); ++i) {
+            target[i] = encodeSigned<int16_t>((components[i] - offset[i % 3]) * invScale);
+        }
+        componentType = WebGL::SHORT;
+        isNormalized = true;
+        return true;
+    }
+
+    case Semantic::NORMAL:
+    case Semantic::TANGENT:
+        if (m_isHighPrecision) {
+            encodeComponents<int16_t>(components, encoded, encodeSigned<int16_t>);
+            componentType = WebGL::SHORT;
+        } else {
+            encodeComponents<int8_t>(components, encoded, encodeSigned<int8_t>);
+            componentType = WebGL::BYTE;
+        }
+        isNormalized = true;
+        return true;
+
+    case Semantic::TEXCOORD:
+        // Texture coordinates outside [0,1] would need KHR_texture_transform
+        // to dequantize, keep these as floats.
+        if (std::any_of(components.begin(), components.end(), [](const float c) { return c < 0 || c > 1; }))
+            return false;
+
+        encodeComponents<uint16_t>(components, encoded, encodeUnsigned<uint16_t>);
+        componentType = WebGL::UNSIGNED_SHORT;
+        isNormalized = true;
+        return true;
+
+    case Semantic::COLOR:
+        if (m_isHighPrecision) {
+            encodeComponents<uint16_t>(components, encoded, encodeUnsigned<uint16_t>);
+            componentType = WebGL::UNSIGNED_SHORT;
+        } else {
+            encodeComponents<uint8_t>(components, encoded, encodeUnsigned<uint8_t>);
+            componentType = WebGL::UNSIGNED_BYTE;
+        }
+        isNormalized = true;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool MeshQuantization::encodeMorphDeltas(const VertexSlot &slot, const gsl::span<const float> &components,
+                                         std::vector<byte> &encoded, WebGL &componentType, bool &isNormalized) const {
+    const auto isWithinUnitRange = [](const gsl::span<const float> &values, const float scale) {
+        return std::all_of(values.begin(), values.end(), [scale](const float c) { return std::abs(c * scale) <= 1; });
+    };
+
+    switch (slot.semantic) {
+    case Semantic::POSITION: {
+        // Morph target position deltas are added to the quantized positions,
+        // so these must be scaled to the same grid. Without a grid, the
+        // deltas can still be normalized when all are within one unit.
+        const auto invScale = 1.0f / m_positionScale;
+
+        if (m_morphTolerance > 0 && isWithinUnitRange(components, invScale)) {
+            // The rounding error is at most half a step of the grid.
+            if (0.5f * m_positionScale / std::numeric_limits<int8_t>::max() <= m_morphTolerance) {
+                encodeComponents<int8_t>(components, encoded,
+                                         [invScale](const float c) { return encodeSigned<int8_t>(c * invScale); });
+                componentType = WebGL::BYTE;
+                isNormalized = true;
+                return true;
+            }
+
+            if (0.5f * m_positionScale / std::numeric_limits<int16_t>::max() <= m_morphTolerance) {
+                encodeComponents<int16_t>(components, encoded,
+                                          [invScale](const float c) { return encodeSigned<int16_t>(c * invScale); });
+                componentType = WebGL::SHORT;
+                isNormalized = true;
+                return true;
+            }
+        }
+
+        if (!m_isPositionQuantized)
+            return false;
+
+        encodeComponents<float>(components, encoded, [invScale](const float c) { return c * invScale; });
+        componentType = WebGL::FLOAT;
+        isNormalized = false;
+        return true;
+    }
+
+    case Semantic::NORMAL:
+    case Semantic::TANGENT:
+        // Like the unit vectors of the main shape, but the deltas of a
+        // flipped vector can be outside the normalized range.
+        if (m_morphTolerance <= 0 || !isWithinUnitRange(components, 1))
+            return false;
+
+        if (m_isHighPrecision) {
+            encodeComponents<int16_t>(components, encoded, encodeSigned<int16_t>);
+            componentType = WebGL::SHORT;
+        } else {
+            encodeComponents<int8_t>(components, encoded, encodeSigned<int8_t>);
+            componentType = WebGL::BYTE;
+        }
+        isNormalized = true;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+SkinQuantization::SkinQuantization(const size_t jointCount, const Arguments &args)
+    : m_jointCount(jointCount), m_isHighPrecision(args.highPrecisionQuantization) {}
+
+bool SkinQuantization::encodeJoints(const VertexSlot &slot, const gsl::span<const byte> &elements, std::vector<byte> &encoded,
+                                    WebGL &componentType) const {
+    if (slot.semantic != Semantic::JOINTS || m_jointCount > 256)
+        return false;
+
+    const auto indices = reinterpret_span<uint16_t>(elements);
+    encoded.resize(indices.size());
+    std::copy(indices.begin(), indices.end(), encoded.begin());
+    componentType = WebGL::UNSIGNED_BYTE;
+    return true;
+}
+
+template <typename T>
+static void encodeWeightSets(const std::vector<gsl::span<const float>> &weightSets, std::vector<std::vector<byte>> &encodedSets) {
+    const size_t dim = array_size<JointWeights>::size;
+    const auto setCount = weightSets.size();
+    const auto componentCount = setCount * dim;
+    const auto vertexCount = weightSets.empty() ? 0 : weightSets[0].size() / dim;
+    const auto maxValue = static_cast<int64_t>(std::numeric_limits<T>::max());
+
+    encodedSets.resize(setCount);
+    std::vector<T *> targets(setCount);
+    for (size_t setIndex = 0; setIndex < setCount; ++setIndex) {
+        encodedSets[setIndex].resize(weightSets[setIndex].size() * sizeof(T));
+        targets[setIndex] = reinterpret_cast<T *>(encodedSets[setIndex].data());
+    }
+
+    std::vector<float> scaled(componentCount);
+    std::vector<int64_t> rounded(componentCount);
+    std::vector<size_t> order(componentCount);
+
+    // Component k of a vertex is component k % dim of set k / dim.
+    const auto component = [&](const size_t k, const size_t vertexIndex) {
+        const auto weight = weightSets[k / dim][vertexIndex * dim + k % dim];
+        return std::isfinite(weight) ? std::max(0.0f, weight) : 0.0f;
+    };
+
+    for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        float total = 0;
+        for (size_t k = 0; k < componentCount; ++k) {
+            total += component(k, vertexIndex);
+        }
+
+        int64_t remainder = 0;
+        for (size_t k = 0; k < componentCount; ++k) {
+            scaled[k] = total > 0 ? component(k, vertexIndex) / total * maxValue : 0;
+            rounded[k] = static_cast<int64_t>(std::floor(scaled[k]));
+            remainder += rounded[k];
+        }
+
+        // Largest remainder rounding: the components that lost the most to
+        // the floor get one more, until the weights add up to the maximum.
+        remainder = total > 0 ? maxValue - remainder : 0;
+        if (remainder > 0) {
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(),
+                      [&](const size_t a, const size_t b) { return scaled[a] - rounded[a] > scaled[b] - rounded[b]; });
+            for (size_t i = 0; remainder > 0; i = (i + 1) % componentCount, --remainder) {
+                ++rounded[order[i]];
+            }
+        }
+
+        for (size_t k = 0; k < componentCount; ++k) {
+            targets[k / dim][vertexIndex * dim + k % dim] = static_cast<T>(std::min(rounded[k], maxValue));
+        }
+    }
+}
+
+void SkinQuantization::encodeWeights(const std::map<SetIndex, gsl::span<const float>> &weightSetMap,
+                                     std::map<SetIndex, std::vector<byte>> &encodedSets) const {
+    std::vector<SetIndex> setIndices;
+    std::vector<gsl::span<const float>> weightSets;
+
+    for (auto &&pair : weightSetMap) {
+        setIndices.push_back(pair.first);
+        weightSets.push_back(pair.second);
+    }
+
+    std::vector<std::vector<byte>> encoded;
+    if (m_isHighPrecision) {
+        encodeWeightSets<uint16_t>(weightSets, encoded);
+    } else {
+        encodeWeightSets<uint8_t>(weightSets, encoded);
+    }
+
+    for (size_t i = 0; i < setIndices.size(); ++i) {
+        encodedSets[setIndices[i]] = std::move(encoded[i]);
+    }
+}
+
+QuantizedAccessors::QuantizedAccessors() = default;
+
+QuantizedAccessors::~QuantizedAccessors() = default;
+
+void QuantizedAccessors::patchJSON(rapidjson::Document &document) const {
+    if (empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    auto &jsonAccessors = document["accessors"];
+
+    for (auto accessor : m_normalizedAccessors) {
+        // The accessors of the other assets are not written, see -splitAssets.
+        if (accessor->id < 0)
+            continue;
+
+        auto &jsonAccessor = jsonAccessors[accessor->id];
+        jsonAccessor.AddMember("normalized", true, allocator);
+    }
+
+    if (m_isUsed) {
+        addExtensionUsed(document, "KHR_mesh_quantization", true);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "MeshRenderables.h"
+#include "macros.h"
+
+class Arguments;
+
+/**
+ * The KHR_mesh_quantization encoding of the vertex attributes of a mesh.
+ *
+ * Positions are stored as normalized int16 on a uniform grid around the
+ * center of the bounds of all primitives of the mesh; the dequantization
+ * transform must be applied by the node (or the inverse bind matrices of a
+ * skinned mesh). Being uniform, it doesn't affect normals and tangents.
+ * Positions can also be kept as floats, when no node can apply the transform.
+ * Normals and tangents use snorm, texture coordinates in [0,1] and colors
+ * use unorm. Morph targets stay float, their position deltas are scaled to
+ * the position grid, unless -morphTargetQuantization normalizes these: the
+ * position deltas to int8 or int16 on the position grid, whichever bounds
+ * the rounding error by the tolerance, and the normal and tangent deltas
+ * like the main unit vectors. The grid then also covers the largest delta.
+ */
+class MeshQuantization {
+  public:
+    MeshQuantization(const VertexBufferTable &table, const Arguments &args,
+                     bool isPositionQuantized);
+
+    DEFAULT_COPY_MOVE_ASSIGN_DTOR(MeshQuantization);
+
+    bool isPositionQuantized() const { return m_isPositionQuantized; }
+
+    const Float3 &positionOffset() const { return m_positionOffset; }
+    float positionScale() const { return m_positionScale; }
+
+    /** The dequantization transform, maps quantized to original positions */
+    MMatrix dequantizationMatrix() const;
+
+    /**
+     * Encodes the vertex elements of a slot. Returns false when the slot
+     * keeps its original encoding.
+     */
+    bool encode(const VertexSlot &slot, const gsl::span<const byte> &elements,
+                std::vector<byte> &encoded,
+                GLTF::Constants::WebGL &componentType, bool &isNormalized) const;
+
+  private:
+    bool encodeMorphDeltas(const VertexSlot &slot, const gsl::span<const float> &components,
+                           std::vector<byte> &encoded, GLTF::Constants::WebGL &componentType,
+                           bool &isNormalized) const;
+
+    Float3 m_positionOffset;
+    float m_positionScale;
+    bool m_isPositionQuantized;
+    bool m_isHighPrecision;
+    float m_morphTolerance;
+};
+
+/**
+ * The encoding of the skin attributes of a mesh, see -skinQuantization.
+ *
+ * Joint indices become uint8 when the skin has at most 256 joints. Weights
+ * become normalized uint8, or uint16 with -highPrecisionQuantization. The
+ * weights of all sets of a vertex are rounded together, so their integers
+ * add up to exactly the maximum, as the glTF spec requires. Both are core
+ * glTF component types, these don't need KHR_mesh_quantization.
+ */
+class SkinQuantization {
+  public:
+    SkinQuantization(size_t jointCount, const Arguments &args);
+
+    DEFAULT_COPY_MOVE_ASSIGN_DTOR(SkinQuantization);
+
+    /**
+     * Encodes the joint indices of a slot. Returns false when the slot
+     * keeps its original encoding.
+     */
+    bool encodeJoints(const VertexSlot &slot,
+                      const gsl::span<const byte> &elements,
+                      std::vector<byte> &encoded,
+                      GLTF::Constants::WebGL &componentType) const;
+
+    /** Encodes the weights of all main shape sets of the vertices at once */
+    void encodeWeights(const std::map<SetIndex, gsl::span<const float>> &weightSets,
+                       std::map<SetIndex, std::vector<byte>> &encodedSets) const;
+
+    GLTF::Constants::WebGL weightComponentType() const {
+        return m_isHighPrecision ? GLTF::Constants::WebGL::UNSIGNED_SHORT
+                                 : GLTF::Constants::WebGL::UNSIGNED_BYTE;
+    }
+
+  private:
+    size_t m_jointCount;
+    bool m_isHighPrecision;
+};
+
+/**
+ * Keeps track of the normalized accessors of the asset. The COLLADA2GLTF
+ * object model doesn't have the normalized flag, so the JSON is patched
+ * after it is written.
+ */
+class QuantizedAccessors {
+  public:
+    QuantizedAccessors();
+    ~QuantizedAccessors();
+
+    /** Normalized skin weights are core glTF, these don't need the
+     * extension */
+    void addNormalized(const GLTF::Accessor *accessor,
+                       const bool needsExtension = true) {
+        m_normalizedAccessors.insert(accessor);
+        m_isUsed |= needsExtension;
+    }
+
+    void setUsed() { m_isUsed = true; }
+
+    bool isNormalized(const GLTF::Accessor *accessor) const {
+        return m_normalizedAccessors.count(accessor) != 0;
+    }
+
+    bool empty() const { return !m_isUsed && m_normalizedAccessors.empty(); }
+
+    /** Adds the normalized flags and, when needed, the KHR_mesh_quantization
+     * extension to the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(QuantizedAccessors);
+
+    std::set<const GLTF::Accessor *> m_normalizedAccessors;
+    bool m_isUsed = false;
+};
@@ -2,15 +2,24 @@
 
 #include "Arguments.h"
 #include "IndentableStream.h"
+#include "KernelRecording.h"
 #include "Mesh.h"
 #include "MeshIndices.h"
 #include "MeshRenderables.h"
 #include "MeshVertices.h"
+#include "Profiler.h"
+#include "parallel.h"
 using namespace coveo::linq;
 
+// Minimum number of corners classified per worker thread.
+const size_t cornerClassificationChunkSize = 64 * 1024;
+
 MeshRenderables::MeshRenderables(const MeshShapes &meshShapes,
+                                 const InstanceNumber instanceNumber,
                                  const Arguments &args)
-    : instanceNumber(meshShapes.at(0)->instanceNumber()) {
+    : instanceNumber(instanceNumber) {
+    ProfileScope profileScope("Mesh welding");
+
     MStatus status;
 
     const auto &mainShape = dynamic_cast<MainShape *>(meshShapes.at(0));
@@ -31,134 +40,165 @@ MeshRenderables::MeshRenderables(const MeshShapes &meshShapes,
                                     .elementCount;
     const auto perPrimitiveVertexCount = mainIndices.perPrimitiveVertexCount();
 
-    auto primitiveVertexIndex = 0;
-
-    VertexElementData vertexIndexKey;
-    VertexLayout vertexLayout;
-
     const auto semanticsMask = args.meshPrimitiveAttributes;
-
-    auto totalWeldCount = 0;
-    auto totalVertexCount = 0;
-
-    for (auto primitiveIndex = 0; primitiveIndex < primitiveCount;
-         ++primitiveIndex) {
-        const auto shaderIndex =
-            shading.primitiveToShaderIndexMap[primitiveIndex];
-
-        for (int counter = perPrimitiveVertexCount; --counter >= 0;
-             ++primitiveVertexIndex) {
-            // Compute the vertex signature (one bit per semantic+set, 0=unused,
-            // 1=used)
-            VertexSignature vertexSignature(shaderIndex, 0);
-
-            vertexLayout.clear();
-            vertexIndexKey.clear();
-
-            for (auto shapeIndex = 0U; shapeIndex < meshShapes.size();
-                 ++shapeIndex) {
-                auto &shape = meshShapes.at(shapeIndex);
-                const auto &shapeVerticesTable = shape->vertices().table();
-
-                for (auto semanticIndex = 0U;
-                     semanticIndex < shapeVerticesTable.size();
-                     ++semanticIndex) {
-                    if (!shapeVerticesTable.at(semanticIndex).empty() &&
-                        semanticsMask.test(semanticIndex)) {
-                        const auto &indicesPerSet =
-                            mainIndicesTable.at(semanticIndex);
-
-                        for (auto setIndex = 0; setIndex < indicesPerSet.size();
-                             ++setIndex) {
-                            const auto &indices = indicesPerSet.at(setIndex);
-                            const auto index = indices[primitiveVertexIndex];
-                            const int isUsed = index >= 0;
-                            vertexSignature.slotUsage <<= 1;
-                            vertexSignature.slotUsage |= isUsed;
-                            if (isUsed) {
-                                auto semantic = Semantic::from(semanticIndex);
-                                vertexLayout.emplace_back(
-                                    ShapeIndex::shape(shapeIndex), semantic,
-                                    setIndex);
-
-                                const auto &elementIndices =
-                                    indicesPerSet.at(setIndex);
-                                const auto vertexIndex =
-                                    elementIndices.at(primitiveVertexIndex);
-                                const auto &vertexElements =
-                                    shapeVerticesTable.at(semantic).at(
-                                        setIndex);
-                                const auto &sourceComponents =
-                                    componentsAt(vertexElements, vertexIndex,
-                                                 semantic, shape->shapeIndex);
-                                const auto sourceBytes =
-                                    sourceComponents.bytes();
-                                vertexIndexKey.insert(vertexIndexKey.end(),
-                                                      sourceBytes.begin(),
-                                                      sourceBytes.end());
-                            }
-                        }
+    const auto cornerCount = size_t(primitiveCount) * perPrimitiveVertexCount;
+
+    // Visits the vertex slots of a corner, in signature bit order.
+    const auto visitSlots = [&](const size_t primitiveVertexIndex,
+                                auto &&visitor) {
+        for (auto shapeIndex = 0U; shapeIndex < meshShapes.size();
+             ++shapeIndex) {
+            auto &shape = meshShapes.at(shapeIndex);
+            const auto &shapeVerticesTable = shape->vertices().table();
+
+            for (auto semanticIndex = 0U;
+                 semanticIndex < shapeVerticesTable.size(); ++semanticIndex) {
+                if (!shapeVerticesTable.at(semanticIndex).empty() &&
+                    semanticsMask.test(semanticIndex)) {
+                    const auto &indicesPerSet =
+                        mainIndicesTable.at(semanticIndex);
+
+                    for (auto setIndex = 0; setIndex < indicesPerSet.size();
+                         ++setIndex) {
+                        const auto &indices = indicesPerSet.at(setIndex);
+                        const auto index = indices[primitiveVertexIndex];
+                        visitor(*shape, shapeIndex, semanticIndex, setIndex,
+                                indices, index >= 0);
                     }
                 }
             }
-
-            // Check if a vertex with exactly the same components already
-            // exists.
-            VertexBuffer &vertexBuffer = m_table[vertexSignature];
-
-            auto &componentsMap = vertexBuffer.componentsMap;
-
-            VertexIndex sharedVertexIndex;
-
-            const auto itSharedIndex =
-                vertexBuffer.vertexToIndexMapping.find(vertexIndexKey);
-
-            if (itSharedIndex == vertexBuffer.vertexToIndexMapping.end()) {
-                // No vertex with same indices found, create a new output vertex
-                // index.
-                sharedVertexIndex = static_cast<VertexIndex>(
-                    vertexBuffer.vertexToIndexMapping.size());
-                vertexBuffer.vertexToIndexMapping[vertexIndexKey] =
-                    sharedVertexIndex;
-
-                // Build the vertex.
-                for (auto &&slot : vertexLayout) {
-                    auto &shape = meshShapes.at(slot.shapeIndex.arrayIndex());
-
-                    const auto &elementIndices =
-                        mainIndices.indicesAt(slot.semantic, slot.setIndex);
-                    const auto vertexIndex =
-                        elementIndices.at(primitiveVertexIndex);
-                    const auto &vertexElements =
-                        shape->vertices().vertexElementComponentsAt(
-                            slot.semantic, slot.setIndex);
-                    const auto &sourceComponents =
-                        componentsAt(vertexElements, vertexIndex, slot.semantic,
-                                     slot.shapeIndex);
-                    const auto sourceBytes = sourceComponents.bytes();
-                    auto &target = componentsMap[slot];
-                    if (target.empty()) {
-                        target.reserve(maxVertexCount * slot.elementByteSize());
-                    }
-
-                    target.insert(target.end(), sourceBytes.begin(),
-                                  sourceBytes.end());
+        }
+    };
+
+    // Phase one: compute the vertex signature of each corner (one bit per
+    // semantic+set, 0=unused, 1=used), in parallel.
+    std::vector<VertexSignature> cornerSignatures(cornerCount,
+                                                  VertexSignature(0, 0));
+
+    parallelFor(
+        cornerCount, cornerClassificationChunkSize,
+        [&](const size_t begin, const size_t end) {
+            for (auto primitiveVertexIndex = begin; primitiveVertexIndex < end;
+                 ++primitiveVertexIndex) {
+                const auto primitiveIndex =
+                    primitiveVertexIndex / perPrimitiveVertexCount;
+
+                VertexSignature vertexSignature(
+                    shading.primitiveToShaderIndexMap[primitiveIndex], 0);
+
+                visitSlots(primitiveVertexIndex,
+                           [&](const MeshShape &, size_t, size_t, int,
+                               const CornerIndices &, const bool isUsed) {
+                               vertexSignature.slotUsage <<= 1;
+                               vertexSignature.slotUsage |= isUsed;
+                           });
+
+                cornerSignatures[primitiveVertexIndex] = vertexSignature;
+            }
+        });
+
+    // Group the corners per signature, keeping them in corner order. The
+    // vertex buffers are created in order of first use, as before, so the
+    // table is identical to the one a serial weld would produce.
+    std::vector<VertexBuffer *> bucketBuffers;
+    std::vector<IndexVector> bucketCorners;
+    {
+        std::unordered_map<VertexSignature, size_t, VertexHashers>
+            signatureToBucket;
+
+        size_t bucketIndex = 0;
+
+        for (size_t primitiveVertexIndex = 0;
+             primitiveVertexIndex < cornerCount; ++primitiveVertexIndex) {
+            const auto &vertexSignature =
+                cornerSignatures[primitiveVertexIndex];
+
+            // Consecutive corners mostly share the same signature.
+            if (bucketCorners.empty() ||
+                cornerSignatures[primitiveVertexIndex - 1] !=
+                    vertexSignature) {
+                const auto result = signatureToBucket.emplace(
+                    vertexSignature, bucketCorners.size());
+                if (result.second) {
+                    bucketBuffers.push_back(&m_table[vertexSignature]);
+                    bucketCorners.emplace_back();
                 }
-            } else {
-                // Reuse the same vertex.
-                sharedVertexIndex = itSharedIndex->second;
-
-                ++totalWeldCount;
+                bucketIndex = result.first->second;
             }
 
-            vertexBuffer.indices.push_back(sharedVertexIndex);
+            bucketCorners[bucketIndex].push_back(
+                static_cast<Index>(primitiveVertexIndex));
         }
     }
 
-    cout << prefix << mainShape->dagPath().partialPathName().asChar()
-         << " will have " << maxVertexCount - totalWeldCount
-         << " vertices. Welded#" << totalWeldCount << ", min#" << minVertexCount
-         << ", max#" << maxVertexCount << endl;
+    // Phase two: weld each signature bucket on its own thread. Each bucket
+    // visits its corners in order, so the output indices are deterministic.
+    std::vector<size_t> bucketWeldCounts(bucketCorners.size(), 0);
+
+    parallelForEach(bucketCorners.size(), 1, [&](const size_t bucketIndex) {
+        const auto &corners = bucketCorners[bucketIndex];
+        VertexBuffer &vertexBuffer = *bucketBuffers[bucketIndex];
+
+        // All corners with the same signature have the same vertex layout.
+        std::vector<kernels::WeldStream> streams;
+
+        visitSlots(corners.front(),
+                   [&](const MeshShape &shape, const size_t shapeIndex,
+                       const size_t semanticIndex, const int setIndex,
+                       const CornerIndices &indices, const bool isUsed) {
+                       if (isUsed) {
+                           const auto semantic = Semantic::from(semanticIndex);
+                           const VertexSlot slot(ShapeIndex::shape(shapeIndex),
+                                                 semantic, setIndex);
+                           auto &target = vertexBuffer.componentsMap[slot];
+                           target.reserve(corners.size() *
+                                          slot.elementByteSize());
+
+                           const auto &elements =
+                               shape.vertices().table().at(semantic).at(
+                                   setIndex);
+                           kernels::WeldStream stream;
+                           stream.indices = indices.data();
+                           stream.elements = elements.bytes().data();
+                           stream.elementByteLength = slot.elementByteSize();
+                           stream.target = &target;
+                           streams.push_back(stream);
+                       }
+                   });
+
+        // The keys of this bucket, when recording the kernel inputs.
+        const auto isRecording = KernelRecording::isRecording();
+        std::vector<byte> recordedKeys;
+
+        vertexBuffer.indices.reserve(corners.size());
+
+        // The common layouts use a weld kernel specialized for their element
+        // sizes, the others the generic one.
+        kernels::WeldOutput output(vertexBuffer.indices);
+        output.recordedKeys = isRecording ? &recordedKeys : nullptr;
+
+        kernels::weldCornersOfLayout(streams.data(), streams.size(),
+                                     corners.data(), corners.size(),
+                                     vertexBuffer.weldTable.kernelTable(),
+                                     output);
+
+        bucketWeldCounts[bucketIndex] = output.weldCount;
+
+        if (isRecording) {
+            KernelRecording::record(
+                kernels::RecordKind::WELD_KEYS,
+                static_cast<uint32_t>(vertexBuffer.weldTable.keyByteLength()),
+                recordedKeys.data(), recordedKeys.size());
+        }
+    });
+
+    m_weldCount = std::accumulate(bucketWeldCounts.begin(),
+                                  bucketWeldCounts.end(), size_t(0));
+    m_minVertexCount = minVertexCount;
+    m_maxVertexCount = maxVertexCount;
+
+    m_heldMemory.set(heldBytes(m_table));
+    profileScope.addBytes(m_heldMemory.byteCount());
 
     // Now compute the blend-shape vector-deltas by subtracting the
     // blend-shape-base mesh from the blend-shape-targets
@@ -208,6 +248,25 @@ MeshRenderables::MeshRenderables(const MeshShapes &meshShapes,
 
 MeshRenderables::~MeshRenderables() = default;
 
+size_t heldBytes(const VertexBufferTable &table) {
+    size_t byteCount = 0;
+    for (auto &&pair : table) {
+        const VertexBuffer &buffer = pair.second;
+        byteCount += heldBytes(buffer.indices);
+        for (auto &&slotCompPair : buffer.componentsMap) {
+            byteCount += heldBytes(slotCompPair.second);
+        }
+    }
+    return byteCount;
+}
+
+void MeshRenderables::printStatistics(const MDagPath &shapeDagPath) const {
+    cout << prefix << shapeDagPath.partialPathName().asChar() << " will have "
+         << m_maxVertexCount - m_weldCount << " vertices. Welded#"
+         << m_weldCount << ", min#" << m_minVertexCount << ", max#"
+         << m_maxVertexCount << endl;
+}
+
 std::ostream &operator<<(std::ostream &out, const VertexSignature &obj) {
     out << '{' << ' ';
     out << std::quoted("shaderIndex") << ':' << obj.shaderIndex << ',';
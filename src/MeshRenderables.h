@@ -1,6 +1,8 @@
 #pragma once
 
+#include "HeldMemory.h"
 #include "Mesh.h"
+#include "VertexWeldTable.h"
 #include "hashers.h"
 #include "sceneTypes.h"
 
@@ -62,12 +64,9 @@ struct VertexSignature {
     }
 
     friend std::size_t hash_value(const VertexSignature &obj) {
-        std::size_t seed = 0x61BAB927;
-        seed ^= (seed << 6) + (seed >> 2) + 0x79FBC802 +
-                static_cast<std::size_t>(obj.shaderIndex);
-        seed ^= (seed << 6) + (seed >> 2) + 0x5A1BB057 +
-                static_cast<std::size_t>(obj.slotUsage);
-        return seed;
+        return static_cast<std::size_t>(fasthash::hashWords(
+            static_cast<uint64_t>(obj.shaderIndex),
+            static_cast<uint64_t>(obj.slotUsage)));
     }
 
     friend std::ostream &operator<<(std::ostream &out,
@@ -125,14 +124,9 @@ struct VertexSlot {
     }
 
     friend std::size_t hash_value(const VertexSlot &obj) {
-        std::size_t seed = 0x7732D720;
-        seed ^=
-            (seed << 6) + (seed >> 2) + 0x6654736D + hash_value(obj.shapeIndex);
-        seed ^= (seed << 6) + (seed >> 2) + 0x1BF620AC +
-                static_cast<std::size_t>(obj.semantic);
-        seed ^= (seed << 6) + (seed >> 2) + 0x54A5F37C +
-                static_cast<std::size_t>(obj.setIndex);
-        return seed;
+        return static_cast<std::size_t>(fasthash::hashWords(
+            static_cast<uint64_t>(obj.semantic),
+            static_cast<uint64_t>(obj.setIndex), hash_value(obj.shapeIndex)));
     }
 
     size_t dimension() const {
@@ -163,36 +157,36 @@ struct VertexHashers {
         return hash_value(vec.shorts());
     }
 
+    std::size_t operator()(const gsl::span<const byte> &elems) const {
+        return hash_bytes(elems);
+    }
+
     std::size_t operator()(const VertexElementData &elems) const {
-        size_t seed = 0x26DFB62C;
-        for (auto &elem : elems) {
-            seed ^=
-                (seed << 6) + (seed >> 2) + 0x3C2E6B88 + static_cast<size_t>(elem);
-        }
-        return seed;
+        return (*this)(span(elems));
     }
 };
 
-typedef std::unordered_map<VertexElementData, Index, VertexHashers>
-    VertexToIndexMapping;
-
 typedef std::unordered_map<VertexSlot, VertexElementData, VertexHashers>
     VertexElementsMap;
 
 struct VertexBuffer {
-    VertexToIndexMapping vertexToIndexMapping;
+    VertexWeldTable weldTable;
     IndexVector indices;
     VertexElementsMap componentsMap;
 
-    size_t maxIndex() const { return vertexToIndexMapping.size(); };
+    size_t maxIndex() const { return weldTable.size(); };
 };
 
 typedef std::unordered_map<VertexSignature, VertexBuffer, VertexHashers>
     VertexBufferTable;
 
+/** The bytes of the indices and vertex elements of the table */
+size_t heldBytes(const VertexBufferTable &table);
+
 class MeshRenderables {
   public:
-    MeshRenderables(const MeshShapes &meshShapes, const Arguments &args);
+    /** Doesn't call Maya, so it can run on a worker thread */
+    MeshRenderables(const MeshShapes &meshShapes, InstanceNumber instanceNumber, const Arguments &args);
 
     ~MeshRenderables();
 
@@ -200,7 +194,16 @@ class MeshRenderables {
 
     const VertexBufferTable &table() const { return m_table; }
 
+    /** Prints the vertex counts. Not done by the constructor, which can run
+     * on a worker thread. */
+    void printStatistics(const MDagPath &shapeDagPath) const;
+
   protected:
     DISALLOW_COPY_MOVE_ASSIGN(MeshRenderables);
     VertexBufferTable m_table;
+    HeldMemory m_heldMemory{MemoryKind::WELDED_VERTICES};
+
+    size_t m_weldCount = 0;
+    size_t m_minVertexCount = 0;
+    size_t m_maxVertexCount = 0;
 };
@@ -9,8 +9,7 @@
 
 MeshShape::MeshShape(ShapeIndex shapeIndex) : shapeIndex(shapeIndex) {}
 
-MeshShape::MeshShape(const MeshIndices &mainIndices, const MFnMesh &fnMesh,
-                     const ExportableNode &node, const Arguments &args,
+MeshShape::MeshShape(const MFnMesh &fnMesh, const Arguments &args,
                      ShapeIndex shapeIndex, const MPlug &weightPlug,
                      const float initialWeight)
     : shapeIndex(shapeIndex), weightPlug(weightPlug),
@@ -21,8 +20,30 @@ MeshShape::MeshShape(const MeshIndices &mainIndices, const MFnMesh &fnMesh,
 
     m_semantics = std::make_unique<MeshSemantics>(
         fnMesh, nullptr, args.blendPrimitiveAttributes);
-    m_vertices = std::make_unique<MeshVertices>(mainIndices, nullptr, fnMesh,
-                                                shapeIndex, node, args);
+}
+
+void MeshShape::convertVertices(const MainShape &mainShape,
+                                const MeshVertexArrays &arrays,
+                                const Arguments &args) {
+    m_vertices = std::make_unique<MeshVertices>(mainShape.indices(), nullptr,
+                                                arrays, shapeIndex, args,
+                                                &mainShape.vertices());
+}
+
+MeshShape::MeshShape(const MainShape &mainShape, const MFnMesh &fnMesh,
+                     const Arguments &args, ShapeIndex shapeIndex,
+                     const MPlug &weightPlug, const float initialWeight,
+                     const BlendShapeTargetDeltas &deltas)
+    : shapeIndex(shapeIndex), weightPlug(weightPlug),
+      initialWeight(initialWeight) {
+    MStatus status;
+    m_dagPath = fnMesh.dagPath(&status);
+    THROW_ON_FAILURE(status);
+
+    m_semantics = std::make_unique<MeshSemantics>(
+        fnMesh, nullptr, args.blendPrimitiveAttributes);
+    m_vertices = std::make_unique<MeshVertices>(mainShape.vertices(), deltas,
+                                                shapeIndex, args);
 }
 
 MeshShape::~MeshShape() = default;
@@ -56,7 +77,7 @@ MainShape::MainShape(ExportableScene &scene, const MFnMesh &fnMesh,
     m_skeleton = std::make_unique<MeshSkeleton>(scene, node, fnMesh);
     m_semantics = std::make_unique<MeshSemantics>(fnMesh, m_skeleton.get(),
                                                   args.meshPrimitiveAttributes);
-    m_indices = std::make_unique<MeshIndices>(m_semantics.get(), fnMesh);
+    m_indices = std::make_unique<MeshIndices>(m_semantics.get(), fnMesh, args);
     m_vertices =
         std::make_unique<MeshVertices>(*m_indices, m_skeleton.get(), fnMesh,
                                        shapeIndex, node, scene.arguments());
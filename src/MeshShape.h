@@ -7,13 +7,23 @@
 
 class ExportableNode;
 class ExportableScene;
+class MainShape;
+struct BlendShapeTargetDeltas;
 
 class MeshShape {
   public:
-    MeshShape(const MeshIndices &mainIndices, const MFnMesh &fnMesh,
-              const ExportableNode &node, const Arguments &args,
+    // Blend shape target evaluated by Maya, without vertices until
+    // convertVertices is called
+    MeshShape(const MFnMesh &fnMesh, const Arguments &args,
               ShapeIndex shapeIndex, const MPlug &weightPlug,
               float initialWeight);
+
+    // Blend shape target built from the sparse offsets stored in the deformer
+    MeshShape(const MainShape &mainShape, const MFnMesh &fnMesh,
+              const Arguments &args, ShapeIndex shapeIndex,
+              const MPlug &weightPlug, float initialWeight,
+              const BlendShapeTargetDeltas &deltas);
+
     virtual ~MeshShape();
 
     virtual void dump(class IndentableStream &out,
@@ -29,6 +39,12 @@ class MeshShape {
 
     size_t instanceNumber() const;
 
+    /** Converts the arrays fetched from the evaluated target. Doesn't call
+     * Maya, so it can run on a worker thread. */
+    void convertVertices(const MainShape &mainShape,
+                         const MeshVertexArrays &arrays,
+                         const Arguments &args);
+
   protected:
     MeshShape(ShapeIndex shapeIndex);
 
@@ -0,0 +1,358 @@
+#include "externals.h"
+
+#include "MeshSimplification.h"
+#include "PrimitiveSplitting.h"
+
+namespace {
+struct Vector3 {
+    double x, y, z;
+};
+
+inline Vector3 operator-(const Vector3 &a, const Vector3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+inline double dot(const Vector3 &a, const Vector3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline Vector3 cross(const Vector3 &a, const Vector3 &b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// The sum of the weighted squared distances to planes, as a symmetric 4x4
+// matrix, and the sum of the weights.
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void addPlane(const Vector3 &n, const double d, const double weight) {
+        a00 += weight * n.x * n.x;
+        a01 += weight * n.x * n.y;
+        a02 += weight * n.x * n.z;
+        a03 += weight * n.x * d;
+        a11 += weight * n.y * n.y;
+        a12 += weight * n.y * n.z;
+        a13 += weight * n.y * d;
+        a22 += weight * n.z * n.z;
+        a23 += weight * n.z * d;
+        a33 += weight * d * d;
+        this->weight += weight;
+    }
+
+    Quadric &operator+=(const Quadric &q) {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a03 += q.a03;
+        a11 += q.a11;
+        a12 += q.a12;
+        a13 += q.a13;
+        a22 += q.a22;
+        a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+        return *this;
+    }
+
+    // The root mean square distance of the point to the planes.
+    double error(const Vector3 &p) const {
+        const auto sum = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z + a33 +
+                         2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z + a03 * p.x + a13 * p.y + a23 * p.z);
+        return weight > 0 ? std::sqrt(std::max(0.0, sum) / weight) : 0;
+    }
+};
+
+// Moves the vertex "from" onto the vertex "to".
+struct Collapse {
+    double error;
+    Index from;
+    Index to;
+
+    friend bool operator<(const Collapse &lhs, const Collapse &rhs) {
+        return std::tie(lhs.error, lhs.from, lhs.to) < std::tie(rhs.error, rhs.from, rhs.to);
+    }
+};
+
+// Removes the triangles that use a vertex more than once.
+void removeDegenerateTriangles(IndexVector &indices) {
+    size_t count = 0;
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const auto a = indices[i];
+        const auto b = indices[i + 1];
+        const auto c = indices[i + 2];
+        if (a != b && b != c && c != a) {
+            indices[count++] = a;
+            indices[count++] = b;
+            indices[count++] = c;
+        }
+    }
+
+    indices.resize(count);
+}
+} // namespace
+
+size_t simplifyVertexBuffer(const VertexBuffer &source, const double targetRatio, const double maxError,
+                            VertexBuffer &target) {
+    const auto vertexCount = source.maxIndex();
+
+    auto indices = source.indices;
+    removeDegenerateTriangles(indices);
+
+    const auto positionIt = source.componentsMap.find(VertexSlot(ShapeIndex::main(), Semantic::POSITION, 0));
+    if (positionIt == source.componentsMap.end() || indices.empty()) {
+        copyCorners(source, indices, target);
+        return indices.size() / 3;
+    }
+
+    const auto positions = reinterpret_span<Position>(positionIt->second);
+    const auto position = [&](const Index vertex) {
+        const auto &p = positions[vertex];
+        return Vector3{p[0], p[1], p[2]};
+    };
+
+    // The error is relative to the largest extent of the positions.
+    Vector3 minPosition = position(indices[0]);
+    Vector3 maxPosition = minPosition;
+    for (auto index : indices) {
+        const auto p = position(index);
+        minPosition = {std::min(minPosition.x, p.x), std::min(minPosition.y, p.y), std::min(minPosition.z, p.z)};
+        maxPosition = {std::max(maxPosition.x, p.x), std::max(maxPosition.y, p.y), std::max(maxPosition.z, p.z)};
+    }
+
+    const auto extent = maxPosition - minPosition;
+    const auto maxAbsoluteError = maxError * std::max({extent.x, extent.y, extent.z});
+
+    // The vertices at the same position share the first of them as position
+    // index, and a quadric.
+    std::vector<Index> positionIndices(vertexCount);
+    {
+        std::vector<Index> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](Index a, Index b) { return positions[a] < positions[b]; });
+
+        for (size_t i = 0; i < vertexCount; ++i) {
+            const auto vertex = order[i];
+            const auto isShared = i > 0 && positions[vertex] == positions[order[i - 1]];
+            positionIndices[vertex] = isShared ? positionIndices[order[i - 1]] : vertex;
+        }
+    }
+
+    // The positions of seams, open borders and non-manifold edges are locked.
+    std::vector<char> isLockedPosition(vertexCount, 0);
+    {
+        for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+            const auto positionIndex = positionIndices[vertex];
+            if (positionIndex != static_cast<Index>(vertex)) {
+                isLockedPosition[positionIndex] = 1;
+            }
+        }
+
+        std::vector<std::pair<Index, Index>> edges;
+        edges.reserve(indices.size());
+
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (size_t corner = 0; corner < 3; ++corner) {
+                const auto a = positionIndices[indices[i + corner]];
+                const auto b = positionIndices[indices[i + (corner + 1) % 3]];
+                if (a != b) {
+                    edges.emplace_back(std::min(a, b), std::max(a, b));
+                }
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end) {
+            while (end < edges.size() && edges[end] == edges[begin]) {
+                ++end;
+            }
+
+            if (end - begin != 2) {
+                isLockedPosition[edges[begin].first] = 1;
+                isLockedPosition[edges[begin].second] = 1;
+            }
+        }
+    }
+
+    const auto isLocked = [&](const Index vertex) { return isLockedPosition[positionIndices[vertex]] != 0; };
+
+    // The quadrics of the planes of the triangles around each position,
+    // weighted by their area.
+    std::vector<Quadric> quadrics(vertexCount);
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const auto p0 = position(indices[i]);
+        const auto normal = cross(position(indices[i + 1]) - p0, position(indices[i + 2]) - p0);
+        const auto length = std::sqrt(dot(normal, normal));
+        if (length <= 0)
+            continue;
+
+        const Vector3 n = {normal.x / length, normal.y / length, normal.z / length};
+        const auto d = -dot(n, p0);
+
+        for (size_t corner = 0; corner < 3; ++corner) {
+            quadrics[positionIndices[indices[i + corner]]].addPlane(n, d, length / 2);
+        }
+    }
+
+    const auto targetTriangleCount =
+        std::max<size_t>(1, static_cast<size_t>(std::llround(indices.size() / 3 * targetRatio)));
+
+    auto triangleCount = indices.size() / 3;
+
+    std::vector<size_t> vertexTriangleOffsets(vertexCount + 1);
+    std::vector<Index> vertexTriangles;
+    std::vector<Collapse> collapses;
+    std::vector<char> isTouched(vertexCount);
+    std::vector<Index> neighbors;
+    std::vector<Index> sharedNeighbors;
+
+    while (triangleCount > targetTriangleCount) {
+        // The triangles of each vertex, as offsets into a flat vector.
+        std::fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end(), 0);
+        for (auto index : indices) {
+            ++vertexTriangleOffsets[index + 1];
+        }
+
+        std::partial_sum(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end(), vertexTriangleOffsets.begin());
+
+        vertexTriangles.resize(indices.size());
+        {
+            auto offsets = vertexTriangleOffsets;
+            for (size_t corner = 0; corner < indices.size(); ++corner) {
+                vertexTriangles[offsets[indices[corner]]++] = static_cast<Index>(corner / 3);
+            }
+        }
+
+        const auto trianglesOf = [&](const Index vertex) {
+            return gsl::make_span(vertexTriangles.data() + vertexTriangleOffsets[vertex],
+                                  vertexTriangles.data() + vertexTriangleOffsets[vertex + 1]);
+        };
+
+        collapses.clear();
+
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (size_t corner = 0; corner < 3; ++corner) {
+                const auto a = indices[i + corner];
+                const auto b = indices[i + (corner + 1) % 3];
+
+                for (auto &&edge : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                    if (isLocked(edge.first))
+                        continue;
+
+                    auto quadric = quadrics[edge.first];
+                    quadric += quadrics[positionIndices[edge.second]];
+
+                    const auto error = quadric.error(position(edge.second));
+                    if (error <= maxAbsoluteError) {
+                        collapses.push_back({error, edge.first, edge.second});
+                    }
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end());
+
+        // A collapse must keep the orientation of the triangles it moves, and
+        // the mesh manifold. The triangles around a position must all use the
+        // same vertex of the target position, which then has same attributes.
+        const auto canCollapse = [&](const Index from, const Index to) {
+            const auto toPositionIndex = positionIndices[to];
+            const auto newPosition = position(to);
+
+            neighbors.clear();
+
+            for (auto triangle : trianglesOf(from)) {
+                const auto *corners = &indices[triangle * 3];
+
+                bool hasTarget = false;
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    const auto vertex = corners[corner];
+                    if (positionIndices[vertex] == toPositionIndex) {
+                        if (vertex != to)
+                            return false;
+                        hasTarget = true;
+                    } else if (vertex != from) {
+                        neighbors.push_back(positionIndices[vertex]);
+                    }
+                }
+
+                // The triangles on the collapsed edge disappear.
+                if (hasTarget)
+                    continue;
+
+                Vector3 p[3];
+                Vector3 q[3];
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    p[corner] = position(corners[corner]);
+                    q[corner] = corners[corner] == from ? newPosition : p[corner];
+                }
+
+                const auto oldNormal = cross(p[1] - p[0], p[2] - p[0]);
+                const auto newNormal = cross(q[1] - q[0], q[2] - q[0]);
+                if (dot(oldNormal, newNormal) <= 0.25 * std::sqrt(dot(oldNormal, oldNormal) * dot(newNormal, newNormal)))
+                    return false;
+            }
+
+            std::sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+            // Only the two vertices opposite to the edge may be neighbors of
+            // both, or the collapse would join two sheets.
+            sharedNeighbors.clear();
+            for (auto triangle : trianglesOf(to)) {
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    const auto positionIndex = positionIndices[indices[triangle * 3 + corner]];
+                    if (positionIndex != toPositionIndex &&
+                        std::binary_search(neighbors.begin(), neighbors.end(), positionIndex)) {
+                        sharedNeighbors.push_back(positionIndex);
+                    }
+                }
+            }
+
+            std::sort(sharedNeighbors.begin(), sharedNeighbors.end());
+            return std::unique(sharedNeighbors.begin(), sharedNeighbors.end()) - sharedNeighbors.begin() <= 2;
+        };
+
+        std::fill(isTouched.begin(), isTouched.end(), 0);
+
+        size_t collapseCount = 0;
+
+        for (auto &&collapse : collapses) {
+            if (triangleCount <= targetTriangleCount)
+                break;
+
+            const auto from = collapse.from;
+            const auto to = collapse.to;
+
+            if (isTouched[from] || isTouched[to] || !canCollapse(from, to))
+                continue;
+
+            for (auto triangle : trianglesOf(from)) {
+                auto *corners = &indices[triangle * 3];
+
+                const auto isRemoved = corners[0] == to || corners[1] == to || corners[2] == to;
+                triangleCount -= isRemoved;
+
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    isTouched[corners[corner]] = 1;
+                    if (corners[corner] == from) {
+                        corners[corner] = to;
+                    }
+                }
+            }
+
+            quadrics[positionIndices[to]] += quadrics[from];
+            ++collapseCount;
+        }
+
+        removeDegenerateTriangles(indices);
+
+        if (collapseCount == 0)
+            break;
+    }
+
+    copyCorners(source, indices, target);
+    return indices.size() / 3;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "sceneTypes.h"
+
+/**
+ * Simplifies the triangles of the vertex buffer to about targetRatio of its
+ * triangles, see -lodRatios. Collapses the edges with the least quadric
+ * error first [Garland and Heckbert 1997], in passes of collapses that don't
+ * share vertices.
+ *
+ * An edge is collapsed onto one of its existing vertices, so the kept
+ * vertices keep all their attributes, including the skin and the morph
+ * targets. The vertices on open borders, and the vertices with more than one
+ * set of attributes at their position, like those on UV seams and hard
+ * edges, are never removed, so the borders and seams are preserved.
+ *
+ * No edge is collapsed with a root mean square distance to the planes of its
+ * original triangles above maxError times the largest extent of the mesh, so
+ * the target can have more triangles than requested.
+ *
+ * The target only has the vertices that are still used. Returns the number
+ * of triangles of the target. Doesn't call Maya.
+ */
+size_t simplifyVertexBuffer(const VertexBuffer &source, double targetRatio, double maxError, VertexBuffer &target);
@@ -5,7 +5,10 @@
 #include "ExportableScene.h"
 #include "IndentableStream.h"
 #include "MayaException.h"
+#include "MeshArena.h"
 #include "MeshSkeleton.h"
+#include "Profiler.h"
+#include "parallel.h"
 #include "spans.h"
 
 struct VertexJointAssignmentSlice {
@@ -19,6 +22,9 @@ struct VertexJointAssignmentSlice {
     DEFAULT_COPY_MOVE_ASSIGN_CTOR_DTOR(VertexJointAssignmentSlice);
 };
 
+// The most weights read with a single call, 64 MB.
+const size_t maxChunkWeightCount = 16 << 20;
+
 void scaleTranslation(MMatrix &m, double s) {
     double *t = m[3];
     t[0] *= s;
@@ -29,6 +35,8 @@ void scaleTranslation(MMatrix &m, double s) {
 MeshSkeleton::MeshSkeleton(ExportableScene &scene, const ExportableNode &node,
                            const MFnMesh &mesh)
     : m_maxVertexJointAssignmentCount(0) {
+    ProfileScope profileScope("Skin extraction");
+
     MStatus status;
 
     auto &args = scene.arguments();
@@ -56,6 +64,12 @@ MeshSkeleton::MeshSkeleton(ExportableScene &scene, const ExportableNode &node,
         THROW_ON_FAILURE(status);
         scaleTranslation(meshMatrix, bakeScaleFactor);
 
+        // The skew is only checked with the full diagnostics, and no more
+        // joints are checked once enough are reported.
+        const bool checkSkewing = args.reportSkewedInverseBindMatrices &&
+                                  args.diagnostics == Diagnostics::FULL;
+        int skewedJointCount = 0;
+
         for (size_t index = 0; index < jointCount; ++index) {
             auto &jointDagPath =
                 jointDagPaths[static_cast<unsigned int>(index)];
@@ -71,9 +85,11 @@ MeshSkeleton::MeshSkeleton(ExportableScene &scene, const ExportableNode &node,
             if (inverseBindMatrix.isSingular()) {
                 cerr << prefix << "WARNING: Inverse bind matrix of joint '"
                      << jointNode->name() << "' is singular!" << endl;
-            } else if (args.reportSkewedInverseBindMatrices) {
+            } else if (checkSkewing &&
+                       skewedJointCount < args.maxDiagnosticItems) {
                 const auto e = getAxesNonOrthogonality(inverseBindMatrix);
                 if (e > MAX_NON_ORTHOGONALITY) {
+                    ++skewedJointCount;
                     cerr << prefix << "WARNING: Inverse bind matrix of joint '"
                          << jointNode->name()
                          << "' is skewed, deviation = " << std::fixed
@@ -89,63 +105,211 @@ MeshSkeleton::MeshSkeleton(ExportableScene &scene, const ExportableNode &node,
         const auto meshDagPath = mesh.dagPath(&status);
         THROW_ON_FAILURE(status);
 
-        MItGeometry iterGeom(meshDagPath, &status);
+        const auto numPoints = mesh.numVertices(&status);
         THROW_ON_FAILURE(status);
 
-        const auto numPoints = iterGeom.count();
-
-        MFloatArray vertexWeights;
-        unsigned int numWeights;
-
         // Build joint (index,weight) assignments
         // To avoid many memory allocations, we put all assignments in a flat
         // vector.
         m_vertexJointAssignmentsVector.reserve(numPoints * 8);
 
-        std::vector<VertexJointAssignmentSlice> slices(numPoints);
+        ArenaVector<VertexJointAssignmentSlice> slices(numPoints);
 
-        std::vector<VertexJointAssignment> assignments;
-        assignments.reserve(jointCount);
+        // The weights of many vertices are read with a single call, as a
+        // dense vertex x influence array. The chunks bound its size.
+        const auto chunkVertexCount = static_cast<int>(std::max<size_t>(
+            1, maxChunkWeightCount / std::max<size_t>(1, jointCount)));
 
-        for (; !iterGeom.isDone(); iterGeom.next()) {
-            const auto pointIndex = iterGeom.index(&status);
-            THROW_ON_FAILURE(status);
+        MFloatArray vertexWeights;
+        unsigned int numWeights;
+
+        ArenaVector<float> chunkWeights;
+        ArenaVector<size_t> chunkAssignmentCounts;
+        ArenaVector<size_t> chunkKeptCounts;
+
+        // See -maxInfluences and -minInfluenceWeight
+        const auto maxInfluences =
+            args.maxInfluences > 0 ? static_cast<size_t>(args.maxInfluences)
+                                   : std::numeric_limits<size_t>::max();
+        const auto minInfluenceWeight =
+            static_cast<float>(args.minInfluenceWeight);
+
+        std::atomic<size_t> limitedVertexCount{0};
+        std::atomic<size_t> prunedVertexCount{0};
 
-            const MObject component = iterGeom.currentItem(&status);
+        for (int chunkStart = 0; chunkStart < numPoints;
+             chunkStart += chunkVertexCount) {
+            const auto chunkLength =
+                std::min(chunkVertexCount, numPoints - chunkStart);
+
+            MIntArray vertexIndices(chunkLength);
+            for (int i = 0; i < chunkLength; ++i) {
+                vertexIndices[i] = chunkStart + i;
+            }
+
+            MFnSingleIndexedComponent fnComponent;
+            MObject component =
+                fnComponent.create(MFn::kMeshVertComponent, &status);
             THROW_ON_FAILURE(status);
+            THROW_ON_FAILURE(fnComponent.addElements(vertexIndices));
 
             status = fnSkin.getWeights(meshDagPath, component, vertexWeights,
                                        numWeights);
             THROW_ON_FAILURE(status);
 
-            assignments.resize(0);
+            if (vertexWeights.length() != chunkLength * numWeights)
+                throw std::runtime_error(
+                    formatted("Unexpected number of skin weights for mesh '%s'",
+                              meshDagPath.partialPathName().asChar()));
+
+            chunkWeights.resize(vertexWeights.length());
+            THROW_ON_FAILURE(vertexWeights.get(chunkWeights.data()));
+
+            const auto isAssigned = [](const float jointWeight) {
+                return std::abs(jointWeight) > 1e-6f;
+            };
+
+            // Counted first, so each vertex gets its own slice of the flat
+            // vector, that is filled in parallel.
+            chunkAssignmentCounts.resize(chunkLength);
+            chunkKeptCounts.resize(chunkLength);
+            parallelForEach(chunkLength, 1024, [&](const size_t i) {
+                const auto *weights = &chunkWeights[i * numWeights];
+                const auto assignedCount = static_cast<size_t>(
+                    std::count_if(weights, weights + numWeights, isAssigned));
+
+                // The largest weight is kept, even when it is small.
+                const auto heavyCount = static_cast<size_t>(std::count_if(
+                    weights, weights + numWeights, [&](const float weight) {
+                        return isAssigned(weight) &&
+                               std::abs(weight) >= minInfluenceWeight;
+                    }));
+                const auto unprunedCount = assignedCount
+                                               ? std::max<size_t>(1, heavyCount)
+                                               : 0;
+
+                if (unprunedCount < assignedCount) {
+                    ++prunedVertexCount;
+                }
 
-            for (int jointIndex = 0; jointIndex < int(numWeights);
-                 ++jointIndex) {
-                const float jointWeight = vertexWeights[jointIndex];
-                if (std::abs(jointWeight) > 1e-6f) {
-                    assignments.emplace_back(jointIndex, jointWeight);
+                if (maxInfluences < unprunedCount) {
+                    ++limitedVertexCount;
                 }
+
+                chunkAssignmentCounts[i] = assignedCount;
+                chunkKeptCounts[i] = std::min(unprunedCount, maxInfluences);
+            });
+
+            auto assignmentsOffset = m_vertexJointAssignmentsVector.size();
+            for (int i = 0; i < chunkLength; ++i) {
+                const auto assignmentsLength = chunkKeptCounts[i];
+                slices[chunkStart + i] = VertexJointAssignmentSlice(
+                    assignmentsOffset, assignmentsLength);
+                assignmentsOffset += assignmentsLength;
+
+                m_maxVertexJointAssignmentCount = std::max(
+                    assignmentsLength, m_maxVertexJointAssignmentCount);
             }
 
-            // Sort weights from large to small.
-            // TODO: Use insertion sort when adding the weights?
-            std::sort(assignments.begin(), assignments.end(),
-                      [](auto &left, auto &right) {
-                          return left.jointWeight > right.jointWeight;
-                      });
+            m_vertexJointAssignmentsVector.resize(assignmentsOffset);
 
-            const auto assignmentsLength = assignments.size();
-            const auto assignmentsOffset =
-                m_vertexJointAssignmentsVector.size();
-            std::copy(assignments.begin(), assignments.end(),
-                      std::back_inserter(m_vertexJointAssignmentsVector));
+            const auto isHeavier = [](auto &left, auto &right) {
+                return left.jointWeight > right.jointWeight;
+            };
 
-            slices[pointIndex] = VertexJointAssignmentSlice(assignmentsOffset,
-                                                            assignmentsLength);
+            parallelFor(chunkLength, 1024, [&](const size_t begin,
+                                               const size_t end) {
+                // The assignments of a vertex that loses some.
+                std::vector<VertexJointAssignment> candidates;
+
+                for (auto i = begin; i < end; ++i) {
+                    const auto *weights = &chunkWeights[i * numWeights];
+                    const auto &slice = slices[chunkStart + i];
+                    auto *assignments =
+                        m_vertexJointAssignmentsVector.data() + slice.offset;
+
+                    const auto isLimited =
+                        slice.length < chunkAssignmentCounts[i];
+                    if (isLimited) {
+                        candidates.resize(chunkAssignmentCounts[i]);
+                    }
+
+                    auto *output = isLimited ? candidates.data() : assignments;
+
+                    size_t assignmentCount = 0;
+                    for (int jointIndex = 0; jointIndex < int(numWeights);
+                         ++jointIndex) {
+                        const float jointWeight = weights[jointIndex];
+                        if (isAssigned(jointWeight)) {
+                            output[assignmentCount++] =
+                                VertexJointAssignment(jointIndex, jointWeight);
+                        }
+                    }
 
-            m_maxVertexJointAssignmentCount =
-                std::max(assignmentsLength, m_maxVertexJointAssignmentCount);
+                    if (!isLimited) {
+                        // Sort weights from large to small.
+                        std::sort(assignments, assignments + assignmentCount,
+                                  isHeavier);
+                        continue;
+                    }
+
+                    // Keep the largest weights, rescaled to the same total.
+                    std::partial_sort(candidates.begin(),
+                                      candidates.begin() + slice.length,
+                                      candidates.end(), isHeavier);
+
+                    float totalWeight = 0;
+                    for (auto &&candidate : candidates) {
+                        totalWeight += candidate.jointWeight;
+                    }
+
+                    float keptWeight = 0;
+                    for (size_t k = 0; k < slice.length; ++k) {
+                        keptWeight += candidates[k].jointWeight;
+                    }
+
+                    const auto scale =
+                        keptWeight != 0 ? totalWeight / keptWeight : 1.0f;
+
+                    for (size_t k = 0; k < slice.length; ++k) {
+                        assignments[k] = VertexJointAssignment(
+                            candidates[k].jointIndex,
+                            candidates[k].jointWeight * scale);
+                    }
+                }
+            });
+        }
+
+        // See -compactSkinJoints. The influences that kept no weight on any
+        // vertex are dropped, and the joint indices are remapped.
+        if (args.compactSkinJoints) {
+            std::vector<int> jointRemap(m_joints.size(), -1);
+            for (auto &&assignment : m_vertexJointAssignmentsVector) {
+                jointRemap[assignment.jointIndex] = 0;
+            }
+
+            MeshJoints usedJoints;
+            usedJoints.reserve(m_joints.size());
+            for (size_t index = 0; index < m_joints.size(); ++index) {
+                if (jointRemap[index] >= 0) {
+                    jointRemap[index] = static_cast<int>(usedJoints.size());
+                    usedJoints.emplace_back(m_joints[index]);
+                }
+            }
+
+            if (usedJoints.size() < m_joints.size()) {
+                for (auto &&assignment : m_vertexJointAssignmentsVector) {
+                    assignment.jointIndex = jointRemap[assignment.jointIndex];
+                }
+
+                std::cout << prefix << "Skin for mesh "
+                          << meshDagPath.partialPathName().asChar()
+                          << " dropped " << m_joints.size() - usedJoints.size()
+                          << " of " << m_joints.size()
+                          << " joints without weights" << endl;
+
+                m_joints = std::move(usedJoints);
+            }
         }
 
         std::cout << prefix << "Skin for mesh "
@@ -153,6 +317,22 @@ MeshSkeleton::MeshSkeleton(ExportableScene &scene, const ExportableNode &node,
                   << m_maxVertexJointAssignmentCount << " weights per vertex"
                   << endl;
 
+        if (prunedVertexCount > 0) {
+            std::cout << prefix << "Skin for mesh "
+                      << meshDagPath.partialPathName().asChar()
+                      << " dropped the weights below " << minInfluenceWeight
+                      << " of " << prunedVertexCount << " of " << numPoints
+                      << " vertices" << endl;
+        }
+
+        if (limitedVertexCount > 0) {
+            std::cout << prefix << "Skin for mesh "
+                      << meshDagPath.partialPathName().asChar()
+                      << " limited " << limitedVertexCount << " of "
+                      << numPoints << " vertices to " << maxInfluences
+                      << " weights" << endl;
+        }
+
         // The vector now contains all the assignments, and cannot be relocated
         // anymore; lets construct the table of spans
         m_vertexJointAssignmentsTable.resize(numPoints);
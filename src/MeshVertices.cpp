@@ -5,367 +5,464 @@
 #include "ExportableScene.h"
 #include "IndentableStream.h"
 #include "MayaException.h"
+#include "MeshArena.h"
+#include "MeshBlendShapeDeltas.h"
 #include "MeshIndices.h"
 #include "MeshSkeleton.h"
 #include "MeshVertices.h"
+#include "Profiler.h"
 #include "dump.h"
-#include "mikktspace.h"
+#include "kernels.h"
+#include "parallel.h"
 #include "spans.h"
 
-struct MikkTSpaceIndices {
-    gsl::span<const Index> positions;
-    gsl::span<const Index> normals;
-    gsl::span<const Index> texcoords;
-    gsl::span<Index> tangents;
-
-    MikkTSpaceIndices(const MeshIndices &meshIndices, const int setIndex) {
-        positions = gsl::make_span(meshIndices.indicesAt(Semantic::POSITION, 0));
-        normals = gsl::make_span(meshIndices.indicesAt(Semantic::NORMAL, 0));
-        texcoords = gsl::make_span(meshIndices.indicesAt(Semantic::TEXCOORD, setIndex));
-        tangents = mutable_span(gsl::make_span(meshIndices.indicesAt(Semantic::TANGENT, setIndex)));
-    }
-};
-
-struct MikkTSpaceVectors {
-    gsl::span<const Position> positions;
-    gsl::span<const Normal> normals;
-    gsl::span<const TexCoord> texcoords;
-    gsl::span<float> tangentComponents;
+// Minimum number of vertex elements converted per worker thread.
+// Smaller meshes are converted on the calling thread.
+const size_t elementConversionChunkSize = 16 * 1024;
+
+// Meshes with fewer triangles are not split into independent tangent chunks.
+const size_t tangentChunkTriangleCount = 64 * 1024;
+
+/** The MikkTSpace input and output of a tangent set, for the given triangles or all of them */
+static kernels::TangentMesh tangentMesh(const MeshIndices &meshIndices, VertexElementsPerSetIndexTable &vertexTable, const int setIndex,
+                                        const ShapeIndex &shapeIndex, const gsl::span<const int> triangles = {}) {
+    // HACK: We assume the indices arrays are large enough here...
+    assert(size_t(meshIndices.indicesAt(Semantic::TANGENT, setIndex).size()) >= meshIndices.maxVertexCount());
+
+    kernels::TangentMesh mesh;
+    mesh.positionIndices = meshIndices.indicesAt(Semantic::POSITION, 0).data();
+    mesh.normalIndices = meshIndices.indicesAt(Semantic::NORMAL, 0).data();
+    mesh.texcoordIndices = meshIndices.indicesAt(Semantic::TEXCOORD, setIndex).data();
+    mesh.tangentIndices = const_cast<Index *>(meshIndices.indicesAt(Semantic::TANGENT, setIndex).data());
+
+    mesh.positions = vertexTable.at(Semantic::POSITION).at(0).floats().data();
+    mesh.normals = vertexTable.at(Semantic::NORMAL).at(0).floats().data();
+    mesh.texcoords = vertexTable.at(Semantic::TEXCOORD).at(setIndex).floats().data();
+    mesh.tangentComponents = const_cast<float *>(vertexTable.at(Semantic::TANGENT).at(setIndex).floats().data());
+    mesh.tangentDimension = shapeIndex.isMainShapeIndex() ? array_size<MainShapeTangent>::size : array_size<BlendShapeTangent>::size;
+
+    mesh.triangles = triangles.empty() ? nullptr : triangles.data();
+    mesh.triangleCount = triangles.empty() ? meshIndices.primitiveCount() : triangles.size();
+    return mesh;
+}
 
-    MikkTSpaceVectors(const MeshIndices &meshIndices, VertexElementsPerSetIndexTable &vertexTable, const int setIndex) {
-        const auto numTangents = meshIndices.maxVertexCount();
+/**
+ * Splits the triangles of a large mesh into chunks that MikkTSpace can process independently.
+ * MikkTSpace only shares a tangent frame between corners that have the same position value,
+ * so triangles that are connected through equal positions always end up in the same chunk.
+ * Returns no chunks if the mesh should be processed as a whole.
+ */
+static ArenaVector<ArenaVector<int>> splitIntoTangentChunks(const MeshIndices &meshIndices,
+                                                            const PositionVector &positions) {
+    ArenaVector<ArenaVector<int>> chunks;
+
+    const auto triangleCount = static_cast<size_t>(meshIndices.primitiveCount());
+    if (triangleCount < 2 * tangentChunkTriangleCount || parallelThreadCount() < 2)
+        return chunks;
+
+    struct PositionHasher {
+        size_t operator()(const Position &p) const {
+            // -0 and 0 are equal positions, so these must hash the same.
+            Position canonical;
+            std::transform(p.begin(), p.end(), canonical.begin(), [](const float c) { return c == 0 ? 0.0f : c; });
+            return hash_value(reinterpret_span<ushort>(gsl::make_span(canonical.data(), canonical.size())));
+        }
+    };
 
-        // HACK: We assume the indices arrays are large enough here...
-        assert(meshIndices.indicesAt(Semantic::TANGENT, setIndex).size() >= numTangents);
+    // Map each position index to the first position index with the same value.
+    ArenaUnorderedMap<Position, int, PositionHasher> positionToRoot;
+    positionToRoot.reserve(positions.size());
 
-        positions = reinterpret_span<Position>(vertexTable.at(Semantic::POSITION).at(0).floats());
-        normals = reinterpret_span<Normal>(vertexTable.at(Semantic::NORMAL).at(0).floats());
-        texcoords = reinterpret_span<TexCoord>(vertexTable.at(Semantic::TEXCOORD).at(setIndex).floats());
-        tangentComponents = mutable_span<float>(vertexTable.at(Semantic::TANGENT).at(setIndex).floats());
+    ArenaVector<int> parents(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        parents[i] = positionToRoot.emplace(positions[i], static_cast<int>(i)).first->second;
     }
-};
-
-struct MikkTSpaceContext : SMikkTSpaceContext {
-    const size_t triangleCount;
-    const ShapeIndex shapeIndex;
-    MikkTSpaceIndices indices;
-    MikkTSpaceVectors vectors;
-    SMikkTSpaceInterface interface;
-
-    // TODO: It seems MikkTSpace can generate zero tangents for some degenerate
-    // triangles, although it does contain code to deal with these. NOTE:
-    // Cleaning up the mesh with Maya seems to fix this.
-    mutable std::unordered_set<int> invalidTriangleIndices;
-
-    MikkTSpaceContext(const MeshIndices &meshIndices, VertexElementsPerSetIndexTable &vertexTable, const int setIndex,
-                      const ShapeIndex &shapeIndex)
-        : SMikkTSpaceContext{}, triangleCount(meshIndices.primitiveCount()), shapeIndex(shapeIndex),
-          indices(meshIndices, setIndex), vectors(meshIndices, vertexTable, setIndex), interface{} {
-        m_pInterface = &interface;
-        m_pUserData = this;
-
-        interface.m_getNumFaces = getNumFaces;
-        interface.m_getNumVerticesOfFace = getNumVerticesOfFace;
-        interface.m_getPosition = getPosition;
-        interface.m_getNormal = getNormal;
-        interface.m_getTexCoord = getTexCoord;
-        interface.m_setTSpaceBasic = setTSpaceBasic;
-        interface.m_reportDegenerateTriangle = reportDegenerateTriangle;
+
+    const auto findRoot = [&parents](int i) {
+        while (parents[i] != i) {
+            i = parents[i] = parents[parents[i]];
+        }
+        return i;
+    };
+
+    // Union the positions of each triangle.
+    const auto &cornerPositions = meshIndices.indicesAt(Semantic::POSITION, 0);
+    for (size_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+        const auto root = findRoot(cornerPositions[triangleIndex * 3]);
+        for (auto corner = 1; corner < 3; ++corner) {
+            const auto other = findRoot(cornerPositions[triangleIndex * 3 + corner]);
+            if (other != root) {
+                parents[other] = root;
+            }
+        }
     }
 
-    void computeTangents(const double angularThreshold) const {
-        const auto mkr = genTangSpace(this, static_cast<float>(angularThreshold));
+    // Collect the connected triangles, in order of appearance.
+    ArenaUnorderedMap<int, size_t> rootToComponent;
+    ArenaVector<ArenaVector<int>> components;
+    for (size_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+        const auto root = findRoot(cornerPositions[triangleIndex * 3]);
+        const auto it = rootToComponent.emplace(root, components.size()).first;
+        if (it->second == components.size()) {
+            components.emplace_back();
+        }
+        components[it->second].push_back(static_cast<int>(triangleIndex));
+    }
 
-        if (!mkr) {
-            MayaException::printError("Failed to get Mikkelsen tangents (aka MikkTSpace)");
+    // Pack the components into chunks of about tangentChunkTriangleCount triangles.
+    for (auto &component : components) {
+        if (chunks.empty() || chunks.back().size() >= tangentChunkTriangleCount) {
+            chunks.emplace_back(std::move(component));
+        } else {
+            auto &chunk = chunks.back();
+            chunk.insert(chunk.end(), component.begin(), component.end());
         }
     }
 
-    static int getNumFaces(const SMikkTSpaceContext *pContext) {
-        const auto count = reinterpret_cast<const MikkTSpaceContext *>(pContext)->triangleCount;
-        return static_cast<int>(count);
+    if (chunks.size() < 2) {
+        chunks.clear();
     }
 
-    static int getNumVerticesOfFace(const SMikkTSpaceContext *pContext, const int iFace) { return 3; }
+    return chunks;
+}
 
-    static void getPosition(const SMikkTSpaceContext *pContext, float fvPosOut[], const int iFace, const int iVert) {
-        const auto context = reinterpret_cast<const MikkTSpaceContext *>(pContext);
-        const auto index = context->indices.positions[iFace * 3 + iVert];
-        const auto &vector = context->vectors.positions[index];
-        fvPosOut[0] = vector[0];
-        fvPosOut[1] = vector[1];
-        fvPosOut[2] = vector[2];
-    }
+MeshVertexArrays::MeshVertexArrays(const MeshIndices &meshIndices, const MFnMesh &mesh, const ShapeIndex shapeIndex,
+                                   const Arguments &args) {
+    MStatus status;
 
-    static void getNormal(const SMikkTSpaceContext *pContext, float fvNormOut[], const int iFace, const int iVert) {
-        const auto context = reinterpret_cast<const MikkTSpaceContext *>(pContext);
-        const auto index = context->indices.normals[iFace * 3 + iVert];
-        const auto &vector = context->vectors.normals[index];
-        fvNormOut[0] = vector[0];
-        fvNormOut[1] = vector[1];
-        fvNormOut[2] = vector[2];
-    }
+    auto &semantics = meshIndices.semantics;
 
-    static void getTexCoord(const SMikkTSpaceContext *pContext, float fvTexcOut[], const int iFace, const int iVert) {
-        const auto context = reinterpret_cast<const MikkTSpaceContext *>(pContext);
-        const auto index = context->indices.texcoords[iFace * 3 + iVert];
+    // Get points
+    THROW_ON_FAILURE(mesh.getPoints(points, MSpace::kTransform));
 
-        if (index < 0) {
-            fvTexcOut[0] = NAN;
-            fvTexcOut[1] = NAN;
-        } else {
-            const auto &vector = context->vectors.texcoords[index];
-            fvTexcOut[0] = vector[0];
-            fvTexcOut[1] = 1 - vector[1];
+    // Get normals
+    auto oppositePlug = mesh.findPlug("opposite", true, &status);
+    THROW_ON_FAILURE(status);
+
+    bool shouldFlipNormals = false;
+    status = oppositePlug.getValue(shouldFlipNormals);
+    THROW_ON_FAILURE(status);
+
+    // TODO: When flipping normals, we should also flip the winding
+    normalSign = shouldFlipNormals ? -1.0f : 1.0f;
+
+    if (args.recomputeBlendShapeNormals && shapeIndex.isBlendShapeIndex()) {
+        isPointsOnly = true;
+
+        const auto dagPath = mesh.dagPath(&status);
+        THROW_ON_FAILURE(status);
+
+        const auto inverseMatrix = dagPath.inclusiveMatrixInverse(&status);
+        THROW_ON_FAILURE(status);
+
+        // The inverse transpose, of the 3x3 part.
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 3; ++column) {
+                normalMatrix[row][column] = inverseMatrix(column, row);
+            }
         }
+        return;
     }
 
-    static void setTSpaceBasic(const SMikkTSpaceContext *pContext, const float fvTangent[], const float fSign,
-                               const int iFace, const int iVert) {
-        const auto context = reinterpret_cast<const MikkTSpaceContext *>(pContext);
+    THROW_ON_FAILURE(mesh.getNormals(normals, MSpace::kWorld));
 
-        // Re-index
-        const auto index = iFace * 3 + iVert;
-        auto &tangentIndexRef = context->indices.tangents[index];
+    // Get color sets.
+    for (auto &&semantic : semantics.descriptions(Semantic::COLOR)) {
+        colorSets.emplace_back();
+        auto &colorSet = colorSets.back();
+        colorSet.setIndex = semantic.setIndex;
+        THROW_ON_FAILURE(mesh.getColors(colorSet.colors, &semantic.setName));
+    }
 
-        // If the vertex doesn't have a tangent, don't assign one
-        if (tangentIndexRef >= 0) {
-            tangentIndexRef = index;
+    // Get UV sets
+    for (auto &&semantic : semantics.descriptions(Semantic::TEXCOORD)) {
+        uvSets.emplace_back();
+        auto &uvSet = uvSets.back();
+        uvSet.setIndex = semantic.setIndex;
+        THROW_ON_FAILURE(mesh.getUVs(uvSet.uArray, uvSet.vArray, &semantic.setName));
+        assert(uvSet.uArray.length() == uvSet.vArray.length());
+    }
 
-            const float tx = fvTangent[0];
-            const float ty = fvTangent[1];
-            const float tz = fvTangent[2];
+    // The Mikkelsen tangents are generated from the other elements.
+    if (args.mikkelsenTangentAngularThreshold > 0)
+        return;
 
-            if (tx == 0 && ty == 0 && tz == 0) {
-                context->invalidTriangleIndices.insert(iFace);
-            }
+    // Get tangent sets
+    for (auto &&semantic : semantics.descriptions(Semantic::TANGENT)) {
+        tangentSets.emplace_back();
+        auto &tangentSet = tangentSets.back();
+        tangentSet.setIndex = semantic.setIndex;
+
+        auto &mTangents = tangentSet.tangents;
+        status = mesh.getTangents(mTangents, MSpace::kWorld, &semantic.setName);
+
+        if (status.error()) {
+            MayaException::printWarning(
+                formatted("Maya failed to provide the tangents of mesh '%s'!\n"
+                          "Assign texture coordinates and/or cleanup your mesh and try again please",
+                          mesh.name().asChar()),
+                status);
+            tangentSets.pop_back();
+            continue;
+        }
 
-            if (context->shapeIndex.isMainShapeIndex()) {
-                float *p = &context->vectors.tangentComponents[index * array_size<MainShapeTangent>::size];
-                p[0] = tx;
-                p[1] = ty;
-                p[2] = tz;
-                p[3] = fSign;
-            } else {
-                float *p = &context->vectors.tangentComponents[index * array_size<BlendShapeTangent>::size];
-                p[0] = tx;
-                p[1] = ty;
-                p[2] = tz;
+        if (!shapeIndex.isMainShapeIndex())
+            continue;
+
+        const int numTangents = mTangents.length();
+
+        // The handedness of all tangents is derived in bulk from the binormals and face-vertex normals.
+        // Maya stores a tangent per face-vertex, in face order. If that doesn't hold for some reason,
+        // fall back to querying each tangent.
+        auto &handedness = tangentSet.handedness;
+        handedness.resize(numTangents);
+
+        MFloatVectorArray mBinormals;
+        MIntArray normalCounts;
+        MIntArray normalIds;
+
+        const auto hasBinormals = mesh.getBinormals(mBinormals, MSpace::kWorld, &semantic.setName) &&
+                                  mesh.getNormalIds(normalCounts, normalIds) &&
+                                  static_cast<int>(mBinormals.length()) == numTangents &&
+                                  static_cast<int>(normalIds.length()) == numTangents;
+
+        if (hasBinormals) {
+            parallelFor(numTangents, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                    const auto faceVertexIndex = static_cast<unsigned>(i);
+                    const auto &t = mTangents[faceVertexIndex];
+                    const auto &b = mBinormals[faceVertexIndex];
+                    const auto &n = normals[normalIds[faceVertexIndex]];
+                    handedness[i] = (t ^ b) * n >= 0 ? 1.0f : -1.0f;
+                }
+            });
+        } else {
+            for (int i = 0; i < numTangents; ++i) {
+                handedness[i] = 2 * mesh.isRightHandedTangent(i, &semantic.setName, &status) - 1.0f;
+                THROW_ON_FAILURE(status);
             }
         }
     }
+}
 
-    static void reportDegenerateTriangle(const SMikkTSpaceContext *pContext, int triangleIndex) {
-        const auto context = reinterpret_cast<const MikkTSpaceContext *>(pContext);
-        context->invalidTriangleIndices.insert(triangleIndex);
-    }
-};
+MeshVertexArrays::~MeshVertexArrays() = default;
 
 MeshVertices::MeshVertices(const MeshIndices &meshIndices, const MeshSkeleton *meshSkeleton, const MFnMesh &mesh,
                            ShapeIndex shapeIndex, const ExportableNode &node, const Arguments &args)
-    : shapeIndex(shapeIndex) {
-    MStatus status;
+    : MeshVertices(meshIndices, meshSkeleton, MeshVertexArrays(meshIndices, mesh, shapeIndex, args), shapeIndex, args) {
+    reportTangentIssues(mesh, meshIndices, args);
+}
 
+MeshVertices::MeshVertices(const MeshIndices &meshIndices, const MeshSkeleton *meshSkeleton,
+                           const MeshVertexArrays &arrays, ShapeIndex shapeIndex, const Arguments &args,
+                           const MeshVertices *mainVertices)
+    : shapeIndex(shapeIndex) {
     auto &semantics = meshIndices.semantics;
 
-    // Get points
-    MPointArray mPoints;
-    THROW_ON_FAILURE(mesh.getPoints(mPoints, MSpace::kTransform));
+    if (arrays.isPointsOnly && !mainVertices)
+        throw std::runtime_error("The vertices of a blend shape target without normals need the main vertices");
+
+    const auto &mPoints = arrays.points;
     const int numPoints = mPoints.length();
-    m_positions.reserve(numPoints);
+    m_positions.resize(numPoints);
 
+    // The Maya arrays are fetched, the conversions are plain range kernels
+    // writing into pre-sized storage, so large meshes can be split over worker threads.
     const auto positionScale = args.getBakeScaleFactor();
-    for (int i = 0; i < numPoints; ++i) {
-        const auto p = mPoints[i] * positionScale;
-        m_positions.push_back(
-            {roundToFloat(p.x, posPrecision), roundToFloat(p.y, posPrecision), roundToFloat(p.z, posPrecision)});
-    }
+    const auto &grids = currentRoundingGrids();
+    const auto positionGrid = grids.position;
+    const auto directionGrid = grids.direction;
+    const auto colorGrid = grids.color;
+    const auto texCoordGrid = grids.texCoord;
+    parallelFor(numPoints, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+        auto *target = m_positions.data();
+        for (auto i = begin; i < end; ++i) {
+            const auto &p = mPoints[static_cast<unsigned>(i)];
+            auto &t = target[i];
+            t[0] = roundToFloat(p.x * positionScale, positionGrid);
+            t[1] = roundToFloat(p.y * positionScale, positionGrid);
+            t[2] = roundToFloat(p.z * positionScale, positionGrid);
+        }
+    });
 
     const auto positionsSpan = floats(span(m_positions));
     m_table.at(Semantic::POSITION).push_back(positionsSpan);
 
-    // Get normals
-    auto oppositePlug = mesh.findPlug("opposite", true, &status);
-    THROW_ON_FAILURE(status);
-
-    bool shouldFlipNormals = false;
-    status = oppositePlug.getValue(shouldFlipNormals);
-    THROW_ON_FAILURE(status);
+    if (arrays.isPointsOnly) {
+        recomputeNormals(meshIndices, *mainVertices, arrays);
+        m_table.at(Semantic::NORMAL).push_back(floats(span(m_normals)));
+
+        // The blend shapes don't change these, the table refers to the main vertices.
+        m_table.at(Semantic::COLOR) = mainVertices->m_table.at(Semantic::COLOR);
+        m_table.at(Semantic::TEXCOORD) = mainVertices->m_table.at(Semantic::TEXCOORD);
+    } else {
+        // Convert normals
+        const auto normalSign = arrays.normalSign;
+        const auto &mNormals = arrays.normals;
+        const int numNormals = mNormals.length();
+        m_normals.resize(numNormals);
+        parallelFor(numNormals, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+            auto *target = m_normals.data();
+            for (auto i = begin; i < end; ++i) {
+                const auto &n = mNormals[static_cast<unsigned>(i)];
+                auto &t = target[i];
+                t[0] = roundToFloat(normalSign * n.x, directionGrid);
+                t[1] = roundToFloat(normalSign * n.y, directionGrid);
+                t[2] = roundToFloat(normalSign * n.z, directionGrid);
+            }
+        });
 
-    // TODO: When flipping normals, we should also flip the winding
-    const float normalSign = shouldFlipNormals ? -1.0f : 1.0f;
-
-    MFloatVectorArray mNormals;
-    THROW_ON_FAILURE(mesh.getNormals(mNormals, MSpace::kWorld));
-    const int numNormals = mNormals.length();
-    m_normals.reserve(numNormals);
-    for (int i = 0; i < numNormals; ++i) {
-        auto n = mNormals[i];
-        m_normals.push_back({roundToFloat(normalSign * n.x, dirPrecision), roundToFloat(normalSign * n.y, dirPrecision),
-                             roundToFloat(normalSign * n.z, dirPrecision)});
+        const auto normalsSpan = floats(span(m_normals));
+        m_table.at(Semantic::NORMAL).push_back(normalsSpan);
     }
 
-    const auto normalsSpan = floats(span(m_normals));
-    m_table.at(Semantic::NORMAL).push_back(normalsSpan);
-
-    // Get color sets.
-    for (auto &&semantic : semantics.descriptions(Semantic::COLOR)) {
-        MColorArray mColors;
-        THROW_ON_FAILURE(mesh.getColors(mColors, &semantic.setName));
-
+    // Convert color sets.
+    for (auto &&colorSet : arrays.colorSets) {
+        const auto &mColors = colorSet.colors;
         const int numColors = mColors.length();
-        THROW_ON_FAILURE(status);
 
-        auto &colors = m_colorSets[semantic.setIndex];
-        colors.reserve(numColors);
-        for (int i = 0; i < numColors; ++i) {
-            const auto &c = mColors[i];
-            ;
-            colors.push_back({roundToFloat(c.r, colPrecision), roundToFloat(c.g, colPrecision),
-                              roundToFloat(c.b, colPrecision), roundToFloat(c.a, colPrecision)});
-        }
+        auto &colors = m_colorSets[colorSet.setIndex];
+        colors.resize(numColors);
+        parallelFor(numColors, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+            auto *target = colors.data();
+            for (auto i = begin; i < end; ++i) {
+                const auto &c = mColors[static_cast<unsigned>(i)];
+                auto &t = target[i];
+                t[0] = roundToFloat(c.r, colorGrid);
+                t[1] = roundToFloat(c.g, colorGrid);
+                t[2] = roundToFloat(c.b, colorGrid);
+                t[3] = roundToFloat(c.a, colorGrid);
+            }
+        });
 
         const auto colorsSpan = floats(span(colors));
         m_table.at(Semantic::COLOR).push_back(colorsSpan);
     }
 
-    // Get UV sets
+    // Convert UV sets
     // These are not interleaved in Maya, so we have to do it ourselves...
-    for (auto &&semantic : semantics.descriptions(Semantic::TEXCOORD)) {
-        MFloatArray uArray;
-        MFloatArray vArray;
-        THROW_ON_FAILURE(mesh.getUVs(uArray, vArray, &semantic.setName));
-
-        assert(uArray.length() == vArray.length());
+    for (auto &&mUVSet : arrays.uvSets) {
+        const auto &uArray = mUVSet.uArray;
+        const auto &vArray = mUVSet.vArray;
         const int uCount = uArray.length();
 
-        auto &uvSet = m_uvSets[semantic.setIndex] = Float2Vector(uCount);
-        for (auto uIndex = 0; uIndex < uCount; uIndex++) {
-            auto &uvArray = uvSet[uIndex];
-            uvArray[0] = roundToFloat(uArray[uIndex], texPrecision);
-            uvArray[1] = roundToFloat(1 - vArray[uIndex], texPrecision);
-        }
+        auto &uvSet = m_uvSets[mUVSet.setIndex] = Float2Vector(uCount);
+        parallelFor(uCount, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+            auto *target = uvSet.data();
+            for (auto i = begin; i < end; ++i) {
+                const auto uIndex = static_cast<unsigned>(i);
+                auto &t = target[i];
+                t[0] = roundToFloat(uArray[uIndex], texCoordGrid);
+                t[1] = roundToFloat(1 - vArray[uIndex], texCoordGrid);
+            }
+        });
 
         const auto uvSpan = floats(span(uvSet));
         m_table.at(Semantic::TEXCOORD).push_back(uvSpan);
     }
 
     // Get tangent sets
-    for (auto &&semantic : semantics.descriptions(Semantic::TANGENT)) {
-        if (args.mikkelsenTangentAngularThreshold > 0) {
-            const auto numTriangles = meshIndices.primitiveCount();
-            const auto numTangents = numTriangles * 3;
+    if (args.mikkelsenTangentAngularThreshold > 0) {
+        ProfileScope profileScope("Tangents");
+
+        const auto &tangentSemantics = semantics.descriptions(Semantic::TANGENT);
+        const auto numTriangles = meshIndices.primitiveCount();
+        const auto numTangents = numTriangles * 3;
 
+        // All sets are allocated up front, since the generators run concurrently.
+        for (auto &&semantic : tangentSemantics) {
             auto &tangentSet = m_tangentSets[semantic.setIndex];
             tangentSet.resize(numTangents * dimension(Semantic::TANGENT, shapeIndex));
+            profileScope.addBytes(tangentSet.size() * sizeof(float));
 
             const auto tangentSpan = floats(span(tangentSet));
             m_table.at(Semantic::TANGENT).push_back(tangentSpan);
+        }
 
-            MikkTSpaceContext context(meshIndices, m_table, semantic.setIndex, shapeIndex);
-            context.computeTangents(args.mikkelsenTangentAngularThreshold);
-
-            if (!context.invalidTriangleIndices.empty()) {
-                // Don't flood the console output if too many faces are invalid.
-                int maxIndices = 10;
+        // Each tangent mesh is one tangent set, for one independent chunk of triangles (or all of them).
+        // These write disjoint corners, and collect their degenerate triangles locally.
+        const auto chunks = splitIntoTangentChunks(meshIndices, m_positions);
 
-                std::stringstream ss;
-                ss << "select -r";
-                for (auto triangleIndex : context.invalidTriangleIndices) {
-                    ss << ' ' << mesh.name() << ".f[" << meshIndices.triangleToFaceIndex(triangleIndex) << "]";
-                    if (--maxIndices < 0)
-                        break;
+        ArenaVector<kernels::TangentMesh> tangentMeshes;
+        for (auto &&semantic : tangentSemantics) {
+            if (chunks.empty()) {
+                tangentMeshes.emplace_back(tangentMesh(meshIndices, m_table, semantic.setIndex, shapeIndex));
+            } else {
+                for (auto &chunk : chunks) {
+                    tangentMeshes.emplace_back(tangentMesh(meshIndices, m_table, semantic.setIndex, shapeIndex, span(chunk)));
                 }
-                ss << ";";
-
-                MayaException::printError(formatted("Tangent generator found degenerate faces!\nThis can cause "
-                                                    "rendering artifacts.\nPlease check and fix your mesh and "
-                                                    "UV mapping.\nUse the following command select the first "
-                                                    "invalid faces:\n%s\n\n",
-                                                    ss.str().c_str()));
             }
-        } else {
-            MFloatVectorArray mTangents;
+        }
 
-            status = mesh.getTangents(mTangents, MSpace::kWorld, &semantic.setName);
+        ArenaVector<char> succeeded(tangentMeshes.size());
+        parallelForEach(tangentMeshes.size(), 1, [&](const size_t meshIndex) {
+            succeeded[meshIndex] = kernels::generateTangents(tangentMeshes[meshIndex], args.mikkelsenTangentAngularThreshold);
+        });
 
-            if (status.error()) {
-                MayaException::printWarning(
-                    formatted("Maya failed to provide the tangents of mesh '%s'!\n"
-                              "Assign texture coordinates and/or cleanup your mesh and try again please",
-                              mesh.name().asChar()),
-                    status);
-            } else {
-                const int numTangents = mTangents.length();
+        m_hasTangentGenerationFailed = std::find(succeeded.begin(), succeeded.end(), 0) != succeeded.end();
 
-                auto &tangentSet = m_tangentSets[semantic.setIndex];
-                tangentSet.reserve(numTangents * dimension(Semantic::TANGENT, shapeIndex));
+        const auto meshesPerSet = std::max<size_t>(1, chunks.size());
 
-                std::unordered_set<int> invalidTangentIds;
+        for (size_t setIndex = 0; setIndex < tangentSemantics.size(); ++setIndex) {
+            std::vector<int> invalidTriangleIndices;
+            for (size_t chunkIndex = 0; chunkIndex < meshesPerSet; ++chunkIndex) {
+                const auto &indices = tangentMeshes[setIndex * meshesPerSet + chunkIndex].invalidTriangleIndices;
+                invalidTriangleIndices.insert(invalidTriangleIndices.end(), indices.begin(), indices.end());
+            }
 
-                for (int i = 0; i < numTangents; ++i) {
-                    auto t = mTangents[i];
-                    const auto rht = 2 * mesh.isRightHandedTangent(i, &semantic.setName, &status) - 1.0f;
-                    THROW_ON_FAILURE(status);
-                    tangentSet.push_back(roundToFloat(t.x, dirPrecision));
-                    tangentSet.push_back(roundToFloat(t.y, dirPrecision));
-                    tangentSet.push_back(roundToFloat(t.z, dirPrecision));
+            std::sort(invalidTriangleIndices.begin(), invalidTriangleIndices.end());
+            invalidTriangleIndices.erase(std::unique(invalidTriangleIndices.begin(), invalidTriangleIndices.end()),
+                                         invalidTriangleIndices.end());
 
-                    auto l = t.x * t.x + t.y * t.y + t.z * t.z;
-                    if (abs(l - 1) > 1e-6) {
-                        invalidTangentIds.insert(i);
+            if (!invalidTriangleIndices.empty()) {
+                m_degenerateTangentTriangles.emplace_back(std::move(invalidTriangleIndices));
+            }
+        }
+    } else if (arrays.isPointsOnly) {
+        orthogonalizeTangents(meshIndices, *mainVertices);
+    } else {
+        for (auto &&mTangentSet : arrays.tangentSets) {
+            const auto &mTangents = mTangentSet.tangents;
+            const auto &handedness = mTangentSet.handedness;
+
+            const int numTangents = mTangents.length();
+            const auto hasHandedness = shapeIndex.isMainShapeIndex();
+            const auto tangentDimension = dimension(Semantic::TANGENT, shapeIndex);
+
+            auto &tangentSet = m_tangentSets[mTangentSet.setIndex];
+            tangentSet.resize(numTangents * tangentDimension);
+
+            // Rounding and validity pass, invalid tangents are just flagged here.
+            ArenaVector<char> isInvalidTangent(numTangents);
+            parallelFor(numTangents, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                    const auto &t = mTangents[static_cast<unsigned>(i)];
+                    float *p = &tangentSet[i * tangentDimension];
+                    p[0] = roundToFloat(t.x, directionGrid);
+                    p[1] = roundToFloat(t.y, directionGrid);
+                    p[2] = roundToFloat(t.z, directionGrid);
+
+                    if (hasHandedness) {
+                        p[3] = handedness[i];
                     }
 
-                    if (shapeIndex.isMainShapeIndex()) {
-                        tangentSet.push_back(rht);
-                    }
+                    const auto l = t.x * t.x + t.y * t.y + t.z * t.z;
+                    isInvalidTangent[i] = std::abs(l - 1) > 1e-6;
                 }
+            });
 
-                const auto tangentSpan = floats(span(tangentSet));
-                m_table.at(Semantic::TANGENT).push_back(tangentSpan);
-
-                if (!invalidTangentIds.empty()) {
-                    auto meshObject = mesh.object(&status);
-                    THROW_ON_FAILURE(status);
-
-                    MItMeshFaceVertex itFaceVertex(meshObject, &status);
-                    THROW_ON_FAILURE(status);
-
-                    // Don't flood the console output if too many vertices are
-                    // invalid.
-                    int selectedIndexCount = 0;
-
-                    const auto meshName = mesh.name();
-
-                    std::stringstream ss;
-                    ss << formatted("doMenuComponentSelectionExt(\"%s\", "
-                                    "\"pvf\", 0);",
-                                    meshName.asChar())
-                       << endl;
-                    ss << formatted("setAttr \"%s.displayTangent\" 1;", meshName.asChar()) << endl;
-                    ss << formatted("checkMeshDisplayNormals \"%s\";", meshName.asChar()) << endl;
-                    ss << "select -r";
-
-                    while (!itFaceVertex.isDone() && selectedIndexCount < 10) {
-                        if (invalidTangentIds.end() != invalidTangentIds.find(itFaceVertex.tangentId())) {
-                            ss << ' ' << mesh.name() << ".vtxFace[" << itFaceVertex.vertId() << "]["
-                               << itFaceVertex.faceId() << "]";
-                            ++selectedIndexCount;
-                        }
-                        itFaceVertex.next();
-                    }
+            std::vector<int> invalidTangentIds;
+            for (int i = 0; i < numTangents; ++i) {
+                if (isInvalidTangent[i]) {
+                    invalidTangentIds.push_back(i);
+                }
+            }
 
-                    ss << ";";
+            const auto tangentSpan = floats(span(tangentSet));
+            m_table.at(Semantic::TANGENT).push_back(tangentSpan);
 
-                    // Find the faces with invalid tangents.
-                    MayaException::printError(formatted("Mesh '%s' has %d invalid tangents!\nAssign texture "
-                                                        "coordinates and/or cleanup your mesh and try again "
-                                                        "please.\nUse the following command to visualize the "
-                                                        "tangents and select the first invalid "
-                                                        "face-vertices:\n\n%s\n",
-                                                        mesh.name().asChar(), invalidTangentIds.size(),
-                                                        ss.str().c_str()));
-                }
+            if (!invalidTangentIds.empty()) {
+                m_invalidTangentIds.emplace_back(std::move(invalidTangentIds));
             }
         }
     }
@@ -433,10 +530,317 @@ MeshVertices::MeshVertices(const MeshIndices &meshIndices, const MeshSkeleton *m
             }
         }
     }
+
+    updateHeldMemory();
+}
+
+MeshVertices::MeshVertices(const MeshVertices &mainVertices, const BlendShapeTargetDeltas &deltas, ShapeIndex shapeIndex,
+                           const Arguments &args)
+    : shapeIndex(shapeIndex), m_positions(mainVertices.m_positions) {
+    const auto positionScale = args.getBakeScaleFactor();
+    const auto positionGrid = currentRoundingGrids().position;
+    const auto numPoints = static_cast<int>(m_positions.size());
+    const auto numDeltas = deltas.vertexIndices.length();
+
+    for (auto i = 0U; i < numDeltas; ++i) {
+        const auto pointIndex = deltas.vertexIndices[i];
+        if (pointIndex < 0 || pointIndex >= numPoints)
+            throw std::runtime_error(formatted("Blend shape target offset #%d refers to invalid vertex %d", i, pointIndex));
+
+        const auto &offset = deltas.offsets[i];
+        auto &p = m_positions[pointIndex];
+        p[0] = roundToFloat(p[0] + offset.x * positionScale, positionGrid);
+        p[1] = roundToFloat(p[1] + offset.y * positionScale, positionGrid);
+        p[2] = roundToFloat(p[2] + offset.z * positionScale, positionGrid);
+    }
+
+    const auto positionsSpan = floats(span(m_positions));
+    m_table.at(Semantic::POSITION).push_back(positionsSpan);
+
+    updateHeldMemory();
+}
+
+typedef std::array<double, 3> NormalSum;
+
+/** The area weighted normal of a triangle */
+static NormalSum faceNormal(const PositionVector &positions, const Index *corners) {
+    const auto &a = positions[corners[0]];
+    const auto &b = positions[corners[1]];
+    const auto &c = positions[corners[2]];
+
+    const double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    const double e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+    return {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+}
+
+/** The normalized world space normal, false when it has no direction */
+static bool worldNormal(const NormalSum &sum, const MeshVertexArrays &arrays, NormalSum &normal) {
+    const auto &m = arrays.normalMatrix;
+    double length = 0;
+    for (int column = 0; column < 3; ++column) {
+        normal[column] = sum[0] * m[0][column] + sum[1] * m[1][column] + sum[2] * m[2][column];
+        length += normal[column] * normal[column];
+    }
+
+    if (length <= 0)
+        return false;
+
+    length = std::sqrt(length);
+    for (auto &component : normal) {
+        component /= length;
+    }
+    return true;
+}
+
+void MeshVertices::recomputeNormals(const MeshIndices &meshIndices, const MeshVertices &mainVertices,
+                                    const MeshVertexArrays &arrays) {
+    ProfileScope profileScope("Blend shape normals");
+
+    const auto &mainPositions = mainVertices.m_positions;
+    const auto &mainNormals = mainVertices.m_normals;
+
+    if (m_positions.size() != mainPositions.size())
+        throw std::runtime_error("The blend shape target doesn't have the points of the main shape");
+
+    m_normals = mainNormals;
+
+    const auto &positionIndices = meshIndices.indicesAt(Semantic::POSITION, 0);
+    const auto &normalIndices = meshIndices.indicesAt(Semantic::NORMAL, 0);
+    const auto triangleCount = static_cast<size_t>(meshIndices.primitiveCount());
+
+    // Only the triangles with a moved corner change the normals.
+    ArenaVector<char> isMovedTriangle(triangleCount);
+    parallelFor(triangleCount, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+        for (auto triangleIndex = begin; triangleIndex < end; ++triangleIndex) {
+            const auto *corners = &positionIndices[triangleIndex * 3];
+            isMovedTriangle[triangleIndex] = m_positions[corners[0]] != mainPositions[corners[0]] ||
+                                             m_positions[corners[1]] != mainPositions[corners[1]] ||
+                                             m_positions[corners[2]] != mainPositions[corners[2]];
+        }
+    });
+
+    ArenaVector<int> movedTriangles;
+    for (size_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+        if (isMovedTriangle[triangleIndex]) {
+            movedTriangles.push_back(static_cast<int>(triangleIndex));
+        }
+    }
+
+    // The face normals of the main and the target positions.
+    ArenaVector<std::array<NormalSum, 2>> faceNormals(movedTriangles.size());
+    parallelFor(movedTriangles.size(), elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            const auto *corners = &positionIndices[movedTriangles[i] * 3];
+            faceNormals[i][0] = faceNormal(mainPositions, corners);
+            faceNormals[i][1] = faceNormal(m_positions, corners);
+        }
+    });
+
+    // The face normals are summed per normal of the main shape, so these
+    // keep its hard edges.
+    const auto normalCount = mainNormals.size();
+    ArenaVector<std::array<NormalSum, 2>> normalSums(normalCount);
+    ArenaVector<char> isMovedNormal(normalCount);
+    ArenaVector<int> movedNormals;
+
+    for (size_t i = 0; i < movedTriangles.size(); ++i) {
+        for (int corner = 0; corner < 3; ++corner) {
+            const auto normalIndex = normalIndices[movedTriangles[i] * 3 + corner];
+            if (normalIndex < 0 || size_t(normalIndex) >= normalCount)
+                continue;
+
+            auto &sums = normalSums[normalIndex];
+            for (int shape = 0; shape < 2; ++shape) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    sums[shape][axis] += faceNormals[i][shape][axis];
+                }
+            }
+
+            if (!isMovedNormal[normalIndex]) {
+                isMovedNormal[normalIndex] = 1;
+                movedNormals.push_back(normalIndex);
+            }
+        }
+    }
+
+    // The main normal, that can be locked or smoothed differently, turned
+    // by the change of the computed normal.
+    const auto normalSign = arrays.normalSign;
+    const auto directionGrid = currentRoundingGrids().direction;
+    parallelFor(movedNormals.size(), elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            const auto normalIndex = movedNormals[i];
+            const auto &sums = normalSums[normalIndex];
+
+            NormalSum mainNormal;
+            NormalSum targetNormal;
+            if (!worldNormal(sums[0], arrays, mainNormal) || !worldNormal(sums[1], arrays, targetNormal))
+                continue;
+
+            const auto &n = mainNormals[normalIndex];
+            const NormalSum turned = {n[0] + normalSign * (targetNormal[0] - mainNormal[0]),
+                                      n[1] + normalSign * (targetNormal[1] - mainNormal[1]),
+                                      n[2] + normalSign * (targetNormal[2] - mainNormal[2])};
+
+            const auto length = std::sqrt(turned[0] * turned[0] + turned[1] * turned[1] + turned[2] * turned[2]);
+            if (length <= 0)
+                continue;
+
+            const auto scale = 1 / length;
+            auto &t = m_normals[normalIndex];
+            t[0] = roundToFloat(turned[0] * scale, directionGrid);
+            t[1] = roundToFloat(turned[1] * scale, directionGrid);
+            t[2] = roundToFloat(turned[2] * scale, directionGrid);
+        }
+    });
+
+    profileScope.addBytes(movedTriangles.size() * 3 * sizeof(Position));
+}
+
+void MeshVertices::orthogonalizeTangents(const MeshIndices &meshIndices, const MeshVertices &mainVertices) {
+    const auto &mainNormals = mainVertices.m_normals;
+    const auto &normalIndices = meshIndices.indicesAt(Semantic::NORMAL, 0);
+    const auto mainDimension = dimension(Semantic::TANGENT, mainVertices.shapeIndex);
+    const auto tangentDimension = dimension(Semantic::TANGENT, shapeIndex);
+    const auto directionGrid = currentRoundingGrids().direction;
+
+    for (auto &&semantic : meshIndices.semantics.descriptions(Semantic::TANGENT)) {
+        const auto mainSetIt = mainVertices.m_tangentSets.find(semantic.setIndex);
+        if (mainSetIt == mainVertices.m_tangentSets.end())
+            continue;
+
+        const auto &mainTangents = mainSetIt->second;
+        const auto tangentCount = mainTangents.size() / mainDimension;
+
+        auto &tangentSet = m_tangentSets[semantic.setIndex];
+        tangentSet.resize(tangentCount * tangentDimension);
+
+        parallelFor(tangentCount, elementConversionChunkSize, [&](const size_t begin, const size_t end) {
+            for (auto i = begin; i < end; ++i) {
+                std::copy_n(&mainTangents[i * mainDimension], 3, &tangentSet[i * tangentDimension]);
+            }
+        });
+
+        // Only the tangents of the corners with a turned normal change. The
+        // corners of a face-vertex share its tangent, so these are written
+        // on this thread.
+        const auto &tangentIndices = meshIndices.indicesAt(Semantic::TANGENT, semantic.setIndex);
+        const auto cornerCount = std::min(tangentIndices.size(), normalIndices.size());
+
+        for (std::ptrdiff_t corner = 0; corner < cornerCount; ++corner) {
+            const auto tangentIndex = tangentIndices[corner];
+            const auto normalIndex = normalIndices[corner];
+            if (tangentIndex < 0 || size_t(tangentIndex) >= tangentCount || normalIndex < 0 ||
+                size_t(normalIndex) >= mainNormals.size() || m_normals[normalIndex] == mainNormals[normalIndex])
+                continue;
+
+            const auto *m = &mainTangents[tangentIndex * mainDimension];
+            const auto &n = m_normals[normalIndex];
+            const auto d = m[0] * n[0] + m[1] * n[1] + m[2] * n[2];
+            const double t[3] = {m[0] - d * n[0], m[1] - d * n[1], m[2] - d * n[2]};
+
+            const auto length = std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+            if (length <= 0)
+                continue;
+
+            const auto scale = 1 / length;
+            auto *p = &tangentSet[tangentIndex * tangentDimension];
+            p[0] = roundToFloat(t[0] * scale, directionGrid);
+            p[1] = roundToFloat(t[1] * scale, directionGrid);
+            p[2] = roundToFloat(t[2] * scale, directionGrid);
+        }
+
+        m_table.at(Semantic::TANGENT).push_back(floats(span(tangentSet)));
+    }
 }
 
 MeshVertices::~MeshVertices() = default;
 
+void MeshVertices::reportTangentIssues(const MFnMesh &mesh, const MeshIndices &meshIndices, const Arguments &args) const {
+    MStatus status;
+
+    if (m_hasTangentGenerationFailed) {
+        MayaException::printError("Failed to get Mikkelsen tangents (aka MikkTSpace)");
+    }
+
+    for (auto &&invalidTriangleIndices : m_degenerateTangentTriangles) {
+        // Don't flood the console output if too many faces are invalid.
+        int maxIndices = 10;
+
+        std::stringstream ss;
+        ss << "select -r";
+        for (auto triangleIndex : invalidTriangleIndices) {
+            ss << ' ' << mesh.name() << ".f[" << meshIndices.triangleToFaceIndex(triangleIndex) << "]";
+            if (--maxIndices < 0)
+                break;
+        }
+        ss << ";";
+
+        MayaException::printError(formatted("Tangent generator found degenerate faces!\nThis can cause "
+                                            "rendering artifacts.\nPlease check and fix your mesh and "
+                                            "UV mapping.\nUse the following command select the first "
+                                            "invalid faces:\n%s\n\n",
+                                            ss.str().c_str()));
+    }
+
+    for (auto &&invalidTangentIds : m_invalidTangentIds) {
+        if (args.diagnostics == Diagnostics::FAST) {
+            MayaException::printError(formatted("Mesh '%s' has %d invalid tangents!\nAssign texture "
+                                                "coordinates and/or cleanup your mesh and try again "
+                                                "please.\nExport with -diagnostics full to get a command "
+                                                "that selects the first invalid face-vertices.\n",
+                                                mesh.name().asChar(), invalidTangentIds.size()));
+            continue;
+        }
+
+        auto meshObject = mesh.object(&status);
+        THROW_ON_FAILURE(status);
+
+        MItMeshFaceVertex itFaceVertex(meshObject, &status);
+        THROW_ON_FAILURE(status);
+
+        // Don't flood the console output if too many vertices are
+        // invalid.
+        int selectedIndexCount = 0;
+
+        const auto meshName = mesh.name();
+
+        std::stringstream ss;
+        ss << formatted("doMenuComponentSelectionExt(\"%s\", "
+                        "\"pvf\", 0);",
+                        meshName.asChar())
+           << endl;
+        ss << formatted("setAttr \"%s.displayTangent\" 1;", meshName.asChar()) << endl;
+        ss << formatted("checkMeshDisplayNormals \"%s\";", meshName.asChar()) << endl;
+        ss << "select -r";
+
+        while (!itFaceVertex.isDone() && selectedIndexCount < args.maxDiagnosticItems) {
+            if (std::binary_search(invalidTangentIds.begin(), invalidTangentIds.end(), itFaceVertex.tangentId())) {
+                ss << ' ' << mesh.name() << ".vtxFace[" << itFaceVertex.vertId() << "][" << itFaceVertex.faceId()
+                   << "]";
+                ++selectedIndexCount;
+            }
+            itFaceVertex.next();
+        }
+
+        ss << ";";
+
+        // Find the faces with invalid tangents.
+        MayaException::printError(formatted("Mesh '%s' has %d invalid tangents!\nAssign texture "
+                                            "coordinates and/or cleanup your mesh and try again "
+                                            "please.\nUse the following command to visualize the "
+                                            "tangents and select the first invalid "
+                                            "face-vertices:\n\n%s\n",
+                                            mesh.name().asChar(), invalidTangentIds.size(), ss.str().c_str()));
+    }
+}
+
+void MeshVertices::updateHeldMemory() {
+    m_heldMemory.set(heldBytes(m_positions) + heldBytes(m_normals) + heldBytes(m_tangentSets) + heldBytes(m_uvSets) +
+                     heldBytes(m_colorSets) + heldBytes(m_jointWeights) + heldBytes(m_jointIndices) + heldBytes(m_jointWeightSums));
+}
+
 void MeshVertices::dump(IndentableStream &out, const std::string &name) const {
     dump_vertex_table(out, name, m_table, shapeIndex);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "HeldMemory.h"
 #include "MeshSemantics.h"
 #include "macros.h"
 #include "sceneTypes.h"
@@ -77,6 +78,55 @@ inline VertexComponents componentsAt(const VertexComponents &elements,
 class Arguments;
 class MeshIndices;
 class ExportableNode;
+struct BlendShapeTargetDeltas;
+
+/**
+ * The Maya arrays of the vertex elements of a shape. Fetching these calls
+ * into Maya, but converting them doesn't, so the blend shape targets are
+ * fetched on the main thread and converted on the workers, see Mesh.
+ */
+struct MeshVertexArrays {
+    MeshVertexArrays(const MeshIndices &meshIndices, const MFnMesh &mesh,
+                     ShapeIndex shapeIndex, const Arguments &args);
+    ~MeshVertexArrays();
+
+    struct ColorSet {
+        SetIndex setIndex;
+        MColorArray colors;
+    };
+
+    struct UVSet {
+        SetIndex setIndex;
+        MFloatArray uArray;
+        MFloatArray vArray;
+    };
+
+    // The Maya tangents, none when generating the Mikkelsen tangents.
+    struct TangentSet {
+        SetIndex setIndex;
+        MFloatVectorArray tangents;
+        // Per tangent, only of the main shape.
+        std::vector<float> handedness;
+    };
+
+    // Only the points of a target are fetched with -recomputeBlendShapeNormals,
+    // the other elements are derived from the main shape.
+    bool isPointsOnly = false;
+
+    MPointArray points;
+    MFloatVectorArray normals;
+    float normalSign = 1;
+
+    // Transforms the object space normals to world space, like Maya's
+    // normals, as row vectors.
+    std::array<std::array<double, 3>, 3> normalMatrix;
+
+    std::vector<ColorSet> colorSets;
+    std::vector<UVSet> uvSets;
+    std::vector<TangentSet> tangentSets;
+
+    DISALLOW_COPY_MOVE_ASSIGN(MeshVertexArrays);
+};
 
 class MeshVertices {
   public:
@@ -84,6 +134,23 @@ class MeshVertices {
                  const MeshSkeleton *meshSkeleton, const MFnMesh &mesh,
                  ShapeIndex shapeIndex, const ExportableNode &node,
                  const Arguments &args);
+
+    /** The vertices converted from the fetched arrays, doesn't call Maya,
+     * so it can run on a worker thread. The tangent issues are reported by
+     * reportTangentIssues. The main vertices are needed when the arrays
+     * only have points. */
+    MeshVertices(const MeshIndices &meshIndices,
+                 const MeshSkeleton *meshSkeleton,
+                 const MeshVertexArrays &arrays, ShapeIndex shapeIndex,
+                 const Arguments &args,
+                 const MeshVertices *mainVertices = nullptr);
+
+    /** Blend shape target vertices, the main shape positions displaced by the
+     * sparse offsets read from the deformer. Only has positions. */
+    MeshVertices(const MeshVertices &mainVertices,
+                 const BlendShapeTargetDeltas &deltas, ShapeIndex shapeIndex,
+                 const Arguments &args);
+
     virtual ~MeshVertices();
 
     const ShapeIndex shapeIndex;
@@ -92,6 +159,11 @@ class MeshVertices {
 
     void dump(class IndentableStream &out, const std::string &name) const;
 
+    /** Prints the invalid tangents found by the conversion, on the main
+     * thread, since the commands that select these query the mesh. */
+    void reportTangentIssues(const MFnMesh &mesh, const MeshIndices &meshIndices,
+                             const Arguments &args) const;
+
     const VertexComponents &
     vertexElementComponentsAt(const size_t semanticIndex,
                               const size_t setIndex) const {
@@ -111,7 +183,28 @@ class MeshVertices {
     std::map<SetIndex, JointIndicesVector> m_jointIndices;
     std::vector<float> m_jointWeightSums;
 
+    // The tangent issues, reported by reportTangentIssues.
+    bool m_hasTangentGenerationFailed = false;
+    std::vector<std::vector<int>> m_degenerateTangentTriangles;
+    std::vector<std::vector<int>> m_invalidTangentIds;
+
     VertexElementsPerSetIndexTable m_table;
 
+    HeldMemory m_heldMemory{MemoryKind::MESH_VERTICES};
+
+    // The normals of a target, the main normals changed by the difference
+    // of the normals computed from the main and target positions.
+    void recomputeNormals(const MeshIndices &meshIndices,
+                          const MeshVertices &mainVertices,
+                          const MeshVertexArrays &arrays);
+
+    // The tangents of a target, the main tangents made perpendicular to the
+    // target normals.
+    void orthogonalizeTangents(const MeshIndices &meshIndices,
+                               const MeshVertices &mainVertices);
+
+    // Accounts the bytes of the vertex elements, after these are extracted.
+    void updateHeldMemory();
+
     DISALLOW_COPY_MOVE_ASSIGN(MeshVertices);
 };
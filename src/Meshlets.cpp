@@ -0,0 +1,324 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Meshlets.h"
+#include "accessors.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+namespace {
+Float3 subtract(const Position &a, const Position &b) { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+
+float dot(const Float3 &a, const Float3 &b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+Float3 cross(const Float3 &a, const Float3 &b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+// The bounding sphere and normal cone of the meshlet.
+void addBounds(const IndexVector &indices, const gsl::span<const Position> &positions,
+               const std::vector<Index> &meshletVertices, const std::vector<Index> &meshletTriangles,
+               MeshletBuffer &meshlets) {
+    const auto maxFloat = std::numeric_limits<float>::max();
+
+    Position min = {maxFloat, maxFloat, maxFloat};
+    Position max = {-maxFloat, -maxFloat, -maxFloat};
+
+    for (auto vertexIndex : meshletVertices) {
+        const auto &p = positions[vertexIndex];
+        for (int axis = 0; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], p[axis]);
+            max[axis] = std::max(max[axis], p[axis]);
+        }
+    }
+
+    const Position center = {(min[0] + max[0]) / 2, (min[1] + max[1]) / 2, (min[2] + max[2]) / 2};
+
+    float radiusSquared = 0;
+    for (auto vertexIndex : meshletVertices) {
+        const auto offset = subtract(positions[vertexIndex], center);
+        radiusSquared = std::max(radiusSquared, dot(offset, offset));
+    }
+
+    meshlets.spheres.push_back({center[0], center[1], center[2], std::sqrt(radiusSquared)});
+
+    // The average of the unit normals, degenerate triangles don't count.
+    std::vector<Float3> normals;
+    normals.reserve(meshletTriangles.size());
+
+    Float3 normalSum = {0, 0, 0};
+
+    for (auto triangleIndex : meshletTriangles) {
+        const auto &a = positions[indices[triangleIndex * 3 + 0]];
+        const auto &b = positions[indices[triangleIndex * 3 + 1]];
+        const auto &c = positions[indices[triangleIndex * 3 + 2]];
+
+        auto normal = cross(subtract(b, a), subtract(c, a));
+        const auto length = std::sqrt(dot(normal, normal));
+        if (length == 0)
+            continue;
+
+        for (auto &component : normal) {
+            component /= length;
+        }
+
+        normals.push_back(normal);
+
+        for (int axis = 0; axis < 3; ++axis) {
+            normalSum[axis] += normal[axis];
+        }
+    }
+
+    const auto sumLength = std::sqrt(dot(normalSum, normalSum));
+    if (sumLength == 0) {
+        meshlets.cones.push_back({0, 0, 1, 1});
+        return;
+    }
+
+    const Float3 axis = {normalSum[0] / sumLength, normalSum[1] / sumLength, normalSum[2] / sumLength};
+
+    float minDot = 1;
+    for (auto &&normal : normals) {
+        minDot = std::min(minDot, dot(normal, axis));
+    }
+
+    // A wide cone is hardly ever culled, so it isn't worth testing.
+    const auto cutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+
+    meshlets.cones.push_back({axis[0], axis[1], axis[2], cutoff});
+}
+} // namespace
+
+void buildMeshlets(const IndexVector &indices, const gsl::span<const Position> &positions, const size_t maxVertices,
+                   const size_t maxTriangles, MeshletBuffer &meshlets) {
+    assert(maxVertices >= 3 && maxVertices <= 256 && maxTriangles >= 1);
+
+    const auto vertexCount = static_cast<size_t>(positions.size());
+    const auto triangleCount = indices.size() / 3;
+
+    // The triangles using each vertex, the remaining ones first.
+    std::vector<int> remainingCounts(vertexCount, 0);
+    for (const auto index : indices) {
+        ++remainingCounts[index];
+    }
+
+    std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        adjacencyOffsets[vertexIndex + 1] = adjacencyOffsets[vertexIndex] + remainingCounts[vertexIndex];
+    }
+
+    std::vector<Index> adjacency(indices.size());
+    {
+        std::vector<size_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t corner = 0; corner < indices.size(); ++corner) {
+            adjacency[cursors[indices[corner]]++] = static_cast<Index>(corner / 3);
+        }
+    }
+
+    std::vector<bool> isEmitted(triangleCount, false);
+
+    // The index of each vertex in the current meshlet, or -1.
+    std::vector<int> localIndices(vertexCount, -1);
+
+    std::vector<Index> meshletVertices;
+    std::vector<Index> meshletTriangles;
+    meshletVertices.reserve(maxVertices);
+    meshletTriangles.reserve(maxTriangles);
+
+    const auto newVertexCount = [&](const size_t triangleIndex) {
+        int count = 0;
+        for (size_t corner = 0; corner < 3; ++corner) {
+            count += localIndices[indices[triangleIndex * 3 + corner]] < 0;
+        }
+        return count;
+    };
+
+    const auto finishMeshlet = [&]() {
+        if (meshletTriangles.empty())
+            return;
+
+        meshlets.descriptors.push_back(static_cast<uint32_t>(meshlets.vertices.size()));
+        meshlets.descriptors.push_back(static_cast<uint32_t>(meshletVertices.size()));
+        meshlets.descriptors.push_back(static_cast<uint32_t>(meshlets.triangles.size() / 3));
+        meshlets.descriptors.push_back(static_cast<uint32_t>(meshletTriangles.size()));
+
+        meshlets.vertices.insert(meshlets.vertices.end(), meshletVertices.begin(), meshletVertices.end());
+
+        for (auto triangleIndex : meshletTriangles) {
+            for (size_t corner = 0; corner < 3; ++corner) {
+                const auto localIndex = localIndices[indices[triangleIndex * 3 + corner]];
+                meshlets.triangles.push_back(static_cast<uint8_t>(localIndex));
+            }
+        }
+
+        addBounds(indices, positions, meshletVertices, meshletTriangles, meshlets);
+
+        for (auto vertexIndex : meshletVertices) {
+            localIndices[vertexIndex] = -1;
+        }
+
+        meshletVertices.clear();
+        meshletTriangles.clear();
+    };
+
+    size_t scanCursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        // The remaining triangle adjacent to the meshlet adding the fewest
+        // vertices, the next one in order otherwise.
+        int bestTriangle = -1;
+        int bestNewVertexCount = 4;
+
+        for (auto vertexIndex : meshletVertices) {
+            const auto begin = adjacencyOffsets[vertexIndex];
+            const auto end = begin + remainingCounts[vertexIndex];
+
+            for (auto i = begin; i < end && bestNewVertexCount > 0; ++i) {
+                const auto triangleIndex = adjacency[i];
+                const auto count = newVertexCount(triangleIndex);
+                if (count < bestNewVertexCount) {
+                    bestNewVertexCount = count;
+                    bestTriangle = triangleIndex;
+                }
+            }
+
+            if (bestNewVertexCount == 0)
+                break;
+        }
+
+        if (bestTriangle < 0) {
+            while (isEmitted[scanCursor]) {
+                ++scanCursor;
+            }
+
+            bestTriangle = static_cast<int>(scanCursor);
+            bestNewVertexCount = newVertexCount(bestTriangle);
+        }
+
+        if (meshletVertices.size() + bestNewVertexCount > maxVertices || meshletTriangles.size() >= maxTriangles) {
+            finishMeshlet();
+        }
+
+        isEmitted[bestTriangle] = true;
+        meshletTriangles.push_back(bestTriangle);
+
+        for (size_t corner = 0; corner < 3; ++corner) {
+            const auto vertexIndex = indices[bestTriangle * 3 + corner];
+
+            if (localIndices[vertexIndex] < 0) {
+                localIndices[vertexIndex] = static_cast<int>(meshletVertices.size());
+                meshletVertices.push_back(vertexIndex);
+            }
+
+            // Move the triangle out of the remaining ones of the vertex.
+            const auto begin = adjacencyOffsets[vertexIndex];
+            const auto end = begin + remainingCounts[vertexIndex];
+            const auto it = std::find(adjacency.begin() + begin, adjacency.begin() + end, bestTriangle);
+            if (it != adjacency.begin() + end) {
+                std::iter_swap(it, adjacency.begin() + end - 1);
+                --remainingCounts[vertexIndex];
+            }
+        }
+    }
+
+    finishMeshlet();
+}
+
+void MeshletPrimitive::getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const {
+    for (auto *accessor : {descriptorAccessor.get(), vertexAccessor.get(), triangleAccessor.get(), sphereAccessor.get(),
+                           coneAccessor.get()}) {
+        accessors.emplace_back(accessor);
+    }
+}
+
+Meshlets::Meshlets(const Arguments &args)
+    : m_maxVertices(args.meshletMaxVertices), m_maxTriangles(args.meshletMaxTriangles) {}
+
+Meshlets::~Meshlets() = default;
+
+MeshletPrimitive *Meshlets::add(const std::string &name, const GLTF::Accessor *indices, MeshletBuffer &&buffer) {
+    auto primitive = std::make_unique<MeshletPrimitive>();
+    primitive->indices = indices;
+    primitive->buffer = std::move(buffer);
+
+    const auto accessorName = [&](const char *path) { return name.empty() ? name : name + "/meshlets/" + path; };
+
+    // The meshlet data is not vertex data, so these use the generic target.
+    const auto genericTarget = static_cast<WebGL>(-1);
+
+    auto &data = primitive->buffer;
+
+    primitive->descriptorAccessor =
+        contiguousAccessor(accessorName("descriptors"), GLTF::Accessor::Type::VEC4, WebGL::UNSIGNED_INT, genericTarget,
+                           span(data.descriptors), 4);
+
+    if (indices->componentType == WebGL::UNSIGNED_SHORT) {
+        std::vector<uint16_t> shortVertices(data.vertices.begin(), data.vertices.end());
+        primitive->vertexAccessor = contiguousAccessor(accessorName("vertices"), GLTF::Accessor::Type::SCALAR,
+                                                       WebGL::UNSIGNED_SHORT, genericTarget, span(shortVertices), 1);
+    } else {
+        primitive->vertexAccessor = contiguousAccessor(accessorName("vertices"), GLTF::Accessor::Type::SCALAR,
+                                                       WebGL::UNSIGNED_INT, genericTarget, span(data.vertices), 1);
+    }
+
+    primitive->triangleAccessor = contiguousAccessor(accessorName("triangles"), GLTF::Accessor::Type::SCALAR,
+                                                     WebGL::UNSIGNED_BYTE, genericTarget, span(data.triangles), 1);
+
+    primitive->sphereAccessor =
+        contiguousChannelAccessor(accessorName("spheres"), reinterpret_span<float>(data.spheres), 4);
+    primitive->coneAccessor = contiguousChannelAccessor(accessorName("cones"), reinterpret_span<float>(data.cones), 4);
+
+    m_primitives.emplace_back(std::move(primitive));
+    return m_primitives.back().get();
+}
+
+void Meshlets::patchJSON(rapidjson::Document &document) const {
+    if (m_primitives.empty() || !document.HasMember("meshes"))
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    // Each primitive has its own indices accessor, so that identifies it.
+    std::map<int, const MeshletPrimitive *> primitivePerIndicesId;
+
+    for (auto &&primitive : m_primitives) {
+        if (primitive->indices && primitive->indices->id >= 0) {
+            primitivePerIndicesId[primitive->indices->id] = primitive.get();
+        }
+    }
+
+    if (primitivePerIndicesId.empty())
+        return;
+
+    for (auto &jsonMesh : document["meshes"].GetArray()) {
+        for (auto &jsonPrimitive : jsonMesh["primitives"].GetArray()) {
+            if (!jsonPrimitive.HasMember("indices"))
+                continue;
+
+            const auto it = primitivePerIndicesId.find(jsonPrimitive["indices"].GetInt());
+            if (it == primitivePerIndicesId.end())
+                continue;
+
+            const auto &primitive = *it->second;
+
+            rapidjson::Value jsonMeshlets(rapidjson::kObjectType);
+            jsonMeshlets.AddMember("maxVertices", m_maxVertices, allocator);
+            jsonMeshlets.AddMember("maxTriangles", m_maxTriangles, allocator);
+            jsonMeshlets.AddMember("meshlets", addAccessor(document, primitive.descriptorAccessor.get()), allocator);
+            jsonMeshlets.AddMember("vertices", addAccessor(document, primitive.vertexAccessor.get()), allocator);
+            jsonMeshlets.AddMember("triangles", addAccessor(document, primitive.triangleAccessor.get()), allocator);
+            jsonMeshlets.AddMember("spheres", addAccessor(document, primitive.sphereAccessor.get()), allocator);
+            jsonMeshlets.AddMember("cones", addAccessor(document, primitive.coneAccessor.get()), allocator);
+
+            if (!jsonPrimitive.HasMember("extensions")) {
+                jsonPrimitive.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+            }
+
+            jsonPrimitive["extensions"].AddMember("MAYA2GLTF_meshlets", jsonMeshlets, allocator);
+        }
+    }
+
+    // A renderer without mesh shaders can still draw the primitives.
+    addExtensionUsed(document, "MAYA2GLTF_meshlets", false);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+#include "sceneTypes.h"
+
+class Arguments;
+
+/** The meshlets of the triangles of a primitive, see -meshlets */
+struct MeshletBuffer {
+    // The vertex offset, vertex count, triangle offset and triangle count of
+    // each meshlet.
+    std::vector<uint32_t> descriptors;
+
+    // The primitive vertex indices used by the meshlets.
+    IndexVector vertices;
+
+    // Three indices in the vertices of its meshlet per triangle.
+    std::vector<uint8_t> triangles;
+
+    // The center and radius of the bounding sphere of each meshlet.
+    std::vector<Float4> spheres;
+
+    // The axis and cutoff of the normal cone of each meshlet.
+    std::vector<Float4> cones;
+
+    size_t meshletCount() const { return spheres.size(); }
+};
+
+/**
+ * Splits the triangles in meshlets with at most maxVertices vertices and
+ * maxTriangles triangles, keeping the triangle order where possible. A
+ * meshlet grows over the triangles adjacent to its vertices that add the
+ * fewest vertices, so the vertex cache order of -optimizeVertexCache gives
+ * compact meshlets.
+ *
+ * The normal cone culls a meshlet when
+ * dot(center - camera, axis) >= cutoff * length(center - camera) + radius;
+ * the cutoff is 1 when the triangles face too many directions to be culled.
+ * At most 256 vertices, as the triangles use 8-bit indices.
+ */
+void buildMeshlets(const IndexVector &indices, const gsl::span<const Position> &positions, size_t maxVertices,
+                   size_t maxTriangles, MeshletBuffer &meshlets);
+
+/** The meshlet accessors of a primitive */
+struct MeshletPrimitive {
+    // The indices of the primitive, which identify it in the JSON. Cleared
+    // when the primitive is destroyed before the JSON is written.
+    const GLTF::Accessor *indices = nullptr;
+
+    MeshletBuffer buffer;
+
+    std::unique_ptr<GLTF::Accessor> descriptorAccessor;
+    std::unique_ptr<GLTF::Accessor> vertexAccessor;
+    std::unique_ptr<GLTF::Accessor> triangleAccessor;
+    std::unique_ptr<GLTF::Accessor> sphereAccessor;
+    std::unique_ptr<GLTF::Accessor> coneAccessor;
+
+    void getAllAccessors(std::vector<GLTF::Accessor *> &accessors) const;
+};
+
+/**
+ * Keeps track of the meshlets of the primitives of the asset, see -meshlets.
+ * The COLLADA2GLTF object model doesn't know about the extension, so the
+ * meshlet accessors are packed with the accessors of their primitive, and
+ * the JSON is patched after it is written.
+ */
+class Meshlets {
+  public:
+    Meshlets(const Arguments &args);
+    ~Meshlets();
+
+    /** Creates the accessors of the meshlets of the primitive with the
+     * indices. The vertex indices of the meshlets use 16-bit indices when the
+     * primitive does. An empty name disables the accessor names. */
+    MeshletPrimitive *add(const std::string &name, const GLTF::Accessor *indices, MeshletBuffer &&buffer);
+
+    bool empty() const { return m_primitives.empty(); }
+
+    /** Adds the extension and the meshlet accessors to the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(Meshlets);
+
+    // The limits of the meshlets, written to the extension.
+    const int m_maxVertices;
+    const int m_maxTriangles;
+
+    std::vector<std::unique_ptr<MeshletPrimitive>> m_primitives;
+};
@@ -0,0 +1,255 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "MeshoptCompression.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+// Bit set in the stream kind for the indices of triangle lists.
+const int triangleStreamKind = 0x100;
+
+// The attribute codec handles at most this stride.
+const int maxMeshoptByteStride = 256;
+
+static const char *filterName(const MeshoptFilter filter) {
+    switch (filter) {
+    case MeshoptFilter::OCTAHEDRAL:
+        return "OCTAHEDRAL";
+    case MeshoptFilter::QUATERNION:
+        return "QUATERNION";
+    default:
+        return nullptr;
+    }
+}
+
+/** Applies the filter to the quantized elements in place, returns false if
+ * the elements don't have the layout the filter requires. */
+static bool applyFilter(const MeshoptFilter filter, byte *data, const size_t count, const int byteStride) {
+    // The filters take 4 float components per element.
+    std::vector<float> components(count * 4);
+
+    switch (filter) {
+    case MeshoptFilter::OCTAHEDRAL:
+        if (byteStride == 4) {
+            const auto *source = reinterpret_cast<const int8_t *>(data);
+            for (size_t i = 0; i < components.size(); ++i) {
+                components[i] = std::max(-1.0f, source[i] / 127.0f);
+            }
+            meshopt_encodeFilterOct(data, count, byteStride, 8, components.data());
+        } else if (byteStride == 8) {
+            const auto *source = reinterpret_cast<const int16_t *>(data);
+            for (size_t i = 0; i < components.size(); ++i) {
+                components[i] = std::max(-1.0f, source[i] / 32767.0f);
+            }
+            meshopt_encodeFilterOct(data, count, byteStride, 16, components.data());
+        } else {
+            return false;
+        }
+        break;
+
+    case MeshoptFilter::QUATERNION: {
+        if (byteStride != 8)
+            return false;
+
+        const auto *source = reinterpret_cast<const int16_t *>(data);
+        for (size_t i = 0; i < components.size(); ++i) {
+            components[i] = std::max(-1.0f, source[i] / 32767.0f);
+        }
+        meshopt_encodeFilterQuat(data, count, byteStride, 16, components.data());
+        break;
+    }
+
+    default:
+        return true;
+    }
+
+    return true;
+}
+
+MeshoptCompression::MeshoptCompression(const Arguments &args) : m_isFallbackWritten(args.meshoptFallback) {
+    // The extension only supports these bitstream versions.
+    meshopt_encodeVertexVersion(0);
+    meshopt_encodeIndexVersion(1);
+}
+
+MeshoptCompression::~MeshoptCompression() = default;
+
+int MeshoptCompression::streamKind(const GLTF::Accessor *accessor) const {
+    int kind = 0;
+
+    const auto it = m_filters.find(accessor);
+    if (it != m_filters.end()) {
+        kind |= static_cast<int>(it->second);
+    }
+
+    if (m_triangleIndices.count(accessor)) {
+        kind |= triangleStreamKind;
+    }
+
+    return kind;
+}
+
+MeshoptView *MeshoptCompression::compress(GLTF::BufferView *bufferView, const WebGL target, const int byteStride,
+                                          const int streamKind) {
+    const auto byteLength = bufferView->byteLength;
+    if (byteLength == 0 || byteStride <= 0 || byteLength % byteStride != 0)
+        return nullptr;
+
+    auto *data = bufferView->buffer->data + bufferView->byteOffset;
+
+    auto view = std::make_unique<MeshoptView>();
+    view->bufferView = bufferView;
+    view->byteStride = byteStride;
+    view->count = byteLength / byteStride;
+    view->fallbackByteLength = byteLength;
+
+    if (target == WebGL::ELEMENT_ARRAY_BUFFER) {
+        std::vector<unsigned int> indices(view->count);
+
+        if (byteStride == 2) {
+            const auto *source = reinterpret_cast<const uint16_t *>(data);
+            std::copy(source, source + view->count, indices.begin());
+        } else if (byteStride == 4) {
+            std::memcpy(indices.data(), data, byteLength);
+        } else {
+            return nullptr;
+        }
+
+        const auto vertexCount = size_t(*std::max_element(indices.begin(), indices.end())) + 1;
+
+        // The triangle codec can rotate the triangles, which is fine for
+        // triangle lists only.
+        const auto isTriangleList = (streamKind & triangleStreamKind) && view->count % 3 == 0;
+
+        if (isTriangleList) {
+            view->mode = "TRIANGLES";
+            view->data.resize(meshopt_encodeIndexBufferBound(indices.size(), vertexCount));
+            view->data.resize(
+                meshopt_encodeIndexBuffer(view->data.data(), view->data.size(), indices.data(), indices.size()));
+        } else {
+            view->mode = "INDICES";
+            view->data.resize(meshopt_encodeIndexSequenceBound(indices.size(), vertexCount));
+            view->data.resize(
+                meshopt_encodeIndexSequence(view->data.data(), view->data.size(), indices.data(), indices.size()));
+        }
+
+        if (isTriangleList) {
+            // Store the indices as the decoder returns them, so the fallback
+            // matches the compressed data.
+            meshopt_decodeIndexBuffer(data, view->count, byteStride, view->data.data(), view->data.size());
+        }
+    } else {
+        if (byteStride % 4 != 0 || byteStride > maxMeshoptByteStride)
+            return nullptr;
+
+        view->filter = static_cast<MeshoptFilter>(streamKind & ~triangleStreamKind);
+        view->mode = "ATTRIBUTES";
+
+        if (view->filter != MeshoptFilter::NONE) {
+            if (!applyFilter(view->filter, data, view->count, byteStride))
+                return nullptr;
+
+            // The filtered data is compressed, the fallback must hold what
+            // the decoder reconstructs from it.
+            view->data.resize(meshopt_encodeVertexBufferBound(view->count, byteStride));
+            view->data.resize(
+                meshopt_encodeVertexBuffer(view->data.data(), view->data.size(), data, view->count, byteStride));
+
+            if (view->filter == MeshoptFilter::OCTAHEDRAL) {
+                meshopt_decodeFilterOct(data, view->count, byteStride);
+            } else {
+                meshopt_decodeFilterQuat(data, view->count, byteStride);
+            }
+        } else {
+            view->data.resize(meshopt_encodeVertexBufferBound(view->count, byteStride));
+            view->data.resize(
+                meshopt_encodeVertexBuffer(view->data.data(), view->data.size(), data, view->count, byteStride));
+        }
+    }
+
+    // Without a gain, keep it uncompressed.
+    if (view->data.empty() || view->data.size() >= size_t(byteLength))
+        return nullptr;
+
+    m_views.emplace_back(std::move(view));
+    return m_views.back().get();
+}
+
+void MeshoptCompression::setPackedLocation(MeshoptView *view, GLTF::Buffer *buffer, const int byteOffset,
+                                           const int fallbackByteOffset) {
+    view->buffer = buffer;
+    view->byteOffset = byteOffset;
+    view->fallbackByteOffset = fallbackByteOffset;
+
+    if (!m_isFallbackWritten) {
+        auto &fallbackByteLength = m_fallbackByteLengths[buffer];
+        fallbackByteLength = std::max(fallbackByteLength, fallbackByteOffset + view->fallbackByteLength);
+    }
+}
+
+void MeshoptCompression::patchJSON(rapidjson::Document &document) const {
+    if (m_views.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    auto &jsonBuffers = document["buffers"];
+    auto &jsonBufferViews = document["bufferViews"];
+
+    // The fallback buffers are added in order of use, to keep the output
+    // deterministic.
+    std::map<const GLTF::Buffer *, int> fallbackBufferIds;
+
+    const auto fallbackBufferId = [&](const GLTF::Buffer *buffer) {
+        const auto it = fallbackBufferIds.find(buffer);
+        if (it != fallbackBufferIds.end())
+            return it->second;
+
+        rapidjson::Value jsonFallback(rapidjson::kObjectType);
+        jsonFallback.AddMember("fallback", true, allocator);
+
+        rapidjson::Value jsonExtensions(rapidjson::kObjectType);
+        jsonExtensions.AddMember("EXT_meshopt_compression", jsonFallback, allocator);
+
+        rapidjson::Value jsonBuffer(rapidjson::kObjectType);
+        jsonBuffer.AddMember("byteLength", m_fallbackByteLengths.at(buffer), allocator);
+        jsonBuffer.AddMember("extensions", jsonExtensions, allocator);
+
+        const auto id = static_cast<int>(jsonBuffers.Size());
+        jsonBuffers.PushBack(jsonBuffer, allocator);
+        fallbackBufferIds[buffer] = id;
+        return id;
+    };
+
+    for (auto &&view : m_views) {
+        auto &jsonView = jsonBufferViews[view->bufferView->id];
+
+        rapidjson::Value jsonMeshopt(rapidjson::kObjectType);
+        jsonMeshopt.AddMember("buffer", view->buffer->id, allocator);
+        jsonMeshopt.AddMember("byteOffset", view->byteOffset, allocator);
+        jsonMeshopt.AddMember("byteLength", static_cast<int>(view->data.size()), allocator);
+        jsonMeshopt.AddMember("byteStride", view->byteStride, allocator);
+        jsonMeshopt.AddMember("count", view->count, allocator);
+        jsonMeshopt.AddMember("mode", rapidjson::StringRef(view->mode), allocator);
+
+        if (const auto filter = filterName(view->filter)) {
+            jsonMeshopt.AddMember("filter", rapidjson::StringRef(filter), allocator);
+        }
+
+        if (!m_isFallbackWritten) {
+            // The buffer view was written with the compressed location.
+            setMember(jsonView, "buffer", fallbackBufferId(view->buffer), allocator);
+            setMember(jsonView, "byteOffset", view->fallbackByteOffset, allocator);
+            setMember(jsonView, "byteLength", view->fallbackByteLength, allocator);
+        }
+
+        if (!jsonView.HasMember("extensions")) {
+            jsonView.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        jsonView["extensions"].AddMember("EXT_meshopt_compression", jsonMeshopt, allocator);
+    }
+
+    addExtensionUsed(document, "EXT_meshopt_compression", !m_isFallbackWritten);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+
+class Arguments;
+
+/** The EXT_meshopt_compression filters, applied before compressing */
+enum class MeshoptFilter { NONE, OCTAHEDRAL, QUATERNION };
+
+/** A buffer view compressed using EXT_meshopt_compression */
+struct MeshoptView {
+    GLTF::BufferView *bufferView = nullptr;
+
+    const char *mode = nullptr;
+    MeshoptFilter filter = MeshoptFilter::NONE;
+    int byteStride = 0;
+    int count = 0;
+
+    std::vector<byte> data;
+
+    // Where the compressed data is packed.
+    GLTF::Buffer *buffer = nullptr;
+    int byteOffset = 0;
+
+    // The uncompressed data, in the fallback buffer when it is not written.
+    int fallbackByteOffset = 0;
+    int fallbackByteLength = 0;
+};
+
+/**
+ * Compresses the buffer views of the packed buffers using meshoptimizer.
+ *
+ * Vertex attributes and animation data use the attribute codec, indices of
+ * triangle lists the triangle codec, other indices the index sequence codec.
+ * Accessors can have a filter, which requires quantized data: quantized
+ * normals and tangents use the octahedral filter, normalized int16 rotations
+ * the quaternion filter. Accessors with different filters are packed into
+ * different buffer views.
+ *
+ * Unless the fallback is written, the uncompressed data is only described by
+ * a fallback buffer without data. The JSON is patched after it is written.
+ */
+class MeshoptCompression {
+  public:
+    MeshoptCompression(const Arguments &args);
+    ~MeshoptCompression();
+
+    void setFilter(const GLTF::Accessor *accessor, MeshoptFilter filter) {
+        m_filters[accessor] = filter;
+    }
+
+    void addTriangleIndices(const GLTF::Accessor *accessor) {
+        m_triangleIndices.insert(accessor);
+    }
+
+    /** Accessors with different stream kinds must not share a buffer view */
+    int streamKind(const GLTF::Accessor *accessor) const;
+
+    bool isFallbackWritten() const { return m_isFallbackWritten; }
+
+    /** Compresses the packed buffer view holding accessors of the stream kind.
+     * With a filter, the uncompressed data is replaced by the filtered data,
+     * so the fallback decodes the same. Returns null when the view can't be
+     * compressed, or doesn't get smaller. */
+    MeshoptView *compress(GLTF::BufferView *bufferView,
+                          GLTF::Constants::WebGL target, int byteStride,
+                          int streamKind);
+
+    /** Sets where the compressed data and the uncompressed data are packed */
+    void setPackedLocation(MeshoptView *view, GLTF::Buffer *buffer,
+                           int byteOffset, int fallbackByteOffset);
+
+    bool empty() const { return m_views.empty(); }
+
+    /** Adds the extension to the compressed buffer views, and the fallback
+     * buffers, to the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(MeshoptCompression);
+
+    const bool m_isFallbackWritten;
+
+    std::map<const GLTF::Accessor *, MeshoptFilter> m_filters;
+    std::set<const GLTF::Accessor *> m_triangleIndices;
+
+    std::vector<std::unique_ptr<MeshoptView>> m_views;
+
+    // The byte length of the fallback buffer of each packed buffer.
+    std::map<const GLTF::Buffer *, int> m_fallbackByteLengths;
+};
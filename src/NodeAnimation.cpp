@@ -1,17 +1,24 @@
 #include "externals.h"
 
+#include "CurveDrivenTransform.h"
+#include "ExportStatistics.h"
 #include "ExportableMesh.h"
 #include "ExportableNode.h"
+#include "ExportableResources.h"
+#include "KernelRecording.h"
 #include "NodeAnimation.h"
 #include "OutputStreamsPatch.h"
+#include "Profiler.h"
 #include "Transform.h"
+#include "dump.h"
+#include "kernels.h"
 
 NodeAnimation::NodeAnimation(const ExportableNode &node, const ExportableFrames &frames, const double scaleFactor, const Arguments &arguments)
     : node(node), mesh(node.mesh()), m_scaleFactor(scaleFactor), m_blendShapeCount(mesh ? mesh->blendShapeCount() : 0), m_arguments(arguments) {
     auto &sNode = node.glSecondaryNode();
     auto &pNode = node.glPrimaryNode();
 
-    m_invalidLocalTransformTimes.reserve(10);
+    m_invalidLocalTransformTimes.reserve(arguments.maxDiagnosticItems);
 
     const size_t detectStepSampleCount = m_arguments.getStepDetectSampleCount();
 
@@ -55,16 +62,163 @@ NodeAnimation::NodeAnimation(const ExportableNode &node, const ExportableFrames
     if (m_blendShapeCount > 0) {
         m_weights = std::make_unique<PropAnimation>(frames, pNode, GLTF::Animation::Path::WEIGHTS, m_blendShapeCount, detectStepSampleCount, true);
     }
+
+    // The channels that are exported, in the order they are added to the glTF animation.
+    auto &pTRS = node.initialTransformState.primaryTRS();
+    auto &sTRS = node.initialTransformState.secondaryTRS();
+
+    switch (node.transformKind) {
+    case TransformKind::Simple:
+        addChannel("T", m_positions, m_arguments.constantTranslationThreshold, pTRS.translation);
+        addChannel("R", m_rotations, m_arguments.constantRotationThreshold, pTRS.rotation);
+        addChannel("S", m_scales, m_arguments.constantScalingThreshold, pTRS.scale);
+        break;
+    case TransformKind::ComplexJoint:
+        addChannel("T", m_positions, m_arguments.constantTranslationThreshold, sTRS.translation);
+        addChannel("R", m_rotations, m_arguments.constantRotationThreshold, pTRS.rotation);
+        addChannel("S", m_scales, m_arguments.constantScalingThreshold, pTRS.scale);
+
+        addChannel("C", m_correctors, m_arguments.constantScalingThreshold, sTRS.scale);
+
+        if (m_arguments.forceAnimationChannels) {
+            addChannel("DT", m_dummyProps1, 0, pTRS.translation);
+            addChannel("DR", m_dummyProps2, 0, sTRS.rotation);
+        }
+        break;
+
+    case TransformKind::ComplexTransform:
+        addChannel("T", m_positions, m_arguments.constantTranslationThreshold, sTRS.translation);
+        addChannel("R", m_rotations, m_arguments.constantRotationThreshold, sTRS.rotation);
+        addChannel("S", m_scales, m_arguments.constantScalingThreshold, sTRS.scale);
+
+        addChannel("C", m_correctors, m_arguments.constantScalingThreshold, pTRS.translation);
+
+        if (m_arguments.forceAnimationChannels) {
+            addChannel("DS", m_dummyProps1, 0, pTRS.scale);
+            addChannel("DR", m_dummyProps2, 0, pTRS.rotation);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (m_blendShapeCount) {
+        const auto initialWeights = mesh->initialWeights();
+        assert(initialWeights.size() == m_blendShapeCount);
+        addChannel("W", m_weights, m_arguments.constantWeightsThreshold, initialWeights);
+    }
+}
+
+void NodeAnimation::addChannel(const char *propName, std::unique_ptr<PropAnimation> &animatedProp, const double constantThreshold,
+                               const gsl::span<const float> &baseValues) {
+    m_channels.push_back({propName, &animatedProp, constantThreshold, baseValues, false, {}});
+}
+
+bool NodeAnimation::exportCurves(const MTime &startTime, const MTime &endTime) {
+    if (m_blendShapeCount > 0)
+        return false;
+
+    const auto transform = CurveDrivenTransform::tryCreate(node);
+    if (!transform)
+        return false;
+
+    // A simple transform only has these props.
+    const std::pair<CurveDrivenTransform::Path, PropAnimation *> props[] = {{CurveDrivenTransform::TRANSLATION, m_positions.get()},
+                                                                           {CurveDrivenTransform::ROTATION, m_rotations.get()},
+                                                                           {CurveDrivenTransform::SCALE, m_scales.get()}};
+
+    GLTF::Node::TransformTRS trs;
+
+    for (auto &&pair : props) {
+        auto &prop = *pair.second;
+        const auto keys = transform->keys(pair.first, startTime, endTime);
+
+        prop.keyInterpolation = keys.interpolation;
+        prop.keyTimes.reserve(keys.times.size());
+
+        for (auto &&time : keys.times) {
+            transform->getTransform(time, m_scaleFactor, trs);
+
+            prop.keyTimes.emplace_back(static_cast<float>((time - startTime).as(MTime::kSeconds)));
+
+            switch (pair.first) {
+            case CurveDrivenTransform::TRANSLATION:
+                prop.append(gsl::make_span(trs.translation), 0);
+                break;
+            case CurveDrivenTransform::ROTATION:
+                prop.appendQuaternion(gsl::make_span(trs.rotation), 0);
+                break;
+            default:
+                prop.append(gsl::make_span(trs.scale), 0);
+                break;
+            }
+        }
+    }
+
+    m_isCurveDriven = true;
+    return true;
+}
+
+void NodeAnimation::writeSamples(std::ostream &stream) const {
+    const auto invalidTimeCount = static_cast<uint32_t>(m_invalidLocalTransformTimes.size());
+    stream.write(reinterpret_cast<const char *>(&m_maxNonOrthogonality), sizeof(m_maxNonOrthogonality));
+    stream.write(reinterpret_cast<const char *>(&invalidTimeCount), sizeof(invalidTimeCount));
+
+    for (auto &&time : m_invalidLocalTransformTimes) {
+        const auto value = time.value();
+        const auto unit = static_cast<int32_t>(time.unit());
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+        stream.write(reinterpret_cast<const char *>(&unit), sizeof(unit));
+    }
+
+    for (auto &&channel : m_channels) {
+        (*channel.animatedProp)->writeSamples(stream);
+    }
+}
+
+bool NodeAnimation::readSamples(std::istream &stream) {
+    uint32_t invalidTimeCount = 0;
+    if (!stream.read(reinterpret_cast<char *>(&m_maxNonOrthogonality), sizeof(m_maxNonOrthogonality)) ||
+        !stream.read(reinterpret_cast<char *>(&invalidTimeCount), sizeof(invalidTimeCount)) ||
+        invalidTimeCount > static_cast<uint32_t>(m_arguments.maxDiagnosticItems))
+        return false;
+
+    for (uint32_t i = 0; i < invalidTimeCount; ++i) {
+        double value = 0;
+        int32_t unit = 0;
+        if (!stream.read(reinterpret_cast<char *>(&value), sizeof(value)) || !stream.read(reinterpret_cast<char *>(&unit), sizeof(unit)))
+            return false;
+
+        m_invalidLocalTransformTimes.emplace_back(value, static_cast<MTime::Unit>(unit));
+    }
+
+    return std::all_of(m_channels.begin(), m_channels.end(), [&](const Channel &channel) { return (*channel.animatedProp)->readSamples(stream); });
+}
+
+void NodeAnimation::clearSamples() {
+    m_maxNonOrthogonality = 0;
+    m_invalidLocalTransformTimes.clear();
+
+    for (auto &&channel : m_channels) {
+        (*channel.animatedProp)->clearSamples();
+    }
 }
 
 void NodeAnimation::sampleAt(const MTime &absoluteTime, const int frameIndex, const int superSampleIndex, NodeTransformCache &transformCache) {
+    if (m_isCurveDriven)
+        return;
+
     auto &transformState = transformCache.getTransform(&node, m_scaleFactor);
     auto &pTRS = transformState.primaryTRS();
     auto &sTRS = transformState.secondaryTRS();
 
-    if (transformState.maxNonOrthogonality > MAX_NON_ORTHOGONALITY && m_invalidLocalTransformTimes.size() < m_invalidLocalTransformTimes.capacity()) {
+    if (transformState.maxNonOrthogonality > MAX_NON_ORTHOGONALITY) {
         m_maxNonOrthogonality = std::max(m_maxNonOrthogonality, transformState.maxNonOrthogonality);
-        m_invalidLocalTransformTimes.emplace_back(absoluteTime);
+
+        if (m_invalidLocalTransformTimes.size() < static_cast<size_t>(m_arguments.maxDiagnosticItems)) {
+            m_invalidLocalTransformTimes.emplace_back(absoluteTime);
+        }
     }
 
     switch (node.transformKind) {
@@ -105,13 +259,13 @@ void NodeAnimation::sampleAt(const MTime &absoluteTime, const int frameIndex, co
     }
 
     if (m_blendShapeCount) {
-        auto weights = mesh->currentWeights();
-        assert(weights.size() == m_blendShapeCount);
-        m_weights->append(span(weights), superSampleIndex);
+        mesh->currentWeights(m_currentWeights);
+        assert(m_currentWeights.size() == m_blendShapeCount);
+        m_weights->append(span(m_currentWeights), superSampleIndex);
     }
 }
 
-void NodeAnimation::exportTo(GLTF::Animation &glAnimation) {
+void NodeAnimation::exportTo(GLTF::Animation &glAnimation, ExportableResources &resources) {
 
     if (!m_invalidLocalTransformTimes.empty()) {
         // TODO: Use SVG to decompose the 3x3 matrix into a product of rotation
@@ -128,103 +282,146 @@ void NodeAnimation::exportTo(GLTF::Animation &glAnimation) {
         cerr << endl;
     }
 
-    // Now create the glTF animations, but only for those props that animate
-    auto &pTRS = node.initialTransformState.primaryTRS();
-    auto &sTRS = node.initialTransformState.secondaryTRS();
+    for (auto &&channel : m_channels) {
+        for (auto &&message : channel.messages) {
+            std::cout << prefix << message << std::endl;
+        }
 
-    switch (node.transformKind) {
-    case TransformKind::Simple:
-        finish(glAnimation, "T", m_positions, m_arguments.constantTranslationThreshold, pTRS.translation);
-        finish(glAnimation, "R", m_rotations, m_arguments.constantRotationThreshold, pTRS.rotation);
-        finish(glAnimation, "S", m_scales, m_arguments.constantScalingThreshold, pTRS.scale);
-        break;
-    case TransformKind::ComplexJoint:
-        finish(glAnimation, "T", m_positions, m_arguments.constantTranslationThreshold, sTRS.translation);
-        finish(glAnimation, "R", m_rotations, m_arguments.constantRotationThreshold, pTRS.rotation);
-        finish(glAnimation, "S", m_scales, m_arguments.constantScalingThreshold, pTRS.scale);
+        if (!channel.isExported)
+            continue;
 
-        finish(glAnimation, "C", m_correctors, m_arguments.constantScalingThreshold, sTRS.scale);
+        auto &animatedProp = *channel.animatedProp;
 
-        if (m_arguments.forceAnimationChannels) {
-            finish(glAnimation, "DT", m_dummyProps1, 0, pTRS.translation);
-            finish(glAnimation, "DR", m_dummyProps2, 0, sTRS.rotation);
-        }
-        break;
+        if (animatedProp->isQuantized()) {
+            auto *outputs = animatedProp->glSampler.output;
+            // Normalized animation outputs are core glTF, like skin weights.
+            resources.quantizedAccessors().addNormalized(outputs, false);
 
-    case TransformKind::ComplexTransform:
-        finish(glAnimation, "T", m_positions, m_arguments.constantTranslationThreshold, sTRS.translation);
-        finish(glAnimation, "R", m_rotations, m_arguments.constantRotationThreshold, sTRS.rotation);
-        finish(glAnimation, "S", m_scales, m_arguments.constantScalingThreshold, sTRS.scale);
+            // The quaternion filter needs normalized int16 rotations.
+            if (m_arguments.meshoptCompression && animatedProp->glTarget.path == GLTF::Animation::Path::ROTATION) {
+                resources.meshoptCompression().setFilter(outputs, MeshoptFilter::QUATERNION);
+            }
+        }
 
-        finish(glAnimation, "C", m_correctors, m_arguments.constantScalingThreshold, pTRS.translation);
+        glAnimation.channels.push_back(&animatedProp->glChannel);
+    }
+}
 
-        if (m_arguments.forceAnimationChannels) {
-            finish(glAnimation, "DS", m_dummyProps1, 0, pTRS.scale);
-            finish(glAnimation, "DR", m_dummyProps2, 0, pTRS.rotation);
+void NodeAnimation::getAllAccessors(std::vector<GLTF::Accessor *> &outputs, std::vector<GLTF::Accessor *> &inputs) const {
+    for (auto &&channel : m_channels) {
+        if (channel.isExported) {
+            auto &glSampler = (*channel.animatedProp)->glSampler;
+            outputs.emplace_back(glSampler.output);
+            inputs.emplace_back(glSampler.input);
         }
-        break;
+    }
+}
 
+static const char *glPathName(const GLTF::Animation::Path path) {
+    switch (path) {
+    case GLTF::Animation::Path::TRANSLATION:
+        return "translation";
+    case GLTF::Animation::Path::ROTATION:
+        return "rotation";
+    case GLTF::Animation::Path::SCALE:
+        return "scale";
+    case GLTF::Animation::Path::WEIGHTS:
+        return "weights";
     default:
-        assert(false);
-        break;
+        return "unknown";
     }
+}
 
-    if (m_blendShapeCount) {
-        const auto initialWeights = mesh->initialWeights();
-        assert(initialWeights.size() == m_blendShapeCount);
-        finish(glAnimation, "W", m_weights, m_arguments.constantWeightsThreshold, initialWeights);
+void NodeAnimation::addStatistics(ClipStatistics &statistics) const {
+    for (auto &&channel : m_channels) {
+        if (!channel.isExported) {
+            ++statistics.droppedChannelCount;
+            continue;
+        }
+
+        ++statistics.keptChannelCount;
+        ++statistics.channelsPerInterpolation[channel.interpolation];
+
+        auto &glSampler = (*channel.animatedProp)->glSampler;
+        statistics.bytesPerPath[glPathName(channel.path)] += glAccessorByteLength(glSampler.output);
     }
 }
 
-void NodeAnimation::finish(GLTF::Animation &glAnimation, const char *propName, std::unique_ptr<PropAnimation> &animatedProp,
-    double constantThreshold, const gsl::span<const float> &baseValues) const {
+void NodeAnimation::finishChannel(const size_t channelIndex, const std::string &animationName) {
+    ProfileScope profileScope("Animation channel finishing");
+
+    auto &channel = m_channels.at(channelIndex);
+    auto &animatedProp = *channel.animatedProp;
+    const auto propName = channel.propName;
+    const auto constantThreshold = channel.constantThreshold;
+    const auto &baseValues = channel.baseValues;
+
     const auto dimension = animatedProp->dimension;
 
+    channel.path = animatedProp->glTarget.path;
+
     if (dimension) {
         assert(dimension == baseValues.size());
 
         const size_t detectStepSampleCount = m_arguments.getStepDetectSampleCount();
 
-        auto &componentValues = animatedProp->componentValuesPerFrameTable.at(0);
+        auto &componentValues = animatedProp->componentValuesPerFrame;
 
-        // Check if all samples are constant. In that case, we drop the animation, unless it is forced
-        bool isConstant = true;
-        for (size_t offset = 0; offset < componentValues.size() && isConstant; offset += dimension) {
-            for (size_t axis = 0; axis < dimension && isConstant; ++axis) {
-                isConstant = std::abs(baseValues[axis] - componentValues[offset + axis]) < constantThreshold;
-            }
+        if (KernelRecording::isRecording()) {
+            std::vector<float> recording{static_cast<float>(constantThreshold)};
+            recording.insert(recording.end(), baseValues.begin(), baseValues.end());
+            recording.insert(recording.end(), componentValues.begin(), componentValues.end());
+
+            const auto kind = channel.path == GLTF::Animation::Path::ROTATION ? kernels::RecordKind::QUATERNION_SAMPLES
+                                                                               : kernels::RecordKind::CHANNEL_SAMPLES;
+            KernelRecording::record(kind, static_cast<uint32_t>(dimension), recording.data(), recording.size() * sizeof(float));
         }
 
+        // Check if all samples are constant. In that case, we drop the animation, unless it is forced
+        const bool isConstant =
+            kernels::isConstantChannel(componentValues.data(), componentValues.size(), baseValues.data(), dimension, constantThreshold);
+
         if (isConstant && !m_arguments.forceAnimationSampling && !m_arguments.forceAnimationChannels) {
             // All animation frames are the same as the scene, to need to animate the prop.
-            animatedProp.release();
+            animatedProp.reset();
         } else {
             const auto useSingleKey = isConstant && !m_arguments.forceAnimationSampling;
             auto interpolation = "LINEAR";
 
-            if (!useSingleKey && detectStepSampleCount > 1) {
-                // Check if STEP animation can be used for this channel.
-                // TODO: Split into multiple parts!
-                auto canUseStep = true;
-                for (size_t offset = 0; offset < componentValues.size() && canUseStep; offset += dimension) {
-                    const auto* startValues = &componentValues[offset];
-                    for (size_t superSample = 1; superSample < detectStepSampleCount; ++superSample) {
-                        auto &stepComponentValues = animatedProp->componentValuesPerFrameTable.at(superSample);
-                        for (size_t axis = 0; axis < dimension; ++axis) {
-                            canUseStep = std::abs(startValues[axis] - stepComponentValues[offset + axis]) < constantThreshold;
-                        }
-                    }
-                }
+            if (animatedProp->keyInterpolation) {
+                // The interpolation of the exported curves is exact.
+                interpolation = animatedProp->keyInterpolation;
+            } else if (!useSingleKey && detectStepSampleCount > 1) {
+                // Check if STEP animation can be used for this channel, or for some of its frames.
+                const auto stepFrames = animatedProp->stepFrames(constantThreshold);
+                const auto stepFrameCount = std::count(stepFrames.begin(), stepFrames.end(), true);
 
-                if (canUseStep) {
-                    std::cout << prefix << "Using STEP interpolation for channel " << node.name() << "/" << propName << std::endl;
+                if (stepFrameCount == static_cast<std::ptrdiff_t>(stepFrames.size())) {
+                    channel.messages.emplace_back("Using STEP interpolation for channel " + node.name() + "/" + propName);
                     interpolation = "STEP";
+                } else if (stepFrameCount > 0) {
+                    channel.messages.emplace_back(formatted("Using STEP interpolation for %d of %d frames of channel ", int(stepFrameCount),
+                                                            int(stepFrames.size())) +
+                                                  node.name() + "/" + propName);
+                    animatedProp->holdStepFrames(stepFrames, constantThreshold);
                 }
             }
 
-            // TODO: Apply a curve simplifier.
-            animatedProp->finish(m_arguments.disableNameAssignment ? "" : node.name() + "/anim/" + glAnimation.name + "/" + propName, useSingleKey, interpolation);
-            glAnimation.channels.push_back(&animatedProp->glChannel);
+            // Only LINEAR channels with a key per frame are fitted, a STEP channel doesn't change in between keys.
+            const auto hasUniformKeys = !animatedProp->keyInterpolation;
+
+            if (m_arguments.cubicSplineFitting && hasUniformKeys && !useSingleKey && strcmp(interpolation, "LINEAR") == 0) {
+                interpolation = "CUBICSPLINE";
+            }
+
+            const auto reductionTolerance = hasUniformKeys && (m_arguments.keyframeReduction || m_arguments.cubicSplineFitting) ? constantThreshold : 0;
+            const auto quantizationTolerance = m_arguments.quantizeAnimation ? constantThreshold : -1;
+            const auto resamplingTolerance = hasUniformKeys ? constantThreshold : 0;
+            animatedProp->finish(m_arguments.disableNameAssignment ? "" : node.name() + "/anim/" + animationName + "/" + propName, useSingleKey, interpolation,
+                                 reductionTolerance, quantizationTolerance, resamplingTolerance, m_arguments.adaptiveSampleRate);
+
+            channel.isExported = true;
+            channel.interpolation = interpolation;
         }
     }
 }
@@ -7,6 +7,8 @@
 class ExportableNode;
 class ExportableMesh;
 class NodeTransformCache;
+class ExportableResources;
+struct ClipStatistics;
 
 class NodeAnimation {
   public:
@@ -20,7 +22,35 @@ class NodeAnimation {
     // Samples values at the current time
     void sampleAt(const MTime &absoluteTime, int relativeFrameIndex, int superSampleIndex, NodeTransformCache &transformCache);
 
-    void exportTo(GLTF::Animation &glAnimation);
+    /** Exports the keys of the anim curves driving the node between the start and end time,
+     * instead of sampling it. Returns false when the node must be sampled, see CurveDrivenTransform. */
+    bool exportCurves(const MTime &startTime, const MTime &endTime);
+
+    bool needsSampling() const { return !m_isCurveDriven; }
+
+    /** Writes the samples of all channels, see SampleCache */
+    void writeSamples(std::ostream &stream) const;
+
+    /** Reads the samples written by writeSamples, returns false when these don't match the node */
+    bool readSamples(std::istream &stream);
+
+    /** Drops the samples, after readSamples failed */
+    void clearSamples();
+
+    size_t channelCount() const { return m_channels.size(); }
+
+    /** Drops the channel if it is constant, detects step interpolation, and creates its accessors.
+     * Doesn't call into Maya, so different channels, also of different nodes, can be finished in parallel. */
+    void finishChannel(size_t channelIndex, const std::string &animationName);
+
+    /** Adds the finished channels to the glTF animation, always in the same order */
+    void exportTo(GLTF::Animation &glAnimation, ExportableResources &resources);
+
+    /** Adds the kept and dropped channels, and the bytes of the output accessors, after finishing */
+    void addStatistics(ClipStatistics &statistics) const;
+
+    /** Gets the output and input accessors of the exported channels. Inputs can be shared by other nodes. */
+    void getAllAccessors(std::vector<GLTF::Accessor *> &outputs, std::vector<GLTF::Accessor *> &inputs) const;
 
     const ExportableNode &node;
     const ExportableMesh *mesh;
@@ -31,6 +61,7 @@ class NodeAnimation {
     const Arguments &m_arguments;
 
     double m_maxNonOrthogonality = 0;
+    bool m_isCurveDriven = false;
     std::vector<MTime> m_invalidLocalTransformTimes;
 
     std::unique_ptr<PropAnimation> m_positions;
@@ -46,13 +77,28 @@ class NodeAnimation {
 
     std::unique_ptr<PropAnimation> m_weights;
 
-    void finish(GLTF::Animation &glAnimation, const char *propName, std::unique_ptr<PropAnimation> &animatedProp, double constantThreshold, const gsl::span<const float> &baseValues) const;
+    // Reused for all samples, to avoid allocations in the sampling loop.
+    std::vector<float> m_currentWeights;
+
+    struct Channel {
+        const char *propName;
+        std::unique_ptr<PropAnimation> *animatedProp;
+        double constantThreshold;
+        gsl::span<const float> baseValues;
+        bool isExported;
+
+        // The messages of finishChannel, printed by exportTo, so the output doesn't depend on the thread timing.
+        std::vector<std::string> messages;
+
+        // Set by finishChannel, the interpolation is null when the channel is dropped.
+        GLTF::Animation::Path path = GLTF::Animation::Path::TRANSLATION;
+        const char *interpolation = nullptr;
+    };
+
+    std::vector<Channel> m_channels;
 
-    template <int N>
-    void finish(GLTF::Animation &glAnimation, const char *propName, std::unique_ptr<PropAnimation> &animatedProp, 
-        double constantThreshold, int detectStepSampleCount, const float (&baseValues)[N]) {
-        finish(glAnimation, propName, animatedProp, constantThreshold, detectStepSampleCount, gsl::make_span(&baseValues[0], N));
-    }
+    void addChannel(const char *propName, std::unique_ptr<PropAnimation> &animatedProp, double constantThreshold,
+                    const gsl::span<const float> &baseValues);
 
     DISALLOW_COPY_MOVE_ASSIGN(NodeAnimation);
 };
@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * Maps Maya nodes to values, by their MObjectHandle, so finding the value of
+ * a node doesn't query the dependency graph. The hash code of the handle only
+ * narrows the search, the handles are compared to the node.
+ */
+template <typename T> class NodeHandleMap {
+  public:
+    T *find(const MObject &node) {
+        const auto range = m_entries.equal_range(MObjectHandle(node).hashCode());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.first == node)
+                return &it->second.second;
+        }
+        return nullptr;
+    }
+
+    /** The value of the node, default constructed when it was not found */
+    T &operator[](const MObject &node) {
+        if (auto *value = find(node))
+            return *value;
+
+        const MObjectHandle handle(node);
+        return m_entries.emplace(handle.hashCode(), std::make_pair(handle, T()))->second.second;
+    }
+
+  private:
+    std::unordered_multimap<unsigned, std::pair<MObjectHandle, T>> m_entries;
+};
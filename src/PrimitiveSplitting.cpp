@@ -0,0 +1,154 @@
+#include "externals.h"
+
+#include "PrimitiveSplitting.h"
+
+void copyCorners(const VertexBuffer &source, const IndexVector &corners, VertexBuffer &target) {
+    std::vector<Index> targetIndices(source.maxIndex(), -1);
+    std::vector<Index> sourceIndices;
+
+    target.indices.reserve(corners.size());
+
+    for (auto sourceIndex : corners) {
+        auto &targetIndex = targetIndices[sourceIndex];
+        if (targetIndex < 0) {
+            targetIndex = static_cast<Index>(sourceIndices.size());
+            sourceIndices.push_back(sourceIndex);
+        }
+        target.indices.push_back(targetIndex);
+    }
+
+    target.weldTable.restoreSize(sourceIndices.size());
+
+    for (auto &&pair : source.componentsMap) {
+        const auto &sourceElements = pair.second;
+        const auto elementByteSize = sourceElements.size() / source.maxIndex();
+
+        auto &targetElements = target.componentsMap[pair.first];
+        targetElements.resize(sourceIndices.size() * elementByteSize);
+
+        for (size_t i = 0; i < sourceIndices.size(); ++i) {
+            memcpy(&targetElements[i * elementByteSize], &sourceElements[sourceIndices[i] * elementByteSize],
+                   elementByteSize);
+        }
+    }
+}
+
+void copyTriangles(const VertexBuffer &source, const std::vector<Index> &triangles, VertexBuffer &target) {
+    IndexVector corners;
+    corners.reserve(triangles.size() * 3);
+
+    for (auto triangle : triangles) {
+        for (int corner = 0; corner < 3; ++corner) {
+            corners.push_back(source.indices[triangle * 3 + corner]);
+        }
+    }
+
+    copyCorners(source, corners, target);
+}
+
+void splitVertexBuffer(const VertexBuffer &vertexBuffer, const size_t maxVertexCount, std::vector<VertexBuffer> &parts) {
+    const auto &indices = vertexBuffer.indices;
+    const auto vertexCount = vertexBuffer.maxIndex();
+    const auto triangleCount = static_cast<Index>(indices.size() / 3);
+
+    // The triangles of each vertex, as offsets into a flat vector.
+    std::vector<size_t> vertexTriangleOffsets(vertexCount + 1, 0);
+    for (auto index : indices) {
+        ++vertexTriangleOffsets[index + 1];
+    }
+
+    std::partial_sum(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end(), vertexTriangleOffsets.begin());
+
+    std::vector<Index> vertexTriangles(indices.size());
+    {
+        auto offsets = vertexTriangleOffsets;
+        for (size_t corner = 0; corner < indices.size(); ++corner) {
+            vertexTriangles[offsets[indices[corner]]++] = static_cast<Index>(corner / 3);
+        }
+    }
+
+    // The part of each triangle, and the last part that used each vertex.
+    std::vector<int> triangleParts(triangleCount, -1);
+    std::vector<int> vertexParts(vertexCount, -1);
+
+    std::vector<Index> partTriangles;
+    std::deque<Index> pendingTriangles;
+
+    Index seedTriangle = 0;
+    int partIndex = 0;
+
+    while (seedTriangle < triangleCount) {
+        size_t partVertexCount = 0;
+        partTriangles.clear();
+
+        const auto queue = [&](const Index triangle) {
+            if (triangleParts[triangle] == -1) {
+                // Queued, not assigned yet.
+                triangleParts[triangle] = -2;
+                pendingTriangles.push_back(triangle);
+            }
+        };
+
+        bool isFull = false;
+
+        while (!isFull && seedTriangle < triangleCount) {
+            while (seedTriangle < triangleCount && triangleParts[seedTriangle] != -1) {
+                ++seedTriangle;
+            }
+
+            if (seedTriangle < triangleCount) {
+                queue(seedTriangle);
+            }
+
+            while (!pendingTriangles.empty()) {
+                const auto triangle = pendingTriangles.front();
+
+                int newVertexCount = 0;
+                for (int corner = 0; corner < 3; ++corner) {
+                    newVertexCount += vertexParts[indices[triangle * 3 + corner]] != partIndex;
+                }
+
+                if (partVertexCount + newVertexCount > maxVertexCount) {
+                    isFull = true;
+                    break;
+                }
+
+                pendingTriangles.pop_front();
+                triangleParts[triangle] = partIndex;
+                partTriangles.push_back(triangle);
+
+                for (int corner = 0; corner < 3; ++corner) {
+                    const auto vertexIndex = indices[triangle * 3 + corner];
+                    if (vertexParts[vertexIndex] != partIndex) {
+                        vertexParts[vertexIndex] = partIndex;
+                        ++partVertexCount;
+
+                        for (auto offset = vertexTriangleOffsets[vertexIndex];
+                             offset < vertexTriangleOffsets[vertexIndex + 1]; ++offset) {
+                            queue(vertexTriangles[offset]);
+                        }
+                    }
+                }
+            }
+        }
+
+        // The triangles that didn't fit are seeds of the next parts.
+        for (auto triangle : pendingTriangles) {
+            triangleParts[triangle] = -1;
+            seedTriangle = std::min(seedTriangle, triangle);
+        }
+
+        pendingTriangles.clear();
+
+        if (partTriangles.empty())
+            break;
+
+        // Each part keeps the triangle order of the vertex buffer.
+        std::sort(partTriangles.begin(), partTriangles.end());
+
+        parts.emplace_back();
+        copyTriangles(vertexBuffer, partTriangles, parts.back());
+
+        ++partIndex;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "sceneTypes.h"
+
+/**
+ * Copies the vertices of the source vertex buffer used by the corners to the
+ * target, in order of first use, with the corners as its indices. All vertex
+ * slots are copied, including the morph targets and the skin attributes.
+ */
+void copyCorners(const VertexBuffer &source, const IndexVector &corners, VertexBuffer &target);
+
+/**
+ * Copies the given triangles of the source vertex buffer to the target, with
+ * their own copy of the vertices they use, in order of first use. All vertex
+ * slots are copied, including the morph targets and the skin attributes.
+ */
+void copyTriangles(const VertexBuffer &source, const std::vector<Index> &triangles, VertexBuffer &target);
+
+/**
+ * Splits the triangles of the vertex buffer in parts of at most
+ * maxVertexCount vertices, see -splitLargePrimitives. Each part grows from a
+ * seed triangle over the triangles that share its vertices, so the parts are
+ * compact patches, and few vertices are duplicated on their borders.
+ * The seeds are taken in triangle order. Doesn't call Maya.
+ */
+void splitVertexBuffer(const VertexBuffer &vertexBuffer, size_t maxVertexCount, std::vector<VertexBuffer> &parts);
@@ -0,0 +1,194 @@
+#include "externals.h"
+
+#include "HeldMemory.h"
+#include "MayaException.h"
+#include "Profiler.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+std::atomic<bool> Profiler::s_isRecording{false};
+
+struct ProfileEvent {
+    const char *phase;
+    Profiler::Clock::time_point begin;
+    Profiler::Clock::time_point end;
+    size_t byteCount;
+    size_t threadIndex;
+
+    // The bytes held per kind at the end of the phase.
+    std::array<size_t, static_cast<size_t>(MemoryKind::COUNT)> heldBytes;
+};
+
+static std::mutex eventsMutex;
+static std::vector<ProfileEvent> events;
+static std::map<std::thread::id, size_t> threadIndices;
+static Profiler::Clock::time_point startTime;
+
+// The peak resident memory of the process, including Maya, 0 when unknown.
+static size_t peakResidentBytes() {
+#ifdef _MSC_VER
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void Profiler::start() {
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    events.clear();
+    threadIndices.clear();
+    threadIndices.emplace(std::this_thread::get_id(), 0);
+    HeldMemory::resetPeaks();
+    startTime = Clock::now();
+    s_isRecording = true;
+}
+
+void Profiler::record(const char *phase, const Clock::time_point begin, const Clock::time_point end,
+                      const size_t byteCount) {
+    std::lock_guard<std::mutex> lock(eventsMutex);
+
+    // The main thread started recording, and has index 0.
+    const auto threadIndex = threadIndices.emplace(std::this_thread::get_id(), threadIndices.size()).first->second;
+
+    ProfileEvent event{phase, begin, end, byteCount, threadIndex, {}};
+    for (size_t kind = 0; kind < event.heldBytes.size(); ++kind) {
+        event.heldBytes[kind] = HeldMemory::currentBytes(static_cast<MemoryKind>(kind));
+    }
+
+    events.push_back(event);
+}
+
+void Profiler::stop(const fs::path &reportPath) {
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    s_isRecording = false;
+
+    const auto microseconds = [](const Clock::duration &duration) {
+        return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(duration).count();
+    };
+
+    struct PhaseSummary {
+        size_t callCount = 0;
+        Clock::duration time{};
+        size_t byteCount = 0;
+        size_t peakHeldBytes = 0;
+    };
+
+    const auto memoryKindCount = static_cast<size_t>(MemoryKind::COUNT);
+
+    std::map<std::string, PhaseSummary> summaries;
+
+    rapidjson::Document document(rapidjson::kObjectType);
+    auto &allocator = document.GetAllocator();
+
+    rapidjson::Value jsonEvents(rapidjson::kArrayType);
+
+    for (auto &event : events) {
+        rapidjson::Value jsonArgs(rapidjson::kObjectType);
+        jsonArgs.AddMember("bytes", static_cast<uint64_t>(event.byteCount), allocator);
+
+        rapidjson::Value jsonEvent(rapidjson::kObjectType);
+        jsonEvent.AddMember("name", rapidjson::StringRef(event.phase), allocator);
+        jsonEvent.AddMember("ph", "X", allocator);
+        jsonEvent.AddMember("ts", microseconds(event.begin - startTime), allocator);
+        jsonEvent.AddMember("dur", microseconds(event.end - event.begin), allocator);
+        jsonEvent.AddMember("pid", 1, allocator);
+        jsonEvent.AddMember("tid", static_cast<uint64_t>(event.threadIndex), allocator);
+        jsonEvent.AddMember("args", jsonArgs, allocator);
+        jsonEvents.PushBack(jsonEvent, allocator);
+
+        // The bytes held are shown as a counter track.
+        rapidjson::Value jsonHeldBytes(rapidjson::kObjectType);
+        size_t heldBytes = 0;
+        for (size_t kind = 0; kind < memoryKindCount; ++kind) {
+            jsonHeldBytes.AddMember(rapidjson::StringRef(HeldMemory::kindName(static_cast<MemoryKind>(kind))),
+                                    static_cast<uint64_t>(event.heldBytes[kind]), allocator);
+            heldBytes += event.heldBytes[kind];
+        }
+
+        rapidjson::Value jsonCounter(rapidjson::kObjectType);
+        jsonCounter.AddMember("name", "Held memory", allocator);
+        jsonCounter.AddMember("ph", "C", allocator);
+        jsonCounter.AddMember("ts", microseconds(event.end - startTime), allocator);
+        jsonCounter.AddMember("pid", 1, allocator);
+        jsonCounter.AddMember("args", jsonHeldBytes, allocator);
+        jsonEvents.PushBack(jsonCounter, allocator);
+
+        auto &summary = summaries[event.phase];
+        ++summary.callCount;
+        summary.time += event.end - event.begin;
+        summary.byteCount += event.byteCount;
+        summary.peakHeldBytes = std::max(summary.peakHeldBytes, heldBytes);
+    }
+
+    rapidjson::Value jsonPhases(rapidjson::kObjectType);
+
+    for (auto &pair : summaries) {
+        auto &summary = pair.second;
+
+        rapidjson::Value jsonPhase(rapidjson::kObjectType);
+        jsonPhase.AddMember("calls", static_cast<uint64_t>(summary.callCount), allocator);
+        jsonPhase.AddMember("milliseconds", microseconds(summary.time) / 1000, allocator);
+        jsonPhase.AddMember("bytes", static_cast<uint64_t>(summary.byteCount), allocator);
+        jsonPhase.AddMember("peakHeldBytes", static_cast<uint64_t>(summary.peakHeldBytes), allocator);
+        jsonPhases.AddMember(rapidjson::Value(pair.first.c_str(), allocator), jsonPhase, allocator);
+    }
+
+    // The peak bytes held per container kind, and of the whole process.
+    rapidjson::Value jsonMemory(rapidjson::kObjectType);
+    rapidjson::Value jsonPeakHeldBytes(rapidjson::kObjectType);
+    for (size_t kind = 0; kind < memoryKindCount; ++kind) {
+        const auto memoryKind = static_cast<MemoryKind>(kind);
+        jsonPeakHeldBytes.AddMember(rapidjson::StringRef(HeldMemory::kindName(memoryKind)),
+                                    static_cast<uint64_t>(HeldMemory::peakBytes(memoryKind)), allocator);
+    }
+    jsonMemory.AddMember("peakHeldBytes", jsonPeakHeldBytes, allocator);
+    jsonMemory.AddMember("peakTotalHeldBytes", static_cast<uint64_t>(HeldMemory::peakTotalBytes()), allocator);
+    jsonMemory.AddMember("peakResidentBytes", static_cast<uint64_t>(peakResidentBytes()), allocator);
+
+    document.AddMember("traceEvents", jsonEvents, allocator);
+    document.AddMember("displayTimeUnit", "ms", allocator);
+    document.AddMember("phases", jsonPhases, allocator);
+    document.AddMember("memory", jsonMemory, allocator);
+    document.AddMember("totalMilliseconds", microseconds(Clock::now() - startTime) / 1000, allocator);
+
+    events.clear();
+    threadIndices.clear();
+
+    std::ofstream file(reportPath.string(), ios::out | ios::trunc);
+    rapidjson::OStreamWrapper streamWrapper(file);
+    rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+    document.Accept(writer);
+
+    if (!file) {
+        MayaException::printWarning(formatted("Failed to write the profile report '%s'", reportPath.string().c_str()));
+        return;
+    }
+
+    cout << prefix << "Wrote the profile report to " << reportPath << endl;
+
+    const auto megabytes = [](const size_t byteCount) { return formatted("%.1f MB", byteCount / (1024.0 * 1024.0)); };
+
+    cout << prefix << "Peak memory held by the export: " << megabytes(HeldMemory::peakTotalBytes()) << endl;
+    for (size_t kind = 0; kind < memoryKindCount; ++kind) {
+        const auto memoryKind = static_cast<MemoryKind>(kind);
+        cout << prefix << "    " << HeldMemory::kindName(memoryKind) << ": " << megabytes(HeldMemory::peakBytes(memoryKind)) << endl;
+    }
+
+    if (const auto residentBytes = peakResidentBytes()) {
+        cout << prefix << "Peak resident memory of Maya: " << megabytes(residentBytes) << endl;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+/**
+ * Records the time spent in the phases of an export, see ProfileScope, and
+ * writes these as a Chrome trace, that can be opened in chrome://tracing or
+ * https://ui.perfetto.dev. Besides the trace events, the report has a
+ * summary of the call count, the inclusive wall time and the bytes processed
+ * per phase, to compare exports across releases.
+ */
+class Profiler {
+  public:
+    /** Starts recording, discarding what was recorded before */
+    static void start();
+
+    static bool isRecording() { return s_isRecording; }
+
+    /** Stops recording, and writes the report */
+    static void stop(const fs::path &reportPath);
+
+    typedef std::chrono::steady_clock Clock;
+
+    /** Thread-safe, the phase must be a string literal */
+    static void record(const char *phase, Clock::time_point begin, Clock::time_point end, size_t byteCount);
+
+  private:
+    static std::atomic<bool> s_isRecording;
+};
+
+/**
+ * Times a phase of the export while it is in scope, when profiling.
+ * The phase name must be a string literal, the scopes can be nested, and
+ * used on worker threads.
+ */
+class ProfileScope {
+  public:
+    explicit ProfileScope(const char *phase, const size_t byteCount = 0)
+        : m_phase(Profiler::isRecording() ? phase : nullptr), m_byteCount(byteCount) {
+        if (m_phase) {
+            m_begin = Profiler::Clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (m_phase) {
+            Profiler::record(m_phase, m_begin, Profiler::Clock::now(), m_byteCount);
+        }
+    }
+
+    void addBytes(const size_t byteCount) { m_byteCount += byteCount; }
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ProfileScope);
+
+    const char *const m_phase;
+    size_t m_byteCount;
+    Profiler::Clock::time_point m_begin;
+};
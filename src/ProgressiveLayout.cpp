@@ -0,0 +1,69 @@
+#include "externals.h"
+
+#include "ProgressiveLayout.h"
+#include "jsonPatch.h"
+
+ProgressiveLayout::ProgressiveLayout() = default;
+
+ProgressiveLayout::~ProgressiveLayout() = default;
+
+int ProgressiveLayout::addTier(const std::string &name) {
+    m_tierNames.push_back(name);
+    return static_cast<int>(m_tierNames.size()) - 1;
+}
+
+void ProgressiveLayout::setPriority(const GLTF::Accessor *accessor, const int priority) {
+    const auto it = m_priorities.emplace(accessor, priority).first;
+    it->second = std::min(it->second, priority);
+}
+
+int ProgressiveLayout::priority(const GLTF::Accessor *accessor) const {
+    const auto it = m_priorities.find(accessor);
+    return it == m_priorities.end() ? m_defaultPriority : it->second;
+}
+
+void ProgressiveLayout::addRange(const GLTF::Buffer *buffer, const int priority, const int byteOffset,
+                                 const int byteLength) {
+    if (byteLength <= 0)
+        return;
+
+    // The regions are placed in order, only the alignment padding is between these.
+    if (!m_ranges.empty()) {
+        auto &last = m_ranges.back();
+        if (last.buffer == buffer && last.priority == priority && byteOffset >= last.byteOffset + last.byteLength &&
+            byteOffset <= ((last.byteOffset + last.byteLength + 3) & ~3)) {
+            last.byteLength = byteOffset + byteLength - last.byteOffset;
+            return;
+        }
+    }
+
+    m_ranges.push_back({buffer, priority, byteOffset, byteLength});
+}
+
+void ProgressiveLayout::patchJSON(rapidjson::Document &document) const {
+    if (m_ranges.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    rapidjson::Value jsonRanges(rapidjson::kArrayType);
+
+    for (auto &&range : m_ranges) {
+        // A buffer that is not written has no id.
+        if (range.buffer->id < 0)
+            continue;
+
+        rapidjson::Value jsonRange(rapidjson::kObjectType);
+        jsonRange.AddMember("tier", rapidjson::Value(m_tierNames.at(range.priority).c_str(), allocator), allocator);
+        jsonRange.AddMember("buffer", range.buffer->id, allocator);
+        jsonRange.AddMember("byteOffset", range.byteOffset, allocator);
+        jsonRange.AddMember("byteLength", range.byteLength, allocator);
+        jsonRanges.PushBack(jsonRange, allocator);
+    }
+
+    if (!document.HasMember("extras")) {
+        document.AddMember("extras", rapidjson::Value(rapidjson::kObjectType), allocator);
+    }
+
+    setMember(document["extras"], "progressiveLayout", std::move(jsonRanges), allocator);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "macros.h"
+
+/**
+ * The order of the packed buffer of -progressiveLayout. The data is
+ * packed in tiers, from the data needed to show a first frame to the data
+ * that can stream in later; the packer places the buffer views of each
+ * tier together, in order of the tiers.
+ *
+ * The byte ranges of the tiers are written to the extras of the glTF, so a
+ * loader can render progressively from the first HTTP range requests.
+ */
+class ProgressiveLayout {
+  public:
+    ProgressiveLayout();
+    ~ProgressiveLayout();
+
+    /** Adds the next tier, returns its priority */
+    int addTier(const std::string &name);
+
+    /** Moves the accessor to the tier, unless it is in an earlier tier */
+    void setPriority(const GLTF::Accessor *accessor, int priority);
+
+    /** The tier of the accessor, the default tier when it has none */
+    int priority(const GLTF::Accessor *accessor) const;
+
+    /** The tier of the accessors without a tier */
+    void setDefaultPriority(int priority) { m_defaultPriority = priority; }
+
+    /** The tier of the additional data of the buffer, e.g. the images */
+    int additionalPriority() const { return m_additionalPriority; }
+    void setAdditionalPriority(int priority) { m_additionalPriority = priority; }
+
+    /** Called by the packer for each placed region of the buffer */
+    void addRange(const GLTF::Buffer *buffer, int priority, int byteOffset, int byteLength);
+
+    bool empty() const { return m_ranges.empty(); }
+
+    /** Adds the byte ranges of the tiers to the extras of the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(ProgressiveLayout);
+
+    struct Range {
+        const GLTF::Buffer *buffer;
+        int priority;
+        int byteOffset;
+        int byteLength;
+    };
+
+    std::vector<std::string> m_tierNames;
+    std::map<const GLTF::Accessor *, int> m_priorities;
+    int m_defaultPriority = 0;
+    int m_additionalPriority = 0;
+
+    // In order of placement, adjacent regions of a tier are merged.
+    std::vector<Range> m_ranges;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "AnimationQuantization.h"
 #include "ExportableFrames.h"
+#include "KeyframeReduction.h"
 #include "accessors.h"
+#include "kernels.h"
 #include "macros.h"
 
 class ExportableNode;
@@ -12,9 +15,10 @@ class PropAnimation {
                   size_t stepDetectSampleCount, const bool useFloatArray)
         : dimension(dimension), useFloatArray(useFloatArray), stepDetectSampleCount(stepDetectSampleCount), frames(frames) {
 
-        componentValuesPerFrameTable.resize(stepDetectSampleCount);
-        for (auto superSample = 0; superSample < stepDetectSampleCount; ++superSample) {
-            componentValuesPerFrameTable[superSample].reserve(frames.count * dimension);
+        componentValuesPerFrame.reserve(frames.count * dimension);
+
+        if (stepDetectSampleCount > 1) {
+            stepDeviationPerFrame.reserve(frames.count);
         }
 
         glTarget.node = &const_cast<GLTF::Node &>(node);
@@ -31,80 +35,234 @@ class PropAnimation {
     const size_t stepDetectSampleCount;
     const ExportableFrames &frames;
 
-    // For each step-detection super-sampling frame, a vector of component values
-    std::vector<std::vector<float>> componentValuesPerFrameTable;
+    // The component values of each frame
+    std::vector<float> componentValuesPerFrame;
+
+    // For each frame, the largest difference of a component between the
+    // step-detection super-samples and the frame. Only the frame values are
+    // kept, the super-samples are compared while sampling.
+    std::vector<float> stepDeviationPerFrame;
+
+    // When the values are keys exported from anim curves instead of samples,
+    // the clip-relative key times in seconds, and their interpolation.
+    std::vector<float> keyTimes;
+    const char *keyInterpolation = nullptr;
 
     GLTF::Animation::Channel glChannel;
     GLTF::Animation::Sampler glSampler;
     GLTF::Animation::Channel::Target glTarget;
 
     template <std::ptrdiff_t Extent> void append(const gsl::span<const float, Extent> &components, size_t superSample) {
-        std::copy(components.begin(), components.end(), std::back_inserter(componentValuesPerFrameTable.at(superSample)));
+        if (superSample > 0) {
+            appendStepSample(components, false);
+            return;
+        }
+
+        componentValuesPerFrame.insert(componentValuesPerFrame.end(), components.begin(), components.end());
+
+        if (stepDetectSampleCount > 1) {
+            stepDeviationPerFrame.push_back(0);
+        }
     }
 
     void appendQuaternion(const gsl::span<const float, 4> &q, int superSample) {
-        auto &componentValuesPerFrame = componentValuesPerFrameTable.at(superSample);
+        if (superSample > 0) {
+            appendStepSample(q, true);
+            return;
+        }
 
         const auto index = componentValuesPerFrame.size();
         if (index == 0) {
             append(q, superSample);
         } else {
-            auto x0 = componentValuesPerFrame[index - 4];
-            auto y0 = componentValuesPerFrame[index - 3];
-            auto z0 = componentValuesPerFrame[index - 2];
-            auto w0 = componentValuesPerFrame[index - 1];
-
-            auto x1 = q[0];
-            auto y1 = q[1];
-            auto z1 = q[2];
-            auto w1 = q[3];
-
-            // Check if the negative quaternion is a closer.
-            auto dp = (x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1) + (z0 - z1) * (z0 - z1) + (w0 - w1) * (w0 - w1);
-            auto dn = (x0 + x1) * (x0 + x1) + (y0 + y1) * (y0 + y1) + (z0 + z1) * (z0 + z1) + (w0 + w1) * (w0 + w1);
-
-            if (dn < dp) {
-                x1 = -x1;
-                y1 = -y1;
-                z1 = -z1;
-                w1 = -w1;
+            // Use the negative quaternion if it is closer.
+            float aligned[4] = {q[0], q[1], q[2], q[3]};
+            kernels::alignQuaternion(&componentValuesPerFrame[index - 4], aligned);
+
+            componentValuesPerFrame.insert(componentValuesPerFrame.end(), aligned, aligned + 4);
+
+            if (stepDetectSampleCount > 1) {
+                stepDeviationPerFrame.push_back(0);
             }
+        }
+    }
+
+    /** Which frames hold their value until the next frame, according to the step-detection super-samples */
+    std::vector<bool> stepFrames(const double threshold) const {
+        return kernels::stepFrames(stepDeviationPerFrame.data(), stepDeviationPerFrame.size(), threshold);
+    }
+
+    /** Emulates STEP interpolation for some frames of a LINEAR channel: a step frame gets an extra key
+     * at its last super-sample, holding its value, unless the next frame has the same value. */
+    void holdStepFrames(const std::vector<bool> &isStep, const double threshold) {
+        const auto frameCount = componentValuesPerFrame.size() / dimension;
+        const auto holdDuration = (stepDetectSampleCount - 1) / (stepDetectSampleCount * frames.framesPerSecond);
+
+        std::vector<float> values;
+        values.reserve(componentValuesPerFrame.size());
+        keyTimes.clear();
+
+        for (size_t frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            const auto *frameValues = &componentValuesPerFrame[frameIndex * dimension];
+            const auto frameTime = frameIndex / frames.framesPerSecond;
 
-            componentValuesPerFrame.push_back(x1);
-            componentValuesPerFrame.push_back(y1);
-            componentValuesPerFrame.push_back(z1);
-            componentValuesPerFrame.push_back(w1);
+            keyTimes.emplace_back(static_cast<float>(frameTime));
+            values.insert(values.end(), frameValues, frameValues + dimension);
+
+            if (frameIndex + 1 < frameCount && isStep[frameIndex]) {
+                const auto *nextValues = frameValues + dimension;
+                const auto isHeld = std::equal(frameValues, frameValues + dimension, nextValues,
+                                               [&](float a, float b) { return std::abs(a - b) < threshold; });
+
+                if (!isHeld) {
+                    keyTimes.emplace_back(static_cast<float>(frameTime + holdDuration));
+                    values.insert(values.end(), frameValues, frameValues + dimension);
+                }
+            }
         }
+
+        componentValuesPerFrame = std::move(values);
+        keyInterpolation = "LINEAR";
     }
 
-    void finish(const std::string &name, const bool useSingleKey, const char *interpolation) {
+    /** A positive reduction tolerance removes the keys of a LINEAR channel that can be interpolated from the other keys.
+     * A CUBICSPLINE channel is fitted to the samples within the tolerance.
+     * A non-negative quantization tolerance stores the outputs as normalized integers when these are within the tolerance.
+     * A maximum rate divisor above 1 first resamples a LINEAR channel at the lowest rate of the clip rate divided by up to
+     * that divisor that still reproduces the samples within the resampling tolerance.
+     * The reduction only checks the resampled keys, so the errors of both steps add up: when both are used, each gets half
+     * of its tolerance, which keeps the keys within the larger tolerance of the original samples. */
+    void finish(const std::string &name, const bool useSingleKey, const char *interpolation, const double reductionTolerance = 0,
+                const double quantizationTolerance = -1, const double resamplingTolerance = 0, const int maxRateDivisor = 1) {
         glSampler.interpolation = interpolation;
 
         if (!m_outputs) {
-            auto &componentValuesPerFrame = componentValuesPerFrameTable.at(0);
-
             if (useSingleKey) {
                 componentValuesPerFrame.resize(dimension);
                 glSampler.input = frames.glInput0();
+            } else if (keyInterpolation) {
+                glSampler.input = frames.glKeyTimes(keyTimes);
+            } else if ((reductionTolerance > 0 || (resamplingTolerance > 0 && maxRateDivisor > 1)) && strcmp(interpolation, "LINEAR") == 0) {
+                const auto isQuaternion = glTarget.path == GLTF::Animation::Path::ROTATION;
+
+                // The frames of the lowest rate that fits come first, the reduction then removes keys of these.
+                const auto toleranceShare = reductionTolerance > 0 ? 0.5 : 1.0;
+                auto keys = resampleKeyframes(span(componentValuesPerFrame), dimension, isQuaternion,
+                                              resamplingTolerance * toleranceShare, maxRateDivisor);
+                const auto isResampled = static_cast<int>(keys.size()) < frames.count;
+                keepFrames(keys);
+
+                if (reductionTolerance > 0) {
+                    // Between the resampled keys, both curves are interpolated linearly, so the reduction only needs
+                    // to check the keys to bound its error at the original frames.
+                    auto reducedKeys = reduceKeyframes(span(componentValuesPerFrame), dimension, isQuaternion,
+                                                       isResampled ? reductionTolerance * 0.5 : reductionTolerance);
+                    keepFrames(reducedKeys);
+
+                    for (auto &key : reducedKeys) {
+                        key = keys[key];
+                    }
+                    keys = reducedKeys;
+                }
+
+                glSampler.input = frames.glInputs(keys);
+            } else if (strcmp(interpolation, "CUBICSPLINE") == 0) {
+                const auto isQuaternion = glTarget.path == GLTF::Animation::Path::ROTATION;
+
+                std::vector<float> splineValues;
+                const auto keys = fitCubicSpline(span(componentValuesPerFrame), dimension, isQuaternion, reductionTolerance,
+                                                 frames.framesPerSecond, splineValues);
+
+                componentValuesPerFrame = std::move(splineValues);
+                glSampler.input = frames.glInputs(keys);
             } else {
                 glSampler.input = frames.glInputs();
             }
 
-            if (stepDetectSampleCount > 1 && !useSingleKey) {
-                // Remove all
+            const auto outputDimension = useFloatArray ? 1 : dimension;
+
+            if (quantizationTolerance >= 0) {
+                m_outputs = quantizedOutputAccessor(name, span(componentValuesPerFrame), outputDimension, glTarget.path, quantizationTolerance);
+                m_isQuantized = m_outputs != nullptr;
             }
 
-            m_outputs = contiguousChannelAccessor(name, span(componentValuesPerFrame), useFloatArray ? 1 : dimension);
+            if (!m_outputs) {
+                m_outputs = contiguousChannelAccessor(name, span(componentValuesPerFrame), outputDimension);
+            }
 
             glSampler.output = m_outputs.get();
 
+            // The accessors hold a copy, the samples are not needed any more.
+            releaseSamples();
+
             // A channel cannot have a name according to the spec.
             // glChannel.name = name;
         }
     }
 
-private:
+    /** Are the outputs normalized integers? */
+    bool isQuantized() const { return m_isQuantized; }
+
+    /** Writes the samples taken so far, see SampleCache */
+    void writeSamples(std::ostream &stream) const {
+        writeVector(stream, componentValuesPerFrame);
+        writeVector(stream, stepDeviationPerFrame);
+    }
+
+    /** Reads the samples of all frames, returns false when these don't match the clip */
+    bool readSamples(std::istream &stream) {
+        return readVector(stream, componentValuesPerFrame, frames.count * dimension) &&
+               readVector(stream, stepDeviationPerFrame, stepDetectSampleCount > 1 ? frames.count : 0);
+    }
+
+    void clearSamples() {
+        componentValuesPerFrame.clear();
+        stepDeviationPerFrame.clear();
+    }
+
+  private:
+    static void writeVector(std::ostream &stream, const std::vector<float> &values) {
+        const auto size = static_cast<uint64_t>(values.size());
+        stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        stream.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(float));
+    }
+
+    static bool readVector(std::istream &stream, std::vector<float> &values, const size_t expectedSize) {
+        uint64_t size = 0;
+        if (!stream.read(reinterpret_cast<char *>(&size), sizeof(size)) || size != expectedSize)
+            return false;
+
+        values.resize(expectedSize);
+        return bool(stream.read(reinterpret_cast<char *>(values.data()), expectedSize * sizeof(float)));
+    }
+
+    /** Keeps the values of the given frames, in increasing order */
+    void keepFrames(const std::vector<int> &frameIndices) {
+        // The values can be moved in place.
+        for (size_t keyIndex = 0; keyIndex < frameIndices.size(); ++keyIndex) {
+            std::copy_n(&componentValuesPerFrame[frameIndices[keyIndex] * dimension], dimension, &componentValuesPerFrame[keyIndex * dimension]);
+        }
+
+        componentValuesPerFrame.resize(frameIndices.size() * dimension);
+    }
+
+    void releaseSamples() {
+        std::vector<float>().swap(componentValuesPerFrame);
+        std::vector<float>().swap(stepDeviationPerFrame);
+        std::vector<float>().swap(keyTimes);
+    }
+
+    template <std::ptrdiff_t Extent> void appendStepSample(const gsl::span<const float, Extent> &components, const bool isQuaternion) {
+        // Super-samples come right after the frame they belong to.
+        const auto *frameValues = &componentValuesPerFrame.at(componentValuesPerFrame.size() - dimension);
+
+        // For quaternions, q and -q are the same rotation.
+        auto &frameDeviation = stepDeviationPerFrame.back();
+        frameDeviation = std::max(frameDeviation, kernels::sampleDeviation(frameValues, components.data(), dimension, isQuaternion));
+    }
+
     std::unique_ptr<GLTF::Accessor> m_outputs;
+    bool m_isQuantized = false;
 
     DISALLOW_COPY_MOVE_ASSIGN(PropAnimation);
 };
@@ -0,0 +1,213 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Digester.h"
+#include "ExportableClip.h"
+#include "ExportableMesh.h"
+#include "ExportableNode.h"
+#include "MayaException.h"
+#include "SampleCache.h"
+#include "dump.h"
+
+// Change this when the samples or their key change.
+const uint32_t sampleCacheVersion = 1;
+
+const char sampleCacheMagic[4] = {'M', '2', 'G', 'S'};
+
+SampleCache::SampleCache(const Arguments &args, fs::path folder) : m_args(args), m_folder(std::move(folder)) {
+    std::error_code error;
+    create_directories(m_folder, error);
+    if (error)
+        throw std::runtime_error(formatted("Couldn't create the sample cache folder '%s'", m_folder.string().c_str()));
+}
+
+SampleCache::~SampleCache() = default;
+
+bool SampleCache::load(ExportableClip &clip) {
+    if (!clip.needsSampling())
+        return false;
+
+    const auto key = clipKey(clip);
+
+    std::ifstream file((m_folder / (key + ".samples")).string(), ios::in | ios::binary);
+
+    char magic[sizeof(sampleCacheMagic)] = {};
+    uint32_t version = 0;
+
+    const auto isHit = file.is_open() && file.read(magic, sizeof(magic)) && std::equal(magic, magic + sizeof(magic), sampleCacheMagic) &&
+                       file.read(reinterpret_cast<char *>(&version), sizeof(version)) && version == sampleCacheVersion &&
+                       clip.readSamples(file);
+
+    if (isHit) {
+        ++m_hitCount;
+        cout << prefix << "Reading the samples of clip '" << clip.clipArg().name << "' from the cache" << endl;
+    } else {
+        ++m_missCount;
+        m_missedKeys[&clip] = key;
+    }
+
+    return isHit;
+}
+
+void SampleCache::store(const ExportableClip &clip) {
+    const auto it = m_missedKeys.find(&clip);
+    if (it == m_missedKeys.end())
+        return;
+
+    const auto path = m_folder / (it->second + ".samples");
+    m_missedKeys.erase(it);
+
+    // Written under another name first, so a failed write never leaves a
+    // truncated file that would be read later.
+    auto tempPath = path;
+    tempPath += ".tmp";
+
+    {
+        std::ofstream file(tempPath.string(), ios::out | ios::binary | ios::trunc);
+        file.write(sampleCacheMagic, sizeof(sampleCacheMagic));
+        file.write(reinterpret_cast<const char *>(&sampleCacheVersion), sizeof(sampleCacheVersion));
+        clip.writeSamples(file);
+
+        if (!file) {
+            MayaException::printWarning(formatted("Failed to write the sample cache file '%s'", tempPath.string().c_str()));
+            return;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error) {
+        MayaException::printWarning(formatted("Failed to write the sample cache file '%s'", path.string().c_str()));
+        fs::remove(tempPath, error);
+    }
+}
+
+void SampleCache::printStatistics() const {
+    const auto total = m_hitCount + m_missCount;
+    if (total == 0)
+        return;
+
+    cout << prefix << "Sample cache: " << m_hitCount << " of " << total << " clips read, " << m_missCount << " sampled ("
+         << m_hitCount * 100 / total << "% hit rate)" << endl;
+}
+
+std::string SampleCache::clipKey(const ExportableClip &clip) {
+    const auto &clipArg = clip.clipArg();
+
+    Digester digester;
+    digester.add(sampleCacheVersion);
+    digester.add(clipArg.startTime.as(MTime::kSeconds));
+    digester.add(static_cast<uint64_t>(clip.frameCount()));
+    digester.add(clipArg.framesPerSecond);
+    digester.add(static_cast<uint64_t>(clip.stepDetectSampleCount()));
+    digester.add(m_args.getBakeScaleFactor());
+    digester.add(m_args.rounding.position.decimals);
+    digester.add(m_args.rounding.direction.decimals);
+    digester.add(m_args.rounding.scale.decimals);
+    digester.add(m_args.forceAnimationChannels);
+
+    for (auto *node : clip.sampledNodes()) {
+        digester.add(nodeDigest(*node));
+    }
+
+    return digester.hexDigest();
+}
+
+const std::string &SampleCache::nodeDigest(const ExportableNode &node) {
+    auto &digest = m_nodeDigests[&node];
+    if (!digest.empty())
+        return digest;
+
+    MStatus status;
+
+    Digester digester;
+    digester.add(node.dagPath.fullPathName());
+    digester.add(node.transformKind);
+    digester.add(node.initialTransformState.primaryTRS());
+    digester.add(node.initialTransformState.secondaryTRS());
+
+    // The correctors of complex transforms depend on the parent.
+    if (node.parentNode) {
+        digester.add(node.parentNode->dagPath.fullPathName());
+        digester.add(node.parentNode->initialTransformState.primaryTRS());
+    }
+
+    if (const auto *mesh = node.mesh()) {
+        const auto weights = mesh->initialWeights();
+        digester.add(static_cast<uint64_t>(weights.size()));
+        for (auto weight : weights) {
+            digester.add(weight);
+        }
+    }
+
+    // The blend shape deformers are upstream of the shapes.
+    std::vector<MObject> roots{node.dagPath.node()};
+
+    unsigned shapeCount = 0;
+    THROW_ON_FAILURE(node.dagPath.numberOfShapesDirectlyBelow(shapeCount));
+
+    for (unsigned shapeIndex = 0; shapeIndex < shapeCount; ++shapeIndex) {
+        auto shapePath = node.dagPath;
+        THROW_ON_FAILURE(shapePath.extendToShapeDirectlyBelow(shapeIndex));
+        roots.emplace_back(shapePath.node());
+    }
+
+    for (auto &root : roots) {
+        MItDependencyGraph dgIt(root, MFn::kInvalid, MItDependencyGraph::kUpstream, MItDependencyGraph::kDepthFirst,
+                                MItDependencyGraph::kNodeLevel, &status);
+        THROW_ON_FAILURE(status);
+
+        dgIt.disablePruningOnFilter();
+
+        for (; !dgIt.isDone(); dgIt.next()) {
+            const auto item = dgIt.currentItem();
+            const MFnDependencyNode fnNode(item);
+
+            digester.add(fnNode.typeName());
+            digester.add(fnNode.name());
+
+            if (item.hasFn(MFn::kAnimCurve)) {
+                digester.add(curveDigest(item));
+            }
+        }
+    }
+
+    digest = digester.digest();
+    return digest;
+}
+
+const std::string &SampleCache::curveDigest(const MObject &curve) {
+    MStatus status;
+    MFnAnimCurve fnCurve(curve, &status);
+    THROW_ON_FAILURE(status);
+
+    auto &digest = m_curveDigestsPerUuid[fnCurve.uuid().asString().asChar()];
+    if (!digest.empty())
+        return digest;
+
+    Digester digester;
+    digester.add(fnCurve.preInfinityType());
+    digester.add(fnCurve.postInfinityType());
+    digester.add(fnCurve.isWeighted());
+
+    const auto keyCount = fnCurve.numKeys();
+    digester.add(keyCount);
+
+    for (unsigned i = 0; i < keyCount; ++i) {
+        digester.add(fnCurve.time(i).as(MTime::kSeconds));
+        digester.add(fnCurve.value(i));
+        digester.add(fnCurve.inTangentType(i));
+        digester.add(fnCurve.outTangentType(i));
+
+        float x = 0, y = 0;
+        THROW_ON_FAILURE(fnCurve.getTangent(i, x, y, true));
+        digester.add(x);
+        digester.add(y);
+        THROW_ON_FAILURE(fnCurve.getTangent(i, x, y, false));
+        digester.add(x);
+        digester.add(y);
+    }
+
+    digest = digester.digest();
+    return digest;
+}
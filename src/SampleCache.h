@@ -0,0 +1,53 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+class Arguments;
+class ExportableClip;
+class ExportableNode;
+
+/**
+ * Stores the samples of the animation clips in a folder, so clips that
+ * didn't change since the previous export are read instead of sampled.
+ *
+ * Each clip is stored in a file named after a hash of everything its samples
+ * depend on: the clip range and frame rate, the sampling arguments, the
+ * sampled nodes with their initial transforms, and the nodes upstream of
+ * these, including the keys of the anim curves. Changing the value of a
+ * static attribute of a rig node is only detected when it changes the
+ * initial transforms.
+ */
+class SampleCache {
+  public:
+    SampleCache(const Arguments &args, fs::path folder);
+    ~SampleCache();
+
+    /** Reads the samples of the clip when these are in the cache, returns false on a miss */
+    bool load(ExportableClip &clip);
+
+    /** Writes the samples of a clip that missed, after it is sampled */
+    void store(const ExportableClip &clip);
+
+    void printStatistics() const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(SampleCache);
+
+    std::string clipKey(const ExportableClip &clip);
+    const std::string &nodeDigest(const ExportableNode &node);
+    const std::string &curveDigest(const MObject &curve);
+
+    const Arguments &m_args;
+    const fs::path m_folder;
+
+    size_t m_hitCount = 0;
+    size_t m_missCount = 0;
+
+    // The keys of the clips that missed, to store these after sampling.
+    std::map<const ExportableClip *, std::string> m_missedKeys;
+
+    // Clips share their nodes and rigs, so the digests are reused.
+    std::map<const ExportableNode *, std::string> m_nodeDigests;
+    std::map<std::string, std::string> m_curveDigestsPerUuid;
+};
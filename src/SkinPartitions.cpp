@@ -0,0 +1,147 @@
+#include "externals.h"
+
+#include "PrimitiveSplitting.h"
+#include "SkinPartitions.h"
+#include "spans.h"
+
+// The joints with a weight of each vertex of the buffer, sorted.
+static std::vector<std::vector<JointIndex>> weightedJoints(const VertexBuffer &vertexBuffer) {
+    std::vector<std::vector<JointIndex>> vertexJoints(vertexBuffer.maxIndex());
+
+    const auto &componentsMap = vertexBuffer.componentsMap;
+
+    for (auto &&pair : componentsMap) {
+        const auto &slot = pair.first;
+        if (slot.semantic != Semantic::JOINTS || !slot.shapeIndex.isMainShapeIndex())
+            continue;
+
+        const auto weightsIt = componentsMap.find(VertexSlot(slot.shapeIndex, Semantic::WEIGHTS, slot.setIndex));
+        if (weightsIt == componentsMap.end())
+            continue;
+
+        const auto indices = reinterpret_span<JointIndices>(span(pair.second));
+        const auto weights = reinterpret_span<JointWeights>(span(weightsIt->second));
+
+        for (size_t vertexIndex = 0; vertexIndex < vertexJoints.size(); ++vertexIndex) {
+            const auto &vertexIndices = indices[vertexIndex];
+            const auto &vertexWeights = weights[vertexIndex];
+            for (size_t i = 0; i < vertexIndices.size(); ++i) {
+                if (vertexWeights[i] > 0) {
+                    vertexJoints[vertexIndex].push_back(vertexIndices[i]);
+                }
+            }
+        }
+    }
+
+    for (auto &joints : vertexJoints) {
+        std::sort(joints.begin(), joints.end());
+        joints.erase(std::unique(joints.begin(), joints.end()), joints.end());
+    }
+
+    return vertexJoints;
+}
+
+// Copies the triangles of the source buffer to the target, with the joint
+// indices mapped to the palette of the partition.
+static void copyPartitionTriangles(const VertexBuffer &source, const std::vector<Index> &triangles,
+                                   const std::vector<JointIndex> &paletteIndices, VertexBuffer &target) {
+    copyTriangles(source, triangles, target);
+
+    for (auto &&pair : target.componentsMap) {
+        if (pair.first.semantic == Semantic::JOINTS) {
+            // The joints without weight map to the first joint of the palette.
+            for (auto &jointIndex : mutable_span(reinterpret_span<JointIndex>(span(pair.second)))) {
+                jointIndex = paletteIndices[jointIndex];
+            }
+        }
+    }
+}
+
+bool partitionSkin(const std::vector<const VertexBuffer *> &vertexBuffers, const size_t jointCount,
+                   const size_t maxJointCount, std::vector<SkinPartition> &partitions) {
+    struct Assignment {
+        std::vector<bool> hasJoint;
+        std::vector<JointIndex> palette;
+        std::vector<std::vector<Index>> trianglesPerBuffer;
+    };
+
+    std::vector<Assignment> assignments;
+    std::vector<JointIndex> triangleJoints;
+
+    for (size_t bufferIndex = 0; bufferIndex < vertexBuffers.size(); ++bufferIndex) {
+        const auto &vertexBuffer = *vertexBuffers[bufferIndex];
+        const auto vertexJoints = weightedJoints(vertexBuffer);
+        const auto triangleCount = static_cast<Index>(vertexBuffer.indices.size() / 3);
+
+        for (Index triangle = 0; triangle < triangleCount; ++triangle) {
+            triangleJoints.clear();
+            for (int corner = 0; corner < 3; ++corner) {
+                const auto &joints = vertexJoints[vertexBuffer.indices[triangle * 3 + corner]];
+                triangleJoints.insert(triangleJoints.end(), joints.begin(), joints.end());
+            }
+
+            std::sort(triangleJoints.begin(), triangleJoints.end());
+            triangleJoints.erase(std::unique(triangleJoints.begin(), triangleJoints.end()), triangleJoints.end());
+
+            if (triangleJoints.size() > maxJointCount)
+                return false;
+
+            size_t bestIndex = assignments.size();
+            size_t bestNewJointCount = maxJointCount + 1;
+
+            for (size_t index = 0; index < assignments.size() && bestNewJointCount > 0; ++index) {
+                const auto &assignment = assignments[index];
+                const auto newJointCount = static_cast<size_t>(std::count_if(
+                    triangleJoints.begin(), triangleJoints.end(), [&](auto joint) { return !assignment.hasJoint[joint]; }));
+
+                if (assignment.palette.size() + newJointCount <= maxJointCount && newJointCount < bestNewJointCount) {
+                    bestIndex = index;
+                    bestNewJointCount = newJointCount;
+                }
+            }
+
+            if (bestIndex == assignments.size()) {
+                assignments.push_back({std::vector<bool>(jointCount), {}, std::vector<std::vector<Index>>(vertexBuffers.size())});
+            }
+
+            auto &assignment = assignments[bestIndex];
+            for (auto joint : triangleJoints) {
+                if (!assignment.hasJoint[joint]) {
+                    assignment.hasJoint[joint] = true;
+                    assignment.palette.push_back(joint);
+                }
+            }
+
+            assignment.trianglesPerBuffer[bufferIndex].push_back(triangle);
+        }
+    }
+
+    partitions.resize(assignments.size());
+
+    std::vector<JointIndex> paletteIndices(jointCount);
+
+    for (size_t index = 0; index < assignments.size(); ++index) {
+        auto &assignment = assignments[index];
+        auto &partition = partitions[index];
+
+        std::sort(assignment.palette.begin(), assignment.palette.end());
+
+        std::fill(paletteIndices.begin(), paletteIndices.end(), 0);
+        for (size_t i = 0; i < assignment.palette.size(); ++i) {
+            paletteIndices[assignment.palette[i]] = static_cast<JointIndex>(i);
+        }
+
+        partition.palette = std::move(assignment.palette);
+        partition.vertexBuffers.resize(vertexBuffers.size());
+
+        for (size_t bufferIndex = 0; bufferIndex < vertexBuffers.size(); ++bufferIndex) {
+            const auto &triangles = assignment.trianglesPerBuffer[bufferIndex];
+            if (!triangles.empty()) {
+                copyPartitionTriangles(*vertexBuffers[bufferIndex], triangles, paletteIndices,
+                                       partition.vertexBuffers[bufferIndex]);
+            }
+        }
+    }
+
+    return true;
+}
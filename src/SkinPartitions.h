@@ -0,0 +1,31 @@
+#pragma once
+
+#include "MeshRenderables.h"
+#include "sceneTypes.h"
+
+/**
+ * The triangles of a skinned mesh that use at most a budget of joints, so
+ * engines that cap the joints per draw call can skin these in one draw, see
+ * -maxSkinJoints.
+ */
+struct SkinPartition {
+    /** The skin joints of the partition, its JOINTS attributes index these */
+    std::vector<JointIndex> palette;
+
+    /** Per vertex buffer of the mesh, the triangles of the partition, with
+     * their own copy of the vertices. Without indices when the partition has
+     * no triangles of the buffer. */
+    std::vector<VertexBuffer> vertexBuffers;
+};
+
+/**
+ * Assigns each triangle of the vertex buffers to the partition that needs
+ * the fewest extra joints for it, adding a partition when none has room
+ * left. The partitions are shared by all vertex buffers, so each one needs a
+ * single skin. Vertices used by triangles of different partitions are
+ * duplicated. Doesn't call Maya.
+ *
+ * Returns false when a single triangle uses more joints than the budget.
+ */
+bool partitionSkin(const std::vector<const VertexBuffer *> &vertexBuffers, size_t jointCount, size_t maxJointCount,
+                   std::vector<SkinPartition> &partitions);
@@ -0,0 +1,213 @@
+#include "externals.h"
+
+#include "SparseAccessors.h"
+#include "accessors.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+SparseAccessors::SparseAccessors() = default;
+
+SparseAccessors::~SparseAccessors() = default;
+
+// Null when the sparse form is too large.
+template <typename T>
+static std::unique_ptr<SparseAccessor>
+sparsify(GLTF::Accessor *denseAccessor, const gsl::span<const T> &components,
+         const WebGL componentType, const size_t dimension,
+         const double maxSizeRatio) {
+    const auto elementCount = components.size() / dimension;
+
+    std::vector<uint32_t> nonZeroIndices;
+    for (size_t index = 0; index < elementCount; ++index) {
+        const auto element = components.subspan(index * dimension, dimension);
+        if (std::any_of(element.begin(), element.end(),
+                        [](T c) { return c != 0; })) {
+            nonZeroIndices.push_back(static_cast<uint32_t>(index));
+        }
+    }
+
+    const auto use32bitIndices =
+        elementCount > std::numeric_limits<uint16_t>::max();
+    const auto indexSize = use32bitIndices ? sizeof(uint32_t) : sizeof(uint16_t);
+    const auto elementSize = dimension * sizeof(T);
+
+    const auto denseSize = elementCount * elementSize;
+    const auto sparseSize = nonZeroIndices.size() * (indexSize + elementSize);
+
+    if (sparseSize > maxSizeRatio * denseSize)
+        return nullptr;
+
+    auto sparse = std::make_unique<SparseAccessor>();
+    sparse->denseAccessor = denseAccessor;
+
+    const auto sparseCount = nonZeroIndices.size();
+
+    if (sparseCount > 0) {
+        sparse->indexData.resize(sparseCount * indexSize);
+        sparse->valueData.resize(sparseCount * elementSize);
+
+        for (size_t i = 0; i < sparseCount; ++i) {
+            const auto index = nonZeroIndices[i];
+            if (use32bitIndices) {
+                reinterpret_cast<uint32_t *>(sparse->indexData.data())[i] = index;
+            } else {
+                reinterpret_cast<uint16_t *>(sparse->indexData.data())[i] =
+                    static_cast<uint16_t>(index);
+            }
+
+            std::memcpy(&sparse->valueData[i * elementSize],
+                        &components[index * dimension], elementSize);
+        }
+
+        // Sparse data must not be in a buffer view with a byte stride, so
+        // these use the generic target.
+        const auto genericTarget = static_cast<WebGL>(-1);
+
+        const auto indicesName = denseAccessor->name + "/sparse/indices";
+
+        sparse->indices =
+            use32bitIndices
+                ? contiguousAccessor(
+                      indicesName, GLTF::Accessor::Type::SCALAR,
+                      WebGL::UNSIGNED_INT, genericTarget,
+                      reinterpret_span<uint32_t>(sparse->indexData), 1)
+                : contiguousAccessor(
+                      indicesName, GLTF::Accessor::Type::SCALAR,
+                      WebGL::UNSIGNED_SHORT, genericTarget,
+                      reinterpret_span<uint16_t>(sparse->indexData), 1);
+
+        sparse->values = contiguousAccessor(
+            denseAccessor->name + "/sparse/values", denseAccessor->type,
+            componentType, genericTarget,
+            reinterpret_span<T>(sparse->valueData), dimension);
+    }
+
+    return sparse;
+}
+
+bool SparseAccessors::trySparsify(GLTF::Accessor *denseAccessor,
+                                  const gsl::span<const float> &components,
+                                  const size_t dimension,
+                                  const double maxSizeRatio) {
+    auto sparse = sparsify(denseAccessor, components, WebGL::FLOAT, dimension,
+                           maxSizeRatio);
+    if (!sparse)
+        return false;
+
+    // The dense data is not packed, so its bounds are computed now.
+    computeBounds(denseAccessor);
+
+    m_accessors[denseAccessor] = std::move(sparse);
+    return true;
+}
+
+bool SparseAccessors::trySparsify(GLTF::Accessor *denseAccessor,
+                                  const gsl::span<const byte> &elements,
+                                  const WebGL componentType,
+                                  const size_t dimension,
+                                  const double maxSizeRatio) {
+    std::unique_ptr<SparseAccessor> sparse;
+
+    switch (componentType) {
+    case WebGL::FLOAT:
+        return trySparsify(denseAccessor, reinterpret_span<float>(elements),
+                           dimension, maxSizeRatio);
+    case WebGL::BYTE:
+        sparse = sparsify(denseAccessor, reinterpret_span<int8_t>(elements),
+                          componentType, dimension, maxSizeRatio);
+        break;
+    case WebGL::SHORT:
+        sparse = sparsify(denseAccessor, reinterpret_span<int16_t>(elements),
+                          componentType, dimension, maxSizeRatio);
+        break;
+    default:
+        return false;
+    }
+
+    if (!sparse)
+        return false;
+
+    // The dense data is not packed, so its bounds are computed now.
+    computeBounds(denseAccessor);
+
+    m_accessors[denseAccessor] = std::move(sparse);
+    return true;
+}
+
+std::vector<GLTF::Accessor *> SparseAccessors::substitute(
+    const std::vector<GLTF::Accessor *> &accessors) const {
+    std::vector<GLTF::Accessor *> result;
+    result.reserve(accessors.size());
+
+    for (auto accessor : accessors) {
+        const auto it = m_accessors.find(accessor);
+        if (it == m_accessors.end()) {
+            result.emplace_back(accessor);
+        } else if (it->second->indices) {
+            result.emplace_back(it->second->indices.get());
+            result.emplace_back(it->second->values.get());
+        }
+    }
+
+    return result;
+}
+
+void SparseAccessors::finishPacking() const {
+    for (auto &pair : m_accessors) {
+        auto &sparse = *pair.second;
+
+        // The dense accessor needs some buffer view for the glTF writer,
+        // patchJSON removes the reference again. Pointing to the values
+        // makes sure that view is written.
+        if (sparse.values) {
+            sparse.denseAccessor->bufferView = sparse.values->bufferView;
+            sparse.denseAccessor->byteOffset = sparse.values->byteOffset;
+        }
+    }
+}
+
+void SparseAccessors::patchJSON(rapidjson::Document &document) const {
+    if (m_accessors.empty())
+        return;
+
+    auto &allocator = document.GetAllocator();
+
+    auto &jsonAccessors = document["accessors"];
+
+    for (auto &pair : m_accessors) {
+        auto &sparse = *pair.second;
+        auto &jsonAccessor = jsonAccessors[sparse.denseAccessor->id];
+
+        jsonAccessor.RemoveMember("bufferView");
+        jsonAccessor.RemoveMember("byteOffset");
+
+        // Without sparse data, all elements are zero.
+        if (!sparse.indices)
+            continue;
+
+        rapidjson::Value jsonIndices(rapidjson::kObjectType);
+        jsonIndices.AddMember("bufferView",
+                              addBufferView(document, sparse.indices->bufferView),
+                              allocator);
+        jsonIndices.AddMember("byteOffset", sparse.indices->byteOffset,
+                              allocator);
+        jsonIndices.AddMember("componentType",
+                              static_cast<int>(sparse.indices->componentType),
+                              allocator);
+
+        rapidjson::Value jsonValues(rapidjson::kObjectType);
+        jsonValues.AddMember("bufferView",
+                             addBufferView(document, sparse.values->bufferView),
+                             allocator);
+        jsonValues.AddMember("byteOffset", sparse.values->byteOffset,
+                             allocator);
+
+        rapidjson::Value jsonSparse(rapidjson::kObjectType);
+        jsonSparse.AddMember("count", sparse.indices->count, allocator);
+        jsonSparse.AddMember("indices", jsonIndices, allocator);
+        jsonSparse.AddMember("values", jsonValues, allocator);
+
+        jsonAccessor.AddMember("sparse", jsonSparse, allocator);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "macros.h"
+
+/**
+ * A glTF sparse accessor. The dense accessor is still created as usual (it
+ * provides the type, count, min and max), but its data is replaced by the
+ * indices and values of the non-zero elements when saving.
+ */
+struct SparseAccessor {
+    GLTF::Accessor *denseAccessor = nullptr;
+
+    // Null when all elements are zero.
+    std::unique_ptr<GLTF::Accessor> indices;
+    std::unique_ptr<GLTF::Accessor> values;
+
+    std::vector<byte> indexData;
+    std::vector<byte> valueData;
+};
+
+/**
+ * Keeps track of the sparse accessors of the asset.
+ * The COLLADA2GLTF object model doesn't know about sparse accessors, so
+ * these are packed instead of their dense accessors, and the JSON is patched
+ * after it is written.
+ */
+class SparseAccessors {
+  public:
+    SparseAccessors();
+    ~SparseAccessors();
+
+    /** Converts the dense float accessor to a sparse one if the sparse form
+     * takes at most maxSizeRatio of the dense byte size. Returns true if the
+     * accessor was made sparse. */
+    bool trySparsify(GLTF::Accessor *denseAccessor,
+                     const gsl::span<const float> &components, size_t dimension,
+                     double maxSizeRatio);
+
+    /** Same for the encoded elements of a quantized accessor, e.g. of
+     * normalized int16 morph target deltas */
+    bool trySparsify(GLTF::Accessor *denseAccessor,
+                     const gsl::span<const byte> &elements,
+                     GLTF::Constants::WebGL componentType, size_t dimension,
+                     double maxSizeRatio);
+
+    bool empty() const { return m_accessors.empty(); }
+
+    /** Replaces the dense accessors of sparse accessors by their indices and
+     * values accessors, so that only these get packed */
+    std::vector<GLTF::Accessor *>
+    substitute(const std::vector<GLTF::Accessor *> &accessors) const;
+
+    /** Must be called after packing, before the JSON is written */
+    void finishPacking() const;
+
+    /** Adds the sparse members and missing buffer views to the glTF JSON */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(SparseAccessors);
+
+    std::map<const GLTF::Accessor *, std::unique_ptr<SparseAccessor>>
+        m_accessors;
+};
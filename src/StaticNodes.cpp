@@ -0,0 +1,75 @@
+#include "externals.h"
+
+#include "ExportableMesh.h"
+#include "ExportableNode.h"
+#include "MayaUtils.h"
+#include "StaticNodes.h"
+
+// The plugs that affect the matrix of a transform.
+static const char *transformPlugNames[] = {"translate",
+                                           "rotate",
+                                           "scale",
+                                           "shear",
+                                           "rotateOrder",
+                                           "rotateAxis",
+                                           "rotatePivot",
+                                           "scalePivot",
+                                           "rotatePivotTranslate",
+                                           "scalePivotTranslate",
+                                           "inheritsTransform",
+                                           "offsetParentMatrix"};
+
+static bool isStaticDagNode(const MDagPath &dagPath) {
+    MStatus status;
+
+    const auto obj = dagPath.node(&status);
+    THROW_ON_FAILURE(status);
+
+    // Shapes don't have a transform of their own.
+    if (!obj.hasFn(MFn::kTransform))
+        return true;
+
+    MFnDependencyNode fnNode(obj, &status);
+    THROW_ON_FAILURE(status);
+
+    // Joints can be moved by IK, and plugin transforms can compute anything.
+    if (obj.hasFn(MFn::kJoint) || fnNode.typeName() != "transform")
+        return false;
+
+    if (MAnimUtil::isAnimated(obj, false, &status) || !status)
+        return false;
+
+    for (auto plugName : transformPlugNames) {
+        const auto plug = fnNode.findPlug(plugName, true, &status);
+        if (status && utils::hasInputConnection(plug))
+            return false;
+    }
+
+    return true;
+}
+
+bool isProvablyStatic(const ExportableNode &node) {
+    MStatus status;
+
+    const auto *mesh = node.mesh();
+    if (mesh && mesh->blendShapeCount() > 0)
+        return false;
+
+    // The local transform is relative to the glTF parent, so all Maya
+    // transforms in between must be static too.
+    const auto parentDagPath = node.parentDagPath();
+    auto dagPath = node.dagPath;
+
+    while (dagPath.length() > 0) {
+        if (node.parentNode && dagPath == parentDagPath)
+            return true;
+
+        if (!isStaticDagNode(dagPath))
+            return false;
+
+        THROW_ON_FAILURE(dagPath.pop());
+    }
+
+    // A logical parent that is not a Maya ancestor can move on its own.
+    return node.parentNode == nullptr;
+}
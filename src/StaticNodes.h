@@ -0,0 +1,15 @@
+#pragma once
+
+class ExportableNode;
+
+/**
+ * Is the local transform of the node provably the same at all times?
+ *
+ * This is conservative: the node, and the Maya ancestors up to its glTF
+ * parent, must be plain transforms without anim curves and without any input
+ * connection to a plug that affects their matrix. That rules out
+ * constraints, expressions, driven keys and rigs. Joints are never
+ * considered static, since IK solvers move them without connections. Nodes
+ * with blend shapes are not static either.
+ */
+bool isProvablyStatic(const ExportableNode &node);
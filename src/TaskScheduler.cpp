@@ -0,0 +1,179 @@
+#include "externals.h"
+
+#include "TaskScheduler.h"
+#include "parallel.h"
+
+// The index of the worker running on this thread, none on other threads.
+static const size_t noWorkerIndex = ~size_t(0);
+static thread_local size_t currentWorkerIndex = noWorkerIndex;
+
+static std::unique_ptr<TaskScheduler> sharedScheduler;
+
+TaskScheduler &TaskScheduler::instance() {
+    if (!sharedScheduler) {
+        // The calling thread also works, while it waits.
+        sharedScheduler.reset(new TaskScheduler(parallelThreadCount() - 1));
+    }
+    return *sharedScheduler;
+}
+
+void TaskScheduler::shutdown() { sharedScheduler.reset(); }
+
+TaskScheduler::TaskScheduler(const size_t workerCount) : m_mainThreadId(std::this_thread::get_id()) {
+    m_workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(std::make_unique<Worker>());
+    }
+
+    m_threads.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_threads.emplace_back(&TaskScheduler::work, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_isStopping = true;
+    }
+
+    m_taskAvailable.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::submit(Task task) {
+    if (m_workers.empty()) {
+        task();
+        return;
+    }
+
+    // Workers push to their own queue, so nested tasks stay local.
+    const auto workerIndex =
+        currentWorkerIndex != noWorkerIndex ? currentWorkerIndex : m_nextWorkerIndex++ % m_workers.size();
+
+    auto &worker = *m_workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.emplace_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        ++m_queuedTaskCount;
+    }
+
+    m_taskAvailable.notify_one();
+}
+
+void TaskScheduler::submitToMainThread(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_mainThreadTasks.emplace_back(std::move(task));
+    }
+
+    m_waitersNotified.notify_all();
+}
+
+size_t TaskScheduler::runMainThreadTasks() {
+    if (!isMainThread())
+        return 0;
+
+    size_t taskCount = 0;
+
+    for (;;) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            if (m_mainThreadTasks.empty())
+                return taskCount;
+
+            task = std::move(m_mainThreadTasks.front());
+            m_mainThreadTasks.pop_front();
+        }
+
+        task();
+        ++taskCount;
+    }
+}
+
+void TaskScheduler::waitUntil(const std::function<bool()> &isDone) {
+    const auto isMain = isMainThread();
+
+    for (;;) {
+        if (isMain) {
+            runMainThreadTasks();
+        }
+
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_waitersNotified.wait(lock, [&] { return isDone() || (isMain && !m_mainThreadTasks.empty()); });
+
+        if (isDone())
+            return;
+    }
+}
+
+void TaskScheduler::notifyWaiters() {
+    {
+        // Orders the change of the waited state before the notification.
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+    }
+
+    m_waitersNotified.notify_all();
+}
+
+bool TaskScheduler::tryPop(const size_t workerIndex, Task &task) {
+    {
+        // The most recent task of its own is the most likely in the cache.
+        auto &worker = *m_workers[workerIndex];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker.
+    for (size_t offset = 1; offset < m_workers.size(); ++offset) {
+        auto &victim = *m_workers[(workerIndex + offset) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskScheduler::work(const size_t workerIndex) {
+    currentWorkerIndex = workerIndex;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_taskAvailable.wait(lock, [this] { return m_isStopping || m_queuedTaskCount > 0; });
+
+            if (m_queuedTaskCount == 0)
+                return;
+
+            // Claims one of the queued tasks, found below.
+            --m_queuedTaskCount;
+        }
+
+        Task task;
+        while (!tryPop(workerIndex, task)) {
+            std::this_thread::yield();
+        }
+
+        try {
+            task();
+        } catch (...) {
+            // The tasks report their own errors, see parallelFor and AsyncFileWriter.
+        }
+    }
+}
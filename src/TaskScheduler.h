@@ -0,0 +1,77 @@
+#pragma once
+
+#include "macros.h"
+
+/**
+ * The threads of the exporter. Pure compute tasks run on a shared pool of
+ * worker threads, that each keep a queue of tasks and steal from the others
+ * when theirs is empty. Tasks that call into the Maya API, which is not
+ * thread-safe, are queued for the main thread instead, which runs them
+ * while it waits, and when ExportableAsset drives the queue between its
+ * stages.
+ *
+ * The pool is created on first use, from the main thread, and stopped when
+ * the plugin is unloaded.
+ */
+class TaskScheduler {
+  public:
+    typedef std::function<void()> Task;
+
+    static TaskScheduler &instance();
+
+    /** Stops the worker threads, if these were started */
+    static void shutdown();
+
+    ~TaskScheduler();
+
+    size_t workerCount() const { return m_workers.size(); }
+
+    bool isMainThread() const { return std::this_thread::get_id() == m_mainThreadId; }
+
+    /** Runs a task that must NOT call into the Maya API on a worker thread.
+     * Tasks should not throw, these are not joined, see waitUntil. */
+    void submit(Task task);
+
+    /** Runs a task on the main thread, the next time it waits or drives the
+     * main thread queue */
+    void submitToMainThread(Task task);
+
+    /** Runs the queued main thread tasks, returns how many. Does nothing
+     * when not called on the main thread. */
+    size_t runMainThreadTasks();
+
+    /** Blocks until isDone returns true, running the main thread tasks
+     * meanwhile when called on the main thread. The tasks that change what
+     * isDone checks must call notifyWaiters afterwards. */
+    void waitUntil(const std::function<bool()> &isDone);
+
+    void notifyWaiters();
+
+  private:
+    explicit TaskScheduler(size_t workerCount);
+    DISALLOW_COPY_MOVE_ASSIGN(TaskScheduler);
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool tryPop(size_t workerIndex, Task &task);
+    void work(size_t workerIndex);
+
+    const std::thread::id m_mainThreadId;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_nextWorkerIndex{0};
+
+    // The workers sleep when no task is queued.
+    std::mutex m_sleepMutex;
+    std::condition_variable m_taskAvailable;
+    size_t m_queuedTaskCount = 0;
+    bool m_isStopping = false;
+
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitersNotified;
+    std::deque<Task> m_mainThreadTasks;
+};
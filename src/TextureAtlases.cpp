@@ -0,0 +1,335 @@
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Digester.h"
+#include "ExportableMaterial.h"
+#include "ExportableResources.h"
+#include "TextureAtlases.h"
+#include "jsonPatch.h"
+
+using GLTF::Constants::WebGL;
+
+// The copies of the border pixels around each image in an atlas.
+const unsigned atlasPadding = 4;
+
+TextureAtlases::TextureAtlases() = default;
+
+TextureAtlases::~TextureAtlases() = default;
+
+/** Are all texture coordinates of the accessor in [0,1]? Quantized ones are
+ * normalized, so these always are. */
+static bool isInUnitRange(const GLTF::Accessor *accessor) {
+    if (accessor->componentType == WebGL::UNSIGNED_SHORT || accessor->componentType == WebGL::UNSIGNED_BYTE)
+        return true;
+
+    const auto view = accessor->bufferView;
+    if (accessor->componentType != WebGL::FLOAT || !view || !view->buffer->data)
+        return false;
+
+    const auto elementByteLength = size_t(accessor->getNumberOfComponents()) * sizeof(float);
+    const auto byteStride = view->byteStride > 0 ? size_t(view->byteStride) : elementByteLength;
+    const auto *elements = view->buffer->data + view->byteOffset + accessor->byteOffset;
+
+    for (int i = 0; i < accessor->count; ++i) {
+        float uv[2];
+        std::memcpy(uv, elements + i * byteStride, sizeof(uv));
+        if (uv[0] < 0 || uv[0] > 1 || uv[1] < 0 || uv[1] > 1)
+            return false;
+    }
+
+    return true;
+}
+
+static unsigned nextPowerOfTwo(const unsigned value) {
+    unsigned power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+void TextureAtlases::build(ExportableResources &resources, const std::vector<GLTF::Mesh *> &meshes,
+                           const std::vector<ExportableMaterial *> &materials, const fs::path &folder) {
+    const auto atlasSize = static_cast<unsigned>(resources.arguments().textureAtlasSize);
+    const auto maxImageSize = atlasSize / 4;
+
+    // Per material and texture coordinate set, are all the coordinates of
+    // its primitives in [0,1]?
+    std::map<std::pair<const GLTF::Material *, int>, bool> unitRanges;
+    for (auto *mesh : meshes) {
+        for (auto *primitive : mesh->primitives) {
+            if (!primitive->material)
+                continue;
+
+            for (auto &&attribute : primitive->attributes) {
+                if (attribute.first.compare(0, 9, "TEXCOORD_") != 0)
+                    continue;
+
+                const auto set = std::stoi(attribute.first.substr(9));
+                auto &isInRange = unitRanges.emplace(std::make_pair(primitive->material, set), true).first->second;
+                isInRange = isInRange && isInUnitRange(attribute.second);
+            }
+        }
+    }
+
+    struct Tile {
+        GLTF::Image *image;
+        fs::path path;
+        unsigned width;
+        unsigned height;
+        bool isJPEG;
+
+        // The pixel of the image at the bottom left in MImage order.
+        unsigned x = 0;
+        unsigned y = 0;
+        int atlasIndex = -1;
+    };
+
+    struct Group {
+        std::vector<Tile> tiles;
+        std::map<GLTF::Image *, size_t> tileIndices;
+        std::vector<std::pair<ExportableMaterial *, ExportableMaterial::TextureInfo>> infos;
+    };
+
+    std::map<std::pair<ImageSlot, GLTF::Sampler *>, Group> groups;
+
+    for (auto *material : materials) {
+        for (auto &&info : material->textureInfos()) {
+            auto *texture = info.texture->texture;
+            auto *image = texture->source;
+            if (!image)
+                continue;
+
+            const auto range = unitRanges.find(std::make_pair(material->glMaterial(), std::max(0, info.texture->texCoord)));
+            if (range == unitRanges.end() || !range->second)
+                continue;
+
+            const auto *header = resources.getImageHeader(image);
+            const auto path = resources.getImageSourcePath(image);
+            if (!header || path.empty() || header->width > maxImageSize || header->height > maxImageSize)
+                continue;
+
+            auto &group = groups[std::make_pair(info.slot, texture->sampler)];
+            if (group.tileIndices.emplace(image, group.tiles.size()).second) {
+                group.tiles.push_back({image, path, header->width, header->height, header->mimeType == "image/jpeg"});
+            }
+            group.infos.emplace_back(material, info);
+        }
+    }
+
+    for (auto &&pair : groups) {
+        auto &group = pair.second;
+        auto &tiles = group.tiles;
+
+        // A single image gains nothing.
+        if (tiles.size() < 2)
+            continue;
+
+        // The images are placed on shelves, from the highest to the lowest.
+        std::vector<size_t> order(tiles.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+            return tiles[a].height > tiles[b].height;
+        });
+
+        struct Atlas {
+            unsigned width = 0;
+            unsigned height = 0;
+            std::vector<size_t> tileIndices;
+        };
+        std::vector<Atlas> atlases;
+
+        unsigned shelfX = 0;
+        unsigned shelfY = 0;
+        unsigned shelfHeight = 0;
+
+        for (auto index : order) {
+            auto &tile = tiles[index];
+            const auto paddedWidth = tile.width + 2 * atlasPadding;
+            const auto paddedHeight = tile.height + 2 * atlasPadding;
+
+            if (!atlases.empty() && shelfX + paddedWidth > atlasSize) {
+                shelfX = 0;
+                shelfY += shelfHeight;
+                shelfHeight = 0;
+            }
+
+            if (atlases.empty() || shelfY + paddedHeight > atlasSize) {
+                atlases.emplace_back();
+                shelfX = 0;
+                shelfY = 0;
+                shelfHeight = 0;
+            }
+
+            auto &atlas = atlases.back();
+            tile.x = shelfX + atlasPadding;
+            tile.y = shelfY + atlasPadding;
+            tile.atlasIndex = static_cast<int>(atlases.size() - 1);
+            atlas.tileIndices.push_back(index);
+
+            shelfX += paddedWidth;
+            shelfHeight = std::max(shelfHeight, paddedHeight);
+            atlas.width = std::max(atlas.width, shelfX);
+            atlas.height = std::max(atlas.height, shelfY + shelfHeight);
+        }
+
+        const auto slot = pair.first.first;
+        const auto sampler = pair.first.second;
+        const char *slotNames[] = {"color", "normal", "orm"};
+
+        std::vector<GLTF::Texture *> atlasTextures(atlases.size());
+
+        for (size_t atlasIndex = 0; atlasIndex < atlases.size(); ++atlasIndex) {
+            auto &atlas = atlases[atlasIndex];
+            if (atlas.tileIndices.size() < 2) {
+                for (auto index : atlas.tileIndices) {
+                    tiles[index].atlasIndex = -1;
+                }
+                continue;
+            }
+
+            atlas.width = std::min(nextPowerOfTwo(atlas.width), atlasSize);
+            atlas.height = std::min(nextPowerOfTwo(atlas.height), atlasSize);
+
+            // The atlas is reused until one of its images changes.
+            Digester digester;
+            digester.add(atlas.width);
+            digester.add(atlas.height);
+            auto isJPEG = true;
+            for (auto index : atlas.tileIndices) {
+                const auto &tile = tiles[index];
+                digester.add(fs::absolute(tile.path).generic_string());
+                digester.add(static_cast<uint64_t>(fs::file_size(tile.path)));
+                digester.add(static_cast<int64_t>(fs::last_write_time(tile.path).time_since_epoch().count()));
+                digester.add(tile.x);
+                digester.add(tile.y);
+                isJPEG = isJPEG && tile.isJPEG;
+            }
+
+            const auto atlasPath = folder / digester.hexDigest().substr(0, 16) /
+                                   formatted("atlas-%s%s", slotNames[slot], isJPEG ? ".jpg" : ".png");
+
+            if (exists(atlasPath)) {
+                cout << prefix << "Using the texture atlas created before at " << atlasPath << endl;
+            } else {
+                cout << prefix << "Packing " << atlas.tileIndices.size() << " textures in a " << atlas.width << "x"
+                     << atlas.height << " atlas" << endl;
+
+                std::vector<uint8_t> pixels(size_t(atlas.width) * atlas.height * 4, 0);
+
+                for (auto index : atlas.tileIndices) {
+                    const auto &tile = tiles[index];
+
+                    MImage image;
+                    THROW_ON_FAILURE_WITH(image.readFromFile(MString(tile.path.c_str())),
+                                          formatted("Failed to read image %s", tile.path.c_str()));
+
+                    unsigned width = 0;
+                    unsigned height = 0;
+                    THROW_ON_FAILURE(image.getSize(width, height));
+                    if (width != tile.width || height != tile.height || image.pixelType() != MImage::kByte)
+                        throw std::runtime_error(formatted("Unexpected pixels in image %s", tile.path.c_str()));
+
+                    // The padding repeats the border pixels.
+                    const auto *source = image.pixels();
+                    const auto paddedWidth = int(width + 2 * atlasPadding);
+                    const auto paddedHeight = int(height + 2 * atlasPadding);
+                    for (int row = 0; row < paddedHeight; ++row) {
+                        const auto sourceRow = std::min(std::max(row - int(atlasPadding), 0), int(height) - 1);
+                        auto *target = &pixels[((size_t(tile.y) - atlasPadding + row) * atlas.width + tile.x - atlasPadding) * 4];
+                        for (int column = 0; column < paddedWidth; ++column) {
+                            const auto sourceColumn = std::min(std::max(column - int(atlasPadding), 0), int(width) - 1);
+                            std::memcpy(target + column * 4, source + (size_t(sourceRow) * width + sourceColumn) * 4, 4);
+                        }
+                    }
+                }
+
+                MImage atlasImage;
+                THROW_ON_FAILURE(atlasImage.create(atlas.width, atlas.height, 4, MImage::kByte));
+                THROW_ON_FAILURE(atlasImage.setPixels(pixels.data(), atlas.width, atlas.height));
+
+                create_directories(atlasPath.parent_path());
+
+                // Written under another name first, so an interrupted write
+                // is never reused.
+                auto tempPath = atlasPath;
+                tempPath += ".tmp";
+
+                THROW_ON_FAILURE_WITH(atlasImage.writeToFile(MString(tempPath.c_str()), isJPEG ? "jpg" : "png"),
+                                      formatted("Failed to write image %s", tempPath.c_str()));
+
+                fs::rename(tempPath, atlasPath);
+            }
+
+            if (auto *image = resources.getImage(atlasPath, slot)) {
+                atlasTextures[atlasIndex] = resources.getTexture(image, sampler);
+            }
+        }
+
+        for (auto &&materialInfo : group.infos) {
+            auto &info = materialInfo.second;
+            const auto &tile = tiles.at(group.tileIndices.at(info.texture->texture->source));
+            if (tile.atlasIndex < 0 || !atlasTextures[tile.atlasIndex])
+                continue;
+
+            // MImage rows go up, glTF texture coordinates go down.
+            const auto &atlas = atlases[tile.atlasIndex];
+            Placement placement{materialInfo.first->glMaterial(), info.member, info.isMetallicRoughnessMember};
+            placement.offset[0] = float(tile.x) / atlas.width;
+            placement.offset[1] = float(atlas.height - tile.y - tile.height) / atlas.height;
+            placement.scale[0] = float(tile.width) / atlas.width;
+            placement.scale[1] = float(tile.height) / atlas.height;
+            m_placements.push_back(placement);
+
+            info.texture->texture = atlasTextures[tile.atlasIndex];
+        }
+    }
+}
+
+void TextureAtlases::patchJSON(rapidjson::Document &document) const {
+    if (m_placements.empty() || !document.HasMember("materials"))
+        return;
+
+    auto &allocator = document.GetAllocator();
+    auto &jsonMaterials = document["materials"];
+
+    for (auto &&placement : m_placements) {
+        // A material that is not part of the asset isn't written.
+        const auto id = placement.material->id;
+        if (id < 0 || id >= static_cast<int>(jsonMaterials.Size()))
+            continue;
+
+        auto *jsonObject = &jsonMaterials[id];
+        if (placement.isMetallicRoughnessMember) {
+            if (!jsonObject->HasMember("pbrMetallicRoughness"))
+                continue;
+            jsonObject = &(*jsonObject)["pbrMetallicRoughness"];
+        }
+
+        if (!jsonObject->HasMember(placement.member))
+            continue;
+
+        auto &jsonInfo = (*jsonObject)[placement.member];
+
+        rapidjson::Value jsonOffset(rapidjson::kArrayType);
+        jsonOffset.PushBack(placement.offset[0], allocator);
+        jsonOffset.PushBack(placement.offset[1], allocator);
+
+        rapidjson::Value jsonScale(rapidjson::kArrayType);
+        jsonScale.PushBack(placement.scale[0], allocator);
+        jsonScale.PushBack(placement.scale[1], allocator);
+
+        rapidjson::Value jsonTransform(rapidjson::kObjectType);
+        jsonTransform.AddMember("offset", jsonOffset, allocator);
+        jsonTransform.AddMember("scale", jsonScale, allocator);
+
+        if (!jsonInfo.HasMember("extensions")) {
+            jsonInfo.AddMember("extensions", rapidjson::Value(rapidjson::kObjectType), allocator);
+        }
+
+        jsonInfo["extensions"].AddMember("KHR_texture_transform", jsonTransform, allocator);
+    }
+
+    // Without the transforms, the textures would show the whole atlas.
+    addExtensionUsed(document, "KHR_texture_transform", true);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "filesystem.h"
+#include "macros.h"
+
+class ExportableMaterial;
+class ExportableResources;
+
+/**
+ * Packs the small textures of the materials into atlases, see
+ * -textureAtlasSize. The textures of a slot with the same sampler share the
+ * atlases, and the texture infos that referred to these refer to an atlas
+ * instead, with a KHR_texture_transform that maps the texture coordinates to
+ * the place of the image. The COLLADA2GLTF object model doesn't know about
+ * the extension, so the JSON is patched after it is written.
+ *
+ * Outside its image, a texture would sample its neighbours in the atlas, so
+ * only the texture infos of which the primitives have all their texture
+ * coordinates in [0,1] are moved. The images are padded with copies of their
+ * border pixels, so filtering doesn't bleed either.
+ */
+class TextureAtlases {
+  public:
+    TextureAtlases();
+    ~TextureAtlases();
+
+    /** Packs the textures of the materials, as drawn by the primitives of the
+     * meshes. The atlas images are kept in the folder, and reused. */
+    void build(ExportableResources &resources, const std::vector<GLTF::Mesh *> &meshes,
+               const std::vector<ExportableMaterial *> &materials, const fs::path &folder);
+
+    bool empty() const { return m_placements.empty(); }
+
+    /** Adds the texture transforms of the texture infos moved to an atlas */
+    void patchJSON(rapidjson::Document &document) const;
+
+  private:
+    DISALLOW_COPY_MOVE_ASSIGN(TextureAtlases);
+
+    /** A texture info that refers to an atlas, and where its image is */
+    struct Placement {
+        const GLTF::Material *material;
+        const char *member;
+        bool isMetallicRoughnessMember;
+        float offset[2];
+        float scale[2];
+    };
+
+    std::vector<Placement> m_placements;
+};
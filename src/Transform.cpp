@@ -2,6 +2,7 @@
 
 #include "ExportableNode.h"
 #include "MayaException.h"
+#include "MayaUtils.h"
 #include "Transform.h"
 
 const double epsilon = 1e-4f;
@@ -28,27 +29,30 @@ double getAxesNonOrthogonality(const MMatrix &m) {
 void getTranslation(const MTransformationMatrix &m, float *result,
                     double scaleFactor) {
     const MVector t = m.getTranslation(MSpace::kPostTransform);
-    result[0] = roundToFloat(t.x * scaleFactor, posPrecision);
-    result[1] = roundToFloat(t.y * scaleFactor, posPrecision);
-    result[2] = roundToFloat(t.z * scaleFactor, posPrecision);
+    const auto &grid = currentRoundingGrids().position;
+    result[0] = roundToFloat(t.x * scaleFactor, grid);
+    result[1] = roundToFloat(t.y * scaleFactor, grid);
+    result[2] = roundToFloat(t.z * scaleFactor, grid);
 }
 
 void getScaling(const MTransformationMatrix &m, float *result) {
     double s[3];
     THROW_ON_FAILURE(m.getScale(s, MSpace::kPostTransform));
-    result[0] = roundToFloat(s[0], sclPrecision);
-    result[1] = roundToFloat(s[1], sclPrecision);
-    result[2] = roundToFloat(s[2], sclPrecision);
+    const auto &grid = currentRoundingGrids().scale;
+    result[0] = roundToFloat(s[0], grid);
+    result[1] = roundToFloat(s[1], grid);
+    result[2] = roundToFloat(s[2], grid);
 }
 
 void getRotation(const MTransformationMatrix &m, float *result) {
     double q[4];
     THROW_ON_FAILURE(m.getRotationQuaternion(q[0], q[1], q[2], q[3]));
 
-    q[0] = roundTo(q[0], dirPrecision);
-    q[1] = roundTo(q[1], dirPrecision);
-    q[2] = roundTo(q[2], dirPrecision);
-    q[3] = roundTo(q[3], dirPrecision);
+    const auto &grid = currentRoundingGrids().direction;
+    q[0] = roundTo(q[0], grid);
+    q[1] = roundTo(q[1], grid);
+    q[2] = roundTo(q[2], grid);
+    q[3] = roundTo(q[3], grid);
 
     MQuaternion mq(q);
     mq.normalizeIt();
@@ -71,13 +75,16 @@ GLTF::Node::TransformMatrix toGLTF(const MMatrix &matrix) {
 }
 
 MMatrix getObjectSpaceMatrix(const MDagPath &dagPath,
-                             const MDagPath &parentPath) {
+                             const MDagPath &parentPath,
+                             const bool isContextEvaluated) {
     MStatus status;
 
     MFnDagNode fnDagNode(dagPath, &status);
     THROW_ON_FAILURE(status);
 
-    const auto childWorldMatrix = dagPath.inclusiveMatrix(&status);
+    const auto childWorldMatrix = isContextEvaluated
+                                      ? utils::getWorldMatrix(dagPath)
+                                      : dagPath.inclusiveMatrix(&status);
     THROW_ON_FAILURE(status);
 
     const auto parentPathLength = parentPath.length(&status);
@@ -87,12 +94,99 @@ MMatrix getObjectSpaceMatrix(const MDagPath &dagPath,
         return childWorldMatrix;
 
     const auto parentWorldMatrixInverse =
-        parentPath.inclusiveMatrixInverse(&status);
+        isContextEvaluated ? utils::getWorldMatrix(parentPath).inverse()
+                           : parentPath.inclusiveMatrixInverse(&status);
     THROW_ON_FAILURE(status);
 
     return childWorldMatrix * parentWorldMatrixInverse;
 }
 
+// Decomposes the matrix with MTransformationMatrix
+static void getMayaTransform(const MMatrix &matrix, const double scaleFactor,
+                             GLTF::Node::TransformTRS &trs) {
+    // TODO: We're not using the GLTF code here yet, we got
+    // non-normalized rotations...
+    MTransformationMatrix mayaMatrix(matrix);
+
+    getTranslation(mayaMatrix, trs.translation, scaleFactor);
+    getRotation(mayaMatrix, trs.rotation);
+    getScaling(mayaMatrix, trs.scale);
+}
+
+// Rounds the decomposition of the kernel like the Maya decomposition
+static void getDecomposedTransform(const kernels::DecomposedTransform &d,
+                                   const double scaleFactor,
+                                   GLTF::Node::TransformTRS &trs) {
+    const auto &grids = currentRoundingGrids();
+
+    for (int i = 0; i < 3; ++i) {
+        trs.translation[i] =
+            roundToFloat(d.translation[i] * scaleFactor, grids.position);
+        trs.scale[i] = roundToFloat(d.scale[i], grids.scale);
+    }
+
+    double q[4];
+    double length = 0;
+    for (int i = 0; i < 4; ++i) {
+        q[i] = roundTo(d.rotation[i], grids.direction);
+        length += q[i] * q[i];
+    }
+
+    length = sqrt(length);
+    for (int i = 0; i < 4; ++i) {
+        trs.rotation[i] = static_cast<float>(q[i] / length);
+    }
+}
+
+#ifndef NDEBUG
+// Does the decomposition of the kernel match the Maya decomposition?
+static bool matchesMayaTransform(const MMatrix &matrix,
+                                 const double scaleFactor,
+                                 const GLTF::Node::TransformTRS &trs) {
+    GLTF::Node::TransformTRS mayaTRS;
+    getMayaTransform(matrix, scaleFactor, mayaTRS);
+
+    const auto tolerance = 1e-4f;
+    for (int i = 0; i < 3; ++i) {
+        if (std::abs(trs.translation[i] - mayaTRS.translation[i]) >
+                tolerance * std::max(1.0f, std::abs(mayaTRS.translation[i])) ||
+            std::abs(trs.scale[i] - mayaTRS.scale[i]) > tolerance)
+            return false;
+    }
+
+    // q and -q are the same rotation.
+    float dp = 0;
+    float dn = 0;
+    for (int i = 0; i < 4; ++i) {
+        dp = std::max(dp, std::abs(trs.rotation[i] - mayaTRS.rotation[i]));
+        dn = std::max(dn, std::abs(trs.rotation[i] + mayaTRS.rotation[i]));
+    }
+
+    return std::min(dp, dn) <= tolerance;
+}
+#endif
+
+// Uses the decomposition of the kernel, or Maya when the kernel leaves
+// the matrix to the caller, like the mirrored matrices.
+static void decompose(const MMatrix &matrix,
+                      const kernels::DecomposedTransform &decomposed,
+                      const double scaleFactor,
+                      GLTF::Node::TransformTRS &trs) {
+    if (decomposed.isDecomposed) {
+        getDecomposedTransform(decomposed, scaleFactor, trs);
+        assert(matchesMayaTransform(matrix, scaleFactor, trs));
+    } else {
+        getMayaTransform(matrix, scaleFactor, trs);
+    }
+}
+
+void getSimpleTransform(const MMatrix &localMatrix, const double scaleFactor,
+                        GLTF::Node::TransformTRS &trs) {
+    kernels::DecomposedTransform decomposed;
+    kernels::decomposeTransforms(&localMatrix.matrix[0][0], 1, &decomposed);
+    decompose(localMatrix, decomposed, scaleFactor, trs);
+}
+
 void makeIdentity(GLTF::Node::TransformTRS &trs) {
     trs.translation[0] = 0;
     trs.translation[1] = 0;
@@ -108,10 +202,135 @@ void makeIdentity(GLTF::Node::TransformTRS &trs) {
     trs.rotation[3] = 1;
 }
 
+void NodeTransformCache::reset() {
+    if (++m_stamp == 0) {
+        // Wrapped around, make sure no old state looks valid.
+        std::fill(m_stamps.begin(), m_stamps.end(), 0);
+        m_stamp = 1;
+    }
+}
+
+NodeTransformState &
+NodeTransformCache::stateOf(const ExportableNode *node) {
+    if (!node)
+        return m_worldState;
+
+    const auto index = node->transformIndex;
+
+    // Nodes are created while loading the scene, so grow on demand.
+    if (index >= m_states.size()) {
+        m_states.resize(index + 1);
+        m_stamps.resize(index + 1, 0);
+    }
+
+    auto &state = m_states[index];
+
+    if (m_stamps[index] != m_stamp) {
+        m_stamps[index] = m_stamp;
+        state.isInitialized = 0;
+    }
+
+    return state;
+}
+
+MMatrix NodeTransformCache::matrixToDecompose(const ExportableNode *node) {
+    const auto localMatrix = getObjectSpaceMatrix(
+        node->dagPath, node->parentDagPath(), m_isContextEvaluated);
+
+    switch (node->transformKind) {
+    case TransformKind::Simple:
+    case TransformKind::ComplexJoint:
+        return localMatrix;
+
+    case TransformKind::ComplexTransform: {
+        MTransformationMatrix pivotTransformationMatrix;
+        const MVector pivotOffset = node->pivotPoint - MPoint::origin;
+        pivotTransformationMatrix.setTranslation(pivotOffset, MSpace::kObject);
+        const auto pivotMatrix = pivotTransformationMatrix.asMatrix();
+
+        // Decompose localMatrix into inverse(pivotMatrix) * innerMatrix *
+        // pivotMatrix Since we combine the pivot translation and local
+        // translation, this becomes localMatrix = inverse(pivotMatrix) *
+        // combinedMatrix
+        // => combinedMatrix = pivotMatrix * localMatrix
+        return pivotMatrix * localMatrix;
+    }
+
+    default:
+        throw std::runtime_error("Unsupported node transform kind");
+    }
+}
+
+void NodeTransformCache::setDecomposedState(
+    const ExportableNode *node, const MMatrix &matrix,
+    const kernels::DecomposedTransform &decomposed, const double scaleFactor,
+    NodeTransformState &state) {
+    assert(node->transformKind != TransformKind::ComplexJoint);
+
+    auto &trs0 = state.localTransforms[0];
+    makeIdentity(trs0);
+
+    auto &trs1 = state.localTransforms[1];
+    makeIdentity(trs1);
+
+    state.requiresExtraNode = node->transformKind != TransformKind::Simple;
+    state.maxNonOrthogonality =
+        m_checkSkewing ? decomposed.nonOrthogonality : 0;
+
+    if (node->transformKind == TransformKind::Simple) {
+        decompose(matrix, decomposed, scaleFactor, trs0);
+    } else {
+        // Inverse pivot translation node
+        const MVector pivotOffset = node->pivotPoint - MPoint::origin;
+        const auto &grid = currentRoundingGrids().position;
+        trs0.translation[0] = roundToFloat(-pivotOffset.x * scaleFactor, grid);
+        trs0.translation[1] = roundToFloat(-pivotOffset.y * scaleFactor, grid);
+        trs0.translation[2] = roundToFloat(-pivotOffset.z * scaleFactor, grid);
+
+        // trs1: scale, rotation and translation + pivot-offset combined
+        decompose(matrix, decomposed, scaleFactor, trs1);
+    }
+
+    state.isInitialized = 1;
+}
+
+void NodeTransformCache::decomposeAll(
+    const std::vector<const ExportableNode *> &nodes,
+    const double scaleFactor) {
+    m_batchNodes.clear();
+    m_batchMatrices.clear();
+
+    for (auto *node : nodes) {
+        // A joint with segment scale compensation needs the scale of its
+        // parent, so is left to getTransform.
+        if (node->transformKind == TransformKind::ComplexJoint ||
+            stateOf(node).isInitialized != 0)
+            continue;
+
+        const auto matrix = matrixToDecompose(node);
+        m_batchMatrices.insert(m_batchMatrices.end(), &matrix.matrix[0][0],
+                               &matrix.matrix[0][0] + 16);
+        m_batchNodes.push_back(node);
+    }
+
+    const auto count = m_batchNodes.size();
+    m_batchResults.resize(count);
+    kernels::decomposeTransforms(m_batchMatrices.data(), count,
+                                 m_batchResults.data());
+
+    for (size_t index = 0; index < count; ++index) {
+        const auto *node = m_batchNodes[index];
+        const MMatrix matrix(reinterpret_cast<const double(*)[4]>(
+            &m_batchMatrices[index * 16]));
+        setDecomposedState(node, matrix, m_batchResults[index], scaleFactor,
+                           stateOf(node));
+    }
+}
+
 const NodeTransformState &
 NodeTransformCache::getTransform(const ExportableNode *node,
                                  const double scaleFactor) {
-    auto &state = m_table[node];
+    auto &state = stateOf(node);
 
     if (state.isInitialized > 0)
         return state;
@@ -122,122 +341,72 @@ NodeTransformCache::getTransform(const ExportableNode *node,
 
     state.isInitialized = -1;
 
-    auto &trs0 = state.localTransforms[0];
-    makeIdentity(trs0);
-
-    auto &trs1 = state.localTransforms[1];
-    makeIdentity(trs1);
-
     if (node == nullptr) {
         // World
+        makeIdentity(state.localTransforms[0]);
+        makeIdentity(state.localTransforms[1]);
         state.requiresExtraNode = false;
         state.maxNonOrthogonality = 0;
+    } else if (node->transformKind == TransformKind::ComplexJoint) {
+        auto &trs0 = state.localTransforms[0];
+        makeIdentity(trs0);
+
+        auto &trs1 = state.localTransforms[1];
+        makeIdentity(trs1);
+
+        state.requiresExtraNode = true;
+
+        auto &parentTransform = getTransform(node->parentNode, scaleFactor);
+        auto &parentPrimaryTRS = parentTransform.primaryTRS();
+        double parentScale[3] = {parentPrimaryTRS.scale[0],
+                                 parentPrimaryTRS.scale[1],
+                                 parentPrimaryTRS.scale[2]};
+
+        // The local matrix = scale * rotation * inverse-parent-scale *
+        // translation Extract and clear the translation, undo  the inverse
+        // parent scale, and extract rotation and scale.
+        auto m = matrixToDecompose(node);
+
+        // Get translation
+        const auto t = m[3];
+        const auto &grids = currentRoundingGrids();
+        trs1.translation[0] = roundToFloat(t[0] * scaleFactor, grids.position);
+        trs1.translation[1] = roundToFloat(t[1] * scaleFactor, grids.position);
+        trs1.translation[2] = roundToFloat(t[2] * scaleFactor, grids.position);
+
+        trs1.scale[0] =
+            roundToFloat(1.0f / parentPrimaryTRS.scale[0], grids.scale);
+        trs1.scale[1] =
+            roundToFloat(1.0f / parentPrimaryTRS.scale[1], grids.scale);
+        trs1.scale[2] =
+            roundToFloat(1.0f / parentPrimaryTRS.scale[2], grids.scale);
+
+        // Clear translation
+        t[0] = t[1] = t[2] = 0;
+
+        // Undo the inverse parent transform
+        double ps[4][4] = {{parentScale[0], 0, 0, 0},
+                           {0, parentScale[1], 0, 0},
+                           {0, 0, parentScale[2], 0},
+                           {0, 0, 0, 1}};
+
+        m = m * ps;
+
+        kernels::DecomposedTransform decomposed;
+        kernels::decomposeTransforms(&m.matrix[0][0], 1, &decomposed);
+
+        state.maxNonOrthogonality =
+            m_checkSkewing ? decomposed.nonOrthogonality : 0;
+
+        // The translation is cleared, so only sets the rotation and scale.
+        decompose(m, decomposed, scaleFactor, trs0);
     } else {
-        state.requiresExtraNode = node->transformKind != TransformKind::Simple;
-
-        const auto localMatrix =
-            getObjectSpaceMatrix(node->dagPath, node->parentDagPath());
-
-        switch (node->transformKind) {
-        case TransformKind::Simple: {
-            state.maxNonOrthogonality = getAxesNonOrthogonality(localMatrix);
-
-            // TODO: We're not using the GLTF code here yet, we got
-            // non-normalized rotations...
-            MTransformationMatrix mayaLocalMatrix(localMatrix);
-
-            auto &trs = state.localTransforms[0];
-
-            getTranslation(mayaLocalMatrix, trs.translation, scaleFactor);
-            getRotation(mayaLocalMatrix, trs.rotation);
-            getScaling(mayaLocalMatrix, trs.scale);
-        } break;
-
-        case TransformKind::ComplexJoint: {
-            auto &parentTransform = getTransform(node->parentNode, scaleFactor);
-            auto &parentPrimaryTRS = parentTransform.primaryTRS();
-            double parentScale[3] = {parentPrimaryTRS.scale[0],
-                                     parentPrimaryTRS.scale[1],
-                                     parentPrimaryTRS.scale[2]};
-
-            // The local matrix = scale * rotation * inverse-parent-scale *
-            // translation Extract and clear the translation, undo  the inverse
-            // parent scale, and extract rotation and scale.
-            auto m = localMatrix;
-
-            // Get translation
-            const auto t = m[3];
-            trs1.translation[0] =
-                roundToFloat(t[0] * scaleFactor, posPrecision);
-            trs1.translation[1] =
-                roundToFloat(t[1] * scaleFactor, posPrecision);
-            trs1.translation[2] =
-                roundToFloat(t[2] * scaleFactor, posPrecision);
-
-            trs1.scale[0] =
-                roundToFloat(1.0f / parentPrimaryTRS.scale[0], sclPrecision);
-            trs1.scale[1] =
-                roundToFloat(1.0f / parentPrimaryTRS.scale[1], sclPrecision);
-            trs1.scale[2] =
-                roundToFloat(1.0f / parentPrimaryTRS.scale[2], sclPrecision);
-
-            // Clear translation
-            t[0] = t[1] = t[2] = 0;
-
-            // Undo the inverse parent transform
-            double ps[4][4] = {{parentScale[0], 0, 0, 0},
-                               {0, parentScale[1], 0, 0},
-                               {0, 0, parentScale[2], 0},
-                               {0, 0, 0, 1}};
-
-            m = m * ps;
-
-            state.maxNonOrthogonality = getAxesNonOrthogonality(m);
-
-            const MTransformationMatrix mayaLocalMatrix(m);
-            getRotation(mayaLocalMatrix, trs0.rotation);
-            getScaling(mayaLocalMatrix, trs0.scale);
-        } break;
-
-        case TransformKind::ComplexTransform: {
-            MTransformationMatrix pivotTransformationMatrix;
-            const MVector pivotOffset = node->pivotPoint - MPoint::origin;
-            pivotTransformationMatrix.setTranslation(pivotOffset,
-                                                     MSpace::kObject);
-            const auto pivotMatrix = pivotTransformationMatrix.asMatrix();
-
-            // cout << "local matrix = " << localMatrix << endl;
-
-            // Decompose localMatrix into inverse(pivotMatrix) * innerMatrix *
-            // pivotMatrix Since we combine the pivot translation and local
-            // translation, this becomes localMatrix = inverse(pivotMatrix) *
-            // combinedMatrix
-            // => combinedMatrix = pivotMatrix * localMatrix
-            const auto combinedMatrix = pivotMatrix * localMatrix;
-
-            state.maxNonOrthogonality = getAxesNonOrthogonality(combinedMatrix);
-
-            // Inverse pivot translation node
-            trs0.translation[0] =
-                roundToFloat(-pivotOffset.x * scaleFactor, posPrecision);
-            trs0.translation[1] =
-                roundToFloat(-pivotOffset.y * scaleFactor, posPrecision);
-            trs0.translation[2] =
-                roundToFloat(-pivotOffset.z * scaleFactor, posPrecision);
-
-            // TODO: We're not using the GLTF code here yet, we got
-            // non-normalized rotations...
-            const MTransformationMatrix mayaMatrix(combinedMatrix);
-
-            // trs1: scale, rotation and translation + pivot-offset combined
-            getTranslation(mayaMatrix, trs1.translation, scaleFactor);
-            getRotation(mayaMatrix, trs1.rotation);
-            getScaling(mayaMatrix, trs1.scale);
-        } break;
-
-        default:
-            throw std::runtime_error("Unsupported node transform kind");
-        }
+        const auto matrix = matrixToDecompose(node);
+
+        kernels::DecomposedTransform decomposed;
+        kernels::decomposeTransforms(&matrix.matrix[0][0], 1, &decomposed);
+
+        setDecomposedState(node, matrix, decomposed, scaleFactor, state);
     }
 
     state.isInitialized = 1;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "kernels.h"
+
 const double MAX_NON_ORTHOGONALITY = 1e-4f;
 
 // How much the axes deviate from being orthogonal
@@ -7,6 +9,10 @@ double getAxesNonOrthogonality(const MMatrix &m);
 
 void makeIdentity(GLTF::Node::TransformTRS &trs);
 
+// Decomposes the local matrix of a simple transform into a single glTF TRS
+void getSimpleTransform(const MMatrix &localMatrix, double scaleFactor,
+                        GLTF::Node::TransformTRS &trs);
+
 class ExportableNode;
 
 /*
@@ -89,16 +95,69 @@ class NodeTransformState {
     int isInitialized = 0;
 };
 
+/**
+ * The local transforms of the nodes at the current time, indexed by the
+ * transform index of the nodes, so no hashing is needed. A parent is
+ * decomposed before the child that needs it.
+ *
+ * Allocate it once for many frames, and reset it when the time changes:
+ * that only bumps a stamp, the table is reused.
+ */
 class NodeTransformCache {
   public:
-    NodeTransformCache() = default;
+    /** When context evaluated, the world matrix plugs are read, so the
+     * transforms are evaluated in the current evaluation context. Without
+     * checkSkewing, the maxNonOrthogonality of the states stays 0 */
+    explicit NodeTransformCache(const bool isContextEvaluated = false,
+                                const size_t nodeCount = 0,
+                                const bool checkSkewing = true)
+        : m_isContextEvaluated(isContextEvaluated),
+          m_checkSkewing(checkSkewing), m_states(nodeCount),
+          m_stamps(nodeCount, 0) {}
     ~NodeTransformCache() = default;
 
     const NodeTransformState &getTransform(const ExportableNode *node,
                                            double scaleFactor);
 
+    /** Decomposes the local matrices of the nodes in one batch, for the
+     * nodes without a transform at this time, so getTransform only has to
+     * look these up. The joints with segment scale compensation are still
+     * decomposed by getTransform, after their parent */
+    void decomposeAll(const std::vector<const ExportableNode *> &nodes,
+                      double scaleFactor);
+
+    /** Forgets all transforms, before evaluating another time */
+    void reset();
+
   private:
     DISALLOW_COPY_MOVE_ASSIGN(NodeTransformCache);
 
-    std::unordered_map<const ExportableNode *, NodeTransformState> m_table;
+    const bool m_isContextEvaluated;
+    const bool m_checkSkewing;
+
+    // A deque, so growing keeps the references to the states valid while
+    // the parents are resolved.
+    std::deque<NodeTransformState> m_states;
+
+    // A state is valid when its stamp is the current stamp.
+    std::vector<unsigned> m_stamps;
+    unsigned m_stamp = 1;
+
+    NodeTransformState m_worldState;
+
+    // The batch of decomposeAll, reused for all times.
+    std::vector<const ExportableNode *> m_batchNodes;
+    std::vector<double> m_batchMatrices;
+    std::vector<kernels::DecomposedTransform> m_batchResults;
+
+    /** The state of the node at this time, uninitialized when new */
+    NodeTransformState &stateOf(const ExportableNode *node);
+
+    /** The local matrix, with the pivot of a complex transform combined */
+    MMatrix matrixToDecompose(const ExportableNode *node);
+
+    /** Sets the state of a simple or complex transform */
+    void setDecomposedState(const ExportableNode *node, const MMatrix &matrix,
+                            const kernels::DecomposedTransform &decomposed,
+                            double scaleFactor, NodeTransformState &state);
 };
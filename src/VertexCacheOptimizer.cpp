@@ -0,0 +1,233 @@
+#include "externals.h"
+
+#include "VertexCacheOptimizer.h"
+
+// The size of the simulated LRU cache. Slightly larger than most hardware
+// caches, the algorithm is not very sensitive to it.
+const int vertexCacheSize = 32;
+
+const float cacheDecayPower = 1.5f;
+const float lastTriangleScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+
+static float vertexScore(const int cachePosition, const int remainingTriangleCount) {
+    if (remainingTriangleCount == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertices of the last triangle get a fixed score, so that
+            // it doesn't matter which one of them is used next.
+            score = lastTriangleScore;
+        } else {
+            const float scaler = 1.0f / (vertexCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+        }
+    }
+
+    // Bonus points for having only a few triangles left, to get rid of the
+    // lone vertices quickly.
+    score += valenceBoostScale * std::pow(float(remainingTriangleCount), -valenceBoostPower);
+
+    return score;
+}
+
+void optimizeVertexCacheOrder(IndexVector &indices, const size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // The triangles using each vertex, the live ones first.
+    std::vector<int> remainingCounts(vertexCount, 0);
+    for (const auto index : indices) {
+        ++remainingCounts[index];
+    }
+
+    std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        adjacencyOffsets[vertexIndex + 1] = adjacencyOffsets[vertexIndex] + remainingCounts[vertexIndex];
+    }
+
+    std::vector<Index> adjacency(indices.size());
+    {
+        std::vector<size_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t corner = 0; corner < indices.size(); ++corner) {
+            adjacency[cursors[indices[corner]]++] = static_cast<Index>(corner / 3);
+        }
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        vertexScores[vertexIndex] = vertexScore(-1, remainingCounts[vertexIndex]);
+    }
+
+    const auto triangleScoreOf = [&](const size_t triangleIndex) {
+        const auto corner = triangleIndex * 3;
+        return vertexScores[indices[corner + 0]] + vertexScores[indices[corner + 1]] + vertexScores[indices[corner + 2]];
+    };
+
+    std::vector<bool> isEmitted(triangleCount, false);
+
+    Index bestTriangle = 0;
+    float bestScore = -1;
+    for (size_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) {
+        const auto score = triangleScoreOf(triangleIndex);
+        if (score > bestScore) {
+            bestScore = score;
+            bestTriangle = static_cast<Index>(triangleIndex);
+        }
+    }
+
+    std::array<Index, vertexCacheSize + 3> cache;
+    std::array<Index, vertexCacheSize + 3> newCache;
+    size_t cacheCount = 0;
+
+    IndexVector output;
+    output.reserve(indices.size());
+
+    size_t scanCursor = 0;
+
+    while (bestTriangle >= 0) {
+        isEmitted[bestTriangle] = true;
+
+        const auto *triangle = &indices[bestTriangle * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // The vertices of the emitted triangle go to the front of the cache.
+        size_t newCacheCount = 0;
+
+        for (int i = 0; i < 3; ++i) {
+            const Index vertexIndex = triangle[i];
+
+            // Move the triangle out of the live part of the adjacency.
+            auto *begin = &adjacency[adjacencyOffsets[vertexIndex]];
+            auto *end = begin + remainingCounts[vertexIndex];
+            std::swap(*std::find(begin, end, bestTriangle), *(end - 1));
+            --remainingCounts[vertexIndex];
+
+            if (std::find(&newCache[0], &newCache[newCacheCount], vertexIndex) == &newCache[newCacheCount]) {
+                newCache[newCacheCount++] = vertexIndex;
+            }
+        }
+
+        for (size_t i = 0; i < cacheCount; ++i) {
+            const auto vertexIndex = cache[i];
+            if (std::find(triangle, triangle + 3, vertexIndex) == triangle + 3) {
+                newCache[newCacheCount++] = vertexIndex;
+            }
+        }
+
+        // Update the scores of the cached and evicted vertices.
+        for (size_t i = 0; i < newCacheCount; ++i) {
+            const auto vertexIndex = newCache[i];
+            const auto position = i < vertexCacheSize ? static_cast<int>(i) : -1;
+            cachePositions[vertexIndex] = position;
+            vertexScores[vertexIndex] = vertexScore(position, remainingCounts[vertexIndex]);
+        }
+
+        cacheCount = std::min<size_t>(newCacheCount, vertexCacheSize);
+        std::swap(cache, newCache);
+
+        // The next triangle is the best one touching the cache...
+        bestTriangle = -1;
+        bestScore = -1;
+
+        for (size_t i = 0; i < cacheCount; ++i) {
+            const auto vertexIndex = cache[i];
+            const auto *begin = &adjacency[adjacencyOffsets[vertexIndex]];
+            const auto *end = begin + remainingCounts[vertexIndex];
+            for (auto it = begin; it != end; ++it) {
+                const auto score = triangleScoreOf(*it);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = *it;
+                }
+            }
+        }
+
+        // ...or the next one in the original order if none does.
+        if (bestTriangle < 0) {
+            while (scanCursor < triangleCount && isEmitted[scanCursor]) {
+                ++scanCursor;
+            }
+
+            if (scanCursor < triangleCount) {
+                bestTriangle = static_cast<Index>(scanCursor);
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+IndexVector optimizeVertexFetchOrder(IndexVector &indices, const size_t vertexCount) {
+    IndexVector newVertexIndices(vertexCount, -1);
+
+    Index nextVertexIndex = 0;
+
+    for (auto &index : indices) {
+        auto &newIndex = newVertexIndices[index];
+        if (newIndex < 0) {
+            newIndex = nextVertexIndex++;
+        }
+        index = newIndex;
+    }
+
+    // Unreferenced vertices go last.
+    for (auto &newIndex : newVertexIndices) {
+        if (newIndex < 0) {
+            newIndex = nextVertexIndex++;
+        }
+    }
+
+    return newVertexIndices;
+}
+
+void remapVertexElements(const gsl::span<const byte> &source, const IndexVector &newVertexIndices,
+                         std::vector<byte> &target) {
+    target.resize(source.size());
+    remapVertexElements(source, newVertexIndices, gsl::make_span(target));
+}
+
+void remapVertexElements(const gsl::span<const byte> &source, const IndexVector &newVertexIndices,
+                         const gsl::span<byte> &target) {
+    const auto vertexCount = newVertexIndices.size();
+
+    assert(target.size() == source.size());
+
+    if (vertexCount == 0)
+        return;
+
+    const auto elementByteSize = source.size() / vertexCount;
+    assert(elementByteSize * vertexCount == size_t(source.size()));
+
+    for (size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex) {
+        memcpy(&target[newVertexIndices[vertexIndex] * elementByteSize], &source[vertexIndex * elementByteSize],
+               elementByteSize);
+    }
+}
+
+double averageCacheMissRatio(const IndexVector &indices, const size_t vertexCount, const size_t cacheSize) {
+    const auto triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0;
+
+    // Time stamp at which each vertex entered the FIFO cache.
+    std::vector<size_t> cacheTimes(vertexCount, 0);
+
+    size_t time = cacheSize + 1;
+    size_t missCount = 0;
+
+    for (const auto index : indices) {
+        if (time - cacheTimes[index] > cacheSize) {
+            cacheTimes[index] = time++;
+            ++missCount;
+        }
+    }
+
+    return double(missCount) / triangleCount;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "sceneTypes.h"
+
+/**
+ * Reorders the triangles of a triangle list for post-transform vertex cache
+ * locality, using Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+ * The vertices are not renumbered.
+ */
+void optimizeVertexCacheOrder(IndexVector &indices, size_t vertexCount);
+
+/**
+ * Renumbers the vertices in order of first use by the indices, for vertex
+ * fetch locality. Returns the new index of each old vertex index.
+ */
+IndexVector optimizeVertexFetchOrder(IndexVector &indices, size_t vertexCount);
+
+/**
+ * Moves the elements of a vertex stream to the new vertex indices returned by
+ * optimizeVertexFetchOrder.
+ */
+void remapVertexElements(const gsl::span<const byte> &source,
+                         const IndexVector &newVertexIndices,
+                         std::vector<byte> &target);
+
+/** Same, into a target of the size of the source, e.g. the data of an
+ * accessor, see allocatedAccessor */
+void remapVertexElements(const gsl::span<const byte> &source,
+                         const IndexVector &newVertexIndices,
+                         const gsl::span<byte> &target);
+
+/** The average number of vertex cache misses per triangle (ACMR), using a
+ * FIFO cache of the given size */
+double averageCacheMissRatio(const IndexVector &indices, size_t vertexCount,
+                             size_t cacheSize = 32);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "BasicTypes.h"
+#include "kernels.h"
+#include "macros.h"
+#include "sceneTypes.h"
+
+/**
+ * Maps vertex keys (the concatenated component bytes of a vertex) to output
+ * vertex indices, to weld identical vertices.
+ *
+ * All keys of a table have the same byte length (fixed per VertexSignature).
+ * The table itself is the Maya independent kernels::WeldTable, see
+ * tools/KernelBenchmark.
+ */
+class VertexWeldTable {
+  public:
+    DEFAULT_COPY_MOVE_ASSIGN_CTOR_DTOR(VertexWeldTable);
+
+    /** The number of unique vertices */
+    size_t size() const { return m_table.size(); }
+
+    size_t keyByteLength() const { return m_table.keyByteLength(); }
+
+    /** The key of the vertex with the given index */
+    gsl::span<const byte> keyAt(const Index index) const {
+        return m_table.keyByteLength() == 0
+                   ? gsl::span<const byte>()
+                   : gsl::make_span(m_table.keyAt(index),
+                                    m_table.keyByteLength());
+    }
+
+    /**
+     * Returns the index of the vertex with the given key and hash, adding a
+     * new vertex with the next index if the key wasn't found.
+     * The key must have the same length as all previous keys.
+     */
+    Index findOrInsert(const gsl::span<const byte> &key, const size_t hash,
+                       bool &isNew) {
+        return m_table.findOrInsert(key.data(), static_cast<size_t>(key.size()),
+                                    hash, isNew);
+    }
+
+    /** The kernel table, for the weld kernels of kernels.h */
+    kernels::WeldTable &kernelTable() { return m_table; }
+
+    /** Restores the number of vertices of a table read from the MeshCache,
+     * which only stores the welded vertices, not their keys. */
+    void restoreSize(const size_t count) { m_table.restoreSize(count); }
+
+  private:
+    kernels::WeldTable m_table;
+};
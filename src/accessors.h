@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MeshRenderables.h"
+#include "kernels.h"
 #include "sceneTypes.h"
 #include "spans.h"
 
@@ -26,18 +27,55 @@ inline GLTF::Accessor::Type glAccessorType(const size_t dimension) {
     }
 }
 
+/**
+ * Allocates the data of an accessor of count elements, without
+ * initializing it, so the caller can write the elements in place, see
+ * accessorElements. The buffer view owns the data.
+ */
+inline std::unique_ptr<GLTF::Accessor>
+allocatedAccessor(const std::string &name, GLTF::Accessor::Type type,
+                  GLTF::Constants::WebGL componentType,
+                  GLTF::Constants::WebGL target, const size_t byteLength,
+                  const size_t count) {
+    // Unlike the constructor that takes the data, this doesn't compute the
+    // min and max, only the accessors that need these get them while packed,
+    // see requireBounds.
+    auto data = static_cast<byte *>(malloc(byteLength));
+
+    auto accessor = std::make_unique<GLTF::Accessor>(type, componentType);
+    accessor->bufferView =
+        new GLTF::BufferView(data, static_cast<int>(byteLength), target);
+    accessor->count = int(count);
+    accessor->name = name;
+
+    return accessor;
+}
+
+/** The data of an accessor made by allocatedAccessor, to write in place */
+template <typename T>
+gsl::span<T> accessorElements(const GLTF::Accessor &accessor) {
+    const auto *view = accessor.bufferView;
+    return view->byteLength > 0
+               ? gsl::make_span(reinterpret_cast<T *>(view->buffer->data),
+                                view->byteLength / sizeof(T))
+               : gsl::span<T>();
+}
+
 template <typename T>
 std::unique_ptr<GLTF::Accessor>
 contiguousAccessor(const std::string &name, GLTF::Accessor::Type type,
                    GLTF::Constants::WebGL componentType,
                    GLTF::Constants::WebGL target, const gsl::span<const T> data,
                    const size_t dimension) {
-    auto bytes = reinterpret_span<byte>(data);
-    auto accessor = std::make_unique<GLTF::Accessor>(
-        type, componentType, const_cast<byte *>(&bytes[0]),
-        int(data.size() / dimension), target);
+    const auto bytes = reinterpret_span<byte>(data);
+    const auto byteLength = static_cast<size_t>(bytes.size());
 
-    accessor->name = name;
+    auto accessor = allocatedAccessor(name, type, componentType, target,
+                                      byteLength, data.size() / dimension);
+    if (byteLength) {
+        std::memcpy(accessor->bufferView->buffer->data, bytes.data(),
+                    byteLength);
+    }
 
     return accessor;
 }
@@ -53,6 +91,34 @@ contiguousChannelAccessor(const std::string &name,
                               dimension);
 }
 
+/** Allocates the accessor of byteLength bytes of elements of the semantic,
+ * see allocatedAccessor */
+inline std::unique_ptr<GLTF::Accessor> allocatedElementAccessor(
+    const std::string &name, const Semantic::Kind semantic,
+    const ShapeIndex &shapeIndex, const size_t byteLength) {
+    const auto dim = dimension(semantic, shapeIndex);
+
+    switch (Component::type(semantic)) {
+    case Component::FLOAT:
+        return allocatedAccessor(name, glAccessorType(dim),
+                                 GLTF::Constants::WebGL::FLOAT,
+                                 GLTF::Constants::WebGL::ARRAY_BUFFER,
+                                 byteLength,
+                                 byteLength / (dim * sizeof(float)));
+
+    case Component::USHORT:
+        return allocatedAccessor(name, glAccessorType(dim),
+                                 GLTF::Constants::WebGL::UNSIGNED_SHORT,
+                                 GLTF::Constants::WebGL::ARRAY_BUFFER,
+                                 byteLength,
+                                 byteLength / (dim * sizeof(ushort)));
+
+    default:
+        assert(false);
+        return nullptr;
+    }
+}
+
 inline std::unique_ptr<GLTF::Accessor> contiguousElementAccessor(
     const std::string &name, const Semantic::Kind semantic,
     const ShapeIndex &shapeIndex, const gsl::span<const byte> &bytes) {
@@ -77,6 +143,97 @@ inline std::unique_ptr<GLTF::Accessor> contiguousElementAccessor(
     }
 }
 
+inline std::unique_ptr<GLTF::Accessor> contiguousEncodedElementAccessor(
+    const std::string &name, const GLTF::Constants::WebGL componentType,
+    const gsl::span<const byte> &bytes, const size_t dim) {
+    const auto type = glAccessorType(dim);
+    const auto target = GLTF::Constants::WebGL::ARRAY_BUFFER;
+
+    switch (componentType) {
+    case GLTF::Constants::WebGL::BYTE:
+        return contiguousAccessor(name, type, componentType, target,
+                                  reinterpret_span<int8_t>(bytes), dim);
+    case GLTF::Constants::WebGL::UNSIGNED_BYTE:
+        return contiguousAccessor(name, type, componentType, target,
+                                  reinterpret_span<uint8_t>(bytes), dim);
+    case GLTF::Constants::WebGL::SHORT:
+        return contiguousAccessor(name, type, componentType, target,
+                                  reinterpret_span<int16_t>(bytes), dim);
+    case GLTF::Constants::WebGL::UNSIGNED_SHORT:
+        return contiguousAccessor(name, type, componentType, target,
+                                  reinterpret_span<uint16_t>(bytes), dim);
+    case GLTF::Constants::WebGL::FLOAT:
+        return contiguousAccessor(name, type, componentType, target,
+                                  reinterpret_span<float>(bytes), dim);
+    default:
+        assert(false);
+        return nullptr;
+    }
+}
+
+/**
+ * Gives the accessor a min and max, which glTF requires for the POSITION
+ * attributes and the animation inputs, and -allAccessorBounds for all. Their
+ * values are computed from the elements when these are packed, or when the
+ * accessor is substituted, see computeBounds.
+ */
+inline void requireBounds(GLTF::Accessor *accessor) {
+    if (accessor->min)
+        return;
+
+    const auto componentCount = accessor->getNumberOfComponents();
+    accessor->min = new float[componentCount];
+    accessor->max = new float[componentCount];
+    std::fill_n(accessor->min, componentCount, std::numeric_limits<float>::max());
+    std::fill_n(accessor->max, componentCount, std::numeric_limits<float>::lowest());
+}
+
+/** Widens the required bounds of the accessor by count of its elements */
+inline void widenBounds(GLTF::Accessor *accessor, const byte *elements,
+                        const int byteStride, const int count) {
+    if (!accessor->min)
+        return;
+
+    const auto componentCount = accessor->getNumberOfComponents();
+    auto *min = accessor->min;
+    auto *max = accessor->max;
+
+    switch (accessor->componentType) {
+    case GLTF::Constants::WebGL::BYTE:
+        return kernels::widenBounds<int8_t>(elements, byteStride, count, componentCount, min, max);
+    case GLTF::Constants::WebGL::UNSIGNED_BYTE:
+        return kernels::widenBounds<uint8_t>(elements, byteStride, count, componentCount, min, max);
+    case GLTF::Constants::WebGL::SHORT:
+        return kernels::widenBounds<int16_t>(elements, byteStride, count, componentCount, min, max);
+    case GLTF::Constants::WebGL::UNSIGNED_SHORT:
+        return kernels::widenBounds<uint16_t>(elements, byteStride, count, componentCount, min, max);
+    case GLTF::Constants::WebGL::UNSIGNED_INT:
+        return kernels::widenBounds<uint32_t>(elements, byteStride, count, componentCount, min, max);
+    case GLTF::Constants::WebGL::FLOAT:
+        return kernels::widenBounds<float>(elements, byteStride, count, componentCount, min, max);
+    default:
+        assert(false);
+    }
+}
+
+/** Computes the required bounds of the accessor from the elements in its
+ * buffer view, for the accessors that are not packed as they are, e.g. the
+ * sparse and Draco compressed ones */
+inline void computeBounds(GLTF::Accessor *accessor) {
+    const auto view = accessor->bufferView;
+    if (!accessor->min || !view)
+        return;
+
+    const auto elementByteLength = accessor->getNumberOfComponents() * accessor->getComponentByteLength();
+    widenBounds(accessor, view->buffer->data + view->byteOffset + accessor->byteOffset,
+                view->byteStride > 0 ? view->byteStride : elementByteLength, accessor->count);
+}
+
+/** The bytes of the elements of the accessor, before compression or packing */
+inline size_t glAccessorByteLength(const GLTF::Accessor *accessor) {
+    return accessor ? size_t(accessor->count) * accessor->getNumberOfComponents() * accessor->getComponentByteLength() : 0;
+}
+
 inline const char *glAccessorTargetPurpose(GLTF::Constants::WebGL target) {
     switch (target) {
     case GLTF::Constants::WebGL::ELEMENT_ARRAY_BUFFER:
@@ -0,0 +1,83 @@
+#pragma once
+
+// The layout of the companion blob of -companionBlob.
+//
+// The blob holds the vertex, index, skin and animation data of the glTF as
+// tightly packed streams, in the component types of their accessors, so an
+// engine can memory map the file and upload the streams as they are. Like
+// dumpRecords.h, this header is self-contained, so loaders can include it:
+// it only depends on the standard library.
+//
+// All values are little endian. The file starts with a FileHeader, followed
+// by the streams, each starting at a multiple of streamAlignment, and ends
+// with the table of the streams, streamCount StreamEntry records at
+// tableOffset.
+
+#include <cstdint>
+
+namespace blobs {
+
+/** The first bytes of a companion blob */
+const char fileMagic[8] = {'M', '2', 'G', 'B', 'L', 'O', 'B', '1'};
+
+/** Incremented when the layout changes */
+const uint32_t fileVersion = 1;
+
+/** The alignment of the streams and of the table, enough for binding any
+ * stream as a vertex, index or storage buffer without copying it */
+const uint64_t streamAlignment = 256;
+
+enum class StreamKind : uint32_t {
+    // A vertex attribute of a mesh primitive; the owner is the mesh.
+    VERTEX_ATTRIBUTE = 1,
+    // A morph target attribute of a mesh primitive; the owner is the mesh.
+    MORPH_TARGET = 2,
+    // The indices of a mesh primitive; the owner is the mesh.
+    INDICES = 3,
+    // The inverse bind matrices of a skin; the owner is the skin.
+    INVERSE_BIND_MATRICES = 4,
+    // The glTF node ids of the joints of a skin, as UNSIGNED_INT; the owner
+    // is the skin, and there is no accessor.
+    JOINT_PALETTE = 5,
+    // The times of an animation sampler; the owner is the animation.
+    ANIMATION_INPUT = 6,
+    // The values of an animation sampler; the owner is the animation.
+    ANIMATION_OUTPUT = 7,
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t streamCount;
+    uint64_t tableOffset;
+    // The byte length of the whole file.
+    uint64_t byteLength;
+};
+
+struct StreamEntry {
+    uint32_t kind;
+    // The glTF component type, e.g. 5126 for FLOAT.
+    uint32_t componentType;
+    uint32_t componentCount;
+    // Whether the integers are normalized, as for KHR_mesh_quantization.
+    uint32_t isNormalized;
+    // The number of elements, each componentCount components.
+    uint64_t count;
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    // The id of the glTF accessor of the stream, or -1.
+    int32_t accessor;
+    // The id of the glTF mesh, skin or animation of the stream, see
+    // StreamKind.
+    int32_t owner;
+};
+
+static_assert(sizeof(FileHeader) == 32, "The file header must not be padded");
+static_assert(sizeof(StreamEntry) == 48, "The stream entries must not be padded");
+
+/** The multiple of streamAlignment at or after the offset */
+inline uint64_t alignedOffset(const uint64_t offset) {
+    return (offset + streamAlignment - 1) / streamAlignment * streamAlignment;
+}
+
+} // namespace blobs
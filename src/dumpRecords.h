@@ -0,0 +1,288 @@
+#pragma once
+
+// The text of the tables of -dumpMaya, and the records of the binary dumps
+// of -dumpMayaBinary.
+//
+// A binary dump is a file header followed by records: the text between the
+// tables as is, and the tables as raw values. tools/DumpViewer turns it back
+// into the text dump, so like kernels.h, this header is self-contained: it
+// only depends on the standard library and milo.h.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "milo.h"
+
+namespace dumps {
+
+/** The first bytes of a binary dump */
+const char fileMagic[8] = {'M', '2', 'G', 'D', 'U', 'M', 'P', '1'};
+
+enum class RecordKind : uint32_t {
+    // Text, already indented.
+    TEXT = 1,
+    // A TableHeader, the name, and the values.
+    TABLE = 2,
+};
+
+/** The number type of the values of a table */
+enum class ValueType : uint32_t {
+    FLOAT32 = 1,
+    FLOAT64 = 2,
+    INT32 = 3,
+    UINT16 = 4,
+    UINT32 = 5,
+};
+
+template <typename T> struct ValueTypeOf;
+template <> struct ValueTypeOf<float> {
+    static const ValueType value = ValueType::FLOAT32;
+};
+template <> struct ValueTypeOf<double> {
+    static const ValueType value = ValueType::FLOAT64;
+};
+template <> struct ValueTypeOf<int32_t> {
+    static const ValueType value = ValueType::INT32;
+};
+template <> struct ValueTypeOf<uint16_t> {
+    static const ValueType value = ValueType::UINT16;
+};
+template <> struct ValueTypeOf<uint32_t> {
+    static const ValueType value = ValueType::UINT32;
+};
+
+inline size_t valueByteLength(const ValueType type) {
+    switch (type) {
+    case ValueType::FLOAT64:
+        return 8;
+    case ValueType::UINT16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+struct TableHeader {
+    uint32_t valueType;
+    uint32_t itemsPerLine;
+    uint32_t precision;
+    // The indentation of the lines of the table, and whether the table
+    // starts on a new line, so it is indented too.
+    uint32_t indentationLevel;
+    uint32_t startsLine;
+    uint32_t nameLength;
+    uint64_t count;
+};
+
+namespace detail {
+inline char *formatValue(char *out, const double value, const int precision) {
+    return fmt::format_double(out, value, std::max(1, precision));
+}
+
+inline char *formatValue(char *out, const float value, const int precision) {
+    return formatValue(out, double(value), precision);
+}
+
+inline char *formatValue(char *out, const int64_t value, int) {
+    auto magnitude =
+        value < 0 ? 0 - static_cast<uint64_t>(value) : uint64_t(value);
+
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+        *out++ = '-';
+    while (length)
+        *out++ = digits[--length];
+    return out;
+}
+
+inline char *formatValue(char *out, const int32_t value, const int precision) {
+    return formatValue(out, int64_t(value), precision);
+}
+
+inline char *formatValue(char *out, const uint16_t value, const int precision) {
+    return formatValue(out, int64_t(value), precision);
+}
+
+inline char *formatValue(char *out, const uint32_t value, const int precision) {
+    return formatValue(out, int64_t(value), precision);
+}
+} // namespace detail
+
+/**
+ * Appends the text of a table, like the text dumps always did: the quoted
+ * name, and the values between brackets on indented lines of itemsPerLine
+ * values. The floating point values have at most precision decimals.
+ */
+template <typename T>
+void formatTable(std::string &text, const std::string &name, const T *values,
+                 const size_t count, const size_t itemsPerLine,
+                 const int precision) {
+    text += '"';
+    text += name;
+    text += "\": [\n\t";
+
+    const auto perLine = itemsPerLine ? itemsPerLine : 1;
+
+    // Formats a line at a time into the text.
+    for (size_t begin = 0; begin < count; begin += perLine) {
+        const auto end = std::min(count, begin + perLine);
+        const auto offset = text.size();
+        text.resize(offset + 3 + (end - begin) * (fmt::BUFFER_SIZE + 2));
+
+        auto *out = &text[offset];
+        if (begin > 0) {
+            *out++ = ',';
+            *out++ = '\n';
+            *out++ = '\t';
+        }
+
+        for (auto index = begin; index < end; ++index) {
+            if (index > begin) {
+                *out++ = ',';
+                *out++ = '\t';
+            }
+            out = detail::formatValue(out, values[index], precision);
+        }
+
+        text.resize(out - &text[0]);
+    }
+
+    text += "\n]";
+}
+
+/** Appends the text, with level tabs before each line. shouldIndent tells
+ * whether the text starts a line, and is updated for the next text. */
+inline void appendIndented(std::string &indented, const char *text,
+                           const size_t length, const int level,
+                           bool &shouldIndent) {
+    const auto *end = text + length;
+    while (text < end) {
+        if (shouldIndent) {
+            indented.append(static_cast<size_t>(level), '\t');
+            shouldIndent = false;
+        }
+
+        const auto *lineEnd =
+            static_cast<const char *>(std::memchr(text, '\n', end - text));
+        const auto *next = lineEnd ? lineEnd + 1 : end;
+        indented.append(text, next);
+        shouldIndent = lineEnd != nullptr;
+        text = next;
+    }
+}
+
+/** Appends a record: the kind, the byte length and the bytes */
+inline void writeRecord(std::streambuf &stream, const RecordKind kind,
+                        const void *data, const size_t byteLength) {
+    const auto kindValue = static_cast<uint32_t>(kind);
+    const auto length = static_cast<uint64_t>(byteLength);
+    stream.sputn(reinterpret_cast<const char *>(&kindValue), sizeof(kindValue));
+    stream.sputn(reinterpret_cast<const char *>(&length), sizeof(length));
+    stream.sputn(static_cast<const char *>(data),
+                 static_cast<std::streamsize>(byteLength));
+}
+
+template <typename T>
+void writeTableRecord(std::streambuf &stream, TableHeader header,
+                      const std::string &name, const T *values,
+                      const size_t count) {
+    header.valueType = static_cast<uint32_t>(ValueTypeOf<T>::value);
+    header.nameLength = static_cast<uint32_t>(name.size());
+    header.count = count;
+
+    const auto kindValue = static_cast<uint32_t>(RecordKind::TABLE);
+    const auto length =
+        static_cast<uint64_t>(sizeof(header) + name.size() + count * sizeof(T));
+    stream.sputn(reinterpret_cast<const char *>(&kindValue), sizeof(kindValue));
+    stream.sputn(reinterpret_cast<const char *>(&length), sizeof(length));
+    stream.sputn(reinterpret_cast<const char *>(&header), sizeof(header));
+    stream.sputn(name.data(), static_cast<std::streamsize>(name.size()));
+    stream.sputn(reinterpret_cast<const char *>(values),
+                 static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+/** Reads the next record, returns false at the end of the stream */
+inline bool readRecord(std::istream &stream, RecordKind &kind,
+                       std::vector<uint8_t> &bytes) {
+    uint32_t kindValue = 0;
+    uint64_t length = 0;
+    if (!stream.read(reinterpret_cast<char *>(&kindValue), sizeof(kindValue)) ||
+        !stream.read(reinterpret_cast<char *>(&length), sizeof(length)))
+        return false;
+
+    kind = static_cast<RecordKind>(kindValue);
+    bytes.resize(static_cast<size_t>(length));
+    return bool(
+        stream.read(reinterpret_cast<char *>(bytes.data()), bytes.size()));
+}
+
+/** The text of a TABLE record, indented like the text dump. Returns false
+ * when the record is invalid. */
+inline bool appendTableText(std::string &indented,
+                            const std::vector<uint8_t> &record) {
+    TableHeader header;
+    if (record.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, record.data(), sizeof(header));
+
+    const auto type = static_cast<ValueType>(header.valueType);
+    const auto valueOffset = sizeof(header) + header.nameLength;
+    if (valueOffset > record.size() ||
+        (record.size() - valueOffset) / valueByteLength(type) < header.count)
+        return false;
+
+    const std::string name(
+        reinterpret_cast<const char *>(record.data()) + sizeof(header),
+        header.nameLength);
+    const auto *values = record.data() + valueOffset;
+    const auto count = static_cast<size_t>(header.count);
+    const auto precision = static_cast<int>(header.precision);
+
+    // The values are copied, the record doesn't align these.
+    std::string text;
+    const auto format = [&](auto zero) {
+        std::vector<decltype(zero)> aligned(count);
+        std::memcpy(aligned.data(), values, count * sizeof(zero));
+        formatTable(text, name, aligned.data(), count, header.itemsPerLine,
+                    precision);
+    };
+
+    switch (type) {
+    case ValueType::FLOAT32:
+        format(float());
+        break;
+    case ValueType::FLOAT64:
+        format(double());
+        break;
+    case ValueType::INT32:
+        format(int32_t());
+        break;
+    case ValueType::UINT16:
+        format(uint16_t());
+        break;
+    case ValueType::UINT32:
+        format(uint32_t());
+        break;
+    default:
+        return false;
+    }
+
+    bool shouldIndent = header.startsLine != 0;
+    appendIndented(indented, text.data(), text.size(),
+                   static_cast<int>(header.indentationLevel), shouldIndent);
+    return true;
+}
+
+} // namespace dumps
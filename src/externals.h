@@ -2,27 +2,35 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bitset>
 #include <cassert>
 #include <cctype>
 #include <cerrno>
 #include <chrono>
 #include <climits>
+#include <condition_variable>
 #include <cmath>
 #include <csignal>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -46,12 +54,18 @@
 #include <GLTFScene.h>
 #include <GLTFTargetNames.h>
 
+#include "draco/compression/encode.h"
+#include "draco/mesh/mesh.h"
+
+#include "meshoptimizer.h"
+
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 4996)
 #pragma warning(default : 4267)
 #endif
 #include "rapidjson/document.h"
+#include "rapidjson/ostreamwrapper.h"
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -69,14 +83,22 @@
 #include <maya/MAnimUtil.h>
 #include <maya/MArgDatabase.h>
 #include <maya/MArgList.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MDagMessage.h>
 #include <maya/MDagModifier.h>
 #include <maya/MDagPath.h>
 #include <maya/MDagPathArray.h>
+#include <maya/MDataHandle.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGMessage.h>
+#include <maya/MEulerRotation.h>
 #include <maya/MFileIO.h>
 #include <maya/MFileObject.h>
 #include <maya/MFloatMatrix.h>
 #include <maya/MFloatPointArray.h>
 #include <maya/MFloatVectorArray.h>
+#include <maya/MFnAnimCurve.h>
 #include <maya/MFnAttribute.h>
 #include <maya/MFnBlendShapeDeformer.h>
 #include <maya/MFnBlinnShader.h>
@@ -88,6 +110,7 @@
 #include <maya/MFnMessageAttribute.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnPhongShader.h>
+#include <maya/MFnPointArrayData.h>
 #include <maya/MFnSet.h>
 #include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnSkinCluster.h>
@@ -97,22 +120,35 @@
 #include <maya/MGlobal.h>
 #include <maya/MIOStream.h>
 #include <maya/MImage.h>
+#include <maya/MItDag.h>
 #include <maya/MItDependencyGraph.h>
 #include <maya/MItDependencyNodes.h>
 #include <maya/MItGeometry.h>
 #include <maya/MItMeshFaceVertex.h>
 #include <maya/MItMeshPolygon.h>
 #include <maya/MMatrix.h>
+#include <maya/MMessage.h>
+#include <maya/MNodeMessage.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MPlugArray.h>
 #include <maya/MPointArray.h>
+#include <maya/MProgressWindow.h>
 #include <maya/MPxCommand.h>
 #include <maya/MQuaternion.h>
 #include <maya/MRenderSetup.h>
+#include <maya/MSceneMessage.h>
 #include <maya/MSelectionList.h>
 #include <maya/MStreamUtils.h>
 #include <maya/MSyntax.h>
 #include <maya/MTime.h>
+#include <maya/MTimerMessage.h>
+#include <maya/MTransformationMatrix.h>
 #include <maya/MUuid.h>
 
+#if MAYA_API_VERSION >= 20180000
+#include <maya/MDGContextGuard.h>
+#endif
+
 #ifdef isnan
 #   undef isnan
 #endif
@@ -0,0 +1,134 @@
+#pragma once
+
+// Word-at-a-time hashing for vertex keys and other short byte sequences.
+//
+// This is a wyhash-style hash: keys are consumed 32 bytes per step in two
+// independent lanes, the remainder 16 and finally 8 bytes at a time, and every
+// step is a single 64x64->128 bit multiply folded back to 64 bits. Compared to
+// the boost-style combine, which mixes one byte or short per step with a
+// serial dependency on the previous step, this needs an order of magnitude
+// fewer instructions on typical 24..64 byte vertex keys.
+//
+// The keys are read as little-endian words on any host, so hashBytes gives the
+// same values everywhere. These are persisted in the -hashBufferURIs names
+// and the -contentStore, see BufferHash.cpp, so changing the algorithm or the
+// secrets changes those names. Persist the values as little-endian bytes.
+//
+// This header is self-contained so that it can be used outside of the plugin,
+// see tools/HashBenchmark.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+namespace fasthash {
+const uint64_t secret0 = 0xa0761d6478bd642fULL;
+const uint64_t secret1 = 0xe7037ed1a0b428dbULL;
+const uint64_t secret2 = 0x8ebc6af09c88c6e3ULL;
+const uint64_t secret3 = 0x589965cc75374cc3ULL;
+
+/** Multiplies a and b to 128 bits, and folds the high and low halves. */
+inline uint64_t mix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    const __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    const uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    const uint64_t ha = a >> 32, hb = b >> 32;
+    const uint64_t la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    const uint64_t lo = t + (rm1 << 32);
+    const uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    return lo ^ hi;
+#endif
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint64_t littleEndian(const uint64_t v) { return __builtin_bswap64(v); }
+inline uint32_t littleEndian(const uint32_t v) { return __builtin_bswap32(v); }
+#else
+inline uint64_t littleEndian(const uint64_t v) { return v; }
+inline uint32_t littleEndian(const uint32_t v) { return v; }
+#endif
+
+inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return littleEndian(v);
+}
+
+inline uint64_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return littleEndian(v);
+}
+
+/** Reads 1..3 bytes */
+inline uint64_t read3(const uint8_t *p, const size_t k) {
+    return (static_cast<uint64_t>(p[0]) << 16) |
+           (static_cast<uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+/** Hashes byteLength bytes starting at data. */
+inline uint64_t hashBytes(const void *data, const size_t byteLength,
+                          uint64_t seed = 0) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    seed ^= mix(seed ^ secret0, secret1);
+
+    uint64_t a, b;
+
+    if (byteLength <= 16) {
+        if (byteLength >= 4) {
+            const size_t k = (byteLength >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + k);
+            b = (read32(p + byteLength - 4) << 32) |
+                read32(p + byteLength - 4 - k);
+        } else if (byteLength > 0) {
+            a = read3(p, byteLength);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t remaining = byteLength;
+
+        if (remaining > 32) {
+            uint64_t lane = seed;
+            do {
+                seed = mix(read64(p) ^ secret1, read64(p + 8) ^ seed);
+                lane = mix(read64(p + 16) ^ secret2, read64(p + 24) ^ lane);
+                p += 32;
+                remaining -= 32;
+            } while (remaining > 32);
+            seed ^= lane;
+        }
+
+        while (remaining > 16) {
+            seed = mix(read64(p) ^ secret1, read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        // The last 16 bytes, possibly overlapping with the previous block.
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+
+    return mix(secret3 ^ byteLength, mix(a ^ secret1, b ^ seed) ^ secret0);
+}
+
+/** Combines two fixed size words, e.g. the fields of a small key struct. */
+inline uint64_t hashWords(const uint64_t a, const uint64_t b,
+                          const uint64_t seed = 0) {
+    return mix(secret3, mix(a ^ secret1 ^ seed, b ^ secret2) ^ secret0);
+}
+} // namespace fasthash
@@ -0,0 +1,68 @@
+#include "externals.h"
+
+#include "fileCopy.h"
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif __APPLE__
+#include <sys/clonefile.h>
+#include <unistd.h>
+#endif
+
+static bool cloneFile(const fs::path &source, const fs::path &target) {
+#ifdef LINUX
+    const auto sourceFile = open(source.c_str(), O_RDONLY);
+    if (sourceFile < 0)
+        return false;
+
+    const auto targetFile = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    const auto isCloned = targetFile >= 0 && ioctl(targetFile, FICLONE, sourceFile) == 0;
+
+    if (targetFile >= 0) {
+        close(targetFile);
+    }
+    close(sourceFile);
+    return isCloned;
+#elif __APPLE__
+    return clonefile(source.c_str(), target.c_str(), 0) == 0;
+#else
+    // Block cloning on Windows needs ReFS, copy_file is as good.
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+bool cloneOrCopyFile(const fs::path &source, const fs::path &target, std::error_code &errorCode) {
+    errorCode.clear();
+
+    // A texture can already be in the output folder, it must not be
+    // truncated or removed to copy it onto itself.
+    std::error_code equivalentError;
+    if (fs::equivalent(source, target, equivalentError))
+        return true;
+
+    // The copy goes to a temporary file first, so the target is only
+    // replaced by a complete copy.
+    auto temporaryPath = target;
+    temporaryPath += ".tmp";
+    fs::remove(temporaryPath, errorCode);
+
+    if (!cloneFile(source, temporaryPath)) {
+        fs::remove(temporaryPath, errorCode);
+        if (!fs::copy_file(source, temporaryPath, fs::copy_options::overwrite_existing, errorCode))
+            return false;
+    }
+
+    fs::rename(temporaryPath, target, errorCode);
+    if (errorCode) {
+        std::error_code removeError;
+        fs::remove(temporaryPath, removeError);
+        return false;
+    }
+
+    return true;
+}
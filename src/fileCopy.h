@@ -0,0 +1,14 @@
+#pragma once
+
+#include "filesystem.h"
+
+/**
+ * Copies the file, overwriting the target. Where the file system supports
+ * it, the target is a copy-on-write clone (a reflink) sharing the blocks of
+ * the source, so large files are copied without reading these. Unlike a
+ * hard link, changing the copy later never changes the source.
+ *
+ * The copy is written to a temporary file that then replaces the target, and
+ * nothing is copied when the target is the source itself.
+ */
+bool cloneOrCopyFile(const fs::path &source, const fs::path &target, std::error_code &errorCode);
@@ -5,18 +5,18 @@
 
 struct CollectionHashers {
     std::size_t operator()(const gsl::span<int> &vec) const {
-        return hash_value(reinterpret_span<ushort>(vec));
+        return hash_bytes(vec);
     }
 
     std::size_t operator()(const gsl::span<float> &vec) const {
-        return hash_value(reinterpret_span<ushort>(vec));
+        return hash_bytes(vec);
     }
 
     std::size_t operator()(const std::vector<int> &vec) const {
-        return hash_value(reinterpret_span<ushort>(span(vec)));
+        return hash_bytes(span(vec));
     }
 
     std::size_t operator()(const std::vector<float> &vec) const {
-        return hash_value(reinterpret_span<ushort>(span(vec)));
+        return hash_bytes(span(vec));
     }
 };
@@ -0,0 +1,104 @@
+#include "externals.h"
+
+#include "imageHeader.h"
+
+static uint32_t readBigEndian(std::istream &stream, const int byteCount) {
+    uint32_t value = 0;
+    for (int i = 0; i < byteCount; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(stream.get());
+    }
+    return value;
+}
+
+static bool readPNGHeader(std::istream &stream, ImageHeader &header) {
+    // The IHDR chunk comes first, a tRNS chunk must come before the data.
+    while (stream) {
+        const auto length = readBigEndian(stream, 4);
+        char type[4];
+        if (!stream.read(type, sizeof(type)))
+            return false;
+
+        const auto chunkEnd = stream.tellg() + std::streamoff(length + 4);
+
+        if (std::equal(type, type + 4, "IHDR")) {
+            header.width = readBigEndian(stream, 4);
+            header.height = readBigEndian(stream, 4);
+            stream.get();
+            const auto colorType = stream.get();
+            // Gray with alpha or RGBA.
+            header.hasAlpha = colorType == 4 || colorType == 6;
+        } else if (std::equal(type, type + 4, "tRNS")) {
+            header.hasAlpha = true;
+        } else if (std::equal(type, type + 4, "IDAT") || std::equal(type, type + 4, "IEND")) {
+            break;
+        }
+
+        stream.seekg(chunkEnd);
+    }
+
+    return stream && header.width > 0 && header.height > 0;
+}
+
+static bool readJPEGHeader(std::istream &stream, ImageHeader &header) {
+    while (stream) {
+        if (stream.get() != 0xFF)
+            return false;
+
+        // Markers can be padded with fill bytes.
+        auto marker = stream.get();
+        while (marker == 0xFF) {
+            marker = stream.get();
+        }
+
+        // Markers without a segment.
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+            continue;
+
+        if (marker == 0xD9 || marker == 0xDA || marker < 0)
+            return false;
+
+        const auto length = readBigEndian(stream, 2);
+        if (length < 2)
+            return false;
+
+        // The start of frame markers, except DHT, JPG and DAC.
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            stream.get();
+            header.height = readBigEndian(stream, 2);
+            header.width = readBigEndian(stream, 2);
+            return stream && header.width > 0 && header.height > 0;
+        }
+
+        stream.seekg(length - 2, std::ios::cur);
+    }
+
+    return false;
+}
+
+bool readImageHeader(const fs::path &path, ImageHeader &header) {
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if (!stream)
+        return false;
+
+    header = ImageHeader();
+
+    std::error_code errorCode;
+    header.byteLength = static_cast<size_t>(fs::file_size(path, errorCode));
+
+    uint8_t signature[8] = {};
+    stream.read(reinterpret_cast<char *>(signature), sizeof(signature));
+
+    const uint8_t pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (std::equal(signature, signature + 8, pngSignature)) {
+        header.mimeType = "image/png";
+        return readPNGHeader(stream, header);
+    }
+
+    if (signature[0] == 0xFF && signature[1] == 0xD8) {
+        header.mimeType = "image/jpeg";
+        stream.seekg(2);
+        return readJPEGHeader(stream, header);
+    }
+
+    return false;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "filesystem.h"
+
+/** What the exporter needs to know about an image file, without its pixels */
+struct ImageHeader {
+    // The glTF MIME type, empty when glTF doesn't support the format.
+    std::string mimeType;
+
+    unsigned width = 0;
+    unsigned height = 0;
+
+    // An alpha channel, or a transparent color of a PNG.
+    bool hasAlpha = false;
+
+    size_t byteLength = 0;
+};
+
+/**
+ * Reads the size and the pixel format of a PNG or JPEG image from the
+ * headers of the file, seeking past the other chunks and segments. Returns
+ * false when the file can't be read or isn't a PNG or JPEG.
+ */
+bool readImageHeader(const fs::path &path, ImageHeader &header);
@@ -0,0 +1,149 @@
+#include "externals.h"
+
+#include "imageScaling.h"
+#include "parallel.h"
+
+// The minimum number of target pixels filtered per thread.
+const size_t scalingChunkPixelCount = 1 << 14;
+
+// The source pixels covering a target pixel along one axis.
+struct Footprint {
+    unsigned first = 0;
+    std::vector<float> weights;
+};
+
+static std::vector<Footprint> footprints(const unsigned size, const unsigned newSize) {
+    const auto scale = static_cast<double>(size) / newSize;
+
+    std::vector<Footprint> result(newSize);
+
+    for (unsigned i = 0; i < newSize; ++i) {
+        const auto begin = i * scale;
+        const auto end = std::min<double>(size, (i + 1) * scale);
+        const auto first = static_cast<unsigned>(begin);
+        const auto last = std::min(size, static_cast<unsigned>(std::ceil(end)));
+
+        auto &footprint = result[i];
+        footprint.first = first;
+
+        for (auto s = first; s < last; ++s) {
+            const auto coverage = std::min<double>(end, s + 1) - std::max<double>(begin, s);
+            footprint.weights.push_back(static_cast<float>(coverage / scale));
+        }
+    }
+
+    return result;
+}
+
+static float sRGBToLinear(const float value) {
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(const float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1 / 2.4f) - 0.055f;
+}
+
+static uint8_t toByte(const float value) {
+    return static_cast<uint8_t>(std::clamp(value * 255 + 0.5f, 0.0f, 255.0f));
+}
+
+std::pair<unsigned, unsigned> fittedImageSize(const unsigned width, const unsigned height,
+                                              const unsigned maxDimension) {
+    if (maxDimension == 0 || (width <= maxDimension && height <= maxDimension))
+        return {width, height};
+
+    const auto scale = static_cast<double>(maxDimension) / std::max(width, height);
+    return {std::max(1u, static_cast<unsigned>(std::lround(width * scale))),
+            std::max(1u, static_cast<unsigned>(std::lround(height * scale)))};
+}
+
+std::vector<uint8_t> downscaleImage(const uint8_t *pixels, const unsigned width, const unsigned height,
+                                    const unsigned newWidth, const unsigned newHeight, const PixelEncoding encoding) {
+    // Decoding each byte once is much cheaper than per sample.
+    std::array<float, 256> colorTable{};
+    std::array<float, 256> linearTable{};
+    for (int i = 0; i < 256; ++i) {
+        linearTable[i] = i / 255.0f;
+        colorTable[i] = encoding == PixelEncoding::sRGB ? sRGBToLinear(linearTable[i]) : linearTable[i];
+    }
+
+    const auto columnFootprints = footprints(width, newWidth);
+    const auto rowFootprints = footprints(height, newHeight);
+
+    // Horizontal pass, into linear floats with all source rows.
+    std::vector<float> columns(size_t(height) * newWidth * 4);
+
+    parallelFor(height, std::max<size_t>(1, scalingChunkPixelCount / newWidth), [&](size_t beginRow, size_t endRow) {
+        for (auto y = beginRow; y < endRow; ++y) {
+            const auto *sourceRow = pixels + y * width * 4;
+            auto *targetRow = columns.data() + y * newWidth * 4;
+
+            for (unsigned x = 0; x < newWidth; ++x) {
+                const auto &footprint = columnFootprints[x];
+                float sum[4] = {};
+
+                for (size_t i = 0; i < footprint.weights.size(); ++i) {
+                    const auto *pixel = sourceRow + (footprint.first + i) * 4;
+                    const auto weight = footprint.weights[i];
+                    sum[0] += weight * colorTable[pixel[0]];
+                    sum[1] += weight * colorTable[pixel[1]];
+                    sum[2] += weight * colorTable[pixel[2]];
+                    sum[3] += weight * linearTable[pixel[3]];
+                }
+
+                std::copy(sum, sum + 4, targetRow + x * 4);
+            }
+        }
+    });
+
+    // Vertical pass, encoding the bytes again.
+    std::vector<uint8_t> result(size_t(newWidth) * newHeight * 4);
+
+    parallelFor(newHeight, std::max<size_t>(1, scalingChunkPixelCount / newWidth), [&](size_t beginRow, size_t endRow) {
+        for (auto y = beginRow; y < endRow; ++y) {
+            const auto &footprint = rowFootprints[y];
+            auto *targetRow = result.data() + y * newWidth * 4;
+
+            for (unsigned x = 0; x < newWidth; ++x) {
+                float sum[4] = {};
+
+                for (size_t i = 0; i < footprint.weights.size(); ++i) {
+                    const auto *pixel = columns.data() + ((footprint.first + i) * newWidth + x) * 4;
+                    const auto weight = footprint.weights[i];
+                    for (int c = 0; c < 4; ++c) {
+                        sum[c] += weight * pixel[c];
+                    }
+                }
+
+                switch (encoding) {
+                case PixelEncoding::sRGB:
+                    for (int c = 0; c < 3; ++c) {
+                        sum[c] = linearToSRGB(sum[c]);
+                    }
+                    break;
+                case PixelEncoding::NormalMap: {
+                    const auto nx = sum[0] * 2 - 1;
+                    const auto ny = sum[1] * 2 - 1;
+                    const auto nz = sum[2] * 2 - 1;
+                    const auto length = std::sqrt(nx * nx + ny * ny + nz * nz);
+                    if (length > 1e-6f) {
+                        sum[0] = (nx / length + 1) / 2;
+                        sum[1] = (ny / length + 1) / 2;
+                        sum[2] = (nz / length + 1) / 2;
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+
+                auto *pixel = targetRow + x * 4;
+                for (int c = 0; c < 4; ++c) {
+                    pixel[c] = toByte(sum[c]);
+                }
+            }
+        }
+    });
+
+    return result;
+}
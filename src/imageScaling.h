@@ -0,0 +1,24 @@
+#pragma once
+
+/** How the channels of the pixels of an image are filtered */
+enum class PixelEncoding {
+    // All channels are linear, e.g. occlusion, roughness and metallic.
+    Linear,
+    // RGB is sRGB encoded and filtered in linear space, alpha is linear.
+    sRGB,
+    // RGB is a unit vector, renormalized after filtering.
+    NormalMap,
+};
+
+/** The size of an image downscaled to fit in maxDimension, keeping the
+ * aspect ratio. Images that fit keep their size. */
+std::pair<unsigned, unsigned> fittedImageSize(unsigned width, unsigned height, unsigned maxDimension);
+
+/**
+ * Downscales 8-bit RGBA pixels with an area filter, that averages all
+ * source pixels covered by each target pixel, weighted by their coverage.
+ * The rows are filtered in parallel, so this must not be given Maya memory
+ * that Maya could touch meanwhile.
+ */
+std::vector<uint8_t> downscaleImage(const uint8_t *pixels, unsigned width, unsigned height, unsigned newWidth,
+                                    unsigned newHeight, PixelEncoding encoding);
@@ -0,0 +1,141 @@
+#pragma once
+
+// Helpers to patch the glTF JSON written by the COLLADA2GLTF object model,
+// for glTF features it doesn't know about.
+
+/** Adds the extension to extensionsUsed, and to extensionsRequired if the
+ * asset can't be loaded without it. */
+inline void addExtensionUsed(rapidjson::Document &document, const char *name,
+                             const bool isRequired) {
+    auto &allocator = document.GetAllocator();
+
+    const auto addTo = [&](const char *member) {
+        if (!document.HasMember(member)) {
+            document.AddMember(rapidjson::StringRef(member),
+                               rapidjson::Value(rapidjson::kArrayType),
+                               allocator);
+        }
+
+        auto &names = document[member];
+
+        for (auto &existing : names.GetArray()) {
+            if (existing.IsString() && strcmp(existing.GetString(), name) == 0)
+                return;
+        }
+
+        names.PushBack(rapidjson::Value(name, allocator), allocator);
+    };
+
+    addTo("extensionsUsed");
+
+    if (isRequired) {
+        addTo("extensionsRequired");
+    }
+}
+
+/** Sets the member of a JSON object, adding it when missing. */
+template <typename T>
+void setMember(rapidjson::Value &object, const char *name, T &&value,
+               rapidjson::Document::AllocatorType &allocator) {
+    rapidjson::Value jsonValue(std::forward<T>(value));
+
+    if (object.HasMember(name)) {
+        object[name] = jsonValue;
+    } else {
+        object.AddMember(rapidjson::StringRef(name), jsonValue, allocator);
+    }
+}
+
+/** Returns the id of the buffer view. Buffer views that are not referenced by
+ * any written accessor are not written by the glTF writer, these are added. */
+inline int addBufferView(rapidjson::Document &document,
+                         GLTF::BufferView *bufferView) {
+    if (bufferView->id >= 0)
+        return bufferView->id;
+
+    auto &allocator = document.GetAllocator();
+
+    if (!document.HasMember("bufferViews")) {
+        document.AddMember("bufferViews",
+                           rapidjson::Value(rapidjson::kArrayType), allocator);
+    }
+
+    auto &jsonBufferViews = document["bufferViews"];
+
+    rapidjson::Value jsonView(rapidjson::kObjectType);
+    jsonView.AddMember("buffer", bufferView->buffer->id, allocator);
+    jsonView.AddMember("byteOffset", bufferView->byteOffset, allocator);
+    jsonView.AddMember("byteLength", bufferView->byteLength, allocator);
+    if (bufferView->byteStride > 0) {
+        jsonView.AddMember("byteStride", bufferView->byteStride, allocator);
+    }
+    if (!bufferView->name.empty()) {
+        jsonView.AddMember(
+            "name", rapidjson::Value(bufferView->name.c_str(), allocator),
+            allocator);
+    }
+
+    // Later patches refer to the buffer view by its id.
+    bufferView->id = static_cast<int>(jsonBufferViews.Size());
+    jsonBufferViews.PushBack(jsonView, allocator);
+
+    return bufferView->id;
+}
+
+inline const char *accessorTypeName(const GLTF::Accessor::Type type) {
+    switch (type) {
+    case GLTF::Accessor::Type::VEC2:
+        return "VEC2";
+    case GLTF::Accessor::Type::VEC3:
+        return "VEC3";
+    case GLTF::Accessor::Type::VEC4:
+        return "VEC4";
+    case GLTF::Accessor::Type::MAT2:
+        return "MAT2";
+    case GLTF::Accessor::Type::MAT3:
+        return "MAT3";
+    case GLTF::Accessor::Type::MAT4:
+        return "MAT4";
+    default:
+        return "SCALAR";
+    }
+}
+
+/** Returns the id of an accessor that is not referenced by anything the glTF
+ * writer knows about, adding it on first use. */
+inline int addAccessor(rapidjson::Document &document,
+                       GLTF::Accessor *accessor) {
+    if (accessor->id >= 0)
+        return accessor->id;
+
+    auto &allocator = document.GetAllocator();
+
+    if (!document.HasMember("accessors")) {
+        document.AddMember("accessors", rapidjson::Value(rapidjson::kArrayType),
+                           allocator);
+    }
+
+    rapidjson::Value jsonAccessor(rapidjson::kObjectType);
+    jsonAccessor.AddMember("bufferView",
+                           addBufferView(document, accessor->bufferView),
+                           allocator);
+    jsonAccessor.AddMember("byteOffset", accessor->byteOffset, allocator);
+    jsonAccessor.AddMember("componentType",
+                           static_cast<int>(accessor->componentType),
+                           allocator);
+    jsonAccessor.AddMember("count", accessor->count, allocator);
+    jsonAccessor.AddMember(
+        "type", rapidjson::StringRef(accessorTypeName(accessor->type)),
+        allocator);
+    if (!accessor->name.empty()) {
+        jsonAccessor.AddMember(
+            "name", rapidjson::Value(accessor->name.c_str(), allocator),
+            allocator);
+    }
+
+    auto &jsonAccessors = document["accessors"];
+    accessor->id = static_cast<int>(jsonAccessors.Size());
+    jsonAccessors.PushBack(jsonAccessor, allocator);
+
+    return accessor->id;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "parallel.h"
+
+// Writes the patched glTF JSON document, serializing the large arrays of the
+// root object, e.g. the nodes and accessors of large scenes, on the workers.
+
+namespace jsonWriting {
+
+// The elements serialized by a worker at a time.
+const rapidjson::SizeType chunkElementCount = 512;
+
+/**
+ * The text of the array as the writer would write it as a member of the
+ * root object, in chunks of elements written in parallel. A chunk writer
+ * starts at the same depth, so its pretty indentation is the same, and only
+ * the comma between the chunks is missing.
+ */
+template <typename ChunkWriter>
+std::string arrayText(const rapidjson::Value &array) {
+    const auto elementCount = array.Size();
+    const auto chunkCount = (elementCount + chunkElementCount - 1) / chunkElementCount;
+
+    std::vector<rapidjson::StringBuffer> chunks(chunkCount);
+    std::vector<size_t> prefixLengths(chunkCount);
+
+    parallelForEach(chunkCount, 1, [&](const size_t chunkIndex) {
+        auto &buffer = chunks[chunkIndex];
+        ChunkWriter writer(buffer);
+
+        writer.StartObject();
+        writer.Key("", 0);
+        writer.StartArray();
+        prefixLengths[chunkIndex] = buffer.GetSize();
+
+        const auto begin = static_cast<rapidjson::SizeType>(chunkIndex * chunkElementCount);
+        const auto end = std::min(elementCount, begin + chunkElementCount);
+        for (auto index = begin; index < end; ++index) {
+            array[index].Accept(writer);
+        }
+
+        if (chunkIndex + 1 == chunkCount) {
+            writer.EndArray(elementCount);
+        }
+    });
+
+    std::string text = "[";
+
+    for (size_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex) {
+        if (chunkIndex > 0) {
+            text += ',';
+        }
+
+        const auto &buffer = chunks[chunkIndex];
+        text.append(buffer.GetString() + prefixLengths[chunkIndex], buffer.GetSize() - prefixLengths[chunkIndex]);
+    }
+
+    return text;
+}
+
+template <typename ChunkWriter, typename Writer>
+void writeDocument(const rapidjson::Document &document, Writer &writer) {
+    if (!document.IsObject()) {
+        document.Accept(writer);
+        return;
+    }
+
+    writer.StartObject();
+
+    for (auto &member : document.GetObject()) {
+        writer.Key(member.name.GetString(), member.name.GetStringLength());
+
+        const auto &value = member.value;
+        if (value.IsArray() && value.Size() > chunkElementCount) {
+            const auto text = arrayText<ChunkWriter>(value);
+            writer.RawValue(text.data(), text.size(), rapidjson::kArrayType);
+        } else {
+            value.Accept(writer);
+        }
+    }
+
+    writer.EndObject(document.MemberCount());
+}
+
+} // namespace jsonWriting
+
+/** Writes the document like document.Accept(writer), byte for byte */
+template <typename OutputStream>
+void writeJSONDocument(const rapidjson::Document &document, rapidjson::Writer<OutputStream> &writer) {
+    jsonWriting::writeDocument<rapidjson::Writer<rapidjson::StringBuffer>>(document, writer);
+}
+
+template <typename OutputStream>
+void writeJSONDocument(const rapidjson::Document &document, rapidjson::PrettyWriter<OutputStream> &writer) {
+    jsonWriting::writeDocument<rapidjson::PrettyWriter<rapidjson::StringBuffer>>(document, writer);
+}
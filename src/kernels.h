@@ -0,0 +1,859 @@
+#pragma once
+
+// The hot inner loops of the exporter, behind Maya independent interfaces.
+//
+// The plugin feeds these with the data it extracted from Maya, while
+// tools/KernelBenchmark feeds them with synthetic data, or with the inputs
+// recorded by an export with -recordKernelInputs. So these loops can be
+// optimized without a Maya license or loading a scene.
+//
+// Like fasthash.h, this header is self-contained: it only depends on the
+// standard library and mikktspace.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "fasthash.h"
+#include "mikktspace.h"
+
+namespace kernels {
+
+// ---------------------------------------------------------------------------
+// Vertex welding
+// ---------------------------------------------------------------------------
+
+/** The hash of a vertex key, the concatenated component bytes of a vertex */
+inline size_t hashVertexKey(const uint8_t *key, const size_t byteLength) {
+    return static_cast<size_t>(fasthash::hashBytes(key, byteLength));
+}
+
+/**
+ * Maps vertex keys to vertex indices, to weld identical vertices.
+ *
+ * All keys of a table have the same byte length, so they are stored
+ * back-to-back in a single arena, in index order. The lookup uses open
+ * addressing with linear probing on precomputed hashes, so adding a vertex
+ * doesn't allocate except when the arena or slots grow.
+ */
+class WeldTable {
+  public:
+    /** The number of unique vertices */
+    size_t size() const { return m_count; }
+
+    size_t keyByteLength() const { return m_keyByteLength; }
+
+    /** The key of the vertex with the given index */
+    const uint8_t *keyAt(const int index) const {
+        return m_keyByteLength == 0 ? nullptr
+                                    : &m_keys[index * m_keyByteLength];
+    }
+
+    /**
+     * Returns the index of the vertex with the given key and hash, adding a
+     * new vertex with the next index if the key wasn't found.
+     * The key must have the same length as all previous keys.
+     */
+    int findOrInsert(const uint8_t *key, const size_t keyLength,
+                     const size_t hash, bool &isNew) {
+        if (m_count == 0 && m_keys.empty()) {
+            m_keyByteLength = keyLength;
+        }
+
+        assert(keyLength == m_keyByteLength);
+
+        if ((m_count + 1) * maxLoadDenominator >
+            m_slots.size() * maxLoadNumerator) {
+            grow();
+        }
+
+        const auto mask = m_slots.size() - 1;
+        auto i = hash & mask;
+
+        for (;;) {
+            auto &slot = m_slots[i];
+
+            if (slot.index < 0) {
+                // Not found, add the key.
+                const auto index = static_cast<int>(m_count++);
+                slot.hash = hash;
+                slot.index = index;
+                m_keys.insert(m_keys.end(), key, key + keyLength);
+                isNew = true;
+                return index;
+            }
+
+            if (slot.hash == hash &&
+                (keyLength == 0 ||
+                 std::memcmp(&m_keys[slot.index * keyLength], key,
+                             keyLength) == 0)) {
+                isNew = false;
+                return slot.index;
+            }
+
+            i = (i + 1) & mask;
+        }
+    }
+
+    /** Forgets the keys, but keeps the number of vertices */
+    void restoreSize(const size_t count) {
+        m_keys.clear();
+        m_slots.clear();
+        m_keyByteLength = 0;
+        m_count = count;
+    }
+
+  private:
+    // Grow when more than this fraction of the slots is used.
+    static const size_t maxLoadNumerator = 1;
+    static const size_t maxLoadDenominator = 2;
+
+    static const size_t initialSlotCount = 1024;
+
+    struct Slot {
+        size_t hash;
+        int index; // negative when the slot is empty
+    };
+
+    std::vector<uint8_t> m_keys;
+    std::vector<Slot> m_slots;
+    size_t m_keyByteLength = 0;
+    size_t m_count = 0;
+
+    void grow() {
+        const auto slotCount =
+            m_slots.empty() ? initialSlotCount : m_slots.size() * 2;
+
+        std::vector<Slot> slots(slotCount, Slot{0, -1});
+        const auto mask = slotCount - 1;
+
+        for (auto &slot : m_slots) {
+            if (slot.index >= 0) {
+                auto i = slot.hash & mask;
+                while (slots[i].index >= 0) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = slot;
+            }
+        }
+
+        m_slots.swap(slots);
+    }
+};
+
+/** A vertex stream of a weld: the element index of each corner, and the
+ * elements, each elementByteLength bytes. The elements of the new vertices
+ * are appended to the target. */
+struct WeldStream {
+    const int *indices = nullptr;
+    const uint8_t *elements = nullptr;
+    size_t elementByteLength = 0;
+    std::vector<uint8_t> *target = nullptr;
+};
+
+/** The output of a weld of corners */
+struct WeldOutput {
+    explicit WeldOutput(std::vector<int> &vertexIndices)
+        : vertexIndices(vertexIndices) {}
+
+    // The vertex index of each corner.
+    std::vector<int> &vertexIndices;
+
+    // The number of corners that reused a vertex.
+    size_t weldCount = 0;
+
+    // When non-null, gets the key of each corner.
+    std::vector<uint8_t> *recordedKeys = nullptr;
+};
+
+namespace detail {
+/** Welds the corners, given a gather that writes the key of a corner and an
+ * append that copies the streams of a new vertex from its key. */
+template <typename Gather, typename Append>
+void weldCornersWith(const int *corners, const size_t cornerCount,
+                     const size_t keyByteLength, uint8_t *key,
+                     WeldTable &table, WeldOutput &output, Gather gather,
+                     Append append) {
+    for (size_t cornerIndex = 0; cornerIndex < cornerCount; ++cornerIndex) {
+        const auto corner = size_t(corners[cornerIndex]);
+
+        gather(corner, key);
+
+        if (output.recordedKeys) {
+            output.recordedKeys->insert(output.recordedKeys->end(), key,
+                                        key + keyByteLength);
+        }
+
+        bool isNew;
+        const auto index = table.findOrInsert(
+            key, keyByteLength, hashVertexKey(key, keyByteLength), isNew);
+
+        if (isNew) {
+            append(key);
+        } else {
+            ++output.weldCount;
+        }
+
+        output.vertexIndices.push_back(index);
+    }
+}
+
+template <size_t Offset>
+inline void gatherFixed(const WeldStream *, const size_t, uint8_t *) {}
+
+template <size_t Offset, size_t Length, size_t... Lengths>
+inline void gatherFixed(const WeldStream *streams, const size_t corner,
+                        uint8_t *key) {
+    const auto index = size_t(streams->indices[corner]);
+    std::memcpy(key + Offset, streams->elements + index * Length, Length);
+    gatherFixed<Offset + Length, Lengths...>(streams + 1, corner, key);
+}
+
+template <size_t Offset>
+inline void appendFixed(const WeldStream *, const uint8_t *) {}
+
+template <size_t Offset, size_t Length, size_t... Lengths>
+inline void appendFixed(const WeldStream *streams, const uint8_t *key) {
+    streams->target->insert(streams->target->end(), key + Offset,
+                            key + Offset + Length);
+    appendFixed<Offset + Length, Lengths...>(streams + 1, key);
+}
+
+template <size_t... Lengths> struct LengthSum;
+
+template <> struct LengthSum<> { static const size_t value = 0; };
+
+template <size_t Length, size_t... Lengths>
+struct LengthSum<Length, Lengths...> {
+    static const size_t value = Length + LengthSum<Lengths...>::value;
+};
+} // namespace detail
+
+/**
+ * Welds the corners of streams of any layout: identical vertices get the
+ * same index, in order of first use.
+ */
+inline void weldCorners(const WeldStream *streams, const size_t streamCount,
+                        const int *corners, const size_t cornerCount,
+                        WeldTable &table, WeldOutput &output) {
+    size_t keyByteLength = 0;
+    for (size_t i = 0; i < streamCount; ++i) {
+        keyByteLength += streams[i].elementByteLength;
+    }
+
+    std::vector<uint8_t> key(keyByteLength);
+
+    detail::weldCornersWith(
+        corners, cornerCount, keyByteLength, key.data(), table, output,
+        [&](const size_t corner, uint8_t *k) {
+            for (size_t i = 0; i < streamCount; ++i) {
+                const auto &stream = streams[i];
+                const auto length = stream.elementByteLength;
+                const auto index = size_t(stream.indices[corner]);
+                std::memcpy(k, stream.elements + index * length, length);
+                k += length;
+            }
+        },
+        [&](const uint8_t *k) {
+            for (size_t i = 0; i < streamCount; ++i) {
+                const auto &stream = streams[i];
+                const auto length = stream.elementByteLength;
+                stream.target->insert(stream.target->end(), k, k + length);
+                k += length;
+            }
+        });
+}
+
+/**
+ * A weld of streams with the given element byte lengths. The key has a fixed
+ * size and the copies are unrolled, so a compiler can turn these in a few
+ * moves. Produces the same output as weldCorners.
+ */
+template <size_t... ElementByteLengths> struct FixedLayoutWeld {
+    static const size_t streamCount = sizeof...(ElementByteLengths);
+    static const size_t keyByteLength =
+        detail::LengthSum<ElementByteLengths...>::value;
+
+    /** Do the streams have this layout? */
+    static bool matches(const WeldStream *streams, const size_t count) {
+        const size_t lengths[] = {ElementByteLengths...};
+        if (count != streamCount)
+            return false;
+        for (size_t i = 0; i < count; ++i) {
+            if (streams[i].elementByteLength != lengths[i])
+                return false;
+        }
+        return true;
+    }
+
+    static void weld(const WeldStream *streams, const int *corners,
+                     const size_t cornerCount, WeldTable &table,
+                     WeldOutput &output) {
+        uint8_t key[keyByteLength];
+
+        detail::weldCornersWith(
+            corners, cornerCount, keyByteLength, key, table, output,
+            [streams](const size_t corner, uint8_t *k) {
+                detail::gatherFixed<0, ElementByteLengths...>(streams, corner,
+                                                              k);
+            },
+            [streams](const uint8_t *k) {
+                detail::appendFixed<0, ElementByteLengths...>(streams, k);
+            });
+    }
+};
+
+namespace detail {
+template <typename... Layouts> struct FixedLayoutWelds {
+    static bool weld(const WeldStream *, const size_t, const int *,
+                     const size_t, WeldTable &, WeldOutput &) {
+        return false;
+    }
+};
+
+template <typename Layout, typename... Layouts>
+struct FixedLayoutWelds<Layout, Layouts...> {
+    /** Welds with the first matching layout, returns false if none matches */
+    static bool weld(const WeldStream *streams, const size_t streamCount,
+                     const int *corners, const size_t cornerCount,
+                     WeldTable &table, WeldOutput &output) {
+        if (Layout::matches(streams, streamCount)) {
+            Layout::weld(streams, corners, cornerCount, table, output);
+            return true;
+        }
+        return FixedLayoutWelds<Layouts...>::weld(
+            streams, streamCount, corners, cornerCount, table, output);
+    }
+};
+} // namespace detail
+
+// The element byte lengths of the common vertex layouts, in slot order:
+// positions and normals are 12 bytes, texture coordinates 8, tangents and
+// weights 16, and joints 8 (4 unsigned shorts).
+typedef FixedLayoutWeld<12, 12> PositionNormalWeld;
+typedef FixedLayoutWeld<12, 12, 8> PositionNormalUvWeld;
+typedef FixedLayoutWeld<12, 12, 8, 16> PositionNormalUvTangentWeld;
+typedef FixedLayoutWeld<12, 12, 8, 16, 8> PositionNormalUvSkinWeld;
+typedef FixedLayoutWeld<12, 12, 8, 16, 16, 8> PositionNormalUvTangentSkinWeld;
+
+/**
+ * Welds the corners with the kernel of their layout when it is one of the
+ * common layouts, and with the generic weldCorners otherwise.
+ */
+inline void weldCornersOfLayout(const WeldStream *streams,
+                                const size_t streamCount, const int *corners,
+                                const size_t cornerCount, WeldTable &table,
+                                WeldOutput &output) {
+    typedef detail::FixedLayoutWelds<
+        PositionNormalWeld, PositionNormalUvWeld, PositionNormalUvTangentWeld,
+        PositionNormalUvSkinWeld, PositionNormalUvTangentSkinWeld>
+        CommonLayoutWelds;
+
+    if (!CommonLayoutWelds::weld(streams, streamCount, corners, cornerCount,
+                                 table, output)) {
+        weldCorners(streams, streamCount, corners, cornerCount, table,
+                    output);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Accessor packing
+// ---------------------------------------------------------------------------
+
+/** Where the elements of an accessor are before packing */
+struct ElementSource {
+    const uint8_t *data = nullptr;
+    int byteStride = 0;
+    int elementByteLength = 0;
+    int count = 0;
+};
+
+/** Copies count elements from first on using the given byte stride */
+inline void copyElements(const ElementSource &source, uint8_t *target,
+                         const int byteStride, const int first,
+                         const int count) {
+    const auto elements = source.data + size_t(first) * source.byteStride;
+
+    // The packed accessors have the same component type as the source, so
+    // the elements are copied as is. Most accessors are tightly packed.
+    if (source.byteStride == source.elementByteLength &&
+        byteStride == source.elementByteLength) {
+        std::memcpy(target, elements, size_t(source.elementByteLength) * count);
+        return;
+    }
+
+    for (auto i = 0; i < count; i++) {
+        std::memcpy(target + size_t(i) * byteStride,
+                    elements + size_t(i) * source.byteStride,
+                    source.elementByteLength);
+    }
+}
+
+namespace detail {
+template <typename T, int N>
+void widenBounds(const uint8_t *elements, const int byteStride,
+                 const int count, float *min, float *max) {
+    if (count <= 0)
+        return;
+
+    // The bounds are kept in the component type, so the loop over the
+    // elements only compares.
+    T lo[N], hi[N];
+    std::memcpy(lo, elements, sizeof(lo));
+    std::memcpy(hi, elements, sizeof(hi));
+
+    for (auto i = 1; i < count; i++) {
+        T v[N];
+        std::memcpy(v, elements + size_t(i) * byteStride, sizeof(v));
+        for (auto c = 0; c < N; c++) {
+            lo[c] = v[c] < lo[c] ? v[c] : lo[c];
+            hi[c] = v[c] > hi[c] ? v[c] : hi[c];
+        }
+    }
+
+    for (auto c = 0; c < N; c++) {
+        min[c] = std::min(min[c], float(lo[c]));
+        max[c] = std::max(max[c], float(hi[c]));
+    }
+}
+} // namespace detail
+
+/**
+ * Widens the bounds of the components by count elements of componentCount
+ * components of type T. The packer calls this on the chunks it just copied,
+ * so the elements are still in the cache.
+ */
+template <typename T>
+void widenBounds(const uint8_t *elements, const int byteStride,
+                 const int count, const int componentCount, float *min,
+                 float *max) {
+    switch (componentCount) {
+    case 1:
+        return detail::widenBounds<T, 1>(elements, byteStride, count, min, max);
+    case 2:
+        return detail::widenBounds<T, 2>(elements, byteStride, count, min, max);
+    case 3:
+        return detail::widenBounds<T, 3>(elements, byteStride, count, min, max);
+    case 4:
+        return detail::widenBounds<T, 4>(elements, byteStride, count, min, max);
+    case 16:
+        return detail::widenBounds<T, 16>(elements, byteStride, count, min,
+                                          max);
+    default:
+        break;
+    }
+
+    for (auto i = 0; i < count; i++) {
+        const auto element = elements + size_t(i) * byteStride;
+        for (auto c = 0; c < componentCount; c++) {
+            T v;
+            std::memcpy(&v, element + c * sizeof(T), sizeof(T));
+            min[c] = std::min(min[c], float(v));
+            max[c] = std::max(max[c], float(v));
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tangent generation
+// ---------------------------------------------------------------------------
+
+/**
+ * The triangles of a tangent set, as MikkTSpace reads and writes them.
+ * Each triangle has 3 corners, and each corner has an index in each stream.
+ */
+struct TangentMesh {
+    const int *positionIndices = nullptr;
+    const int *normalIndices = nullptr;
+
+    // A negative index marks a corner without texture coordinates.
+    const int *texcoordIndices = nullptr;
+
+    // Set to the corner index for the corners that get a tangent, a negative
+    // index marks a corner that doesn't need one.
+    int *tangentIndices = nullptr;
+
+    // 3 floats per position and normal, 2 per texture coordinate, with the
+    // v axis pointing down as in glTF.
+    const float *positions = nullptr;
+    const float *normals = nullptr;
+    const float *texcoords = nullptr;
+
+    // Per corner tangentDimension floats, the fourth is the handedness.
+    float *tangentComponents = nullptr;
+    size_t tangentDimension = 4;
+
+    // The triangles to process, or null for the first triangleCount ones.
+    const int *triangles = nullptr;
+    size_t triangleCount = 0;
+
+    // The triangles that got a zero tangent or were reported degenerate.
+    std::vector<int> invalidTriangleIndices;
+
+    int triangleIndex(const int iFace) const {
+        return triangles ? triangles[iFace] : iFace;
+    }
+
+    int cornerIndex(const int iFace, const int iVert) const {
+        return triangleIndex(iFace) * 3 + iVert;
+    }
+};
+
+namespace detail {
+struct TangentContext : SMikkTSpaceContext {
+    TangentMesh &mesh;
+    SMikkTSpaceInterface interface;
+
+    explicit TangentContext(TangentMesh &mesh)
+        : SMikkTSpaceContext{}, mesh(mesh), interface{} {
+        m_pInterface = &interface;
+        m_pUserData = this;
+
+        interface.m_getNumFaces = getNumFaces;
+        interface.m_getNumVerticesOfFace = getNumVerticesOfFace;
+        interface.m_getPosition = getPosition;
+        interface.m_getNormal = getNormal;
+        interface.m_getTexCoord = getTexCoord;
+        interface.m_setTSpaceBasic = setTSpaceBasic;
+        interface.m_reportDegenerateTriangle = reportDegenerateTriangle;
+    }
+
+    static TangentMesh &meshOf(const SMikkTSpaceContext *pContext) {
+        return static_cast<const TangentContext *>(pContext)->mesh;
+    }
+
+    static int getNumFaces(const SMikkTSpaceContext *pContext) {
+        return static_cast<int>(meshOf(pContext).triangleCount);
+    }
+
+    static int getNumVerticesOfFace(const SMikkTSpaceContext *, const int) {
+        return 3;
+    }
+
+    static void getPosition(const SMikkTSpaceContext *pContext,
+                            float fvPosOut[], const int iFace,
+                            const int iVert) {
+        const auto &mesh = meshOf(pContext);
+        const auto index =
+            mesh.positionIndices[mesh.cornerIndex(iFace, iVert)];
+        std::copy_n(mesh.positions + size_t(index) * 3, 3, fvPosOut);
+    }
+
+    static void getNormal(const SMikkTSpaceContext *pContext,
+                          float fvNormOut[], const int iFace,
+                          const int iVert) {
+        const auto &mesh = meshOf(pContext);
+        const auto index = mesh.normalIndices[mesh.cornerIndex(iFace, iVert)];
+        std::copy_n(mesh.normals + size_t(index) * 3, 3, fvNormOut);
+    }
+
+    static void getTexCoord(const SMikkTSpaceContext *pContext,
+                            float fvTexcOut[], const int iFace,
+                            const int iVert) {
+        const auto &mesh = meshOf(pContext);
+        const auto index =
+            mesh.texcoordIndices[mesh.cornerIndex(iFace, iVert)];
+
+        if (index < 0) {
+            fvTexcOut[0] = NAN;
+            fvTexcOut[1] = NAN;
+        } else {
+            const auto *texcoord = mesh.texcoords + size_t(index) * 2;
+            fvTexcOut[0] = texcoord[0];
+            fvTexcOut[1] = 1 - texcoord[1];
+        }
+    }
+
+    static void setTSpaceBasic(const SMikkTSpaceContext *pContext,
+                               const float fvTangent[], const float fSign,
+                               const int iFace, const int iVert) {
+        auto &mesh = meshOf(pContext);
+
+        // Re-index
+        const auto index = mesh.cornerIndex(iFace, iVert);
+        auto &tangentIndexRef = mesh.tangentIndices[index];
+
+        // If the vertex doesn't have a tangent, don't assign one. The
+        // blend shape targets share the indices of the main shape, which
+        // already has these, and are converted concurrently, so these are
+        // only written when they change.
+        if (tangentIndexRef >= 0) {
+            if (tangentIndexRef != index)
+                tangentIndexRef = index;
+
+            if (fvTangent[0] == 0 && fvTangent[1] == 0 && fvTangent[2] == 0) {
+                mesh.invalidTriangleIndices.push_back(
+                    mesh.triangleIndex(iFace));
+            }
+
+            float *p = mesh.tangentComponents + size_t(index) *
+                                                    mesh.tangentDimension;
+            p[0] = fvTangent[0];
+            p[1] = fvTangent[1];
+            p[2] = fvTangent[2];
+
+            if (mesh.tangentDimension > 3) {
+                p[3] = fSign;
+            }
+        }
+    }
+
+    static void reportDegenerateTriangle(const SMikkTSpaceContext *pContext,
+                                         const int triangleIndex) {
+        auto &mesh = meshOf(pContext);
+        mesh.invalidTriangleIndices.push_back(
+            mesh.triangleIndex(triangleIndex));
+    }
+};
+} // namespace detail
+
+/**
+ * Computes the Mikkelsen tangents of the mesh. Meshes that share no
+ * streams can be processed concurrently. Returns false when MikkTSpace
+ * failed.
+ */
+inline bool generateTangents(TangentMesh &mesh,
+                             const double angularThreshold) {
+    detail::TangentContext context(mesh);
+    return genTangSpace(&context, static_cast<float>(angularThreshold)) != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Transforms
+// ---------------------------------------------------------------------------
+
+/** The translation, rotation and scale of a local matrix, see
+ * decomposeTransforms. Not decomposed when mirrored or degenerate. */
+struct DecomposedTransform {
+    double translation[3];
+    // x, y, z, w with w >= 0
+    double rotation[4];
+    double scale[3];
+    // How much the axes deviate from being orthogonal.
+    double nonOrthogonality;
+    bool isDecomposed;
+};
+
+/**
+ * Decomposes count 4x4 matrices, stored like MMatrix: row major, with the
+ * scaled axes in the first three rows, and the translation in the last row.
+ *
+ * The axes are orthogonalized with Gram-Schmidt, like MTransformationMatrix
+ * does, so the shear is dropped. The loop only does plain arithmetic on
+ * the matrices, which is much cheaper than an MTransformationMatrix per
+ * matrix. The matrices with a negative determinant or a zero scale are
+ * left to the caller.
+ */
+inline void decomposeTransforms(const double *matrices, const size_t count,
+                                DecomposedTransform *results) {
+    const double tiny = 1e-12;
+
+    for (size_t index = 0; index < count; ++index) {
+        const double *m = matrices + index * 16;
+        auto &r = results[index];
+
+        double x[3] = {m[0], m[1], m[2]};
+        double y[3] = {m[4], m[5], m[6]};
+        double z[3] = {m[8], m[9], m[10]};
+
+        const auto dot = [](const double *a, const double *b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        };
+
+        const auto det = x[0] * (y[1] * z[2] - y[2] * z[1]) -
+                         x[1] * (y[0] * z[2] - y[2] * z[0]) +
+                         x[2] * (y[0] * z[1] - y[1] * z[0]);
+
+        const auto lx = std::sqrt(dot(x, x));
+        const auto ly = std::sqrt(dot(y, y));
+        const auto lz = std::sqrt(dot(z, z));
+
+        const auto sxy = dot(x, y);
+        const auto syz = dot(y, z);
+        const auto szx = dot(z, x);
+        r.nonOrthogonality =
+            std::max(std::max(std::abs(sxy) / std::max(lx * ly, tiny),
+                              std::abs(syz) / std::max(ly * lz, tiny)),
+                     std::abs(szx) / std::max(lz * lx, tiny));
+
+        // Gram-Schmidt: x keeps its direction, y is made orthogonal to x,
+        // and z to both.
+        const auto sx = lx;
+        const auto ix = 1 / std::max(sx, tiny);
+        for (int i = 0; i < 3; ++i)
+            x[i] *= ix;
+
+        const auto dxy = dot(x, y);
+        for (int i = 0; i < 3; ++i)
+            y[i] -= dxy * x[i];
+        const auto sy = std::sqrt(dot(y, y));
+        const auto iy = 1 / std::max(sy, tiny);
+        for (int i = 0; i < 3; ++i)
+            y[i] *= iy;
+
+        const auto dxz = dot(x, z);
+        const auto dyz = dot(y, z);
+        for (int i = 0; i < 3; ++i)
+            z[i] -= dxz * x[i] + dyz * y[i];
+        const auto sz = std::sqrt(dot(z, z));
+        const auto iz = 1 / std::max(sz, tiny);
+        for (int i = 0; i < 3; ++i)
+            z[i] *= iz;
+
+        // The rows are the rotated axes. These give four times the products
+        // of the quaternion components; the largest square is the most
+        // accurate pivot, like Shepperd's method.
+        const auto ww = 1 + x[0] + y[1] + z[2];
+        const auto xx = 1 + x[0] - y[1] - z[2];
+        const auto yy = 1 - x[0] + y[1] - z[2];
+        const auto zz = 1 - x[0] - y[1] + z[2];
+        const auto wx = y[2] - z[1];
+        const auto wy = z[0] - x[2];
+        const auto wz = x[1] - y[0];
+        const auto xy = x[1] + y[0];
+        const auto xz = z[0] + x[2];
+        const auto yz = y[2] + z[1];
+
+        double q[4];
+        if (ww >= xx && ww >= yy && ww >= zz) {
+            q[0] = wx, q[1] = wy, q[2] = wz, q[3] = ww;
+        } else if (xx >= yy && xx >= zz) {
+            q[0] = xx, q[1] = xy, q[2] = xz, q[3] = wx;
+        } else if (yy >= zz) {
+            q[0] = xy, q[1] = yy, q[2] = yz, q[3] = wy;
+        } else {
+            q[0] = xz, q[1] = yz, q[2] = zz, q[3] = wz;
+        }
+
+        const auto iq = std::copysign(1.0, q[3]) /
+                        std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] +
+                                  q[3] * q[3]);
+        for (int i = 0; i < 4; ++i)
+            r.rotation[i] = q[i] * iq;
+
+        r.translation[0] = m[12];
+        r.translation[1] = m[13];
+        r.translation[2] = m[14];
+
+        r.scale[0] = sx;
+        r.scale[1] = sy;
+        r.scale[2] = sz;
+
+        r.isDecomposed = det > tiny && sx > tiny && sy > tiny && sz > tiny;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Animation samples
+// ---------------------------------------------------------------------------
+
+/**
+ * Negates the quaternion q when -q is closer to the previous sample, so
+ * interpolating between both samples takes the shortest path.
+ */
+inline void alignQuaternion(const float *previous, float *q) {
+    float dp = 0;
+    float dn = 0;
+    for (int i = 0; i < 4; ++i) {
+        dp += (previous[i] - q[i]) * (previous[i] - q[i]);
+        dn += (previous[i] + q[i]) * (previous[i] + q[i]);
+    }
+
+    if (dn < dp) {
+        for (int i = 0; i < 4; ++i) {
+            q[i] = -q[i];
+        }
+    }
+}
+
+/** The largest difference of a component of the sample with the frame.
+ * For quaternions, q and -q are the same rotation. */
+inline float sampleDeviation(const float *frameValues, const float *sample,
+                             const size_t dimension,
+                             const bool isQuaternion) {
+    float deviation = 0;
+    float negatedDeviation = 0;
+    for (size_t axis = 0; axis < dimension; ++axis) {
+        deviation =
+            std::max(deviation, std::abs(sample[axis] - frameValues[axis]));
+        negatedDeviation = std::max(negatedDeviation,
+                                    std::abs(sample[axis] + frameValues[axis]));
+    }
+    return isQuaternion ? std::min(deviation, negatedDeviation) : deviation;
+}
+
+/** Are all frames of the values within the threshold of the base values? */
+inline bool isConstantChannel(const float *values, const size_t valueCount,
+                              const float *baseValues, const size_t dimension,
+                              const double threshold) {
+    for (size_t offset = 0; offset < valueCount; offset += dimension) {
+        for (size_t axis = 0; axis < dimension; ++axis) {
+            if (!(std::abs(baseValues[axis] - values[offset + axis]) <
+                  threshold))
+                return false;
+        }
+    }
+    return true;
+}
+
+/** Which frames hold their value until the next frame, given the deviation
+ * of their step-detection super-samples */
+inline std::vector<bool> stepFrames(const float *deviationPerFrame,
+                                    const size_t frameCount,
+                                    const double threshold) {
+    std::vector<bool> isStep(frameCount);
+    for (size_t frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+        isStep[frameIndex] = deviationPerFrame[frameIndex] < threshold;
+    }
+    return isStep;
+}
+
+// ---------------------------------------------------------------------------
+// Recorded inputs
+// ---------------------------------------------------------------------------
+
+/** The kind of a recorded kernel input, see -recordKernelInputs */
+enum class RecordKind : uint32_t {
+    // The keys of a weld table, the parameter is the key byte length.
+    WELD_KEYS = 1,
+    // The constant threshold, the base values and the samples of an
+    // animation channel, as floats. The parameter is the dimension.
+    CHANNEL_SAMPLES = 2,
+    // As CHANNEL_SAMPLES, for a rotation channel.
+    QUATERNION_SAMPLES = 3,
+};
+
+/** Appends a record: the kind, the parameter, the byte length and bytes */
+inline void writeRecord(std::ostream &stream, const RecordKind kind,
+                        const uint32_t parameter, const void *data,
+                        const size_t byteLength) {
+    const uint32_t header[2] = {static_cast<uint32_t>(kind), parameter};
+    const auto length = static_cast<uint64_t>(byteLength);
+    stream.write(reinterpret_cast<const char *>(header), sizeof(header));
+    stream.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    stream.write(static_cast<const char *>(data), byteLength);
+}
+
+/** Reads the next record, returns false at the end of the stream */
+inline bool readRecord(std::istream &stream, RecordKind &kind,
+                       uint32_t &parameter, std::vector<uint8_t> &bytes) {
+    uint32_t header[2];
+    uint64_t length = 0;
+    if (!stream.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+        !stream.read(reinterpret_cast<char *>(&length), sizeof(length)))
+        return false;
+
+    kind = static_cast<RecordKind>(header[0]);
+    parameter = header[1];
+    bytes.resize(static_cast<size_t>(length));
+    return bool(
+        stream.read(reinterpret_cast<char *>(bytes.data()), bytes.size()));
+}
+
+} // namespace kernels
@@ -307,9 +307,28 @@ inline unsigned CountDecimalDigit32(std::uint32_t n) {
 
 inline void DigitGen(const DiyFp &W, const DiyFp &Mp, std::uint64_t delta,
                      char *buffer, int *len, int *K) {
-    static const std::uint32_t kPow10[] = {
-        1,      10,      100,      1000,      10000,
-        100000, 1000000, 10000000, 100000000, 1000000000};
+    // Up to 10^19, the loop below can produce more than 9 digits after the
+    // decimal point (the fix of RapidJSON for the same overflow).
+    static const std::uint64_t kPow10[] = {1ULL,
+                                           10ULL,
+                                           100ULL,
+                                           1000ULL,
+                                           10000ULL,
+                                           100000ULL,
+                                           1000000ULL,
+                                           10000000ULL,
+                                           100000000ULL,
+                                           1000000000ULL,
+                                           10000000000ULL,
+                                           100000000000ULL,
+                                           1000000000000ULL,
+                                           10000000000000ULL,
+                                           100000000000000ULL,
+                                           1000000000000000ULL,
+                                           10000000000000000ULL,
+                                           100000000000000000ULL,
+                                           1000000000000000000ULL,
+                                           10000000000000000000ULL};
     const DiyFp one(std::uint64_t(1) << -Mp.e, Mp.e);
     const DiyFp wp_w = Mp - W;
     std::uint32_t p1 = static_cast<std::uint32_t>(Mp.f >> -one.e);
@@ -382,8 +401,9 @@ inline void DigitGen(const DiyFp &W, const DiyFp &Mp, std::uint64_t delta,
         kappa--;
         if (p2 < delta) {
             *K += kappa;
+            const int index = -static_cast<int>(kappa);
             GrisuRound(buffer, *len, delta, p2, one.f,
-                       wp_w.f * kPow10[-static_cast<int>(kappa)]);
+                       wp_w.f * (index < 20 ? kPow10[index] : 0));
             return;
         }
     }
@@ -494,7 +514,7 @@ inline char *Prettify(char *buffer, int length, int k, int maxDecimalPlaces) {
 enum { BUFFER_SIZE = 25 };
 
 // Formats value using Grisu2 algorithm.
-char *format_double(char *buffer, double value, int maxDecimalPlaces) {
+inline char *format_double(char *buffer, double value, int maxDecimalPlaces) {
     assert(maxDecimalPlaces >= 1);
 
     if (std::isnan(value)) {
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "TaskScheduler.h"
+#include "progress.h"
+
+/** The number of threads used to run parallel loops, including the calling
+ * thread. */
+inline size_t parallelThreadCount() {
+    static const size_t count =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    return count;
+}
+
+/** The progress of a parallel loop, shared with its tasks, which can start
+ * after the loop returned, when the calling thread did their chunks. */
+struct ParallelLoopState {
+    std::atomic<size_t> nextChunkIndex{0};
+    std::atomic<size_t> doneChunkCount{0};
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
+
+/**
+ * Splits the range [0, count) into contiguous chunks of at least
+ * minChunkSize elements, and calls rangeKernel(begin, end) for each of them.
+ * The chunks are taken by the calling thread and by tasks on the workers of
+ * the TaskScheduler, so the calling thread does all chunks that no worker
+ * took, and loops can be nested. Small ranges don't use any worker at all.
+ *
+ * The kernels must NOT call into the Maya API, which is not thread-safe.
+ * The first exception thrown by a kernel is rethrown on the calling thread.
+ * Cancellation is checked before each chunk, so aborting the export stops
+ * the remaining chunks.
+ */
+template <typename RangeKernel>
+void parallelFor(const size_t count, const size_t minChunkSize,
+                 RangeKernel &&rangeKernel) {
+    const auto maxChunkCount =
+        std::max<size_t>(1, count / std::max<size_t>(1, minChunkSize));
+    const auto chunkCount = std::min(parallelThreadCount(), maxChunkCount);
+
+    if (chunkCount <= 1) {
+        if (count > 0) {
+            uiCheckCancelled();
+            rangeKernel(size_t(0), count);
+        }
+        return;
+    }
+
+    const auto chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    auto *scheduler = &TaskScheduler::instance();
+    const auto state = std::make_shared<ParallelLoopState>();
+    auto *kernel = &rangeKernel;
+
+    // Only touches the kernel for a chunk that is not done yet, so while the
+    // loop didn't return.
+    const auto runChunks = [=]() {
+        for (;;) {
+            const auto chunkIndex = state->nextChunkIndex++;
+            if (chunkIndex >= chunkCount)
+                return;
+
+            const auto begin = chunkIndex * chunkSize;
+            const auto end = std::min(count, begin + chunkSize);
+
+            if (begin < end) {
+                try {
+                    uiCheckCancelled();
+                    (*kernel)(begin, end);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->errorMutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                }
+            }
+
+            if (++state->doneChunkCount == chunkCount) {
+                scheduler->notifyWaiters();
+            }
+        }
+    };
+
+    for (size_t taskIndex = 1; taskIndex < chunkCount; ++taskIndex) {
+        scheduler->submit(runChunks);
+    }
+
+    runChunks();
+
+    scheduler->waitUntil([&] { return state->doneChunkCount == chunkCount; });
+
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+/** Calls elementKernel(index) for each index in [0, count), in parallel. */
+template <typename ElementKernel>
+void parallelForEach(const size_t count, const size_t minChunkSize,
+                     ElementKernel &&elementKernel) {
+    parallelFor(count, minChunkSize,
+                [&](const size_t begin, const size_t end) {
+                    for (auto index = begin; index < end; ++index) {
+                        elementKernel(index);
+                    }
+                });
+}
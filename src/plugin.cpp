@@ -2,7 +2,9 @@
 
 #include "Arguments.h"
 #include "Exporter.h"
+#include "LiveLink.h"
 #include "OutputStreamsPatch.h"
+#include "TaskScheduler.h"
 #include "version.h"
 #include <maya/MFnPlugin.h>
 
@@ -24,5 +26,11 @@ MStatus uninitializePlugin(MObject obj) {
     MFnPlugin plugin(obj);
     status = plugin.deregisterCommand("maya2glTF");
     CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // The timer callbacks and the worker threads must stop before the plugin
+    // is unloaded.
+    Exporter::stopExport();
+    LiveLink::stop();
+    TaskScheduler::shutdown();
     return status;
 }
@@ -1,24 +1,106 @@
 #include "externals.h"
 
-#include "dump.h"
+#include "IndentableStream.h"
 #include "progress.h"
 
+// The progress window is only shown by the interactive UI. Batch and
+// standalone exports, see src/standalone, have no window to update.
+static bool hasProgressUI() {
+    return MGlobal::mayaState() == MGlobal::kInteractive;
+}
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+// The progress window is updated and polled at most this often.
+const auto pollInterval = std::chrono::milliseconds(100);
+
+struct ProgressState {
+    // Only the main thread may call MProgressWindow.
+    std::thread::id mainThreadId;
+    bool hasWindow = false;
+
+    int step = 0;
+    int shownStep = 0;
+    Clock::time_point lastPoll;
+
+    // Set by the main thread, read by the workers.
+    std::atomic<bool> isCancelled{false};
+};
+
+ProgressState progress;
+
+// Updates the window and polls for cancellation, at most every
+// pollInterval. Returns true when cancelled.
+bool pollProgressWindow(const std::string *stepName) {
+    if (!progress.hasWindow)
+        return false;
+
+    const auto now = Clock::now();
+    if (now - progress.lastPoll < pollInterval)
+        return progress.isCancelled;
+
+    progress.lastPoll = now;
+
+    if (progress.shownStep != progress.step) {
+        progress.shownStep = progress.step;
+        MProgressWindow::setProgress(progress.step);
+    }
+
+    if (stepName) {
+        MProgressWindow::setProgressStatus(
+            MString(("maya2glTF: " + *stepName + "...").c_str()));
+    }
+
+    if (MProgressWindow::isCancelled()) {
+        cout << prefix << "Aborting" << endl;
+        progress.isCancelled = true;
+    }
+
+    return progress.isCancelled;
+}
+} // namespace
+
 void uiSetupProgress(size_t stepCount) {
-    MGlobal::executeCommand(
-        formatted("maya2glTF_exportProgressUI(%d);", stepCount).c_str());
+    progress.mainThreadId = std::this_thread::get_id();
+    progress.step = 0;
+    progress.shownStep = 0;
+    progress.lastPoll = Clock::time_point();
+    progress.isCancelled = false;
+    progress.hasWindow = hasProgressUI() && MProgressWindow::reserve();
+
+    if (!progress.hasWindow)
+        return;
+
+    MProgressWindow::setTitle("maya2glTF");
+    MProgressWindow::setInterruptable(true);
+    MProgressWindow::setProgressRange(
+        0, std::max(1, static_cast<int>(stepCount)));
+    MProgressWindow::setProgressStatus("maya2glTF: exporting...");
+    MProgressWindow::startProgress();
 }
 
 void uiAdvanceProgress(const std::string &stepName) {
-    int result = 0;
-    MGlobal::executeCommand(
-        formatted("maya2glTF_advanceExportProgressUI(\"%s\");",
-                  stepName.c_str())
-            .c_str(),
-        result);
-    if (result < 0)
+    ++progress.step;
+
+    if (pollProgressWindow(&stepName))
+        throw std::runtime_error("Aborted!");
+}
+
+void uiCheckCancelled() {
+    const auto isMainThread =
+        std::this_thread::get_id() == progress.mainThreadId;
+    const auto isCancelled = isMainThread ? pollProgressWindow(nullptr)
+                                          : progress.isCancelled.load();
+    if (isCancelled)
         throw std::runtime_error("Aborted!");
 }
 
 void uiTeardownProgress() {
-    MGlobal::executeCommand("maya2glTF_teardownProgressUI();");
+    if (!progress.hasWindow)
+        return;
+
+    progress.hasWindow = false;
+    progress.isCancelled = false;
+    MProgressWindow::endProgress();
 }
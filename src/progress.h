@@ -2,9 +2,16 @@
 
 extern void uiSetupProgress(size_t stepCount);
 
-/** Throws an exception when abortion is requested */
+/** Throws an exception when abortion is requested. Only updates the progress
+ * window a few times per second, so can be called for each step */
 extern void uiAdvanceProgress(const std::string &stepName);
 
+/** Throws an exception when abortion is requested. Cheap enough to call in
+ * long loops, also from the worker threads: only the main thread polls the
+ * progress window, a few times per second, the workers read the flag it
+ * sets. */
+extern void uiCheckCancelled();
+
 extern void uiTeardownProgress();
 
 /** Progress is advanced each `checkProgressFrameInterval` frames when exporting
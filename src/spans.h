@@ -1,5 +1,7 @@
 #pragma once
 
+#include "fasthash.h"
+
 template <typename T>
 static gsl::span<const T> span(const std::vector<T> &vec) {
     return gsl::make_span(vec);
@@ -47,12 +49,13 @@ static gsl::span<T> mutable_span(const gsl::span<const T> &span) {
     return gsl::make_span(const_cast<T *>(bgn_ptr), const_cast<T *>(end_ptr));
 }
 
+template <typename T> static std::size_t hash_bytes(const gsl::span<T> &span) {
+    return static_cast<std::size_t>(
+        fasthash::hashBytes(span.data(), span.size() * sizeof(T)));
+}
+
 static std::size_t hash_value(const gsl::span<const uint16_t> &span) {
-    std::size_t seed = span.size();
-    for (const size_t i : span) {
-        seed ^= i + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    }
-    return seed;
+    return hash_bytes(span);
 }
 
 template <typename T>
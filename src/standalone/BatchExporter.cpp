@@ -0,0 +1,531 @@
+// Standalone batch exporter, for exporting many scenes on a machine or a
+// render farm without the Maya UI.
+//
+// The exporter runs in its own process on top of MLibrary. It opens the scenes
+// of a job manifest or a scene list, one at a time, and exports each with the
+// same arguments as the maya2glTF command. The jobs can be divided over
+// multiple worker processes, and the status of each job is written to a
+// results file. See the "Batch export" section of the Readme.
+//
+// This file is not part of the plug-in, it is built as maya2glTF_batch.
+
+#include "externals.h"
+
+#include "Arguments.h"
+#include "Exporter.h"
+#include "IndentableStream.h"
+#include "MayaException.h"
+#include "TaskScheduler.h"
+#include "filesystem.h"
+
+#include <maya/MLibrary.h>
+
+static const char *usage = R"(Usage:
+  maya2glTF_batch (-manifest <file> | -scenes <file>) [options]
+
+  -manifest <file>      a JSON job manifest with the scenes and their arguments
+  -scenes <file>        a text file with a scene path per line
+  -arguments <string>   the maya2glTF arguments of all jobs
+  -outputFolder <path>  the root folder, each job exports to a sub folder with the name of its scene
+  -workers <count>      the number of worker processes to run in parallel, 1 by default
+  -results <file>       the JSON file to write the status per job to, batch_results.json by default
+  -worker <index> <count>
+                        only run the jobs of this worker, e.g. on one machine of a farm
+)";
+
+const char *const jobSucceeded = "succeeded";
+const char *const jobFailed = "failed";
+const char *const jobCrashed = "crashed";
+
+struct BatchJob {
+    std::string scene;
+    std::string arguments;
+    std::string outputFolder;
+
+    // When not empty, the playback range is exported as a clip with this name.
+    std::string playbackClip;
+};
+
+struct JobResult {
+    size_t jobIndex = 0;
+    std::string status;
+    std::string message;
+    double seconds = 0;
+};
+
+struct BatchOptions {
+    std::string manifestPath;
+    std::string scenesPath;
+    std::string arguments;
+    std::string outputFolder;
+    std::string resultsPath = "batch_results.json";
+    int workerCount = 1;
+
+    // When workerIndex >= 0, this process runs the jobs of one worker.
+    int workerIndex = -1;
+    int workerTotal = 1;
+
+    // Skip the jobs that already have a result in the results file.
+    bool resume = false;
+
+    // The original arguments, forwarded to the worker processes.
+    std::vector<std::string> forwarded;
+};
+
+static std::string readText(const fs::path &path) {
+    std::ifstream file(path.string(), ios::in | ios::binary);
+    if (!file)
+        throw std::runtime_error(formatted("Failed to open '%s'", path.string().c_str()));
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+static std::string jsonString(const rapidjson::Value &object, const char *name) {
+    const auto member = object.FindMember(name);
+    return member != object.MemberEnd() && member->value.IsString() ? member->value.GetString() : "";
+}
+
+/** Relative scene paths in a manifest are relative to the manifest */
+static std::string resolvedPath(const fs::path &folder, const std::string &path) {
+    const fs::path scenePath(path);
+    return scenePath.is_relative() ? (folder / scenePath).string() : path;
+}
+
+static std::vector<BatchJob> readManifest(const std::string &manifestPath, BatchOptions &options) {
+    rapidjson::Document document;
+    if (document.Parse(readText(manifestPath).c_str()).HasParseError() || !document.IsObject())
+        throw std::runtime_error(formatted("Invalid job manifest '%s'", manifestPath.c_str()));
+
+    const auto folder = fs::path(manifestPath).parent_path();
+
+    // The options on the command line take precedence.
+    if (options.arguments.empty()) {
+        options.arguments = jsonString(document, "arguments");
+    }
+
+    if (options.outputFolder.empty()) {
+        options.outputFolder = jsonString(document, "outputFolder");
+    }
+
+    std::vector<BatchJob> jobs;
+
+    const auto jsonJobs = document.FindMember("jobs");
+    if (jsonJobs == document.MemberEnd() || !jsonJobs->value.IsArray())
+        throw std::runtime_error(formatted("The job manifest '%s' has no jobs array", manifestPath.c_str()));
+
+    for (auto &&jsonJob : jsonJobs->value.GetArray()) {
+        BatchJob job;
+
+        if (jsonJob.IsString()) {
+            job.scene = jsonJob.GetString();
+        } else if (jsonJob.IsObject()) {
+            job.scene = jsonString(jsonJob, "scene");
+            job.arguments = jsonString(jsonJob, "arguments");
+            job.outputFolder = jsonString(jsonJob, "outputFolder");
+            job.playbackClip = jsonString(jsonJob, "playbackClip");
+        }
+
+        if (job.scene.empty())
+            throw std::runtime_error(formatted("Job #%d of '%s' has no scene", int(jobs.size()), manifestPath.c_str()));
+
+        job.scene = resolvedPath(folder, job.scene);
+        jobs.emplace_back(std::move(job));
+    }
+
+    return jobs;
+}
+
+static std::vector<BatchJob> readSceneList(const std::string &scenesPath) {
+    std::vector<BatchJob> jobs;
+    std::istringstream lines(readText(scenesPath));
+    std::string line;
+
+    while (std::getline(lines, line)) {
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        line.erase(0, line.find_first_not_of(" \t"));
+
+        // Skip empty lines and comments.
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        BatchJob job;
+        job.scene = line;
+        jobs.emplace_back(std::move(job));
+    }
+
+    return jobs;
+}
+
+/** Splits the arguments at white space, except within double quotes */
+static void appendArguments(MArgList &argList, const std::string &arguments) {
+    std::string token;
+    bool isQuoted = false;
+    bool hasToken = false;
+
+    for (const auto c : arguments) {
+        if (c == '"') {
+            isQuoted = !isQuoted;
+            hasToken = true;
+        } else if (std::isspace(static_cast<unsigned char>(c)) && !isQuoted) {
+            if (hasToken) {
+                argList.addArg(MString(token.c_str()));
+                token.clear();
+                hasToken = false;
+            }
+        } else {
+            token += c;
+            hasToken = true;
+        }
+    }
+
+    if (hasToken) {
+        argList.addArg(MString(token.c_str()));
+    }
+}
+
+static std::string outputFolderOf(const BatchJob &job, const BatchOptions &options) {
+    if (!job.outputFolder.empty())
+        return job.outputFolder;
+
+    if (options.outputFolder.empty())
+        return "";
+
+    return (fs::path(options.outputFolder) / fs::path(job.scene).stem()).string();
+}
+
+static void runJob(const BatchJob &job, const BatchOptions &options) {
+    cout << prefix << "Opening " << job.scene << endl;
+
+    const auto openStatus = MFileIO::open(job.scene.c_str(), nullptr, true);
+    if (openStatus.error()) {
+        // A scene that needs missing plug-ins (like Arnold) can still be exported,
+        // the export fails by itself if the scene wasn't opened.
+        MayaException::printWarning(formatted("Some errors occurred while opening '%s'", job.scene.c_str()), openStatus);
+    }
+
+    // Like the MEL batch scripts, all visible meshes are exported.
+    THROW_ON_FAILURE_WITH(MGlobal::executeCommand("select -r `ls -v -type mesh -ap`"), "Failed to select the meshes");
+
+    MArgList argList;
+    appendArguments(argList, options.arguments);
+    appendArguments(argList, job.arguments);
+
+    const auto outputFolder = outputFolderOf(job, options);
+    if (!outputFolder.empty()) {
+        argList.addArg("-outputFolder");
+        argList.addArg(outputFolder.c_str());
+    }
+
+    if (!job.playbackClip.empty()) {
+        argList.addArg("-animationClipName");
+        argList.addArg(job.playbackClip.c_str());
+        argList.addArg("-animationClipStartTime");
+        argList.addArg(MAnimControl::minTime().as(MTime::uiUnit()));
+        argList.addArg("-animationClipEndTime");
+        argList.addArg(MAnimControl::maxTime().as(MTime::uiUnit()));
+        argList.addArg("-animationClipFrameRate");
+        argList.addArg(MTime(1, MTime::kSeconds).as(MTime::uiUnit()));
+    }
+
+    const Arguments arguments(argList, SyntaxFactory::createSyntax());
+    Exporter::exportScene(arguments);
+}
+
+static rapidjson::Value jsonResult(const JobResult &result, const BatchJob &job, rapidjson::Document::AllocatorType &allocator) {
+    rapidjson::Value jsonResult(rapidjson::kObjectType);
+    jsonResult.AddMember("job", static_cast<uint64_t>(result.jobIndex), allocator);
+    jsonResult.AddMember("scene", rapidjson::Value(job.scene.c_str(), allocator), allocator);
+    jsonResult.AddMember("status", rapidjson::Value(result.status.c_str(), allocator), allocator);
+    jsonResult.AddMember("seconds", result.seconds, allocator);
+
+    if (!result.message.empty()) {
+        jsonResult.AddMember("message", rapidjson::Value(result.message.c_str(), allocator), allocator);
+    }
+
+    return jsonResult;
+}
+
+static void writeResults(const std::string &path, const std::vector<JobResult> &results, const std::vector<BatchJob> &jobs) {
+    rapidjson::Document document(rapidjson::kObjectType);
+    auto &allocator = document.GetAllocator();
+
+    size_t failedCount = 0;
+    rapidjson::Value jsonResults(rapidjson::kArrayType);
+
+    for (auto &&result : results) {
+        failedCount += result.status != jobSucceeded;
+        jsonResults.PushBack(jsonResult(result, jobs.at(result.jobIndex), allocator), allocator);
+    }
+
+    document.AddMember("jobCount", static_cast<uint64_t>(jobs.size()), allocator);
+    document.AddMember("failedCount", static_cast<uint64_t>(failedCount), allocator);
+    document.AddMember("results", jsonResults, allocator);
+
+    // Written next to the final file first, so a crash never leaves half a file.
+    const auto temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, ios::out | ios::trunc);
+        rapidjson::OStreamWrapper streamWrapper(file);
+        rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(streamWrapper);
+        document.Accept(writer);
+
+        if (!file)
+            throw std::runtime_error(formatted("Failed to write the results '%s'", temporaryPath.c_str()));
+    }
+
+    fs::rename(temporaryPath, path);
+}
+
+static std::vector<JobResult> readResults(const std::string &path) {
+    std::vector<JobResult> results;
+
+    if (!fs::exists(path))
+        return results;
+
+    rapidjson::Document document;
+    if (document.Parse(readText(path).c_str()).HasParseError() || !document.IsObject() || !document.HasMember("results"))
+        return results;
+
+    for (auto &&jsonResult : document["results"].GetArray()) {
+        JobResult result;
+        result.jobIndex = jsonResult["job"].GetUint64();
+        result.status = jsonString(jsonResult, "status");
+        result.message = jsonString(jsonResult, "message");
+        result.seconds = jsonResult["seconds"].GetDouble();
+        results.emplace_back(std::move(result));
+    }
+
+    return results;
+}
+
+static bool isJobOfWorker(const size_t jobIndex, const BatchOptions &options) {
+    return options.workerIndex < 0 || int(jobIndex % options.workerTotal) == options.workerIndex;
+}
+
+/** Runs the jobs of this worker in this process, returns the number of failed jobs */
+static int runWorker(const std::vector<BatchJob> &jobs, const BatchOptions &options) {
+    auto results = options.resume ? readResults(options.resultsPath) : std::vector<JobResult>();
+
+    std::unordered_set<size_t> finishedJobs;
+    for (auto &&result : results) {
+        finishedJobs.insert(result.jobIndex);
+    }
+
+    int failedCount = 0;
+
+    for (size_t jobIndex = 0; jobIndex < jobs.size(); ++jobIndex) {
+        if (!isJobOfWorker(jobIndex, options) || finishedJobs.count(jobIndex))
+            continue;
+
+        JobResult result;
+        result.jobIndex = jobIndex;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        try {
+            runJob(jobs[jobIndex], options);
+            result.status = jobSucceeded;
+        } catch (const MayaException &ex) {
+            MayaException::printError(ex.what(), ex.status);
+            result.status = jobFailed;
+            result.message = ex.what();
+        } catch (const std::exception &ex) {
+            MayaException::printError(ex.what());
+            result.status = jobFailed;
+            result.message = ex.what();
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        failedCount += result.status != jobSucceeded;
+
+        cout << prefix << "Job #" << jobIndex << " " << result.status << " in " << result.seconds << " seconds" << endl;
+
+        // Written after each job, for the coordinator to see how far a crashed worker got.
+        results.emplace_back(std::move(result));
+        writeResults(options.resultsPath, results, jobs);
+    }
+
+    return failedCount;
+}
+
+static std::string quoted(const std::string &argument) {
+    std::string result = "\"";
+    for (const auto c : argument) {
+        if (c == '"') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+/** Runs the worker processes, and merges their results, returns the number of failed jobs */
+static int runCoordinator(const std::string &executablePath, const std::vector<BatchJob> &jobs, const BatchOptions &options) {
+    const auto workerCount = std::max(1, std::min(options.workerCount, static_cast<int>(jobs.size())));
+
+    const auto workerResultsPath = [&](const int workerIndex) { return formatted("%s.worker%d", options.resultsPath.c_str(), workerIndex); };
+
+    std::vector<std::thread> threads;
+
+    for (auto workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        threads.emplace_back([&, workerIndex] {
+            const auto resultsPath = workerResultsPath(workerIndex);
+            fs::remove(resultsPath);
+
+            std::string command = quoted(executablePath);
+            for (auto &&argument : options.forwarded) {
+                command += " " + quoted(argument);
+            }
+            command += formatted(" -worker %d %d -resume -results ", workerIndex, workerCount) + quoted(resultsPath);
+
+#ifdef _MSC_VER
+            // cmd.exe strips the outer quotes of a command starting with a quote.
+            command = "\"" + command + "\"";
+#endif
+
+            for (;;) {
+                const auto exitCode = std::system(command.c_str());
+
+                // A worker that crashed is restarted after the job it was running.
+                auto results = readResults(resultsPath);
+
+                std::unordered_set<size_t> finishedJobs;
+                for (auto &&result : results) {
+                    finishedJobs.insert(result.jobIndex);
+                }
+
+                size_t crashedJob = jobs.size();
+                for (size_t jobIndex = workerIndex; jobIndex < jobs.size(); jobIndex += workerCount) {
+                    if (!finishedJobs.count(jobIndex)) {
+                        crashedJob = jobIndex;
+                        break;
+                    }
+                }
+
+                if (crashedJob == jobs.size())
+                    break;
+
+                JobResult result;
+                result.jobIndex = crashedJob;
+                result.status = jobCrashed;
+                result.message = formatted("The worker process exited with code %d", exitCode);
+                results.emplace_back(std::move(result));
+                writeResults(resultsPath, results, jobs);
+            }
+        });
+    }
+
+    for (auto &&thread : threads) {
+        thread.join();
+    }
+
+    std::vector<JobResult> results;
+    for (auto workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        const auto resultsPath = workerResultsPath(workerIndex);
+        const auto workerResults = readResults(resultsPath);
+        results.insert(results.end(), workerResults.begin(), workerResults.end());
+        fs::remove(resultsPath);
+    }
+
+    std::sort(results.begin(), results.end(), [](const JobResult &a, const JobResult &b) { return a.jobIndex < b.jobIndex; });
+    writeResults(options.resultsPath, results, jobs);
+
+    return static_cast<int>(std::count_if(results.begin(), results.end(), [](const JobResult &r) { return r.status != jobSucceeded; }));
+}
+
+static BatchOptions parseOptions(const int argc, char *argv[]) {
+    BatchOptions options;
+
+    for (auto i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value of " + option);
+            return argv[++i];
+        };
+
+        if (option == "-manifest") {
+            options.manifestPath = value();
+        } else if (option == "-scenes") {
+            options.scenesPath = value();
+        } else if (option == "-arguments") {
+            options.arguments = value();
+        } else if (option == "-outputFolder") {
+            options.outputFolder = value();
+        } else if (option == "-workers") {
+            options.workerCount = std::stoi(value());
+            continue;
+        } else if (option == "-results") {
+            options.resultsPath = value();
+            continue;
+        } else if (option == "-worker") {
+            options.workerIndex = std::stoi(value());
+            options.workerTotal = std::stoi(value());
+            continue;
+        } else if (option == "-resume") {
+            options.resume = true;
+            continue;
+        } else {
+            throw std::runtime_error("Unknown option " + option);
+        }
+
+        // The job options are passed on to the workers.
+        options.forwarded.push_back(option);
+        options.forwarded.push_back(argv[i]);
+    }
+
+    if (options.manifestPath.empty() == options.scenesPath.empty())
+        throw std::runtime_error("Either -manifest or -scenes is needed");
+
+    if (options.workerIndex >= options.workerTotal || options.workerTotal < 1)
+        throw std::runtime_error("Invalid -worker index and count");
+
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    BatchOptions options;
+    std::vector<BatchJob> jobs;
+
+    try {
+        options = parseOptions(argc, argv);
+        jobs = options.manifestPath.empty() ? readSceneList(options.scenesPath) : readManifest(options.manifestPath, options);
+    } catch (const std::exception &ex) {
+        cerr << ex.what() << endl << endl << usage;
+        return 2;
+    }
+
+    cout << prefix << jobs.size() << " jobs" << endl;
+
+    // The coordinator only starts processes, it doesn't need Maya.
+    if (options.workerCount > 1 && options.workerIndex < 0) {
+        const auto failedCount = runCoordinator(argv[0], jobs, options);
+        cout << prefix << failedCount << " of " << jobs.size() << " jobs failed, see " << options.resultsPath << endl;
+        return failedCount > 0 ? 1 : 0;
+    }
+
+    const auto status = MLibrary::initialize(true, argv[0], true);
+    if (!status) {
+        status.perror("MLibrary::initialize");
+        return 2;
+    }
+
+    int failedCount = 0;
+
+    try {
+        failedCount = runWorker(jobs, options);
+    } catch (const std::exception &ex) {
+        cerr << prefix << ex.what() << endl;
+        failedCount = 1;
+    }
+
+    // The worker threads must stop before Maya is cleaned up.
+    TaskScheduler::shutdown();
+
+    const auto exitCode = failedCount > 0 ? 1 : 0;
+    MLibrary::cleanup(exitCode, false);
+    return exitCode;
+}
@@ -11,3 +11,27 @@ inline void setCurrentTime(const MTime time, const bool shouldRedraw) {
         M3dView::active3dView().refresh(true, true);
     }
 }
+
+/** While in scope, plugs are evaluated at the given time, without changing
+ * the current time of the scene. Before Maya 2018, plugs can't be evaluated
+ * in a context implicitly, so the current time is changed instead. */
+class ScopedEvaluationTime {
+  public:
+#if MAYA_API_VERSION >= 20180000
+    explicit ScopedEvaluationTime(const MTime &time)
+        : m_context(time), m_guard(m_context) {}
+#else
+    explicit ScopedEvaluationTime(const MTime &time) {
+        setCurrentTime(time, false);
+    }
+#endif
+
+  private:
+    ScopedEvaluationTime(const ScopedEvaluationTime &) = delete;
+    ScopedEvaluationTime &operator=(const ScopedEvaluationTime &) = delete;
+
+#if MAYA_API_VERSION >= 20180000
+    MDGContext m_context;
+    MDGContextGuard m_guard;
+#endif
+};
@@ -0,0 +1,158 @@
+// Prints a binary dump of -dumpMaya -dumpMayaBinary as the text dump, see
+// src/dumpRecords.h. With --summary, each table is printed as its length and
+// the range of its values, to get an overview of a production-size asset.
+//
+// This tool does not depend on Maya; build and run it with CMake
+//
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --config Release
+//   build/DumpViewer [--summary] dump.bin
+//
+// or directly with e.g.
+//
+//   g++ -O2 -std=c++14 -I../../src DumpViewer.cpp -o DumpViewer
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "dumpRecords.h"
+
+namespace {
+/** The length and range of the values of a table record */
+bool appendTableSummary(std::string &indented,
+                        const std::vector<uint8_t> &record) {
+    dumps::TableHeader header;
+    if (record.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, record.data(), sizeof(header));
+
+    const auto type = static_cast<dumps::ValueType>(header.valueType);
+    const auto valueOffset = sizeof(header) + header.nameLength;
+    const auto valueLength = dumps::valueByteLength(type);
+    if (valueOffset > record.size() ||
+        (record.size() - valueOffset) / valueLength < header.count)
+        return false;
+
+    const std::string name(
+        reinterpret_cast<const char *>(record.data()) + sizeof(header),
+        header.nameLength);
+    const auto count = static_cast<size_t>(header.count);
+
+    double range[2] = {0, 0};
+    for (size_t index = 0; index < count; ++index) {
+        const auto *bytes = record.data() + valueOffset + index * valueLength;
+
+        double value = 0;
+        switch (type) {
+        case dumps::ValueType::FLOAT32: {
+            float v;
+            std::memcpy(&v, bytes, sizeof(v));
+            value = v;
+        } break;
+        case dumps::ValueType::FLOAT64:
+            std::memcpy(&value, bytes, sizeof(value));
+            break;
+        case dumps::ValueType::INT32: {
+            int32_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            value = v;
+        } break;
+        case dumps::ValueType::UINT16: {
+            uint16_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            value = v;
+        } break;
+        case dumps::ValueType::UINT32: {
+            uint32_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            value = v;
+        } break;
+        default:
+            return false;
+        }
+
+        range[0] = index ? std::min(range[0], value) : value;
+        range[1] = index ? std::max(range[1], value) : value;
+    }
+
+    char rangeText[2][fmt::BUFFER_SIZE + 1];
+    for (int i = 0; i < 2; ++i) {
+        *fmt::format_double(rangeText[i], range[i], 6) = 0;
+    }
+
+    std::string text = "\"" + name + "\": [ /* " + std::to_string(count) +
+                       " values";
+    if (count) {
+        text += std::string(", ") + rangeText[0] + " to " + rangeText[1];
+    }
+    text += " */ ]";
+
+    bool shouldIndent = header.startsLine != 0;
+    dumps::appendIndented(indented, text.data(), text.size(),
+                          static_cast<int>(header.indentationLevel),
+                          shouldIndent);
+    return true;
+}
+} // namespace
+
+int main(const int argc, const char *argv[]) {
+    bool isSummary = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--summary") {
+            isSummary = true;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!path) {
+        fprintf(stderr, "Usage: DumpViewer [--summary] dump.bin\n");
+        return 1;
+    }
+
+    std::ifstream stream(path, std::ios::binary);
+    char magic[sizeof(dumps::fileMagic)];
+    if (!stream.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, dumps::fileMagic, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s is not a binary dump of -dumpMayaBinary\n", path);
+        return 1;
+    }
+
+    dumps::RecordKind kind;
+    std::vector<uint8_t> record;
+    std::string text;
+
+    while (dumps::readRecord(stream, kind, record)) {
+        text.clear();
+
+        switch (kind) {
+        case dumps::RecordKind::TEXT:
+            text.assign(record.begin(), record.end());
+            break;
+        case dumps::RecordKind::TABLE:
+            if (!(isSummary ? appendTableSummary(text, record)
+                            : dumps::appendTableText(text, record))) {
+                fprintf(stderr, "Invalid table record in %s\n", path);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Unknown record kind %u in %s\n",
+                    static_cast<unsigned>(kind), path);
+            return 1;
+        }
+
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+
+    // Reading the first bytes of the next record failed.
+    if (stream.gcount() != 0) {
+        fprintf(stderr, "Truncated record in %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
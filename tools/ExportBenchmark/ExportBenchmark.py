@@ -0,0 +1,326 @@
+# Headless benchmark of the maya2glTF exporter.
+#
+# Exports a fixed corpus of scenes under several argument profiles, and
+# writes the wall time, the per-phase timings of -profileReport, the output
+# sizes of -statisticsReport and the peak memory held by the exporter to a
+# results file. When a baseline results file is given, the results are
+# compared with it, and the script fails when a measurement regressed more
+# than its tolerance.
+#
+# The corpus is the maya/scenes folder, plus stress scenes generated by this
+# script: a dense mesh, a mesh with many blend shapes, a deep skinned
+# skeleton, long clips and many textures.
+#
+# Run it with the Python interpreter of Maya, after building the plug-in:
+#
+#   mayapy ExportBenchmark.py --output C:/temp/bench
+#   mayapy ExportBenchmark.py --output C:/temp/bench --baseline C:/temp/bench-1.0/results.json
+#
+# Use --help for the other options. Measure on an otherwise idle machine,
+# the timings of a single repeat vary a lot; the fastest repeat is kept.
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import random
+import shutil
+import sys
+import time
+
+import maya.standalone
+
+maya.standalone.initialize(name='python')
+
+import maya.cmds as cmds
+import maya.mel as mel
+
+repoDir = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+
+# The arguments of each profile, appended to the export command.
+profiles = {
+    'default': '',
+    'glb': '-glb',
+    'compressed': '-glb -meshQuantization -meshoptCompression -quantizeAnimation -keyframeReduction',
+    'draco': '-glb -dracoCompression',
+    'parallel': '-asyncWriteThreads 4 -prefetchImageThreads 4 -meshPipelineDepth 4',
+}
+
+# The relative increase of a measurement that is reported as a regression.
+defaultTolerances = {
+    'milliseconds': 0.15,
+    'bytes': 0.01,
+    'heldBytes': 0.10,
+}
+
+# Timings below this many milliseconds are too noisy to compare.
+minimumComparedMilliseconds = 20
+
+
+def melString(value):
+    return '"%s"' % value.replace('\\', '/').replace('"', '\\"')
+
+
+def newScene():
+    cmds.file(new=True, force=True)
+    cmds.playbackOptions(minTime=1, maxTime=1)
+
+
+def keyRandomly(node, attributes, frameCount, step, amplitude):
+    for frame in range(1, frameCount + 1, step):
+        for attribute in attributes:
+            cmds.setKeyframe(node, attribute=attribute, time=frame, value=random.uniform(-amplitude, amplitude))
+
+
+def createDenseMesh():
+    cmds.polySphere(name='dense', subdivisionsAxis=500, subdivisionsHeight=500)
+
+
+def createManyBlendShapes():
+    base = cmds.polyPlane(name='base', subdivisionsWidth=64, subdivisionsHeight=64)[0]
+    vertexCount = cmds.polyEvaluate(base, vertex=True)
+
+    targets = []
+    for targetIndex in range(64):
+        target = cmds.duplicate(base, name='target%d' % targetIndex)[0]
+        for vertexIndex in random.sample(range(vertexCount), vertexCount // 8):
+            cmds.move(0, random.uniform(-0.2, 0.2), 0, '%s.vtx[%d]' % (target, vertexIndex), relative=True)
+        targets.append(target)
+
+    blendShape = cmds.blendShape(targets + [base], name='shapes')[0]
+    cmds.delete(targets)
+
+    frameCount = 120
+    for targetIndex in range(len(targets)):
+        keyRandomly(blendShape, ['w[%d]' % targetIndex], frameCount, 10, 1)
+
+    cmds.playbackOptions(minTime=1, maxTime=frameCount)
+
+
+def createDeepSkeleton():
+    jointCount = 200
+    height = 100.0
+
+    cmds.select(clear=True)
+    joints = [cmds.joint(position=(0, height * i / jointCount, 0)) for i in range(jointCount)]
+
+    mesh = cmds.polyCylinder(name='tail', height=height, subdivisionsHeight=jointCount * 2, subdivisionsAxis=16)[0]
+    cmds.move(0, height / 2, 0, mesh)
+    cmds.skinCluster(joints[0], mesh, maximumInfluences=4)
+
+    frameCount = 240
+    for joint in joints[1:]:
+        keyRandomly(joint, ['rotateX', 'rotateZ'], frameCount, 4, 10)
+
+    cmds.playbackOptions(minTime=1, maxTime=frameCount)
+
+
+def createLongClips():
+    frameCount = 3000
+    for cubeIndex in range(50):
+        cube = cmds.polyCube(name='cube%d' % cubeIndex)[0]
+        keyRandomly(cube, ['translateX', 'translateY', 'translateZ', 'rotateY', 'scaleX'], frameCount, 25, 5)
+
+    cmds.playbackOptions(minTime=1, maxTime=frameCount)
+
+
+def createManyTextures(textureFolder):
+    imagesDir = os.path.join(repoDir, 'maya', 'images')
+    images = sorted(f for f in os.listdir(imagesDir) if f.lower().endswith(('.png', '.jpg')))
+
+    if not os.path.isdir(textureFolder):
+        os.makedirs(textureFolder)
+
+    for index in range(64):
+        # Distinct files, so the exporter can't share the images.
+        source = images[index % len(images)]
+        texturePath = os.path.join(textureFolder, 'texture%d%s' % (index, os.path.splitext(source)[1]))
+        shutil.copyfile(os.path.join(imagesDir, source), texturePath)
+
+        plane = cmds.polyPlane(name='plane%d' % index)[0]
+        cmds.move(index % 8, 0, index // 8, plane)
+
+        material = cmds.shadingNode('lambert', asShader=True, name='material%d' % index)
+        shadingGroup = cmds.sets(renderable=True, noSurfaceShader=True, empty=True, name='material%dSG' % index)
+        cmds.connectAttr(material + '.outColor', shadingGroup + '.surfaceShader')
+
+        fileNode = cmds.shadingNode('file', asTexture=True, name='file%d' % index)
+        cmds.setAttr(fileNode + '.fileTextureName', texturePath, type='string')
+        cmds.connectAttr(fileNode + '.outColor', material + '.color')
+
+        cmds.sets(plane, edit=True, forceElement=shadingGroup)
+
+
+def stressScenes(outputFolder):
+    folder = os.path.join(outputFolder, 'stress')
+    return [
+        ('stress/DenseMesh', createDenseMesh),
+        ('stress/ManyBlendShapes', createManyBlendShapes),
+        ('stress/DeepSkeleton', createDeepSkeleton),
+        ('stress/LongClips', createLongClips),
+        ('stress/ManyTextures', lambda: createManyTextures(os.path.join(folder, 'textures'))),
+    ]
+
+
+def openScene(path):
+    try:
+        cmds.file(path, open=True, force=True, ignoreVersion=True, prompt=False)
+    except RuntimeError:
+        # Missing optional plug-ins, like Arnold, are not fatal.
+        print('Some errors occurred while loading %s' % path)
+
+
+def exportScene(name, profileArgs, exportFolder):
+    if os.path.isdir(exportFolder):
+        shutil.rmtree(exportFolder)
+    os.makedirs(exportFolder)
+
+    command = 'maya2glTF -outputFolder %s -sceneName "scene" -profileReport "profile.json" -statisticsReport "statistics.json"' % melString(
+        exportFolder)
+
+    startTime = cmds.playbackOptions(query=True, minTime=True)
+    endTime = cmds.playbackOptions(query=True, maxTime=True)
+
+    if endTime > startTime:
+        command += ' -acn "clip" -ast %f -aet %f -afr %f' % (startTime, endTime, mel.eval('currentTimeUnitToFPS'))
+
+    command += ' ' + profileArgs
+
+    begin = time.time()
+    mel.eval(command)
+    milliseconds = (time.time() - begin) * 1000
+
+    with open(os.path.join(exportFolder, 'profile.json')) as file:
+        profile = json.load(file)
+
+    with open(os.path.join(exportFolder, 'statistics.json')) as file:
+        statistics = json.load(file)
+
+    outputBytes = 0
+    for folder, _, filenames in os.walk(exportFolder):
+        for filename in filenames:
+            if filename not in ('profile.json', 'statistics.json'):
+                outputBytes += os.path.getsize(os.path.join(folder, filename))
+
+    return {
+        'milliseconds': milliseconds,
+        'phaseMilliseconds': dict((phase, summary['milliseconds']) for phase, summary in profile['phases'].items()),
+        'heldBytes': profile['memory']['peakTotalHeldBytes'],
+        'bytes': outputBytes,
+        'totals': statistics['totals'],
+    }
+
+
+def runScene(name, createOrOpen, args, results):
+    for profileName in args.profiles:
+        best = None
+
+        for repeat in range(args.repeat):
+            # Reloaded for each run, so all runs start from the same state.
+            createOrOpen()
+
+            exportFolder = os.path.join(args.output, 'exports', name, profileName)
+
+            try:
+                result = exportScene(name, profiles[profileName], exportFolder)
+            except Exception as error:
+                print('*** Exporting %s with profile %s failed: %s' % (name, profileName, error))
+                break
+
+            if best is None or result['milliseconds'] < best['milliseconds']:
+                best = result
+
+        if best:
+            key = '%s|%s' % (name, profileName)
+            results[key] = best
+            print('%-50s %10.0f ms %12d bytes %12d held bytes' % (key, best['milliseconds'], best['bytes'], best['heldBytes']))
+
+
+def compare(results, baseline, tolerances):
+    regressions = []
+
+    def check(key, measurement, value, baseValue):
+        if baseValue <= 0:
+            return
+        if measurement == 'milliseconds' and value < minimumComparedMilliseconds:
+            return
+        increase = (value - baseValue) / float(baseValue)
+        if increase > tolerances[measurement]:
+            regressions.append('%s %s: %.0f -> %.0f (+%.0f%%)' % (key, measurement, baseValue, value, increase * 100))
+
+    for key, result in sorted(results.items()):
+        base = baseline.get(key)
+        if not base:
+            print('%s is not in the baseline' % key)
+            continue
+
+        for measurement in ('milliseconds', 'bytes', 'heldBytes'):
+            check(key, measurement, result[measurement], base[measurement])
+
+        for phase, milliseconds in sorted(result['phaseMilliseconds'].items()):
+            baseMilliseconds = base['phaseMilliseconds'].get(phase, 0)
+            check('%s %s' % (key, phase), 'milliseconds', milliseconds, baseMilliseconds)
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmarks the maya2glTF exporter')
+    parser.add_argument('--output', required=True, help='the folder to export to, and to write results.json to')
+    parser.add_argument('--baseline', help='a results.json file to compare with')
+    parser.add_argument('--plugin', default='maya2glTF', help='the name or path of the plug-in to load')
+    parser.add_argument('--scenes', default=os.path.join(repoDir, 'maya', 'scenes'), help='the folder with the scenes to export')
+    parser.add_argument('--profiles', nargs='+', default=sorted(profiles.keys()), choices=sorted(profiles.keys()))
+    parser.add_argument('--repeat', type=int, default=3, help='the number of exports per scene and profile, the fastest is kept')
+    parser.add_argument('--skipStress', action='store_true', help="don't export the generated stress scenes")
+    parser.add_argument('--seed', type=int, default=1, help='the random seed of the stress scenes')
+    for measurement, tolerance in sorted(defaultTolerances.items()):
+        parser.add_argument('--%sTolerance' % measurement, type=float, default=tolerance,
+                            help='the relative increase of the %s that is a regression' % measurement)
+    args = parser.parse_args()
+
+    cmds.loadPlugin(args.plugin, quiet=True)
+
+    results = {}
+
+    sceneFilenames = sorted(f for f in os.listdir(args.scenes) if f.endswith(('.ma', '.mb')))
+    for sceneFilename in sceneFilenames:
+        path = os.path.join(args.scenes, sceneFilename)
+        runScene(os.path.splitext(sceneFilename)[0], lambda: openScene(path), args, results)
+
+    if not args.skipStress:
+        for name, create in stressScenes(args.output):
+            def createScene():
+                # The same scene for every run.
+                random.seed(args.seed)
+                newScene()
+                create()
+
+            runScene(name, createScene, args, results)
+
+    resultsPath = os.path.join(args.output, 'results.json')
+    with open(resultsPath, 'w') as file:
+        json.dump(results, file, indent=2, sort_keys=True)
+    print('Wrote %s' % resultsPath)
+
+    if not args.baseline:
+        return 0
+
+    with open(args.baseline) as file:
+        baseline = json.load(file)
+
+    tolerances = dict((measurement, getattr(args, '%sTolerance' % measurement)) for measurement in defaultTolerances)
+    regressions = compare(results, baseline, tolerances)
+
+    for regression in regressions:
+        print('REGRESSION: %s' % regression)
+
+    print('%d regressions compared with %s' % (len(regressions), args.baseline))
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    exitCode = main()
+    maya.standalone.uninitialize()
+    sys.exit(exitCode)
@@ -0,0 +1,152 @@
+// Microbenchmark comparing the word-at-a-time vertex key hash in
+// src/fasthash.h with the byte-wise and short-wise combiners it replaced.
+//
+// The keys mimic the welding keys built by MeshRenderables: per corner the
+// concatenated bytes of position, normal, uv and optionally tangent, color and
+// skinning attributes, taken from a subdivided grid so that most keys occur
+// several times, like shared vertices do in a real mesh.
+//
+// This tool does not depend on Maya; build and run it with e.g.
+//
+//   g++ -O2 -std=c++14 -I../../src HashBenchmark.cpp -o HashBenchmark
+//   cl /O2 /EHsc /I..\..\src HashBenchmark.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "fasthash.h"
+
+namespace {
+typedef unsigned char byte;
+
+size_t legacyByteHash(const byte *data, const size_t length) {
+    size_t seed = 0x26DFB62C;
+    for (size_t i = 0; i < length; ++i) {
+        seed ^= (seed << 6) + (seed >> 2) + 0x3C2E6B88 +
+                static_cast<size_t>(data[i]);
+    }
+    return seed;
+}
+
+size_t legacyShortHash(const byte *data, const size_t length) {
+    const size_t count = length / 2;
+    size_t seed = count;
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t s;
+        memcpy(&s, data + i * 2, 2);
+        seed ^= s + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+size_t fastHash(const byte *data, const size_t length) {
+    return static_cast<size_t>(fasthash::hashBytes(data, length));
+}
+
+struct KeyLayout {
+    const char *name;
+    size_t floatCount;
+};
+
+// Builds the keys of a grid of gridSize x gridSize quads, 6 corners per quad.
+std::vector<byte> makeKeys(const KeyLayout &layout, const size_t gridSize) {
+    std::vector<byte> keys;
+    std::vector<float> key(layout.floatCount);
+
+    const int cornerX[6] = {0, 1, 1, 0, 1, 0};
+    const int cornerY[6] = {0, 0, 1, 0, 1, 1};
+
+    for (size_t y = 0; y < gridSize; ++y) {
+        for (size_t x = 0; x < gridSize; ++x) {
+            for (int c = 0; c < 6; ++c) {
+                const float u = float(x + cornerX[c]) / gridSize;
+                const float v = float(y + cornerY[c]) / gridSize;
+                for (size_t i = 0; i < layout.floatCount; ++i) {
+                    // position, normal, uv, ... all derived from the grid
+                    // coordinates, with a few constant components.
+                    switch (i % 4) {
+                    case 0:
+                        key[i] = u * (1 + i);
+                        break;
+                    case 1:
+                        key[i] = v * (1 + i);
+                        break;
+                    case 2:
+                        key[i] = 0;
+                        break;
+                    default:
+                        key[i] = 1;
+                        break;
+                    }
+                }
+                const byte *bytes = reinterpret_cast<const byte *>(key.data());
+                keys.insert(keys.end(), bytes,
+                            bytes + key.size() * sizeof(float));
+            }
+        }
+    }
+
+    return keys;
+}
+
+template <typename Hasher>
+void run(const char *hasherName, Hasher hasher, const std::vector<byte> &keys,
+         const size_t keyLength) {
+    const size_t keyCount = keys.size() / keyLength;
+    const int repeats = 20;
+
+    size_t checksum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (size_t i = 0; i < keyCount; ++i) {
+            checksum += hasher(&keys[i * keyLength], keyLength);
+        }
+    }
+    const auto stop = std::chrono::steady_clock::now();
+
+    // Bucket quality: distinct keys vs distinct low bits, as a hash table
+    // with a power of two capacity sees them.
+    std::unordered_set<size_t> slots;
+    const size_t mask = (1u << 16) - 1;
+    for (size_t i = 0; i < keyCount; ++i) {
+        slots.insert(hasher(&keys[i * keyLength], keyLength) & mask);
+    }
+
+    const double seconds = std::chrono::duration<double>(stop - start).count();
+    const double nsPerKey = seconds * 1e9 / (double(keyCount) * repeats);
+    const double gbPerSecond =
+        double(keys.size()) * repeats / seconds / (1024.0 * 1024 * 1024);
+
+    printf("  %-8s %7.2f ns/key %7.2f GiB/s  %6zu/%zu low-16 slots used "
+           "(checksum %zx)\n",
+           hasherName, nsPerKey, gbPerSecond, slots.size(),
+           std::min<size_t>(mask + 1, keyCount), checksum);
+}
+} // namespace
+
+int main() {
+    const KeyLayout layouts[] = {
+        {"position", 3},
+        {"position+normal+uv", 8},
+        {"position+normal+uv+tangent", 12},
+        {"position+normal+uv+tangent+color+skin", 24},
+    };
+
+    const size_t gridSize = 256;
+
+    for (const auto &layout : layouts) {
+        const size_t keyLength = layout.floatCount * sizeof(float);
+        const auto keys = makeKeys(layout, gridSize);
+        printf("%s (%zu bytes per key, %zu keys)\n", layout.name, keyLength,
+               keys.size() / keyLength);
+        run("byte", legacyByteHash, keys, keyLength);
+        run("short", legacyShortHash, keys, keyLength);
+        run("fast", fastHash, keys, keyLength);
+    }
+
+    return 0;
+}
@@ -0,0 +1,547 @@
+// Microbenchmark of the Maya independent kernels in src/kernels.h: vertex
+// key hashing, gathering and welding, accessor packing, MikkTSpace tangents,
+// quaternion alignment, the constant and step detection of animation
+// channels, and the decomposition of the local transforms.
+//
+// Without arguments, the kernels are fed with synthetic data: the corners of
+// a subdivided grid for the mesh kernels, and random walks for the animation
+// kernels. Given the files recorded by exports with -recordKernelInputs, the
+// welding and animation kernels replay these instead.
+//
+// This tool does not depend on Maya; build and run it with CMake
+//
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build --config Release
+//   build/KernelBenchmark [recording...]
+//
+// or directly with e.g.
+//
+//   gcc -O2 -c ../../src/mikktspace.c -o mikktspace.o
+//   g++ -O2 -std=c++14 -I../../src KernelBenchmark.cpp mikktspace.o -o KernelBenchmark
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "kernels.h"
+
+namespace {
+typedef unsigned char byte;
+
+// Each measurement runs for at least this long, the fastest run is reported.
+const double minimumSeconds = 0.2;
+const int runCount = 5;
+
+size_t checksum = 0;
+
+/** Prints the nanoseconds per item of the fastest run of the kernel */
+template <typename Kernel>
+void measure(const char *name, const size_t itemCount, const char *itemName,
+             Kernel kernel) {
+    double bestSeconds = 0;
+    size_t repeats = 1;
+
+    for (int run = 0; run < runCount; ++run) {
+        double seconds = 0;
+        for (;;) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < repeats; ++r) {
+                checksum += kernel();
+            }
+            const auto stop = std::chrono::steady_clock::now();
+            seconds = std::chrono::duration<double>(stop - start).count();
+
+            // Find the repeat count of a long enough run first.
+            if (run > 0 || seconds >= minimumSeconds)
+                break;
+            repeats *= 2;
+        }
+
+        seconds /= repeats;
+        if (run == 0 || seconds < bestSeconds) {
+            bestSeconds = seconds;
+        }
+    }
+
+    printf("  %-40s %10.2f ns/%s %10.3f ms\n", name,
+           bestSeconds * 1e9 / double(itemCount), itemName,
+           bestSeconds * 1e3);
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic data
+// ---------------------------------------------------------------------------
+
+// The corners of the two triangles of a grid quad.
+const int cornerX[6] = {0, 1, 1, 0, 1, 0};
+const int cornerY[6] = {0, 0, 1, 0, 1, 1};
+
+/** The vertex keys of the corners of a grid of gridSize x gridSize quads,
+ * so most keys occur several times, like shared vertices in a real mesh */
+std::vector<byte> gridKeys(const size_t floatCount, const size_t gridSize) {
+    std::vector<byte> keys;
+    std::vector<float> key(floatCount);
+
+    for (size_t y = 0; y < gridSize; ++y) {
+        for (size_t x = 0; x < gridSize; ++x) {
+            for (int c = 0; c < 6; ++c) {
+                const float u = float(x + cornerX[c]) / gridSize;
+                const float v = float(y + cornerY[c]) / gridSize;
+                for (size_t i = 0; i < floatCount; ++i) {
+                    key[i] = i % 4 == 0 ? u * (1 + i)
+                                        : i % 4 == 1 ? v * (1 + i)
+                                                     : i % 4 == 2 ? 0 : 1;
+                }
+                const byte *bytes = reinterpret_cast<const byte *>(key.data());
+                keys.insert(keys.end(), bytes,
+                            bytes + key.size() * sizeof(float));
+            }
+        }
+    }
+
+    return keys;
+}
+
+/** A grid mesh with shared positions, normals and texture coordinates */
+struct GridMesh {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<int> cornerIndices;
+    size_t triangleCount = 0;
+
+    explicit GridMesh(const size_t gridSize) {
+        const auto rowLength = gridSize + 1;
+        for (size_t y = 0; y <= gridSize; ++y) {
+            for (size_t x = 0; x <= gridSize; ++x) {
+                const float u = float(x) / gridSize;
+                const float v = float(y) / gridSize;
+                positions.insert(positions.end(),
+                                 {u, v, 0.1f * std::sin(u * 20)});
+                normals.insert(normals.end(), {0, 0, 1});
+                texcoords.insert(texcoords.end(), {u, v});
+            }
+        }
+
+        for (size_t y = 0; y < gridSize; ++y) {
+            for (size_t x = 0; x < gridSize; ++x) {
+                for (int c = 0; c < 6; ++c) {
+                    cornerIndices.push_back(static_cast<int>(
+                        (y + cornerY[c]) * rowLength + x + cornerX[c]));
+                }
+            }
+        }
+
+        triangleCount = cornerIndices.size() / 3;
+    }
+};
+
+/** A random walk of unit quaternions, with random signs as Maya returns them */
+std::vector<float> quaternionWalk(const size_t frameCount,
+                                  std::mt19937 &random) {
+    std::normal_distribution<float> step(0, 0.05f);
+    std::bernoulli_distribution flip(0.3);
+
+    std::vector<float> values;
+    float q[4] = {0, 0, 0, 1};
+
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+        float length = 0;
+        for (auto &c : q) {
+            c += step(random);
+            length += c * c;
+        }
+
+        const auto sign = flip(random) ? -1 : 1;
+        for (auto &c : q) {
+            c /= std::sqrt(length);
+            values.push_back(sign * c);
+        }
+    }
+
+    return values;
+}
+
+// ---------------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------------
+
+void benchmarkWelding(const char *name, const std::vector<byte> &keys,
+                      const size_t keyLength) {
+    const auto keyCount = keys.size() / keyLength;
+
+    measure(name, keyCount, "key", [&] {
+        kernels::WeldTable table;
+        bool isNew;
+        for (size_t i = 0; i < keyCount; ++i) {
+            const auto key = &keys[i * keyLength];
+            table.findOrInsert(key, keyLength,
+                               kernels::hashVertexKey(key, keyLength), isNew);
+        }
+        return table.size();
+    });
+}
+
+void benchmarkHashing(const char *name, const std::vector<byte> &keys,
+                      const size_t keyLength) {
+    const auto keyCount = keys.size() / keyLength;
+
+    measure(name, keyCount, "key", [&] {
+        size_t sum = 0;
+        for (size_t i = 0; i < keyCount; ++i) {
+            sum += kernels::hashVertexKey(&keys[i * keyLength], keyLength);
+        }
+        return sum;
+    });
+}
+
+void benchmarkSyntheticMeshes() {
+    printf("Vertex keys of a 512x512 grid\n");
+
+    const struct {
+        const char *name;
+        size_t floatCount;
+    } layouts[] = {
+        {"position", 3},
+        {"position+normal+uv", 8},
+        {"position+normal+uv+tangent", 12},
+        {"position+normal+uv+tangent+color+skin", 24},
+    };
+
+    for (const auto &layout : layouts) {
+        const auto keyLength = layout.floatCount * sizeof(float);
+        const auto keys = gridKeys(layout.floatCount, 512);
+        printf(" %s\n", layout.name);
+        benchmarkHashing("hash", keys, keyLength);
+        benchmarkWelding("weld", keys, keyLength);
+    }
+
+    printf("Accessor packing of 1M vertices\n");
+
+    const int vertexCount = 1 << 20;
+    std::vector<byte> positions(size_t(vertexCount) * 12, 1);
+    std::vector<byte> normals(size_t(vertexCount) * 12, 2);
+    std::vector<byte> texcoords(size_t(vertexCount) * 8, 3);
+    std::vector<byte> target(size_t(vertexCount) * 32);
+
+    kernels::ElementSource sources[3];
+    const std::vector<byte> *streams[3] = {&positions, &normals, &texcoords};
+    const int offsets[3] = {0, 12, 24};
+    for (int i = 0; i < 3; ++i) {
+        sources[i].data = streams[i]->data();
+        sources[i].elementByteLength = int(streams[i]->size() / vertexCount);
+        sources[i].byteStride = sources[i].elementByteLength;
+        sources[i].count = vertexCount;
+    }
+
+    measure("tightly packed", vertexCount, "vertex", [&] {
+        size_t byteOffset = 0;
+        for (auto &source : sources) {
+            kernels::copyElements(source, target.data() + byteOffset,
+                                  source.elementByteLength, 0, source.count);
+            byteOffset += size_t(source.elementByteLength) * source.count;
+        }
+        return size_t(target[byteOffset / 2]);
+    });
+
+    measure("interleaved", vertexCount, "vertex", [&] {
+        for (int i = 0; i < 3; ++i) {
+            kernels::copyElements(sources[i], target.data() + offsets[i], 32,
+                                  0, sources[i].count);
+        }
+        return size_t(target[vertexCount]);
+    });
+
+    measure("tightly packed with bounds", vertexCount, "vertex", [&] {
+        float min[3] = {1e30f, 1e30f, 1e30f};
+        float max[3] = {-1e30f, -1e30f, -1e30f};
+        const auto &source = sources[0];
+        for (int first = 0; first < source.count; first += 4096) {
+            const auto n = std::min(4096, source.count - first);
+            auto *chunk = target.data() + size_t(first) * 12;
+            kernels::copyElements(source, chunk, 12, first, n);
+            kernels::widenBounds<float>(chunk, 12, n, 3, min, max);
+        }
+        return size_t(target[vertexCount]) + size_t(max[0] - min[0]);
+    });
+
+    printf("Gather and weld of a 128x128 grid\n");
+
+    const GridMesh weldGrid(128);
+    const auto cornerCount = weldGrid.cornerIndices.size();
+    std::vector<int> corners(cornerCount);
+    for (size_t i = 0; i < cornerCount; ++i) {
+        corners[i] = static_cast<int>(i);
+    }
+
+    const std::vector<float> *weldStreams[3] = {
+        &weldGrid.positions, &weldGrid.normals, &weldGrid.texcoords};
+    const size_t weldDimensions[3] = {3, 3, 2};
+
+    const auto benchmarkGatherAndWeld = [&](const char *name,
+                                            const bool isFixedLayout) {
+        measure(name, cornerCount, "corner", [&] {
+            std::vector<byte> targets[3];
+            kernels::WeldStream streams[3];
+            for (int i = 0; i < 3; ++i) {
+                streams[i].indices = weldGrid.cornerIndices.data();
+                streams[i].elements =
+                    reinterpret_cast<const byte *>(weldStreams[i]->data());
+                streams[i].elementByteLength =
+                    weldDimensions[i] * sizeof(float);
+                streams[i].target = &targets[i];
+            }
+
+            kernels::WeldTable table;
+            std::vector<int> vertexIndices;
+            vertexIndices.reserve(cornerCount);
+            kernels::WeldOutput output(vertexIndices);
+
+            if (isFixedLayout) {
+                kernels::PositionNormalUvWeld::weld(
+                    streams, corners.data(), cornerCount, table, output);
+            } else {
+                kernels::weldCorners(streams, 3, corners.data(), cornerCount,
+                                     table, output);
+            }
+            return table.size() + output.weldCount;
+        });
+    };
+
+    benchmarkGatherAndWeld("generic layout", false);
+    benchmarkGatherAndWeld("position+normal+uv layout", true);
+
+    printf("MikkTSpace tangents of a 256x256 grid\n");
+
+    const GridMesh grid(256);
+    std::vector<float> tangentComponents(grid.cornerIndices.size() * 4);
+    std::vector<int> tangentIndices(grid.cornerIndices.size());
+
+    measure("tangents", grid.triangleCount, "triangle", [&] {
+        kernels::TangentMesh mesh;
+        mesh.positionIndices = grid.cornerIndices.data();
+        mesh.normalIndices = grid.cornerIndices.data();
+        mesh.texcoordIndices = grid.cornerIndices.data();
+        mesh.tangentIndices = tangentIndices.data();
+        mesh.positions = grid.positions.data();
+        mesh.normals = grid.normals.data();
+        mesh.texcoords = grid.texcoords.data();
+        mesh.tangentComponents = tangentComponents.data();
+        mesh.triangleCount = grid.triangleCount;
+        return size_t(kernels::generateTangents(mesh, 180));
+    });
+}
+
+void benchmarkAlignment(const char *name, const std::vector<float> &samples) {
+    const auto frameCount = samples.size() / 4;
+    std::vector<float> aligned(samples.size());
+
+    measure(name, frameCount, "frame", [&] {
+        std::copy(samples.begin(), samples.end(), aligned.begin());
+        for (size_t frame = 1; frame < frameCount; ++frame) {
+            kernels::alignQuaternion(&aligned[(frame - 1) * 4],
+                                     &aligned[frame * 4]);
+        }
+        return size_t(aligned.back() > 0);
+    });
+}
+
+void benchmarkConstantDetection(const char *name,
+                                const std::vector<float> &samples,
+                                const float *baseValues,
+                                const size_t dimension,
+                                const double threshold) {
+    measure(name, samples.size() / dimension, "frame", [&] {
+        return size_t(kernels::isConstantChannel(
+            samples.data(), samples.size(), baseValues, dimension, threshold));
+    });
+}
+
+void benchmarkSyntheticAnimation() {
+    printf("Animation channels of 100K frames\n");
+
+    const size_t frameCount = 100000;
+    std::mt19937 random(1);
+
+    benchmarkAlignment("quaternion alignment", quaternionWalk(frameCount, random));
+
+    // A channel that stays constant is scanned completely.
+    const float baseValues[3] = {1, 2, 3};
+    std::vector<float> constantSamples;
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+        constantSamples.insert(constantSamples.end(), baseValues,
+                               baseValues + 3);
+    }
+    benchmarkConstantDetection("constant detection", constantSamples,
+                               baseValues, 3, 1e-5);
+
+    // 4 step-detection super-samples per frame, as with -detectStepAnimations.
+    const size_t superSampleCount = 4;
+    const auto samples = quaternionWalk(frameCount * superSampleCount, random);
+    std::vector<float> deviations(frameCount);
+
+    measure("step detection", frameCount, "frame", [&] {
+        for (size_t frame = 0; frame < frameCount; ++frame) {
+            const auto *frameValues = &samples[frame * superSampleCount * 4];
+            float deviation = 0;
+            for (size_t s = 1; s < superSampleCount; ++s) {
+                deviation = std::max(
+                    deviation, kernels::sampleDeviation(
+                                   frameValues, frameValues + s * 4, 4, true));
+            }
+            deviations[frame] = deviation;
+        }
+        const auto isStep =
+            kernels::stepFrames(deviations.data(), frameCount, 1e-5);
+        return size_t(std::count(isStep.begin(), isStep.end(), true));
+    });
+
+    // The local matrices of a frame of a rig with 1000 joints.
+    const size_t jointCount = 1000;
+    const auto rotations = quaternionWalk(jointCount, random);
+    std::uniform_real_distribution<double> scales(0.5, 2);
+    std::vector<double> matrices(jointCount * 16);
+    for (size_t joint = 0; joint < jointCount; ++joint) {
+        double q[4];
+        for (int i = 0; i < 4; ++i)
+            q[i] = rotations[joint * 4 + i];
+
+        const double s[3] = {scales(random), scales(random), scales(random)};
+        const double x = q[0], y = q[1], z = q[2], w = q[3];
+        const double rows[3][3] = {
+            {1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w)},
+            {2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w)},
+            {2 * (x * z + y * w), 2 * (y * z - x * w),
+             1 - 2 * (x * x + y * y)}};
+
+        double *m = &matrices[joint * 16];
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 3; ++column)
+                m[row * 4 + column] = s[row] * rows[row][column];
+            m[row * 4 + 3] = 0;
+        }
+        m[12] = double(joint);
+        m[13] = 1;
+        m[14] = 2;
+        m[15] = 1;
+    }
+
+    std::vector<kernels::DecomposedTransform> decomposed(jointCount);
+    measure("transform decomposition", jointCount, "matrix", [&] {
+        kernels::decomposeTransforms(matrices.data(), jointCount,
+                                     decomposed.data());
+        return size_t(decomposed[jointCount / 2].rotation[3] * 1000);
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Recorded data
+// ---------------------------------------------------------------------------
+
+bool replayRecording(const char *path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    // The records of a kind are concatenated, to measure these at once.
+    std::vector<std::vector<byte>> keysPerLength(256);
+    std::vector<float> quaternions;
+    std::vector<std::vector<float>> channels;
+    std::vector<uint32_t> channelDimensions;
+    size_t sampleCount = 0;
+
+    kernels::RecordKind kind;
+    uint32_t parameter;
+    std::vector<byte> bytes;
+
+    printf("Recording %s\n", path);
+
+    while (kernels::readRecord(stream, kind, parameter, bytes)) {
+        switch (kind) {
+        case kernels::RecordKind::WELD_KEYS:
+            if (parameter > 0 && parameter < keysPerLength.size()) {
+                auto &keys = keysPerLength[parameter];
+                keys.insert(keys.end(), bytes.begin(), bytes.end());
+            }
+            break;
+        case kernels::RecordKind::QUATERNION_SAMPLES:
+        case kernels::RecordKind::CHANNEL_SAMPLES: {
+            std::vector<float> values(bytes.size() / sizeof(float));
+            std::memcpy(values.data(), bytes.data(),
+                        values.size() * sizeof(float));
+
+            if (kind == kernels::RecordKind::QUATERNION_SAMPLES &&
+                parameter == 4) {
+                quaternions.insert(quaternions.end(), values.begin() + 5,
+                                   values.end());
+            }
+
+            sampleCount += (values.size() - 1 - parameter) / parameter;
+            channels.emplace_back(std::move(values));
+            channelDimensions.push_back(parameter);
+            break;
+        }
+        default:
+            fprintf(stderr, "Unknown record kind %u\n", unsigned(kind));
+            return false;
+        }
+    }
+
+    for (size_t keyLength = 1; keyLength < keysPerLength.size(); ++keyLength) {
+        const auto &keys = keysPerLength[keyLength];
+        if (keys.empty())
+            continue;
+
+        // A single table per key length, the plugin has one per mesh.
+        printf(" %zu recorded keys of %zu bytes\n", keys.size() / keyLength,
+               keyLength);
+        benchmarkHashing("hash", keys, keyLength);
+        benchmarkWelding("weld", keys, keyLength);
+    }
+
+    if (!quaternions.empty()) {
+        printf(" %zu recorded rotation frames\n", quaternions.size() / 4);
+        benchmarkAlignment("quaternion alignment", quaternions);
+    }
+
+    if (!channels.empty()) {
+        printf(" %zu recorded channels, %zu frames\n", channels.size(),
+               sampleCount);
+        measure("constant detection", sampleCount, "frame", [&] {
+            size_t constantCount = 0;
+            for (size_t i = 0; i < channels.size(); ++i) {
+                const auto &values = channels[i];
+                const auto dimension = channelDimensions[i];
+                const auto threshold = values[0];
+                const auto *baseValues = &values[1];
+                const auto offset = 1 + dimension;
+                constantCount += kernels::isConstantChannel(
+                    values.data() + offset, values.size() - offset,
+                    baseValues, dimension, threshold);
+            }
+            return constantCount;
+        });
+    }
+
+    return true;
+}
+} // namespace
+
+int main(const int argc, const char *argv[]) {
+    if (argc <= 1) {
+        benchmarkSyntheticMeshes();
+        benchmarkSyntheticAnimation();
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!replayRecording(argv[i]))
+            return 1;
+    }
+
+    printf("(checksum %zx)\n", checksum);
+    return 0;
+}